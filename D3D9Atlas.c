@@ -0,0 +1,550 @@
+#include "D3D9Atlas.h"
+
+// ---------- Debugging -------------
+#define __DEBUG_OBJECT__ "D3D9Atlas"
+#include "dbg/dbg.h"
+
+// Private headers
+/*
+ * Description : Create a new empty page
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * Return : D3D9AtlasPage * an allocated page, or NULL on error
+ */
+static D3D9AtlasPage * D3D9Atlas_create_page (D3D9Atlas *this, IDirect3DDevice9 * pDevice);
+
+/*
+ * Description : Move the images of a page so the space of the removed images can be reused
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9AtlasPage *page : A page to repack
+ * Return : void
+ */
+static void D3D9Atlas_repack (D3D9Atlas *this, D3D9AtlasPage *page);
+
+/*
+ * Description : Release the texture and the memory of a page
+ * D3D9AtlasPage *page : An allocated page without regions
+ * Return : void
+ */
+static void D3D9AtlasPage_free (D3D9AtlasPage *page);
+
+/*
+ * Description : Find a place for an image in the existing pages
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9Image *image : A decoded image accepted by the atlas
+ * int *x, int *y : Output position of the padded image
+ * Return : D3D9AtlasPage * the page containing the image, or NULL if none has enough space
+ */
+static D3D9AtlasPage * D3D9Atlas_find_page (D3D9Atlas *this, D3D9Image *image, int *x, int *y);
+
+/*
+ * Description : Find the page whose removed images left the most space, if it is enough for a rectangle
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * long long area : Area of the padded image to pack
+ * Return : D3D9AtlasPage * the page to repack, or NULL if no repack can make room for the image
+ */
+static D3D9AtlasPage * D3D9Atlas_find_fragmented (D3D9Atlas *this, long long area);
+
+/*
+ * Description : Write the pixels of an image and extend its edges into the padding around it
+ * D3DLOCKED_RECT *locked : The padded rect of the image, locked
+ * D3D9Image *image : A decoded image
+ * Return : void
+ */
+static void D3D9Atlas_write_image (D3DLOCKED_RECT *locked, D3D9Image *image);
+
+/*
+ * Description : Sort the regions by decreasing height, as expected by the skyline packer
+ * const void *a, const void *b : Pointers to D3D9AtlasRegion pointers
+ * Return : int the comparison result
+ */
+static int D3D9AtlasRegion_compare_height (const void *a, const void *b);
+
+
+/*
+ * Description : Allocate a new D3D9Atlas structure.
+ * int pageSize : Width and height of the atlas textures
+ * int maxSpriteSize : Images with a side larger than this aren't packed
+ * Return : A pointer to an allocated D3D9Atlas.
+ */
+D3D9Atlas *
+D3D9Atlas_new (
+	int pageSize,
+	int maxSpriteSize
+) {
+	D3D9Atlas *this;
+
+	if ((this = calloc (1, sizeof(D3D9Atlas))) == NULL)
+		return NULL;
+
+	if (!D3D9Atlas_init (this, pageSize, maxSpriteSize)) {
+		D3D9Atlas_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9Atlas structure.
+ * D3D9Atlas *this : An allocated D3D9Atlas to initialize.
+ * int pageSize : Width and height of the atlas textures
+ * int maxSpriteSize : Images with a side larger than this aren't packed
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Atlas_init (
+	D3D9Atlas *this,
+	int pageSize,
+	int maxSpriteSize
+) {
+	this->pages = (BbQueue) bb_queue_local_decl ();
+	this->pageSize = pageSize;
+	this->maxSpriteSize = maxSpriteSize;
+	this->repacked = false;
+
+	return D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+}
+
+/*
+ * Description : Check if an image can be packed into the atlas
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9Image *image : A decoded image
+ * Return : bool true if the image is small enough and decoded in system memory
+ */
+bool
+D3D9Atlas_accepts (
+	D3D9Atlas *this,
+	D3D9Image *image
+) {
+	return (image->pixels != NULL
+		&&  image->w > 0 && image->h > 0
+		&&  image->w <= this->maxSpriteSize
+		&&  image->h <= this->maxSpriteSize);
+}
+
+/*
+ * Description : Create a new empty page
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * Return : D3D9AtlasPage * an allocated page, or NULL on error
+ */
+static D3D9AtlasPage *
+D3D9Atlas_create_page (
+	D3D9Atlas *this,
+	IDirect3DDevice9 * pDevice
+) {
+	D3D9AtlasPage *page;
+
+	if ((page = calloc (1, sizeof(D3D9AtlasPage))) == NULL) {
+		return NULL;
+	}
+
+	if (!D3D9AtlasPacker_init (&page->packer, this->pageSize, this->pageSize)) {
+		free (page);
+		return NULL;
+	}
+
+	if (pDevice->lpVtbl->CreateTexture (pDevice, this->pageSize, this->pageSize, 1, 0,
+		D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &page->texture, NULL) != D3D_OK) {
+		warn ("Cannot create an atlas page of %dx%d.", this->pageSize, this->pageSize);
+		D3D9AtlasPage_free (page);
+		return NULL;
+	}
+
+	page->regions = (BbQueue) bb_queue_local_decl ();
+	bb_queue_add (&this->pages, page);
+
+	dbg ("Atlas page %d created.", bb_queue_get_length (&this->pages));
+
+	return page;
+}
+
+/*
+ * Description : Find a place for an image in the existing pages
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9Image *image : A decoded image accepted by the atlas
+ * int *x, int *y : Output position of the padded image
+ * Return : D3D9AtlasPage * the page containing the image, or NULL if none has enough space
+ */
+static D3D9AtlasPage *
+D3D9Atlas_find_page (
+	D3D9Atlas *this,
+	D3D9Image *image,
+	int *x, int *y
+) {
+	foreach_bbqueue_item (&this->pages, D3D9AtlasPage *page)
+	{
+		if (D3D9AtlasPacker_insert (&page->packer, image->w + 2 * D3D9_ATLAS_PADDING, image->h + 2 * D3D9_ATLAS_PADDING, x, y)) {
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Find the page whose removed images left the most space, if it is enough for a rectangle
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * long long area : Area of the padded image to pack
+ * Return : D3D9AtlasPage * the page to repack, or NULL if no repack can make room for the image
+ */
+static D3D9AtlasPage *
+D3D9Atlas_find_fragmented (
+	D3D9Atlas *this,
+	long long area
+) {
+	D3D9AtlasPage *fragmented = NULL;
+	long long mostWasted = area - 1;
+
+	// The skyline never reuses the space left by the removed images until the page is repacked
+	foreach_bbqueue_item (&this->pages, D3D9AtlasPage *page)
+	{
+		long long wasted = page->packer.allocatedArea - page->packer.usedArea;
+
+		if (wasted > mostWasted) {
+			fragmented = page;
+			mostWasted = wasted;
+		}
+	}
+
+	return fragmented;
+}
+
+/*
+ * Description : Write the pixels of an image and extend its edges into the padding around it
+ * D3DLOCKED_RECT *locked : The padded rect of the image, locked
+ * D3D9Image *image : A decoded image
+ * Return : void
+ */
+static void
+D3D9Atlas_write_image (
+	D3DLOCKED_RECT *locked,
+	D3D9Image *image
+) {
+	for (int row = -D3D9_ATLAS_PADDING; row < image->h + D3D9_ATLAS_PADDING; row++)
+	{
+		int sourceRow = (row < 0) ? 0 : (row >= image->h) ? image->h - 1 : row;
+		unsigned char *source = image->pixels + sourceRow * image->pitch;
+		unsigned char *destination = (unsigned char *) locked->pBits + (row + D3D9_ATLAS_PADDING) * locked->Pitch;
+
+		for (int column = 0; column < D3D9_ATLAS_PADDING; column++) {
+			memcpy (destination + column * 4, source, 4);
+			memcpy (destination + (D3D9_ATLAS_PADDING + image->w + column) * 4, source + (image->w - 1) * 4, 4);
+		}
+
+		memcpy (destination + D3D9_ATLAS_PADDING * 4, source, image->w * 4);
+	}
+}
+
+/*
+ * Description : Pack an image into an atlas page. When no page has enough space, the pages containing removed images
+ *               are repacked first, and a new page is created only if the image still doesn't fit.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * D3D9Image *image : A decoded image accepted by the atlas
+ * Return : D3D9AtlasRegion * the region of the image, or NULL on error
+ */
+D3D9AtlasRegion *
+D3D9Atlas_add (
+	D3D9Atlas *this,
+	IDirect3DDevice9 * pDevice,
+	D3D9Image *image
+) {
+	int w = image->w + 2 * D3D9_ATLAS_PADDING;
+	int h = image->h + 2 * D3D9_ATLAS_PADDING;
+	D3D9AtlasRegion *region;
+	D3D9AtlasPage *target, *fragmented;
+	D3DLOCKED_RECT locked;
+	RECT padded;
+	int x, y;
+
+	if ((region = calloc (1, sizeof(D3D9AtlasRegion))) == NULL) {
+		return NULL;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// First page with enough space, then the space of the removed images, then a new page
+	if (!(target = D3D9Atlas_find_page (this, image, &x, &y))
+	&&  (fragmented = D3D9Atlas_find_fragmented (this, (long long) w * h)))
+	{
+		// A repack moves a whole page : one per frame at most, the next one waits for D3D9Atlas_update
+		if (this->repacked) {
+			fragmented->repackNeeded = true;
+			D3D9Lock_release_exclusive (&this->lock);
+			free (region);
+			return NULL;
+		}
+
+		D3D9Atlas_repack (this, fragmented);
+		fragmented->repackNeeded = false;
+		this->repacked = true;
+
+		if (D3D9AtlasPacker_insert (&fragmented->packer, w, h, &x, &y)) {
+			target = fragmented;
+		}
+	}
+
+	if (!target) {
+		if (!(target = D3D9Atlas_create_page (this, pDevice))
+		||  !D3D9AtlasPacker_insert (&target->packer, w, h, &x, &y)) {
+			D3D9Lock_release_exclusive (&this->lock);
+			free (region);
+			return NULL;
+		}
+	}
+
+	region->page = target;
+	SetRect (&padded, x, y, x + w, y + h);
+	SetRect (&region->rect, x + D3D9_ATLAS_PADDING, y + D3D9_ATLAS_PADDING,
+		x + D3D9_ATLAS_PADDING + image->w, y + D3D9_ATLAS_PADDING + image->h);
+
+	// Copy the pixels in the page, the padding included
+	if (target->texture->lpVtbl->LockRect (target->texture, 0, &locked, &padded, 0) != D3D_OK) {
+		D3D9AtlasPacker_remove (&target->packer, w, h);
+		D3D9Lock_release_exclusive (&this->lock);
+		free (region);
+		return NULL;
+	}
+
+	D3D9Atlas_write_image (&locked, image);
+
+	target->texture->lpVtbl->UnlockRect (target->texture, 0);
+	bb_queue_add (&target->regions, region);
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return region;
+}
+
+/*
+ * Description : Remove an image from its page. The space is reclaimed by the next D3D9Atlas_update.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9AtlasRegion *region : A region returned by D3D9Atlas_add
+ * Return : void
+ */
+void
+D3D9Atlas_remove (
+	D3D9Atlas *this,
+	D3D9AtlasRegion *region
+) {
+	D3D9AtlasPage *page = region->page;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	D3D9AtlasPacker_remove (&page->packer,
+		region->rect.right  - region->rect.left + 2 * D3D9_ATLAS_PADDING,
+		region->rect.bottom - region->rect.top  + 2 * D3D9_ATLAS_PADDING);
+	bb_queue_remv (&page->regions, region);
+
+	if (D3D9AtlasPacker_get_efficiency (&page->packer) < D3D9_ATLAS_REPACK_THRESHOLD) {
+		page->repackNeeded = true;
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	free (region);
+}
+
+/*
+ * Description : Release the empty pages and repack the most fragmented one. Called once per frame, before the uploads.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * Return : void
+ */
+void
+D3D9Atlas_update (
+	D3D9Atlas *this
+) {
+	D3D9AtlasPage *fragmented = NULL;
+	int count;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	count = bb_queue_get_length (&this->pages);
+
+	while (count--)
+	{
+		D3D9AtlasPage *page = bb_queue_pop (&this->pages);
+
+		if (!bb_queue_get_length (&page->regions)) {
+			D3D9AtlasPage_free (page);
+			continue;
+		}
+
+		if (page->repackNeeded
+		&& (!fragmented || D3D9AtlasPacker_get_efficiency (&page->packer) < D3D9AtlasPacker_get_efficiency (&fragmented->packer))) {
+			fragmented = page;
+		}
+
+		bb_queue_add (&this->pages, page);
+	}
+
+	// The other pages needing a repack wait for the next frames
+	if (fragmented) {
+		D3D9Atlas_repack (this, fragmented);
+		fragmented->repackNeeded = false;
+	}
+
+	this->repacked = (fragmented != NULL);
+
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Sort the regions by decreasing height, as expected by the skyline packer
+ * const void *a, const void *b : Pointers to D3D9AtlasRegion pointers
+ * Return : int the comparison result
+ */
+static int
+D3D9AtlasRegion_compare_height (
+	const void *a,
+	const void *b
+) {
+	const D3D9AtlasRegion *regionA = *(const D3D9AtlasRegion **) a;
+	const D3D9AtlasRegion *regionB = *(const D3D9AtlasRegion **) b;
+
+	return (regionB->rect.bottom - regionB->rect.top) - (regionA->rect.bottom - regionA->rect.top);
+}
+
+/*
+ * Description : Move the images of a page so the space of the removed images can be reused
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9AtlasPage *page : A page to repack
+ * Return : void
+ */
+static void
+D3D9Atlas_repack (
+	D3D9Atlas *this,
+	D3D9AtlasPage *page
+) {
+	int count = bb_queue_get_length (&page->regions);
+	D3D9AtlasRegion **regions = NULL;
+	RECT *rects = NULL;
+	unsigned char *copy = NULL;
+	D3D9AtlasPacker packer;
+	D3DLOCKED_RECT locked;
+	int index = 0;
+
+	if (!D3D9AtlasPacker_init (&packer, this->pageSize, this->pageSize)) {
+		return;
+	}
+
+	if (!(regions = malloc (sizeof(D3D9AtlasRegion *) * count))
+	||  !(rects = malloc (sizeof(RECT) * count))) {
+		goto cleanup;
+	}
+
+	foreach_bbqueue_item (&page->regions, D3D9AtlasRegion *region)
+	{
+		regions[index++] = region;
+	}
+
+	qsort (regions, count, sizeof(D3D9AtlasRegion *), D3D9AtlasRegion_compare_height);
+
+	// Compute the new layout first : the page is left untouched if it doesn't fit
+	for (index = 0; index < count; index++) {
+		int w = regions[index]->rect.right  - regions[index]->rect.left;
+		int h = regions[index]->rect.bottom - regions[index]->rect.top;
+		int x, y;
+
+		if (!D3D9AtlasPacker_insert (&packer, w + 2 * D3D9_ATLAS_PADDING, h + 2 * D3D9_ATLAS_PADDING, &x, &y)) {
+			warn ("Cannot repack an atlas page.");
+			goto cleanup;
+		}
+
+		SetRect (&rects[index], x + D3D9_ATLAS_PADDING, y + D3D9_ATLAS_PADDING, x + D3D9_ATLAS_PADDING + w, y + D3D9_ATLAS_PADDING + h);
+	}
+
+	// Move the pixels through a copy of the page, the source and destination rects can overlap
+	if ((copy = malloc (this->pageSize * this->pageSize * 4)) == NULL) {
+		goto cleanup;
+	}
+
+	if (page->texture->lpVtbl->LockRect (page->texture, 0, &locked, NULL, 0) != D3D_OK) {
+		goto cleanup;
+	}
+
+	// The space of the removed images is cleared, so it's transparent when reused
+	for (int row = 0; row < this->pageSize; row++) {
+		memcpy (copy + row * this->pageSize * 4, (unsigned char *) locked.pBits + row * locked.Pitch, this->pageSize * 4);
+		memset ((unsigned char *) locked.pBits + row * locked.Pitch, 0, this->pageSize * 4);
+	}
+
+	// The images are moved with their padding
+	for (index = 0; index < count; index++) {
+		RECT *source = &regions[index]->rect;
+		RECT *destination = &rects[index];
+		int rowSize = (source->right - source->left + 2 * D3D9_ATLAS_PADDING) * 4;
+
+		for (int row = -D3D9_ATLAS_PADDING; row < source->bottom - source->top + D3D9_ATLAS_PADDING; row++) {
+			memcpy (
+				(unsigned char *) locked.pBits + (destination->top + row) * locked.Pitch + (destination->left - D3D9_ATLAS_PADDING) * 4,
+				copy + (source->top + row) * this->pageSize * 4 + (source->left - D3D9_ATLAS_PADDING) * 4,
+				rowSize
+			);
+		}
+
+		regions[index]->rect = *destination;
+	}
+
+	page->texture->lpVtbl->UnlockRect (page->texture, 0);
+
+	// Swap the packers
+	free (page->packer.nodes);
+	page->packer = packer;
+	packer.nodes = NULL;
+
+	dbg ("Atlas page repacked : %d images.", count);
+
+cleanup:
+	free (packer.nodes);
+	free (copy);
+	free (rects);
+	free (regions);
+}
+
+/*
+ * Description : Release the texture and the memory of a page
+ * D3D9AtlasPage *page : An allocated page without regions
+ * Return : void
+ */
+static void
+D3D9AtlasPage_free (
+	D3D9AtlasPage *page
+) {
+	if (page->texture) {
+		page->texture->lpVtbl->Release (page->texture);
+	}
+
+	free (page->packer.nodes);
+	free (page);
+}
+
+/*
+ * Description : Free an allocated D3D9Atlas structure and release its pages.
+ * D3D9Atlas *this : An allocated D3D9Atlas to free.
+ */
+void
+D3D9Atlas_free (
+	D3D9Atlas *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	while (bb_queue_get_length (&this->pages)) {
+		D3D9AtlasPage *page = bb_queue_pop (&this->pages);
+
+		while (bb_queue_get_length (&page->regions)) {
+			free (bb_queue_pop (&page->regions));
+		}
+
+		D3D9AtlasPage_free (page);
+	}
+
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
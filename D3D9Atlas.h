@@ -0,0 +1,141 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "BbQueue/BbQueue.h"
+#include "D3D9Lock.h"
+#include "D3D9AtlasPacker.h"
+#include "D3D9ImageLoader.h"
+
+// ---------- Defines -------------
+#define D3D9_ATLAS_DEFAULT_PAGE_SIZE       1024
+// Images with a side larger than this aren't packed into the atlas
+#define D3D9_ATLAS_DEFAULT_MAX_SPRITE_SIZE 128
+// Border kept around each image and filled with its edge pixels, so filtering doesn't sample the neighbours
+#define D3D9_ATLAS_PADDING                 1
+// A page is repacked when its live images cover less than this ratio of the space consumed
+#define D3D9_ATLAS_REPACK_THRESHOLD        0.5
+
+// ------ Structure declaration -------
+typedef struct
+{
+	IDirect3DTexture9 *texture;
+	D3D9AtlasPacker packer;
+	BbQueue regions;
+	bool repackNeeded;
+
+}	D3D9AtlasPage;
+
+// Place of an image in an atlas page, without its padding. The rect can move when the page is repacked.
+typedef struct
+{
+	D3D9AtlasPage *page;
+	RECT rect;
+
+}	D3D9AtlasRegion;
+
+typedef struct
+{
+	BbQueue pages;
+	int pageSize;
+	int maxSpriteSize;
+	// A page has been repacked since the last D3D9Atlas_update : at most one page is repacked per frame
+	bool repacked;
+	D3D9Lock lock;
+
+}	D3D9Atlas;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9Atlas structure.
+ * int pageSize : Width and height of the atlas textures
+ * int maxSpriteSize : Images with a side larger than this aren't packed
+ * Return : A pointer to an allocated D3D9Atlas.
+ */
+D3D9Atlas *
+D3D9Atlas_new (
+	int pageSize,
+	int maxSpriteSize
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9Atlas structure.
+ * D3D9Atlas *this : An allocated D3D9Atlas to initialize.
+ * int pageSize : Width and height of the atlas textures
+ * int maxSpriteSize : Images with a side larger than this aren't packed
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Atlas_init (
+	D3D9Atlas *this,
+	int pageSize,
+	int maxSpriteSize
+);
+
+/*
+ * Description : Check if an image can be packed into the atlas
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9Image *image : A decoded image
+ * Return : bool true if the image is small enough and decoded in system memory
+ */
+bool
+D3D9Atlas_accepts (
+	D3D9Atlas *this,
+	D3D9Image *image
+);
+
+/*
+ * Description : Pack an image into an atlas page. When no page has enough space, the page with the most space left by
+ *               removed images is repacked first, if no page has been repacked in this frame yet. Otherwise it is repacked
+ *               by the next D3D9Atlas_update, and the image isn't packed. A new page is created only if no page can make room.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * D3D9Image *image : A decoded image accepted by the atlas
+ * Return : D3D9AtlasRegion * the region of the image, or NULL on error
+ */
+D3D9AtlasRegion *
+D3D9Atlas_add (
+	D3D9Atlas *this,
+	IDirect3DDevice9 * pDevice,
+	D3D9Image *image
+);
+
+/*
+ * Description : Remove an image from its page. The space is reclaimed by the next D3D9Atlas_update.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * D3D9AtlasRegion *region : A region returned by D3D9Atlas_add
+ * Return : void
+ */
+void
+D3D9Atlas_remove (
+	D3D9Atlas *this,
+	D3D9AtlasRegion *region
+);
+
+/*
+ * Description : Release the empty pages and repack the most fragmented one. Called once per frame, before the uploads.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Atlas *this : An allocated D3D9Atlas
+ * Return : void
+ */
+void
+D3D9Atlas_update (
+	D3D9Atlas *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9Atlas structure and release its pages.
+ * D3D9Atlas *this : An allocated D3D9Atlas to free.
+ */
+void
+D3D9Atlas_free (
+	D3D9Atlas *this
+);
@@ -0,0 +1,291 @@
+#include "D3D9AtlasPacker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Private headers
+/*
+ * Description : Get the height a rectangle would be placed at, if placed at the start of a skyline node
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int index : Index of the skyline node
+ * int w, int h : Size of the rectangle
+ * Return : int the y position of the rectangle, or -1 if it doesn't fit there
+ */
+static int D3D9AtlasPacker_fit (D3D9AtlasPacker *this, int index, int w, int h);
+
+/*
+ * Description : Insert a node in the skyline
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int index : Position of the new node
+ * D3D9AtlasSkylineNode node : The node to insert
+ * Return : bool true on success, false otherwise
+ */
+static bool D3D9AtlasPacker_insert_node (D3D9AtlasPacker *this, int index, D3D9AtlasSkylineNode node);
+
+
+/*
+ * Description : Allocate a new D3D9AtlasPacker structure.
+ * int w, int h : Size of the area to pack
+ * Return : A pointer to an allocated D3D9AtlasPacker.
+ */
+D3D9AtlasPacker *
+D3D9AtlasPacker_new (
+	int w, int h
+) {
+	D3D9AtlasPacker *this;
+
+	if ((this = calloc (1, sizeof(D3D9AtlasPacker))) == NULL)
+		return NULL;
+
+	if (!D3D9AtlasPacker_init (this, w, h)) {
+		D3D9AtlasPacker_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9AtlasPacker structure.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker to initialize.
+ * int w, int h : Size of the area to pack
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9AtlasPacker_init (
+	D3D9AtlasPacker *this,
+	int w, int h
+) {
+	this->w = w;
+	this->h = h;
+	this->nodesCapacity = 16;
+
+	if ((this->nodes = malloc (sizeof(D3D9AtlasSkylineNode) * this->nodesCapacity)) == NULL) {
+		return false;
+	}
+
+	D3D9AtlasPacker_reset (this);
+
+	return true;
+}
+
+/*
+ * Description : Remove all the rectangles
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * Return : void
+ */
+void
+D3D9AtlasPacker_reset (
+	D3D9AtlasPacker *this
+) {
+	// A single flat segment covering the whole width
+	this->nodes[0] = (D3D9AtlasSkylineNode) {.x = 0, .y = 0, .w = this->w};
+	this->nodesCount = 1;
+	this->usedArea = 0;
+	this->allocatedArea = 0;
+}
+
+/*
+ * Description : Get the height a rectangle would be placed at, if placed at the start of a skyline node
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int index : Index of the skyline node
+ * int w, int h : Size of the rectangle
+ * Return : int the y position of the rectangle, or -1 if it doesn't fit there
+ */
+static int
+D3D9AtlasPacker_fit (
+	D3D9AtlasPacker *this,
+	int index,
+	int w, int h
+) {
+	int x = this->nodes[index].x;
+	int y = 0;
+	int remaining = w;
+
+	if (x + w > this->w) {
+		return -1;
+	}
+
+	// The rectangle rests on the highest node it spans
+	while (remaining > 0) {
+		if (this->nodes[index].y > y) {
+			y = this->nodes[index].y;
+		}
+
+		if (y + h > this->h) {
+			return -1;
+		}
+
+		remaining -= this->nodes[index].w;
+		index++;
+	}
+
+	return y;
+}
+
+/*
+ * Description : Insert a node in the skyline
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int index : Position of the new node
+ * D3D9AtlasSkylineNode node : The node to insert
+ * Return : bool true on success, false otherwise
+ */
+static bool
+D3D9AtlasPacker_insert_node (
+	D3D9AtlasPacker *this,
+	int index,
+	D3D9AtlasSkylineNode node
+) {
+	if (this->nodesCount == this->nodesCapacity) {
+		D3D9AtlasSkylineNode *nodes;
+
+		if ((nodes = realloc (this->nodes, sizeof(D3D9AtlasSkylineNode) * this->nodesCapacity * 2)) == NULL) {
+			return false;
+		}
+
+		this->nodes = nodes;
+		this->nodesCapacity *= 2;
+	}
+
+	memmove (&this->nodes[index + 1], &this->nodes[index], sizeof(D3D9AtlasSkylineNode) * (this->nodesCount - index));
+	this->nodes[index] = node;
+	this->nodesCount++;
+
+	return true;
+}
+
+/*
+ * Description : Find a place for a rectangle, as low then as left as possible
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int w, int h : Size of the rectangle
+ * int *x, int *y : Output position of the rectangle
+ * Return : bool true on success, false if the rectangle doesn't fit
+ */
+bool
+D3D9AtlasPacker_insert (
+	D3D9AtlasPacker *this,
+	int w, int h,
+	int *x, int *y
+) {
+	int bestIndex = -1;
+	int bestTop = INT_MAX;
+	int bestWidth = INT_MAX;
+	int bestY = 0;
+
+	if (w <= 0 || h <= 0) {
+		return false;
+	}
+
+	// Bottom-left : the lowest top edge wins, then the narrowest segment
+	for (int index = 0; index < this->nodesCount; index++) {
+		int top, fitY;
+
+		if ((fitY = D3D9AtlasPacker_fit (this, index, w, h)) == -1) {
+			continue;
+		}
+
+		top = fitY + h;
+
+		if (top < bestTop || (top == bestTop && this->nodes[index].w < bestWidth)) {
+			bestIndex = index;
+			bestTop = top;
+			bestWidth = this->nodes[index].w;
+			bestY = fitY;
+		}
+	}
+
+	if (bestIndex == -1) {
+		return false;
+	}
+
+	D3D9AtlasSkylineNode node = {.x = this->nodes[bestIndex].x, .y = bestY + h, .w = w};
+
+	if (!D3D9AtlasPacker_insert_node (this, bestIndex, node)) {
+		return false;
+	}
+
+	// Shrink or remove the segments now covered by the new one
+	for (int index = bestIndex + 1; index < this->nodesCount; ) {
+		D3D9AtlasSkylineNode *previous = &this->nodes[index - 1];
+		D3D9AtlasSkylineNode *current = &this->nodes[index];
+		int overlap = previous->x + previous->w - current->x;
+
+		if (overlap <= 0) {
+			break;
+		}
+
+		if (overlap < current->w) {
+			current->x += overlap;
+			current->w -= overlap;
+			break;
+		}
+
+		memmove (current, current + 1, sizeof(D3D9AtlasSkylineNode) * (this->nodesCount - index - 1));
+		this->nodesCount--;
+	}
+
+	// Merge the neighbour segments at the same height
+	for (int index = 0; index < this->nodesCount - 1; ) {
+		if (this->nodes[index].y == this->nodes[index + 1].y) {
+			this->nodes[index].w += this->nodes[index + 1].w;
+			memmove (&this->nodes[index + 1], &this->nodes[index + 2], sizeof(D3D9AtlasSkylineNode) * (this->nodesCount - index - 2));
+			this->nodesCount--;
+		}
+		else {
+			index++;
+		}
+	}
+
+	*x = node.x;
+	*y = bestY;
+
+	this->usedArea += (long long) w * h;
+	this->allocatedArea += (long long) w * h;
+
+	return true;
+}
+
+/*
+ * Description : Account the removal of a packed rectangle.
+ *               The skyline cannot reuse the space until the packer is reset and repacked.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int w, int h : Size of the rectangle removed
+ * Return : void
+ */
+void
+D3D9AtlasPacker_remove (
+	D3D9AtlasPacker *this,
+	int w, int h
+) {
+	this->usedArea -= (long long) w * h;
+}
+
+/*
+ * Description : Get the ratio between the area of the rectangles still packed and of all the rectangles packed since the last reset
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * Return : float between 0.0 and 1.0, 1.0 if nothing has been packed
+ */
+float
+D3D9AtlasPacker_get_efficiency (
+	D3D9AtlasPacker *this
+) {
+	if (this->allocatedArea == 0) {
+		return 1.0;
+	}
+
+	return (float) this->usedArea / (float) this->allocatedArea;
+}
+
+/*
+ * Description : Free an allocated D3D9AtlasPacker structure.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker to free.
+ */
+void
+D3D9AtlasPacker_free (
+	D3D9AtlasPacker *this
+) {
+	if (this != NULL) {
+		free (this->nodes);
+		free (this);
+	}
+}
@@ -0,0 +1,116 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+
+
+// ------ Structure declaration -------
+
+// Segment of the skyline : the height reached by the packed rectangles between x and x + w
+typedef struct
+{
+	int x, y, w;
+
+}	D3D9AtlasSkylineNode;
+
+// Skyline bottom-left rectangle packer. It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	int w, h;
+
+	D3D9AtlasSkylineNode *nodes;
+	int nodesCount;
+	int nodesCapacity;
+
+	// Area of the rectangles currently packed, and of all the rectangles packed since the last reset
+	long long usedArea;
+	long long allocatedArea;
+
+}	D3D9AtlasPacker;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9AtlasPacker structure.
+ * int w, int h : Size of the area to pack
+ * Return : A pointer to an allocated D3D9AtlasPacker.
+ */
+D3D9AtlasPacker *
+D3D9AtlasPacker_new (
+	int w, int h
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9AtlasPacker structure.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker to initialize.
+ * int w, int h : Size of the area to pack
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9AtlasPacker_init (
+	D3D9AtlasPacker *this,
+	int w, int h
+);
+
+/*
+ * Description : Find a place for a rectangle, as low then as left as possible
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int w, int h : Size of the rectangle
+ * int *x, int *y : Output position of the rectangle
+ * Return : bool true on success, false if the rectangle doesn't fit
+ */
+bool
+D3D9AtlasPacker_insert (
+	D3D9AtlasPacker *this,
+	int w, int h,
+	int *x, int *y
+);
+
+/*
+ * Description : Account the removal of a packed rectangle.
+ *               The skyline cannot reuse the space until the packer is reset and repacked.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * int w, int h : Size of the rectangle removed
+ * Return : void
+ */
+void
+D3D9AtlasPacker_remove (
+	D3D9AtlasPacker *this,
+	int w, int h
+);
+
+/*
+ * Description : Remove all the rectangles
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * Return : void
+ */
+void
+D3D9AtlasPacker_reset (
+	D3D9AtlasPacker *this
+);
+
+/*
+ * Description : Get the ratio between the area of the rectangles still packed and of all the rectangles packed since the last reset
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker
+ * Return : float between 0.0 and 1.0, 1.0 if nothing has been packed
+ */
+float
+D3D9AtlasPacker_get_efficiency (
+	D3D9AtlasPacker *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9AtlasPacker structure.
+ * D3D9AtlasPacker *this : An allocated D3D9AtlasPacker to free.
+ */
+void
+D3D9AtlasPacker_free (
+	D3D9AtlasPacker *this
+);
@@ -0,0 +1,253 @@
+#include "D3D9BoundsKernel.h"
+#include <string.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+// Kernel selected for the CPU
+typedef int (*D3D9BoundsKernelFunction) (D3D9Bounds *bounds, int x, int y, int w, int h, unsigned int *mask);
+
+// Private headers
+/*
+ * Description : Test all the bounds against a rectangle, 4 objects at a time
+ * Same parameters and return as D3D9BoundsKernel_intersect.
+ */
+static int D3D9BoundsKernel_intersect_sse2 (D3D9Bounds *bounds, int x, int y, int w, int h, unsigned int *mask)
+	__attribute__ ((target ("sse2")));
+
+/*
+ * Description : Test all the bounds against a rectangle, 8 objects at a time
+ * Same parameters and return as D3D9BoundsKernel_intersect.
+ */
+static int D3D9BoundsKernel_intersect_avx2 (D3D9Bounds *bounds, int x, int y, int w, int h, unsigned int *mask)
+	__attribute__ ((target ("avx2")));
+
+/*
+ * Description : Test the objects not handled by a SIMD kernel
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int first : Index of the first object to test
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output mask, the words of the objects tested must be cleared
+ * Return : int the number of objects intersecting the rectangle
+ */
+static int D3D9BoundsKernel_intersect_tail (D3D9Bounds *bounds, int first, int x, int y, int w, int h, unsigned int *mask);
+
+/*
+ * Description : Select the kernel for the CPU
+ * Return : D3D9BoundsKernelFunction the widest kernel supported
+ */
+static D3D9BoundsKernelFunction D3D9BoundsKernel_select (void);
+
+
+/*
+ * Description : Test all the bounds against a rectangle. The widest instruction set supported by the CPU is used.
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output of D3D9_BOUNDS_MASK_WORDS (count) words, the bit of each object intersecting the rectangle is set
+ * Return : int the number of objects intersecting the rectangle
+ */
+int
+D3D9BoundsKernel_intersect (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+) {
+	// Every thread selects the same kernel, so the race on the first call is harmless
+	static D3D9BoundsKernelFunction kernel = NULL;
+
+	if (kernel == NULL) {
+		kernel = D3D9BoundsKernel_select ();
+	}
+
+	return kernel (bounds, x, y, w, h, mask);
+}
+
+/*
+ * Description : Select the kernel for the CPU
+ * Return : D3D9BoundsKernelFunction the widest kernel supported
+ */
+static D3D9BoundsKernelFunction
+D3D9BoundsKernel_select (
+	void
+) {
+	__builtin_cpu_init ();
+
+	if (__builtin_cpu_supports ("avx2")) {
+		return D3D9BoundsKernel_intersect_avx2;
+	}
+
+	if (__builtin_cpu_supports ("sse2")) {
+		return D3D9BoundsKernel_intersect_sse2;
+	}
+
+	return D3D9BoundsKernel_intersect_scalar;
+}
+
+/*
+ * Description : Test all the bounds against a rectangle, one object at a time. Reference of the SIMD versions.
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output of D3D9_BOUNDS_MASK_WORDS (count) words, the bit of each object intersecting the rectangle is set
+ * Return : int the number of objects intersecting the rectangle
+ */
+int
+D3D9BoundsKernel_intersect_scalar (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+) {
+	memset (mask, 0, sizeof(unsigned int) * D3D9_BOUNDS_MASK_WORDS (bounds->count));
+
+	// An empty rectangle contains no pixel
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+
+	return D3D9BoundsKernel_intersect_tail (bounds, 0, x, y, w, h, mask);
+}
+
+/*
+ * Description : Test the objects not handled by a SIMD kernel
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int first : Index of the first object to test
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output mask, the words of the objects tested must be cleared
+ * Return : int the number of objects intersecting the rectangle
+ */
+static int
+D3D9BoundsKernel_intersect_tail (
+	D3D9Bounds *bounds,
+	int first,
+	int x, int y, int w, int h,
+	unsigned int *mask
+) {
+	int found = 0;
+
+	for (int index = first; index < bounds->count; index++) {
+		if (bounds->w [index] > 0 && bounds->h [index] > 0
+		&&  bounds->x [index] < x + w && x < bounds->x [index] + bounds->w [index]
+		&&  bounds->y [index] < y + h && y < bounds->y [index] + bounds->h [index]) {
+			mask [index / 32] |= 1U << (index % 32);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Test all the bounds against a rectangle, 4 objects at a time
+ * Same parameters and return as D3D9BoundsKernel_intersect.
+ */
+static int
+D3D9BoundsKernel_intersect_sse2 (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+) {
+	__m128i left   = _mm_set1_epi32 (x);
+	__m128i top    = _mm_set1_epi32 (y);
+	__m128i right  = _mm_set1_epi32 (x + w);
+	__m128i bottom = _mm_set1_epi32 (y + h);
+	__m128i zero   = _mm_setzero_si128 ();
+	int found = 0;
+	int index;
+
+	memset (mask, 0, sizeof(unsigned int) * D3D9_BOUNDS_MASK_WORDS (bounds->count));
+
+	// An empty rectangle contains no pixel
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+
+	for (index = 0; index + 4 <= bounds->count; index += 4) {
+		__m128i bx = _mm_loadu_si128 ((const __m128i *) &bounds->x [index]);
+		__m128i by = _mm_loadu_si128 ((const __m128i *) &bounds->y [index]);
+		__m128i bw = _mm_loadu_si128 ((const __m128i *) &bounds->w [index]);
+		__m128i bh = _mm_loadu_si128 ((const __m128i *) &bounds->h [index]);
+
+		__m128i hit = _mm_and_si128 (
+			_mm_and_si128 (_mm_cmplt_epi32 (bx, right), _mm_cmpgt_epi32 (_mm_add_epi32 (bx, bw), left)),
+			_mm_and_si128 (_mm_cmplt_epi32 (by, bottom), _mm_cmpgt_epi32 (_mm_add_epi32 (by, bh), top))
+		);
+		// The empty objects contain no pixel
+		hit = _mm_and_si128 (hit, _mm_and_si128 (_mm_cmpgt_epi32 (bw, zero), _mm_cmpgt_epi32 (bh, zero)));
+		unsigned int bits = _mm_movemask_ps (_mm_castsi128_ps (hit));
+
+		// 4 divides 32 : the bits of a group never cross a word
+		mask [index / 32] |= bits << (index % 32);
+		found += __builtin_popcount (bits);
+	}
+
+	return found + D3D9BoundsKernel_intersect_tail (bounds, index, x, y, w, h, mask);
+}
+
+/*
+ * Description : Test all the bounds against a rectangle, 8 objects at a time
+ * Same parameters and return as D3D9BoundsKernel_intersect.
+ */
+static int
+D3D9BoundsKernel_intersect_avx2 (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+) {
+	__m256i left   = _mm256_set1_epi32 (x);
+	__m256i top    = _mm256_set1_epi32 (y);
+	__m256i right  = _mm256_set1_epi32 (x + w);
+	__m256i bottom = _mm256_set1_epi32 (y + h);
+	__m256i zero   = _mm256_setzero_si256 ();
+	int found = 0;
+	int index;
+
+	memset (mask, 0, sizeof(unsigned int) * D3D9_BOUNDS_MASK_WORDS (bounds->count));
+
+	// An empty rectangle contains no pixel
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+
+	for (index = 0; index + 8 <= bounds->count; index += 8) {
+		__m256i bx = _mm256_loadu_si256 ((const __m256i *) &bounds->x [index]);
+		__m256i by = _mm256_loadu_si256 ((const __m256i *) &bounds->y [index]);
+		__m256i bw = _mm256_loadu_si256 ((const __m256i *) &bounds->w [index]);
+		__m256i bh = _mm256_loadu_si256 ((const __m256i *) &bounds->h [index]);
+
+		// AVX2 only compares with greater than : a < b is written b > a
+		__m256i hit = _mm256_and_si256 (
+			_mm256_and_si256 (_mm256_cmpgt_epi32 (right, bx), _mm256_cmpgt_epi32 (_mm256_add_epi32 (bx, bw), left)),
+			_mm256_and_si256 (_mm256_cmpgt_epi32 (bottom, by), _mm256_cmpgt_epi32 (_mm256_add_epi32 (by, bh), top))
+		);
+		// The empty objects contain no pixel
+		hit = _mm256_and_si256 (hit, _mm256_and_si256 (_mm256_cmpgt_epi32 (bw, zero), _mm256_cmpgt_epi32 (bh, zero)));
+		unsigned int bits = _mm256_movemask_ps (_mm256_castsi256_ps (hit));
+
+		// 8 divides 32 : the bits of a group never cross a word
+		mask [index / 32] |= bits << (index % 32);
+		found += __builtin_popcount (bits);
+	}
+
+	// The AVX registers are left dirty for the SSE code of the caller otherwise
+	_mm256_zeroupper ();
+
+	return found + D3D9BoundsKernel_intersect_tail (bounds, index, x, y, w, h, mask);
+}
+
+/*
+ * Description : Get the last object set in a mask
+ * unsigned int *mask : A mask filled by D3D9BoundsKernel_intersect
+ * int count : Number of objects of the mask
+ * Return : int the index of the last object set, or -1 if the mask is empty
+ */
+int
+D3D9BoundsKernel_get_last (
+	unsigned int *mask,
+	int count
+) {
+	for (int word = D3D9_BOUNDS_MASK_WORDS (count) - 1; word >= 0; word--) {
+		if (mask [word]) {
+			return word * 32 + 31 - __builtin_clz (mask [word]);
+		}
+	}
+
+	return -1;
+}
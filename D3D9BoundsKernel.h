@@ -0,0 +1,68 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+// Number of words of a mask holding one bit per object
+#define D3D9_BOUNDS_MASK_WORDS(count) (((count) + 31) / 32)
+// Test the bit of an object in a mask
+#define D3D9_BOUNDS_MASK_TEST(mask, index) (((mask) [(index) / 32] >> ((index) % 32)) & 1)
+
+// ------ Structure declaration -------
+
+// Bounds of the objects stored as separated arrays, so they can be loaded in SIMD registers.
+// Objects are tested against a rectangle, half open : [x, x + w) x [y, y + h).
+// A point is tested as a rectangle of 1 x 1. An empty object or rectangle intersects nothing.
+typedef struct
+{
+	const int *x;
+	const int *y;
+	const int *w;
+	const int *h;
+	int count;
+
+}	D3D9Bounds;
+
+// ----------- Functions ------------
+
+/*
+ * Description : Test all the bounds against a rectangle. The widest instruction set supported by the CPU is used.
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output of D3D9_BOUNDS_MASK_WORDS (count) words, the bit of each object intersecting the rectangle is set
+ * Return : int the number of objects intersecting the rectangle
+ */
+int
+D3D9BoundsKernel_intersect (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+);
+
+/*
+ * Description : Test all the bounds against a rectangle, one object at a time. Reference of the SIMD versions.
+ * D3D9Bounds *bounds : The bounds of the objects
+ * int x, int y, int w, int h : The rectangle tested
+ * unsigned int *mask : Output of D3D9_BOUNDS_MASK_WORDS (count) words, the bit of each object intersecting the rectangle is set
+ * Return : int the number of objects intersecting the rectangle
+ */
+int
+D3D9BoundsKernel_intersect_scalar (
+	D3D9Bounds *bounds,
+	int x, int y, int w, int h,
+	unsigned int *mask
+);
+
+/*
+ * Description : Get the last object set in a mask
+ * unsigned int *mask : A mask filled by D3D9BoundsKernel_intersect
+ * int count : Number of objects of the mask
+ * Return : int the index of the last object set, or -1 if the mask is empty
+ */
+int
+D3D9BoundsKernel_get_last (
+	unsigned int *mask,
+	int count
+);
@@ -0,0 +1,336 @@
+#include "D3D9FontCache.h"
+
+// ---------- Debugging -------------
+#define __DEBUG_OBJECT__ "D3D9FontCache"
+#include "dbg/dbg.h"
+
+// Private headers
+/*
+ * Description : Get the cached entry of a font
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * char *family, int size, int weight : Key of the font
+ * Return : D3D9FontCacheEntry * the entry, or NULL if the font isn't cached
+ */
+static D3D9FontCacheEntry * D3D9FontCache_find (D3D9FontCache *this, char *family, int size, int weight);
+
+/*
+ * Description : Get a reference on a font, creating it if needed
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family, int size, int weight : Key of the font
+ * Return : D3D9FontCacheEntry * the referenced entry, or NULL on error
+ */
+static D3D9FontCacheEntry * D3D9FontCache_get (D3D9FontCache *this, IDirect3DDevice9 * pDevice, char *family, int size, int weight);
+
+/*
+ * Description : Release the font and the memory of an entry
+ * D3D9FontCacheEntry *entry : An entry removed from the cache
+ * Return : void
+ */
+static void D3D9FontCacheEntry_free (D3D9FontCacheEntry *entry);
+
+
+/*
+ * Description : Allocate a new D3D9FontCache structure.
+ * Return : A pointer to an allocated D3D9FontCache.
+ */
+D3D9FontCache *
+D3D9FontCache_new (
+	void
+) {
+	D3D9FontCache *this;
+
+	if ((this = calloc (1, sizeof(D3D9FontCache))) == NULL)
+		return NULL;
+
+	if (!D3D9FontCache_init (this)) {
+		D3D9FontCache_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9FontCache structure.
+ * D3D9FontCache *this : An allocated D3D9FontCache to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9FontCache_init (
+	D3D9FontCache *this
+) {
+	memset (&this->stats, 0, sizeof(this->stats));
+	this->fonts = (BbQueue) bb_queue_local_decl ();
+
+	return D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+}
+
+/*
+ * Description : Get the cached entry of a font
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * char *family, int size, int weight : Key of the font
+ * Return : D3D9FontCacheEntry * the entry, or NULL if the font isn't cached
+ */
+static D3D9FontCacheEntry *
+D3D9FontCache_find (
+	D3D9FontCache *this,
+	char *family,
+	int size,
+	int weight
+) {
+	foreach_bbqueue_item (&this->fonts, D3D9FontCacheEntry *entry)
+	{
+		// Font family names are case insensitive
+		if (entry->size == size && entry->weight == weight && _stricmp (entry->family, family) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Get a reference on a font, creating it if needed
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family, int size, int weight : Key of the font
+ * Return : D3D9FontCacheEntry * the referenced entry, or NULL on error
+ */
+static D3D9FontCacheEntry *
+D3D9FontCache_get (
+	D3D9FontCache *this,
+	IDirect3DDevice9 * pDevice,
+	char *family,
+	int size,
+	int weight
+) {
+	D3D9FontCacheEntry *entry;
+
+	if ((entry = D3D9FontCache_find (this, family, size, weight))) {
+		entry->refCount++;
+		this->stats.creationsAvoided++;
+		this->stats.bytesSaved += D3D9_FONT_CACHE_ESTIMATED_FONT_BYTES;
+		return entry;
+	}
+
+	if ((entry = calloc (1, sizeof(D3D9FontCacheEntry))) == NULL) {
+		return NULL;
+	}
+
+	if ((entry->family = strdup (family)) == NULL) {
+		free (entry);
+		return NULL;
+	}
+
+	if ((D3DXCreateFont (
+		pDevice,
+		size,
+		0,
+		weight,
+		1,
+		0,
+		DEFAULT_CHARSET,
+		OUT_DEFAULT_PRECIS,
+		DEFAULT_QUALITY,
+		DEFAULT_PITCH | FF_DONTCARE,
+		family,
+		&entry->font
+	)) != S_OK) {
+		warn ("Cannot create the font <%s | size=%d | weight=%d>.", family, size, weight);
+		entry->font = NULL;
+		D3D9FontCacheEntry_free (entry);
+		return NULL;
+	}
+
+	entry->size     = size;
+	entry->weight   = weight;
+	entry->refCount = 1;
+
+	bb_queue_add (&this->fonts, entry);
+	this->stats.creations++;
+	this->stats.entries++;
+
+	return entry;
+}
+
+/*
+ * Description : Get a reference on a shared font, and create it if it isn't cached
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family : Name of the font family
+ * int size : Height of the font
+ * int weight : Weight of the font, FW_NORMAL, FW_BOLD...
+ * Return : D3D9FontCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9FontCacheEntry *
+D3D9FontCache_acquire (
+	D3D9FontCache *this,
+	IDirect3DDevice9 * pDevice,
+	char *family,
+	int size,
+	int weight
+) {
+	D3D9FontCacheEntry *entry;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	entry = D3D9FontCache_get (this, pDevice, family, size, weight);
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return entry;
+}
+
+/*
+ * Description : Create a font and keep it cached even when no text uses it
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family : Name of the font family
+ * int size : Height of the font
+ * int weight : Weight of the font, FW_NORMAL, FW_BOLD...
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9FontCache_preload (
+	D3D9FontCache *this,
+	IDirect3DDevice9 * pDevice,
+	char *family,
+	int size,
+	int weight
+) {
+	D3D9FontCacheEntry *entry;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The reference of the cache is taken only once
+	if ((entry = D3D9FontCache_find (this, family, size, weight)) && entry->preloaded) {
+		D3D9Lock_release_exclusive (&this->lock);
+		return true;
+	}
+
+	if ((entry = D3D9FontCache_get (this, pDevice, family, size, weight))) {
+		entry->preloaded = true;
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return (entry != NULL);
+}
+
+/*
+ * Description : Release a reference on a shared font. The font is released when it isn't referenced anymore.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * D3D9FontCacheEntry *entry : An entry referenced with acquire
+ * Return : void
+ */
+void
+D3D9FontCache_release (
+	D3D9FontCache *this,
+	D3D9FontCacheEntry *entry
+) {
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	if (--entry->refCount == 0) {
+		bb_queue_remv (&this->fonts, entry);
+		this->stats.entries--;
+		D3D9FontCacheEntry_free (entry);
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Release the video memory of the fonts before the device is reset.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * Return : void
+ */
+void
+D3D9FontCache_on_lost_device (
+	D3D9FontCache *this
+) {
+	D3D9Lock_acquire_shared (&this->lock);
+
+	foreach_bbqueue_item (&this->fonts, D3D9FontCacheEntry *entry) {
+		entry->font->lpVtbl->OnLostDevice (entry->font);
+	}
+
+	D3D9Lock_release_shared (&this->lock);
+}
+
+/*
+ * Description : Restore the fonts after the device has been reset.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * Return : void
+ */
+void
+D3D9FontCache_on_reset_device (
+	D3D9FontCache *this
+) {
+	D3D9Lock_acquire_shared (&this->lock);
+
+	foreach_bbqueue_item (&this->fonts, D3D9FontCacheEntry *entry) {
+		entry->font->lpVtbl->OnResetDevice (entry->font);
+	}
+
+	D3D9Lock_release_shared (&this->lock);
+}
+
+/*
+ * Description : Get the creation counters of the cache
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * D3D9FontCacheStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9FontCache_get_stats (
+	D3D9FontCache *this,
+	D3D9FontCacheStats *stats
+) {
+	D3D9Lock_acquire_shared (&this->lock);
+	*stats = this->stats;
+	D3D9Lock_release_shared (&this->lock);
+}
+
+/*
+ * Description : Release the font and the memory of an entry
+ * D3D9FontCacheEntry *entry : An entry removed from the cache
+ * Return : void
+ */
+static void
+D3D9FontCacheEntry_free (
+	D3D9FontCacheEntry *entry
+) {
+	if (entry->font) {
+		entry->font->lpVtbl->Release (entry->font);
+	}
+
+	free (entry->family);
+	free (entry);
+}
+
+/*
+ * Description : Free an allocated D3D9FontCache structure and release all its fonts.
+ * D3D9FontCache *this : An allocated D3D9FontCache to free.
+ */
+void
+D3D9FontCache_free (
+	D3D9FontCache *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	while (bb_queue_get_length (&this->fonts)) {
+		D3D9FontCacheEntry *entry = bb_queue_pop (&this->fonts);
+		if (entry->refCount > (entry->preloaded ? 1 : 0)) {
+			warn ("Font <%s> is still referenced %d times.", entry->family, entry->refCount);
+		}
+		D3D9FontCacheEntry_free (entry);
+	}
+
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
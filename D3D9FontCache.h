@@ -0,0 +1,160 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "dx/d3dx9.h"
+#include "BbQueue/BbQueue.h"
+#include "D3D9Lock.h"
+
+// ---------- Defines -------------
+// Estimation of the glyph textures allocated by a ID3DXFont, used to report the memory saved by sharing fonts
+#define D3D9_FONT_CACHE_ESTIMATED_FONT_BYTES (256 * 256 * 2)
+
+// ------ Structure declaration -------
+typedef struct
+{
+	// Key : family, size and weight of the font
+	char *family;
+	int size;
+	int weight;
+
+	ID3DXFont *font;
+	int refCount;
+	// The cache keeps a reference on preloaded fonts
+	bool preloaded;
+
+}	D3D9FontCacheEntry;
+
+typedef struct
+{
+	int creations;
+	// Fonts shared instead of created again, and the estimated memory saved by sharing them
+	int creationsAvoided;
+	DWORD bytesSaved;
+	int entries;
+
+}	D3D9FontCacheStats;
+
+typedef struct
+{
+	BbQueue fonts;
+	D3D9FontCacheStats stats;
+	D3D9Lock lock;
+
+}	D3D9FontCache;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9FontCache structure.
+ * Return : A pointer to an allocated D3D9FontCache.
+ */
+D3D9FontCache *
+D3D9FontCache_new (
+	void
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9FontCache structure.
+ * D3D9FontCache *this : An allocated D3D9FontCache to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9FontCache_init (
+	D3D9FontCache *this
+);
+
+/*
+ * Description : Get a reference on a shared font, and create it if it isn't cached
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family : Name of the font family
+ * int size : Height of the font
+ * int weight : Weight of the font, FW_NORMAL, FW_BOLD...
+ * Return : D3D9FontCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9FontCacheEntry *
+D3D9FontCache_acquire (
+	D3D9FontCache *this,
+	IDirect3DDevice9 * pDevice,
+	char *family,
+	int size,
+	int weight
+);
+
+/*
+ * Description : Create a font and keep it cached even when no text uses it
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *family : Name of the font family
+ * int size : Height of the font
+ * int weight : Weight of the font, FW_NORMAL, FW_BOLD...
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9FontCache_preload (
+	D3D9FontCache *this,
+	IDirect3DDevice9 * pDevice,
+	char *family,
+	int size,
+	int weight
+);
+
+/*
+ * Description : Release a reference on a shared font. The font is released when it isn't referenced anymore.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * D3D9FontCacheEntry *entry : An entry referenced with acquire
+ * Return : void
+ */
+void
+D3D9FontCache_release (
+	D3D9FontCache *this,
+	D3D9FontCacheEntry *entry
+);
+
+/*
+ * Description : Release the video memory of the fonts before the device is reset.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * Return : void
+ */
+void
+D3D9FontCache_on_lost_device (
+	D3D9FontCache *this
+);
+
+/*
+ * Description : Restore the fonts after the device has been reset.
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * Return : void
+ */
+void
+D3D9FontCache_on_reset_device (
+	D3D9FontCache *this
+);
+
+/*
+ * Description : Get the creation counters of the cache
+ * D3D9FontCache *this : An allocated D3D9FontCache
+ * D3D9FontCacheStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9FontCache_get_stats (
+	D3D9FontCache *this,
+	D3D9FontCacheStats *stats
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9FontCache structure and release all its fonts.
+ * D3D9FontCache *this : An allocated D3D9FontCache to free.
+ */
+void
+D3D9FontCache_free (
+	D3D9FontCache *this
+);
@@ -1,136 +1,296 @@
 #include "D3D9Hook.h"
 #include "HookEngine/HookEngine.h"
-#include "Scanner/Scanner.h"
+#include "D3D9SignatureScanner.h"
+#include "D3D9SignatureCache.h"
+#include "D3D9VftableScanner.h"
+#include "D3D9MemoryPatch.h"
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <tlhelp32.h>
 
 // ---------- Debugging -------------
 #define __DEBUG_OBJECT__ "D3D9Hook"
 #include "dbg/dbg.h"
 
 
-static EnumerationStringAssociation association [D3D9INDEX_VFTABLE_SIZE] = {
-
-	[0 ... D3D9INDEX_VFTABLE_SIZE-1] = {D3D9INDEX_Undefined, "D3D9INDEX_Undefined"},
-
-	associate (D3D9INDEX_QueryInterface),
-	associate (D3D9INDEX_AddRef),
-	associate (D3D9INDEX_Release),
-	associate (D3D9INDEX_TestCooperativeLevel),
-	associate (D3D9INDEX_GetAvailableTextureMem),
-	associate (D3D9INDEX_EvictManagedResources),
-	associate (D3D9INDEX_GetDirect3D),
-	associate (D3D9INDEX_GetDeviceCaps),
-	associate (D3D9INDEX_GetDisplayMode),
-	associate (D3D9INDEX_GetCreationParameters),
-	associate (D3D9INDEX_SetCursorProperties),
-	associate (D3D9INDEX_SetCursorPosition),
-	associate (D3D9INDEX_ShowCursor),
-	associate (D3D9INDEX_CreateAdditionalSwapChain),
-	associate (D3D9INDEX_GetSwapChain),
-	associate (D3D9INDEX_GetNumberOfSwapChains),
-	associate (D3D9INDEX_Reset),
-	associate (D3D9INDEX_Present),
-	associate (D3D9INDEX_GetBackBuffer),
-	associate (D3D9INDEX_GetRasterStatus),
-	associate (D3D9INDEX_SetDialogBoxMode),
-	associate (D3D9INDEX_SetGammaRamp),
-	associate (D3D9INDEX_GetGammaRamp),
-	associate (D3D9INDEX_CreateTexture),
-	associate (D3D9INDEX_CreateVolumeTexture),
-	associate (D3D9INDEX_CreateCubeTexture),
-	associate (D3D9INDEX_CreateVertexBuffer),
-	associate (D3D9INDEX_CreateIndexBuffer),
-	associate (D3D9INDEX_CreateRenderTarget),
-	associate (D3D9INDEX_CreateDepthStencilSurface),
-	associate (D3D9INDEX_UpdateSurface),
-	associate (D3D9INDEX_UpdateTexture),
-	associate (D3D9INDEX_GetRenderTargetData),
-	associate (D3D9INDEX_GetFrontBufferData),
-	associate (D3D9INDEX_StretchRect),
-	associate (D3D9INDEX_ColorFill),
-	associate (D3D9INDEX_CreateOffscreenPlainSurface),
-	associate (D3D9INDEX_SetRenderTarget),
-	associate (D3D9INDEX_GetRenderTarget),
-	associate (D3D9INDEX_SetDepthStencilSurface),
-	associate (D3D9INDEX_GetDepthStencilSurface),
-	associate (D3D9INDEX_BeginScene),
-	associate (D3D9INDEX_EndScene),
-	associate (D3D9INDEX_Clear),
-	associate (D3D9INDEX_SetTransform),
-	associate (D3D9INDEX_GetTransform),
-	associate (D3D9INDEX_MultiplyTransform),
-	associate (D3D9INDEX_SetViewport),
-	associate (D3D9INDEX_GetViewport),
-	associate (D3D9INDEX_SetMaterial),
-	associate (D3D9INDEX_GetMaterial),
-	associate (D3D9INDEX_SetLight),
-	associate (D3D9INDEX_GetLight),
-	associate (D3D9INDEX_LightEnable),
-	associate (D3D9INDEX_GetLightEnable),
-	associate (D3D9INDEX_SetClipPlane),
-	associate (D3D9INDEX_GetClipPlane),
-	associate (D3D9INDEX_SetRenderState),
-	associate (D3D9INDEX_GetRenderState),
-	associate (D3D9INDEX_CreateStateBlock),
-	associate (D3D9INDEX_BeginStateBlock),
-	associate (D3D9INDEX_EndStateBlock),
-	associate (D3D9INDEX_SetClipStatus),
-	associate (D3D9INDEX_GetClipStatus),
-	associate (D3D9INDEX_GetTexture),
-	associate (D3D9INDEX_SetTexture),
-	associate (D3D9INDEX_GetTextureStageState),
-	associate (D3D9INDEX_SetTextureStageState),
-	associate (D3D9INDEX_GetSamplerState),
-	associate (D3D9INDEX_SetSamplerState),
-	associate (D3D9INDEX_ValidateDevice),
-	associate (D3D9INDEX_SetPaletteEntries),
-	associate (D3D9INDEX_GetPaletteEntries),
-	associate (D3D9INDEX_SetCurrentTexturePalette),
-	associate (D3D9INDEX_GetCurrentTexturePalette),
-	associate (D3D9INDEX_SetScissorRect),
-	associate (D3D9INDEX_GetScissorRect),
-	associate (D3D9INDEX_SetSoftwareVertexProcessing),
-	associate (D3D9INDEX_GetSoftwareVertexProcessing),
-	associate (D3D9INDEX_SetNPatchMode),
-	associate (D3D9INDEX_GetNPatchMode),
-	associate (D3D9INDEX_DrawPrimitive),
-	associate (D3D9INDEX_DrawIndexedPrimitive),
-	associate (D3D9INDEX_DrawPrimitiveUP),
-	associate (D3D9INDEX_DrawIndexedPrimitiveUP),
-	associate (D3D9INDEX_ProcessVertices),
-	associate (D3D9INDEX_CreateVertexDeclaration),
-	associate (D3D9INDEX_SetVertexDeclaration),
-	associate (D3D9INDEX_GetVertexDeclaration),
-	associate (D3D9INDEX_SetFVF),
-	associate (D3D9INDEX_GetFVF),
-	associate (D3D9INDEX_CreateVertexShader),
-	associate (D3D9INDEX_SetVertexShader),
-	associate (D3D9INDEX_GetVertexShader),
-	associate (D3D9INDEX_SetVertexShaderConstantF),
-	associate (D3D9INDEX_GetVertexShaderConstantF),
-	associate (D3D9INDEX_SetVertexShaderConstantI),
-	associate (D3D9INDEX_GetVertexShaderConstantI),
-	associate (D3D9INDEX_SetVertexShaderConstantB),
-	associate (D3D9INDEX_GetVertexShaderConstantB),
-	associate (D3D9INDEX_SetStreamSource),
-	associate (D3D9INDEX_GetStreamSource),
-	associate (D3D9INDEX_SetStreamSourceFreq),
-	associate (D3D9INDEX_GetStreamSourceFreq),
-	associate (D3D9INDEX_SetIndices),
-	associate (D3D9INDEX_GetIndices),
-	associate (D3D9INDEX_CreatePixelShader),
-	associate (D3D9INDEX_SetPixelShader),
-	associate (D3D9INDEX_GetPixelShader),
-	associate (D3D9INDEX_SetPixelShaderConstantF),
-	associate (D3D9INDEX_GetPixelShaderConstantF),
-	associate (D3D9INDEX_SetPixelShaderConstantI),
-	associate (D3D9INDEX_GetPixelShaderConstantI),
-	associate (D3D9INDEX_SetPixelShaderConstantB),
-	associate (D3D9INDEX_GetPixelShaderConstantB),
-	associate (D3D9INDEX_DrawRectPatch),
-	associate (D3D9INDEX_DrawTriPatch),
-	associate (D3D9INDEX_DeletePatch),
-	associate (D3D9INDEX_CreateQuery)
+// Signature searched in the d3d9 module. The masks have the format of mem_scanner.
+typedef struct {
+	char *name;
+	unsigned char *pattern;
+	char *searchMask;
+	char *resultMask;
+} D3D9HookSignature;
+
+typedef enum {
+	D3D9HOOK_SIGNATURE_DeviceVftable,
+
+	D3D9HOOK_SIGNATURES_COUNT
+} D3D9HookSignatureIndex;
+
+// All the signatures are searched in a single pass over the module
+static D3D9HookSignature signatures [D3D9HOOK_SIGNATURES_COUNT] = {
+	[D3D9HOOK_SIGNATURE_DeviceVftable] = {
+		.name = "pDeviceVftable",
+		.pattern = (unsigned char []) {
+			/*	C706 084E8C5C     mov [dword ds:esi], d3d9.5C8C4E08
+				8986 68300000     mov [dword ds:esi+3068], eax
+				8986 60300000     mov [dword ds:esi+3060], eax 		*/
+				0xC7, 0x06, '?', '?', '?', '?',
+				0x89, 0x86, '?', '?', '?', '?',
+				0x89, 0x86, '?', '?', '?', '?'
+		},
+		.searchMask =
+			"xx????"
+			"xx????"
+			"xx????",
+		.resultMask =
+			"xx????"
+			"xxxxxx"
+			"xxxxxx"
+	}
+};
+
+// Private headers
+/*
+ * Description : Get the offsets of the signatures in the module : from the signature cache if they still match there,
+ *               or by scanning the module. The offsets scanned are written in the cache for the next injection.
+ * D3D9SignatureScanner *scanner : Scanner with all the signatures compiled
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : bool true on success, false if the module can't be scanned
+ */
+static bool D3D9Hook_find_signatures (D3D9SignatureScanner *scanner, unsigned char *module, DWORD sizeOfModule, size_t *offsets);
+
+/*
+ * Description : Find the device vftable with the signatures of the constructor storing it
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found
+ */
+static DWORD * D3D9Hook_resolve_signature (unsigned char *module, DWORD sizeOfModule, D3D9VftableScanner *image);
+
+/*
+ * Description : Find the device vftable among the arrays of pointers to code fixed by the relocations of the module
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found or ambiguous
+ */
+static DWORD * D3D9Hook_resolve_relocated_arrays (unsigned char *module, DWORD sizeOfModule, D3D9VftableScanner *image);
+
+/*
+ * Description : Find the device vftable among the arrays of pointers to code in the data sections of the module
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found or ambiguous
+ */
+static DWORD * D3D9Hook_resolve_arrays (unsigned char *module, DWORD sizeOfModule, D3D9VftableScanner *image);
+
+/*
+ * Description : Get the device vftable from a device created on a hidden window, without rendering
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if the device can't be created
+ */
+static DWORD * D3D9Hook_resolve_dummy_device (unsigned char *module, DWORD sizeOfModule, D3D9VftableScanner *image);
+
+/*
+ * Description : Choose the device vftable among the arrays found by a heuristic
+ * D3D9VftableScanner *image : Headers of the module
+ * D3D9VftableCandidate *candidates : Arrays found
+ * int count : Number of arrays found, which can exceed D3D9_HOOK_VFTABLE_CANDIDATES
+ * Return : DWORD * the vftable, or NULL if none or ambiguous
+ */
+static DWORD * D3D9Hook_choose_vftable (D3D9VftableScanner *image, D3D9VftableCandidate *candidates, int count);
+
+/*
+ * Description : Suspend all the threads of the process except the current one
+ * HANDLE *threads : Output of the threads suspended
+ * int capacity : Maximum number of threads suspended
+ * Return : int the number of threads suspended
+ */
+static int D3D9Hook_suspend_threads (HANDLE *threads, int capacity);
+
+/*
+ * Description : Resume the threads suspended by D3D9Hook_suspend_threads
+ * HANDLE *threads : The threads suspended
+ * int count : Number of threads suspended
+ * Return : void
+ */
+static void D3D9Hook_resume_threads (HANDLE *threads, int count);
+
+/*
+ * Description : Check the requests of hooks and add the ones writing the shared vftable to a patch
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook
+ * int count : Number of requests
+ * D3D9MemoryPatch *patch : Output of the slots to write
+ * Return : bool true if all the requests are valid, false otherwise
+ */
+static bool D3D9Hook_prepare_hooks (D3D9Hook *this, D3D9HookRequest *requests, int count, D3D9MemoryPatch *patch);
+
+/*
+ * Description : Write the hooks prepared by D3D9Hook_prepare_hooks in the vftable and in the shadow vftables,
+ *               and fill their originals. Nothing is allocated nor logged.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook
+ * int count : Number of requests
+ * D3D9MemoryPatch *patch : The slots to write
+ * Return : bool true on success, false if the vftable can't be made writable : nothing is hooked then
+ */
+static bool D3D9Hook_commit_hooks (D3D9Hook *this, D3D9HookRequest *requests, int count, D3D9MemoryPatch *patch);
+
+/*
+ * Description : Write back the original of a hooked method in the vftable, in the shadow vftables or over the detour.
+ *               The thunk of the method, if it is called, must already call the original.
+ * D3D9Hook *this : An allocated D3D9Hook, locked
+ * D3D9VirtualFunctionTableIndex index : Index of a hooked method
+ * Return : bool true on success, false if the method can't be restored : it stays hooked then
+ */
+static bool D3D9Hook_restore (D3D9Hook *this, D3D9VirtualFunctionTableIndex index);
+
+/*
+ * Description : Check if the calls of a method go through its thunk : in inline mode, or when its hook is swappable
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method
+ * Return : bool true if the thunk calls the hook, false if the vftables point to the hook itself
+ */
+static bool D3D9Hook_uses_thunk (D3D9Hook *this, D3D9VirtualFunctionTableIndex index);
+
+/*
+ * Description : Get the address written in the vftables in place of a method
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method
+ * ULONG_PTR hookFunction : Hook of the method
+ * Return : void * the thunk of the method, or the hook called directly
+ */
+static void * D3D9Hook_get_target (D3D9Hook *this, D3D9VirtualFunctionTableIndex index, ULONG_PTR hookFunction);
+
+/*
+ * Description : Hash a name of method, FNV-1a
+ * char *name : Name of the method, without its prefix
+ * Return : unsigned int the hash of the name
+ */
+static unsigned int D3D9Hook_hash_name (char *name);
+
+/*
+ * Description : Mix the bits of a hash, so its low bits depend on all of them
+ * unsigned int hash : A hash
+ * Return : unsigned int the hash mixed
+ */
+static unsigned int D3D9Hook_mix (unsigned int hash);
+
+/*
+ * Description : Build the perfect hash of the names, placing the largest buckets first
+ * Return : bool true on success, false if a bucket can't be placed
+ */
+static bool D3D9Hook_hash_names (void);
+
+// Strategy finding the device vftable in the d3d9 module
+typedef struct {
+	char *name;
+	DWORD * (*resolve) (unsigned char *module, DWORD sizeOfModule, D3D9VftableScanner *image);
+} D3D9HookResolver;
+
+// Tried in order until one finds the vftable, the cheapest first
+static D3D9HookResolver resolvers [] = {
+	{"signature",        D3D9Hook_resolve_signature},
+	{"relocated arrays", D3D9Hook_resolve_relocated_arrays},
+	{"pointer arrays",   D3D9Hook_resolve_arrays},
+	{"dummy device",     D3D9Hook_resolve_dummy_device},
+};
+
+// Name of each method, generated from D3D9_HOOK_METHODS
+#define D3D9_HOOK_NAME(name, type, parameters) [D3D9INDEX_##name] = "D3D9INDEX_" #name,
+static char *names [D3D9INDEX_VFTABLE_SIZE] = {
+	D3D9_HOOK_METHODS (D3D9_HOOK_NAME)
+	[D3D9INDEX_Undefined] = "D3D9INDEX_Undefined"
+};
+
+// Prefix of the names, optional in D3D9VirtualFunctionTableIndex_from_string
+#define D3D9_HOOK_NAMES_PREFIX "D3D9INDEX_"
+
+// Perfect hash of the names without their prefix, built at the first lookup :
+// the first hash picks a bucket, its displacement seeds the second hash which picks a slot owned by a single name.
+static unsigned short nameDisplacements [D3D9_HOOK_NAMES_BUCKETS];
+// Index of the method + 1 in each slot, 0 if the slot is empty
+static unsigned char nameSlots [D3D9_HOOK_NAMES_SLOTS];
+static volatile bool namesHashed = false;
+static D3D9Lock namesLock = D3D9_LOCK_INITIALIZER;
+
+// Pointer sized arguments of each method, the device included : copied by its thunk
+#define D3D9_HOOK_ARGUMENTS_COUNT(name, type, parameters) [D3D9INDEX_##name] = D3D9ARGUMENTS_##name,
+static int argumentsCounts [D3D9_HOOK_VFTABLE_MIN_COUNT] = {
+	D3D9_HOOK_METHODS (D3D9_HOOK_ARGUMENTS_COUNT)
+};
+
+// Parameters of the profiled methods and arguments given to their target, by number
+#define D3D9_HOOK_PARAMETERS_1  ULONG_PTR a1
+#define D3D9_HOOK_PARAMETERS_2  D3D9_HOOK_PARAMETERS_1, ULONG_PTR a2
+#define D3D9_HOOK_PARAMETERS_3  D3D9_HOOK_PARAMETERS_2, ULONG_PTR a3
+#define D3D9_HOOK_PARAMETERS_4  D3D9_HOOK_PARAMETERS_3, ULONG_PTR a4
+#define D3D9_HOOK_PARAMETERS_5  D3D9_HOOK_PARAMETERS_4, ULONG_PTR a5
+#define D3D9_HOOK_PARAMETERS_6  D3D9_HOOK_PARAMETERS_5, ULONG_PTR a6
+#define D3D9_HOOK_PARAMETERS_7  D3D9_HOOK_PARAMETERS_6, ULONG_PTR a7
+#define D3D9_HOOK_PARAMETERS_8  D3D9_HOOK_PARAMETERS_7, ULONG_PTR a8
+#define D3D9_HOOK_PARAMETERS_9  D3D9_HOOK_PARAMETERS_8, ULONG_PTR a9
+#define D3D9_HOOK_PARAMETERS_10 D3D9_HOOK_PARAMETERS_9, ULONG_PTR a10
+#define D3D9_HOOK_ARGUMENTS_1   a1
+#define D3D9_HOOK_ARGUMENTS_2   D3D9_HOOK_ARGUMENTS_1, a2
+#define D3D9_HOOK_ARGUMENTS_3   D3D9_HOOK_ARGUMENTS_2, a3
+#define D3D9_HOOK_ARGUMENTS_4   D3D9_HOOK_ARGUMENTS_3, a4
+#define D3D9_HOOK_ARGUMENTS_5   D3D9_HOOK_ARGUMENTS_4, a5
+#define D3D9_HOOK_ARGUMENTS_6   D3D9_HOOK_ARGUMENTS_5, a6
+#define D3D9_HOOK_ARGUMENTS_7   D3D9_HOOK_ARGUMENTS_6, a7
+#define D3D9_HOOK_ARGUMENTS_8   D3D9_HOOK_ARGUMENTS_7, a8
+#define D3D9_HOOK_ARGUMENTS_9   D3D9_HOOK_ARGUMENTS_8, a9
+#define D3D9_HOOK_ARGUMENTS_10  D3D9_HOOK_ARGUMENTS_9, a10
+
+// Type returned by the profiled methods : the value of a void method is passed through as it is
+#define D3D9_HOOK_RESULT_HRESULT HRESULT
+#define D3D9_HOOK_RESULT_ULONG   ULONG
+#define D3D9_HOOK_RESULT_UINT    UINT
+#define D3D9_HOOK_RESULT_BOOL    BOOL
+#define D3D9_HOOK_RESULT_float   float
+#define D3D9_HOOK_RESULT_void    ULONG_PTR
+
+// The D3D9Hook profiled : the wrappers have no other context than their index
+static D3D9Hook *profiledHook = NULL;
+
+// Wrapper timing a method : it calls the hook it replaced, or the original, counts the call and times a sample of the calls.
+// The frame ends once the original Present returns.
+#define D3D9_HOOK_PROFILED_METHOD(name, type, parameters)                                                    \
+static D3D9_HOOK_RESULT_##type __stdcall                                                                      \
+D3D9Hook_profile_##name (                                                                                     \
+	D3D9_HOOK_CONCAT (D3D9_HOOK_PARAMETERS_, D3D9_HOOK_COUNT parameters)                                     \
+) {                                                                                                           \
+	D3D9Hook *this = profiledHook;                                                                            \
+	D3D9_HOOK_RESULT_##type (__stdcall *target) (                                                             \
+		D3D9_HOOK_CONCAT (D3D9_HOOK_PARAMETERS_, D3D9_HOOK_COUNT parameters)                                 \
+	) = this->profiledTargets [D3D9INDEX_##name] ? : this->original.slots [D3D9INDEX_##name];                 \
+                                                                                                              \
+	unsigned long long start = D3D9Profiler_start (this->profiler, D3D9INDEX_##name);                         \
+	D3D9_HOOK_RESULT_##type result =                                                                          \
+		target (D3D9_HOOK_CONCAT (D3D9_HOOK_ARGUMENTS_, D3D9_HOOK_COUNT parameters));                        \
+	D3D9Profiler_stop (this->profiler, D3D9INDEX_##name, start);                                              \
+                                                                                                              \
+	if (D3D9INDEX_##name == D3D9INDEX_Present) {                                                              \
+		D3D9Profiler_aggregate (this->profiler);                                                              \
+	}                                                                                                         \
+                                                                                                              \
+	return result;                                                                                            \
+}
+
+D3D9_HOOK_METHODS (D3D9_HOOK_PROFILED_METHOD)
+
+#define D3D9_HOOK_PROFILED_ENTRY(name, type, parameters) [D3D9INDEX_##name] = (void *) D3D9Hook_profile_##name,
+static void *profiledMethods [D3D9_HOOK_VFTABLE_MIN_COUNT] = {
+	D3D9_HOOK_METHODS (D3D9_HOOK_PROFILED_ENTRY)
 };
 
 
@@ -158,6 +318,30 @@ D3D9Hook_new (
 	return this;
 }
 
+/*
+ * Description : Allocate a new D3D9Hook structure hooking a vftable already known, without searching the d3d9 module.
+ * DWORD *vftable : The device vftable
+ * int vftableCount : Number of methods of the vftable, between D3D9_HOOK_VFTABLE_MIN_COUNT and D3D9_HOOK_VFTABLE_MAX_COUNT
+ * Return : A pointer to an allocated D3D9Hook.
+ */
+D3D9Hook *
+D3D9Hook_new_with_vftable (
+	DWORD *vftable,
+	int vftableCount
+) {
+	D3D9Hook *this;
+
+	if ((this = calloc (1, sizeof(D3D9Hook))) == NULL)
+		return NULL;
+
+	if (!D3D9Hook_init_with_vftable (this, vftable, vftableCount)) {
+		D3D9Hook_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
 /*
  * Description : Initialize an allocated D3D9Hook structure.
  * D3D9Hook *this : An allocated D3D9Hook to initialize.
@@ -171,108 +355,1266 @@ D3D9Hook_init (
 	DWORD baseAddress,
 	DWORD sizeOfModule
 ) {
-	unsigned char pattern [] = {
-		/*	C706 084E8C5C     mov [dword ds:esi], d3d9.5C8C4E08
-			8986 68300000     mov [dword ds:esi+3068], eax
-			8986 60300000     mov [dword ds:esi+3060], eax 		*/
-			0xC7, 0x06, '?', '?', '?', '?',
-			0x89, 0x86, '?', '?', '?', '?',
-			0x89, 0x86, '?', '?', '?', '?'
-	};
-
-	// Get the d3d9 device vftable
-	DWORD * pDeviceVftable = (DWORD *) mem_scanner ("pDeviceVftable",
-		baseAddress, sizeOfModule,
-		pattern,
-
-		"xx????"
-		"xx????"
-		"xx????",
-
-		"xx????"
-		"xxxxxx"
-		"xxxxxx"
-	);
-
-	if (!pDeviceVftable) {
+	unsigned char *module = (unsigned char *) baseAddress;
+	D3D9VftableScanner *image;
+	LARGE_INTEGER frequency;
+	DWORD *vftable = NULL;
+
+	// Only the heuristics need the headers of the module
+	if (!(image = D3D9VftableScanner_new (module, sizeOfModule, baseAddress))) {
+		dbg ("Cannot read the headers of the d3d9 module.");
+	}
+
+	QueryPerformanceFrequency (&frequency);
+
+	for (int index = 0; index < (int) (sizeof(resolvers) / sizeof(*resolvers)) && !vftable; index++) {
+		D3D9HookResolver *resolver = &resolvers [index];
+		LARGE_INTEGER start, end;
+
+		QueryPerformanceCounter (&start);
+		vftable = resolver->resolve (module, sizeOfModule, image);
+		QueryPerformanceCounter (&end);
+
+		long long elapsed = (end.QuadPart - start.QuadPart) * 1000000LL / frequency.QuadPart;
+
+		// Accept a vftable only if all the methods of the device point to the code of the module
+		if (vftable && image && !D3D9VftableScanner_is_array (image, (DWORD) vftable, D3D9_HOOK_VFTABLE_MIN_COUNT)) {
+			dbg ("%s : 0x%.08X isn't a device vftable (%lld us).", resolver->name, vftable, elapsed);
+			vftable = NULL;
+		}
+		else if (vftable) {
+			dbg ("%s : pDeviceVftable found at 0x%.08X (%lld us).", resolver->name, vftable, elapsed);
+		}
+		else {
+			dbg ("%s : pDeviceVftable not found (%lld us).", resolver->name, elapsed);
+		}
+	}
+
+	if (!vftable) {
+		dbg ("Cannot find the d3d9 device vftable.");
+		D3D9VftableScanner_free (image);
+		return false;
+	}
+
+	// The devices implementing IDirect3DDevice9Ex have more methods, copied too in the shadow vftables
+	int vftableCount = (image && D3D9VftableScanner_is_array (image, (DWORD) vftable, D3D9_HOOK_VFTABLE_MAX_COUNT))
+		? D3D9_HOOK_VFTABLE_MAX_COUNT : D3D9_HOOK_VFTABLE_MIN_COUNT;
+
+	D3D9VftableScanner_free (image);
+
+	return D3D9Hook_init_with_vftable (this, vftable, vftableCount);
+}
+
+/*
+ * Description : Initialize an allocated D3D9Hook structure hooking a vftable already known, without searching the d3d9 module.
+ * D3D9Hook *this : An allocated D3D9Hook to initialize.
+ * DWORD *vftable : The device vftable
+ * int vftableCount : Number of methods of the vftable, between D3D9_HOOK_VFTABLE_MIN_COUNT and D3D9_HOOK_VFTABLE_MAX_COUNT
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Hook_init_with_vftable (
+	D3D9Hook *this,
+	DWORD *vftable,
+	int vftableCount
+) {
+	if (!vftable || vftableCount < D3D9_HOOK_VFTABLE_MIN_COUNT || vftableCount > D3D9_HOOK_VFTABLE_MAX_COUNT) {
+		dbg ("Invalid device vftable : 0x%.08X, %d methods.", vftable, vftableCount);
+		return false;
+	}
+
+	this->vftable      = vftable;
+	this->vftableCount = vftableCount;
+
+	for (int index = 0; index < D3D9INDEX_VFTABLE_SIZE; index++) {
+		this->modes [index] = D3D9_HOOK_MODE_INLINE;
+	}
+
+	memset (&this->original, 0, sizeof(this->original));
+	memset (this->hooked, 0, sizeof(this->hooked));
+	memset (this->installed, 0, sizeof(this->installed));
+	memset (this->swappable, 0, sizeof(this->swappable));
+	memset (this->shadowHooks, 0, sizeof(this->shadowHooks));
+	this->shadowsCount = 0;
+
+	this->profiler = NULL;
+	memset (this->profiledTargets, 0, sizeof(this->profiledTargets));
+	memset (this->profilerHooks, 0, sizeof(this->profilerHooks));
+
+	// The hooks installed through the thunks can be swapped and unhooked once no call runs them
+	if (!(this->thunks = D3D9HookThunks_new (argumentsCounts, D3D9_HOOK_VFTABLE_MIN_COUNT))) {
+		dbg ("Cannot allocate the thunks of the hooks.");
+		return false;
+	}
+
+	return D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT)
+	    && D3D9Lock_init (&this->waitLock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+}
+
+/*
+ * Description : Find the device vftable with the signatures of the constructor storing it
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found
+ */
+static DWORD *
+D3D9Hook_resolve_signature (
+	unsigned char *module,
+	DWORD sizeOfModule,
+	D3D9VftableScanner *image
+) {
+	D3D9SignatureScanner *scanner;
+	size_t offsets [D3D9HOOK_SIGNATURES_COUNT];
+	DWORD *vftable = NULL;
+
+	if (!(scanner = D3D9SignatureScanner_new ())) {
+		dbg ("Cannot allocate the signature scanner.");
+		return NULL;
+	}
+
+	// Compile the signatures once, then search all of them in a single pass over the module
+	for (int index = 0; index < D3D9HOOK_SIGNATURES_COUNT; index++) {
+		D3D9HookSignature *signature = &signatures [index];
+
+		if (D3D9SignatureScanner_add (scanner, signature->name, signature->pattern,
+			signature->searchMask, signature->resultMask) != index) {
+			dbg ("Cannot compile the %s signature.", signature->name);
+			D3D9SignatureScanner_free (scanner);
+			return NULL;
+		}
+	}
+
+	if (!D3D9Hook_find_signatures (scanner, module, sizeOfModule, offsets)) {
+		dbg ("Cannot scan the d3d9 module.");
+	}
+	else if (offsets [D3D9HOOK_SIGNATURE_DeviceVftable] == D3D9_SIGNATURE_NOT_FOUND) {
 		dbg ("pDeviceVftable pattern not found.");
+	}
+	else {
+		vftable = (DWORD *) D3D9SignatureScanner_get_result (scanner,
+			D3D9HOOK_SIGNATURE_DeviceVftable, module, offsets [D3D9HOOK_SIGNATURE_DeviceVftable]);
+	}
+
+	D3D9SignatureScanner_free (scanner);
+
+	return vftable;
+}
+
+/*
+ * Description : Choose the device vftable among the arrays found by a heuristic
+ * D3D9VftableScanner *image : Headers of the module
+ * D3D9VftableCandidate *candidates : Arrays found
+ * int count : Number of arrays found, which can exceed D3D9_HOOK_VFTABLE_CANDIDATES
+ * Return : DWORD * the vftable, or NULL if none or ambiguous
+ */
+static DWORD *
+D3D9Hook_choose_vftable (
+	D3D9VftableScanner *image,
+	D3D9VftableCandidate *candidates,
+	int count
+) {
+	int chosen;
+
+	if (count > D3D9_HOOK_VFTABLE_CANDIDATES) {
+		dbg ("Too many arrays of pointers found : %d.", count);
+		return NULL;
+	}
+
+	if ((chosen = D3D9VftableScanner_choose (candidates, count)) == -1) {
+		if (count) {
+			dbg ("%d arrays of pointers found, none is the only one referenced by the code.", count);
+		}
+		return NULL;
+	}
+
+	return (DWORD *) (image->base + candidates [chosen].offset);
+}
+
+/*
+ * Description : Find the device vftable among the arrays of pointers to code fixed by the relocations of the module
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found or ambiguous
+ */
+static DWORD *
+D3D9Hook_resolve_relocated_arrays (
+	unsigned char *module,
+	DWORD sizeOfModule,
+	D3D9VftableScanner *image
+) {
+	D3D9VftableCandidate candidates [D3D9_HOOK_VFTABLE_CANDIDATES];
+
+	if (!image) {
+		return NULL;
+	}
+
+	return D3D9Hook_choose_vftable (image, candidates, D3D9VftableScanner_find_relocated_arrays (image,
+		D3D9_HOOK_VFTABLE_MIN_COUNT, D3D9_HOOK_VFTABLE_MAX_COUNT, candidates, D3D9_HOOK_VFTABLE_CANDIDATES));
+}
+
+/*
+ * Description : Find the device vftable among the arrays of pointers to code in the data sections of the module
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if not found or ambiguous
+ */
+static DWORD *
+D3D9Hook_resolve_arrays (
+	unsigned char *module,
+	DWORD sizeOfModule,
+	D3D9VftableScanner *image
+) {
+	D3D9VftableCandidate candidates [D3D9_HOOK_VFTABLE_CANDIDATES];
+
+	if (!image) {
+		return NULL;
+	}
+
+	return D3D9Hook_choose_vftable (image, candidates, D3D9VftableScanner_find_arrays (image,
+		D3D9_HOOK_VFTABLE_MIN_COUNT, D3D9_HOOK_VFTABLE_MAX_COUNT, candidates, D3D9_HOOK_VFTABLE_CANDIDATES));
+}
+
+/*
+ * Description : Get the device vftable from a device created on a hidden window, without rendering
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * D3D9VftableScanner *image : Headers of the module, or NULL if they can't be read
+ * Return : DWORD * the vftable, or NULL if the device can't be created
+ */
+static DWORD *
+D3D9Hook_resolve_dummy_device (
+	unsigned char *module,
+	DWORD sizeOfModule,
+	D3D9VftableScanner *image
+) {
+	D3DPRESENT_PARAMETERS parameters = {0};
+	IDirect3DDevice9 *device = NULL;
+	DWORD *vftable = NULL;
+	IDirect3D9 *d3d;
+	HWND window;
+
+	if (!(d3d = Direct3DCreate9 (D3D_SDK_VERSION))) {
+		dbg ("Cannot create the Direct3D object.");
+		return NULL;
+	}
+
+	if (!(window = CreateWindowExA (0, "STATIC", "D3D9Hook", WS_OVERLAPPEDWINDOW, 0, 0, 8, 8, NULL, NULL, NULL, NULL))) {
+		dbg ("Cannot create the window of the dummy device.");
+		d3d->lpVtbl->Release (d3d);
+		return NULL;
+	}
+
+	parameters.Windowed         = TRUE;
+	parameters.SwapEffect       = D3DSWAPEFFECT_DISCARD;
+	parameters.BackBufferFormat = D3DFMT_UNKNOWN;
+	parameters.hDeviceWindow    = window;
+
+	// A NULLREF device needs neither a driver nor a visible window
+	if (SUCCEEDED (d3d->lpVtbl->CreateDevice (d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_NULLREF, window,
+		D3DCREATE_SOFTWARE_VERTEXPROCESSING | D3DCREATE_DISABLE_DRIVER_MANAGEMENT, &parameters, &device)))
+	{
+		vftable = (DWORD *) device->lpVtbl;
+		device->lpVtbl->Release (device);
+	}
+	else {
+		dbg ("Cannot create the dummy device.");
+	}
+
+	DestroyWindow (window);
+	d3d->lpVtbl->Release (d3d);
+
+	return vftable;
+}
+
+/*
+ * Description : Get the offsets of the signatures in the module : from the signature cache if they still match there,
+ *               or by scanning the module. The offsets scanned are written in the cache for the next injection.
+ * D3D9SignatureScanner *scanner : Scanner with all the signatures compiled
+ * unsigned char *module : Base of the d3d9 module
+ * DWORD sizeOfModule : The size of the module
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : bool true on success, false if the module can't be scanned
+ */
+static bool
+D3D9Hook_find_signatures (
+	D3D9SignatureScanner *scanner,
+	unsigned char *module,
+	DWORD sizeOfModule,
+	size_t *offsets
+) {
+	char path [MAX_PATH] = "";
+	D3D9ModuleFingerprint fingerprint;
+	D3D9SignatureCache *cache;
+	bool cached = true;
+
+	// The cache is shared by all the processes hooked
+	if (GetTempPathA (sizeof(path) - sizeof(D3D9_HOOK_SIGNATURE_CACHE_NAME), path) >= sizeof(path) - sizeof(D3D9_HOOK_SIGNATURE_CACHE_NAME)) {
+		path [0] = '\0';
+	}
+	strcat (path, D3D9_HOOK_SIGNATURE_CACHE_NAME);
+
+	D3D9SignatureCache_fingerprint (module, sizeOfModule, &fingerprint);
+
+	if (!(cache = D3D9SignatureCache_new (path))) {
+		dbg ("Cannot load the signature cache %s.", path);
+	}
+
+	// A cached offset is used only if the bytes there still match the signature
+	for (int index = 0; index < D3D9HOOK_SIGNATURES_COUNT; index++) {
+		size_t offset;
+
+		if (cache
+		&&  D3D9SignatureCache_get (cache, &fingerprint, signatures [index].name, &offset)
+		&&  D3D9SignatureScanner_matches (scanner, index, module, sizeOfModule, offset)) {
+			offsets [index] = offset;
+		} else {
+			cached = false;
+		}
+	}
+
+	if (cached) {
+		dbg ("Signatures found in the cache %s.", path);
+		D3D9SignatureCache_free (cache);
+		return true;
+	}
+
+	// One thread per processor : the module is split in chunks stolen by the idle threads
+	if (D3D9SignatureScanner_find_first_parallel (scanner, module, sizeOfModule, 0, offsets) == -1) {
+		D3D9SignatureCache_free (cache);
 		return false;
 	}
 
-	dbg ("pDeviceVftable found : 0x%.08X",  pDeviceVftable);
-	this->vftable = pDeviceVftable;
+	if (cache) {
+		for (int index = 0; index < D3D9HOOK_SIGNATURES_COUNT; index++) {
+			if (offsets [index] != D3D9_SIGNATURE_NOT_FOUND) {
+				D3D9SignatureCache_set (cache, &fingerprint, signatures [index].name, offsets [index]);
+			}
+		}
+
+		if (!D3D9SignatureCache_save (cache)) {
+			dbg ("Cannot write the signature cache %s.", path);
+		}
+
+		D3D9SignatureCache_free (cache);
+	}
 
 	return true;
 }
 
-
 /*
- * Description :
+ * Description : Choose how a method is hooked. D3D9_HOOK_MODE_INLINE by default.
  * D3D9Hook *this : An allocated D3D9Hook
- * D3D9VirtualFunctionTableIndex index : Index of the function to hook
- * ULONG_PTR hookFunction : Hook function
- * Return : DWORD address of the original function hooked, or 0 if error
+ * D3D9VirtualFunctionTableIndex index : Index of the method, not hooked yet
+ * D3D9HookMode mode : The mode of the hook
+ * Return : bool true on success, false if the index is invalid or already hooked
  */
-void *
-D3D9Hook_hook (
+bool
+D3D9Hook_set_mode (
 	D3D9Hook *this,
 	D3D9VirtualFunctionTableIndex index,
-	ULONG_PTR hookFunction
+	D3D9HookMode mode
 ) {
-	if (!D3D9VirtualFunctionTableIndex_is_valid (index)) {
+	bool changed = false;
+
+	if (!D3D9VirtualFunctionTableIndex_is_valid (index) || index == D3D9INDEX_Undefined) {
 		dbg ("Invalid D3D9VirtualFunctionTableIndex : %d", index);
-		return 0;
+		return false;
 	}
 
-	char * functionName = D3D9VirtualFunctionTableIndex_to_string (index);
-	if (!HookEngine_hook (this->vftable [index], hookFunction)) {
-		dbg ("Cannot hook %s.", functionName);
-		return 0;
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The hook can't move once installed
+	if (!this->hooked [index]) {
+		this->modes [index] = mode;
+		changed = true;
 	}
 
-	void * originalFunction = (void *) HookEngine_get_original_function (hookFunction);
+	D3D9Lock_release_exclusive (&this->lock);
 
-	if (!originalFunction) {
-		dbg ("Cannot get original function for 0x%.08X.", hookFunction);
-		return 0;
+	if (!changed) {
+		dbg ("%s is already hooked : its mode can't change.", D3D9VirtualFunctionTableIndex_to_string (index));
 	}
 
-	dbg ("%s has been hooked. Original function address = 0x%.08X.", functionName, originalFunction);
-
-	return originalFunction;
+	return changed;
 }
 
 /*
- * Description : Free an allocated D3D9Hook structure.
- * D3D9Hook *this : An allocated D3D9Hook to free.
+ * Description : Choose if the hook of a method in slot or shadow mode is called through its thunk.
+ *               A swappable hook can be given to D3D9Hook_swap, and is waited for by D3D9Hook_unhook,
+ *               but each call counts itself on the way in and out. The hooks in inline mode are always swappable.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method, not hooked yet
+ * bool swappable : true to call the hook through the thunk, false to write the hook itself in the vftables (default)
+ * Return : bool true on success, false if the index is invalid or already hooked
  */
-void
-D3D9Hook_free (
-	D3D9Hook *this
+bool
+D3D9Hook_set_swappable (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	bool swappable
 ) {
-	if (this != NULL) {
-		free (this);
+	bool changed = false;
+
+	if (!D3D9VirtualFunctionTableIndex_is_valid (index) || index == D3D9INDEX_Undefined) {
+		dbg ("Invalid D3D9VirtualFunctionTableIndex : %d", index);
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	if (!this->hooked [index]) {
+		this->swappable [index] = swappable;
+		changed = true;
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	if (!changed) {
+		dbg ("%s is already hooked : it can't become swappable.", D3D9VirtualFunctionTableIndex_to_string (index));
 	}
+
+	return changed;
 }
 
 /*
- * Description : Check if a D3D9VirtualFunctionTableIndex is valid
- * D3D9VirtualFunctionTableIndex index : An allocated D3D9VirtualFunctionTableIndex
- * Return : bool true on success, false otherwise
+ * Description : Check if the calls of a method go through its thunk : in inline mode, or when its hook is swappable
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method
+ * Return : bool true if the thunk calls the hook, false if the vftables point to the hook itself
  */
-bool
-D3D9VirtualFunctionTableIndex_is_valid (
+static bool
+D3D9Hook_uses_thunk (
+	D3D9Hook *this,
 	D3D9VirtualFunctionTableIndex index
 ) {
-	return (index < D3D9INDEX_VFTABLE_SIZE
-		 && index >= 0);
+	// The wrappers of the profiler are waited for before it is freed
+	return this->modes [index] == D3D9_HOOK_MODE_INLINE
+	    || this->swappable [index]
+	    || this->profilerHooks [index];
 }
 
-
 /*
- * Description : Convert a D3D9VirtualFunctionTableIndex to string
- * D3D9VirtualFunctionTableIndex index : The D3D9VirtualFunctionTableIndex to convert
- * Return : char * the string
+ * Description : Get the address written in the vftables in place of a method
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method
+ * ULONG_PTR hookFunction : Hook of the method
+ * Return : void * the thunk of the method, or the hook called directly
+ */
+static void *
+D3D9Hook_get_target (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	ULONG_PTR hookFunction
+) {
+	if (D3D9Hook_uses_thunk (this, index)) {
+		return D3D9HookThunks_get_entry (this->thunks, index);
+	}
+
+	return (void *) hookFunction;
+}
+
+/*
+ * Description : Hook a method in the mode chosen for its index. The original is also kept in this->original.
+ *               In inline mode or once swappable, the method calls the hook through a thunk : the hook can be swapped,
+ *               and D3D9Hook_unhook waits for its calls. Otherwise the vftables point to the hook itself.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the function to hook
+ * ULONG_PTR hookFunction : Hook function
+ * Return : DWORD address of the original function hooked, or 0 if error
+ */
+void *
+D3D9Hook_hook (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	ULONG_PTR hookFunction
+) {
+	D3D9HookRequest request = {.index = index, .hookFunction = hookFunction, .originalFunction = NULL};
+	D3D9MemoryPatch *patch;
+	ULONG_PTR entry;
+	bool hooked;
+
+	if (!D3D9VirtualFunctionTableIndex_is_valid (index) || index == D3D9INDEX_Undefined) {
+		dbg ("Invalid D3D9VirtualFunctionTableIndex : %d", index);
+		return 0;
+	}
+
+	char * functionName = D3D9VirtualFunctionTableIndex_to_string (index);
+	entry = (ULONG_PTR) D3D9HookThunks_get_entry (this->thunks, index);
+
+	if (!(patch = D3D9MemoryPatch_new ())) {
+		dbg ("Cannot allocate the patch of the vftable.");
+		return 0;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	if (this->hooked [index]) {
+		dbg ("%s is already hooked.", functionName);
+		hooked = false;
+	}
+	else if (this->modes [index] == D3D9_HOOK_MODE_INLINE) {
+		// The detour jumps to the thunk, which calls the hook
+		D3D9HookThunks_swap (this->thunks, index, (void *) hookFunction);
+
+		if ((hooked = HookEngine_hook (this->vftable [index], entry))) {
+			if ((request.originalFunction = (void *) HookEngine_get_original_function (entry))) {
+				this->original.slots [index] = request.originalFunction;
+				this->installed [index] = D3D9_HOOK_MODE_INLINE;
+				this->hooked [index] = true;
+			} else {
+				// Nothing would track the detour : it is removed
+				dbg ("Cannot get original function for 0x%.08X.", hookFunction);
+				HookEngine_unhook (entry);
+				hooked = false;
+			}
+		}
+	}
+	else {
+		// A single pointer is written : the other threads don't need to be suspended
+		hooked = D3D9Hook_prepare_hooks (this, &request, 1, patch)
+		      && D3D9Hook_commit_hooks (this, &request, 1, patch);
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+	D3D9MemoryPatch_free (patch);
+
+	if (!hooked) {
+		dbg ("Cannot hook %s.", functionName);
+		return 0;
+	}
+
+	dbg ("%s has been hooked. Original function address = 0x%.08X.", functionName, request.originalFunction);
+
+	return request.originalFunction;
+}
+
+/*
+ * Description : Check the requests of hooks and add the ones writing the shared vftable to a patch
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook
+ * int count : Number of requests
+ * D3D9MemoryPatch *patch : Output of the slots to write
+ * Return : bool true if all the requests are valid, false otherwise
+ */
+static bool
+D3D9Hook_prepare_hooks (
+	D3D9Hook *this,
+	D3D9HookRequest *requests,
+	int count,
+	D3D9MemoryPatch *patch
+) {
+	for (int index = 0; index < count; index++) {
+		D3D9HookRequest *request = &requests [index];
+
+		if (!D3D9VirtualFunctionTableIndex_is_valid (request->index) || request->index == D3D9INDEX_Undefined) {
+			dbg ("Invalid D3D9VirtualFunctionTableIndex : %d", request->index);
+			return false;
+		}
+
+		char * functionName = D3D9VirtualFunctionTableIndex_to_string (request->index);
+
+		if (this->hooked [request->index]) {
+			dbg ("%s is already hooked.", functionName);
+			return false;
+		}
+
+		for (int other = 0; other < index; other++) {
+			if (requests [other].index == request->index) {
+				dbg ("%s is hooked twice in the batch.", functionName);
+				return false;
+			}
+		}
+
+		// The thunk isn't installed yet : it calls the hook as soon as the game can reach it
+		if (D3D9Hook_uses_thunk (this, request->index)) {
+			D3D9HookThunks_swap (this->thunks, request->index, (void *) request->hookFunction);
+		}
+
+		// The shadow mode writes only the shadow vftables
+		if (this->modes [request->index] != D3D9_HOOK_MODE_SHADOW
+		&&  D3D9MemoryPatch_add (patch, (void **) &this->vftable [request->index],
+				D3D9Hook_get_target (this, request->index, request->hookFunction)) == -1) {
+			dbg ("Cannot allocate the patch of %s.", functionName);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Write the hooks prepared by D3D9Hook_prepare_hooks in the vftable and in the shadow vftables,
+ *               and fill their originals. Nothing is allocated nor logged.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook
+ * int count : Number of requests
+ * D3D9MemoryPatch *patch : The slots to write
+ * Return : bool true on success, false if the vftable can't be made writable : nothing is hooked then
+ */
+static bool
+D3D9Hook_commit_hooks (
+	D3D9Hook *this,
+	D3D9HookRequest *requests,
+	int count,
+	D3D9MemoryPatch *patch
+) {
+	if (!D3D9MemoryPatch_apply (patch)) {
+		return false;
+	}
+
+	for (int index = 0; index < count; index++) {
+		D3D9HookRequest *request = &requests [index];
+		void *entry = D3D9Hook_get_target (this, request->index, request->hookFunction);
+
+		if (this->modes [request->index] == D3D9_HOOK_MODE_SHADOW) {
+			// The shadowed devices call the hook, the others keep calling the method of the shared vftable
+			request->originalFunction = (void *) this->vftable [request->index];
+			this->shadowHooks [request->index] = entry;
+		}
+		else {
+			for (int entry = 0; entry < patch->count; entry++) {
+				if (patch->entries [entry].address == (void **) &this->vftable [request->index]) {
+					request->originalFunction = patch->entries [entry].original;
+				}
+			}
+		}
+
+		// The shadow vftables are copies of the shared one : they get its hooks too
+		for (int shadow = 0; shadow < this->shadowsCount; shadow++) {
+			(void) __sync_lock_test_and_set (&this->shadows [shadow].vftable [request->index], entry);
+		}
+
+		// The batch doesn't detour : restored as a slot, the method in inline mode keeps calling its thunk
+		this->installed [request->index] = (this->modes [request->index] == D3D9_HOOK_MODE_SHADOW) ? D3D9_HOOK_MODE_SHADOW : D3D9_HOOK_MODE_SLOT;
+		this->original.slots [request->index] = request->originalFunction;
+		this->hooked [request->index] = true;
+	}
+
+	return true;
+}
+
+/*
+ * Description : Suspend all the threads of the process except the current one
+ * HANDLE *threads : Output of the threads suspended
+ * int capacity : Maximum number of threads suspended
+ * Return : int the number of threads suspended
+ */
+static int
+D3D9Hook_suspend_threads (
+	HANDLE *threads,
+	int capacity
+) {
+	THREADENTRY32 entry = {.dwSize = sizeof(THREADENTRY32)};
+	DWORD process = GetCurrentProcessId ();
+	DWORD current = GetCurrentThreadId ();
+	HANDLE snapshot;
+	int count = 0;
+
+	if ((snapshot = CreateToolhelp32Snapshot (TH32CS_SNAPTHREAD, 0)) == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+
+	// Nothing is allocated nor logged until the threads are resumed : a suspended thread can own the heap lock
+	if (Thread32First (snapshot, &entry)) {
+		do {
+			HANDLE thread;
+
+			if (entry.th32OwnerProcessID != process || entry.th32ThreadID == current) {
+				continue;
+			}
+
+			if (!(thread = OpenThread (THREAD_SUSPEND_RESUME, FALSE, entry.th32ThreadID))) {
+				continue;
+			}
+
+			if (SuspendThread (thread) == (DWORD) -1) {
+				CloseHandle (thread);
+				continue;
+			}
+
+			threads [count++] = thread;
+		} while (count < capacity && Thread32Next (snapshot, &entry));
+	}
+
+	CloseHandle (snapshot);
+
+	return count;
+}
+
+/*
+ * Description : Resume the threads suspended by D3D9Hook_suspend_threads
+ * HANDLE *threads : The threads suspended
+ * int count : Number of threads suspended
+ * Return : void
+ */
+static void
+D3D9Hook_resume_threads (
+	HANDLE *threads,
+	int count
+) {
+	for (int index = 0; index < count; index++) {
+		ResumeThread (threads [index]);
+		CloseHandle (threads [index]);
+	}
+}
+
+/*
+ * Description : Hook several methods at once by writing their slots of the vftable, or of the shadow vftables in shadow mode.
+ *               The other threads are suspended meanwhile, so the game never renders with a part of the hooks only.
+ *               The batch doesn't detour : the methods in inline mode are hooked in slot mode.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook. Their original functions are written in the requests.
+ * int count : Number of requests
+ * Return : bool true if all the methods are hooked, false if none is
+ */
+bool
+D3D9Hook_hook_batch (
+	D3D9Hook *this,
+	D3D9HookRequest *requests,
+	int count
+) {
+	HANDLE threads [D3D9_HOOK_MAX_SUSPENDED_THREADS];
+	LARGE_INTEGER frequency, start, suspended, patched, resumed;
+	D3D9MemoryPatch *patch;
+	int threadsCount;
+	bool applied;
+
+	if (!(patch = D3D9MemoryPatch_new ())) {
+		dbg ("Cannot allocate the patch of the vftable.");
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// Everything is checked and allocated before the threads are suspended
+	if (!D3D9Hook_prepare_hooks (this, requests, count, patch)) {
+		D3D9Lock_release_exclusive (&this->lock);
+		D3D9MemoryPatch_free (patch);
+		return false;
+	}
+
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&start);
+
+	threadsCount = D3D9Hook_suspend_threads (threads, D3D9_HOOK_MAX_SUSPENDED_THREADS);
+	QueryPerformanceCounter (&suspended);
+
+	applied = D3D9Hook_commit_hooks (this, requests, count, patch);
+	QueryPerformanceCounter (&patched);
+
+	D3D9Hook_resume_threads (threads, threadsCount);
+	QueryPerformanceCounter (&resumed);
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	dbg ("%d threads suspended in %lld us, %d pages patched in %lld us, threads resumed in %lld us.",
+		threadsCount, (suspended.QuadPart - start.QuadPart) * 1000000LL / frequency.QuadPart,
+		patch->pagesCount, (patched.QuadPart - suspended.QuadPart) * 1000000LL / frequency.QuadPart,
+		(resumed.QuadPart - patched.QuadPart) * 1000000LL / frequency.QuadPart);
+
+	D3D9MemoryPatch_free (patch);
+
+	if (!applied) {
+		dbg ("Cannot make the vftable writable : no method has been hooked.");
+		return false;
+	}
+
+	for (int index = 0; index < count; index++) {
+		dbg ("%s has been hooked. Original function address = 0x%.08X.",
+			D3D9VirtualFunctionTableIndex_to_string (requests [index].index), requests [index].originalFunction);
+	}
+
+	return true;
+}
+
+/*
+ * Description : Replace the hook of a method without unhooking it : the calls starting now run the new hook.
+ *               Once it returns true, the previous hook isn't running anymore and can be released.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of a method hooked in inline mode or swappable
+ * ULONG_PTR hookFunction : The new hook function. It calls the same original function.
+ * int timeout : Maximum time to wait for the calls of the previous hook, in milliseconds
+ * Return : bool true once the previous hook is finished, false if the method isn't hooked through its thunk or on timeout
+ */
+bool
+D3D9Hook_swap (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	ULONG_PTR hookFunction,
+	int timeout
+) {
+	bool hooked, swappable = false;
+
+	if (!D3D9VirtualFunctionTableIndex_is_valid (index) || index == D3D9INDEX_Undefined || !hookFunction) {
+		dbg ("Invalid D3D9VirtualFunctionTableIndex or hook : %d", index);
+		return false;
+	}
+
+	char * functionName = D3D9VirtualFunctionTableIndex_to_string (index);
+
+	D3D9Lock_acquire_exclusive (&this->waitLock);
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The thunk stays installed : the game never calls the method without a hook meanwhile
+	if ((hooked = this->hooked [index])
+	&&  (swappable = D3D9Hook_uses_thunk (this, index))) {
+		D3D9HookThunks_swap (this->thunks, index, (void *) hookFunction);
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	if (!hooked || !swappable) {
+		D3D9Lock_release_exclusive (&this->waitLock);
+		dbg ("%s isn't hooked, or its hook is called directly : it can't be swapped.", functionName);
+		return false;
+	}
+
+	// The hooks can take the lock : the calls running are waited for without it
+	if (!D3D9HookThunks_wait (this->thunks, index, timeout)) {
+		D3D9Lock_release_exclusive (&this->waitLock);
+		dbg ("The previous hook of %s is still running after %d ms.", functionName, timeout);
+		return false;
+	}
+
+	D3D9Lock_release_exclusive (&this->waitLock);
+
+	dbg ("%s hook swapped to 0x%.08X.", functionName, hookFunction);
+
+	return true;
+}
+
+/*
+ * Description : Give back its original function to a method. The calls starting now skip the hook,
+ *               then the calls running it are waited for before the method is restored.
+ *               Once it returns true, the hook isn't running anymore and the method can be hooked again.
+ *               A hook called directly, not swappable, isn't waited for : it can still be running when it returns.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of a hooked method
+ * int timeout : Maximum time to wait for the calls of the hook, in milliseconds
+ * Return : bool true on success, false if the method isn't hooked, on timeout or if it can't be restored :
+ *          the hook is skipped but the method stays hooked then, D3D9Hook_unhook can be called again.
+ */
+bool
+D3D9Hook_unhook (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	int timeout
+) {
+	bool hooked, swappable = false, restored;
+
+	if (!D3D9VirtualFunctionTableIndex_is_valid (index) || index == D3D9INDEX_Undefined) {
+		dbg ("Invalid D3D9VirtualFunctionTableIndex : %d", index);
+		return false;
+	}
+
+	char * functionName = D3D9VirtualFunctionTableIndex_to_string (index);
+
+	D3D9Lock_acquire_exclusive (&this->waitLock);
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The thunk calls the original from now on : the method works while the hook drains
+	if ((hooked = this->hooked [index])
+	&&  (swappable = D3D9Hook_uses_thunk (this, index))) {
+		D3D9HookThunks_swap (this->thunks, index, this->original.slots [index]);
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	if (!hooked) {
+		D3D9Lock_release_exclusive (&this->waitLock);
+		dbg ("%s isn't hooked.", functionName);
+		return false;
+	}
+
+	if (swappable && !D3D9HookThunks_wait (this->thunks, index, timeout)) {
+		D3D9Lock_release_exclusive (&this->waitLock);
+		dbg ("The hook of %s is still running after %d ms.", functionName, timeout);
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	restored = D3D9Hook_restore (this, index);
+	D3D9Lock_release_exclusive (&this->lock);
+
+	D3D9Lock_release_exclusive (&this->waitLock);
+
+	if (!restored) {
+		dbg ("Cannot restore %s : its hook is skipped.", functionName);
+		return false;
+	}
+
+	dbg ("%s has been unhooked.", functionName);
+
+	return true;
+}
+
+/*
+ * Description : Write back the original of a hooked method in the vftable, in the shadow vftables or over the detour.
+ *               The thunk of the method, if it is called, must already call the original.
+ * D3D9Hook *this : An allocated D3D9Hook, locked
+ * D3D9VirtualFunctionTableIndex index : Index of a hooked method
+ * Return : bool true on success, false if the method can't be restored : it stays hooked then
+ */
+static bool
+D3D9Hook_restore (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index
+) {
+	void *original = this->original.slots [index];
+	D3D9MemoryPatch *patch;
+
+	// The batch hooks the methods in inline mode as slots : they are restored as they were installed
+	switch (this->installed [index])
+	{
+		case D3D9_HOOK_MODE_INLINE:
+			// The shadow vftables point to the detoured method : nothing to write there
+			if (!HookEngine_unhook ((ULONG_PTR) D3D9HookThunks_get_entry (this->thunks, index))) {
+				return false;
+			}
+			break;
+
+		case D3D9_HOOK_MODE_SLOT:
+			if (!(patch = D3D9MemoryPatch_new ())) {
+				return false;
+			}
+
+			if (D3D9MemoryPatch_add (patch, (void **) &this->vftable [index], original) == -1
+			|| !D3D9MemoryPatch_apply (patch)) {
+				D3D9MemoryPatch_free (patch);
+				return false;
+			}
+
+			D3D9MemoryPatch_free (patch);
+
+			// The shadow vftables copied the thunk too
+			// Fall through
+
+		case D3D9_HOOK_MODE_SHADOW:
+			for (int shadow = 0; shadow < this->shadowsCount; shadow++) {
+				(void) __sync_lock_test_and_set (&this->shadows [shadow].vftable [index], original);
+			}
+			break;
+	}
+
+	// The original stays readable : a hook called directly can still be running
+	this->shadowHooks [index] = NULL;
+	this->hooked [index] = false;
+
+	return true;
+}
+
+/*
+ * Description : Unhook all the methods hooked
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * int timeout : Maximum time to wait for the calls of each hook, in milliseconds
+ * Return : bool true if all the methods are unhooked, false otherwise
+ */
+bool
+D3D9Hook_unhook_all (
+	D3D9Hook *this,
+	int timeout
+) {
+	bool unhooked = true;
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		if (this->hooked [index] && !D3D9Hook_unhook (this, index, timeout)) {
+			unhooked = false;
+		}
+	}
+
+	return unhooked;
+}
+
+/*
+ * Description : Time all the methods of the device and count their calls in a profiler, aggregated at each Present.
+ *               Every call is counted, one out of D3D9_PROFILER_SAMPLE_PERIOD on average is timed.
+ *               The methods not hooked are hooked at once, a method hooked is timed with its hook.
+ *               The methods whose hook is called directly, not swappable, aren't timed.
+ *               Only one D3D9Hook can be profiled at the same time.
+ *               /!\ The hooks mustn't be swapped nor unhooked until D3D9Hook_unprofile.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9Profiler *profiler : A profiler of D3D9_HOOK_VFTABLE_MIN_COUNT methods, indexed by D3D9VirtualFunctionTableIndex
+ * Return : bool true on success, false if another D3D9Hook is profiled or the methods can't be hooked
+ */
+bool
+D3D9Hook_profile (
+	D3D9Hook *this,
+	D3D9Profiler *profiler
+) {
+	D3D9HookRequest requests [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	int count = 0, direct = 0;
+
+	if (profiler->count < D3D9_HOOK_VFTABLE_MIN_COUNT || !__sync_bool_compare_and_swap (&profiledHook, NULL, this)) {
+		dbg ("Cannot profile : the profiler is too small, or another D3D9Hook is profiled.");
+		return false;
+	}
+
+	this->profiler = profiler;
+
+	D3D9Lock_acquire_exclusive (&this->waitLock);
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The wrappers of the methods hooked call their hook, the others are hooked in a batch
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		this->profilerHooks [index] = false;
+		this->profiledTargets [index] = NULL;
+
+		if (!this->hooked [index]) {
+			// Hooked through their thunk : D3D9Hook_unprofile waits for the wrappers
+			this->profilerHooks [index] = true;
+			requests [count++] = (D3D9HookRequest) {.index = index, .hookFunction = (ULONG_PTR) profiledMethods [index]};
+		}
+		else if (D3D9Hook_uses_thunk (this, index)) {
+			this->profiledTargets [index] = this->thunks->thunks [index].implementation;
+		}
+		else {
+			// The wrapper can't be inserted before a hook called directly
+			direct++;
+		}
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	if (count && !D3D9Hook_hook_batch (this, requests, count)) {
+		memset (this->profilerHooks, 0, sizeof(this->profilerHooks));
+		D3D9Lock_release_exclusive (&this->waitLock);
+		this->profiler = NULL;
+		profiledHook = NULL;
+		dbg ("Cannot hook the methods profiled.");
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		if (this->profiledTargets [index]) {
+			D3D9HookThunks_swap (this->thunks, index, profiledMethods [index]);
+		}
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+	D3D9Lock_release_exclusive (&this->waitLock);
+
+	// The cost per call is measured by D3D9Profiler_measure_overhead, not here : the game waits for D3D9Hook_profile
+	dbg ("%d methods profiled, %d with their hook, %d hooked directly aren't.",
+		D3D9_HOOK_VFTABLE_MIN_COUNT - direct, D3D9_HOOK_VFTABLE_MIN_COUNT - direct - count, direct);
+
+	return true;
+}
+
+/*
+ * Description : Stop timing the methods : unhook the methods hooked by D3D9Hook_profile, give back their hook to the others.
+ *               Once it returns true, the profiler isn't used anymore and can be freed.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * int timeout : Maximum time to wait for the calls of each method, in milliseconds
+ * Return : bool true on success, false if some methods are still timed : D3D9Hook_unprofile can be called again.
+ */
+bool
+D3D9Hook_unprofile (
+	D3D9Hook *this,
+	int timeout
+) {
+	bool unprofiled = true;
+
+	if (profiledHook != this) {
+		dbg ("This D3D9Hook isn't profiled.");
+		return false;
+	}
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		if (this->profilerHooks [index]) {
+			if (D3D9Hook_unhook (this, index, timeout)) {
+				this->profilerHooks [index] = false;
+			} else {
+				unprofiled = false;
+			}
+		}
+		else if (this->profiledTargets [index]) {
+			// A method unhooked meanwhile doesn't call the wrapper anymore
+			if (!this->hooked [index] || D3D9Hook_swap (this, index, (ULONG_PTR) this->profiledTargets [index], timeout)) {
+				this->profiledTargets [index] = NULL;
+			} else {
+				unprofiled = false;
+			}
+		}
+	}
+
+	if (!unprofiled) {
+		dbg ("Some methods are still profiled.");
+		return false;
+	}
+
+	this->profiler = NULL;
+	profiledHook = NULL;
+
+	return true;
+}
+
+/*
+ * Description : Install a copy of the vftable on a device, with the hooks in shadow mode.
+ *               The hooks in shadow mode added later are installed on the device too.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * IDirect3DDevice9 *device : A device using the hooked vftable
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Hook_shadow_device (
+	D3D9Hook *this,
+	IDirect3DDevice9 *device
+) {
+	void **vftable;
+
+	if (!(vftable = malloc (this->vftableCount * sizeof(void *)))) {
+		dbg ("Cannot allocate the shadow vftable.");
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	for (int index = 0; index < this->shadowsCount; index++) {
+		if (this->shadows [index].device == device) {
+			D3D9Lock_release_exclusive (&this->lock);
+			free (vftable);
+			return true;
+		}
+	}
+
+	if ((DWORD *) device->lpVtbl != this->vftable || this->shadowsCount == D3D9_HOOK_MAX_SHADOWS) {
+		D3D9Lock_release_exclusive (&this->lock);
+		dbg ("Cannot shadow the device 0x%.08X : it doesn't use the hooked vftable, or too many devices are shadowed.", device);
+		free (vftable);
+		return false;
+	}
+
+	// The methods hooked in inline or slot mode are hooked in the copy too
+	memcpy (vftable, this->vftable, this->vftableCount * sizeof(void *));
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		if (this->shadowHooks [index]) {
+			vftable [index] = this->shadowHooks [index];
+		}
+	}
+
+	D3D9HookShadow *shadow = &this->shadows [this->shadowsCount++];
+	shadow->device  = device;
+	shadow->vftable = vftable;
+
+	// The copy is complete before the device can see it
+	(void) __sync_lock_test_and_set ((void **) &device->lpVtbl, vftable);
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	dbg ("Device 0x%.08X uses the shadow vftable 0x%.08X.", device, vftable);
+
+	return true;
+}
+
+/*
+ * Description : Give back its vftable to a device given to D3D9Hook_shadow_device.
+ *               /!\ This function must be called from the DirectX thread, before the device is released.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * IDirect3DDevice9 *device : A shadowed device
+ * Return : bool true on success, false if the device isn't shadowed
+ */
+bool
+D3D9Hook_unshadow_device (
+	D3D9Hook *this,
+	IDirect3DDevice9 *device
+) {
+	void **vftable = NULL;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	for (int index = 0; index < this->shadowsCount; index++) {
+		if (this->shadows [index].device == device) {
+			vftable = this->shadows [index].vftable;
+			this->shadows [index] = this->shadows [--this->shadowsCount];
+			(void) __sync_lock_test_and_set ((void **) &device->lpVtbl, this->vftable);
+			break;
+		}
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+
+	if (!vftable) {
+		dbg ("The device 0x%.08X isn't shadowed.", device);
+		return false;
+	}
+
+	// No other thread calls the device : the shadow vftable isn't used anymore
+	free (vftable);
+
+	return true;
+}
+
+/*
+ * Description : Unhook all the methods and free an allocated D3D9Hook structure.
+ *               The thunks are kept for the lifetime of the process : a thread can be about to enter one,
+ *               or returning from one, however long the calls are waited for. They call the originals once unhooked.
+ *               The shadow vftables still installed are kept : their devices can still call through them.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook to free.
+ */
+void
+D3D9Hook_free (
+	D3D9Hook *this
+) {
+	bool released = true;
+
+	if (this == NULL) {
+		return;
+	}
+
+	if (this->thunks) {
+		released = D3D9Hook_unhook_all (this, D3D9_HOOK_UNHOOK_TIMEOUT);
+
+		// The calls which entered a thunk before its method was restored can still be running a hook
+		for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT && released; index++) {
+			released = D3D9HookThunks_wait (this->thunks, index, D3D9_HOOK_UNHOOK_TIMEOUT);
+		}
+
+		if (!released) {
+			dbg ("Some methods can't be unhooked : their hooks can still be called.");
+		}
+
+		// The thunks aren't freed : see above
+	}
+
+	// The wrappers of the profiler have been unhooked with the other hooks
+	if (released) {
+		__sync_bool_compare_and_swap (&profiledHook, this, NULL);
+	}
+
+	D3D9Lock_destroy (&this->lock);
+	D3D9Lock_destroy (&this->waitLock);
+	free (this);
+}
+
+/*
+ * Description : Check if a D3D9VirtualFunctionTableIndex is valid
+ * D3D9VirtualFunctionTableIndex index : An allocated D3D9VirtualFunctionTableIndex
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9VirtualFunctionTableIndex_is_valid (
+	D3D9VirtualFunctionTableIndex index
+) {
+	return (index < D3D9INDEX_VFTABLE_SIZE
+		 && index >= 0);
+}
+
+
+/*
+ * Description : Convert a D3D9VirtualFunctionTableIndex to string
+ * D3D9VirtualFunctionTableIndex index : The D3D9VirtualFunctionTableIndex to convert
+ * Return : char * the string
  */
 char *
 D3D9VirtualFunctionTableIndex_to_string (
@@ -282,7 +1624,168 @@ D3D9VirtualFunctionTableIndex_to_string (
 		return NULL;
 	}
 
-	return association [index].string;
+	return names [index];
+}
+
+
+/*
+ * Description : Hash a name of method, FNV-1a
+ * char *name : Name of the method, without its prefix
+ * Return : unsigned int the hash of the name
+ */
+static unsigned int
+D3D9Hook_hash_name (
+	char *name
+) {
+	unsigned int hash = 2166136261u;
+
+	for (; *name; name++) {
+		hash = (hash ^ (unsigned char) *name) * 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Description : Mix the bits of a hash, so its low bits depend on all of them
+ * unsigned int hash : A hash
+ * Return : unsigned int the hash mixed
+ */
+static unsigned int
+D3D9Hook_mix (
+	unsigned int hash
+) {
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/*
+ * Description : Build the perfect hash of the names, placing the largest buckets first
+ * Return : bool true on success, false if a bucket can't be placed
+ */
+static bool
+D3D9Hook_hash_names (
+	void
+) {
+	unsigned int hashes [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	int buckets [D3D9_HOOK_NAMES_BUCKETS][D3D9_HOOK_NAMES_BUCKET_SIZE];
+	int bucketsSizes [D3D9_HOOK_NAMES_BUCKETS] = {0};
+	int maxSize = 0;
+
+	memset (nameSlots, 0, sizeof(nameSlots));
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		hashes [index] = D3D9Hook_hash_name (names [index] + strlen (D3D9_HOOK_NAMES_PREFIX));
+		int bucket = D3D9Hook_mix (hashes [index]) % D3D9_HOOK_NAMES_BUCKETS;
+
+		if (bucketsSizes [bucket] == D3D9_HOOK_NAMES_BUCKET_SIZE) {
+			dbg ("Too many names in the bucket %d.", bucket);
+			return false;
+		}
+
+		buckets [bucket][bucketsSizes [bucket]++] = index;
+		if (bucketsSizes [bucket] > maxSize) {
+			maxSize = bucketsSizes [bucket];
+		}
+	}
+
+	// The largest buckets have the fewest displacements available : they are placed while the slots are empty
+	for (int size = maxSize; size > 0; size--)
+	for (int bucket = 0; bucket < D3D9_HOOK_NAMES_BUCKETS; bucket++)
+	{
+		if (bucketsSizes [bucket] != size) {
+			continue;
+		}
+
+		bool placed = false;
+
+		for (unsigned int displacement = 0; displacement <= USHRT_MAX && !placed; displacement++)
+		{
+			int slots [D3D9_HOOK_NAMES_BUCKET_SIZE];
+			placed = true;
+
+			for (int member = 0; member < size && placed; member++) {
+				slots [member] = D3D9Hook_mix (hashes [buckets [bucket][member]] ^ ((displacement + 1) * 0x9E3779B9u)) % D3D9_HOOK_NAMES_SLOTS;
+				placed = (nameSlots [slots [member]] == 0);
+
+				// Two names of the bucket can't share a slot either
+				for (int previous = 0; previous < member && placed; previous++) {
+					placed = (slots [previous] != slots [member]);
+				}
+			}
+
+			if (placed) {
+				nameDisplacements [bucket] = displacement;
+
+				for (int member = 0; member < size; member++) {
+					nameSlots [slots [member]] = buckets [bucket][member] + 1;
+				}
+			}
+		}
+
+		if (!placed) {
+			dbg ("The bucket %d of the names can't be placed.", bucket);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Find a method by its name
+ * char *name : Name of the method, with or without the D3D9INDEX_ prefix : "SetRenderState" or "D3D9INDEX_SetRenderState"
+ * Return : D3D9VirtualFunctionTableIndex the index of the method, D3D9INDEX_Undefined if unknown
+ */
+D3D9VirtualFunctionTableIndex
+D3D9VirtualFunctionTableIndex_from_string (
+	char *name
+) {
+	if (!name) {
+		return D3D9INDEX_Undefined;
+	}
+
+	if (strncmp (name, D3D9_HOOK_NAMES_PREFIX, strlen (D3D9_HOOK_NAMES_PREFIX)) == 0) {
+		name += strlen (D3D9_HOOK_NAMES_PREFIX);
+	}
+
+	if (!__atomic_load_n (&namesHashed, __ATOMIC_ACQUIRE))
+	{
+		D3D9Lock_acquire_exclusive (&namesLock);
+
+		if (!namesHashed && D3D9Hook_hash_names ()) {
+			__atomic_store_n (&namesHashed, true, __ATOMIC_RELEASE);
+		}
+
+		D3D9Lock_release_exclusive (&namesLock);
+	}
+
+	if (!namesHashed) {
+		// The hash can't be built : compare all the names
+		for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+			if (strcmp (names [index] + strlen (D3D9_HOOK_NAMES_PREFIX), name) == 0) {
+				return index;
+			}
+		}
+
+		return D3D9INDEX_Undefined;
+	}
+
+	unsigned int hash = D3D9Hook_hash_name (name);
+	unsigned int displacement = nameDisplacements [D3D9Hook_mix (hash) % D3D9_HOOK_NAMES_BUCKETS];
+	int slot = nameSlots [D3D9Hook_mix (hash ^ ((displacement + 1) * 0x9E3779B9u)) % D3D9_HOOK_NAMES_SLOTS];
+
+	// A single name can be in this slot : any other name is unknown
+	if (slot == 0 || strcmp (names [slot - 1] + strlen (D3D9_HOOK_NAMES_PREFIX), name) != 0) {
+		return D3D9INDEX_Undefined;
+	}
+
+	return slot - 1;
 }
 
 
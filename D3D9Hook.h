@@ -5,144 +5,139 @@
 #include "Utils/Utils.h"
 #include "dx/d3d9.h"
 #include "dx/d3dx9.h"
+#include "D3D9Lock.h"
+#include "D3D9HookThunks.h"
+#include "D3D9Profiler.h"
+#include "D3D9HookMethods.h"
 
 // ---------- Defines -------------
-
+// Name of the file keeping the offsets of the signatures between two injections, in the temporary directory
+#define D3D9_HOOK_SIGNATURE_CACHE_NAME "D3D9Hook.cache"
+// The device vftable has one pointer per method of IDirect3DDevice9, or of IDirect3DDevice9Ex which extends it
+#define D3D9_HOOK_VFTABLE_MIN_COUNT    119
+#define D3D9_HOOK_VFTABLE_MAX_COUNT    134
+// Arrays of pointers kept by the vftable heuristics
+#define D3D9_HOOK_VFTABLE_CANDIDATES   16
+// Threads of the process beyond this count aren't suspended while a batch of hooks is applied
+#define D3D9_HOOK_MAX_SUSPENDED_THREADS 1024
+// Devices with a shadow vftable at the same time
+#define D3D9_HOOK_MAX_SHADOWS          8
+// Time D3D9Hook_free waits for the calls running in the hooks, in milliseconds
+#define D3D9_HOOK_UNHOOK_TIMEOUT       1000
+// Perfect hash of the names of the methods : buckets of the first hash, slots of the second, methods per bucket
+#define D3D9_HOOK_NAMES_BUCKETS        64
+#define D3D9_HOOK_NAMES_SLOTS          128
+#define D3D9_HOOK_NAMES_BUCKET_SIZE    16
 
 // ------ Structure declaration -------
-typedef struct _D3D9Hook
-{
-	DWORD *vftable;
-
-}	D3D9Hook;
-
+#define D3D9_HOOK_INDEX(name, type, parameters) D3D9INDEX_##name,
 typedef enum
 {
-	D3D9INDEX_QueryInterface, // 0
-	D3D9INDEX_AddRef, // 1
-	D3D9INDEX_Release, // 2
-	D3D9INDEX_TestCooperativeLevel, // 3
-	D3D9INDEX_GetAvailableTextureMem, // 4
-	D3D9INDEX_EvictManagedResources, // 5
-	D3D9INDEX_GetDirect3D, // 6
-	D3D9INDEX_GetDeviceCaps, // 7
-	D3D9INDEX_GetDisplayMode, // 8
-	D3D9INDEX_GetCreationParameters, // 9
-	D3D9INDEX_SetCursorProperties, // 10
-	D3D9INDEX_SetCursorPosition, // 11
-	D3D9INDEX_ShowCursor, // 12
-	D3D9INDEX_CreateAdditionalSwapChain, // 13
-	D3D9INDEX_GetSwapChain, // 14
-	D3D9INDEX_GetNumberOfSwapChains, // 15
-	D3D9INDEX_Reset, // 16
-	D3D9INDEX_Present, // 17
-	D3D9INDEX_GetBackBuffer, // 18
-	D3D9INDEX_GetRasterStatus, // 19
-	D3D9INDEX_SetDialogBoxMode, // 20
-	D3D9INDEX_SetGammaRamp, // 21
-	D3D9INDEX_GetGammaRamp, // 22
-	D3D9INDEX_CreateTexture, // 23
-	D3D9INDEX_CreateVolumeTexture, // 24
-	D3D9INDEX_CreateCubeTexture, // 25
-	D3D9INDEX_CreateVertexBuffer, // 26
-	D3D9INDEX_CreateIndexBuffer, // 27
-	D3D9INDEX_CreateRenderTarget, // 28
-	D3D9INDEX_CreateDepthStencilSurface, // 29
-	D3D9INDEX_UpdateSurface, // 30
-	D3D9INDEX_UpdateTexture, // 31
-	D3D9INDEX_GetRenderTargetData, // 32
-	D3D9INDEX_GetFrontBufferData, // 33
-	D3D9INDEX_StretchRect, // 34
-	D3D9INDEX_ColorFill, // 35
-	D3D9INDEX_CreateOffscreenPlainSurface, // 36
-	D3D9INDEX_SetRenderTarget, // 37
-	D3D9INDEX_GetRenderTarget, // 38
-	D3D9INDEX_SetDepthStencilSurface, // 39
-	D3D9INDEX_GetDepthStencilSurface, // 40
-	D3D9INDEX_BeginScene, // 41
-	D3D9INDEX_EndScene, // 42
-	D3D9INDEX_Clear, // 43
-	D3D9INDEX_SetTransform, // 44
-	D3D9INDEX_GetTransform, // 45
-	D3D9INDEX_MultiplyTransform, // 46
-	D3D9INDEX_SetViewport, // 47
-	D3D9INDEX_GetViewport, // 48
-	D3D9INDEX_SetMaterial, // 49
-	D3D9INDEX_GetMaterial, // 50
-	D3D9INDEX_SetLight, // 51
-	D3D9INDEX_GetLight, // 52
-	D3D9INDEX_LightEnable, // 53
-	D3D9INDEX_GetLightEnable, // 54
-	D3D9INDEX_SetClipPlane, // 55
-	D3D9INDEX_GetClipPlane, // 56
-	D3D9INDEX_SetRenderState, // 57
-	D3D9INDEX_GetRenderState, // 58
-	D3D9INDEX_CreateStateBlock, // 59
-	D3D9INDEX_BeginStateBlock, // 60
-	D3D9INDEX_EndStateBlock, // 61
-	D3D9INDEX_SetClipStatus, // 62
-	D3D9INDEX_GetClipStatus, // 63
-	D3D9INDEX_GetTexture, // 64
-	D3D9INDEX_SetTexture, // 65
-	D3D9INDEX_GetTextureStageState, // 66
-	D3D9INDEX_SetTextureStageState, // 67
-	D3D9INDEX_GetSamplerState, // 68
-	D3D9INDEX_SetSamplerState, // 69
-	D3D9INDEX_ValidateDevice, // 70
-	D3D9INDEX_SetPaletteEntries, // 71
-	D3D9INDEX_GetPaletteEntries, // 72
-	D3D9INDEX_SetCurrentTexturePalette, // 73
-	D3D9INDEX_GetCurrentTexturePalette, // 74
-	D3D9INDEX_SetScissorRect, // 75
-	D3D9INDEX_GetScissorRect, // 76
-	D3D9INDEX_SetSoftwareVertexProcessing, // 77
-	D3D9INDEX_GetSoftwareVertexProcessing, // 78
-	D3D9INDEX_SetNPatchMode, // 79
-	D3D9INDEX_GetNPatchMode, // 80
-	D3D9INDEX_DrawPrimitive, // 81
-	D3D9INDEX_DrawIndexedPrimitive, // 82
-	D3D9INDEX_DrawPrimitiveUP, // 83
-	D3D9INDEX_DrawIndexedPrimitiveUP, // 84
-	D3D9INDEX_ProcessVertices, // 85
-	D3D9INDEX_CreateVertexDeclaration, // 86
-	D3D9INDEX_SetVertexDeclaration, // 87
-	D3D9INDEX_GetVertexDeclaration, // 88
-	D3D9INDEX_SetFVF, // 89
-	D3D9INDEX_GetFVF, // 90
-	D3D9INDEX_CreateVertexShader, // 91
-	D3D9INDEX_SetVertexShader, // 92
-	D3D9INDEX_GetVertexShader, // 93
-	D3D9INDEX_SetVertexShaderConstantF, // 94
-	D3D9INDEX_GetVertexShaderConstantF, // 95
-	D3D9INDEX_SetVertexShaderConstantI, // 96
-	D3D9INDEX_GetVertexShaderConstantI, // 97
-	D3D9INDEX_SetVertexShaderConstantB, // 98
-	D3D9INDEX_GetVertexShaderConstantB, // 99
-	D3D9INDEX_SetStreamSource, // 100
-	D3D9INDEX_GetStreamSource, // 101
-	D3D9INDEX_SetStreamSourceFreq, // 102
-	D3D9INDEX_GetStreamSourceFreq, // 103
-	D3D9INDEX_SetIndices, // 104
-	D3D9INDEX_GetIndices, // 105
-	D3D9INDEX_CreatePixelShader, // 106
-	D3D9INDEX_SetPixelShader, // 107
-	D3D9INDEX_GetPixelShader, // 108
-	D3D9INDEX_SetPixelShaderConstantF, // 109
-	D3D9INDEX_GetPixelShaderConstantF, // 110
-	D3D9INDEX_SetPixelShaderConstantI, // 111
-	D3D9INDEX_GetPixelShaderConstantI, // 112
-	D3D9INDEX_SetPixelShaderConstantB, // 113
-	D3D9INDEX_GetPixelShaderConstantB, // 114
-	D3D9INDEX_DrawRectPatch, // 115
-	D3D9INDEX_DrawTriPatch, // 116
-	D3D9INDEX_DeletePatch, // 117
-	D3D9INDEX_CreateQuery, // 118
+	D3D9_HOOK_METHODS (D3D9_HOOK_INDEX)
 
 	D3D9INDEX_Undefined, // Unknown index
 	D3D9INDEX_VFTABLE_SIZE // Always at the end
 
 } D3D9VirtualFunctionTableIndex;
 
+_Static_assert (D3D9INDEX_Undefined == D3D9_HOOK_VFTABLE_MIN_COUNT, "D3D9_HOOK_METHODS lists all the methods of IDirect3DDevice9");
+
+// Pointer sized arguments of each method, the device included : D3D9ARGUMENTS_SetRenderState is 3
+#define D3D9_HOOK_ARGUMENTS(name, type, parameters) D3D9ARGUMENTS_##name = D3D9_HOOK_COUNT parameters,
+enum
+{
+	D3D9_HOOK_METHODS (D3D9_HOOK_ARGUMENTS)
+};
+
+// Signature of each method, shared by its hook and its original : D3D9Method_SetRenderState
+#define D3D9_HOOK_METHOD_TYPE(name, type, parameters) typedef type (__stdcall *D3D9Method_##name) parameters;
+D3D9_HOOK_METHODS (D3D9_HOOK_METHOD_TYPE)
+
+// Hook a method with a function of its signature, checked by the compiler.
+// Return : D3D9Method_<name> the original function, NULL if error
+#define D3D9Hook_hook_method(this, name, hookFunction) \
+	((D3D9Method_##name) D3D9Hook_hook ((this), D3D9INDEX_##name, (ULONG_PTR) (D3D9Method_##name) {hookFunction}))
+
+// Original function of a hooked method, with its signature : D3D9Hook_get_original (hook, Present) (pDevice, NULL, NULL, NULL, NULL)
+#define D3D9Hook_get_original(this, name) \
+	((D3D9Method_##name) (this)->original.slots [D3D9INDEX_##name])
+
+// Method of the device to hook with D3D9Hook_hook_batch
+typedef struct
+{
+	D3D9VirtualFunctionTableIndex index;
+	ULONG_PTR hookFunction;
+
+	// Output : address of the original method
+	void *originalFunction;
+
+}	D3D9HookRequest;
+
+// How a method is hooked, chosen per index with D3D9Hook_set_mode
+typedef enum
+{
+	// Detour of the method with HookEngine : catches all the calls, but costs a jump to the hook and one back to the original
+	D3D9_HOOK_MODE_INLINE,
+	// Pointer swapped in the vftable shared by the devices : no trampoline, catches only the calls through the vftable.
+	// The vftable points to the hook itself, unless it is made swappable with D3D9Hook_set_swappable.
+	D3D9_HOOK_MODE_SLOT,
+	// Pointer swapped in a copy of the vftable, installed on each device given to D3D9Hook_shadow_device, swappable the same way
+	D3D9_HOOK_MODE_SHADOW
+
+}	D3D9HookMode;
+
+// Original methods of the device, by index or typed : original.methods.SetRenderState (pDevice, state, value)
+typedef union
+{
+	void *slots [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	IDirect3DDevice9Vtbl methods;
+
+}	D3D9HookDispatchTable;
+
+// Copy of the vftable installed on a device
+typedef struct
+{
+	IDirect3DDevice9 *device;
+	void **vftable;
+
+}	D3D9HookShadow;
+
+typedef struct _D3D9Hook
+{
+	DWORD *vftable;
+	// Number of methods of the vftable, more if the devices implement IDirect3DDevice9Ex
+	int vftableCount;
+
+	D3D9HookMode modes [D3D9INDEX_VFTABLE_SIZE];
+	// Original of each method hooked once, NULL if never hooked. Kept once unhooked, for the hooks still running.
+	D3D9HookDispatchTable original;
+	// Methods hooked now, and the mode they were installed in : the batch hooks the methods in inline mode as slots
+	bool hooked [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookMode installed [D3D9_HOOK_VFTABLE_MIN_COUNT];
+
+	// One thunk per method : installed in place of the method, it calls the hook and counts the calls running.
+	// Never freed : a thread can enter a thunk at any time once it has been installed.
+	D3D9HookThunks *thunks;
+	// Methods in slot or shadow mode calling their hook through their thunk. The others call it directly.
+	bool swappable [D3D9_HOOK_VFTABLE_MIN_COUNT];
+
+	// Thunks installed in the shadow vftables, NULL for the methods not hooked in shadow mode
+	void *shadowHooks [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookShadow shadows [D3D9_HOOK_MAX_SHADOWS];
+	int shadowsCount;
+
+	// Protects the hooks and the shadows, which can be changed from the DirectX thread
+	D3D9Lock lock;
+	// Serializes the swaps and the unhooks, which wait for the calls running without holding the lock
+	D3D9Lock waitLock;
+
+	// Profiler fed by D3D9Hook_profile, NULL if the methods aren't profiled
+	D3D9Profiler *profiler;
+	// Hook called by the profiler for the methods hooked before, NULL for the methods it hooked itself
+	void *profiledTargets [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	bool profilerHooks [D3D9_HOOK_VFTABLE_MIN_COUNT];
+
+}	D3D9Hook;
 
 // --------- Allocators ---------
 
@@ -158,6 +153,18 @@ D3D9Hook_new (
 	DWORD sizeOfModule
 );
 
+/*
+ * Description : Allocate a new D3D9Hook structure hooking a vftable already known, without searching the d3d9 module.
+ * DWORD *vftable : The device vftable
+ * int vftableCount : Number of methods of the vftable, between D3D9_HOOK_VFTABLE_MIN_COUNT and D3D9_HOOK_VFTABLE_MAX_COUNT
+ * Return : A pointer to an allocated D3D9Hook.
+ */
+D3D9Hook *
+D3D9Hook_new_with_vftable (
+	DWORD *vftable,
+	int vftableCount
+);
+
 // ----------- Functions ------------
 
 /*
@@ -173,9 +180,55 @@ D3D9Hook_init (
 	DWORD sizeOfModule
 );
 
+/*
+ * Description : Initialize an allocated D3D9Hook structure hooking a vftable already known, without searching the d3d9 module.
+ * D3D9Hook *this : An allocated D3D9Hook to initialize.
+ * DWORD *vftable : The device vftable
+ * int vftableCount : Number of methods of the vftable, between D3D9_HOOK_VFTABLE_MIN_COUNT and D3D9_HOOK_VFTABLE_MAX_COUNT
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Hook_init_with_vftable (
+	D3D9Hook *this,
+	DWORD *vftable,
+	int vftableCount
+);
+
+
+/*
+ * Description : Choose how a method is hooked. D3D9_HOOK_MODE_INLINE by default.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method, not hooked yet
+ * D3D9HookMode mode : The mode of the hook
+ * Return : bool true on success, false if the index is invalid or already hooked
+ */
+bool
+D3D9Hook_set_mode (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	D3D9HookMode mode
+);
+
+/*
+ * Description : Choose if the hook of a method in slot or shadow mode is called through its thunk.
+ *               A swappable hook can be given to D3D9Hook_swap, and is waited for by D3D9Hook_unhook,
+ *               but each call counts itself on the way in and out. The hooks in inline mode are always swappable.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of the method, not hooked yet
+ * bool swappable : true to call the hook through the thunk, false to write the hook itself in the vftables (default)
+ * Return : bool true on success, false if the index is invalid or already hooked
+ */
+bool
+D3D9Hook_set_swappable (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	bool swappable
+);
 
 /*
- * Description :
+ * Description : Hook a method in the mode chosen for its index. The original is also kept in this->original.
+ *               In inline mode or once swappable, the method calls the hook through a thunk : the hook can be swapped,
+ *               and D3D9Hook_unhook waits for its calls. Otherwise the vftables point to the hook itself.
  * D3D9Hook *this : An allocated D3D9Hook
  * D3D9VirtualFunctionTableIndex index : Index of the function to hook
  * ULONG_PTR hookFunction : Hook function
@@ -188,6 +241,129 @@ D3D9Hook_hook (
 	ULONG_PTR hookFunction
 );
 
+/*
+ * Description : Hook several methods at once by writing their slots of the vftable, or of the shadow vftables in shadow mode.
+ *               The other threads are suspended meanwhile, so the game never renders with a part of the hooks only.
+ *               The batch doesn't detour : the methods in inline mode are hooked in slot mode.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9HookRequest *requests : Methods to hook. Their original functions are written in the requests.
+ * int count : Number of requests
+ * Return : bool true if all the methods are hooked, false if none is
+ */
+bool
+D3D9Hook_hook_batch (
+	D3D9Hook *this,
+	D3D9HookRequest *requests,
+	int count
+);
+
+/*
+ * Description : Replace the hook of a method without unhooking it : the calls starting now run the new hook.
+ *               Once it returns true, the previous hook isn't running anymore and can be released.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of a method hooked in inline mode or swappable
+ * ULONG_PTR hookFunction : The new hook function. It calls the same original function.
+ * int timeout : Maximum time to wait for the calls of the previous hook, in milliseconds
+ * Return : bool true once the previous hook is finished, false if the method isn't hooked through its thunk or on timeout
+ */
+bool
+D3D9Hook_swap (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	ULONG_PTR hookFunction,
+	int timeout
+);
+
+/*
+ * Description : Give back its original function to a method. The calls starting now skip the hook,
+ *               then the calls running it are waited for before the method is restored.
+ *               Once it returns true, the hook isn't running anymore and the method can be hooked again.
+ *               A hook called directly, not swappable, isn't waited for : it can still be running when it returns.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9VirtualFunctionTableIndex index : Index of a hooked method
+ * int timeout : Maximum time to wait for the calls of the hook, in milliseconds
+ * Return : bool true on success, false if the method isn't hooked, on timeout or if it can't be restored :
+ *          the hook is skipped but the method stays hooked then, D3D9Hook_unhook can be called again.
+ */
+bool
+D3D9Hook_unhook (
+	D3D9Hook *this,
+	D3D9VirtualFunctionTableIndex index,
+	int timeout
+);
+
+/*
+ * Description : Unhook all the methods hooked
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * int timeout : Maximum time to wait for the calls of each hook, in milliseconds
+ * Return : bool true if all the methods are unhooked, false otherwise
+ */
+bool
+D3D9Hook_unhook_all (
+	D3D9Hook *this,
+	int timeout
+);
+
+/*
+ * Description : Time all the methods of the device and count their calls in a profiler, aggregated at each Present.
+ *               Every call is counted, one out of D3D9_PROFILER_SAMPLE_PERIOD on average is timed.
+ *               The methods not hooked are hooked at once, a method hooked is timed with its hook.
+ *               The methods whose hook is called directly, not swappable, aren't timed.
+ *               Only one D3D9Hook can be profiled at the same time.
+ *               /!\ The hooks mustn't be swapped nor unhooked until D3D9Hook_unprofile.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * D3D9Profiler *profiler : A profiler of D3D9_HOOK_VFTABLE_MIN_COUNT methods, indexed by D3D9VirtualFunctionTableIndex
+ * Return : bool true on success, false if another D3D9Hook is profiled or the methods can't be hooked
+ */
+bool
+D3D9Hook_profile (
+	D3D9Hook *this,
+	D3D9Profiler *profiler
+);
+
+/*
+ * Description : Stop timing the methods : unhook the methods hooked by D3D9Hook_profile, give back their hook to the others.
+ *               Once it returns true, the profiler isn't used anymore and can be freed.
+ *               /!\ This function must not be called from a hook.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * int timeout : Maximum time to wait for the calls of each method, in milliseconds
+ * Return : bool true on success, false if some methods are still timed : D3D9Hook_unprofile can be called again.
+ */
+bool
+D3D9Hook_unprofile (
+	D3D9Hook *this,
+	int timeout
+);
+
+/*
+ * Description : Install a copy of the vftable on a device, with the hooks in shadow mode.
+ *               The hooks in shadow mode added later are installed on the device too.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * IDirect3DDevice9 *device : A device using the hooked vftable
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Hook_shadow_device (
+	D3D9Hook *this,
+	IDirect3DDevice9 *device
+);
+
+/*
+ * Description : Give back its vftable to a device given to D3D9Hook_shadow_device.
+ *               /!\ This function must be called from the DirectX thread, before the device is released.
+ * D3D9Hook *this : An allocated D3D9Hook
+ * IDirect3DDevice9 *device : A shadowed device
+ * Return : bool true on success, false if the device isn't shadowed
+ */
+bool
+D3D9Hook_unshadow_device (
+	D3D9Hook *this,
+	IDirect3DDevice9 *device
+);
+
 /*
  * Description : Unit tests checking if a D3D9Hook is coherent
  * D3D9Hook *this : The instance to test
@@ -208,6 +384,16 @@ D3D9VirtualFunctionTableIndex_to_string (
 	D3D9VirtualFunctionTableIndex index
 );
 
+/*
+ * Description : Find a method by its name
+ * char *name : Name of the method, with or without the D3D9INDEX_ prefix : "SetRenderState" or "D3D9INDEX_SetRenderState"
+ * Return : D3D9VirtualFunctionTableIndex the index of the method, D3D9INDEX_Undefined if unknown
+ */
+D3D9VirtualFunctionTableIndex
+D3D9VirtualFunctionTableIndex_from_string (
+	char *name
+);
+
 /*
  * Description : Check if a D3D9VirtualFunctionTableIndex is valid
  * D3D9VirtualFunctionTableIndex index : An allocated D3D9VirtualFunctionTableIndex
@@ -221,7 +407,11 @@ D3D9VirtualFunctionTableIndex_is_valid (
 // --------- Destructors ----------
 
 /*
- * Description : Free an allocated D3D9Hook structure.
+ * Description : Unhook all the methods and free an allocated D3D9Hook structure.
+ *               The thunks are kept for the lifetime of the process : a thread can be about to enter one,
+ *               or returning from one, however long the calls are waited for. They call the originals once unhooked.
+ *               The shadow vftables still installed are kept : their devices can still call through them.
+ *               /!\ This function must not be called from a hook.
  * D3D9Hook *this : An allocated D3D9Hook to free.
  */
 void
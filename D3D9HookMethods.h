@@ -0,0 +1,137 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "dx/d3d9.h"
+
+// ---------- Defines -------------
+// Number of parameters in a list, up to 10 : D3D9_HOOK_COUNT (IDirect3DDevice9 *, DWORD) is 2
+#define D3D9_HOOK_COUNT(...) D3D9_HOOK_COUNT_N (__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define D3D9_HOOK_COUNT_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, count, ...) count
+
+// Paste two tokens once they are expanded
+#define D3D9_HOOK_CONCAT(left, right) D3D9_HOOK_CONCAT_ (left, right)
+#define D3D9_HOOK_CONCAT_(left, right) left##right
+
+// The methods of IDirect3DDevice9 in the order of the vftable : name, type returned, parameters with the device.
+// Everything describing a method is generated from this list : X (name, type, parameters) is expanded once per method.
+#define D3D9_HOOK_METHODS(X) \
+	X (QueryInterface, HRESULT, (IDirect3DDevice9 *, REFIID, void **)) \
+	X (AddRef, ULONG, (IDirect3DDevice9 *)) \
+	X (Release, ULONG, (IDirect3DDevice9 *)) \
+	X (TestCooperativeLevel, HRESULT, (IDirect3DDevice9 *)) \
+	X (GetAvailableTextureMem, UINT, (IDirect3DDevice9 *)) \
+	X (EvictManagedResources, HRESULT, (IDirect3DDevice9 *)) \
+	X (GetDirect3D, HRESULT, (IDirect3DDevice9 *, IDirect3D9 **)) \
+	X (GetDeviceCaps, HRESULT, (IDirect3DDevice9 *, D3DCAPS9 *)) \
+	X (GetDisplayMode, HRESULT, (IDirect3DDevice9 *, UINT, D3DDISPLAYMODE *)) \
+	X (GetCreationParameters, HRESULT, (IDirect3DDevice9 *, D3DDEVICE_CREATION_PARAMETERS *)) \
+	X (SetCursorProperties, HRESULT, (IDirect3DDevice9 *, UINT, UINT, IDirect3DSurface9 *)) \
+	X (SetCursorPosition, void, (IDirect3DDevice9 *, int, int, DWORD)) \
+	X (ShowCursor, BOOL, (IDirect3DDevice9 *, BOOL)) \
+	X (CreateAdditionalSwapChain, HRESULT, (IDirect3DDevice9 *, D3DPRESENT_PARAMETERS *, IDirect3DSwapChain9 **)) \
+	X (GetSwapChain, HRESULT, (IDirect3DDevice9 *, UINT, IDirect3DSwapChain9 **)) \
+	X (GetNumberOfSwapChains, UINT, (IDirect3DDevice9 *)) \
+	X (Reset, HRESULT, (IDirect3DDevice9 *, D3DPRESENT_PARAMETERS *)) \
+	X (Present, HRESULT, (IDirect3DDevice9 *, CONST RECT *, CONST RECT *, HWND, CONST RGNDATA *)) \
+	X (GetBackBuffer, HRESULT, (IDirect3DDevice9 *, UINT, UINT, D3DBACKBUFFER_TYPE, IDirect3DSurface9 **)) \
+	X (GetRasterStatus, HRESULT, (IDirect3DDevice9 *, UINT, D3DRASTER_STATUS *)) \
+	X (SetDialogBoxMode, HRESULT, (IDirect3DDevice9 *, BOOL)) \
+	X (SetGammaRamp, void, (IDirect3DDevice9 *, UINT, DWORD, CONST D3DGAMMARAMP *)) \
+	X (GetGammaRamp, void, (IDirect3DDevice9 *, UINT, D3DGAMMARAMP *)) \
+	X (CreateTexture, HRESULT, (IDirect3DDevice9 *, UINT, UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DTexture9 **, HANDLE *)) \
+	X (CreateVolumeTexture, HRESULT, (IDirect3DDevice9 *, UINT, UINT, UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DVolumeTexture9 **, HANDLE *)) \
+	X (CreateCubeTexture, HRESULT, (IDirect3DDevice9 *, UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DCubeTexture9 **, HANDLE *)) \
+	X (CreateVertexBuffer, HRESULT, (IDirect3DDevice9 *, UINT, DWORD, DWORD, D3DPOOL, IDirect3DVertexBuffer9 **, HANDLE *)) \
+	X (CreateIndexBuffer, HRESULT, (IDirect3DDevice9 *, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DIndexBuffer9 **, HANDLE *)) \
+	X (CreateRenderTarget, HRESULT, (IDirect3DDevice9 *, UINT, UINT, D3DFORMAT, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9 **, HANDLE *)) \
+	X (CreateDepthStencilSurface, HRESULT, (IDirect3DDevice9 *, UINT, UINT, D3DFORMAT, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9 **, HANDLE *)) \
+	X (UpdateSurface, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 *, CONST RECT *, IDirect3DSurface9 *, CONST POINT *)) \
+	X (UpdateTexture, HRESULT, (IDirect3DDevice9 *, IDirect3DBaseTexture9 *, IDirect3DBaseTexture9 *)) \
+	X (GetRenderTargetData, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 *, IDirect3DSurface9 *)) \
+	X (GetFrontBufferData, HRESULT, (IDirect3DDevice9 *, UINT, IDirect3DSurface9 *)) \
+	X (StretchRect, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 *, CONST RECT *, IDirect3DSurface9 *, CONST RECT *, D3DTEXTUREFILTERTYPE)) \
+	X (ColorFill, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 *, CONST RECT *, D3DCOLOR)) \
+	X (CreateOffscreenPlainSurface, HRESULT, (IDirect3DDevice9 *, UINT, UINT, D3DFORMAT, D3DPOOL, IDirect3DSurface9 **, HANDLE *)) \
+	X (SetRenderTarget, HRESULT, (IDirect3DDevice9 *, DWORD, IDirect3DSurface9 *)) \
+	X (GetRenderTarget, HRESULT, (IDirect3DDevice9 *, DWORD, IDirect3DSurface9 **)) \
+	X (SetDepthStencilSurface, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 *)) \
+	X (GetDepthStencilSurface, HRESULT, (IDirect3DDevice9 *, IDirect3DSurface9 **)) \
+	X (BeginScene, HRESULT, (IDirect3DDevice9 *)) \
+	X (EndScene, HRESULT, (IDirect3DDevice9 *)) \
+	X (Clear, HRESULT, (IDirect3DDevice9 *, DWORD, CONST D3DRECT *, DWORD, D3DCOLOR, float, DWORD)) \
+	X (SetTransform, HRESULT, (IDirect3DDevice9 *, D3DTRANSFORMSTATETYPE, CONST D3DMATRIX *)) \
+	X (GetTransform, HRESULT, (IDirect3DDevice9 *, D3DTRANSFORMSTATETYPE, D3DMATRIX *)) \
+	X (MultiplyTransform, HRESULT, (IDirect3DDevice9 *, D3DTRANSFORMSTATETYPE, CONST D3DMATRIX *)) \
+	X (SetViewport, HRESULT, (IDirect3DDevice9 *, CONST D3DVIEWPORT9 *)) \
+	X (GetViewport, HRESULT, (IDirect3DDevice9 *, D3DVIEWPORT9 *)) \
+	X (SetMaterial, HRESULT, (IDirect3DDevice9 *, CONST D3DMATERIAL9 *)) \
+	X (GetMaterial, HRESULT, (IDirect3DDevice9 *, D3DMATERIAL9 *)) \
+	X (SetLight, HRESULT, (IDirect3DDevice9 *, DWORD, CONST D3DLIGHT9 *)) \
+	X (GetLight, HRESULT, (IDirect3DDevice9 *, DWORD, D3DLIGHT9 *)) \
+	X (LightEnable, HRESULT, (IDirect3DDevice9 *, DWORD, BOOL)) \
+	X (GetLightEnable, HRESULT, (IDirect3DDevice9 *, DWORD, BOOL *)) \
+	X (SetClipPlane, HRESULT, (IDirect3DDevice9 *, DWORD, CONST float *)) \
+	X (GetClipPlane, HRESULT, (IDirect3DDevice9 *, DWORD, float *)) \
+	X (SetRenderState, HRESULT, (IDirect3DDevice9 *, D3DRENDERSTATETYPE, DWORD)) \
+	X (GetRenderState, HRESULT, (IDirect3DDevice9 *, D3DRENDERSTATETYPE, DWORD *)) \
+	X (CreateStateBlock, HRESULT, (IDirect3DDevice9 *, D3DSTATEBLOCKTYPE, IDirect3DStateBlock9 **)) \
+	X (BeginStateBlock, HRESULT, (IDirect3DDevice9 *)) \
+	X (EndStateBlock, HRESULT, (IDirect3DDevice9 *, IDirect3DStateBlock9 **)) \
+	X (SetClipStatus, HRESULT, (IDirect3DDevice9 *, CONST D3DCLIPSTATUS9 *)) \
+	X (GetClipStatus, HRESULT, (IDirect3DDevice9 *, D3DCLIPSTATUS9 *)) \
+	X (GetTexture, HRESULT, (IDirect3DDevice9 *, DWORD, IDirect3DBaseTexture9 **)) \
+	X (SetTexture, HRESULT, (IDirect3DDevice9 *, DWORD, IDirect3DBaseTexture9 *)) \
+	X (GetTextureStageState, HRESULT, (IDirect3DDevice9 *, DWORD, D3DTEXTURESTAGESTATETYPE, DWORD *)) \
+	X (SetTextureStageState, HRESULT, (IDirect3DDevice9 *, DWORD, D3DTEXTURESTAGESTATETYPE, DWORD)) \
+	X (GetSamplerState, HRESULT, (IDirect3DDevice9 *, DWORD, D3DSAMPLERSTATETYPE, DWORD *)) \
+	X (SetSamplerState, HRESULT, (IDirect3DDevice9 *, DWORD, D3DSAMPLERSTATETYPE, DWORD)) \
+	X (ValidateDevice, HRESULT, (IDirect3DDevice9 *, DWORD *)) \
+	X (SetPaletteEntries, HRESULT, (IDirect3DDevice9 *, UINT, CONST PALETTEENTRY *)) \
+	X (GetPaletteEntries, HRESULT, (IDirect3DDevice9 *, UINT, PALETTEENTRY *)) \
+	X (SetCurrentTexturePalette, HRESULT, (IDirect3DDevice9 *, UINT)) \
+	X (GetCurrentTexturePalette, HRESULT, (IDirect3DDevice9 *, UINT *)) \
+	X (SetScissorRect, HRESULT, (IDirect3DDevice9 *, CONST RECT *)) \
+	X (GetScissorRect, HRESULT, (IDirect3DDevice9 *, RECT *)) \
+	X (SetSoftwareVertexProcessing, HRESULT, (IDirect3DDevice9 *, BOOL)) \
+	X (GetSoftwareVertexProcessing, BOOL, (IDirect3DDevice9 *)) \
+	X (SetNPatchMode, HRESULT, (IDirect3DDevice9 *, float)) \
+	X (GetNPatchMode, float, (IDirect3DDevice9 *)) \
+	X (DrawPrimitive, HRESULT, (IDirect3DDevice9 *, D3DPRIMITIVETYPE, UINT, UINT)) \
+	X (DrawIndexedPrimitive, HRESULT, (IDirect3DDevice9 *, D3DPRIMITIVETYPE, INT, UINT, UINT, UINT, UINT)) \
+	X (DrawPrimitiveUP, HRESULT, (IDirect3DDevice9 *, D3DPRIMITIVETYPE, UINT, CONST void *, UINT)) \
+	X (DrawIndexedPrimitiveUP, HRESULT, (IDirect3DDevice9 *, D3DPRIMITIVETYPE, UINT, UINT, UINT, CONST void *, D3DFORMAT, CONST void *, UINT)) \
+	X (ProcessVertices, HRESULT, (IDirect3DDevice9 *, UINT, UINT, UINT, IDirect3DVertexBuffer9 *, IDirect3DVertexDeclaration9 *, DWORD)) \
+	X (CreateVertexDeclaration, HRESULT, (IDirect3DDevice9 *, CONST D3DVERTEXELEMENT9 *, IDirect3DVertexDeclaration9 **)) \
+	X (SetVertexDeclaration, HRESULT, (IDirect3DDevice9 *, IDirect3DVertexDeclaration9 *)) \
+	X (GetVertexDeclaration, HRESULT, (IDirect3DDevice9 *, IDirect3DVertexDeclaration9 **)) \
+	X (SetFVF, HRESULT, (IDirect3DDevice9 *, DWORD)) \
+	X (GetFVF, HRESULT, (IDirect3DDevice9 *, DWORD *)) \
+	X (CreateVertexShader, HRESULT, (IDirect3DDevice9 *, CONST DWORD *, IDirect3DVertexShader9 **)) \
+	X (SetVertexShader, HRESULT, (IDirect3DDevice9 *, IDirect3DVertexShader9 *)) \
+	X (GetVertexShader, HRESULT, (IDirect3DDevice9 *, IDirect3DVertexShader9 **)) \
+	X (SetVertexShaderConstantF, HRESULT, (IDirect3DDevice9 *, UINT, CONST float *, UINT)) \
+	X (GetVertexShaderConstantF, HRESULT, (IDirect3DDevice9 *, UINT, float *, UINT)) \
+	X (SetVertexShaderConstantI, HRESULT, (IDirect3DDevice9 *, UINT, CONST int *, UINT)) \
+	X (GetVertexShaderConstantI, HRESULT, (IDirect3DDevice9 *, UINT, int *, UINT)) \
+	X (SetVertexShaderConstantB, HRESULT, (IDirect3DDevice9 *, UINT, CONST BOOL *, UINT)) \
+	X (GetVertexShaderConstantB, HRESULT, (IDirect3DDevice9 *, UINT, BOOL *, UINT)) \
+	X (SetStreamSource, HRESULT, (IDirect3DDevice9 *, UINT, IDirect3DVertexBuffer9 *, UINT, UINT)) \
+	X (GetStreamSource, HRESULT, (IDirect3DDevice9 *, UINT, IDirect3DVertexBuffer9 **, UINT *, UINT *)) \
+	X (SetStreamSourceFreq, HRESULT, (IDirect3DDevice9 *, UINT, UINT)) \
+	X (GetStreamSourceFreq, HRESULT, (IDirect3DDevice9 *, UINT, UINT *)) \
+	X (SetIndices, HRESULT, (IDirect3DDevice9 *, IDirect3DIndexBuffer9 *)) \
+	X (GetIndices, HRESULT, (IDirect3DDevice9 *, IDirect3DIndexBuffer9 **)) \
+	X (CreatePixelShader, HRESULT, (IDirect3DDevice9 *, CONST DWORD *, IDirect3DPixelShader9 **)) \
+	X (SetPixelShader, HRESULT, (IDirect3DDevice9 *, IDirect3DPixelShader9 *)) \
+	X (GetPixelShader, HRESULT, (IDirect3DDevice9 *, IDirect3DPixelShader9 **)) \
+	X (SetPixelShaderConstantF, HRESULT, (IDirect3DDevice9 *, UINT, CONST float *, UINT)) \
+	X (GetPixelShaderConstantF, HRESULT, (IDirect3DDevice9 *, UINT, float *, UINT)) \
+	X (SetPixelShaderConstantI, HRESULT, (IDirect3DDevice9 *, UINT, CONST int *, UINT)) \
+	X (GetPixelShaderConstantI, HRESULT, (IDirect3DDevice9 *, UINT, int *, UINT)) \
+	X (SetPixelShaderConstantB, HRESULT, (IDirect3DDevice9 *, UINT, CONST BOOL *, UINT)) \
+	X (GetPixelShaderConstantB, HRESULT, (IDirect3DDevice9 *, UINT, BOOL *, UINT)) \
+	X (DrawRectPatch, HRESULT, (IDirect3DDevice9 *, UINT, CONST float *, CONST D3DRECTPATCH_INFO *)) \
+	X (DrawTriPatch, HRESULT, (IDirect3DDevice9 *, UINT, CONST float *, CONST D3DTRIPATCH_INFO *)) \
+	X (DeletePatch, HRESULT, (IDirect3DDevice9 *, UINT)) \
+	X (CreateQuery, HRESULT, (IDirect3DDevice9 *, D3DQUERYTYPE, IDirect3DQuery9 **))
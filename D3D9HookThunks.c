@@ -0,0 +1,394 @@
+#include "D3D9HookThunks.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+// Private headers
+/*
+ * Description : Write the code of a thunk
+ * unsigned char *code : Output of D3D9_HOOK_THUNKS_CODE_SIZE bytes
+ * D3D9HookThunk *thunk : Data of the thunk
+ * int argumentsCount : Number of pointer sized arguments of the method, the object included
+ * Return : void
+ */
+static void D3D9HookThunks_write_code (unsigned char *code, D3D9HookThunk *thunk, int argumentsCount);
+
+/*
+ * Description : Write the 32 bits operand addressing some data : absolute on x86, relative to the next instruction on x86-64
+ * unsigned char *cursor : Output of the operand
+ * volatile void *data : Address of the data
+ * unsigned char *next : Address of the next instruction
+ * Return : unsigned char * the byte after the operand
+ */
+static unsigned char * D3D9HookThunks_write_operand (unsigned char *cursor, volatile void *data, unsigned char *next);
+
+/*
+ * Description : Round a size up to a multiple of the page size
+ * size_t size : Size in bytes
+ * Return : size_t the rounded size
+ */
+static size_t D3D9HookThunks_round_to_pages (size_t size);
+
+/*
+ * Description : Wait until a counter of calls drops to 0
+ * volatile int *counter : Counter of a thunk, not incremented by the calls starting
+ * int *timeout : Maximum time to wait, in milliseconds. The time waited is subtracted.
+ * Return : bool true once the counter is 0, false on timeout
+ */
+static bool D3D9HookThunks_drain (volatile int *counter, int *timeout);
+
+
+/*
+ * Description : Allocate a new D3D9HookThunks structure.
+ * int *argumentsCounts : Number of pointer sized arguments of each method, the object included
+ * int count : Number of thunks
+ * Return : A pointer to an allocated D3D9HookThunks.
+ */
+D3D9HookThunks *
+D3D9HookThunks_new (
+	int *argumentsCounts,
+	int count
+) {
+	D3D9HookThunks *this;
+
+	if ((this = calloc (1, sizeof(D3D9HookThunks))) == NULL)
+		return NULL;
+
+	if (!D3D9HookThunks_init (this, argumentsCounts, count)) {
+		D3D9HookThunks_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9HookThunks structure : write the code of all the thunks.
+ *               The thunks have no implementation yet : they must not be called before D3D9HookThunks_swap.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks to initialize.
+ * int *argumentsCounts : Number of pointer sized arguments of each method, the object included
+ * int count : Number of thunks
+ * Return : true on success, false if a method has too many arguments or the memory can't be allocated.
+ */
+bool
+D3D9HookThunks_init (
+	D3D9HookThunks *this,
+	int *argumentsCounts,
+	int count
+) {
+	this->memory = NULL;
+	this->thunks = NULL;
+	this->count  = count;
+
+	#if !defined (__i386__) && !defined (__x86_64__)
+	return false;
+	#endif
+
+	for (int index = 0; index < count; index++) {
+		if (argumentsCounts [index] < 0 || argumentsCounts [index] > D3D9_HOOK_THUNKS_MAX_ARGUMENTS) {
+			return false;
+		}
+	}
+
+	this->codeSize = D3D9HookThunks_round_to_pages ((size_t) count * D3D9_HOOK_THUNKS_CODE_SIZE);
+	this->size     = this->codeSize + D3D9HookThunks_round_to_pages ((size_t) count * sizeof(D3D9HookThunk));
+
+	#ifdef _WIN32
+	if (!(this->memory = VirtualAlloc (NULL, this->size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))) {
+		return false;
+	}
+	#else
+	if ((this->memory = mmap (NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		this->memory = NULL;
+		return false;
+	}
+	#endif
+
+	// The pages are zeroed : no implementation, no call running
+	this->thunks = (D3D9HookThunk *) (this->memory + this->codeSize);
+
+	for (int index = 0; index < count; index++) {
+		this->thunks [index].active = &this->thunks [index].inFlight [0];
+		D3D9HookThunks_write_code (this->memory + index * D3D9_HOOK_THUNKS_CODE_SIZE, &this->thunks [index], argumentsCounts [index]);
+	}
+
+	// The code never changes once written
+	#ifdef _WIN32
+	DWORD protection;
+	if (!VirtualProtect (this->memory, this->codeSize, PAGE_EXECUTE_READ, &protection)) {
+		return false;
+	}
+	FlushInstructionCache (GetCurrentProcess (), this->memory, this->codeSize);
+	#else
+	if (mprotect (this->memory, this->codeSize, PROT_READ | PROT_EXEC) != 0) {
+		return false;
+	}
+	#endif
+
+	return true;
+}
+
+/*
+ * Description : Round a size up to a multiple of the page size
+ * size_t size : Size in bytes
+ * Return : size_t the rounded size
+ */
+static size_t
+D3D9HookThunks_round_to_pages (
+	size_t size
+) {
+	size_t pageSize;
+
+	#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo (&info);
+	pageSize = info.dwPageSize;
+	#else
+	pageSize = sysconf (_SC_PAGESIZE);
+	#endif
+
+	return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+/*
+ * Description : Write the 32 bits operand addressing some data : absolute on x86, relative to the next instruction on x86-64
+ * unsigned char *cursor : Output of the operand
+ * volatile void *data : Address of the data
+ * unsigned char *next : Address of the next instruction
+ * Return : unsigned char * the byte after the operand
+ */
+static unsigned char *
+D3D9HookThunks_write_operand (
+	unsigned char *cursor,
+	volatile void *data,
+	unsigned char *next
+) {
+	#ifdef __x86_64__
+	// The data pages follow the code pages : always in the range of a 32 bits displacement
+	int32_t operand = (int32_t) ((intptr_t) data - (intptr_t) next);
+	#else
+	uint32_t operand = (uint32_t) (uintptr_t) data;
+	#endif
+
+	memcpy (cursor, &operand, sizeof(operand));
+
+	return cursor + sizeof(operand);
+}
+
+/*
+ * Description : Write the code of a thunk
+ * unsigned char *code : Output of D3D9_HOOK_THUNKS_CODE_SIZE bytes
+ * D3D9HookThunk *thunk : Data of the thunk
+ * int argumentsCount : Number of pointer sized arguments of the method, the object included
+ * Return : void
+ */
+static void
+D3D9HookThunks_write_code (
+	unsigned char *code,
+	D3D9HookThunk *thunk,
+	int argumentsCount
+) {
+	unsigned char *cursor = code;
+
+	#ifdef __x86_64__
+	// The arguments stay in their registers
+	(void) argumentsCount;
+
+	// mov r11, [active]
+	*cursor++ = 0x4C; *cursor++ = 0x8B; *cursor++ = 0x1D;
+	cursor = D3D9HookThunks_write_operand (cursor, &thunk->active, cursor + 4);
+
+	// lock inc dword [r11] : counted before the implementation is read, so D3D9HookThunks_wait can't miss the call
+	*cursor++ = 0xF0; *cursor++ = 0x41; *cursor++ = 0xFF; *cursor++ = 0x03;
+
+	// sub rsp, 40 : aligns the stack and reserves the home space of the Windows calling convention
+	*cursor++ = 0x48; *cursor++ = 0x83; *cursor++ = 0xEC; *cursor++ = 0x28;
+
+	// mov [rsp + 32], r11 : the counter to decrement, above the home space
+	*cursor++ = 0x4C; *cursor++ = 0x89; *cursor++ = 0x5C; *cursor++ = 0x24; *cursor++ = 0x20;
+
+	// call [implementation] : the arguments in registers are untouched
+	*cursor++ = 0xFF; *cursor++ = 0x15;
+	cursor = D3D9HookThunks_write_operand (cursor, &thunk->implementation, cursor + 4);
+
+	// mov r11, [rsp + 32]
+	*cursor++ = 0x4C; *cursor++ = 0x8B; *cursor++ = 0x5C; *cursor++ = 0x24; *cursor++ = 0x20;
+
+	// add rsp, 40
+	*cursor++ = 0x48; *cursor++ = 0x83; *cursor++ = 0xC4; *cursor++ = 0x28;
+
+	// lock dec dword [r11] : the registers of the return value are untouched
+	*cursor++ = 0xF0; *cursor++ = 0x41; *cursor++ = 0xFF; *cursor++ = 0x0B;
+
+	// ret
+	*cursor++ = 0xC3;
+	#else
+	// mov ecx, [active] : ecx isn't an argument of a __stdcall method
+	*cursor++ = 0x8B; *cursor++ = 0x0D;
+	cursor = D3D9HookThunks_write_operand (cursor, &thunk->active, cursor + 4);
+
+	// lock inc dword [ecx] : counted before the implementation is read, so D3D9HookThunks_wait can't miss the call
+	*cursor++ = 0xF0; *cursor++ = 0xFF; *cursor++ = 0x01;
+
+	// push ecx : the counter to decrement
+	*cursor++ = 0x51;
+
+	// push dword [esp + 4 * count + 4], count times : copies the arguments above the return address of the caller
+	for (int index = 0; index < argumentsCount; index++) {
+		*cursor++ = 0xFF; *cursor++ = 0x74; *cursor++ = 0x24; *cursor++ = (unsigned char) (argumentsCount * 4 + 4);
+	}
+
+	// call [implementation] : the implementation pops its copy of the arguments
+	*cursor++ = 0xFF; *cursor++ = 0x15;
+	cursor = D3D9HookThunks_write_operand (cursor, &thunk->implementation, cursor + 4);
+
+	// pop ecx
+	*cursor++ = 0x59;
+
+	// lock dec dword [ecx] : eax and edx, the return value, are untouched
+	*cursor++ = 0xF0; *cursor++ = 0xFF; *cursor++ = 0x09;
+
+	// ret 4 * count : pops the arguments of the caller, as the method would
+	*cursor++ = 0xC2; *cursor++ = (unsigned char) (argumentsCount * 4); *cursor++ = 0x00;
+	#endif
+
+	// int3 up to the next thunk
+	memset (cursor, 0xCC, D3D9_HOOK_THUNKS_CODE_SIZE - (cursor - code));
+}
+
+/*
+ * Description : Get the address to install in place of a method
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * Return : void * the entry of the thunk
+ */
+void *
+D3D9HookThunks_get_entry (
+	D3D9HookThunks *this,
+	int index
+) {
+	return this->memory + index * D3D9_HOOK_THUNKS_CODE_SIZE;
+}
+
+/*
+ * Description : Change the function called by a thunk. The calls already running keep the previous one.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * void *implementation : The function called from now on, with the signature of the method
+ * Return : void * the previous implementation
+ */
+void *
+D3D9HookThunks_swap (
+	D3D9HookThunks *this,
+	int index,
+	void *implementation
+) {
+	void *previous = __sync_lock_test_and_set (&this->thunks [index].implementation, implementation);
+
+	// The counter is read by D3D9HookThunks_wait after the swap is visible
+	__sync_synchronize ();
+
+	return previous;
+}
+
+/*
+ * Description : Wait until the calls started before are finished. Once it returns true after D3D9HookThunks_swap,
+ *               no thread executes the previous implementation anymore, nor will.
+ *               The calls started meanwhile aren't waited for, so it ends even if the method is called without pause.
+ *               /!\ Two threads must not wait for the same thunk at the same time.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * int timeout : Maximum time to wait, in milliseconds
+ * Return : bool true once the calls are finished, false on timeout
+ */
+bool
+D3D9HookThunks_wait (
+	D3D9HookThunks *this,
+	int index,
+	int timeout
+) {
+	D3D9HookThunk *thunk = &this->thunks [index];
+	volatile int *previous = thunk->active;
+	volatile int *next = (previous == &thunk->inFlight [0]) ? &thunk->inFlight [1] : &thunk->inFlight [0];
+
+	// A call reading an implementation has incremented one of the counters before.
+	// The inactive counter only gets the calls which read the active one before the last flip : it drains first.
+	// The calls starting after the flip count on the other counter, so the previous one drains too.
+	if (!D3D9HookThunks_drain (next, &timeout)) {
+		return false;
+	}
+
+	(void) __sync_lock_test_and_set (&thunk->active, next);
+	__sync_synchronize ();
+
+	return D3D9HookThunks_drain (previous, &timeout);
+}
+
+/*
+ * Description : Wait until a counter of calls drops to 0
+ * volatile int *counter : Counter of a thunk, not incremented by the calls starting
+ * int *timeout : Maximum time to wait, in milliseconds. The time waited is subtracted.
+ * Return : bool true once the counter is 0, false on timeout
+ */
+static bool
+D3D9HookThunks_drain (
+	volatile int *counter,
+	int *timeout
+) {
+	for (int spin = 0; *counter != 0; spin++) {
+		if (spin < D3D9_HOOK_THUNKS_SPIN_COUNT) {
+			#ifdef _WIN32
+			Sleep (0);
+			#else
+			sched_yield ();
+			#endif
+			continue;
+		}
+
+		if ((*timeout)-- <= 0) {
+			return false;
+		}
+
+		#ifdef _WIN32
+		Sleep (1);
+		#else
+		usleep (1000);
+		#endif
+	}
+
+	__sync_synchronize ();
+
+	return true;
+}
+
+/*
+ * Description : Free an allocated D3D9HookThunks structure and the code of its thunks.
+ *               /!\ No thread must hold the address of a thunk anymore. Once installed in place of a method,
+ *               a thread can be about to enter a thunk or returning from it at any time : it can't be freed then.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks to free.
+ */
+void
+D3D9HookThunks_free (
+	D3D9HookThunks *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	if (this->memory) {
+		#ifdef _WIN32
+		VirtualFree (this->memory, 0, MEM_RELEASE);
+		#else
+		munmap (this->memory, this->size);
+		#endif
+	}
+
+	free (this);
+}
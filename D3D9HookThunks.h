@@ -0,0 +1,146 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// Bytes of code of a thunk
+#define D3D9_HOOK_THUNKS_CODE_SIZE      64
+// Arguments copied by a thunk, the object included : enough for all the methods of IDirect3DDevice9
+#ifdef __x86_64__
+// x86-64 : the thunk doesn't copy the stack, only the arguments passed in registers are supported
+#define D3D9_HOOK_THUNKS_MAX_ARGUMENTS  4
+#else
+#define D3D9_HOOK_THUNKS_MAX_ARGUMENTS  10
+#endif
+// Size of the data of a thunk : one cache line
+#define D3D9_HOOK_THUNKS_LINE_SIZE      64
+// Yields before D3D9HookThunks_wait sleeps between two checks
+#define D3D9_HOOK_THUNKS_SPIN_COUNT     64
+
+// ------ Structure declaration -------
+
+// Data read and written by the code of a thunk
+typedef union
+{
+	struct {
+		// Function called by the thunk, swapped atomically
+		void * volatile implementation;
+		// Counter of the calls starting now : one of inFlight, flipped by D3D9HookThunks_wait
+		volatile int * volatile active;
+		// Calls running, by phase : incremented before the implementation is read, decremented once it returns
+		volatile int inFlight [2];
+	};
+
+	// The counters of two methods called by two threads don't share a cache line
+	char line [D3D9_HOOK_THUNKS_LINE_SIZE];
+
+}	D3D9HookThunk;
+
+// Executable stubs standing between a hooked method and its hook.
+// A thunk copies the arguments of the method, calls the current implementation and returns to the caller :
+// the implementation can be swapped without a gap, and the calls running it are counted, so a hook
+// can be released once D3D9HookThunks_wait returns.
+// The code is written once then made read only : the counters written at each call live in other pages.
+// x86 : __stdcall methods, their arguments are copied. x86-64 : only the arguments passed in registers.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	// Code of all the thunks followed by their data, allocated together
+	unsigned char *memory;
+	size_t codeSize;
+	size_t size;
+
+	D3D9HookThunk *thunks;
+	int count;
+
+}	D3D9HookThunks;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9HookThunks structure.
+ * int *argumentsCounts : Number of pointer sized arguments of each method, the object included
+ * int count : Number of thunks
+ * Return : A pointer to an allocated D3D9HookThunks.
+ */
+D3D9HookThunks *
+D3D9HookThunks_new (
+	int *argumentsCounts,
+	int count
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9HookThunks structure : write the code of all the thunks.
+ *               The thunks have no implementation yet : they must not be called before D3D9HookThunks_swap.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks to initialize.
+ * int *argumentsCounts : Number of pointer sized arguments of each method, the object included
+ * int count : Number of thunks
+ * Return : true on success, false if a method has too many arguments or the memory can't be allocated.
+ */
+bool
+D3D9HookThunks_init (
+	D3D9HookThunks *this,
+	int *argumentsCounts,
+	int count
+);
+
+/*
+ * Description : Get the address to install in place of a method
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * Return : void * the entry of the thunk
+ */
+void *
+D3D9HookThunks_get_entry (
+	D3D9HookThunks *this,
+	int index
+);
+
+/*
+ * Description : Change the function called by a thunk. The calls already running keep the previous one.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * void *implementation : The function called from now on, with the signature of the method
+ * Return : void * the previous implementation
+ */
+void *
+D3D9HookThunks_swap (
+	D3D9HookThunks *this,
+	int index,
+	void *implementation
+);
+
+/*
+ * Description : Wait until the calls started before are finished. Once it returns true after D3D9HookThunks_swap,
+ *               no thread executes the previous implementation anymore, nor will.
+ *               The calls started meanwhile aren't waited for, so it ends even if the method is called without pause.
+ *               /!\ Two threads must not wait for the same thunk at the same time.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks
+ * int index : Index of the thunk
+ * int timeout : Maximum time to wait, in milliseconds
+ * Return : bool true once the calls are finished, false on timeout
+ */
+bool
+D3D9HookThunks_wait (
+	D3D9HookThunks *this,
+	int index,
+	int timeout
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9HookThunks structure and the code of its thunks.
+ *               /!\ No thread must hold the address of a thunk anymore. Once installed in place of a method,
+ *               a thread can be about to enter a thunk or returning from it at any time : it can't be freed then.
+ * D3D9HookThunks *this : An allocated D3D9HookThunks to free.
+ */
+void
+D3D9HookThunks_free (
+	D3D9HookThunks *this
+);
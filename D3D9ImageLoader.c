@@ -0,0 +1,564 @@
+#include "D3D9ImageLoader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include "D3D9ImageWin32.h"
+#endif
+
+// Private headers
+/*
+ * Description : Worker thread decoding the pending requests
+ * void *param : The D3D9ImageLoader
+ * Return : 0
+ */
+#ifdef _WIN32
+static DWORD WINAPI D3D9ImageLoader_worker (LPVOID param);
+#else
+static void * D3D9ImageLoader_worker (void *param);
+#endif
+
+/*
+ * Description : Wake up workers waiting for a pending request
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * int count : Number of workers to wake up
+ * Return : void
+ */
+static void D3D9ImageLoader_signal (D3D9ImageLoader *this, int count);
+
+/*
+ * Description : Wait for a pending request, or for the loader to stop
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * Return : void
+ */
+static void D3D9ImageLoader_wait (D3D9ImageLoader *this);
+
+/*
+ * Description : Add a request at the end of a queue
+ * D3D9ImageQueue *queue : A queue of requests
+ * D3D9ImageRequest *request : A request in no queue
+ * Return : void
+ */
+static void D3D9ImageQueue_push (D3D9ImageQueue *queue, D3D9ImageRequest *request);
+
+/*
+ * Description : Remove the first request of a queue
+ * D3D9ImageQueue *queue : A queue of requests
+ * Return : D3D9ImageRequest * the first request, or NULL if the queue is empty
+ */
+static D3D9ImageRequest * D3D9ImageQueue_pop (D3D9ImageQueue *queue);
+
+/*
+ * Description : Allocate a request for an image file
+ * char *filePath : Path of the image
+ * void *userData : Data given back with the request
+ * Return : D3D9ImageRequest * an allocated request, or NULL on failure
+ */
+static D3D9ImageRequest * D3D9ImageRequest_new (char *filePath, void *userData);
+
+
+/*
+ * Description : Allocate a new D3D9ImageLoader structure and start its worker threads.
+ * int threadsCount : Number of worker threads decoding the images
+ * D3D9ImageDecoder decoder : Function decoding a file. If NULL, D3D9Image_decode_file is used.
+ * Return : A pointer to an allocated D3D9ImageLoader.
+ */
+D3D9ImageLoader *
+D3D9ImageLoader_new (
+	int threadsCount,
+	D3D9ImageDecoder decoder
+) {
+	D3D9ImageLoader *this;
+
+	if ((this = calloc (1, sizeof(D3D9ImageLoader))) == NULL)
+		return NULL;
+
+	if (!D3D9ImageLoader_init (this, threadsCount, decoder)) {
+		D3D9ImageLoader_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9ImageLoader structure and start its worker threads.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader to initialize.
+ * int threadsCount : Number of worker threads decoding the images
+ * D3D9ImageDecoder decoder : Function decoding a file. If NULL, D3D9Image_decode_file is used.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9ImageLoader_init (
+	D3D9ImageLoader *this,
+	int threadsCount,
+	D3D9ImageDecoder decoder
+) {
+	this->decoder = (decoder) ? decoder : D3D9Image_decode_file;
+	this->stopping = 0;
+	this->threadsCount = 0;
+	this->pending = (D3D9ImageQueue) {NULL, NULL};
+	this->decoded = (D3D9ImageQueue) {NULL, NULL};
+
+	if (!D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT)) {
+		return false;
+	}
+
+	#ifdef _WIN32
+	if ((this->pendingSemaphore = CreateSemaphore (NULL, 0, LONG_MAX, NULL)) == NULL) {
+		return false;
+	}
+	#else
+	if (sem_init (&this->pendingSemaphore, 0, 0) != 0) {
+		return false;
+	}
+	this->pendingSemaphoreReady = true;
+	#endif
+
+	if ((this->threads = calloc (threadsCount, sizeof(*this->threads))) == NULL) {
+		return false;
+	}
+
+	for (int i = 0; i < threadsCount; i++) {
+		#ifdef _WIN32
+		if ((this->threads[i] = CreateThread (NULL, 0, D3D9ImageLoader_worker, this, 0, NULL)) == NULL) {
+			return false;
+		}
+		#else
+		if (pthread_create (&this->threads[i], NULL, D3D9ImageLoader_worker, this) != 0) {
+			return false;
+		}
+		#endif
+
+		this->threadsCount++;
+	}
+
+	return true;
+}
+
+/*
+ * Description : Wake up workers waiting for a pending request
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * int count : Number of workers to wake up
+ * Return : void
+ */
+static void
+D3D9ImageLoader_signal (
+	D3D9ImageLoader *this,
+	int count
+) {
+	#ifdef _WIN32
+	ReleaseSemaphore (this->pendingSemaphore, count, NULL);
+	#else
+	while (count--) {
+		sem_post (&this->pendingSemaphore);
+	}
+	#endif
+}
+
+/*
+ * Description : Wait for a pending request, or for the loader to stop
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * Return : void
+ */
+static void
+D3D9ImageLoader_wait (
+	D3D9ImageLoader *this
+) {
+	#ifdef _WIN32
+	WaitForSingleObject (this->pendingSemaphore, INFINITE);
+	#else
+	while (sem_wait (&this->pendingSemaphore) != 0) {
+		// Interrupted by a signal
+	}
+	#endif
+}
+
+/*
+ * Description : Worker thread decoding the pending requests
+ * void *param : The D3D9ImageLoader
+ * Return : 0
+ */
+#ifdef _WIN32
+static DWORD WINAPI
+D3D9ImageLoader_worker (
+	LPVOID param
+)
+#else
+static void *
+D3D9ImageLoader_worker (
+	void *param
+)
+#endif
+{
+	D3D9ImageLoader *this = param;
+
+	#ifdef _WIN32
+	D3D9ImageWin32_thread_init ();
+	#endif
+
+	while (true)
+	{
+		D3D9ImageRequest *request;
+
+		D3D9ImageLoader_wait (this);
+
+		if (this->stopping) {
+			break;
+		}
+
+		D3D9Lock_acquire_exclusive (&this->lock);
+		request = D3D9ImageQueue_pop (&this->pending);
+		D3D9Lock_release_exclusive (&this->lock);
+
+		if (!request) {
+			continue;
+		}
+
+		// File I/O and decoding happen here, outside of the DirectX thread
+		request->success = this->decoder (request->filePath, &request->image);
+
+		D3D9Lock_acquire_exclusive (&this->lock);
+		D3D9ImageQueue_push (&this->decoded, request);
+		D3D9Lock_release_exclusive (&this->lock);
+	}
+
+	#ifdef _WIN32
+	D3D9ImageWin32_thread_release ();
+	return 0;
+	#else
+	return NULL;
+	#endif
+}
+
+/*
+ * Description : Add a request at the end of a queue
+ * D3D9ImageQueue *queue : A queue of requests
+ * D3D9ImageRequest *request : A request in no queue
+ * Return : void
+ */
+static void
+D3D9ImageQueue_push (
+	D3D9ImageQueue *queue,
+	D3D9ImageRequest *request
+) {
+	request->next = NULL;
+
+	if (queue->last) {
+		queue->last->next = request;
+	} else {
+		queue->first = request;
+	}
+
+	queue->last = request;
+}
+
+/*
+ * Description : Remove the first request of a queue
+ * D3D9ImageQueue *queue : A queue of requests
+ * Return : D3D9ImageRequest * the first request, or NULL if the queue is empty
+ */
+static D3D9ImageRequest *
+D3D9ImageQueue_pop (
+	D3D9ImageQueue *queue
+) {
+	D3D9ImageRequest *request = queue->first;
+
+	if (request) {
+		if (!(queue->first = request->next)) {
+			queue->last = NULL;
+		}
+		request->next = NULL;
+	}
+
+	return request;
+}
+
+/*
+ * Description : Allocate a request for an image file
+ * char *filePath : Path of the image
+ * void *userData : Data given back with the request
+ * Return : D3D9ImageRequest * an allocated request, or NULL on failure
+ */
+static D3D9ImageRequest *
+D3D9ImageRequest_new (
+	char *filePath,
+	void *userData
+) {
+	D3D9ImageRequest *request;
+
+	if ((request = calloc (1, sizeof(D3D9ImageRequest))) == NULL) {
+		return NULL;
+	}
+
+	if ((request->filePath = strdup (filePath)) == NULL) {
+		free (request);
+		return NULL;
+	}
+
+	request->userData = userData;
+
+	return request;
+}
+
+/*
+ * Description : Queue an image file to be read and decoded by the worker threads
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * char *filePath : Path of the image
+ * void *userData : Data given back with the decoded request
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9ImageLoader_submit (
+	D3D9ImageLoader *this,
+	char *filePath,
+	void *userData
+) {
+	D3D9ImageRequest *request;
+
+	if ((request = D3D9ImageRequest_new (filePath, userData)) == NULL) {
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	D3D9ImageQueue_push (&this->pending, request);
+	D3D9Lock_release_exclusive (&this->lock);
+
+	D3D9ImageLoader_signal (this, 1);
+
+	return true;
+}
+
+/*
+ * Description : Queue a request that doesn't need any decoding, given back by D3D9ImageLoader_pop_decoded as a success
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * char *filePath : Path of the image
+ * unsigned long long version : Version of the file, from D3D9Image_get_version
+ * void *userData : Data given back with the request
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9ImageLoader_submit_ready (
+	D3D9ImageLoader *this,
+	char *filePath,
+	unsigned long long version,
+	void *userData
+) {
+	D3D9ImageRequest *request;
+
+	if ((request = D3D9ImageRequest_new (filePath, userData)) == NULL) {
+		return false;
+	}
+
+	// The workers are skipped, the request goes straight to the DirectX thread
+	request->image.version = version;
+	request->success = true;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	D3D9ImageQueue_push (&this->decoded, request);
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return true;
+}
+
+/*
+ * Description : Get the next request decoded by the worker threads. Never blocks.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * Return : D3D9ImageRequest * a decoded request to free with D3D9ImageRequest_free, or NULL if none is ready
+ */
+D3D9ImageRequest *
+D3D9ImageLoader_pop_decoded (
+	D3D9ImageLoader *this
+) {
+	D3D9ImageRequest *request;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	request = D3D9ImageQueue_pop (&this->decoded);
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return request;
+}
+
+/*
+ * Description : Read and decode an image file in system memory.
+ *               Formats unknown to WIC (.dds, .tga, .hdr, .pfm, .ppm) are only read, and decoded by D3DX during the upload.
+ *               Without WIC, outside of Windows, every file is only read.
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_decode_file (
+	char *filePath,
+	D3D9Image *image
+) {
+	memset (image, 0, sizeof(D3D9Image));
+
+	// The version is read before the content, so a file modified meanwhile is decoded again next time
+	if (!D3D9Image_get_version (filePath, &image->version)) {
+		return false;
+	}
+
+	#ifdef _WIN32
+	if (D3D9ImageWin32_decode (filePath, image)) {
+		return true;
+	}
+	#endif
+
+	return D3D9Image_read_file (filePath, image);
+}
+
+/*
+ * Description : Get the version of an image file from its size and modification time, without reading it
+ * char *filePath : Path of the image
+ * unsigned long long *version : Output version
+ * Return : bool true on success, false if the file cannot be found
+ */
+bool
+D3D9Image_get_version (
+	char *filePath,
+	unsigned long long *version
+) {
+	struct stat info;
+
+	if (stat (filePath, &info) != 0) {
+		return false;
+	}
+
+	// 64 bits FNV-1a of the size and the modification time
+	*version = 14695981039346656037ULL;
+	*version = (*version ^ (unsigned long long) info.st_size)  * 1099511628211ULL;
+	*version = (*version ^ (unsigned long long) info.st_mtime) * 1099511628211ULL;
+	#ifndef _WIN32
+	*version = (*version ^ (unsigned long long) info.st_mtim.tv_nsec) * 1099511628211ULL;
+	#endif
+
+	return true;
+}
+
+/*
+ * Description : Read the content of an image file without decoding it
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_read_file (
+	char *filePath,
+	D3D9Image *image
+) {
+	FILE *file;
+	long size;
+
+	if ((file = fopen (filePath, "rb")) == NULL) {
+		return false;
+	}
+
+	fseek (file, 0, SEEK_END);
+	size = ftell (file);
+	fseek (file, 0, SEEK_SET);
+
+	if (size <= 0 || (image->fileData = malloc (size)) == NULL) {
+		fclose (file);
+		return false;
+	}
+
+	if (fread (image->fileData, 1, size, file) != (size_t) size) {
+		free (image->fileData);
+		image->fileData = NULL;
+		fclose (file);
+		return false;
+	}
+
+	image->fileSize = size;
+	fclose (file);
+
+	return true;
+}
+
+/*
+ * Description : Free the buffers of a D3D9Image
+ * D3D9Image *this : A D3D9Image
+ */
+void
+D3D9Image_release (
+	D3D9Image *this
+) {
+	free (this->pixels);
+	free (this->fileData);
+	this->pixels = NULL;
+	this->fileData = NULL;
+}
+
+/*
+ * Description : Free an allocated D3D9ImageRequest
+ * D3D9ImageRequest *this : An allocated D3D9ImageRequest
+ */
+void
+D3D9ImageRequest_free (
+	D3D9ImageRequest *this
+) {
+	if (this != NULL) {
+		D3D9Image_release (&this->image);
+		free (this->filePath);
+		free (this);
+	}
+}
+
+/*
+ * Description : Stop the worker threads and free an allocated D3D9ImageLoader structure.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader to free.
+ */
+void
+D3D9ImageLoader_free (
+	D3D9ImageLoader *this
+) {
+	D3D9ImageRequest *request;
+
+	if (this == NULL) {
+		return;
+	}
+
+	// Wake up and join the workers
+	__atomic_store_n (&this->stopping, 1, __ATOMIC_RELEASE);
+
+	if (this->threadsCount) {
+		D3D9ImageLoader_signal (this, this->threadsCount);
+
+		#ifdef _WIN32
+		WaitForMultipleObjects (this->threadsCount, this->threads, TRUE, INFINITE);
+		#else
+		for (int i = 0; i < this->threadsCount; i++) {
+			pthread_join (this->threads[i], NULL);
+		}
+		#endif
+	}
+
+	#ifdef _WIN32
+	for (int i = 0; i < this->threadsCount; i++) {
+		CloseHandle (this->threads[i]);
+	}
+
+	if (this->pendingSemaphore) {
+		CloseHandle (this->pendingSemaphore);
+	}
+	#else
+	if (this->pendingSemaphoreReady) {
+		sem_destroy (&this->pendingSemaphore);
+	}
+	#endif
+
+	while ((request = D3D9ImageQueue_pop (&this->pending))) {
+		D3D9ImageRequest_free (request);
+	}
+
+	while ((request = D3D9ImageQueue_pop (&this->decoded))) {
+		D3D9ImageRequest_free (request);
+	}
+
+	free (this->threads);
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
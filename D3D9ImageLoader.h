@@ -0,0 +1,217 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include "D3D9Lock.h"
+
+// ---------- Defines -------------
+#define D3D9_IMAGE_LOADER_DEFAULT_THREADS 2
+
+// ------ Structure declaration -------
+
+// Image decoded in system memory, ready to be uploaded to a texture
+typedef struct
+{
+	int w, h;
+	int pitch;
+	// 32 bits BGRA pixels (D3DFMT_A8R8G8B8), or NULL if the image couldn't be decoded off the DirectX thread
+	unsigned char *pixels;
+	// Content of the file, kept when the image must be decoded by D3DX during the upload
+	void *fileData;
+	size_t fileSize;
+	// Version of the file decoded, from D3D9Image_get_version
+	unsigned long long version;
+
+}	D3D9Image;
+
+// Decode a file into a D3D9Image. Called from the worker threads.
+typedef bool (*D3D9ImageDecoder) (
+	char *filePath,
+	D3D9Image *image
+);
+
+typedef struct _D3D9ImageRequest
+{
+	char *filePath;
+	D3D9Image image;
+	bool success;
+	void *userData;
+
+	// Next request of the queue containing this one
+	struct _D3D9ImageRequest *next;
+
+}	D3D9ImageRequest;
+
+// Requests in FIFO order, linked through the requests
+typedef struct
+{
+	D3D9ImageRequest *first;
+	D3D9ImageRequest *last;
+
+}	D3D9ImageQueue;
+
+typedef struct
+{
+	#ifdef _WIN32
+	HANDLE *threads;
+	HANDLE pendingSemaphore;
+	#else
+	pthread_t *threads;
+	sem_t pendingSemaphore;
+	bool pendingSemaphoreReady;
+	#endif
+	int threadsCount;
+	volatile long stopping;
+
+	D3D9ImageQueue pending;
+	D3D9ImageQueue decoded;
+	D3D9Lock lock;
+
+	D3D9ImageDecoder decoder;
+
+}	D3D9ImageLoader;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9ImageLoader structure and start its worker threads.
+ * int threadsCount : Number of worker threads decoding the images
+ * D3D9ImageDecoder decoder : Function decoding a file. If NULL, D3D9Image_decode_file is used.
+ * Return : A pointer to an allocated D3D9ImageLoader.
+ */
+D3D9ImageLoader *
+D3D9ImageLoader_new (
+	int threadsCount,
+	D3D9ImageDecoder decoder
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9ImageLoader structure and start its worker threads.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader to initialize.
+ * int threadsCount : Number of worker threads decoding the images
+ * D3D9ImageDecoder decoder : Function decoding a file. If NULL, D3D9Image_decode_file is used.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9ImageLoader_init (
+	D3D9ImageLoader *this,
+	int threadsCount,
+	D3D9ImageDecoder decoder
+);
+
+/*
+ * Description : Queue an image file to be read and decoded by the worker threads
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * char *filePath : Path of the image
+ * void *userData : Data given back with the decoded request
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9ImageLoader_submit (
+	D3D9ImageLoader *this,
+	char *filePath,
+	void *userData
+);
+
+/*
+ * Description : Queue a request that doesn't need any decoding, given back by D3D9ImageLoader_pop_decoded as a success
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * char *filePath : Path of the image
+ * unsigned long long version : Version of the file, from D3D9Image_get_version
+ * void *userData : Data given back with the request
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9ImageLoader_submit_ready (
+	D3D9ImageLoader *this,
+	char *filePath,
+	unsigned long long version,
+	void *userData
+);
+
+/*
+ * Description : Get the next request decoded by the worker threads. Never blocks.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader
+ * Return : D3D9ImageRequest * a decoded request to free with D3D9ImageRequest_free, or NULL if none is ready
+ */
+D3D9ImageRequest *
+D3D9ImageLoader_pop_decoded (
+	D3D9ImageLoader *this
+);
+
+/*
+ * Description : Read and decode an image file in system memory.
+ *               Formats unknown to WIC (.dds, .tga, .hdr, .pfm, .ppm) are only read, and decoded by D3DX during the upload.
+ *               Without WIC, outside of Windows, every file is only read.
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_decode_file (
+	char *filePath,
+	D3D9Image *image
+);
+
+/*
+ * Description : Get the version of an image file from its size and modification time, without reading it
+ * char *filePath : Path of the image
+ * unsigned long long *version : Output version
+ * Return : bool true on success, false if the file cannot be found
+ */
+bool
+D3D9Image_get_version (
+	char *filePath,
+	unsigned long long *version
+);
+
+/*
+ * Description : Read the content of an image file without decoding it
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_read_file (
+	char *filePath,
+	D3D9Image *image
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free the buffers of a D3D9Image
+ * D3D9Image *this : A D3D9Image
+ */
+void
+D3D9Image_release (
+	D3D9Image *this
+);
+
+/*
+ * Description : Free an allocated D3D9ImageRequest
+ * D3D9ImageRequest *this : An allocated D3D9ImageRequest
+ */
+void
+D3D9ImageRequest_free (
+	D3D9ImageRequest *this
+);
+
+/*
+ * Description : Stop the worker threads and free an allocated D3D9ImageLoader structure.
+ * D3D9ImageLoader *this : An allocated D3D9ImageLoader to free.
+ */
+void
+D3D9ImageLoader_free (
+	D3D9ImageLoader *this
+);
@@ -0,0 +1,172 @@
+#define COBJMACROS
+#include "D3D9ImageWin32.h"
+#include <wincodec.h>
+
+// ---------- Debugging -------------
+#define __DEBUG_OBJECT__ "D3D9ImageWin32"
+#include "dbg/dbg.h"
+
+// WIC factory of the current worker thread
+static __thread IWICImagingFactory *wicFactory = NULL;
+
+
+/*
+ * Description : Prepare the current worker thread for WIC
+ * Return : void
+ */
+void
+D3D9ImageWin32_thread_init (
+	void
+) {
+	CoInitializeEx (NULL, COINIT_MULTITHREADED);
+}
+
+/*
+ * Description : Decode an image file with WIC into 32 bits BGRA pixels
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false if WIC cannot decode the file
+ */
+bool
+D3D9ImageWin32_decode (
+	char *filePath,
+	D3D9Image *image
+) {
+	IWICBitmapDecoder *decoder = NULL;
+	IWICBitmapFrameDecode *frame = NULL;
+	IWICFormatConverter *converter = NULL;
+	WCHAR widePath [MAX_PATH];
+	UINT w, h;
+	bool success = false;
+
+	if (!wicFactory) {
+		if (FAILED (CoCreateInstance (&CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER,
+			&IID_IWICImagingFactory, (void **) &wicFactory))) {
+			wicFactory = NULL;
+			return false;
+		}
+	}
+
+	if (!MultiByteToWideChar (CP_ACP, 0, filePath, -1, widePath, MAX_PATH)) {
+		return false;
+	}
+
+	if (FAILED (IWICImagingFactory_CreateDecoderFromFilename (wicFactory, widePath, NULL,
+		GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder))) {
+		goto cleanup;
+	}
+
+	if (FAILED (IWICBitmapDecoder_GetFrame (decoder, 0, &frame))
+	||  FAILED (IWICImagingFactory_CreateFormatConverter (wicFactory, &converter))
+	||  FAILED (IWICFormatConverter_Initialize (converter, (IWICBitmapSource *) frame,
+			&GUID_WICPixelFormat32bppBGRA, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom))
+	||  FAILED (IWICFormatConverter_GetSize (converter, &w, &h))) {
+		goto cleanup;
+	}
+
+	image->w = w;
+	image->h = h;
+	image->pitch = w * 4;
+
+	if ((image->pixels = malloc (image->pitch * h)) == NULL) {
+		goto cleanup;
+	}
+
+	if (FAILED (IWICFormatConverter_CopyPixels (converter, NULL, image->pitch, image->pitch * h, image->pixels))) {
+		free (image->pixels);
+		image->pixels = NULL;
+		goto cleanup;
+	}
+
+	success = true;
+
+cleanup:
+	if (converter)
+		IWICFormatConverter_Release (converter);
+	if (frame)
+		IWICBitmapFrameDecode_Release (frame);
+	if (decoder)
+		IWICBitmapDecoder_Release (decoder);
+
+	return success;
+}
+
+/*
+ * Description : Create a managed texture from a decoded image.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Image *image : A decoded D3D9Image
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * IDirect3DTexture9 **texture : Output texture
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_create_texture (
+	D3D9Image *image,
+	IDirect3DDevice9 * pDevice,
+	IDirect3DTexture9 **texture
+) {
+	if (image->pixels)
+	{
+		// Already decoded : only copy the pixels
+		D3DLOCKED_RECT locked;
+
+		if (pDevice->lpVtbl->CreateTexture (pDevice, image->w, image->h, 1, 0,
+			D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, texture, NULL) != D3D_OK) {
+			warn ("Cannot create a %dx%d texture.", image->w, image->h);
+			return false;
+		}
+
+		if ((*texture)->lpVtbl->LockRect (*texture, 0, &locked, NULL, 0) != D3D_OK) {
+			(*texture)->lpVtbl->Release (*texture);
+			*texture = NULL;
+			return false;
+		}
+
+		for (int y = 0; y < image->h; y++) {
+			memcpy ((unsigned char *) locked.pBits + y * locked.Pitch, image->pixels + y * image->pitch, image->pitch);
+		}
+
+		(*texture)->lpVtbl->UnlockRect (*texture, 0);
+
+		return true;
+	}
+
+	if (image->fileData)
+	{
+		// Format unknown to WIC : D3DX decodes it from memory, the file has already been read
+		return (D3DXCreateTextureFromFileInMemoryEx (
+			pDevice,
+			image->fileData,
+			image->fileSize,
+			D3DX_DEFAULT,
+			D3DX_DEFAULT,
+			D3DX_DEFAULT,
+			0,
+			D3DFMT_UNKNOWN,
+			D3DPOOL_MANAGED,
+			D3DX_DEFAULT,
+			D3DX_DEFAULT,
+			0,
+			NULL,
+			NULL,
+			texture) == D3D_OK);
+	}
+
+	return false;
+}
+
+/*
+ * Description : Release the WIC objects of the current worker thread
+ * Return : void
+ */
+void
+D3D9ImageWin32_thread_release (
+	void
+) {
+	if (wicFactory) {
+		IWICImagingFactory_Release (wicFactory);
+		wicFactory = NULL;
+	}
+
+	CoUninitialize ();
+}
@@ -0,0 +1,59 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// Windows backend of the image loader : decoding with WIC, and upload of the images to DirectX textures
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "dx/d3dx9.h"
+#include "D3D9ImageLoader.h"
+
+// ----------- Functions ------------
+
+/*
+ * Description : Prepare the current worker thread for WIC
+ * Return : void
+ */
+void
+D3D9ImageWin32_thread_init (
+	void
+);
+
+/*
+ * Description : Decode an image file with WIC into 32 bits BGRA pixels
+ * char *filePath : Path of the image
+ * D3D9Image *image : Output image
+ * Return : bool true on success, false if WIC cannot decode the file
+ */
+bool
+D3D9ImageWin32_decode (
+	char *filePath,
+	D3D9Image *image
+);
+
+/*
+ * Description : Create a managed texture from a decoded image.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9Image *image : A decoded D3D9Image
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * IDirect3DTexture9 **texture : Output texture
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9Image_create_texture (
+	D3D9Image *image,
+	IDirect3DDevice9 * pDevice,
+	IDirect3DTexture9 **texture
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Release the WIC objects of the current worker thread
+ * Return : void
+ */
+void
+D3D9ImageWin32_thread_release (
+	void
+);
@@ -0,0 +1,365 @@
+#include "D3D9Lock.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+// Private headers
+/*
+ * Description : Read the monotonic clock
+ * Return : long long the current time in ticks
+ */
+static long long D3D9Lock_get_ticks (void);
+
+/*
+ * Description : Convert a duration in ticks to microseconds
+ * long long ticks : A duration in ticks
+ * Return : long long the duration in microseconds
+ */
+static long long D3D9Lock_ticks_to_us (long long ticks);
+
+/*
+ * Description : Try to acquire a side of the lock without blocking
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool exclusive : true for the exclusive side, false for the shared side
+ * Return : bool true if the lock has been acquired
+ */
+static bool D3D9Lock_try_acquire (D3D9Lock *this, bool exclusive);
+
+/*
+ * Description : Acquire a side of the lock, spinning first then parking the thread
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool exclusive : true for the exclusive side, false for the shared side
+ * Return : void
+ */
+static void D3D9Lock_acquire (D3D9Lock *this, bool exclusive);
+
+
+/*
+ * Description : Allocate a new D3D9Lock structure.
+ * int spinCount : Number of attempts before parking the thread
+ * Return : A pointer to an allocated D3D9Lock.
+ */
+D3D9Lock *
+D3D9Lock_new (
+	int spinCount
+) {
+	D3D9Lock *this;
+
+	if ((this = calloc (1, sizeof(D3D9Lock))) == NULL)
+		return NULL;
+
+	if (!D3D9Lock_init (this, spinCount)) {
+		D3D9Lock_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9Lock structure.
+ * D3D9Lock *this : An allocated D3D9Lock to initialize.
+ * int spinCount : Number of attempts before parking the thread
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Lock_init (
+	D3D9Lock *this,
+	int spinCount
+) {
+	#ifdef _WIN32
+	InitializeSRWLock (&this->primitive);
+	#else
+	if (pthread_rwlock_init (&this->primitive, NULL) != 0) {
+		return false;
+	}
+	#endif
+
+	this->spinCount = spinCount;
+	this->holdTiming = false;
+	this->exclusiveSince = 0;
+	memset (&this->stats, 0, sizeof(this->stats));
+
+	return true;
+}
+
+/*
+ * Description : Read the monotonic clock
+ * Return : long long the current time in ticks
+ */
+static long long
+D3D9Lock_get_ticks (
+	void
+) {
+	#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter (&counter);
+	return counter.QuadPart;
+	#else
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+	#endif
+}
+
+/*
+ * Description : Convert a duration in ticks to microseconds
+ * long long ticks : A duration in ticks
+ * Return : long long the duration in microseconds
+ */
+static long long
+D3D9Lock_ticks_to_us (
+	long long ticks
+) {
+	#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency (&frequency);
+	return ticks * 1000000LL / frequency.QuadPart;
+	#else
+	return ticks / 1000;
+	#endif
+}
+
+/*
+ * Description : Try to acquire a side of the lock without blocking
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool exclusive : true for the exclusive side, false for the shared side
+ * Return : bool true if the lock has been acquired
+ */
+static bool
+D3D9Lock_try_acquire (
+	D3D9Lock *this,
+	bool exclusive
+) {
+	#ifdef _WIN32
+	return (exclusive) ?
+		TryAcquireSRWLockExclusive (&this->primitive) :
+		TryAcquireSRWLockShared (&this->primitive);
+	#else
+	return (exclusive) ?
+		pthread_rwlock_trywrlock (&this->primitive) == 0 :
+		pthread_rwlock_tryrdlock (&this->primitive) == 0;
+	#endif
+}
+
+/*
+ * Description : Acquire a side of the lock, spinning first then parking the thread
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool exclusive : true for the exclusive side, false for the shared side
+ * Return : void
+ */
+static void
+D3D9Lock_acquire (
+	D3D9Lock *this,
+	bool exclusive
+) {
+	// Uncontended path : no clock read, no kernel transition
+	if (D3D9Lock_try_acquire (this, exclusive)) {
+		return;
+	}
+
+	long long start = D3D9Lock_get_ticks ();
+	bool acquired = false;
+
+	for (int spin = 0; spin < this->spinCount && !acquired; spin++) {
+		#if defined(__i386__) || defined(__x86_64__)
+		_mm_pause ();
+		#endif
+		acquired = D3D9Lock_try_acquire (this, exclusive);
+	}
+
+	if (!acquired) {
+		// Park the thread until the lock is available
+		#ifdef _WIN32
+		if (exclusive)
+			AcquireSRWLockExclusive (&this->primitive);
+		else
+			AcquireSRWLockShared (&this->primitive);
+		#else
+		if (exclusive)
+			pthread_rwlock_wrlock (&this->primitive);
+		else
+			pthread_rwlock_rdlock (&this->primitive);
+		#endif
+	}
+
+	__sync_fetch_and_add (&this->stats.contentions, 1);
+	__sync_fetch_and_add (&this->stats.waitTime, D3D9Lock_get_ticks () - start);
+}
+
+/*
+ * Description : Acquire the shared side of the lock. Several readers can hold it together.
+ *               /!\ The lock isn't recursive.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_acquire_shared (
+	D3D9Lock *this
+) {
+	D3D9Lock_acquire (this, false);
+	__sync_fetch_and_add (&this->stats.sharedAcquisitions, 1);
+}
+
+/*
+ * Description : Release the shared side of the lock
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_release_shared (
+	D3D9Lock *this
+) {
+	#ifdef _WIN32
+	ReleaseSRWLockShared (&this->primitive);
+	#else
+	pthread_rwlock_unlock (&this->primitive);
+	#endif
+}
+
+/*
+ * Description : Acquire the exclusive side of the lock.
+ *               /!\ The lock isn't recursive.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_acquire_exclusive (
+	D3D9Lock *this
+) {
+	D3D9Lock_acquire (this, true);
+
+	// Only the owner writes these fields
+	this->stats.exclusiveAcquisitions++;
+	this->exclusiveSince = (this->holdTiming) ? D3D9Lock_get_ticks () : 0;
+}
+
+/*
+ * Description : Acquire the exclusive side of the lock only if it is available right now
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : bool true if the lock has been acquired, it must be released then
+ */
+bool
+D3D9Lock_try_acquire_exclusive (
+	D3D9Lock *this
+) {
+	if (!D3D9Lock_try_acquire (this, true)) {
+		return false;
+	}
+
+	// Only the owner writes these fields
+	this->stats.exclusiveAcquisitions++;
+	this->exclusiveSince = (this->holdTiming) ? D3D9Lock_get_ticks () : 0;
+
+	return true;
+}
+
+/*
+ * Description : Release the exclusive side of the lock
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_release_exclusive (
+	D3D9Lock *this
+) {
+	// Acquired while the hold timing was disabled
+	if (this->exclusiveSince) {
+		long long held = D3D9Lock_get_ticks () - this->exclusiveSince;
+
+		this->stats.holdTime += held;
+		if (held > this->stats.maxHoldTime) {
+			this->stats.maxHoldTime = held;
+		}
+	}
+
+	#ifdef _WIN32
+	ReleaseSRWLockExclusive (&this->primitive);
+	#else
+	pthread_rwlock_unlock (&this->primitive);
+	#endif
+}
+
+/*
+ * Description : Enable or disable the measure of the time the exclusive side is held.
+ *               It costs two clock reads per exclusive acquisition, the wait time is measured anyway.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool enabled : true to measure the hold time
+ * Return : void
+ */
+void
+D3D9Lock_set_hold_timing (
+	D3D9Lock *this,
+	bool enabled
+) {
+	this->holdTiming = enabled;
+}
+
+/*
+ * Description : Get a snapshot of the contention counters, with times in microseconds
+ * D3D9Lock *this : An allocated D3D9Lock
+ * D3D9LockStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9Lock_get_stats (
+	D3D9Lock *this,
+	D3D9LockStats *stats
+) {
+	stats->sharedAcquisitions    = this->stats.sharedAcquisitions;
+	stats->exclusiveAcquisitions = this->stats.exclusiveAcquisitions;
+	stats->contentions           = this->stats.contentions;
+	stats->waitTime              = D3D9Lock_ticks_to_us (this->stats.waitTime);
+	stats->holdTime              = D3D9Lock_ticks_to_us (this->stats.holdTime);
+	stats->maxHoldTime           = D3D9Lock_ticks_to_us (this->stats.maxHoldTime);
+}
+
+/*
+ * Description : Reset the contention counters
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_reset_stats (
+	D3D9Lock *this
+) {
+	D3D9Lock_acquire_exclusive (this);
+	memset (&this->stats, 0, sizeof(this->stats));
+	D3D9Lock_release_exclusive (this);
+}
+
+/*
+ * Description : Release the primitive of a D3D9Lock initialized with D3D9Lock_init, without freeing the structure.
+ *               The lock must not be held.
+ * D3D9Lock *this : An initialized D3D9Lock
+ */
+void
+D3D9Lock_destroy (
+	D3D9Lock *this
+) {
+	// A SRW lock doesn't own any resource
+	#ifndef _WIN32
+	pthread_rwlock_destroy (&this->primitive);
+	#else
+	(void) this;
+	#endif
+}
+
+/*
+ * Description : Free an allocated D3D9Lock structure.
+ * D3D9Lock *this : An allocated D3D9Lock to free.
+ */
+void
+D3D9Lock_free (
+	D3D9Lock *this
+) {
+	if (this != NULL) {
+		D3D9Lock_destroy (this);
+		free (this);
+	}
+}
@@ -0,0 +1,195 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// ---------- Defines -------------
+// Number of failed attempts before a thread stops spinning and parks on the lock
+#define D3D9_LOCK_DEFAULT_SPIN_COUNT 64
+
+#ifdef _WIN32
+#define D3D9_LOCK_PRIMITIVE_INITIALIZER SRWLOCK_INIT
+#else
+#define D3D9_LOCK_PRIMITIVE_INITIALIZER PTHREAD_RWLOCK_INITIALIZER
+#endif
+
+// Static initializer of a D3D9Lock
+#define D3D9_LOCK_INITIALIZER {                      \
+	.primitive      = D3D9_LOCK_PRIMITIVE_INITIALIZER, \
+	.spinCount      = D3D9_LOCK_DEFAULT_SPIN_COUNT,    \
+	.holdTiming     = false,                           \
+	.exclusiveSince = 0,                               \
+	.stats          = {0}                              \
+}
+
+// ------ Structure declaration -------
+typedef struct
+{
+	// Number of times the shared / exclusive side has been acquired
+	volatile long long sharedAcquisitions;
+	volatile long long exclusiveAcquisitions;
+	// Number of acquisitions that had to spin or park because the lock was held
+	volatile long long contentions;
+	// Total time spent waiting for the lock, in ticks while locked, in microseconds in a snapshot
+	volatile long long waitTime;
+	// Total and longest time the exclusive side has been held, measured only when the hold timing is enabled
+	volatile long long holdTime;
+	volatile long long maxHoldTime;
+
+}	D3D9LockStats;
+
+typedef struct
+{
+	#ifdef _WIN32
+	SRWLOCK primitive;
+	#else
+	pthread_rwlock_t primitive;
+	#endif
+
+	int spinCount;
+	// The clock is read on every exclusive acquisition only when the hold timing is enabled
+	volatile bool holdTiming;
+	long long exclusiveSince;
+	D3D9LockStats stats;
+
+}	D3D9Lock;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9Lock structure.
+ * int spinCount : Number of attempts before parking the thread
+ * Return : A pointer to an allocated D3D9Lock.
+ */
+D3D9Lock *
+D3D9Lock_new (
+	int spinCount
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9Lock structure.
+ * D3D9Lock *this : An allocated D3D9Lock to initialize.
+ * int spinCount : Number of attempts before parking the thread
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Lock_init (
+	D3D9Lock *this,
+	int spinCount
+);
+
+/*
+ * Description : Acquire the shared side of the lock. Several readers can hold it together.
+ *               /!\ The lock isn't recursive.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_acquire_shared (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Release the shared side of the lock
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_release_shared (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Acquire the exclusive side of the lock.
+ *               /!\ The lock isn't recursive.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_acquire_exclusive (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Acquire the exclusive side of the lock only if it is available right now
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : bool true if the lock has been acquired, it must be released then
+ */
+bool
+D3D9Lock_try_acquire_exclusive (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Release the exclusive side of the lock
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_release_exclusive (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Enable or disable the measure of the time the exclusive side is held.
+ *               It costs two clock reads per exclusive acquisition, the wait time is measured anyway.
+ * D3D9Lock *this : An allocated D3D9Lock
+ * bool enabled : true to measure the hold time
+ * Return : void
+ */
+void
+D3D9Lock_set_hold_timing (
+	D3D9Lock *this,
+	bool enabled
+);
+
+/*
+ * Description : Get a snapshot of the contention counters, with times in microseconds
+ * D3D9Lock *this : An allocated D3D9Lock
+ * D3D9LockStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9Lock_get_stats (
+	D3D9Lock *this,
+	D3D9LockStats *stats
+);
+
+/*
+ * Description : Reset the contention counters
+ * D3D9Lock *this : An allocated D3D9Lock
+ * Return : void
+ */
+void
+D3D9Lock_reset_stats (
+	D3D9Lock *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Release the primitive of a D3D9Lock initialized with D3D9Lock_init, without freeing the structure.
+ *               The lock must not be held.
+ * D3D9Lock *this : An initialized D3D9Lock
+ */
+void
+D3D9Lock_destroy (
+	D3D9Lock *this
+);
+
+/*
+ * Description : Free an allocated D3D9Lock structure.
+ * D3D9Lock *this : An allocated D3D9Lock to free.
+ */
+void
+D3D9Lock_free (
+	D3D9Lock *this
+);
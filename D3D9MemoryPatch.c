@@ -0,0 +1,294 @@
+#include "D3D9MemoryPatch.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Private headers
+/*
+ * Description : Write the values or the originals of all the entries, changing the protection of each page once
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch
+ * bool revert : true to write back the originals, false to write the values
+ * Return : bool true on success, false if a page can't be made writable
+ */
+static bool D3D9MemoryPatch_write (D3D9MemoryPatch *this, bool revert);
+
+/*
+ * Description : Make a page writable
+ * void *page : Address of the page
+ * size_t size : Size of the page
+ * unsigned long *protection : Output of the previous protection
+ * Return : bool true on success, false on failure
+ */
+static bool D3D9MemoryPatch_unprotect (void *page, size_t size, unsigned long *protection);
+
+/*
+ * Description : Restore the protection of a page made writable by D3D9MemoryPatch_unprotect
+ * void *page : Address of the page
+ * size_t size : Size of the page
+ * unsigned long protection : The previous protection
+ * Return : void
+ */
+static void D3D9MemoryPatch_protect (void *page, size_t size, unsigned long protection);
+
+
+/*
+ * Description : Allocate a new D3D9MemoryPatch structure.
+ * Return : A pointer to an allocated D3D9MemoryPatch.
+ */
+D3D9MemoryPatch *
+D3D9MemoryPatch_new (
+	void
+) {
+	D3D9MemoryPatch *this;
+
+	if ((this = calloc (1, sizeof(D3D9MemoryPatch))) == NULL)
+		return NULL;
+
+	if (!D3D9MemoryPatch_init (this)) {
+		D3D9MemoryPatch_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9MemoryPatch structure.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9MemoryPatch_init (
+	D3D9MemoryPatch *this
+) {
+	this->entries     = NULL;
+	this->count       = 0;
+	this->capacity    = 0;
+	this->pages       = NULL;
+	this->protections = NULL;
+	this->pagesCount  = 0;
+	this->applied     = false;
+
+	#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo (&info);
+	this->pageSize = info.dwPageSize;
+	#else
+	this->pageSize = sysconf (_SC_PAGESIZE);
+	#endif
+
+	return this->pageSize != 0;
+}
+
+/*
+ * Description : Add a pointer to write when the patch is applied
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch, not applied
+ * void **address : Address of the pointer, aligned on the size of a pointer
+ * void *value : Value to write
+ * Return : int the index of the entry, or -1 if the address is misaligned, already patched, or out of memory
+ */
+int
+D3D9MemoryPatch_add (
+	D3D9MemoryPatch *this,
+	void **address,
+	void *value
+) {
+	void *page = (void *) ((size_t) address & ~(this->pageSize - 1));
+	int position;
+
+	// An aligned pointer never crosses a page, and is written at once
+	if (this->applied || ((size_t) address % sizeof(void *)) != 0) {
+		return -1;
+	}
+
+	for (int index = 0; index < this->count; index++) {
+		if (this->entries [index].address == address) {
+			return -1;
+		}
+	}
+
+	// The pages are reserved with the entries, so applying the patch doesn't allocate
+	if (this->count == this->capacity) {
+		int capacity = (this->capacity) ? this->capacity * 2 : 16;
+		D3D9MemoryPatchEntry *entries;
+		unsigned long *protections;
+		void **pages;
+
+		if ((entries = realloc (this->entries, capacity * sizeof(D3D9MemoryPatchEntry))) == NULL) {
+			return -1;
+		}
+		this->entries = entries;
+
+		if ((pages = realloc (this->pages, capacity * sizeof(void *))) == NULL) {
+			return -1;
+		}
+		this->pages = pages;
+
+		if ((protections = realloc (this->protections, capacity * sizeof(unsigned long))) == NULL) {
+			return -1;
+		}
+		this->protections = protections;
+
+		this->capacity = capacity;
+	}
+
+	// Insert the page sorted, once
+	for (position = 0; position < this->pagesCount && this->pages [position] < page; position++);
+
+	if (position == this->pagesCount || this->pages [position] != page) {
+		memmove (&this->pages [position + 1], &this->pages [position], (this->pagesCount - position) * sizeof(void *));
+		this->pages [position] = page;
+		this->pagesCount++;
+	}
+
+	D3D9MemoryPatchEntry *entry = &this->entries [this->count];
+	entry->address  = address;
+	entry->value    = value;
+	entry->original = NULL;
+
+	return this->count++;
+}
+
+/*
+ * Description : Make a page writable
+ * void *page : Address of the page
+ * size_t size : Size of the page
+ * unsigned long *protection : Output of the previous protection
+ * Return : bool true on success, false on failure
+ */
+static bool
+D3D9MemoryPatch_unprotect (
+	void *page,
+	size_t size,
+	unsigned long *protection
+) {
+	#ifdef _WIN32
+	// The page can contain code too, so it stays executable
+	return VirtualProtect (page, size, PAGE_EXECUTE_READWRITE, protection) != 0;
+	#else
+	*protection = PROT_READ;
+	return mprotect (page, size, PROT_READ | PROT_WRITE) == 0;
+	#endif
+}
+
+/*
+ * Description : Restore the protection of a page made writable by D3D9MemoryPatch_unprotect
+ * void *page : Address of the page
+ * size_t size : Size of the page
+ * unsigned long protection : The previous protection
+ * Return : void
+ */
+static void
+D3D9MemoryPatch_protect (
+	void *page,
+	size_t size,
+	unsigned long protection
+) {
+	#ifdef _WIN32
+	DWORD previous;
+	VirtualProtect (page, size, protection, &previous);
+	#else
+	mprotect (page, size, protection);
+	#endif
+}
+
+/*
+ * Description : Write the values or the originals of all the entries, changing the protection of each page once
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch
+ * bool revert : true to write back the originals, false to write the values
+ * Return : bool true on success, false if a page can't be made writable
+ */
+static bool
+D3D9MemoryPatch_write (
+	D3D9MemoryPatch *this,
+	bool revert
+) {
+	// All the pages are made writable before the first write, so a failure leaves the memory untouched
+	for (int page = 0; page < this->pagesCount; page++) {
+		if (!D3D9MemoryPatch_unprotect (this->pages [page], this->pageSize, &this->protections [page])) {
+			while (page-- > 0) {
+				D3D9MemoryPatch_protect (this->pages [page], this->pageSize, this->protections [page]);
+			}
+			return false;
+		}
+	}
+
+	for (int index = 0; index < this->count; index++) {
+		D3D9MemoryPatchEntry *entry = &this->entries [index];
+
+		if (revert) {
+			(void) __sync_lock_test_and_set (entry->address, entry->original);
+		} else {
+			entry->original = __sync_lock_test_and_set (entry->address, entry->value);
+		}
+	}
+
+	__sync_synchronize ();
+
+	for (int page = 0; page < this->pagesCount; page++) {
+		D3D9MemoryPatch_protect (this->pages [page], this->pageSize, this->protections [page]);
+	}
+
+	return true;
+}
+
+/*
+ * Description : Write all the pointers of the patch and keep the values replaced in the entries.
+ *               Nothing is allocated, so it can be called while the other threads are suspended.
+ *               On POSIX the previous protection can't be read : the pages are left read only.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch
+ * Return : bool true on success, false if a page can't be made writable : nothing is written then.
+ */
+bool
+D3D9MemoryPatch_apply (
+	D3D9MemoryPatch *this
+) {
+	if (this->applied || !D3D9MemoryPatch_write (this, false)) {
+		return false;
+	}
+
+	this->applied = true;
+
+	return true;
+}
+
+/*
+ * Description : Write back the values replaced by D3D9MemoryPatch_apply
+ * D3D9MemoryPatch *this : An applied D3D9MemoryPatch
+ * Return : bool true on success, false if not applied or a page can't be made writable : nothing is written then.
+ */
+bool
+D3D9MemoryPatch_revert (
+	D3D9MemoryPatch *this
+) {
+	if (!this->applied || !D3D9MemoryPatch_write (this, true)) {
+		return false;
+	}
+
+	this->applied = false;
+
+	return true;
+}
+
+/*
+ * Description : Free an allocated D3D9MemoryPatch structure. An applied patch stays in memory.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch to free.
+ */
+void
+D3D9MemoryPatch_free (
+	D3D9MemoryPatch *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	free (this->entries);
+	free (this->pages);
+	free (this->protections);
+	free (this);
+}
@@ -0,0 +1,111 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+
+
+// ------ Structure declaration -------
+
+// Pointer written by the patch, like a slot of a vftable
+typedef struct
+{
+	void **address;
+	void *value;
+
+	// Value replaced, filled by D3D9MemoryPatch_apply
+	void *original;
+
+}	D3D9MemoryPatchEntry;
+
+// Set of pointers written all at once : the protection of each page is changed once for all its pointers,
+// and nothing is written if a page can't be made writable.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	D3D9MemoryPatchEntry *entries;
+	int count;
+	int capacity;
+
+	// Distinct pages of the entries and their protection before the patch, sorted by address
+	void **pages;
+	unsigned long *protections;
+	int pagesCount;
+
+	size_t pageSize;
+	bool applied;
+
+}	D3D9MemoryPatch;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9MemoryPatch structure.
+ * Return : A pointer to an allocated D3D9MemoryPatch.
+ */
+D3D9MemoryPatch *
+D3D9MemoryPatch_new (
+	void
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9MemoryPatch structure.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9MemoryPatch_init (
+	D3D9MemoryPatch *this
+);
+
+/*
+ * Description : Add a pointer to write when the patch is applied
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch, not applied
+ * void **address : Address of the pointer, aligned on the size of a pointer
+ * void *value : Value to write
+ * Return : int the index of the entry, or -1 if the address is misaligned, already patched, or out of memory
+ */
+int
+D3D9MemoryPatch_add (
+	D3D9MemoryPatch *this,
+	void **address,
+	void *value
+);
+
+/*
+ * Description : Write all the pointers of the patch and keep the values replaced in the entries.
+ *               Nothing is allocated, so it can be called while the other threads are suspended.
+ *               On POSIX the previous protection can't be read : the pages are left read only.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch
+ * Return : bool true on success, false if a page can't be made writable : nothing is written then.
+ */
+bool
+D3D9MemoryPatch_apply (
+	D3D9MemoryPatch *this
+);
+
+/*
+ * Description : Write back the values replaced by D3D9MemoryPatch_apply
+ * D3D9MemoryPatch *this : An applied D3D9MemoryPatch
+ * Return : bool true on success, false if not applied or a page can't be made writable : nothing is written then.
+ */
+bool
+D3D9MemoryPatch_revert (
+	D3D9MemoryPatch *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9MemoryPatch structure. An applied patch stays in memory.
+ * D3D9MemoryPatch *this : An allocated D3D9MemoryPatch to free.
+ */
+void
+D3D9MemoryPatch_free (
+	D3D9MemoryPatch *this
+);
@@ -1,24 +1,101 @@
 #include "D3D9Object.h"
+#include <stddef.h>
 
 // ---------- Debugging -------------
 #define __DEBUG_OBJECT__ "D3D9Object"
 #include "dbg/dbg.h"
 
+// Get the D3D9Object containing a D3D9ObjectRect, D3D9ObjectText or D3D9ObjectSprite
+#define D3D9Object_from_member(member, field) \
+	((D3D9Object *) ((char *) (member) - offsetof (D3D9Object, field)))
+
+// Row of the draw list copied by the DirectX thread, consistent with the writes in place
+typedef struct {
+	IDirect3DTexture9 *texture;
+	int x, y, w, h;
+	D3DCOLOR color;
+} D3D9ObjectDrawRow;
+
+// Number of objects reclaimed at once
+#define D3D9_OBJECT_RECLAIM_BATCH 64
+
+// Minimum number of rows of a draw list snapshot
+#define D3D9_OBJECT_DRAW_LIST_MIN_CAPACITY 64
+
+// Iterate over the slot indices of a list of the factory table. The slot iterated can't be removed from the list meanwhile.
+#define foreach_d3d9object_slot(list, index) \
+	foreach_d3d9object_table_slot (&d3d9ObjectFactory.table, (list), index)
+
+// Snapshot drawn before the first publication
+static D3D9ObjectDrawList emptyDrawList = {
+	.count   = 0,
+	.objects = NULL
+};
+
 // Factory declaration and static initialization
 struct D3D9ObjectFactory {
-	BbQueue drawObjects;
-	BbQueue allObjects;
-	BbQueue spriteToInstanciate;
-	HANDLE mutex;
-	int id;
-	bool initialized;
+	D3D9ObjectPool *objectPool;
+	// Objects of the factory, with the list of the objects drawn and the list of all the objects
+	D3D9ObjectTable table;
+	D3D9ImageLoader *imageLoader;
+	D3D9Atlas *atlas;
+	D3D9TextureCache textureCache;
+	D3D9FontCache fontCache;
+	int uploadBudget;
+	ID3DXSprite *sprite;
+	D3D9RectRenderer *rectRenderer;
+	D3D9SpatialGrid *grid;
+	D3D9SpriteBatch spriteBatch;
+	unsigned int *visibleMask;
+	int visibleCapacity;
+	D3D9ObjectDrawStats drawStats;
+	// Snapshots of the draw list built by the writers, and the objects deleted until the DirectX thread frees them
+	D3D9SnapshotExchange snapshots;
+	// Whether the draw list changed since the last snapshot, published when the writer releases the factory
+	bool changed;
+	// Owned by the DirectX thread : texts measured and sprites uploaded, given to the factory when it isn't held by a writer,
+	// and objects deleted that these lists still reference.
+	D3D9ObjectText *measuredTexts;
+	D3D9Object *uploadedSprites;
+	D3D9Object *deletedObjects;
+	// Owned by the DirectX thread : texts owning a quad, released before the device is reset
+	D3D9ObjectText *renderedTexts;
+	D3D9Lock lock;
+	// Thread holding the factory exclusively, 0 if none, and the number of times it locked it
+	volatile DWORD lockOwner;
+	int lockDepth;
 } d3d9ObjectFactory = {
-	.drawObjects         = bb_queue_local_decl (),
-	.allObjects          = bb_queue_local_decl (),
-	.spriteToInstanciate = bb_queue_local_decl (),
-	.mutex               = NULL,
-	.id                  = 0,
-	.initialized         = false
+	.objectPool          = NULL,
+	.table               = D3D9_OBJECT_TABLE_INITIALIZER,
+	.imageLoader         = NULL,
+	.atlas               = NULL,
+	.textureCache        = {
+		.lruFirst = NULL,
+		.lruLast  = NULL,
+		.evicted  = NULL,
+		.budget   = D3D9_TEXTURE_CACHE_DEFAULT_BUDGET,
+		.lock     = D3D9_LOCK_INITIALIZER
+	},
+	.fontCache           = {
+		.fonts = bb_queue_local_decl (),
+		.lock  = D3D9_LOCK_INITIALIZER
+	},
+	.uploadBudget        = D3D9_OBJECT_SPRITE_DEFAULT_UPLOAD_BUDGET,
+	.sprite              = NULL,
+	.rectRenderer        = NULL,
+	.grid                = NULL,
+	.spriteBatch         = D3D9_SPRITE_BATCH_INITIALIZER,
+	.visibleMask         = NULL,
+	.visibleCapacity     = 0,
+	.snapshots           = D3D9_SNAPSHOT_EXCHANGE_INITIALIZER (D3D9Object, nextRetired),
+	.changed             = false,
+	.measuredTexts       = NULL,
+	.renderedTexts       = NULL,
+	.uploadedSprites     = NULL,
+	.deletedObjects      = NULL,
+	.lock                = D3D9_LOCK_INITIALIZER,
+	.lockOwner           = 0,
+	.lockDepth           = 0
 };
 
 // Private headers
@@ -29,6 +106,434 @@ struct D3D9ObjectFactory {
  */
 static void D3D9ObjectFactory_add (D3D9Object *this);
 
+/*
+ * Description      : Reserve a slot in the factory object table and give its ID to the object
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : bool true on success, false otherwise
+ */
+static bool D3D9ObjectFactory_register (D3D9Object *this);
+
+/*
+ * Description      : Release the slot of the object, so its ID becomes invalid
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void D3D9ObjectFactory_unregister (D3D9Object *this);
+
+/*
+ * Description     : Get the slot of an ID if the ID is still valid
+ * unsigned int id : A D3D9ObjectFactory ID
+ * Return          : D3D9ObjectTableSlot * the slot of the ID, or NULL if the ID is stale or unknown
+ */
+static D3D9ObjectTableSlot * D3D9ObjectFactory_get_slot (unsigned int id);
+
+/*
+ * Description : Mark the draw list as changed, so a new snapshot is published when the factory is released.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
+ * Return      : void
+ */
+static void D3D9ObjectFactory_invalidate (void);
+
+/*
+ * Description : Build a new snapshot of the draw list and publish it for the DirectX thread.
+ *               /!\ The factory MUST BE LOCKED exclusively when calling this function.
+ * Return      : bool true on success, false otherwise
+ */
+static bool D3D9ObjectFactory_publish (void);
+
+/*
+ * Description : Get the last snapshot published. It is current while the factory is locked.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
+ * Return      : D3D9ObjectDrawList * the snapshot published
+ */
+static D3D9ObjectDrawList * D3D9ObjectFactory_get_published (void);
+
+/*
+ * Description : Lock the factory exclusively only if no other thread holds it, so the DirectX thread never waits for the writers.
+ *               Like D3D9ObjectFactory_lock, it is recursive.
+ * Return      : bool true if the factory is locked, false otherwise
+ */
+static bool D3D9ObjectFactory_try_lock (void);
+
+/*
+ * Description : Give the extents of the texts measured and the sprites uploaded by the DirectX thread to the factory,
+ *               if no writer holds it. Their rows are written in the snapshot published, without building a new one.
+ *               /!\ This function must be called only from the DirectX thread, outside D3D9ObjectFactory_acquire_draw_list.
+ * Return      : bool true if nothing is left waiting for the factory
+ */
+static bool D3D9ObjectFactory_apply_pending (void);
+
+/*
+ * Description      : Draw a sprite uploaded by the DirectX thread on top of the others.
+ *                    Its row is appended to the snapshot published when it has room for it.
+ *                    /!\ The factory MUST BE LOCKED, and this function must be called only from the DirectX thread.
+ * D3D9Object *this : An allocated D3D9Object of type sprite
+ * Return           : void
+ */
+static void D3D9ObjectFactory_add_uploaded (D3D9Object *this);
+
+/*
+ * Description                  : Copy the hot fields of an object into a snapshot of the draw list
+ * D3D9ObjectDrawList *drawList : A snapshot of the draw list
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
+ */
+static void D3D9ObjectDrawList_fill (D3D9ObjectDrawList *drawList, int index, D3D9Object *object);
+
+/*
+ * Description                  : Copy the fields of an object that a change keeps the draw order of into a row of the draw list
+ * D3D9ObjectDrawList *drawList : A snapshot of the draw list
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
+ */
+static void D3D9ObjectDrawList_copy_fields (D3D9ObjectDrawList *drawList, int index, D3D9Object *object);
+
+/*
+ * Description                  : Write the fields of an object into its row of the snapshot published, while the DirectX thread may read it.
+ *                                /!\ The factory MUST BE LOCKED exclusively when calling this function.
+ * D3D9ObjectDrawList *drawList : The snapshot published
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
+ */
+static void D3D9ObjectDrawList_write_row (D3D9ObjectDrawList *drawList, int index, D3D9Object *object);
+
+/*
+ * Description                  : Copy a row of the draw list, consistent with the writes in place
+ *                                /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int index                    : Index of the object in the snapshot
+ * D3D9ObjectDrawRow *row       : Output of the row
+ * Return                       : void
+ */
+static void D3D9ObjectDrawList_read_row (D3D9ObjectDrawList *drawList, int index, D3D9ObjectDrawRow *row);
+
+/*
+ * Description      : Get the new fields of an object drawn into the next snapshot, and index its new bounds.
+ *                    /!\ The factory MUST BE LOCKED when calling this function.
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void D3D9ObjectFactory_update (D3D9Object *this);
+
+/*
+ * Description        : Defer the release of an object until the DirectX thread can't draw it anymore
+ *                      /!\ The factory MUST BE LOCKED when calling this function.
+ * D3D9Object *object : An object removed from the factory
+ * Return             : void
+ */
+static void D3D9ObjectFactory_retire (D3D9Object *object);
+
+/*
+ * Description        : Release the objects deleted that no snapshot references anymore. The ones still referenced
+ *                      by the lists of the DirectX thread are kept until these lists are applied.
+ *                      /!\ This function must be called only from the DirectX thread, without the lock.
+ * D3D9Object *object : The objects given back by the snapshot exchange, linked through nextRetired
+ * Return             : void
+ */
+static void D3D9ObjectFactory_reclaim (D3D9Object *object);
+
+/*
+ * Description      : Check if an object deleted is still referenced by the lists of the DirectX thread or by the image loader
+ *                    /!\ This function must be called only from the DirectX thread.
+ * D3D9Object *this : An object deleted
+ * Return           : bool true if the object can't be freed yet
+ */
+static bool D3D9Object_is_pending (D3D9Object *this);
+
+/*
+ * Description      : Release the resources of an object removed from the factory, without freeing its memory
+ *                    /!\ This function must be called only from the DirectX thread.
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void D3D9Object_clear (D3D9Object *this);
+
+/*
+ * Description  : Get the top level object of the draw list at a given position.
+ *                /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y : The position to test
+ * Return       : A pointer to the object at this position, or NULL
+ */
+static D3D9Object * D3D9ObjectFactory_get_object_at (int x, int y);
+
+/*
+ * Description  : Get the top level object at a given position by testing all the bounds of the published snapshot.
+ *                Used when the spatial index can't answer.
+ *                /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y : The position to test
+ * Return       : A pointer to the object at this position, or NULL
+ */
+static D3D9Object * D3D9ObjectFactory_scan_object_at (int x, int y);
+
+/*
+ * Description      : Insert a drawn object in the spatial index with its current bounds, or remove it if it isn't drawn anymore.
+ *                    /!\ The factory MUST BE LOCKED when calling this function.
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void D3D9ObjectFactory_index (D3D9Object *this);
+
+/*
+ * Description      : Get the size of an object on the screen
+ * D3D9Object *this : An allocated D3D9Object
+ * int *w, int *h   : Output of the size. The size of a text is known once it has been drawn.
+ * Return           : void
+ */
+static void D3D9Object_get_size (D3D9Object *this, int *w, int *h);
+
+/*
+ * Description                : Get the objects of the draw list intersecting a rectangle, the top level object first.
+ *                              /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y, int w, int h : The rectangle to test
+ * D3D9Object **objects       : Output of the objects found
+ * int capacity               : Maximum number of objects written
+ * Return                     : int the number of objects found, it can be greater than capacity
+ */
+static int D3D9ObjectFactory_query (int x, int y, int w, int h, D3D9Object **objects, int capacity);
+
+/*
+ * Description  : Order the handles of the spatial index from the top level object to the bottom one
+ * const void *a, const void *b : Handles of drawn objects
+ * Return       : int like strcmp
+ */
+static int D3D9ObjectFactory_compare_depth (const void *a, const void *b);
+
+/*
+ * Description                    : Publish the result of the DirectX initialization of a sprite and signal its waiters
+ * D3D9Object *this               : An allocated D3D9Object of type sprite
+ * D3D9ObjectSpriteStatus status  : D3D9_OBJECT_SPRITE_READY or D3D9_OBJECT_SPRITE_ERROR
+ * Return                         : void
+ */
+static void D3D9ObjectSprite_complete (D3D9Object *this, D3D9ObjectSpriteStatus status);
+
+/*
+ * Description                 : Create the texture of a sprite from its decoded image, then complete the sprite.
+ *                               /!\ This function must be called only from the DirectX thread.
+ * D3D9ImageRequest *request   : A request decoded by the image loader, freed by this function
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * Return                      : void
+ */
+static void D3D9ObjectSprite_upload (D3D9ImageRequest *request, IDirect3DDevice9 * pDevice);
+
+/*
+ * Description                 : Get the sprite shared by all the sprite objects, and create it the first time.
+ *                               /!\ This function must be called only from the DirectX thread.
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * Return                      : ID3DXSprite * the shared sprite, or NULL on error
+ */
+static ID3DXSprite * D3D9ObjectFactory_get_sprite (IDirect3DDevice9 * pDevice);
+
+/*
+ * Description                 : Get the renderer shared by all the rectangle objects, and create it the first time.
+ * Return                      : D3D9RectRenderer * the shared renderer, or NULL on error
+ */
+static D3D9RectRenderer * D3D9ObjectFactory_get_rect_renderer (void);
+
+/*
+ * Description                  : Draw the run of consecutive rectangles starting at an index of the draw list in one batch
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int first                    : Index of the first rectangle of the run
+ * unsigned int *visible        : The visibility mask of the frame, or NULL
+ * IDirect3DDevice9 * pDevice   : An allocated d3d9 device
+ * D3D9ObjectDrawStats *stats   : Counters of the frame
+ * Return                       : int the index following the run
+ */
+static int D3D9ObjectFactory_draw_rects (D3D9ObjectDrawList *drawList, int first, unsigned int *visible, IDirect3DDevice9 * pDevice, D3D9ObjectDrawStats *stats);
+
+/*
+ * Description                  : Mark the objects of the draw list intersecting the viewport in the visibility mask.
+ *                                /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * IDirect3DDevice9 * pDevice   : An allocated d3d9 device
+ * Return                       : unsigned int * the visibility mask, or NULL if every object must be drawn
+ */
+static unsigned int * D3D9ObjectFactory_cull (D3D9ObjectDrawList *drawList, IDirect3DDevice9 * pDevice);
+
+/*
+ * Description           : Check if an object of the draw list must be drawn
+ * unsigned int *visible : The visibility mask of the frame, or NULL
+ * int index             : Index of the object in the snapshot
+ * Return                : bool true if the object intersects the viewport
+ */
+static inline bool D3D9ObjectFactory_is_visible (unsigned int *visible, int index);
+
+/*
+ * Description                 : Get the renderer shared by all the rectangle objects, and create it the first time.
+ * Return                      : D3D9RectRenderer * the shared renderer, or NULL on error
+ */
+static D3D9RectRenderer *
+D3D9ObjectFactory_get_rect_renderer (
+	void
+) {
+	if (!d3d9ObjectFactory.rectRenderer
+	&&  !(d3d9ObjectFactory.rectRenderer = D3D9RectRenderer_new (D3D9_RECT_RENDERER_DEFAULT_CAPACITY))) {
+		warn ("Cannot allocate the rectangle renderer.");
+	}
+
+	return d3d9ObjectFactory.rectRenderer;
+}
+
+/*
+ * Description                  : Draw the run of consecutive rectangles starting at an index of the draw list in one batch
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int first                    : Index of the first rectangle of the run
+ * unsigned int *visible        : The visibility mask of the frame, or NULL
+ * IDirect3DDevice9 * pDevice   : An allocated d3d9 device
+ * D3D9ObjectDrawStats *stats   : Counters of the frame
+ * Return                       : int the index following the run
+ */
+static int
+D3D9ObjectFactory_draw_rects (
+	D3D9ObjectDrawList *drawList,
+	int first,
+	unsigned int *visible,
+	IDirect3DDevice9 * pDevice,
+	D3D9ObjectDrawStats *stats
+) {
+	D3D9RectRenderer *renderer = D3D9ObjectFactory_get_rect_renderer ();
+	int last;
+
+	for (last = first; last < drawList->count && drawList->types [last] == D3D9_OBJECT_RECTANGLE; last++) {
+		if (!D3D9ObjectFactory_is_visible (visible, last)) {
+			stats->culled++;
+			continue;
+		}
+
+		if (renderer) {
+			D3D9ObjectDrawRow row;
+
+			D3D9ObjectDrawList_read_row (drawList, last, &row);
+			D3D9RectRenderer_add (renderer, row.x, row.y, row.w, row.h, row.color);
+		}
+	}
+
+	if (renderer) {
+		stats->drawCalls += D3D9RectRenderer_flush (renderer, pDevice);
+	}
+
+	return last;
+}
+
+/*
+ * Description                  : Mark the objects of the draw list intersecting the viewport in the visibility mask.
+ *                                /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * IDirect3DDevice9 * pDevice   : An allocated d3d9 device
+ * Return                       : unsigned int * the visibility mask, or NULL if every object must be drawn
+ */
+static unsigned int *
+D3D9ObjectFactory_cull (
+	D3D9ObjectDrawList *drawList,
+	IDirect3DDevice9 * pDevice
+) {
+	int words = D3D9_BOUNDS_MASK_WORDS (drawList->count);
+	unsigned int sequence;
+	D3DVIEWPORT9 viewport;
+	D3D9Bounds bounds = {
+		.x     = drawList->x,
+		.y     = drawList->y,
+		.w     = drawList->w,
+		.h     = drawList->h,
+		.count = drawList->count
+	};
+
+	if (FAILED (pDevice->lpVtbl->GetViewport (pDevice, &viewport))) {
+		return NULL;
+	}
+
+	// Grow the mask, reused from a frame to another
+	if (words > d3d9ObjectFactory.visibleCapacity) {
+		unsigned int *visibleMask;
+		int capacity = words * 2;
+
+		if ((visibleMask = realloc (d3d9ObjectFactory.visibleMask, sizeof(unsigned int) * capacity)) == NULL) {
+			return NULL;
+		}
+
+		d3d9ObjectFactory.visibleMask = visibleMask;
+		d3d9ObjectFactory.visibleCapacity = capacity;
+	}
+
+	sequence = D3D9SeqLock_read_begin (&drawList->sequence);
+	D3D9BoundsKernel_intersect (&bounds, viewport.X, viewport.Y, viewport.Width, viewport.Height, d3d9ObjectFactory.visibleMask);
+
+	// A row moved while the bounds were tested : nothing is culled in this frame, rather than retrying
+	if (D3D9SeqLock_read_retry (&drawList->sequence, sequence)) {
+		return NULL;
+	}
+
+	return d3d9ObjectFactory.visibleMask;
+}
+
+/*
+ * Description           : Check if an object of the draw list must be drawn
+ * unsigned int *visible : The visibility mask of the frame, or NULL
+ * int index             : Index of the object in the snapshot
+ * Return                : bool true if the object intersects the viewport
+ */
+static inline bool
+D3D9ObjectFactory_is_visible (
+	unsigned int *visible,
+	int index
+) {
+	return (visible == NULL) || D3D9_BOUNDS_MASK_TEST (visible, index);
+}
+
+/*
+ * Description                  : Draw the run of consecutive sprites starting at an index of the draw list in one batch
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int first                    : Index of the first sprite of the run
+ * unsigned int *visible        : The visibility mask of the frame, or NULL
+ * D3D9ObjectDrawStats *stats   : Counters of the frame
+ * Return                       : int the index following the run
+ */
+static int D3D9ObjectFactory_draw_sprites (D3D9ObjectDrawList *drawList, int first, unsigned int *visible, D3D9ObjectDrawStats *stats);
+
+/*
+ * Description            : Get the part of its texture drawn by a sprite
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite, uploaded
+ * Return                 : RECT * the region of the atlas page containing the image, or NULL for the whole texture
+ */
+static RECT * D3D9ObjectSprite_get_source (D3D9ObjectSprite *this);
+
+/*
+ * Description            : Draw a sprite inside a batch already begun
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite
+ * ID3DXSprite *sprite    : The shared sprite, between Begin and End
+ * int x, y               : {x, y} position of the sprite
+ * D3DCOLOR color         : Color modulating the sprite, its alpha is the opacity
+ * Return                 : void
+ */
+static void D3D9ObjectSprite_draw_batched (D3D9ObjectSprite *this, ID3DXSprite *sprite, int x, int y, D3DCOLOR color);
+
+/*
+ * Description          : Measure the string of a text and load its glyphs in the font cache
+ *                        /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this : An allocated D3D9ObjectText
+ * Return               : void
+ */
+static void D3D9ObjectText_layout (D3D9ObjectText *this);
+
+/*
+ * Description                 : Render the layout of a text into a new quad, in white over a transparent background
+ *                               /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this        : An allocated D3D9ObjectText, measured
+ * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
+ * Return                      : bool true if the quad has been rendered, false otherwise
+ */
+static bool D3D9ObjectText_render (D3D9ObjectText *this, IDirect3DDevice9 * pDevice);
+
+/*
+ * Description          : Release the quad of a text, rendered again by the next draw
+ *                        /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this : An allocated D3D9ObjectText
+ * Return               : void
+ */
+static void D3D9ObjectText_release_quad (D3D9ObjectText *this);
+
 
 /// ===== D3D9ObjectFactory =====
 /*
@@ -42,23 +547,91 @@ D3D9ObjectFactory_createD3D9Object (
 ) {
 	D3D9Object *this = NULL;
 
-	// Check if the factory has been initialized
-	if (!d3d9ObjectFactory.initialized) {
-		d3d9ObjectFactory.mutex = CreateMutex (NULL, false, NULL);
-		d3d9ObjectFactory.initialized = true;
+	D3D9ObjectFactory_lock ();
+
+	// The objects are allocated in contiguous slabs, so the draw loop walks through close memory
+	if (!d3d9ObjectFactory.objectPool
+	&&  !(d3d9ObjectFactory.objectPool = D3D9ObjectPool_new (sizeof(D3D9Object), D3D9_OBJECT_POOL_DEFAULT_SLAB_COUNT))) {
+		warn ("Cannot allocate the pool of objects.");
+		D3D9ObjectFactory_release ();
+		return NULL;
 	}
 
 	// Allocate a new instance of D3D9Object
-	if ((this = calloc (1, sizeof(D3D9Object))) == NULL)
+	if ((this = D3D9ObjectPool_alloc (d3d9ObjectFactory.objectPool)) == NULL) {
+		D3D9ObjectFactory_release ();
 		return NULL;
+	}
 
 	this->type  = type;
-	this->id    = d3d9ObjectFactory.id++;
-	this->mutex = d3d9ObjectFactory.mutex;
+	this->lock  = &d3d9ObjectFactory.lock;
+
+	if (!D3D9ObjectFactory_register (this)) {
+		D3D9ObjectPool_release (d3d9ObjectFactory.objectPool, this);
+		D3D9ObjectFactory_release ();
+		return NULL;
+	}
+
+	D3D9ObjectFactory_release ();
 
 	return this;
 }
 
+/*
+ * Description      : Reserve a slot in the factory object table and give its ID to the object
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : bool true on success, false otherwise
+ */
+static bool
+D3D9ObjectFactory_register (
+	D3D9Object *this
+) {
+	int id;
+
+	if ((id = D3D9ObjectTable_register (&d3d9ObjectFactory.table, this)) == -1) {
+		warn ("Too many objects allocated in the factory.");
+		return false;
+	}
+
+	this->id = id;
+
+	return true;
+}
+
+/*
+ * Description      : Release the slot of the object, so its ID becomes invalid
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void
+D3D9ObjectFactory_unregister (
+	D3D9Object *this
+) {
+	D3D9ObjectTableSlot *slot;
+
+	if (!(slot = D3D9ObjectFactory_get_slot (this->id)) || slot->object != this) {
+		return;
+	}
+
+	if (d3d9ObjectFactory.grid) {
+		D3D9SpatialGrid_remove (d3d9ObjectFactory.grid, D3D9_OBJECT_TABLE_INDEX (this->id));
+	}
+
+	D3D9ObjectTable_unregister (&d3d9ObjectFactory.table, this->id);
+}
+
+/*
+ * Description     : Get the slot of an ID if the ID is still valid
+ * unsigned int id : A D3D9ObjectFactory ID
+ * Return          : D3D9ObjectTableSlot * the slot of the ID, or NULL if the ID is stale or unknown
+ */
+static D3D9ObjectTableSlot *
+D3D9ObjectFactory_get_slot (
+	unsigned int id
+) {
+	return D3D9ObjectTable_get_slot (&d3d9ObjectFactory.table, id);
+}
+
 /*
  * Description      : Add a D3D9Object into the collection of the factory
  * D3D9Object *this : An allocated D3D9Object
@@ -68,11 +641,16 @@ static void
 D3D9ObjectFactory_add (
 	D3D9Object *this
 ) {
-	if (!bb_queue_exists (&d3d9ObjectFactory.drawObjects, this))
-		bb_queue_add (&d3d9ObjectFactory.drawObjects, this);
+	if (!D3D9ObjectFactory_get_slot (this->id)) {
+		warn ("Object ID=%d isn't registered in the factory.", this->id);
+		return;
+	}
 
-	if (!bb_queue_exists (&d3d9ObjectFactory.allObjects, this))
-		bb_queue_add (&d3d9ObjectFactory.allObjects, this);
+	if (D3D9ObjectTable_add (&d3d9ObjectFactory.table, D3D9_OBJECT_TABLE_INDEX (this->id))) {
+		D3D9ObjectFactory_index (this);
+	}
+
+	D3D9ObjectFactory_invalidate ();
 }
 
 /*
@@ -84,16 +662,14 @@ D3D9Object *
 D3D9ObjectFactory_get (
 	unsigned int id
 ) {
-	foreach_bbqueue_item (&d3d9ObjectFactory.allObjects, D3D9Object *object)
-	{
-		if (object->id == id) {
-			return object;
-		}
-	}
+	D3D9ObjectTableSlot *slot;
 
-	warn ("Object ID=%d not found in global list.", id);
+	if (!(slot = D3D9ObjectFactory_get_slot (id)) || !slot->listed) {
+		warn ("Object ID=%d not found in global list.", id);
+		return NULL;
+	}
 
-	return NULL;
+	return slot->object;
 }
 
 /*
@@ -105,16 +681,14 @@ D3D9Object *
 D3D9ObjectFactory_get_draw (
 	unsigned int id
 ) {
-	foreach_bbqueue_item (&d3d9ObjectFactory.drawObjects, D3D9Object *object)
-	{
-		if (object->id == id) {
-			return object;
-		}
-	}
+	D3D9ObjectTableSlot *slot;
 
-	warn ("Object ID=%d not found in draw list.", id);
+	if (!(slot = D3D9ObjectFactory_get_slot (id)) || !slot->drawn) {
+		warn ("Object ID=%d not found in draw list.", id);
+		return NULL;
+	}
 
-	return NULL;
+	return slot->object;
 }
 
 /*
@@ -132,22 +706,18 @@ D3D9ObjectFactory_show (
 
 	if (!(object = D3D9ObjectFactory_get (id))) {
 		warn ("Cannot show object ID=%d.", id);
+		D3D9ObjectFactory_release ();
 		return NULL;
 	}
 
-	// Put the object shown in the last position of the allObject list, so
+	// Put the object on top. It goes last in the list of all the objects too, so
 	// it keeps a coherent order when hide_all / show_all is called.
-	bb_queue_put_last (&d3d9ObjectFactory.allObjects, object);
-
-	// If already exists, put it to the last position
-	if (bb_queue_exists (&d3d9ObjectFactory.drawObjects, object)) {
-		bb_queue_put_last (&d3d9ObjectFactory.drawObjects, object);
-	}
-	else {
-		// Add the object in the draw list
-		bb_queue_add (&d3d9ObjectFactory.drawObjects, object);
+	if (D3D9ObjectTable_show (&d3d9ObjectFactory.table, D3D9_OBJECT_TABLE_INDEX (id))) {
+		D3D9ObjectFactory_index (object);
 	}
 
+	D3D9ObjectFactory_invalidate ();
+
 	D3D9ObjectFactory_release ();
 
 	return object;
@@ -164,12 +734,15 @@ D3D9ObjectFactory_show_all (
 ) {
 	D3D9ObjectFactory_lock ();
 
-	foreach_bbqueue_item (&d3d9ObjectFactory.allObjects, D3D9Object *object)
+	foreach_d3d9object_slot (&d3d9ObjectFactory.table.allObjects, index)
 	{
-		if (!bb_queue_exists (&d3d9ObjectFactory.drawObjects, object))
-			bb_queue_add (&d3d9ObjectFactory.drawObjects, object);
+		if (D3D9ObjectTable_add (&d3d9ObjectFactory.table, index)) {
+			D3D9ObjectFactory_index (d3d9ObjectFactory.table.slots [index].object);
+		}
 	}
 
+	D3D9ObjectFactory_invalidate ();
+
 	D3D9ObjectFactory_release ();
 }
 
@@ -188,16 +761,15 @@ D3D9ObjectFactory_hide (
 
 	if (!(object = D3D9ObjectFactory_get_draw (id))) {
 		warn ("Cannot hide object ID=%d.", id);
+		D3D9ObjectFactory_release ();
 		return NULL;
 	}
 
 	// Remove from the draw list
-	if (!(bb_queue_exists (&d3d9ObjectFactory.drawObjects, object))) {
-		warn ("Object ID=%d doesn't exist in the draw list. Abort hide.", id);
-		return NULL;
-	}
+	D3D9ObjectTable_hide (&d3d9ObjectFactory.table, D3D9_OBJECT_TABLE_INDEX (id));
+	D3D9ObjectFactory_index (object);
 
-	bb_queue_remv (&d3d9ObjectFactory.drawObjects, object);
+	D3D9ObjectFactory_invalidate ();
 
 	D3D9ObjectFactory_release ();
 
@@ -216,10 +788,15 @@ D3D9ObjectFactory_hide_all (
 	D3D9ObjectFactory_lock ();
 
 	// Remove all D3D9Objects from the drawObjects list
-	while (bb_queue_get_length (&d3d9ObjectFactory.drawObjects)) {
-		bb_queue_pop (&d3d9ObjectFactory.drawObjects);
+	while (d3d9ObjectFactory.table.drawObjects.count) {
+		int index = d3d9ObjectFactory.table.drawObjects.head;
+
+		D3D9ObjectTable_hide (&d3d9ObjectFactory.table, index);
+		D3D9ObjectFactory_index (d3d9ObjectFactory.table.slots [index].object);
 	}
 
+	D3D9ObjectFactory_invalidate ();
+
 	D3D9ObjectFactory_release ();
 }
 
@@ -238,16 +815,14 @@ D3D9ObjectFactory_delete (
 
 	if (!(object = D3D9ObjectFactory_get (id))) {
 		warn ("Cannot find the object to delete.");
+		D3D9ObjectFactory_release ();
 		return;
 	}
 
-	if (bb_queue_exists (&d3d9ObjectFactory.drawObjects, object)) {
-		bb_queue_remv (&d3d9ObjectFactory.drawObjects, object);
-	}
-
-	bb_queue_remv (&d3d9ObjectFactory.allObjects, object);
-
-	D3D9Object_free (object);
+	// Invalidate the ID now and remove it from the lists, but free the memory only once the DirectX thread has stopped drawing it
+	D3D9ObjectFactory_unregister (object);
+	D3D9ObjectFactory_retire (object);
+	D3D9ObjectFactory_invalidate ();
 
 	D3D9ObjectFactory_release ();
 }
@@ -263,379 +838,1871 @@ D3D9ObjectFactory_delete_all (
 ) {
 	D3D9ObjectFactory_lock ();
 
-	// Remove all D3D9Objects from the drawObjects list
-	while (bb_queue_get_length (&d3d9ObjectFactory.drawObjects)) {
-		bb_queue_pop (&d3d9ObjectFactory.drawObjects);
-	}
-
-	// Remove all D3D9Objects from the global list
-	while (bb_queue_get_length (&d3d9ObjectFactory.allObjects)) {
-		D3D9Object *object = bb_queue_pop (&d3d9ObjectFactory.allObjects);
+	// Remove all D3D9Objects from the global list, and the draw list with them
+	while (d3d9ObjectFactory.table.allObjects.count) {
+		D3D9Object *object = d3d9ObjectFactory.table.slots [d3d9ObjectFactory.table.allObjects.head].object;
 
-		// Free the memory
-		D3D9Object_free (object);
+		// Free the memory once the DirectX thread has stopped drawing it
+		D3D9ObjectFactory_unregister (object);
+		D3D9ObjectFactory_retire (object);
 	}
 
+	D3D9ObjectFactory_invalidate ();
+
 	D3D9ObjectFactory_release ();
 }
 
 /*
- * Description : Return a pointer to the objects list
- * Return      : BbQueue * A list of D3D9Objects pointer
+ * Description      : Copy the objects of the draw list, the top level one last, at the end of a list of the caller.
+ *                    The factory isn't modified : several threads can copy it at once.
+ *                    /!\ The factory MUST BE LOCKED while the objects are used.
+ * BbQueue *objects : A list receiving the D3D9Objects pointers
+ * Return           : int the number of objects copied
  */
-BbQueue *
+int
 D3D9ObjectFactory_get_objects (
-	void
+	BbQueue *objects
 ) {
-	return &d3d9ObjectFactory.drawObjects;
+	int count = 0;
+
+	foreach_d3d9object_slot (&d3d9ObjectFactory.table.drawObjects, index) {
+		bb_queue_add (objects, d3d9ObjectFactory.table.slots [index].object);
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Description      : Get the object drawn right above another one, without copying nor modifying the draw list.
+ *                    /!\ The factory MUST BE LOCKED, at least in shared mode, during the whole iteration.
+ * D3D9Object *this : An object of the draw list, or NULL to get the object drawn first
+ * Return           : D3D9Object * the next object drawn, or NULL at the end of the draw list
+ */
+D3D9Object *
+D3D9ObjectFactory_get_next_object (
+	D3D9Object *this
+) {
+	int index = -1;
+
+	if (this && !D3D9ObjectFactory_get_slot (this->id)) {
+		return NULL;
+	}
+
+	if (this) {
+		index = D3D9_OBJECT_TABLE_INDEX (this->id);
+	}
+
+	if ((index = D3D9ObjectTable_get_next_drawn (&d3d9ObjectFactory.table, index)) == -1) {
+		return NULL;
+	}
+
+	return d3d9ObjectFactory.table.slots [index].object;
 }
 
+/*
+ * Description : Get the last snapshot of the draw list published by the writers, without waiting for them.
+ *               The texts measured and the sprites uploaded by the DirectX thread are given to the factory first, if no writer holds it.
+ *               The snapshot and its objects stay valid until D3D9ObjectFactory_release_draw_list is called.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : D3D9ObjectDrawList * The current draw list snapshot
+ */
+D3D9ObjectDrawList *
+D3D9ObjectFactory_acquire_draw_list (
+	void
+) {
+	D3D9Snapshot *snapshot;
+
+	D3D9ObjectFactory_apply_pending ();
+
+	if (!(snapshot = D3D9SnapshotExchange_acquire (&d3d9ObjectFactory.snapshots))) {
+		return &emptyDrawList;
+	}
+
+	return (D3D9ObjectDrawList *) snapshot;
+}
 
 /*
- * Description : Lock the mutex shared with all the d3d9objects
+ * Description : Notify the factory that the draw list snapshot acquired isn't used anymore.
+ *               The objects deleted before the last publication are freed : no snapshot acquired from now on references them.
+ *               /!\ This function must be called only from the DirectX thread.
  * Return      : void
  */
 void
-D3D9ObjectFactory_lock (
+D3D9ObjectFactory_release_draw_list (
 	void
 ) {
-	WaitForSingleObject (d3d9ObjectFactory.mutex, INFINITE);
+	D3D9ObjectFactory_reclaim (D3D9SnapshotExchange_release (&d3d9ObjectFactory.snapshots));
 }
 
-
 /*
- * Description : Release the mutex shared with all the d3d9objects
+ * Description : Mark the draw list as changed, so a new snapshot is published when the factory is released.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
  * Return      : void
  */
-void
-D3D9ObjectFactory_release (
+static void
+D3D9ObjectFactory_invalidate (
+	void
+) {
+	d3d9ObjectFactory.changed = true;
+}
+
+/*
+ * Description : Build a new snapshot of the draw list and publish it for the DirectX thread.
+ *               /!\ The factory MUST BE LOCKED exclusively when calling this function.
+ * Return      : bool true on success, false otherwise
+ */
+static bool
+D3D9ObjectFactory_publish (
 	void
 ) {
-	ReleaseMutex (d3d9ObjectFactory.mutex);
+	int count = d3d9ObjectFactory.table.drawObjects.count;
+	D3D9ObjectDrawList *drawList;
+	int capacity;
+
+	// The block of a snapshot the DirectX thread doesn't read anymore is reused. Otherwise a new one is allocated,
+	// with room for the draw list to grow, the pointers first for the alignment.
+	if (!(drawList = (D3D9ObjectDrawList *) D3D9SnapshotExchange_get_spare (&d3d9ObjectFactory.snapshots, count))) {
+		size_t rowSize = sizeof(D3D9Object *) + sizeof(IDirect3DTexture9 *) + sizeof(D3D9ObjectType) + sizeof(int) * 4 + sizeof(D3DCOLOR)
+		               + sizeof(D3D9SeqLock);
+
+		capacity = (count * 2 > D3D9_OBJECT_DRAW_LIST_MIN_CAPACITY) ? count * 2 : D3D9_OBJECT_DRAW_LIST_MIN_CAPACITY;
+
+		if ((drawList = malloc (sizeof(D3D9ObjectDrawList) + rowSize * capacity)) == NULL) {
+			// The previous snapshot is drawn again, and the objects deleted are kept until the next publication
+			warn ("Cannot allocate a new draw list snapshot.");
+			return false;
+		}
+
+		drawList->snapshot.capacity = capacity;
+	}
+
+	capacity = drawList->snapshot.capacity;
+	drawList->objects  = (D3D9Object **) (drawList + 1);
+	drawList->textures = (IDirect3DTexture9 **) (drawList->objects + capacity);
+	drawList->types    = (D3D9ObjectType *) (drawList->textures + capacity);
+	drawList->x        = (int *) (drawList->types + capacity);
+	drawList->y        = drawList->x + capacity;
+	drawList->w        = drawList->y + capacity;
+	drawList->h        = drawList->w + capacity;
+	drawList->colors   = (D3DCOLOR *) (drawList->h + capacity);
+	drawList->versions = (D3D9SeqLock *) (drawList->colors + capacity);
+	drawList->sequence = D3D9_SEQ_LOCK_INITIALIZER;
+	drawList->count    = 0;
+
+	foreach_d3d9object_slot (&d3d9ObjectFactory.table.drawObjects, index)
+	{
+		D3D9ObjectTableSlot *slot = &d3d9ObjectFactory.table.slots [index];
+
+		slot->row = drawList->count;
+		D3D9ObjectDrawList_fill (drawList, drawList->count++, slot->object);
+	}
+
+	D3D9SnapshotExchange_publish (&d3d9ObjectFactory.snapshots, &drawList->snapshot);
+	d3d9ObjectFactory.changed = false;
+
+	return true;
 }
 
+/*
+ * Description : Get the last snapshot published. It is current while the factory is locked.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
+ * Return      : D3D9ObjectDrawList * the snapshot published
+ */
+static D3D9ObjectDrawList *
+D3D9ObjectFactory_get_published (
+	void
+) {
+	D3D9Snapshot *snapshot = d3d9ObjectFactory.snapshots.published;
+
+	return (snapshot) ? (D3D9ObjectDrawList *) snapshot : &emptyDrawList;
+}
 
 /*
- * Description : Get the top level object that is hovered. If no object is hovered, return NULL
- * HWND hWindow : The window containing the directX context
- * Return : A pointer to the hovered object, or NULL
+ * Description : Give the extents of the texts measured and the sprites uploaded by the DirectX thread to the factory,
+ *               if no writer holds it. Their rows are written in the snapshot published, without building a new one.
+ *               /!\ This function must be called only from the DirectX thread, outside D3D9ObjectFactory_acquire_draw_list.
+ * Return      : bool true if nothing is left waiting for the factory
  */
-D3D9Object *
-D3D9ObjectFactory_get_hovered_object (
-	HWND hWindow
+static bool
+D3D9ObjectFactory_apply_pending (
+	void
 ) {
-	int mouseX, mouseY;
-	get_mouse_pos_in_window (hWindow, &mouseX, &mouseY);
+	D3D9ObjectText *text;
+	D3D9Object *object;
+
+	if (!d3d9ObjectFactory.measuredTexts && !d3d9ObjectFactory.uploadedSprites) {
+		return true;
+	}
+
+	// Tried again at the next frame
+	if (!D3D9ObjectFactory_try_lock ()) {
+		return false;
+	}
 
-	foreach_bbqueue_item_reversed (&d3d9ObjectFactory.drawObjects, D3D9Object *object)
+	while ((text = d3d9ObjectFactory.measuredTexts))
 	{
-		switch (object->type)
-		{
-			case D3D9_OBJECT_RECTANGLE: {
-				D3D9ObjectRect *rect = &object->rect;
-				if (in_bound (mouseX, mouseY, object->x, object->y, object->x + rect->w, object->y + rect->h)) {
-					return object;
-				}
-			} break;
+		D3D9ObjectDrawList *drawList = D3D9ObjectFactory_get_published ();
+		D3D9ObjectTableSlot *slot;
 
-			case D3D9_OBJECT_SPRITE: {
-				D3D9ObjectSprite *sprite = &object->sprite;
-				if (in_bound (mouseX, mouseY, object->x, object->y, object->x + sprite->w, object->y + sprite->h)) {
-					return object;
-				}
-			} break;
+		object = D3D9Object_from_member (text, text);
+		d3d9ObjectFactory.measuredTexts = text->nextMeasured;
+		text->measured = false;
+		text->nextMeasured = NULL;
 
-			default :
-				continue;
-			break;
+		// A text deleted meanwhile is only waiting to be reclaimed
+		if (!(slot = D3D9ObjectFactory_get_slot (object->id))) {
+			continue;
 		}
+
+		text->w = text->layoutW;
+		text->h = text->layoutH;
+		D3D9ObjectFactory_index (object);
+
+		// The DirectX thread is the only reader, and doesn't read the snapshot now
+		if (slot->drawn && slot->row >= 0 && slot->row < drawList->count && drawList->objects [slot->row] == object) {
+			drawList->w [slot->row] = text->w;
+			drawList->h [slot->row] = text->h;
+		}
+	}
+
+	while ((object = d3d9ObjectFactory.uploadedSprites))
+	{
+		d3d9ObjectFactory.uploadedSprites = object->sprite.nextUploaded;
+		object->sprite.uploaded = false;
+		object->sprite.nextUploaded = NULL;
+
+		// A sprite deleted while it was loading isn't drawn
+		if (D3D9ObjectFactory_get_slot (object->id)) {
+			D3D9ObjectFactory_add_uploaded (object);
+		}
+	}
+
+	D3D9ObjectFactory_release ();
+
+	return true;
+}
+
+/*
+ * Description      : Draw a sprite uploaded by the DirectX thread on top of the others.
+ *                    Its row is appended to the snapshot published when it has room for it.
+ *                    /!\ The factory MUST BE LOCKED, and this function must be called only from the DirectX thread.
+ * D3D9Object *this : An allocated D3D9Object of type sprite
+ * Return           : void
+ */
+static void
+D3D9ObjectFactory_add_uploaded (
+	D3D9Object *this
+) {
+	int index = D3D9_OBJECT_TABLE_INDEX (this->id);
+	D3D9ObjectTableSlot *slot = &d3d9ObjectFactory.table.slots [index];
+	D3D9Snapshot *snapshot = d3d9ObjectFactory.snapshots.published;
+	D3D9ObjectDrawList *drawList = (D3D9ObjectDrawList *) snapshot;
+
+	if (!D3D9ObjectTable_add (&d3d9ObjectFactory.table, index)) {
+		return;
+	}
+
+	D3D9ObjectFactory_index (this);
+
+	// The snapshot published matches the draw list unless a publication failed, and the sprite is on top of it :
+	// its row goes last, and the snapshot doesn't need to be built again. The DirectX thread doesn't read it now.
+	if (!d3d9ObjectFactory.changed && snapshot && drawList->count < snapshot->capacity) {
+		slot->row = drawList->count;
+		D3D9ObjectDrawList_fill (drawList, slot->row, this);
+		drawList->count++;
+		return;
 	}
 
-	return NULL;
+	// Built again when the factory is released
+	D3D9ObjectFactory_invalidate ();
 }
 
+/*
+ * Description                  : Copy the hot fields of an object into a snapshot of the draw list
+ * D3D9ObjectDrawList *drawList : A snapshot of the draw list
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
+ */
+static void
+D3D9ObjectDrawList_fill (
+	D3D9ObjectDrawList *drawList,
+	int index,
+	D3D9Object *object
+) {
+	drawList->objects [index]  = object;
+	drawList->types [index]    = object->type;
+	drawList->versions [index] = D3D9_SEQ_LOCK_INITIALIZER;
+
+	D3D9ObjectDrawList_copy_fields (drawList, index, object);
+}
+
+/*
+ * Description                  : Copy the fields of an object that a change keeps the draw order of into a row of the draw list
+ * D3D9ObjectDrawList *drawList : A snapshot of the draw list
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
+ */
+static void
+D3D9ObjectDrawList_copy_fields (
+	D3D9ObjectDrawList *drawList,
+	int index,
+	D3D9Object *object
+) {
+	drawList->x [index]        = object->x;
+	drawList->y [index]        = object->y;
+	drawList->textures [index] = NULL;
+
+	switch (object->type)
+	{
+		case D3D9_OBJECT_RECTANGLE: {
+			D3D9ObjectRect *rect = &object->rect;
+			drawList->w [index]      = rect->w;
+			drawList->h [index]      = rect->h;
+			drawList->colors [index] = D3DCOLOR_ARGB (rect->opacity, rect->r, rect->g, rect->b);
+		} break;
+
+		case D3D9_OBJECT_TEXT: {
+			D3D9ObjectText *text = &object->text;
+			drawList->w [index]      = text->w;
+			drawList->h [index]      = text->h;
+			drawList->colors [index] = D3DCOLOR_RGBA (text->r, text->g, text->b, text->opacity);
+		} break;
+
+		case D3D9_OBJECT_SPRITE: {
+			D3D9ObjectSprite *sprite = &object->sprite;
+			drawList->w [index]        = sprite->w;
+			drawList->h [index]        = sprite->h;
+			drawList->colors [index]   = D3DCOLOR_ARGB (sprite->opacity, 255, 255, 255);
+			drawList->textures [index] = sprite->texture;
+		} break;
+
+		default :
+			drawList->w [index]      = 0;
+			drawList->h [index]      = 0;
+			drawList->colors [index] = 0;
+		break;
+	}
+}
 
-/// ===== D3D9Object =====
 /*
- * Description : Move an allocated D3D9Object on the screen
+ * Description      : Get the new fields of an object drawn into the next snapshot, and index its new bounds.
+ *                    /!\ The factory MUST BE LOCKED when calling this function.
  * D3D9Object *this : An allocated D3D9Object
- # int x, int y : The new position on the screen
- * Return : void
+ * Return           : void
  */
-void
-D3D9Object_move (
-	D3D9Object *this,
-	int x, int y
+static void
+D3D9ObjectFactory_update (
+	D3D9Object *this
 ) {
-	this->x = x;
-	this->y = y;
+	D3D9ObjectDrawList *drawList = D3D9ObjectFactory_get_published ();
+	D3D9ObjectTableSlot *slot;
+
+	if (!(slot = D3D9ObjectFactory_get_slot (this->id)) || !slot->drawn) {
+		return;
+	}
+
+	// The draw order is the same : the row of the snapshot published is written in place, unless a new one is built anyway
+	if (!d3d9ObjectFactory.changed
+	&&  slot->row >= 0 && slot->row < drawList->count && drawList->objects [slot->row] == this) {
+		D3D9ObjectDrawList_write_row (drawList, slot->row, this);
+	} else {
+		D3D9ObjectFactory_invalidate ();
+	}
+
+	D3D9ObjectFactory_index (this);
 }
 
 /*
- * Description                 : Initialize an allocated D3D9ObjectRect object.
- * int x, y                    : {x, y} position of the rectangle
- * int w, h                    : width and height of the rectangle
- * byte r, byte g, byte b      : color of the rectangle
- * Return                      : void
+ * Description                  : Write the fields of an object into its row of the snapshot published, while the DirectX thread may read it.
+ *                                /!\ The factory MUST BE LOCKED exclusively when calling this function.
+ * D3D9ObjectDrawList *drawList : The snapshot published
+ * int index                    : Index of the object in the snapshot
+ * D3D9Object *object           : An allocated D3D9Object
+ * Return                       : void
  */
-bool
-D3D9ObjectRect_init (
-	D3D9Object * this,
-	int x, int y,
-	int w, int h,
-	byte r, byte g, byte b
+static void
+D3D9ObjectDrawList_write_row (
+	D3D9ObjectDrawList *drawList,
+	int index,
+	D3D9Object *object
 ) {
-	D3D9ObjectFactory_lock ();
+	D3D9SeqLock_write_begin (&drawList->sequence);
+	D3D9SeqLock_write_begin (&drawList->versions [index]);
 
-	D3D9ObjectRect * rect = &this->rect;
+	D3D9ObjectDrawList_copy_fields (drawList, index, object);
 
-	// Fill the structure
-	this->x = x;
-	this->y = y;
-	rect->w = w;
-	rect->h = h;
-	rect->r = r;
-	rect->g = g;
-	rect->b = b;
+	D3D9SeqLock_write_end (&drawList->versions [index]);
+	D3D9SeqLock_write_end (&drawList->sequence);
+}
 
-	dbg ("Rectangle <ID=%d | x=%d | y=%d | w=%d | h=%d | rgb=%02X%02X%02X> has been created.", this->id, x, y, w, h, r, g, b);
+/*
+ * Description                  : Copy a row of the draw list, consistent with the writes in place
+ *                                /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int index                    : Index of the object in the snapshot
+ * D3D9ObjectDrawRow *row       : Output of the row
+ * Return                       : void
+ */
+static void
+D3D9ObjectDrawList_read_row (
+	D3D9ObjectDrawList *drawList,
+	int index,
+	D3D9ObjectDrawRow *row
+) {
+	unsigned int version;
+
+	do {
+		version = D3D9SeqLock_read_begin (&drawList->versions [index]);
+
+		row->texture = drawList->textures [index];
+		row->x       = drawList->x [index];
+		row->y       = drawList->y [index];
+		row->w       = drawList->w [index];
+		row->h       = drawList->h [index];
+		row->color   = drawList->colors [index];
+	} while (D3D9SeqLock_read_retry (&drawList->versions [index], version));
+}
 
-	D3D9ObjectFactory_add (this);
+/*
+ * Description      : Insert a drawn object in the spatial index with its current bounds, or remove it if it isn't drawn anymore.
+ *                    /!\ The factory MUST BE LOCKED when calling this function.
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void
+D3D9ObjectFactory_index (
+	D3D9Object *this
+) {
+	int handle = D3D9_OBJECT_TABLE_INDEX (this->id);
+	D3D9ObjectTableSlot *slot;
+	int w, h;
+
+	if (!d3d9ObjectFactory.grid
+	&&  !(d3d9ObjectFactory.grid = D3D9SpatialGrid_new (
+		D3D9_SPATIAL_GRID_DEFAULT_CELL_SIZE, D3D9_SPATIAL_GRID_DEFAULT_COLUMNS, D3D9_SPATIAL_GRID_DEFAULT_ROWS))) {
+		warn ("Cannot allocate the spatial index of the factory.");
+		return;
+	}
 
-	D3D9ObjectFactory_release ();
-	return true;
+	if (!(slot = D3D9ObjectFactory_get_slot (this->id)) || !slot->drawn) {
+		D3D9SpatialGrid_remove (d3d9ObjectFactory.grid, handle);
+		return;
+	}
+
+	D3D9Object_get_size (this, &w, &h);
+
+	if (!D3D9SpatialGrid_update (d3d9ObjectFactory.grid, handle, this->x, this->y, w, h)) {
+		warn ("Cannot index object ID=%d, it won't be hit tested.", this->id);
+	}
 }
 
 /*
- * Description : Set attributes of a D3D9ObjectRect
- * D3D9ObjectRect *this : An allocated D3D9ObjectRect
- * byte r, byte g, byte b : New color of the rectangle
- * int w, int h : Width and height of the rectangle
- * Return : void
+ * Description      : Get the size of an object on the screen
+ * D3D9Object *this : An allocated D3D9Object
+ * int *w, int *h   : Output of the size. The size of a text is known once it has been drawn.
+ * Return           : void
  */
-void
-D3D9ObjectRect_set (
-	D3D9ObjectRect *this,
-	byte r, byte g, byte b,
-	int w, int h
+static void
+D3D9Object_get_size (
+	D3D9Object *this,
+	int *w, int *h
 ) {
-	this->r = r;
-	this->g = g;
-	this->b = b;
-	this->w = w;
-	this->h = h;
+	switch (this->type)
+	{
+		case D3D9_OBJECT_RECTANGLE:
+			*w = this->rect.w;
+			*h = this->rect.h;
+		break;
+
+		case D3D9_OBJECT_TEXT:
+			*w = this->text.w;
+			*h = this->text.h;
+		break;
+
+		case D3D9_OBJECT_SPRITE:
+			*w = this->sprite.w;
+			*h = this->sprite.h;
+		break;
+
+		default :
+			*w = 0;
+			*h = 0;
+		break;
+	}
 }
 
 /*
- * Description                 : Initialize an allocated D3D9ObjectText object.
- * D3D9Object * this           : An allocated D3D9Object
- * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
- * int x, y                    : {x, y} position of the text
- * byte r, byte g, byte b      : color of the text
- * float opacity : opacity of the text, value between 0.0 and 1.0
- * char * string               : String of the text
- * int fontSize                : the size of the font
- * char * fontFamily           : The name of the family font. If NULL, "Arial" is used.
- * Return                      : void
+ * Description        : Defer the release of an object until the DirectX thread can't draw it anymore
+ *                      /!\ The factory MUST BE LOCKED when calling this function.
+ * D3D9Object *object : An object removed from the factory
+ * Return             : void
  */
-bool
-D3D9ObjectText_init (
-	D3D9Object * this,
-	IDirect3DDevice9 * pDevice,
-	int x, int y,
-	byte r, byte g, byte b,
-	float opacity,
-	char *string,
-	int fontSize,
-	char *fontFamily
+static void
+D3D9ObjectFactory_retire (
+	D3D9Object *object
+) {
+	// Given back to the DirectX thread once a snapshot without it is published
+	D3D9SnapshotExchange_remove (&d3d9ObjectFactory.snapshots, object);
+}
+
+/*
+ * Description        : Release the objects deleted that no snapshot references anymore. The ones still referenced
+ *                      by the lists of the DirectX thread are kept until these lists are applied.
+ *                      /!\ This function must be called only from the DirectX thread, without the lock.
+ * D3D9Object *object : The objects given back by the snapshot exchange, linked through nextRetired
+ * Return             : void
+ */
+static void
+D3D9ObjectFactory_reclaim (
+	D3D9Object *object
+) {
+	void *objects [D3D9_OBJECT_RECLAIM_BATCH];
+	int objectsCount = 0;
+	D3D9Object *kept = NULL;
+
+	// The objects kept by the previous frames are tried again
+	if (d3d9ObjectFactory.deletedObjects) {
+		D3D9Object *last = d3d9ObjectFactory.deletedObjects;
+
+		while (last->nextRetired) {
+			last = last->nextRetired;
+		}
+
+		last->nextRetired = object;
+		object = d3d9ObjectFactory.deletedObjects;
+		d3d9ObjectFactory.deletedObjects = NULL;
+	}
+
+	while (object)
+	{
+		D3D9Object *next = object->nextRetired;
+
+		if (D3D9Object_is_pending (object)) {
+			object->nextRetired = kept;
+			kept = object;
+			object = next;
+			continue;
+		}
+
+		// The memory of the objects is given back to the pool in bulk
+		D3D9Object_clear (object);
+		objects [objectsCount++] = object;
+
+		if (objectsCount == D3D9_OBJECT_RECLAIM_BATCH) {
+			D3D9ObjectPool_release_bulk (d3d9ObjectFactory.objectPool, objects, objectsCount);
+			objectsCount = 0;
+		}
+
+		object = next;
+	}
+
+	if (objectsCount) {
+		D3D9ObjectPool_release_bulk (d3d9ObjectFactory.objectPool, objects, objectsCount);
+	}
+
+	d3d9ObjectFactory.deletedObjects = kept;
+}
+
+/*
+ * Description      : Check if an object deleted is still referenced by the lists of the DirectX thread or by the image loader
+ *                    /!\ This function must be called only from the DirectX thread.
+ * D3D9Object *this : An object deleted
+ * Return           : bool true if the object can't be freed yet
+ */
+static bool
+D3D9Object_is_pending (
+	D3D9Object *this
+) {
+	switch (this->type)
+	{
+		case D3D9_OBJECT_TEXT:
+			return this->text.measured;
+
+		case D3D9_OBJECT_SPRITE:
+			return this->sprite.uploaded || this->sprite.loading;
+
+		default :
+			return false;
+	}
+}
+
+
+/*
+ * Description : Lock exclusively the lock shared with all the d3d9objects, before modifying them.
+ *               The lock is recursive : the thread holding it can lock it again, and the snapshot is published by the last release.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_lock (
+	void
+) {
+	DWORD self = GetCurrentThreadId ();
+
+	// Only the owner can find its own ID there
+	if (d3d9ObjectFactory.lockOwner == self) {
+		d3d9ObjectFactory.lockDepth++;
+		return;
+	}
+
+	D3D9Lock_acquire_exclusive (&d3d9ObjectFactory.lock);
+	d3d9ObjectFactory.lockOwner = self;
+	d3d9ObjectFactory.lockDepth = 1;
+}
+
+
+/*
+ * Description : Release the exclusive lock shared with all the d3d9objects, once as many times as it has been locked.
+ *               If the draw list changed, its new snapshot is published for the DirectX thread first.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_release (
+	void
+) {
+	if (--d3d9ObjectFactory.lockDepth > 0) {
+		return;
+	}
+
+	if (d3d9ObjectFactory.changed) {
+		D3D9ObjectFactory_publish ();
+	}
+
+	d3d9ObjectFactory.lockOwner = 0;
+	D3D9Lock_release_exclusive (&d3d9ObjectFactory.lock);
+}
+
+/*
+ * Description : Lock the factory exclusively only if no other thread holds it, so the DirectX thread never waits for the writers.
+ *               Like D3D9ObjectFactory_lock, it is recursive.
+ * Return      : bool true if the factory is locked, false otherwise
+ */
+static bool
+D3D9ObjectFactory_try_lock (
+	void
+) {
+	DWORD self = GetCurrentThreadId ();
+
+	if (d3d9ObjectFactory.lockOwner == self) {
+		d3d9ObjectFactory.lockDepth++;
+		return true;
+	}
+
+	if (!D3D9Lock_try_acquire_exclusive (&d3d9ObjectFactory.lock)) {
+		return false;
+	}
+
+	d3d9ObjectFactory.lockOwner = self;
+	d3d9ObjectFactory.lockDepth = 1;
+
+	return true;
+}
+
+/*
+ * Description : Lock in shared mode the lock shared with all the d3d9objects, before reading or drawing them.
+ *               Inside the exclusive lock, the thread locks it again exclusively.
+ *               /!\ The shared lock isn't recursive, and cannot be upgraded to the exclusive lock.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_lock_shared (
+	void
+) {
+	if (d3d9ObjectFactory.lockOwner == GetCurrentThreadId ()) {
+		d3d9ObjectFactory.lockDepth++;
+		return;
+	}
+
+	D3D9Lock_acquire_shared (&d3d9ObjectFactory.lock);
+}
+
+/*
+ * Description : Release the shared lock shared with all the d3d9objects
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_release_shared (
+	void
+) {
+	if (d3d9ObjectFactory.lockOwner == GetCurrentThreadId ()) {
+		D3D9ObjectFactory_release ();
+		return;
+	}
+
+	D3D9Lock_release_shared (&d3d9ObjectFactory.lock);
+}
+
+/*
+ * Description  : Enable or disable the measure of the time the factory lock is held exclusively
+ * bool enabled : true to measure the hold time, it costs two clock reads per exclusive lock
+ * Return       : void
+ */
+void
+D3D9ObjectFactory_set_lock_hold_timing (
+	bool enabled
+) {
+	D3D9Lock_set_hold_timing (&d3d9ObjectFactory.lock, enabled);
+}
+
+/*
+ * Description          : Get the contention counters of the factory lock
+ * D3D9LockStats *stats : Output of the counters, times in microseconds
+ * Return               : void
+ */
+void
+D3D9ObjectFactory_get_lock_stats (
+	D3D9LockStats *stats
+) {
+	D3D9Lock_get_stats (&d3d9ObjectFactory.lock, stats);
+}
+
+
+/*
+ * Description                  : Get the hit / miss / eviction counters of the sprite texture cache
+ * D3D9TextureCacheStats *stats : Output of the counters
+ * Return                       : void
+ */
+void
+D3D9ObjectFactory_get_texture_cache_stats (
+	D3D9TextureCacheStats *stats
+) {
+	D3D9TextureCache_get_stats (&d3d9ObjectFactory.textureCache, stats);
+}
+
+/*
+ * Description  : Set the maximum bytes of texture memory kept by the sprite texture cache
+ * DWORD budget : The budget in bytes. Only textures not used by any sprite are evicted.
+ * Return       : void
+ */
+void
+D3D9ObjectFactory_set_texture_cache_budget (
+	DWORD budget
+) {
+	D3D9TextureCache_set_budget (&d3d9ObjectFactory.textureCache, budget);
+}
+
+/*
+ * Description                : Create a font shared by the texts, and keep it even when no text uses it
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *fontFamily           : The name of the family font. If NULL, "Arial" is used.
+ * int fontSize               : the size of the font
+ * int fontWeight             : the weight of the font, FW_NORMAL, FW_BOLD...
+ * Return                     : bool true on success, false otherwise
+ */
+bool
+D3D9ObjectFactory_preload_font (
+	IDirect3DDevice9 * pDevice,
+	char *fontFamily,
+	int fontSize,
+	int fontWeight
+) {
+	if (fontFamily == NULL) {
+		fontFamily = "Arial";
+	}
+
+	return D3D9FontCache_preload (&d3d9ObjectFactory.fontCache, pDevice, fontFamily, fontSize, fontWeight);
+}
+
+/*
+ * Description               : Get the counters of the fonts shared by the texts
+ * D3D9FontCacheStats *stats : Output of the counters
+ * Return                    : void
+ */
+void
+D3D9ObjectFactory_get_font_cache_stats (
+	D3D9FontCacheStats *stats
+) {
+	D3D9FontCache_get_stats (&d3d9ObjectFactory.fontCache, stats);
+}
+
+/*
+ * Description                : Get the allocation counters of the pool of D3D9Objects
+ * D3D9ObjectPoolStats *stats : Output of the counters
+ * Return                     : void
+ */
+void
+D3D9ObjectFactory_get_pool_stats (
+	D3D9ObjectPoolStats *stats
+) {
+	if (!d3d9ObjectFactory.objectPool) {
+		memset (stats, 0, sizeof(D3D9ObjectPoolStats));
+		return;
+	}
+
+	D3D9ObjectPool_get_stats (d3d9ObjectFactory.objectPool, stats);
+}
+
+/*
+ * Description : Get the top level object of the draw list at a given position.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y : The position to test
+ * Return : A pointer to the object at this position, or NULL
+ */
+static D3D9Object *
+D3D9ObjectFactory_get_object_at (
+	int x, int y
+) {
+	int handles [D3D9_OBJECT_HIT_TEST_CAPACITY];
+	D3D9ObjectTableSlot *top = NULL;
+	int count;
+
+	if (!d3d9ObjectFactory.grid) {
+		return D3D9ObjectFactory_scan_object_at (x, y);
+	}
+
+	// Only the cell containing the point is visited
+	count = D3D9SpatialGrid_query_point (d3d9ObjectFactory.grid, x, y, handles, D3D9_OBJECT_HIT_TEST_CAPACITY);
+
+	if (count > D3D9_OBJECT_HIT_TEST_CAPACITY) {
+		return D3D9ObjectFactory_scan_object_at (x, y);
+	}
+
+	// The top level object is the last one in the draw list
+	for (int index = 0; index < count; index++) {
+		D3D9ObjectTableSlot *slot = &d3d9ObjectFactory.table.slots [handles [index]];
+
+		if (top == NULL || slot->drawLink.order > top->drawLink.order) {
+			top = slot;
+		}
+	}
+
+	return (top) ? top->object : NULL;
+}
+
+/*
+ * Description  : Get the top level object at a given position by testing all the bounds of the published snapshot.
+ *                Used when the spatial index can't answer.
+ *                /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y : The position to test
+ * Return       : A pointer to the object at this position, or NULL
+ */
+static D3D9Object *
+D3D9ObjectFactory_scan_object_at (
+	int x, int y
+) {
+	D3D9ObjectDrawList *drawList = D3D9ObjectFactory_get_published ();
+	D3D9Bounds bounds = {
+		.x     = drawList->x,
+		.y     = drawList->y,
+		.w     = drawList->w,
+		.h     = drawList->h,
+		.count = drawList->count
+	};
+	unsigned int *mask;
+	int top;
+
+	if ((mask = malloc (sizeof(unsigned int) * (D3D9_BOUNDS_MASK_WORDS (drawList->count) + 1))) == NULL) {
+		warn ("Cannot allocate the mask of the hit test.");
+		return NULL;
+	}
+
+	// The top level object is the last one of the draw list containing the point
+	D3D9BoundsKernel_intersect (&bounds, x, y, 1, 1, mask);
+	top = D3D9BoundsKernel_get_last (mask, drawList->count);
+	free (mask);
+
+	// The snapshot lags the draw list until the lock is released : the objects deleted since are ignored
+	if (top == -1 || !D3D9ObjectFactory_get_slot (drawList->objects [top]->id)) {
+		return NULL;
+	}
+
+	return drawList->objects [top];
+}
+
+/*
+ * Description                : Get the objects of the draw list intersecting a rectangle, the top level object first.
+ *                              /!\ The factory MUST BE LOCKED when calling this function.
+ * int x, int y, int w, int h : The rectangle to test
+ * D3D9Object **objects       : Output of the objects found
+ * int capacity               : Maximum number of objects written
+ * Return                     : int the number of objects found, it can be greater than capacity
+ */
+static int
+D3D9ObjectFactory_query (
+	int x, int y, int w, int h,
+	D3D9Object **objects,
+	int capacity
+) {
+	int buffer [D3D9_OBJECT_HIT_TEST_CAPACITY];
+	int *handles = buffer;
+	int count;
+
+	if (!d3d9ObjectFactory.grid) {
+		return 0;
+	}
+
+	count = D3D9SpatialGrid_query_rect (d3d9ObjectFactory.grid, x, y, w, h, handles, D3D9_OBJECT_HIT_TEST_CAPACITY);
+
+	// All the objects found are needed to know which ones are on top
+	if (count > D3D9_OBJECT_HIT_TEST_CAPACITY) {
+		if ((handles = malloc (sizeof(int) * count)) == NULL) {
+			warn ("Cannot allocate the result of the hit test.");
+			return 0;
+		}
+
+		D3D9SpatialGrid_query_rect (d3d9ObjectFactory.grid, x, y, w, h, handles, count);
+	}
+
+	qsort (handles, count, sizeof(int), D3D9ObjectFactory_compare_depth);
+
+	for (int index = 0; index < count && index < capacity; index++) {
+		objects [index] = d3d9ObjectFactory.table.slots [handles [index]].object;
+	}
+
+	if (handles != buffer) {
+		free (handles);
+	}
+
+	return count;
+}
+
+/*
+ * Description  : Order the handles of the spatial index from the top level object to the bottom one
+ * const void *a, const void *b : Handles of drawn objects
+ * Return       : int like strcmp
+ */
+static int
+D3D9ObjectFactory_compare_depth (
+	const void *a,
+	const void *b
+) {
+	unsigned long long depthA = d3d9ObjectFactory.table.slots [*(const int *) a].drawLink.order;
+	unsigned long long depthB = d3d9ObjectFactory.table.slots [*(const int *) b].drawLink.order;
+
+	return (depthA < depthB) - (depthA > depthB);
+}
+
+/*
+ * Description : Get the top level object that is hovered. If no object is hovered, return NULL
+ * HWND hWindow : The window containing the directX context
+ * Return : A pointer to the hovered object, or NULL
+ */
+D3D9Object *
+D3D9ObjectFactory_get_hovered_object (
+	HWND hWindow
+) {
+	int mouseX, mouseY;
+	D3D9Object *hovered;
+	get_mouse_pos_in_window (hWindow, &mouseX, &mouseY);
+
+	D3D9ObjectFactory_lock_shared ();
+	hovered = D3D9ObjectFactory_get_object_at (mouseX, mouseY);
+	D3D9ObjectFactory_release_shared ();
+
+	return hovered;
+}
+
+/*
+ * Description : Get the objects of the draw list at a given position, the top level object first.
+ * int x, int y : The position to test
+ * D3D9Object **objects : Output of the objects found
+ * int capacity : Maximum number of objects written
+ * Return : int the number of objects at this position, it can be greater than capacity
+ */
+int
+D3D9ObjectFactory_get_objects_at (
+	int x, int y,
+	D3D9Object **objects,
+	int capacity
+) {
+	int count;
+
+	D3D9ObjectFactory_lock_shared ();
+	count = D3D9ObjectFactory_query (x, y, 1, 1, objects, capacity);
+	D3D9ObjectFactory_release_shared ();
+
+	return count;
+}
+
+/*
+ * Description : Get the objects of the draw list intersecting a rectangle, the top level object first.
+ * int x, int y, int w, int h : The rectangle to test
+ * D3D9Object **objects : Output of the objects found
+ * int capacity : Maximum number of objects written
+ * Return : int the number of objects intersecting the rectangle, it can be greater than capacity
+ */
+int
+D3D9ObjectFactory_get_objects_in_rect (
+	int x, int y, int w, int h,
+	D3D9Object **objects,
+	int capacity
+) {
+	int count;
+
+	D3D9ObjectFactory_lock_shared ();
+	count = D3D9ObjectFactory_query (x, y, w, h, objects, capacity);
+	D3D9ObjectFactory_release_shared ();
+
+	return count;
+}
+
+
+/// ===== D3D9Object =====
+/*
+ * Description : Move an allocated D3D9Object on the screen. The DirectX thread draws it at its new place from its next frame.
+ *               Its row is written in place in the snapshot published, without building a new one.
+ * D3D9Object *this : An allocated D3D9Object
+ # int x, int y : The new position on the screen
+ * Return : void
+ */
+void
+D3D9Object_move (
+	D3D9Object *this,
+	int x, int y
+) {
+	D3D9ObjectFactory_lock ();
+
+	this->x = x;
+	this->y = y;
+	D3D9ObjectFactory_update (this);
+
+	D3D9ObjectFactory_release ();
+}
+
+/*
+ * Description                 : Initialize an allocated D3D9ObjectRect object.
+ * int x, y                    : {x, y} position of the rectangle
+ * int w, h                    : width and height of the rectangle
+ * byte r, byte g, byte b      : color of the rectangle
+ * Return                      : void
+ */
+bool
+D3D9ObjectRect_init (
+	D3D9Object * this,
+	int x, int y,
+	int w, int h,
+	byte r, byte g, byte b
+) {
+	D3D9ObjectFactory_lock ();
+
+	D3D9ObjectRect * rect = &this->rect;
+
+	// Fill the structure
+	this->x = x;
+	this->y = y;
+	rect->w = w;
+	rect->h = h;
+	rect->r = r;
+	rect->g = g;
+	rect->b = b;
+	rect->opacity = 255;
+
+	dbg ("Rectangle <ID=%d | x=%d | y=%d | w=%d | h=%d | rgb=%02X%02X%02X> has been created.", this->id, x, y, w, h, r, g, b);
+
+	D3D9ObjectFactory_add (this);
+
+	D3D9ObjectFactory_release ();
+	return true;
+}
+
+/*
+ * Description : Set attributes of a D3D9ObjectRect
+ * D3D9ObjectRect *this : An allocated D3D9ObjectRect
+ * byte r, byte g, byte b : New color of the rectangle
+ * int w, int h : Width and height of the rectangle
+ * Return : void
+ */
+void
+D3D9ObjectRect_set (
+	D3D9ObjectRect *this,
+	byte r, byte g, byte b,
+	int w, int h
+) {
+	D3D9ObjectFactory_lock ();
+
+	this->r = r;
+	this->g = g;
+	this->b = b;
+	this->w = w;
+	this->h = h;
+	D3D9ObjectFactory_update (D3D9Object_from_member (this, rect));
+
+	D3D9ObjectFactory_release ();
+}
+
+/*
+ * Description : Set the opacity of a D3D9ObjectRect
+ * D3D9ObjectRect *this : An allocated D3D9ObjectRect
+ * float opacity : opacity of the rectangle, between 0.0 and 1.0
+ * Return : void
+ */
+void
+D3D9ObjectRect_set_opacity (
+	D3D9ObjectRect *this,
+	float opacity
+) {
+	D3D9ObjectFactory_lock ();
+
+	this->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	D3D9ObjectFactory_update (D3D9Object_from_member (this, rect));
+
+	D3D9ObjectFactory_release ();
+}
+
+/*
+ * Description                 : Initialize an allocated D3D9ObjectText object.
+ * D3D9Object * this           : An allocated D3D9Object
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * int x, y                    : {x, y} position of the text
+ * byte r, byte g, byte b      : color of the text
+ * float opacity : opacity of the text, value between 0.0 and 1.0
+ * char * string               : String of the text
+ * int fontSize                : the size of the font
+ * char * fontFamily           : The name of the family font. If NULL, "Arial" is used.
+ * Return                      : void
+ */
+bool
+D3D9ObjectText_init (
+	D3D9Object * this,
+	IDirect3DDevice9 * pDevice,
+	int x, int y,
+	byte r, byte g, byte b,
+	float opacity,
+	char *string,
+	int fontSize,
+	char *fontFamily
+) {
+	D3D9ObjectFactory_lock ();
+
+	D3D9ObjectText * text = &this->text;
+
+	// Default parameters
+	if (fontFamily == NULL) {
+		fontFamily = "Arial";
+	}
+
+	// Share the font of the texts with the same family, size and weight
+	if (!(text->fontEntry = D3D9FontCache_acquire (&d3d9ObjectFactory.fontCache, pDevice, fontFamily, fontSize, FW_BOLD))) {
+		warn ("Cannot create the font ID=%d.", this->id);
+		D3D9ObjectFactory_release ();
+		return false;
+	}
+
+	text->font = text->fontEntry->font;
+
+	// Allocate the string
+	D3D9TextBuffer_init (&text->string);
+	D3D9TextBuffer_init (&text->layoutString);
+	D3D9Lock_init (&text->stringLock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+
+	if (!D3D9TextBuffer_set (&text->string, string)) {
+		warn ("Cannot allocate the string of the text ID=%d.", this->id);
+		D3D9FontCache_release (&d3d9ObjectFactory.fontCache, text->fontEntry);
+		D3D9Lock_destroy (&text->stringLock);
+		text->fontEntry = NULL;
+		D3D9ObjectFactory_release ();
+		return false;
+	}
+
+	// Fill the structure
+	this->x = x;
+	this->y = y;
+	text->r = r;
+	text->g = g;
+	text->b = b;
+	text->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	text->dirty = TRUE;
+	text->layoutW = 0;
+	text->layoutH = 0;
+	text->quad = NULL;
+	text->prevRendered = NULL;
+	text->nextRendered = NULL;
+	text->measured = false;
+	text->nextMeasured = NULL;
+	text->w = 0;
+	text->h = 0;
+
+	dbg ("Text <ID=%d | string=<%s> | x=%d | y=%d | rgb=%02X%02X%02X | opacity=%d> has been created.", this->id, string, x, y, r, g, b, text->opacity);
+
+	D3D9ObjectFactory_add (this);
+
+	D3D9ObjectFactory_release ();
+	return true;
+}
+
+/*
+ * Description : Set new attribute to D3D9ObjectText
+ * D3D9ObjectText *this : An allocated D3D9ObjectText
+ * char *string : New string of the text
+ * byte r, byte g, byte b : New color of the text
+ * float opacity : opacity of the text
+ * Return : void
+ */
+void
+D3D9ObjectText_set (
+	D3D9ObjectText *this,
+	char *string,
+	byte r, byte g, byte b,
+	float opacity
+) {
+	D3D9Lock_acquire_exclusive (&this->stringLock);
+
+	// Setting the same string again costs no allocation and keeps the layout
+	if (!D3D9TextBuffer_equals (&this->string, string)) {
+		if (D3D9TextBuffer_set (&this->string, string)) {
+			InterlockedExchange (&this->dirty, TRUE);
+		} else {
+			warn ("Cannot allocate the string <%s>.", string);
+		}
+	}
+
+	D3D9Lock_release_exclusive (&this->stringLock);
+
+	D3D9ObjectFactory_lock ();
+
+	this->r = r;
+	this->g = g;
+	this->b = b;
+	this->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	D3D9ObjectFactory_update (D3D9Object_from_member (this, text));
+
+	D3D9ObjectFactory_release ();
+}
+
+/*
+ * Description                 : Initialize an allocated D3D9ObjectSprite object.
+ * D3D9Object * this           : An allocated D3D9Object
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * char * filePath             : Absolute or relative path of the image (.bmp, .dds, .dib, .hdr, .jpg, .pfm, .png, .ppm, and .tga)
+ * int x, y                    : {x, y} position of the sprite
+ # float opacity   : opacity of the image, value between 0.0 and 1.0
+ * Return                      : bool True on success, false otherwise
+ */
+bool
+D3D9ObjectSprite_init (
+	D3D9Object * this,
+	IDirect3DDevice9 * pDevice,
+	char *filePath,
+	int x, int y,
+	float opacity
+) {
+	D3D9ObjectSpriteBatch batch;
+
+	if (!D3D9ObjectSpriteBatch_init (&batch)) {
+		return false;
+	}
+
+	if (!D3D9ObjectSprite_init_async (this, pDevice, filePath, x, y, opacity, &batch, NULL, NULL)) {
+		CloseHandle (batch.doneEvent);
+		return false;
+	}
+
+	// Wait until the DirectX thread initialize the directx objects
+	D3D9ObjectSpriteStatus status = D3D9ObjectSpriteBatch_wait (&batch, INFINITE);
+	CloseHandle (batch.doneEvent);
+
+	return (status == D3D9_OBJECT_SPRITE_READY);
+}
+
+/*
+ * Description                        : Initialize an allocated D3D9ObjectSprite object without waiting for the DirectX thread.
+ * D3D9Object * this                  : An allocated D3D9Object
+ * IDirect3DDevice9 * pDevice         : An allocated IDirect3DDevice9
+ * char * filePath                    : Absolute or relative path of the image (.bmp, .dds, .dib, .hdr, .jpg, .pfm, .png, .ppm, and .tga)
+ * int x, y                           : {x, y} position of the sprite
+ * float opacity                      : opacity of the image, value between 0.0 and 1.0
+ * D3D9ObjectSpriteBatch *batch       : Completion handle signaled when the sprite is ready, or NULL
+ * D3D9ObjectSpriteCallback callback  : Function called from the DirectX thread when the sprite is ready, or NULL
+ * void *userData                     : Data given to the callback
+ * Return                             : bool True if the sprite has been submitted, false otherwise
+ */
+bool
+D3D9ObjectSprite_init_async (
+	D3D9Object * this,
+	IDirect3DDevice9 * pDevice,
+	char *filePath,
+	int x, int y,
+	float opacity,
+	D3D9ObjectSpriteBatch *batch,
+	D3D9ObjectSpriteCallback callback,
+	void *userData
+) {
+	D3D9ObjectSprite * sprite = &this->sprite;
+	char path [MAX_PATH];
+	unsigned long long version;
+	bool versioned;
+	bool submitted;
+
+	if (batch && batch->sealed) {
+		warn ("Sprite ID=%d cannot be added to a batch already waited.", this->id);
+		return false;
+	}
+
+	// The file system is queried before locking the factory : a slow disk never stalls the other writers
+	D3D9TextureCache_normalize_path (filePath, path);
+	versioned = D3D9Image_get_version (filePath, &version);
+
+	D3D9ObjectFactory_lock ();
+
+	// Fill the structure
+	this->x = x;
+	this->y = y;
+	sprite->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	sprite->filePath = strdup (filePath);
+	sprite->status = D3D9_OBJECT_SPRITE_NOT_READY;
+	sprite->batch = batch;
+	sprite->callback = callback;
+	sprite->userData = userData;
+
+	// The image is read and decoded by the worker threads, then uploaded by the DirectX thread.
+	if (!d3d9ObjectFactory.imageLoader
+	&&  !(d3d9ObjectFactory.imageLoader = D3D9ImageLoader_new (D3D9_IMAGE_LOADER_DEFAULT_THREADS, NULL))) {
+		warn ("Cannot start the image loader.");
+		D3D9ObjectFactory_release ();
+		return false;
+	}
+
+	// Small images are packed together in atlas pages
+	if (!d3d9ObjectFactory.atlas
+	&&  !(d3d9ObjectFactory.atlas = D3D9Atlas_new (D3D9_ATLAS_DEFAULT_PAGE_SIZE, D3D9_ATLAS_DEFAULT_MAX_SPRITE_SIZE))) {
+		warn ("Cannot allocate the sprite atlas.");
+		D3D9ObjectFactory_release ();
+		return false;
+	}
+
+	// Referenced by the image loader until it is uploaded
+	sprite->loading = true;
+
+	// A texture cached for the same version of the file is shared without reading nor decoding the file
+	if (versioned
+	&& (sprite->textureEntry = D3D9TextureCache_acquire (&d3d9ObjectFactory.textureCache, path, version))) {
+		submitted = D3D9ImageLoader_submit_ready (d3d9ObjectFactory.imageLoader, filePath, version, this);
+	} else {
+		submitted = D3D9ImageLoader_submit (d3d9ObjectFactory.imageLoader, filePath, this);
+	}
+
+	if (!submitted) {
+		warn ("Cannot submit the image <%s>.", filePath);
+		sprite->loading = false;
+		if (sprite->textureEntry) {
+			D3D9TextureCache_release (&d3d9ObjectFactory.textureCache, sprite->textureEntry);
+			sprite->textureEntry = NULL;
+		}
+		D3D9ObjectFactory_release ();
+		return false;
+	}
+
+	if (batch) {
+		InterlockedIncrement (&batch->pending);
+	}
+
+	dbg ("Sprite <ID=%d | filePath=<%s> | x=%d | y=%d | opacity=%.2f> has been created.", this->id, filePath, x, y, opacity);
+
+	D3D9ObjectFactory_release ();
+
+	return true;
+}
+
+/*
+ * Description            : Get the initialization status of a sprite
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite
+ * Return                 : D3D9ObjectSpriteStatus the current status
+ */
+D3D9ObjectSpriteStatus
+D3D9ObjectSprite_get_status (
+	D3D9ObjectSprite *this
+) {
+	return InterlockedCompareExchange ((volatile LONG *) &this->status, 0, 0);
+}
+
+/*
+ * Description                    : Publish the result of the DirectX initialization of a sprite and signal its waiters
+ * D3D9Object *this               : An allocated D3D9Object of type sprite
+ * D3D9ObjectSpriteStatus status  : D3D9_OBJECT_SPRITE_READY or D3D9_OBJECT_SPRITE_ERROR
+ * Return                         : void
+ */
+static void
+D3D9ObjectSprite_complete (
+	D3D9Object *this,
+	D3D9ObjectSpriteStatus status
+) {
+	D3D9ObjectSprite *sprite = &this->sprite;
+	D3D9ObjectSpriteBatch *batch = sprite->batch;
+
+	// The waiter may free the batch as soon as it is signaled
+	sprite->batch = NULL;
+	InterlockedExchange ((volatile LONG *) &sprite->status, status);
+
+	if (sprite->callback) {
+		sprite->callback (this, status, sprite->userData);
+	}
+
+	if (batch) {
+		if (status == D3D9_OBJECT_SPRITE_ERROR) {
+			InterlockedIncrement (&batch->failed);
+		}
+
+		if (InterlockedDecrement (&batch->pending) == 0) {
+			SetEvent (batch->doneEvent);
+		}
+	}
+}
+
+/*
+ * Description : Set new attribute to D3D9ObjectSprite
+ * D3D9ObjectText *this : An allocated D3D9ObjectSprite
+ * float opacity : opacity of the sprite
+ * Return : void
+ */
+void
+D3D9ObjectSprite_set (
+	D3D9ObjectSprite *this,
+	float opacity
+) {
+	D3D9ObjectFactory_lock ();
+
+	this->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	D3D9ObjectFactory_update (D3D9Object_from_member (this, sprite));
+
+	D3D9ObjectFactory_release ();
+}
+
+/*
+ * Description                 : Initialize D3D9ObjectSprite DirectX objects from the images decoded by the worker threads,
+ *                               within the upload budget of the frame. At least one image is uploaded per frame.
+ *                               /!\ This function must be called only from the DirectX thread.
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * Return                      : void
+ */
+void
+D3D9ObjectSprite_init_directx (
+	IDirect3DDevice9 * pDevice
+) {
+	D3D9ImageRequest *request;
+	LARGE_INTEGER frequency, start, now;
+
+	if (!d3d9ObjectFactory.imageLoader) {
+		return;
+	}
+
+	// Release the textures evicted by the other threads, then reclaim the space of the sprites deleted since the last frame
+	D3D9TextureCache_drain (&d3d9ObjectFactory.textureCache);
+	D3D9Atlas_update (d3d9ObjectFactory.atlas);
+
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&start);
+
+	// Upload the decoded images until the budget of the frame is spent. The budget is checked after an upload,
+	// so the sprites waited for are completed even with a budget of zero.
+	do {
+		if (!(request = D3D9ImageLoader_pop_decoded (d3d9ObjectFactory.imageLoader))) {
+			break;
+		}
+
+		D3D9ObjectSprite_upload (request, pDevice);
+		QueryPerformanceCounter (&now);
+	} while (((now.QuadPart - start.QuadPart) * 1000000LL / frequency.QuadPart) < d3d9ObjectFactory.uploadBudget);
+
+	// The sprites uploaded are drawn from the next frame, or once no writer holds the factory
+	D3D9ObjectFactory_apply_pending ();
+}
+
+/*
+ * Description                 : Create the texture of a sprite from its decoded image, then complete the sprite.
+ *                               /!\ This function must be called only from the DirectX thread.
+ * D3D9ImageRequest *request   : A request decoded by the image loader, freed by this function
+ * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
+ * Return                      : void
+ */
+static void
+D3D9ObjectSprite_upload (
+	D3D9ImageRequest *request,
+	IDirect3DDevice9 * pDevice
+) {
+	D3D9Object * this = request->userData;
+	D3D9ObjectSprite * sprite = &this->sprite;
+	IDirect3DTexture9 * texture;
+	char path [MAX_PATH];
+
+	// The image loader doesn't reference the sprite anymore : it can be freed if it has been deleted meanwhile
+	sprite->loading = false;
+
+	// The texture has already been found in the cache when the image was submitted
+	if (request->success && !sprite->textureEntry)
+	{
+		// Share the texture of the sprites created from the same image, decoded meanwhile
+		D3D9TextureCache_normalize_path (sprite->filePath, path);
+		sprite->textureEntry = D3D9TextureCache_acquire (&d3d9ObjectFactory.textureCache, path, request->image.version);
+
+		// Pack the small images in the atlas
+		if (!sprite->textureEntry && D3D9Atlas_accepts (d3d9ObjectFactory.atlas, &request->image)) {
+			D3D9AtlasRegion *region;
+
+			if ((region = D3D9Atlas_add (d3d9ObjectFactory.atlas, pDevice, &request->image))) {
+				if (!(sprite->textureEntry = D3D9TextureCache_insert_region (&d3d9ObjectFactory.textureCache,
+					path, request->image.version, d3d9ObjectFactory.atlas, region))) {
+					D3D9Atlas_remove (d3d9ObjectFactory.atlas, region);
+				}
+			}
+		}
+
+		if (!sprite->textureEntry && D3D9Image_create_texture (&request->image, pDevice, &texture)) {
+			if (!(sprite->textureEntry = D3D9TextureCache_insert (&d3d9ObjectFactory.textureCache, path, request->image.version, texture))) {
+				texture->lpVtbl->Release (texture);
+			}
+		}
+	}
+
+	D3D9ImageRequest_free (request);
+
+	if (!sprite->textureEntry) {
+		warn ("Cannot create the texture <%s>.", sprite->filePath);
+		D3D9ObjectSprite_complete (this, D3D9_OBJECT_SPRITE_ERROR);
+		return;
+	}
+
+	sprite->texture = sprite->textureEntry->texture;
+
+	sprite->w = sprite->textureEntry->w;
+	sprite->h = sprite->textureEntry->h;
+
+	// All the sprite objects are drawn with the same sprite
+	if (!D3D9ObjectFactory_get_sprite (pDevice)) {
+		D3D9ObjectSprite_complete (this, D3D9_OBJECT_SPRITE_ERROR);
+		return;
+	}
+
+	// Drawn once the factory is free : the DirectX thread never waits for the writers
+	sprite->uploaded = true;
+	sprite->nextUploaded = d3d9ObjectFactory.uploadedSprites;
+	d3d9ObjectFactory.uploadedSprites = this;
+
+	D3D9ObjectSprite_complete (this, D3D9_OBJECT_SPRITE_READY);
+}
+
+
+/*
+ * Description       : Set the maximum time spent by D3D9ObjectSprite_init_directx on uploading textures in a frame.
+ *                     At least one texture is uploaded per frame.
+ * int microseconds  : Upload budget of a frame in microseconds
+ * Return            : void
+ */
+void
+D3D9ObjectSprite_set_upload_budget (
+	int microseconds
+) {
+	d3d9ObjectFactory.uploadBudget = microseconds;
+}
+
+
+/// ===== D3D9ObjectSpriteBatch =====
+
+/*
+ * Description : Allocate a new completion handle for sprites initialized asynchronously
+ * Return      : D3D9ObjectSpriteBatch * an allocated D3D9ObjectSpriteBatch, or NULL
+ */
+D3D9ObjectSpriteBatch *
+D3D9ObjectSpriteBatch_new (
+	void
 ) {
-	D3D9ObjectFactory_lock ();
+	D3D9ObjectSpriteBatch *this;
 
-	D3D9ObjectText * text = &this->text;
+	if ((this = calloc (1, sizeof(D3D9ObjectSpriteBatch))) == NULL)
+		return NULL;
 
-	// Default parameters
-	if (fontFamily == NULL) {
-		fontFamily = "Arial";
+	if (!D3D9ObjectSpriteBatch_init (this)) {
+		free (this);
+		return NULL;
 	}
 
-	// Allocate the font
-	if ((D3DXCreateFont (
-		pDevice,
-		fontSize,
-		0,
-		FW_BOLD,
-		1,
-		0,
-		DEFAULT_CHARSET,
-		OUT_DEFAULT_PRECIS,
-		DEFAULT_QUALITY,
-		DEFAULT_PITCH | FF_DONTCARE,
-		fontFamily,
-		&text->font
-	)) != S_OK) {
-		warn ("Cannot create the font ID=%d.", this->id);
-		D3D9ObjectFactory_release ();
+	return this;
+}
+
+/*
+ * Description                 : Initialize an allocated D3D9ObjectSpriteBatch
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * Return                      : bool true on success, false otherwise
+ */
+bool
+D3D9ObjectSpriteBatch_init (
+	D3D9ObjectSpriteBatch *this
+) {
+	// One pending submission is held until the batch is waited, so the event
+	// isn't signaled while sprites are still being submitted.
+	this->pending = 1;
+	this->failed  = 0;
+	this->sealed  = 0;
+
+	if ((this->doneEvent = CreateEvent (NULL, TRUE, FALSE, NULL)) == NULL) {
+		warn ("Cannot create the sprite batch event.");
 		return false;
 	}
 
-	// Fill the structure
-	this->x = x;
-	this->y = y;
-	text->r = r;
-	text->g = g;
-	text->b = b;
-	text->string = strdup (string);
-	text->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	return true;
+}
 
-	dbg ("Text <ID=%d | string=<%s> | x=%d | y=%d | rgb=%02X%02X%02X | opacity=%d> has been created.", this->id, string, x, y, r, g, b, text->opacity);
+/*
+ * Description                 : Wait once for all the sprites submitted with the batch.
+ *                               No sprite can be submitted with the batch after this call.
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * DWORD timeout               : Maximum time to wait in milliseconds, or INFINITE
+ * Return                      : D3D9_OBJECT_SPRITE_READY if all the sprites are ready,
+ *                               D3D9_OBJECT_SPRITE_ERROR if at least one failed,
+ *                               D3D9_OBJECT_SPRITE_NOT_READY if the timeout expired
+ */
+D3D9ObjectSpriteStatus
+D3D9ObjectSpriteBatch_wait (
+	D3D9ObjectSpriteBatch *this,
+	DWORD timeout
+) {
+	// Release the submission guard the first time the batch is waited
+	if (InterlockedExchange (&this->sealed, 1) == 0) {
+		if (InterlockedDecrement (&this->pending) == 0) {
+			SetEvent (this->doneEvent);
+		}
+	}
 
-	D3D9ObjectFactory_add (this);
+	if (WaitForSingleObject (this->doneEvent, timeout) != WAIT_OBJECT_0) {
+		return D3D9_OBJECT_SPRITE_NOT_READY;
+	}
 
-	D3D9ObjectFactory_release ();
-	return true;
+	return (InterlockedCompareExchange (&this->failed, 0, 0)) ?
+		D3D9_OBJECT_SPRITE_ERROR : D3D9_OBJECT_SPRITE_READY;
 }
 
 /*
- * Description : Set new attribute to D3D9ObjectText
- * D3D9ObjectText *this : An allocated D3D9ObjectText
- * char *string : New string of the text
- * byte r, byte g, byte b : New color of the text
- * float opacity : opacity of the text
- * Return : void
+ * Description                 : Free an allocated D3D9ObjectSpriteBatch.
+ *                               /!\ The batch must have been waited with success before.
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * Return                      : void
  */
 void
-D3D9ObjectText_set (
-	D3D9ObjectText *this,
-	char *string,
-	byte r, byte g, byte b,
-	float opacity
+D3D9ObjectSpriteBatch_free (
+	D3D9ObjectSpriteBatch *this
 ) {
-	this->string = strdup (string);
-	this->r = r;
-	this->g = g;
-	this->b = b;
-	this->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	if (this != NULL) {
+		CloseHandle (this->doneEvent);
+		free (this);
+	}
 }
 
+
+
+/// ===== Frame drawing =====
+
 /*
- * Description                 : Initialize an allocated D3D9ObjectSprite object.
- * D3D9Object * this           : An allocated D3D9Object
+ * Description                 : Get the sprite shared by all the sprite objects, and create it the first time.
+ *                               /!\ This function must be called only from the DirectX thread.
  * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
- * char * filePath             : Absolute or relative path of the image (.bmp, .dds, .dib, .hdr, .jpg, .pfm, .png, .ppm, and .tga)
- * int x, y                    : {x, y} position of the sprite
- # float opacity   : opacity of the image, value between 0.0 and 1.0
- * Return                      : bool True on success, false otherwise
+ * Return                      : ID3DXSprite * the shared sprite, or NULL on error
  */
-bool
-D3D9ObjectSprite_init (
-	D3D9Object * this,
-	IDirect3DDevice9 * pDevice,
-	char *filePath,
-	int x, int y,
-	float opacity
+static ID3DXSprite *
+D3D9ObjectFactory_get_sprite (
+	IDirect3DDevice9 * pDevice
 ) {
-	D3D9ObjectFactory_lock ();
+	if (!d3d9ObjectFactory.sprite
+	&&  D3DXCreateSprite (pDevice, &d3d9ObjectFactory.sprite) != D3D_OK) {
+		warn ("Cannot create the sprite.");
+		d3d9ObjectFactory.sprite = NULL;
+	}
 
-	D3D9ObjectSprite * sprite = &this->sprite;
+	return d3d9ObjectFactory.sprite;
+}
 
-	// Fill the structure
-	this->x = x;
-	this->y = y;
-	sprite->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
-	sprite->filePath = strdup (filePath);
+/*
+ * Description : Draw the published draw list. Consecutive sprites are drawn in one batch of the shared sprite,
+ *               sorted by texture. The order between the sprites and the other objects is kept.
+ *               /!\ This function must be called only from the DirectX thread.
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_draw (
+	IDirect3DDevice9 * pDevice
+) {
+	D3D9ObjectDrawList *drawList = D3D9ObjectFactory_acquire_draw_list ();
+	D3D9ObjectDrawStats stats = {
+		.objects         = drawList->count,
+		.publishDeferred = (d3d9ObjectFactory.measuredTexts || d3d9ObjectFactory.uploadedSprites)
+	};
+	unsigned int *visible = D3D9ObjectFactory_cull (drawList, pDevice);
+
+	for (int index = 0; index < drawList->count;)
+	{
+		D3D9Object *object = drawList->objects [index];
 
-	dbg ("Sprite <ID=%d | filePath=<%s> | x=%d | y=%d | opacity=%.2f> has been created.", this->id, filePath, x, y, opacity);
+		switch (drawList->types [index])
+		{
+			case D3D9_OBJECT_RECTANGLE:
+				index = D3D9ObjectFactory_draw_rects (drawList, index, visible, pDevice, &stats);
+			break;
 
-	// Only DirectX thread can call safely D3DXCreateTextureFromFile and D3DXCreateSprite.
-	bb_queue_add (&d3d9ObjectFactory.spriteToInstanciate, this);
+			case D3D9_OBJECT_TEXT: {
+				bool dirty = InterlockedCompareExchange (&object->text.dirty, FALSE, FALSE);
+				D3D9ObjectDrawRow row;
+				bool rendered;
 
-	D3D9ObjectFactory_release ();
+				// The extents of a text are measured when it is drawn : a text changed is never culled
+				if (!dirty && !D3D9ObjectFactory_is_visible (visible, index)) {
+					stats.culled++;
+					index++;
+					break;
+				}
+
+				if (dirty) {
+					stats.textLayoutMisses++;
+				} else {
+					stats.textLayoutHits++;
+				}
+
+				rendered = (object->text.quad == NULL);
+				D3D9ObjectDrawList_read_row (drawList, index, &row);
+				D3D9ObjectText_draw (&object->text, row.x, row.y, pDevice);
+				stats.drawCalls++;
+
+				if (rendered && object->text.quad) {
+					stats.textRenders++;
+				}
+
+				// The extents measured are given to the factory at the next frame, without waiting for the writers
+				if (dirty && !object->text.measured) {
+					object->text.measured = true;
+					object->text.nextMeasured = d3d9ObjectFactory.measuredTexts;
+					d3d9ObjectFactory.measuredTexts = &object->text;
+				}
+				index++;
+			} break;
+
+			case D3D9_OBJECT_SPRITE:
+				index = D3D9ObjectFactory_draw_sprites (drawList, index, visible, &stats);
+			break;
 
-	while (sprite->status == D3D9_OBJECT_SPRITE_NOT_READY) {
-		// Active waiting until the DirectX thread initialize the directx objects
-		Sleep (1);
+			default :
+				index++;
+			break;
+		}
 	}
 
-	if (sprite->status == D3D9_OBJECT_SPRITE_ERROR) {
-		return false;
+	D3D9ObjectFactory_release_draw_list ();
+
+	d3d9ObjectFactory.drawStats = stats;
+}
+
+/*
+ * Description                  : Draw the run of consecutive sprites starting at an index of the draw list in one batch
+ * D3D9ObjectDrawList *drawList : The acquired draw list snapshot
+ * int first                    : Index of the first sprite of the run
+ * unsigned int *visible        : The visibility mask of the frame, or NULL
+ * D3D9ObjectDrawStats *stats   : Counters of the frame
+ * Return                       : int the index following the run
+ */
+static int
+D3D9ObjectFactory_draw_sprites (
+	D3D9ObjectDrawList *drawList,
+	int first,
+	unsigned int *visible,
+	D3D9ObjectDrawStats *stats
+) {
+	ID3DXSprite *sprite = d3d9ObjectFactory.sprite;
+	D3D9SpriteBatch *batch = &d3d9ObjectFactory.spriteBatch;
+	int last = first;
+	int count;
+
+	while (last < drawList->count && drawList->types [last] == D3D9_OBJECT_SPRITE) {
+		last++;
 	}
 
-	return true;
+	if (!sprite) {
+		return last;
+	}
+
+	count = 0;
+
+	for (int index = first; index < last; index++) {
+		if (D3D9ObjectFactory_is_visible (visible, index)) {
+			count++;
+		} else {
+			stats->culled++;
+		}
+	}
+
+	if (count == 0) {
+		return last;
+	}
+
+	// Group the sprites sharing a texture, so the batch is flushed once per texture
+	D3D9SpriteBatch_begin (batch, sprite, count);
+
+	for (int index = first; index < last; index++) {
+		if (D3D9ObjectFactory_is_visible (visible, index)) {
+			D3D9ObjectDrawRow row;
+
+			D3D9ObjectDrawList_read_row (drawList, index, &row);
+			D3D9SpriteBatch_add (batch, row.texture, D3D9ObjectSprite_get_source (&drawList->objects [index]->sprite),
+				row.x, row.y, row.color);
+		}
+	}
+
+	D3D9SpriteBatch_end (batch);
+
+	stats->spriteBatches++;
+	stats->textureChanges += batch->textureChanges;
+	stats->drawCalls      += batch->draws;
+
+	return last;
 }
 
 /*
- * Description : Set new attribute to D3D9ObjectSprite
- * D3D9ObjectText *this : An allocated D3D9ObjectSprite
- * float opacity : opacity of the sprite
- * Return : void
+ * Description                : Get the counters of the last frame drawn by D3D9ObjectFactory_draw
+ * D3D9ObjectDrawStats *stats : Output of the counters
+ * Return                     : void
  */
 void
-D3D9ObjectSprite_set (
-	D3D9ObjectSprite *this,
-	float opacity
+D3D9ObjectFactory_get_draw_stats (
+	D3D9ObjectDrawStats *stats
 ) {
-	this->opacity = (opacity * 255 > 255) ? 255 : opacity * 255;
+	*stats = d3d9ObjectFactory.drawStats;
 }
 
 /*
- * Description                 : Initialize D3D9ObjectSprite DirectX objects.
- *                               /!\ This function must be called only from the DirectX thread.
- * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
- * Return                      : void
+ * Description : Release the video memory of the shared sprite, the fonts and the text quads before the device is reset.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : void
  */
 void
-D3D9ObjectSprite_init_directx (
-	IDirect3DDevice9 * pDevice
+D3D9ObjectFactory_on_lost_device (
+	void
 ) {
-	while (bb_queue_get_length (&d3d9ObjectFactory.spriteToInstanciate))
-	{
-		D3D9Object * this = bb_queue_pop (&d3d9ObjectFactory.spriteToInstanciate);
-		D3D9ObjectSprite * sprite = &this->sprite;
-
-		// Create the texture
-		if ((D3DXCreateTextureFromFileEx (
-				pDevice,
-				sprite->filePath,
-				D3DX_DEFAULT,
-				D3DX_DEFAULT,
-				D3DX_DEFAULT,
-				0,
-				D3DFMT_UNKNOWN,
-				D3DPOOL_MANAGED,
-				D3DX_DEFAULT,
-				D3DX_DEFAULT,
-				0,
-				NULL,
-				NULL,
-				&sprite->texture)) != D3D_OK) {
-			warn ("Cannot create the texture <%s>.", sprite->filePath);
-			sprite->status = D3D9_OBJECT_SPRITE_ERROR;
-			continue;
-		}
+	// The quads are in the default pool : they are rendered again by the next frames
+	while (d3d9ObjectFactory.renderedTexts) {
+		D3D9ObjectText_release_quad (d3d9ObjectFactory.renderedTexts);
+	}
 
-		D3DSURFACE_DESC surfaceDesc;
-		sprite->texture->lpVtbl->GetLevelDesc (sprite->texture, 0, &surfaceDesc);
-		sprite->w = surfaceDesc.Width;
-		sprite->h = surfaceDesc.Height;
+	if (d3d9ObjectFactory.sprite) {
+		d3d9ObjectFactory.sprite->lpVtbl->OnLostDevice (d3d9ObjectFactory.sprite);
+	}
 
-		// Create the sprite
-		if ((D3DXCreateSprite (pDevice, &sprite->sprite)) != D3D_OK) {
-			warn ("Cannot create the sprite.");
-			sprite->status = D3D9_OBJECT_SPRITE_ERROR;
-			continue;
-		}
+	if (d3d9ObjectFactory.rectRenderer) {
+		D3D9RectRenderer_on_lost_device (d3d9ObjectFactory.rectRenderer);
+	}
 
-		D3D9ObjectFactory_add (this);
+	D3D9FontCache_on_lost_device (&d3d9ObjectFactory.fontCache);
+}
 
-		sprite->status = D3D9_OBJECT_SPRITE_READY;
+/*
+ * Description : Restore the shared sprite and the fonts after the device has been reset.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_on_reset_device (
+	void
+) {
+	if (d3d9ObjectFactory.sprite) {
+		d3d9ObjectFactory.sprite->lpVtbl->OnResetDevice (d3d9ObjectFactory.sprite);
 	}
+
+	D3D9FontCache_on_reset_device (&d3d9ObjectFactory.fontCache);
 }
 
 
 /// ===== Drawing utilities =====
 
 /*
- * Description                 : Draw a rectangle at a given position / color on the screen
+ * Description                 : Draw a rectangle at a given position / color on the screen, alone in its DrawPrimitive call.
+ *                               D3D9ObjectFactory_draw batches the rectangles of the draw list instead.
  * D3D9ObjectRect *this        : An allocated D3D9ObjectRect
  * int x, y                    : {x, y} position of the rectangle
  * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
@@ -646,14 +2713,18 @@ D3D9ObjectRect_draw (
 	int x, int y,
 	IDirect3DDevice9 * pDevice
 ) {
-	D3DRECT rectPosition = {x, y, x + this->w, y + this->h};
-	D3DCOLOR color = D3DCOLOR_RGBA (this->r, this->g, this->b, 255);
+	D3D9RectRenderer *renderer = D3D9ObjectFactory_get_rect_renderer ();
+	D3DCOLOR color = D3DCOLOR_ARGB (this->opacity, this->r, this->g, this->b);
 
-	pDevice->lpVtbl->Clear (pDevice, 1, &rectPosition, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, color, 0,  0);
+	if (renderer && D3D9RectRenderer_add (renderer, x, y, this->w, this->h, color)) {
+		D3D9RectRenderer_flush (renderer, pDevice);
+	}
 }
 
 /*
- * Description                 : Draw text at a given position / color on the screen
+ * Description                 : Draw text at a given position / color on the screen. The layout is rendered into a quad
+ *                               once, then the quad is drawn with the shared sprite until the string changes.
+ *                               /!\ This function must be called only from the DirectX thread.
  * D3D9ObjectText *text        : An allocated D3D9ObjectText
  * int x, y                    : {x, y} position of the text
  * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
@@ -664,16 +2735,165 @@ D3D9ObjectText_draw (
 	int x, int y,
 	IDirect3DDevice9 * pDevice
 ) {
-    RECT rect;
-    ID3DXFont *font = this->font;
+	ID3DXSprite *sprite = D3D9ObjectFactory_get_sprite (pDevice);
 	D3DCOLOR color = D3DCOLOR_RGBA (this->r, this->g, this->b, this->opacity);
+	RECT rect;
+
+	if (InterlockedCompareExchange (&this->dirty, FALSE, FALSE)) {
+		D3D9ObjectText_release_quad (this);
+		D3D9ObjectText_layout (this);
+	}
+
+	if (sprite && (this->quad || D3D9ObjectText_render (this, pDevice))) {
+		D3DXVECTOR3 position3D = {x, y, 0.0};
+
+		sprite->lpVtbl->Begin (sprite, D3DXSPRITE_ALPHABLEND);
+		sprite->lpVtbl->Draw (sprite, this->quad, NULL, NULL, &position3D, color);
+		sprite->lpVtbl->End (sprite);
+		return;
+	}
+
+	// No quad : the glyphs are drawn again
+	SetRect (&rect, x, y, x + this->layoutW, y + this->layoutH);
+	this->font->lpVtbl->DrawText (this->font, NULL, this->layoutString.data, this->layoutString.length, &rect, DT_NOCLIP | DT_LEFT, color);
+}
+
+/*
+ * Description                 : Render the layout of a text into a new quad, in white over a transparent background
+ *                               /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this        : An allocated D3D9ObjectText, measured
+ * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
+ * Return                      : bool true if the quad has been rendered, false otherwise
+ */
+static bool
+D3D9ObjectText_render (
+	D3D9ObjectText *this,
+	IDirect3DDevice9 * pDevice
+) {
+	RECT rect = {0, 0, this->layoutW, this->layoutH};
+	IDirect3DSurface9 *target = NULL, *surface = NULL;
+	IDirect3DTexture9 *quad = NULL;
+	D3DVIEWPORT9 viewport;
+	bool rendered = false;
+
+	if (this->layoutW <= 0 || this->layoutH <= 0) {
+		return false;
+	}
+
+	if (pDevice->lpVtbl->CreateTexture (pDevice, this->layoutW, this->layoutH, 1, D3DUSAGE_RENDERTARGET,
+		D3DFMT_A8R8G8B8, D3DPOOL_DEFAULT, &quad, NULL) != D3D_OK) {
+		return false;
+	}
+
+	// Setting a render target resets the viewport of the application
+	pDevice->lpVtbl->GetViewport (pDevice, &viewport);
+
+	if (quad->lpVtbl->GetSurfaceLevel (quad, 0, &surface) == D3D_OK
+	&&  pDevice->lpVtbl->GetRenderTarget (pDevice, 0, &target) == D3D_OK
+	&&  pDevice->lpVtbl->SetRenderTarget (pDevice, 0, surface) == D3D_OK)
+	{
+		// Cleared in transparent white, so the antialiased edges blend toward the color of the text
+		pDevice->lpVtbl->Clear (pDevice, 0, NULL, D3DCLEAR_TARGET, D3DCOLOR_ARGB (0, 255, 255, 255), 1.0f, 0);
+		this->font->lpVtbl->DrawText (this->font, NULL, this->layoutString.data, this->layoutString.length, &rect,
+			DT_NOCLIP | DT_LEFT, D3DCOLOR_ARGB (255, 255, 255, 255));
+
+		pDevice->lpVtbl->SetRenderTarget (pDevice, 0, target);
+		pDevice->lpVtbl->SetViewport (pDevice, &viewport);
+		rendered = true;
+	}
+
+	if (target) {
+		target->lpVtbl->Release (target);
+	}
+
+	if (surface) {
+		surface->lpVtbl->Release (surface);
+	}
+
+	if (!rendered) {
+		quad->lpVtbl->Release (quad);
+		return false;
+	}
+
+	this->quad = quad;
+	this->prevRendered = NULL;
+	this->nextRendered = d3d9ObjectFactory.renderedTexts;
+
+	if (this->nextRendered) {
+		this->nextRendered->prevRendered = this;
+	}
+
+	d3d9ObjectFactory.renderedTexts = this;
+
+	return true;
+}
+
+/*
+ * Description          : Release the quad of a text, rendered again by the next draw
+ *                        /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this : An allocated D3D9ObjectText
+ * Return               : void
+ */
+static void
+D3D9ObjectText_release_quad (
+	D3D9ObjectText *this
+) {
+	if (!this->quad) {
+		return;
+	}
+
+	if (this->prevRendered) {
+		this->prevRendered->nextRendered = this->nextRendered;
+	} else {
+		d3d9ObjectFactory.renderedTexts = this->nextRendered;
+	}
+
+	if (this->nextRendered) {
+		this->nextRendered->prevRendered = this->prevRendered;
+	}
+
+	this->quad->lpVtbl->Release (this->quad);
+	this->quad = NULL;
+	this->prevRendered = NULL;
+	this->nextRendered = NULL;
+}
+
+/*
+ * Description          : Measure the string of a text and load its glyphs in the font cache
+ *                        /!\ This function must be called only from the DirectX thread.
+ * D3D9ObjectText *this : An allocated D3D9ObjectText
+ * Return               : void
+ */
+static void
+D3D9ObjectText_layout (
+	D3D9ObjectText *this
+) {
+	RECT rect = {0, 0, 0, 0};
+	ID3DXFont *font = this->font;
+	D3D9TextBuffer *string = &this->layoutString;
+	bool copied;
+
+	// Copy the string, so D3D9ObjectText_set can change it while it is drawn
+	D3D9Lock_acquire_shared (&this->stringLock);
+	InterlockedExchange (&this->dirty, FALSE);
+	copied = D3D9TextBuffer_set (string, this->string.data);
+	D3D9Lock_release_shared (&this->stringLock);
+
+	if (!copied) {
+		warn ("Cannot allocate the layout of the text.");
+		return;
+	}
+
+	font->lpVtbl->DrawText (font, NULL, string->data, string->length, &rect, DT_CALCRECT | DT_LEFT, 0);
+	font->lpVtbl->PreloadText (font, string->data, string->length);
 
-    SetRect (&rect, x, y, x, y);
-    font->lpVtbl->DrawText (font, NULL, this->string, -1, &rect, DT_NOCLIP | DT_LEFT, color);
+	this->layoutW = rect.right - rect.left;
+	this->layoutH = rect.bottom - rect.top;
 }
 
 /*
- * Description                    : Draw a sprite at a given position on the screen
+ * Description                    : Draw a sprite at a given position on the screen, in its own batch of the shared sprite.
+ *                                  D3D9ObjectFactory_draw batches the sprites of the draw list instead.
  * D3D9ObjectSprite *spriteObject : An allocated D3D9ObjectSprite.
  * int x, y                       : {x, y} position of the sprite
  * Return                         : void
@@ -683,18 +2903,51 @@ D3D9ObjectSprite_draw (
 	D3D9ObjectSprite *this,
 	int x, int y
 ) {
-	ID3DXSprite * sprite        = this->sprite;
-	IDirect3DTexture9 * texture = this->texture;
-	D3DXVECTOR3 position3D      = {x, y, 0.0};
-	D3DCOLOR color              = D3DCOLOR_ARGB (this->opacity, 255, 255, 255);
+	ID3DXSprite * sprite = d3d9ObjectFactory.sprite;
+
+	if (!sprite) {
+		return;
+	}
 
 	sprite->lpVtbl->Begin (sprite, D3DXSPRITE_ALPHABLEND);
-	sprite->lpVtbl->Draw (sprite, texture, NULL, NULL, &position3D, color);
+	D3D9ObjectSprite_draw_batched (this, sprite, x, y, D3DCOLOR_ARGB (this->opacity, 255, 255, 255));
 	sprite->lpVtbl->End (sprite);
 }
 
 /*
- * Description : Free an allocated D3D9Object
+ * Description            : Draw a sprite inside a batch already begun
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite
+ * ID3DXSprite *sprite    : The shared sprite, between Begin and End
+ * int x, y               : {x, y} position of the sprite
+ * D3DCOLOR color         : Color modulating the sprite, its alpha is the opacity
+ * Return                 : void
+ */
+static void
+D3D9ObjectSprite_draw_batched (
+	D3D9ObjectSprite *this,
+	ID3DXSprite *sprite,
+	int x, int y,
+	D3DCOLOR color
+) {
+	D3DXVECTOR3 position3D = {x, y, 0.0};
+
+	sprite->lpVtbl->Draw (sprite, this->texture, D3D9ObjectSprite_get_source (this), NULL, &position3D, color);
+}
+
+/*
+ * Description            : Get the part of its texture drawn by a sprite
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite, uploaded
+ * Return                 : RECT * the region of the atlas page containing the image, or NULL for the whole texture
+ */
+static RECT *
+D3D9ObjectSprite_get_source (
+	D3D9ObjectSprite *this
+) {
+	return (this->textureEntry->region) ? &this->textureEntry->region->rect : NULL;
+}
+
+/*
+ * Description : Free an allocated D3D9Object. Its memory is released once the DirectX thread has released the last snapshot drawing it.
  *               /!\ The factory MUST BE LOCKED when calling this function.
  * D3D9Object *this : An allocated D3D9Object
  * Return : void
@@ -702,6 +2955,22 @@ D3D9ObjectSprite_draw (
 void
 D3D9Object_free (
 	D3D9Object *this
+) {
+	// Same path as D3D9ObjectFactory_delete : the published draw list may still point to the object
+	D3D9ObjectFactory_unregister (this);
+	D3D9ObjectFactory_retire (this);
+	D3D9ObjectFactory_invalidate ();
+}
+
+/*
+ * Description      : Release the resources of an object removed from the factory, without freeing its memory
+ *                    /!\ This function must be called only from the DirectX thread.
+ * D3D9Object *this : An allocated D3D9Object
+ * Return           : void
+ */
+static void
+D3D9Object_clear (
+	D3D9Object *this
 ) {
 	switch (this->type)
 	{
@@ -710,23 +2979,23 @@ D3D9Object_free (
 		} break;
 
 		case D3D9_OBJECT_TEXT: {
-			ID3DXFont *font = this->text.font;
-			if (font)
-				font->lpVtbl->Release (font);
+			D3D9FontCacheEntry *fontEntry = this->text.fontEntry;
+			D3D9ObjectText_release_quad (&this->text);
+			if (fontEntry) {
+				D3D9FontCache_release (&d3d9ObjectFactory.fontCache, fontEntry);
+				D3D9TextBuffer_reset (&this->text.string);
+				D3D9TextBuffer_reset (&this->text.layoutString);
+				D3D9Lock_destroy (&this->text.stringLock);
+			}
 		} break;
 
 		case D3D9_OBJECT_SPRITE: {
-			ID3DXSprite * sprite = this->sprite.sprite;
-			IDirect3DTexture9 * texture = this->sprite.texture;
-			if (texture)
-				texture->lpVtbl->Release (texture);
-			if (sprite)
-				sprite->lpVtbl->Release (sprite);
+			D3D9TextureCacheEntry * textureEntry = this->sprite.textureEntry;
+			if (textureEntry)
+				D3D9TextureCache_release (&d3d9ObjectFactory.textureCache, textureEntry);
 			free (this->sprite.filePath);
 		} break;
 
 		default : warn ("Cannot free completely an unknown type."); break;
 	}
-
-	free (this);
 }
@@ -7,8 +7,27 @@
 #include "dx/d3dx9.h"
 #include "BbQueue/BbQueue.h"
 #include "Win32Tools/Win32Tools.h"
+#include "D3D9Lock.h"
+#include "D3D9ImageLoader.h"
+#include "D3D9ImageWin32.h"
+#include "D3D9TextureCache.h"
+#include "D3D9FontCache.h"
+#include "D3D9TextBuffer.h"
+#include "D3D9ObjectPool.h"
+#include "D3D9ObjectTable.h"
+#include "D3D9Snapshot.h"
+#include "D3D9SeqLock.h"
+#include "D3D9RectRenderer.h"
+#include "D3D9SpriteBatch.h"
+#include "D3D9SpatialGrid.h"
+#include "D3D9BoundsKernel.h"
 
 // ---------- Defines -------------
+// Default time spent uploading sprite textures per frame, in microseconds
+#define D3D9_OBJECT_SPRITE_DEFAULT_UPLOAD_BUDGET 1000
+
+// Number of objects stacked on a point handled without allocation by the hit tests
+#define D3D9_OBJECT_HIT_TEST_CAPACITY 256
 
 
 // ------ Structure declaration -------
@@ -38,30 +57,83 @@ typedef struct
 {
 	int w, h;
 	byte r, g, b;
+	int opacity;
 
 } 	D3D9ObjectRect;
 
-typedef struct
+typedef struct _D3D9ObjectText
 {
 	ID3DXFont *font;
+	D3D9FontCacheEntry *fontEntry;
 	byte r, g, b;
 	int opacity;
-	char *string;
+
+	// String of the text, locked while the DirectX thread copies it
+	D3D9TextBuffer string;
+	D3D9Lock stringLock;
+
+	// Layout of the string, measured again by the DirectX thread only when the string changes.
+	// The copy of the string measured is drawn until the next layout. Set and cleared with the Interlocked functions.
+	volatile LONG dirty;
+	D3D9TextBuffer layoutString;
+	int layoutW, layoutH;
+
+	// Quad the layout is rendered into once with DrawText, then drawn with the shared sprite, modulated by the color.
+	// Owned by the DirectX thread : NULL until rendered, released when the string changes or the device is lost.
+	IDirect3DTexture9 *quad;
+	struct _D3D9ObjectText *prevRendered, *nextRendered;
+
+	// Texts measured again, waiting for the DirectX thread to give their extents to the factory
+	bool measured;
+	struct _D3D9ObjectText *nextMeasured;
+
+	// Extents known by the factory, for the culling and the hit tests
+	int w, h;
 
 } 	D3D9ObjectText;
 
+// Completion handle shared by sprites initialized asynchronously.
+// It is signaled once every sprite submitted with it is ready or has failed.
+typedef struct
+{
+	volatile LONG pending;
+	volatile LONG failed;
+	volatile LONG sealed;
+	HANDLE doneEvent;
+
+}	D3D9ObjectSpriteBatch;
+
+struct _D3D9Object;
+
+// Called from the DirectX thread when the DirectX objects of a sprite have been initialized
+typedef void (*D3D9ObjectSpriteCallback) (
+	struct _D3D9Object *object,
+	D3D9ObjectSpriteStatus status,
+	void *userData
+);
+
 typedef struct
 {
 	int opacity;
 	char * filePath;
-	ID3DXSprite * sprite;
 	IDirect3DTexture9 * texture;
-	D3D9ObjectSpriteStatus status;
+	D3D9TextureCacheEntry * textureEntry;
+	volatile D3D9ObjectSpriteStatus status;
 	int w, h;
 
+	D3D9ObjectSpriteBatch *batch;
+	D3D9ObjectSpriteCallback callback;
+	void *userData;
+
+	// Referenced by the image loader until the DirectX thread uploads it
+	volatile bool loading;
+	// Sprites uploaded, waiting for the DirectX thread to give them to the factory
+	bool uploaded;
+	struct _D3D9Object *nextUploaded;
+
 } 	D3D9ObjectSprite;
 
-typedef struct
+typedef struct _D3D9Object
 {
 	int id;
 	D3D9ObjectType type;
@@ -73,10 +145,58 @@ typedef struct
 		D3D9ObjectSprite sprite;
 	};
 
-	HANDLE mutex;
+	D3D9Lock *lock;
+
+	// Objects deleted, waiting for the DirectX thread to release the last snapshot drawing them
+	struct _D3D9Object *nextRetired;
 
 }	D3D9Object;
 
+// Snapshot of the draw list, built by the writer that changed it and published at the end of its critical section.
+// The frame thread reads it without locking between D3D9ObjectFactory_acquire_draw_list and
+// D3D9ObjectFactory_release_draw_list.
+typedef struct
+{
+	D3D9Snapshot snapshot;
+	int count;
+	D3D9Object **objects;
+
+	// Hot fields of the objects in draw order, so the frame loop and the hit tests stream through contiguous arrays.
+	// They are copied by the writer when it publishes the snapshot. A change that keeps the draw order, like a move,
+	// is written in place in the snapshot published : the row version is odd meanwhile, and the frame copies the row again
+	// if it changed while copied. The sequence of the snapshot protects the bulk reads of the culling the same way.
+	IDirect3DTexture9 **textures;
+	D3D9ObjectType *types;
+	int *x, *y;
+	int *w, *h;
+	D3DCOLOR *colors;
+	D3D9SeqLock *versions;
+	D3D9SeqLock sequence;
+
+}	D3D9ObjectDrawList;
+
+// Counters of the last frame drawn by D3D9ObjectFactory_draw
+typedef struct
+{
+	int objects;
+	// Begin / End pairs of the shared sprite
+	int spriteBatches;
+	// Texture switches inside the sprite batches, each of them flushes the batch
+	int textureChanges;
+	// Rectangles DrawPrimitive, DrawText and sprite Draw calls
+	int drawCalls;
+	// Texts drawn with their cached layout, or measured again because their string changed
+	int textLayoutHits;
+	int textLayoutMisses;
+	// Texts rendered into their quad, the only DrawText calls of a frame unless a quad cannot be created
+	int textRenders;
+	// Objects skipped because they are outside the viewport
+	int culled;
+	// 1 if texts measured or sprites uploaded are still waiting for the factory, because a writer held it
+	int publishDeferred;
+
+}	D3D9ObjectDrawStats;
+
 
 // ----------- Functions ------------
 
@@ -144,11 +264,90 @@ D3D9ObjectFactory_hide_all (
 );
 
 /*
- * Description : Return a pointer to the objects list
- * Return      : BbQueue * A list of D3D9Objects pointer
+ * Description      : Copy the objects of the draw list, the top level one last, at the end of a list of the caller.
+ *                    The factory isn't modified : several threads can copy it at once.
+ *                    /!\ The factory MUST BE LOCKED while the objects are used.
+ * BbQueue *objects : A list receiving the D3D9Objects pointers
+ * Return           : int the number of objects copied
  */
-BbQueue *
+int
 D3D9ObjectFactory_get_objects (
+	BbQueue *objects
+);
+
+/*
+ * Description      : Get the object drawn right above another one, without copying nor modifying the draw list.
+ *                    /!\ The factory MUST BE LOCKED, at least in shared mode, during the whole iteration.
+ * D3D9Object *this : An object of the draw list, or NULL to get the object drawn first
+ * Return           : D3D9Object * the next object drawn, or NULL at the end of the draw list
+ */
+D3D9Object *
+D3D9ObjectFactory_get_next_object (
+	D3D9Object *this
+);
+
+/*
+ * Description : Get the last snapshot of the draw list published by the writers, without waiting for them.
+ *               The texts measured and the sprites uploaded by the DirectX thread are given to the factory first, if no writer holds it.
+ *               The snapshot and its objects stay valid until D3D9ObjectFactory_release_draw_list is called.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : D3D9ObjectDrawList * The current draw list snapshot
+ */
+D3D9ObjectDrawList *
+D3D9ObjectFactory_acquire_draw_list (
+	void
+);
+
+/*
+ * Description : Notify the factory that the draw list snapshot acquired isn't used anymore.
+ *               The objects deleted before the last publication are freed : no snapshot acquired from now on references them.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_release_draw_list (
+	void
+);
+
+/*
+ * Description : Draw the published draw list. Consecutive sprites are drawn in one batch of the shared sprite,
+ *               sorted by texture. The order between the sprites and the other objects is kept.
+ *               /!\ This function must be called only from the DirectX thread.
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_draw (
+	IDirect3DDevice9 * pDevice
+);
+
+/*
+ * Description                : Get the counters of the last frame drawn by D3D9ObjectFactory_draw
+ * D3D9ObjectDrawStats *stats : Output of the counters
+ * Return                     : void
+ */
+void
+D3D9ObjectFactory_get_draw_stats (
+	D3D9ObjectDrawStats *stats
+);
+
+/*
+ * Description : Release the video memory of the shared sprite, the fonts and the text quads before the device is reset.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_on_lost_device (
+	void
+);
+
+/*
+ * Description : Restore the shared sprite and the fonts after the device has been reset.
+ *               /!\ This function must be called only from the DirectX thread.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_on_reset_device (
 	void
 );
 
@@ -181,7 +380,8 @@ D3D9ObjectFactory_delete (
 );
 
 /*
- * Description : Lock the mutex shared with all the d3d9objects
+ * Description : Lock exclusively the lock shared with all the d3d9objects, before modifying them.
+ *               The lock is recursive : the thread holding it can lock it again, and the snapshot is published by the last release.
  * Return      : void
  */
 void
@@ -190,7 +390,8 @@ D3D9ObjectFactory_lock (
 );
 
 /*
- * Description : Release the mutex shared with all the d3d9objects
+ * Description : Release the exclusive lock shared with all the d3d9objects, once as many times as it has been locked.
+ *               If the draw list changed, its new snapshot is published for the DirectX thread first.
  * Return      : void
  */
 void
@@ -199,7 +400,48 @@ D3D9ObjectFactory_release (
 );
 
 /*
- * Description                 : Initialize D3D9ObjectSprite DirectX objects.
+ * Description : Lock in shared mode the lock shared with all the d3d9objects, before reading or drawing them.
+ *               Inside the exclusive lock, the thread locks it again exclusively.
+ *               /!\ The shared lock isn't recursive, and cannot be upgraded to the exclusive lock.
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_lock_shared (
+	void
+);
+
+/*
+ * Description : Release the shared lock shared with all the d3d9objects
+ * Return      : void
+ */
+void
+D3D9ObjectFactory_release_shared (
+	void
+);
+
+/*
+ * Description  : Enable or disable the measure of the time the factory lock is held exclusively
+ * bool enabled : true to measure the hold time, it costs two clock reads per exclusive lock
+ * Return       : void
+ */
+void
+D3D9ObjectFactory_set_lock_hold_timing (
+	bool enabled
+);
+
+/*
+ * Description          : Get the contention counters of the factory lock
+ * D3D9LockStats *stats : Output of the counters, times in microseconds
+ * Return               : void
+ */
+void
+D3D9ObjectFactory_get_lock_stats (
+	D3D9LockStats *stats
+);
+
+/*
+ * Description                 : Initialize D3D9ObjectSprite DirectX objects from the images decoded by the worker threads,
+ *                               within the upload budget of the frame. At least one image is uploaded per frame.
  *                               /!\ This function must be called only from the DirectX thread.
  * IDirect3DDevice9 * pDevice  : An allocated IDirect3DDevice9
  * Return                      : void
@@ -209,6 +451,73 @@ D3D9ObjectSprite_init_directx (
 	IDirect3DDevice9 * pDevice
 );
 
+/*
+ * Description       : Set the maximum time spent by D3D9ObjectSprite_init_directx on uploading textures in a frame.
+ *                     At least one texture is uploaded per frame.
+ * int microseconds  : Upload budget of a frame in microseconds
+ * Return            : void
+ */
+void
+D3D9ObjectSprite_set_upload_budget (
+	int microseconds
+);
+
+/*
+ * Description                  : Get the hit / miss / eviction counters of the sprite texture cache
+ * D3D9TextureCacheStats *stats : Output of the counters
+ * Return                       : void
+ */
+void
+D3D9ObjectFactory_get_texture_cache_stats (
+	D3D9TextureCacheStats *stats
+);
+
+/*
+ * Description  : Set the maximum bytes of texture memory kept by the sprite texture cache
+ * DWORD budget : The budget in bytes. Only textures not used by any sprite are evicted.
+ * Return       : void
+ */
+void
+D3D9ObjectFactory_set_texture_cache_budget (
+	DWORD budget
+);
+
+/*
+ * Description                : Create a font shared by the texts, and keep it even when no text uses it
+ * IDirect3DDevice9 * pDevice : An allocated IDirect3DDevice9
+ * char *fontFamily           : The name of the family font. If NULL, "Arial" is used.
+ * int fontSize               : the size of the font
+ * int fontWeight             : the weight of the font, FW_NORMAL, FW_BOLD...
+ * Return                     : bool true on success, false otherwise
+ */
+bool
+D3D9ObjectFactory_preload_font (
+	IDirect3DDevice9 * pDevice,
+	char *fontFamily,
+	int fontSize,
+	int fontWeight
+);
+
+/*
+ * Description               : Get the counters of the fonts shared by the texts
+ * D3D9FontCacheStats *stats : Output of the counters
+ * Return                    : void
+ */
+void
+D3D9ObjectFactory_get_font_cache_stats (
+	D3D9FontCacheStats *stats
+);
+
+/*
+ * Description                : Get the allocation counters of the pool of D3D9Objects
+ * D3D9ObjectPoolStats *stats : Output of the counters
+ * Return                     : void
+ */
+void
+D3D9ObjectFactory_get_pool_stats (
+	D3D9ObjectPoolStats *stats
+);
+
 /*
  * Description : Get the top level object that is hovered. If no object is hovered, return NULL
  * HWND hWindow : The window containing the directX context
@@ -219,10 +528,39 @@ D3D9ObjectFactory_get_hovered_object (
 	HWND hWindow
 );
 
+/*
+ * Description : Get the objects of the draw list at a given position, the top level object first.
+ * int x, int y : The position to test
+ * D3D9Object **objects : Output of the objects found
+ * int capacity : Maximum number of objects written
+ * Return : int the number of objects at this position, it can be greater than capacity
+ */
+int
+D3D9ObjectFactory_get_objects_at (
+	int x, int y,
+	D3D9Object **objects,
+	int capacity
+);
+
+/*
+ * Description : Get the objects of the draw list intersecting a rectangle, the top level object first.
+ * int x, int y, int w, int h : The rectangle to test
+ * D3D9Object **objects : Output of the objects found
+ * int capacity : Maximum number of objects written
+ * Return : int the number of objects intersecting the rectangle, it can be greater than capacity
+ */
+int
+D3D9ObjectFactory_get_objects_in_rect (
+	int x, int y, int w, int h,
+	D3D9Object **objects,
+	int capacity
+);
+
 /// ===== D3D9Object =====
 
 /*
- * Description : Move an allocated D3D9Object on the screen
+ * Description : Move an allocated D3D9Object on the screen. The DirectX thread draws it at its new place from its next frame.
+ *               Its row is written in place in the snapshot published, without building a new one.
  * D3D9Object *this : An allocated D3D9Object
  # int x, int y : The new position on the screen
  * Return : void
@@ -262,6 +600,18 @@ D3D9ObjectRect_set (
 	int w, int h
 );
 
+/*
+ * Description : Set the opacity of a D3D9ObjectRect
+ * D3D9ObjectRect *this : An allocated D3D9ObjectRect
+ * float opacity : opacity of the rectangle, between 0.0 and 1.0
+ * Return : void
+ */
+void
+D3D9ObjectRect_set_opacity (
+	D3D9ObjectRect *this,
+	float opacity
+);
+
 
 /*
  * Description                 : Initialize an allocated D3D9ObjectText object.
@@ -321,6 +671,40 @@ D3D9ObjectSprite_init (
 	float opacity
 );
 
+/*
+ * Description                        : Initialize an allocated D3D9ObjectSprite object without waiting for the DirectX thread.
+ * D3D9Object * this                  : An allocated D3D9Object
+ * IDirect3DDevice9 * pDevice         : An allocated IDirect3DDevice9
+ * char * filePath                    : Absolute or relative path of the image (.bmp, .dds, .dib, .hdr, .jpg, .pfm, .png, .ppm, and .tga)
+ * int x, y                           : {x, y} position of the sprite
+ * float opacity                      : opacity of the image, value between 0.0 and 1.0
+ * D3D9ObjectSpriteBatch *batch       : Completion handle signaled when the sprite is ready, or NULL
+ * D3D9ObjectSpriteCallback callback  : Function called from the DirectX thread when the sprite is ready, or NULL
+ * void *userData                     : Data given to the callback
+ * Return                             : bool True if the sprite has been submitted, false otherwise
+ */
+bool
+D3D9ObjectSprite_init_async (
+	D3D9Object * this,
+	IDirect3DDevice9 * pDevice,
+	char *filePath,
+	int x, int y,
+	float opacity,
+	D3D9ObjectSpriteBatch *batch,
+	D3D9ObjectSpriteCallback callback,
+	void *userData
+);
+
+/*
+ * Description            : Get the initialization status of a sprite
+ * D3D9ObjectSprite *this : An allocated D3D9ObjectSprite
+ * Return                 : D3D9ObjectSpriteStatus the current status
+ */
+D3D9ObjectSpriteStatus
+D3D9ObjectSprite_get_status (
+	D3D9ObjectSprite *this
+);
+
 /*
  * Description : Set new attribute to D3D9ObjectSprite
  * D3D9ObjectText *this : An allocated D3D9ObjectSprite
@@ -333,11 +717,59 @@ D3D9ObjectSprite_set (
 	float opacity
 );
 
+/// ===== D3D9ObjectSpriteBatch =====
+
+/*
+ * Description : Allocate a new completion handle for sprites initialized asynchronously
+ * Return      : D3D9ObjectSpriteBatch * an allocated D3D9ObjectSpriteBatch, or NULL
+ */
+D3D9ObjectSpriteBatch *
+D3D9ObjectSpriteBatch_new (
+	void
+);
+
+/*
+ * Description                 : Initialize an allocated D3D9ObjectSpriteBatch
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * Return                      : bool true on success, false otherwise
+ */
+bool
+D3D9ObjectSpriteBatch_init (
+	D3D9ObjectSpriteBatch *this
+);
+
+/*
+ * Description                 : Wait once for all the sprites submitted with the batch.
+ *                               No sprite can be submitted with the batch after this call.
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * DWORD timeout               : Maximum time to wait in milliseconds, or INFINITE
+ * Return                      : D3D9_OBJECT_SPRITE_READY if all the sprites are ready,
+ *                               D3D9_OBJECT_SPRITE_ERROR if at least one failed,
+ *                               D3D9_OBJECT_SPRITE_NOT_READY if the timeout expired
+ */
+D3D9ObjectSpriteStatus
+D3D9ObjectSpriteBatch_wait (
+	D3D9ObjectSpriteBatch *this,
+	DWORD timeout
+);
+
+/*
+ * Description                 : Free an allocated D3D9ObjectSpriteBatch.
+ *                               /!\ The batch must have been waited with success before.
+ * D3D9ObjectSpriteBatch *this : An allocated D3D9ObjectSpriteBatch
+ * Return                      : void
+ */
+void
+D3D9ObjectSpriteBatch_free (
+	D3D9ObjectSpriteBatch *this
+);
+
 /// ===== Drawing utilities =====
 
 
 /*
- * Description                 : Draw a rectangle at a given position / color on the screen
+ * Description                 : Draw a rectangle at a given position / color on the screen, alone in its DrawPrimitive call.
+ *                               D3D9ObjectFactory_draw batches the rectangles of the draw list instead.
  * D3D9ObjectRect *rect        : An allocated D3D9ObjectRect
  * int x, y                    : {x, y} position of the rectangle
  * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
@@ -350,7 +782,9 @@ D3D9ObjectRect_draw (
 );
 
 /*
- * Description                 : Draw text at a given position / color on the screen
+ * Description                 : Draw text at a given position / color on the screen. The layout is rendered into a quad
+ *                               once, then the quad is drawn with the shared sprite until the string changes.
+ *                               /!\ This function must be called only from the DirectX thread.
  * D3D9ObjectText *text        : An allocated D3D9ObjectText
  * int x, y                    : {x, y} position of the text
  * IDirect3DDevice9 * pDevice  : An allocated d3d9 device
@@ -363,7 +797,8 @@ D3D9ObjectText_draw (
 );
 
 /*
- * Description                    : Draw a sprite at a given position on the screen
+ * Description                    : Draw a sprite at a given position on the screen, in its own batch of the shared sprite.
+ *                                  D3D9ObjectFactory_draw batches the sprites of the draw list instead.
  * D3D9ObjectSprite *spriteObject : An allocated D3D9ObjectSprite.
  * int x, y                       : {x, y} position of the text
  * Return                         : void
@@ -379,7 +814,8 @@ D3D9ObjectSprite_draw (
 
 
 /*
- * Description : Free an allocated D3D9Object
+ * Description : Free an allocated D3D9Object. Its memory is released once the DirectX thread has released the last snapshot drawing it.
+ *               /!\ The factory MUST BE LOCKED when calling this function.
  * D3D9Object *this : An allocated D3D9Object
  * Return : void
  */
@@ -0,0 +1,419 @@
+#include "D3D9ObjectPool.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Free blocks kept by a thread for one pool, used without locking
+typedef struct
+{
+	int poolId;
+	D3D9ObjectPoolBlock *blocks;
+	int count;
+
+}	D3D9ObjectPoolThreadCache;
+
+static __thread D3D9ObjectPoolThreadCache threadCache = {
+	.poolId = 0,
+	.blocks = NULL,
+	.count  = 0
+};
+
+// Identifier given to the next pool initialized
+static volatile int nextPoolId = 1;
+
+// Pools alive, linked through nextPool
+static D3D9ObjectPool *livePools = NULL;
+static D3D9Lock livePoolsLock = D3D9_LOCK_INITIALIZER;
+
+// Private headers
+/*
+ * Description : Get the cache of the calling thread, and give it to the pool if it belongs to another one
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : D3D9ObjectPoolThreadCache * the cache of the thread, for this pool
+ */
+static D3D9ObjectPoolThreadCache * D3D9ObjectPool_get_thread_cache (D3D9ObjectPool *this);
+
+/*
+ * Description : Give the blocks of the cache of the calling thread back to their pool, or drop them if it has been freed
+ * Return : void
+ */
+static void D3D9ObjectPool_drain_thread_cache (void);
+
+/*
+ * Description : Allocate a new slab and add its blocks to the free list
+ *               /!\ The pool MUST BE LOCKED when calling this function.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : bool true on success, false otherwise
+ */
+static bool D3D9ObjectPool_grow (D3D9ObjectPool *this);
+
+/*
+ * Description : Allocate memory aligned on a cache line
+ * size_t size : Size of the memory
+ * Return : void * the aligned memory, or NULL on error
+ */
+static void * D3D9ObjectPool_aligned_alloc (size_t size);
+
+/*
+ * Description : Free memory allocated by D3D9ObjectPool_aligned_alloc
+ * void *memory : The aligned memory
+ * Return : void
+ */
+static void D3D9ObjectPool_aligned_free (void *memory);
+
+
+/*
+ * Description : Allocate a new D3D9ObjectPool structure.
+ * int blockSize : Size of the blocks, rounded up to a cache line
+ * int slabCount : Number of blocks allocated at once
+ * Return : A pointer to an allocated D3D9ObjectPool.
+ */
+D3D9ObjectPool *
+D3D9ObjectPool_new (
+	int blockSize,
+	int slabCount
+) {
+	D3D9ObjectPool *this;
+
+	if ((this = calloc (1, sizeof(D3D9ObjectPool))) == NULL)
+		return NULL;
+
+	if (!D3D9ObjectPool_init (this, blockSize, slabCount)) {
+		D3D9ObjectPool_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9ObjectPool structure.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool to initialize.
+ * int blockSize : Size of the blocks, rounded up to a cache line
+ * int slabCount : Number of blocks allocated at once
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9ObjectPool_init (
+	D3D9ObjectPool *this,
+	int blockSize,
+	int slabCount
+) {
+	if (blockSize < (int) sizeof(D3D9ObjectPoolBlock)) {
+		blockSize = sizeof(D3D9ObjectPoolBlock);
+	}
+
+	// Blocks never share a cache line
+	this->id        = __sync_fetch_and_add (&nextPoolId, 1);
+	this->blockSize = (blockSize + D3D9_OBJECT_POOL_CACHE_LINE - 1) & ~(D3D9_OBJECT_POOL_CACHE_LINE - 1);
+	this->slabCount = slabCount;
+	this->slabs     = NULL;
+	this->freeList  = NULL;
+	memset (&this->stats, 0, sizeof(this->stats));
+
+	if (!D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT)) {
+		return false;
+	}
+
+	D3D9Lock_acquire_exclusive (&livePoolsLock);
+	this->nextPool = livePools;
+	livePools = this;
+	D3D9Lock_release_exclusive (&livePoolsLock);
+
+	return true;
+}
+
+/*
+ * Description : Give the blocks of the cache of the calling thread back to their pool, or drop them if it has been freed
+ * Return : void
+ */
+static void
+D3D9ObjectPool_drain_thread_cache (
+	void
+) {
+	D3D9ObjectPoolBlock *last = threadCache.blocks;
+
+	while (last && last->next) {
+		last = last->next;
+	}
+
+	// The pool can't be freed while it's found in the list
+	D3D9Lock_acquire_shared (&livePoolsLock);
+
+	for (D3D9ObjectPool *pool = livePools; pool != NULL && last != NULL; pool = pool->nextPool)
+	{
+		if (pool->id == threadCache.poolId) {
+			D3D9Lock_acquire_exclusive (&pool->lock);
+			last->next = pool->freeList;
+			pool->freeList = threadCache.blocks;
+			D3D9Lock_release_exclusive (&pool->lock);
+			break;
+		}
+	}
+
+	D3D9Lock_release_shared (&livePoolsLock);
+
+	threadCache.blocks = NULL;
+	threadCache.count  = 0;
+}
+
+/*
+ * Description : Get the cache of the calling thread, and give it to the pool if it belongs to another one
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : D3D9ObjectPoolThreadCache * the cache of the thread, for this pool
+ */
+static D3D9ObjectPoolThreadCache *
+D3D9ObjectPool_get_thread_cache (
+	D3D9ObjectPool *this
+) {
+	if (threadCache.poolId != this->id)
+	{
+		if (threadCache.count != 0) {
+			D3D9ObjectPool_drain_thread_cache ();
+		}
+
+		threadCache.poolId = this->id;
+		threadCache.blocks = NULL;
+	}
+
+	return &threadCache;
+}
+
+/*
+ * Description : Allocate a zeroed block
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : void * a cache line aligned block, or NULL on error
+ */
+void *
+D3D9ObjectPool_alloc (
+	D3D9ObjectPool *this
+) {
+	D3D9ObjectPoolThreadCache *cache = D3D9ObjectPool_get_thread_cache (this);
+	D3D9ObjectPoolBlock *block;
+
+	if (cache->count > 0)
+	{
+		block = cache->blocks;
+		cache->blocks = block->next;
+		cache->count--;
+		__sync_fetch_and_add (&this->stats.threadCacheHits, 1);
+	}
+	else
+	{
+		D3D9Lock_acquire_exclusive (&this->lock);
+
+		if (!this->freeList && !D3D9ObjectPool_grow (this)) {
+			D3D9Lock_release_exclusive (&this->lock);
+			return NULL;
+		}
+
+		block = this->freeList;
+		this->freeList = block->next;
+
+		D3D9Lock_release_exclusive (&this->lock);
+	}
+
+	__sync_fetch_and_add (&this->stats.allocations, 1);
+	memset (block, 0, this->blockSize);
+
+	return block;
+}
+
+/*
+ * Description : Give a block back to the pool
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * void *block : A block allocated by this pool
+ * Return : void
+ */
+void
+D3D9ObjectPool_release (
+	D3D9ObjectPool *this,
+	void *block
+) {
+	D3D9ObjectPoolThreadCache *cache = D3D9ObjectPool_get_thread_cache (this);
+	D3D9ObjectPoolBlock *freeBlock = block;
+
+	if (block == NULL) {
+		return;
+	}
+
+	__sync_fetch_and_add (&this->stats.frees, 1);
+
+	if (cache->count < D3D9_OBJECT_POOL_THREAD_CACHE_SIZE) {
+		freeBlock->next = cache->blocks;
+		cache->blocks = freeBlock;
+		cache->count++;
+		return;
+	}
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	freeBlock->next = this->freeList;
+	this->freeList = freeBlock;
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Give many blocks back to the pool at once, locking it only once
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * void **blocks : Blocks allocated by this pool
+ * int count : Number of blocks
+ * Return : void
+ */
+void
+D3D9ObjectPool_release_bulk (
+	D3D9ObjectPool *this,
+	void **blocks,
+	int count
+) {
+	D3D9ObjectPoolBlock *first = NULL;
+	D3D9ObjectPoolBlock *last = NULL;
+	int linked = 0;
+
+	// Link the blocks together before locking the pool
+	for (int index = 0; index < count; index++) {
+		D3D9ObjectPoolBlock *block = blocks [index];
+
+		if (block == NULL) {
+			continue;
+		}
+
+		block->next = first;
+		first = block;
+		last = (last) ? last : block;
+		linked++;
+	}
+
+	if (!first) {
+		return;
+	}
+
+	__sync_fetch_and_add (&this->stats.frees, linked);
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	last->next = this->freeList;
+	this->freeList = first;
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Allocate a new slab and add its blocks to the free list
+ *               /!\ The pool MUST BE LOCKED when calling this function.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : bool true on success, false otherwise
+ */
+static bool
+D3D9ObjectPool_grow (
+	D3D9ObjectPool *this
+) {
+	D3D9ObjectPoolSlab *slab;
+	char *blocks;
+
+	// The header takes a whole cache line, so the blocks stay aligned
+	if ((slab = D3D9ObjectPool_aligned_alloc (D3D9_OBJECT_POOL_CACHE_LINE + (size_t) this->blockSize * this->slabCount)) == NULL) {
+		return false;
+	}
+
+	slab->next = this->slabs;
+	this->slabs = slab;
+	this->stats.slabs++;
+	blocks = (char *) slab + D3D9_OBJECT_POOL_CACHE_LINE;
+
+	// Chain the blocks in address order, so consecutive allocations are contiguous
+	for (int index = this->slabCount - 1; index >= 0; index--) {
+		D3D9ObjectPoolBlock *block = (D3D9ObjectPoolBlock *) (blocks + (size_t) index * this->blockSize);
+		block->next = this->freeList;
+		this->freeList = block;
+	}
+
+	return true;
+}
+
+/*
+ * Description : Get the allocation counters of the pool
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * D3D9ObjectPoolStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9ObjectPool_get_stats (
+	D3D9ObjectPool *this,
+	D3D9ObjectPoolStats *stats
+) {
+	D3D9Lock_acquire_shared (&this->lock);
+	*stats = this->stats;
+	D3D9Lock_release_shared (&this->lock);
+}
+
+/*
+ * Description : Allocate memory aligned on a cache line
+ * size_t size : Size of the memory
+ * Return : void * the aligned memory, or NULL on error
+ */
+static void *
+D3D9ObjectPool_aligned_alloc (
+	size_t size
+) {
+	#ifdef _WIN32
+	return _aligned_malloc (size, D3D9_OBJECT_POOL_CACHE_LINE);
+	#else
+	void *memory;
+	return (posix_memalign (&memory, D3D9_OBJECT_POOL_CACHE_LINE, size) == 0) ? memory : NULL;
+	#endif
+}
+
+/*
+ * Description : Free memory allocated by D3D9ObjectPool_aligned_alloc
+ * void *memory : The aligned memory
+ * Return : void
+ */
+static void
+D3D9ObjectPool_aligned_free (
+	void *memory
+) {
+	#ifdef _WIN32
+	_aligned_free (memory);
+	#else
+	free (memory);
+	#endif
+}
+
+/*
+ * Description : Free an allocated D3D9ObjectPool structure and all its slabs.
+ *               /!\ The blocks allocated by the pool become invalid.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool to free.
+ */
+void
+D3D9ObjectPool_free (
+	D3D9ObjectPool *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	// The caches of the other threads drop their blocks once the pool isn't found anymore
+	D3D9Lock_acquire_exclusive (&livePoolsLock);
+	for (D3D9ObjectPool **link = &livePools; *link != NULL; link = &(*link)->nextPool) {
+		if (*link == this) {
+			*link = this->nextPool;
+			break;
+		}
+	}
+	D3D9Lock_release_exclusive (&livePoolsLock);
+
+	// The cache of the calling thread points into the slabs
+	if (threadCache.poolId == this->id) {
+		threadCache.blocks = NULL;
+		threadCache.count  = 0;
+	}
+
+	while (this->slabs) {
+		D3D9ObjectPoolSlab *next = this->slabs->next;
+		D3D9ObjectPool_aligned_free (this->slabs);
+		this->slabs = next;
+	}
+
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
@@ -0,0 +1,148 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include "D3D9Lock.h"
+
+// ---------- Defines -------------
+#define D3D9_OBJECT_POOL_CACHE_LINE         64
+// Default number of blocks allocated at once
+#define D3D9_OBJECT_POOL_DEFAULT_SLAB_COUNT 256
+// Maximum number of free blocks kept by a thread without locking the pool
+#define D3D9_OBJECT_POOL_THREAD_CACHE_SIZE  32
+
+// ------ Structure declaration -------
+typedef struct _D3D9ObjectPoolBlock
+{
+	struct _D3D9ObjectPoolBlock *next;
+
+}	D3D9ObjectPoolBlock;
+
+// Header of a slab, in the cache line preceding its blocks
+typedef struct _D3D9ObjectPoolSlab
+{
+	struct _D3D9ObjectPoolSlab *next;
+
+}	D3D9ObjectPoolSlab;
+
+typedef struct
+{
+	int slabs;
+	int allocations;
+	int frees;
+	// Allocations served by the cache of the thread, without locking the pool
+	int threadCacheHits;
+
+}	D3D9ObjectPoolStats;
+
+// Fixed size block allocator. Blocks are cut in cache line aligned slabs, so the blocks allocated
+// together are contiguous in memory. Free blocks are kept in a free list and never given back to the system
+// before the pool is freed. The free blocks kept by a thread for a pool go back to that pool when the thread
+// allocates from another one, or are dropped if the pool has been freed meanwhile.
+typedef struct _D3D9ObjectPool
+{
+	// Identifier of the pool, so the thread caches of a freed pool are never used by another one
+	int id;
+	// Next pool alive, so the thread caches can find the pool of their blocks
+	struct _D3D9ObjectPool *nextPool;
+
+	int blockSize;
+	int slabCount;
+	D3D9ObjectPoolSlab *slabs;
+
+	D3D9ObjectPoolBlock *freeList;
+	D3D9ObjectPoolStats stats;
+	D3D9Lock lock;
+
+}	D3D9ObjectPool;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9ObjectPool structure.
+ * int blockSize : Size of the blocks, rounded up to a cache line
+ * int slabCount : Number of blocks allocated at once
+ * Return : A pointer to an allocated D3D9ObjectPool.
+ */
+D3D9ObjectPool *
+D3D9ObjectPool_new (
+	int blockSize,
+	int slabCount
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9ObjectPool structure.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool to initialize.
+ * int blockSize : Size of the blocks, rounded up to a cache line
+ * int slabCount : Number of blocks allocated at once
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9ObjectPool_init (
+	D3D9ObjectPool *this,
+	int blockSize,
+	int slabCount
+);
+
+/*
+ * Description : Allocate a zeroed block
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * Return : void * a cache line aligned block, or NULL on error
+ */
+void *
+D3D9ObjectPool_alloc (
+	D3D9ObjectPool *this
+);
+
+/*
+ * Description : Give a block back to the pool
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * void *block : A block allocated by this pool
+ * Return : void
+ */
+void
+D3D9ObjectPool_release (
+	D3D9ObjectPool *this,
+	void *block
+);
+
+/*
+ * Description : Give many blocks back to the pool at once, locking it only once
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * void **blocks : Blocks allocated by this pool
+ * int count : Number of blocks
+ * Return : void
+ */
+void
+D3D9ObjectPool_release_bulk (
+	D3D9ObjectPool *this,
+	void **blocks,
+	int count
+);
+
+/*
+ * Description : Get the allocation counters of the pool
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool
+ * D3D9ObjectPoolStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9ObjectPool_get_stats (
+	D3D9ObjectPool *this,
+	D3D9ObjectPoolStats *stats
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9ObjectPool structure and all its slabs.
+ *               /!\ The blocks allocated by the pool become invalid.
+ * D3D9ObjectPool *this : An allocated D3D9ObjectPool to free.
+ */
+void
+D3D9ObjectPool_free (
+	D3D9ObjectPool *this
+);
@@ -0,0 +1,340 @@
+#include "D3D9ObjectTable.h"
+#include <stdlib.h>
+
+
+/*
+ * Description : Allocate a new D3D9ObjectTable structure.
+ * Return : A pointer to an allocated D3D9ObjectTable.
+ */
+D3D9ObjectTable *
+D3D9ObjectTable_new (
+	void
+) {
+	D3D9ObjectTable *this;
+
+	if ((this = calloc (1, sizeof(D3D9ObjectTable))) == NULL)
+		return NULL;
+
+	D3D9ObjectTable_init (this);
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9ObjectTable structure.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable to initialize.
+ * Return : void
+ */
+void
+D3D9ObjectTable_init (
+	D3D9ObjectTable *this
+) {
+	*this = (D3D9ObjectTable) D3D9_OBJECT_TABLE_INITIALIZER;
+}
+
+/*
+ * Description : Reserve a slot for an object and get its ID
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * void *object : The object, not NULL
+ * Return : int the ID of the object, -1 if the table is full or cannot grow
+ */
+int
+D3D9ObjectTable_register (
+	D3D9ObjectTable *this,
+	void *object
+) {
+	D3D9ObjectTableSlot *slot;
+	int index;
+
+	if (this->freeSlot != -1) {
+		// Reuse a released slot
+		index = this->freeSlot;
+		this->freeSlot = this->slots [index].nextFree;
+	}
+	else {
+		if (this->slotsCount > D3D9_OBJECT_ID_INDEX_MASK) {
+			return -1;
+		}
+
+		// Grow the table
+		if (this->slotsCount == this->slotsCapacity) {
+			int capacity = (this->slotsCapacity) ? this->slotsCapacity * 2 : D3D9_OBJECT_TABLE_DEFAULT_CAPACITY;
+			D3D9ObjectTableSlot *slots;
+
+			if ((slots = realloc (this->slots, sizeof(D3D9ObjectTableSlot) * capacity)) == NULL) {
+				return -1;
+			}
+
+			this->slots = slots;
+			this->slotsCapacity = capacity;
+		}
+
+		index = this->slotsCount++;
+		this->slots [index].generation = 0;
+	}
+
+	slot = &this->slots [index];
+	slot->object   = object;
+	slot->nextFree = -1;
+	slot->listed   = false;
+	slot->drawn    = false;
+	slot->listLink = (D3D9ObjectTableLink) {-1, -1, 0};
+	slot->drawLink = (D3D9ObjectTableLink) {-1, -1, 0};
+	slot->row      = -1;
+
+	return (slot->generation << D3D9_OBJECT_ID_INDEX_BITS) | index;
+}
+
+/*
+ * Description : Remove the object of an ID from the lists and release its slot, so the ID becomes invalid
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * unsigned int id : An ID of the table
+ * Return : bool true if the ID was valid, false otherwise
+ */
+bool
+D3D9ObjectTable_unregister (
+	D3D9ObjectTable *this,
+	unsigned int id
+) {
+	D3D9ObjectTableSlot *slot;
+	int index = D3D9_OBJECT_TABLE_INDEX (id);
+
+	if (!(slot = D3D9ObjectTable_get_slot (this, id))) {
+		return false;
+	}
+
+	if (slot->drawn) {
+		D3D9ObjectTableList_remove (this, &this->drawObjects, index);
+	}
+
+	if (slot->listed) {
+		D3D9ObjectTableList_remove (this, &this->allObjects, index);
+	}
+
+	slot->object     = NULL;
+	slot->listed     = false;
+	slot->drawn      = false;
+	slot->generation = (slot->generation + 1) & D3D9_OBJECT_ID_GENERATION_MASK;
+	slot->nextFree   = this->freeSlot;
+	this->freeSlot   = index;
+
+	return true;
+}
+
+/*
+ * Description : Get the slot of an ID if the ID is still valid
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * unsigned int id : An ID of the table
+ * Return : D3D9ObjectTableSlot * the slot of the ID, or NULL if the ID is stale or unknown
+ */
+D3D9ObjectTableSlot *
+D3D9ObjectTable_get_slot (
+	D3D9ObjectTable *this,
+	unsigned int id
+) {
+	unsigned int index      = id & D3D9_OBJECT_ID_INDEX_MASK;
+	unsigned int generation = id >> D3D9_OBJECT_ID_INDEX_BITS;
+	D3D9ObjectTableSlot *slot;
+
+	if (index >= (unsigned int) this->slotsCount) {
+		return NULL;
+	}
+
+	slot = &this->slots [index];
+
+	if (slot->object == NULL || slot->generation != generation) {
+		return NULL;
+	}
+
+	return slot;
+}
+
+/*
+ * Description : Draw an object, on top of the others if it isn't drawn yet, and list it if it isn't yet
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered slot
+ * Return : bool true if the object wasn't drawn before
+ */
+bool
+D3D9ObjectTable_add (
+	D3D9ObjectTable *this,
+	int index
+) {
+	D3D9ObjectTableSlot *slot = &this->slots [index];
+	bool added = !slot->drawn;
+
+	if (!slot->drawn) {
+		D3D9ObjectTableList_append (this, &this->drawObjects, index);
+		slot->drawn = true;
+	}
+
+	if (!slot->listed) {
+		D3D9ObjectTableList_append (this, &this->allObjects, index);
+		slot->listed = true;
+	}
+
+	return added;
+}
+
+/*
+ * Description : Draw an object on top of the others, and move it last in the list of all the objects
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered and listed slot
+ * Return : bool true if the object wasn't drawn before
+ */
+bool
+D3D9ObjectTable_show (
+	D3D9ObjectTable *this,
+	int index
+) {
+	D3D9ObjectTableSlot *slot = &this->slots [index];
+	bool shown = !slot->drawn;
+
+	// The object shown goes last in the list of all the objects, so it keeps a coherent order
+	// when all the objects are hidden then shown again.
+	D3D9ObjectTableList_remove (this, &this->allObjects, index);
+	D3D9ObjectTableList_append (this, &this->allObjects, index);
+
+	// If already drawn, put it on top
+	if (slot->drawn) {
+		D3D9ObjectTableList_remove (this, &this->drawObjects, index);
+	}
+
+	D3D9ObjectTableList_append (this, &this->drawObjects, index);
+	slot->drawn = true;
+
+	return shown;
+}
+
+/*
+ * Description : Stop drawing an object. It stays in the list of all the objects.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered slot
+ * Return : bool true if the object was drawn before
+ */
+bool
+D3D9ObjectTable_hide (
+	D3D9ObjectTable *this,
+	int index
+) {
+	D3D9ObjectTableSlot *slot = &this->slots [index];
+
+	if (!slot->drawn) {
+		return false;
+	}
+
+	D3D9ObjectTableList_remove (this, &this->drawObjects, index);
+	slot->drawn = false;
+
+	return true;
+}
+
+/*
+ * Description : Get the next object drawn above another one, without modifying the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a drawn slot, or -1 to get the object drawn first
+ * Return : int the index of the next slot drawn, or -1 at the end of the draw list
+ */
+int
+D3D9ObjectTable_get_next_drawn (
+	D3D9ObjectTable *this,
+	int index
+) {
+	if (index == -1) {
+		return this->drawObjects.head;
+	}
+
+	if (!this->slots [index].drawn) {
+		return -1;
+	}
+
+	return this->slots [index].drawLink.next;
+}
+
+/*
+ * Description : Append a slot at the end of a list of the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * D3D9ObjectTableList *list : &this->drawObjects or &this->allObjects
+ * int index : Index of a slot not in the list
+ * Return : void
+ */
+void
+D3D9ObjectTableList_append (
+	D3D9ObjectTable *this,
+	D3D9ObjectTableList *list,
+	int index
+) {
+	D3D9ObjectTableLink *link = D3D9ObjectTable_get_link (this, list, index);
+
+	link->prev  = list->tail;
+	link->next  = -1;
+	link->order = list->nextOrder++;
+
+	if (list->tail != -1) {
+		D3D9ObjectTable_get_link (this, list, list->tail)->next = index;
+	} else {
+		list->head = index;
+	}
+
+	list->tail = index;
+	list->count++;
+}
+
+/*
+ * Description : Remove a slot from a list of the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * D3D9ObjectTableList *list : &this->drawObjects or &this->allObjects
+ * int index : Index of a slot in the list
+ * Return : void
+ */
+void
+D3D9ObjectTableList_remove (
+	D3D9ObjectTable *this,
+	D3D9ObjectTableList *list,
+	int index
+) {
+	D3D9ObjectTableLink *link = D3D9ObjectTable_get_link (this, list, index);
+
+	if (link->prev != -1) {
+		D3D9ObjectTable_get_link (this, list, link->prev)->next = link->next;
+	} else {
+		list->head = link->next;
+	}
+
+	if (link->next != -1) {
+		D3D9ObjectTable_get_link (this, list, link->next)->prev = link->prev;
+	} else {
+		list->tail = link->prev;
+	}
+
+	link->prev = -1;
+	link->next = -1;
+	list->count--;
+}
+
+/*
+ * Description : Release the slots of an initialized D3D9ObjectTable, without freeing the structure.
+ *               The objects aren't freed.
+ * D3D9ObjectTable *this : An initialized D3D9ObjectTable
+ */
+void
+D3D9ObjectTable_destroy (
+	D3D9ObjectTable *this
+) {
+	free (this->slots);
+	D3D9ObjectTable_init (this);
+}
+
+/*
+ * Description : Free an allocated D3D9ObjectTable structure. The objects aren't freed.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable to free.
+ */
+void
+D3D9ObjectTable_free (
+	D3D9ObjectTable *this
+) {
+	if (this != NULL) {
+		D3D9ObjectTable_destroy (this);
+		free (this);
+	}
+}
@@ -0,0 +1,261 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// An object ID packs the index of its slot in the table with the generation of that slot,
+// so an ID of a deleted object is never confused with the object reusing its slot.
+#define D3D9_OBJECT_ID_INDEX_BITS      20
+#define D3D9_OBJECT_ID_INDEX_MASK      ((1 << D3D9_OBJECT_ID_INDEX_BITS) - 1)
+#define D3D9_OBJECT_ID_GENERATION_MASK 0x7FF
+
+// Number of slots allocated the first time the table grows
+#define D3D9_OBJECT_TABLE_DEFAULT_CAPACITY 64
+
+// Get the index of the slot of an ID
+#define D3D9_OBJECT_TABLE_INDEX(id) ((int) ((id) & D3D9_OBJECT_ID_INDEX_MASK))
+
+// Static initializer of an empty table
+#define D3D9_OBJECT_TABLE_INITIALIZER {                                                      \
+	.slots         = NULL,                                                                   \
+	.slotsCount    = 0,                                                                      \
+	.slotsCapacity = 0,                                                                      \
+	.freeSlot      = -1,                                                                     \
+	.drawObjects   = {-1, -1, 0, 0, offsetof (D3D9ObjectTableSlot, drawLink)},               \
+	.allObjects    = {-1, -1, 0, 0, offsetof (D3D9ObjectTableSlot, listLink)}                \
+}
+
+// Iterate over the slot indices of a list of the table. The slot iterated can't be removed from the list meanwhile.
+#define foreach_d3d9object_table_slot(table, list, index) \
+	for (int index = (list)->head; index != -1; index = D3D9ObjectTable_get_link ((table), (list), index)->next)
+
+// ------ Structure declaration -------
+
+// Neighbours of a slot in a list of the table, -1 at the ends.
+// The order grows along the list, so two slots are compared without walking it.
+typedef struct
+{
+	int prev;
+	int next;
+	unsigned long long order;
+
+}	D3D9ObjectTableLink;
+
+// Slot of the object table. An object ID is resolved in constant time by its slot index,
+// and the generation rejects IDs of objects that have been deleted since.
+typedef struct
+{
+	void *object;
+	unsigned int generation;
+	int nextFree;
+	bool listed;
+	bool drawn;
+	D3D9ObjectTableLink listLink;
+	D3D9ObjectTableLink drawLink;
+	// Row of the object in the last snapshot of the draw list built by the owner of the table, -1 if none
+	int row;
+
+}	D3D9ObjectTableSlot;
+
+// Ordered list of slots, linked by the D3D9ObjectTableLink at linkOffset in each slot
+typedef struct
+{
+	int head;
+	int tail;
+	int count;
+	unsigned long long nextOrder;
+	size_t linkOffset;
+
+}	D3D9ObjectTableList;
+
+// Table of the objects of the factory, and its two lists linked through the slots :
+// an object is found, moved on top or removed in constant time, and the lists keep their order.
+// It doesn't depend on DirectX, so it can be used and tested on its own. It isn't thread safe.
+typedef struct
+{
+	D3D9ObjectTableSlot *slots;
+	int slotsCount;
+	int slotsCapacity;
+	int freeSlot;
+
+	// Objects drawn, the top level one last
+	D3D9ObjectTableList drawObjects;
+	// All the objects registered and shown once, in the order they have been shown
+	D3D9ObjectTableList allObjects;
+
+}	D3D9ObjectTable;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9ObjectTable structure.
+ * Return : A pointer to an allocated D3D9ObjectTable.
+ */
+D3D9ObjectTable *
+D3D9ObjectTable_new (
+	void
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9ObjectTable structure.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable to initialize.
+ * Return : void
+ */
+void
+D3D9ObjectTable_init (
+	D3D9ObjectTable *this
+);
+
+/*
+ * Description : Reserve a slot for an object and get its ID
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * void *object : The object, not NULL
+ * Return : int the ID of the object, -1 if the table is full or cannot grow
+ */
+int
+D3D9ObjectTable_register (
+	D3D9ObjectTable *this,
+	void *object
+);
+
+/*
+ * Description : Remove the object of an ID from the lists and release its slot, so the ID becomes invalid
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * unsigned int id : An ID of the table
+ * Return : bool true if the ID was valid, false otherwise
+ */
+bool
+D3D9ObjectTable_unregister (
+	D3D9ObjectTable *this,
+	unsigned int id
+);
+
+/*
+ * Description : Get the slot of an ID if the ID is still valid
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * unsigned int id : An ID of the table
+ * Return : D3D9ObjectTableSlot * the slot of the ID, or NULL if the ID is stale or unknown
+ */
+D3D9ObjectTableSlot *
+D3D9ObjectTable_get_slot (
+	D3D9ObjectTable *this,
+	unsigned int id
+);
+
+/*
+ * Description : Get the links of a slot in a list of the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * D3D9ObjectTableList *list : &this->drawObjects or &this->allObjects
+ * int index : Index of a slot
+ * Return : D3D9ObjectTableLink * the neighbours of the slot in the list
+ */
+static inline D3D9ObjectTableLink *
+D3D9ObjectTable_get_link (
+	D3D9ObjectTable *this,
+	D3D9ObjectTableList *list,
+	int index
+) {
+	return (D3D9ObjectTableLink *) ((char *) &this->slots [index] + list->linkOffset);
+}
+
+/*
+ * Description : Draw an object, on top of the others if it isn't drawn yet, and list it if it isn't yet
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered slot
+ * Return : bool true if the object wasn't drawn before
+ */
+bool
+D3D9ObjectTable_add (
+	D3D9ObjectTable *this,
+	int index
+);
+
+/*
+ * Description : Draw an object on top of the others, and move it last in the list of all the objects
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered and listed slot
+ * Return : bool true if the object wasn't drawn before
+ */
+bool
+D3D9ObjectTable_show (
+	D3D9ObjectTable *this,
+	int index
+);
+
+/*
+ * Description : Stop drawing an object. It stays in the list of all the objects.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a registered slot
+ * Return : bool true if the object was drawn before
+ */
+bool
+D3D9ObjectTable_hide (
+	D3D9ObjectTable *this,
+	int index
+);
+
+/*
+ * Description : Get the next object drawn above another one, without modifying the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * int index : Index of a drawn slot, or -1 to get the object drawn first
+ * Return : int the index of the next slot drawn, or -1 at the end of the draw list
+ */
+int
+D3D9ObjectTable_get_next_drawn (
+	D3D9ObjectTable *this,
+	int index
+);
+
+/*
+ * Description : Append a slot at the end of a list of the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * D3D9ObjectTableList *list : &this->drawObjects or &this->allObjects
+ * int index : Index of a slot not in the list
+ * Return : void
+ */
+void
+D3D9ObjectTableList_append (
+	D3D9ObjectTable *this,
+	D3D9ObjectTableList *list,
+	int index
+);
+
+/*
+ * Description : Remove a slot from a list of the table
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable
+ * D3D9ObjectTableList *list : &this->drawObjects or &this->allObjects
+ * int index : Index of a slot in the list
+ * Return : void
+ */
+void
+D3D9ObjectTableList_remove (
+	D3D9ObjectTable *this,
+	D3D9ObjectTableList *list,
+	int index
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Release the slots of an initialized D3D9ObjectTable, without freeing the structure.
+ *               The objects aren't freed.
+ * D3D9ObjectTable *this : An initialized D3D9ObjectTable
+ */
+void
+D3D9ObjectTable_destroy (
+	D3D9ObjectTable *this
+);
+
+/*
+ * Description : Free an allocated D3D9ObjectTable structure. The objects aren't freed.
+ * D3D9ObjectTable *this : An allocated D3D9ObjectTable to free.
+ */
+void
+D3D9ObjectTable_free (
+	D3D9ObjectTable *this
+);
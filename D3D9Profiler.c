@@ -0,0 +1,561 @@
+#include "D3D9Profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Last profiler used by the thread and its counters : a thread finds its shard without searching
+__thread D3D9ProfilerCounters *d3d9ProfilerCounters = NULL;
+__thread long d3d9ProfilerSerial = 0;
+// The first call of a thread is timed
+__thread unsigned int d3d9ProfilerCountdown = 1;
+// State of the generator of the sample periods
+static __thread unsigned int sampleSeed = 0;
+
+// Serial of the last profiler allocated
+static volatile long serials = 0;
+
+// Private headers
+/*
+ * Description : Read the monotonic clock
+ * Return : long long the current time in nanoseconds
+ */
+static long long D3D9Profiler_get_time (void);
+
+/*
+ * Description : Measure the nanoseconds per tick since the profiler started
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : void
+ */
+static void D3D9Profiler_calibrate (D3D9Profiler *this);
+
+/*
+ * Description : Find the counters of the current thread, claiming a shard on its first call
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : D3D9ProfilerCounters * the counters of all the methods, or NULL if no shard is free or they can't be allocated
+ */
+static D3D9ProfilerCounters * D3D9Profiler_find_counters (D3D9Profiler *this);
+
+/*
+ * Description : Get the bucket of the histograms counting a duration
+ * unsigned long long ticks : A duration in ticks
+ * Return : int the index of the bucket
+ */
+static int D3D9Profiler_get_bucket (unsigned long long ticks);
+
+/*
+ * Description : Get the counters of the current thread in a profiler, cached for the next calls
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : D3D9ProfilerCounters * the counters of all the methods, or NULL if the calls of the thread are dropped
+ */
+static D3D9ProfilerCounters * D3D9Profiler_get_counters (D3D9Profiler *this);
+
+
+/*
+ * Description : Allocate a new D3D9Profiler structure.
+ * int count : Number of methods profiled
+ * Return : A pointer to an allocated D3D9Profiler.
+ */
+D3D9Profiler *
+D3D9Profiler_new (
+	int count
+) {
+	D3D9Profiler *this;
+
+	if ((this = calloc (1, sizeof(D3D9Profiler))) == NULL)
+		return NULL;
+
+	if (!D3D9Profiler_init (this, count)) {
+		D3D9Profiler_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9Profiler structure.
+ * D3D9Profiler *this : An allocated D3D9Profiler to initialize.
+ * int count : Number of methods profiled
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Profiler_init (
+	D3D9Profiler *this,
+	int count
+) {
+	this->count   = count;
+	this->serial  = __sync_add_and_fetch (&serials, 1);
+	this->dropped = 0;
+	this->frames  = 0;
+
+	memset (this->shards, 0, sizeof(this->shards));
+	this->shardsCount = 0;
+
+	if (!(this->stats = calloc (count, sizeof(D3D9ProfilerStats)))) {
+		return false;
+	}
+
+	// A first ratio, refined at each frame
+	this->startTicks = D3D9Profiler_get_ticks ();
+	this->startTime  = D3D9Profiler_get_time ();
+	this->nanosecondsPerTick = 1.0;
+
+	#ifdef _WIN32
+	Sleep (1);
+	#else
+	usleep (1000);
+	#endif
+
+	D3D9Profiler_calibrate (this);
+
+	return D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+}
+
+/*
+ * Description : Read the clock timing the calls
+ * Return : unsigned long long the current time in ticks
+ */
+unsigned long long
+D3D9Profiler_get_ticks (
+	void
+) {
+	#if defined(__i386__) || defined(__x86_64__)
+	// Not serializing : a few instructions can overlap the measure, much cheaper than the monotonic clock
+	return __rdtsc ();
+	#else
+	return (unsigned long long) D3D9Profiler_get_time ();
+	#endif
+}
+
+/*
+ * Description : Read the monotonic clock
+ * Return : long long the current time in nanoseconds
+ */
+static long long
+D3D9Profiler_get_time (
+	void
+) {
+	#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter (&counter);
+	QueryPerformanceFrequency (&frequency);
+	return (long long) ((double) counter.QuadPart * 1000000000.0 / (double) frequency.QuadPart);
+	#else
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+	#endif
+}
+
+/*
+ * Description : Measure the nanoseconds per tick since the profiler started
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : void
+ */
+static void
+D3D9Profiler_calibrate (
+	D3D9Profiler *this
+) {
+	unsigned long long ticks = D3D9Profiler_get_ticks () - this->startTicks;
+	long long time = D3D9Profiler_get_time () - this->startTime;
+
+	if (ticks > 0 && time > 0) {
+		this->nanosecondsPerTick = (double) time / (double) ticks;
+	}
+}
+
+/*
+ * Description : Get the bucket of the histograms counting a duration
+ * unsigned long long ticks : A duration in ticks
+ * Return : int the index of the bucket
+ */
+static int
+D3D9Profiler_get_bucket (
+	unsigned long long ticks
+) {
+	if (ticks < D3D9_PROFILER_SUB_BUCKETS) {
+		return (int) ticks;
+	}
+
+	// The highest bit gives the power of two, the bits below it the sub bucket
+	int shift = 63 - __builtin_clzll (ticks) - D3D9_PROFILER_SUB_BUCKETS_BITS;
+
+	return (shift + 1) * D3D9_PROFILER_SUB_BUCKETS + (int) ((ticks >> shift) & (D3D9_PROFILER_SUB_BUCKETS - 1));
+}
+
+/*
+ * Description : Get the shortest duration counted in a bucket of the histograms
+ * int bucket : Index of the bucket
+ * Return : unsigned long long the duration in ticks
+ */
+unsigned long long
+D3D9Profiler_get_bucket_ticks (
+	int bucket
+) {
+	if (bucket < D3D9_PROFILER_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	int shift = bucket / D3D9_PROFILER_SUB_BUCKETS - 1;
+
+	return (unsigned long long) (D3D9_PROFILER_SUB_BUCKETS + bucket % D3D9_PROFILER_SUB_BUCKETS) << shift;
+}
+
+/*
+ * Description : Find the counters of the current thread, claiming a shard on its first call
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : D3D9ProfilerCounters * the counters of all the methods, or NULL if no shard is free or they can't be allocated
+ */
+static D3D9ProfilerCounters *
+D3D9Profiler_find_counters (
+	D3D9Profiler *this
+) {
+	D3D9ProfilerCounters *counters;
+	int index;
+
+	#ifdef _WIN32
+	unsigned long thread = GetCurrentThreadId ();
+	#else
+	unsigned long thread = (unsigned long) pthread_self ();
+	#endif
+
+	// The thread has already recorded in this profiler, then used another one
+	for (index = 0; index < this->shardsCount && index < D3D9_PROFILER_MAX_SHARDS; index++) {
+		if (this->shards [index].owner == thread && this->shards [index].methods) {
+			return this->shards [index].methods;
+		}
+	}
+
+	if ((index = __sync_fetch_and_add (&this->shardsCount, 1)) >= D3D9_PROFILER_MAX_SHARDS) {
+		return NULL;
+	}
+
+	// The last counters aren't part of the stats : D3D9Profiler_measure_overhead records there
+	counters = calloc (this->count + 1, sizeof(D3D9ProfilerCounters));
+
+	this->shards [index].owner = thread;
+	this->shards [index].methods = counters;
+
+	return counters;
+}
+
+/*
+ * Description : Record a call of a method and its duration in the shard of the current thread
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * unsigned long long ticks : Duration of the call, difference of two D3D9Profiler_get_ticks
+ * Return : void
+ */
+void
+D3D9Profiler_record (
+	D3D9Profiler *this,
+	int index,
+	unsigned long long ticks
+) {
+	D3D9ProfilerCounters *counters;
+
+	if (!(counters = D3D9Profiler_get_counters (this))) {
+		__sync_fetch_and_add (&this->dropped, 1);
+		return;
+	}
+
+	counters = &counters [index];
+
+	// Only this thread writes the counters : the stores only need to be whole for D3D9Profiler_aggregate
+	__atomic_store_n (&counters->calls, counters->calls + 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&counters->samples, counters->samples + 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&counters->ticks, counters->ticks + ticks, __ATOMIC_RELAXED);
+	counters->buckets [D3D9Profiler_get_bucket (ticks)]++;
+}
+
+/*
+ * Description : Get the counters of the current thread in a profiler, cached for the next calls
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : D3D9ProfilerCounters * the counters of all the methods, or NULL if the calls of the thread are dropped
+ */
+static D3D9ProfilerCounters *
+D3D9Profiler_get_counters (
+	D3D9Profiler *this
+) {
+	// A thread without counters is cached too : it doesn't claim another shard at each call
+	if (d3d9ProfilerSerial != this->serial) {
+		d3d9ProfilerCounters = D3D9Profiler_find_counters (this);
+		d3d9ProfilerSerial   = this->serial;
+	}
+
+	return d3d9ProfilerCounters;
+}
+
+/*
+ * Description : Start timing a call, called by D3D9Profiler_start when the countdown of the thread expires
+ *               or when the thread uses another profiler. Use D3D9Profiler_start.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : unsigned long long the start of the call in ticks, 0 if the call isn't timed
+ */
+unsigned long long
+D3D9Profiler_start_sample (
+	D3D9Profiler *this
+) {
+	if (!D3D9Profiler_get_counters (this)) {
+		__sync_fetch_and_add (&this->dropped, 1);
+		return 0;
+	}
+
+	// The period is drawn between 1 and twice its average : a method called at a fixed rank in a sequence of calls
+	// isn't always or never timed. The seed only needs to differ between the threads.
+	if (!sampleSeed) {
+		sampleSeed = (unsigned int) (size_t) &sampleSeed | 1;
+	}
+
+	sampleSeed ^= sampleSeed << 13;
+	sampleSeed ^= sampleSeed >> 17;
+	sampleSeed ^= sampleSeed << 5;
+	d3d9ProfilerCountdown = sampleSeed % (2 * D3D9_PROFILER_SAMPLE_PERIOD - 1) + 1;
+
+	// D3D9Profiler_record counts the call once it is timed. A start of 0 would mean a call not timed.
+	return D3D9Profiler_get_ticks () | 1;
+}
+
+/*
+ * Description : Sum the shards of all the threads in the stats, and end the frame. Called once per frame, on Present.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : void
+ */
+void
+D3D9Profiler_aggregate (
+	D3D9Profiler *this
+) {
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	// The shards claimed by the threads beyond D3D9_PROFILER_MAX_SHARDS don't exist
+	int shardsCount = (this->shardsCount < D3D9_PROFILER_MAX_SHARDS) ? this->shardsCount : D3D9_PROFILER_MAX_SHARDS;
+
+	for (int index = 0; index < this->count; index++) {
+		D3D9ProfilerStats *stats = &this->stats [index];
+		unsigned long long calls = 0, samples = 0, ticks = 0;
+
+		for (int shard = 0; shard < shardsCount; shard++) {
+			D3D9ProfilerCounters *counters = this->shards [shard].methods;
+
+			if (counters) {
+				calls   += __atomic_load_n (&counters [index].calls, __ATOMIC_RELAXED);
+				samples += __atomic_load_n (&counters [index].samples, __ATOMIC_RELAXED);
+				ticks   += __atomic_load_n (&counters [index].ticks, __ATOMIC_RELAXED);
+			}
+		}
+
+		unsigned long long frameSamples = samples - stats->samples;
+		unsigned long long frameSampledTicks = ticks - stats->sampledTicks;
+
+		stats->frameCalls = calls - stats->calls;
+
+		// The calls not timed last as long as the calls timed during the frame, or since the start if none was timed
+		if (stats->frameCalls == frameSamples) {
+			stats->frameTicks = frameSampledTicks;
+		} else if (frameSamples) {
+			stats->frameTicks = (unsigned long long) ((double) frameSampledTicks * stats->frameCalls / frameSamples);
+		} else if (samples) {
+			stats->frameTicks = (unsigned long long) ((double) ticks * stats->frameCalls / samples);
+		} else {
+			stats->frameTicks = 0;
+		}
+
+		stats->calls        = calls;
+		stats->ticks       += stats->frameTicks;
+		stats->samples      = samples;
+		stats->sampledTicks = ticks;
+
+		// Most of the methods aren't timed at each frame : their histograms don't change
+		if (!frameSamples) {
+			continue;
+		}
+
+		memset (stats->buckets, 0, sizeof(stats->buckets));
+
+		for (int shard = 0; shard < shardsCount; shard++) {
+			D3D9ProfilerCounters *counters = this->shards [shard].methods;
+
+			if (counters) {
+				for (int bucket = 0; bucket < D3D9_PROFILER_BUCKETS; bucket++) {
+					stats->buckets [bucket] += counters [index].buckets [bucket];
+				}
+			}
+		}
+	}
+
+	this->frames++;
+	D3D9Profiler_calibrate (this);
+
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Get the stats of a method aggregated by the last D3D9Profiler_aggregate
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * D3D9ProfilerStats *stats : Output of the stats
+ * Return : bool true on success, false if the index is invalid
+ */
+bool
+D3D9Profiler_get_stats (
+	D3D9Profiler *this,
+	int index,
+	D3D9ProfilerStats *stats
+) {
+	if (index < 0 || index >= this->count) {
+		return false;
+	}
+
+	D3D9Lock_acquire_shared (&this->lock);
+	*stats = this->stats [index];
+	D3D9Lock_release_shared (&this->lock);
+
+	return true;
+}
+
+/*
+ * Description : Get the methods which took the most time during the last frame
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int *indices : Output of the indices of the methods, the most expensive first
+ * int capacity : Maximum number of indices
+ * Return : int the number of indices written, only the methods called during the last frame
+ */
+int
+D3D9Profiler_get_costliest (
+	D3D9Profiler *this,
+	int *indices,
+	int capacity
+) {
+	int count = 0;
+
+	D3D9Lock_acquire_shared (&this->lock);
+
+	// Insertion in the sorted output : the capacity is a handful of methods
+	for (int index = 0; index < this->count; index++) {
+		unsigned long long ticks = this->stats [index].frameTicks;
+		int position;
+
+		if (!this->stats [index].frameCalls) {
+			continue;
+		}
+
+		for (position = count; position > 0 && this->stats [indices [position - 1]].frameTicks < ticks; position--) {
+			if (position < capacity) {
+				indices [position] = indices [position - 1];
+			}
+		}
+
+		if (position < capacity) {
+			indices [position] = index;
+			count += (count < capacity);
+		}
+	}
+
+	D3D9Lock_release_shared (&this->lock);
+
+	return count;
+}
+
+/*
+ * Description : Get a percentile of the duration of the calls timed of a method since the profiler started
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * double percentile : Between 0 and 100
+ * Return : double the duration in nanoseconds, 0 if the method hasn't been called
+ */
+double
+D3D9Profiler_get_percentile (
+	D3D9Profiler *this,
+	int index,
+	double percentile
+) {
+	unsigned long long rank, seen = 0;
+	double ticks = 0.0;
+
+	if (index < 0 || index >= this->count) {
+		return 0.0;
+	}
+
+	D3D9Lock_acquire_shared (&this->lock);
+
+	// The histograms only count the calls timed
+	D3D9ProfilerStats *stats = &this->stats [index];
+	rank = (unsigned long long) ((double) stats->samples * percentile / 100.0);
+
+	for (int bucket = 0; bucket < D3D9_PROFILER_BUCKETS && stats->samples; bucket++) {
+		if ((seen += stats->buckets [bucket]) > rank || seen == stats->samples) {
+			// Middle of the bucket
+			ticks = (D3D9Profiler_get_bucket_ticks (bucket) + D3D9Profiler_get_bucket_ticks (bucket + 1)) / 2.0;
+			break;
+		}
+	}
+
+	D3D9Lock_release_shared (&this->lock);
+
+	return D3D9Profiler_ticks_to_ns (this, ticks);
+}
+
+/*
+ * Description : Convert a duration in ticks to nanoseconds. The ratio is measured at each D3D9Profiler_aggregate.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * double ticks : A duration in ticks
+ * Return : double the duration in nanoseconds
+ */
+double
+D3D9Profiler_ticks_to_ns (
+	D3D9Profiler *this,
+	double ticks
+) {
+	return ticks * this->nanosecondsPerTick;
+}
+
+/*
+ * Description : Measure what the profiler adds to a call : D3D9Profiler_start and D3D9Profiler_stop,
+ *               the samples included. The calls timed aren't counted in the stats.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : double the time added to each call, in nanoseconds
+ */
+double
+D3D9Profiler_measure_overhead (
+	D3D9Profiler *this
+) {
+	long long start = D3D9Profiler_get_time ();
+
+	for (int call = 0; call < D3D9_PROFILER_OVERHEAD_CALLS; call++) {
+		unsigned long long ticks = D3D9Profiler_start (this, this->count);
+		D3D9Profiler_stop (this, this->count, ticks);
+	}
+
+	return (double) (D3D9Profiler_get_time () - start) / D3D9_PROFILER_OVERHEAD_CALLS;
+}
+
+/*
+ * Description : Free an allocated D3D9Profiler structure.
+ *               /!\ No thread must record a call anymore.
+ * D3D9Profiler *this : An allocated D3D9Profiler to free.
+ */
+void
+D3D9Profiler_free (
+	D3D9Profiler *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	for (int shard = 0; shard < D3D9_PROFILER_MAX_SHARDS; shard++) {
+		free (this->shards [shard].methods);
+	}
+
+	free (this->stats);
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
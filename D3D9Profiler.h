@@ -0,0 +1,296 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include "D3D9Lock.h"
+
+// ---------- Defines -------------
+// Each power of two of a duration is split in 2^bits buckets : a duration is known within 25%
+#define D3D9_PROFILER_SUB_BUCKETS_BITS 2
+#define D3D9_PROFILER_SUB_BUCKETS      (1 << D3D9_PROFILER_SUB_BUCKETS_BITS)
+#define D3D9_PROFILER_BUCKETS          (64 * D3D9_PROFILER_SUB_BUCKETS)
+// Threads recording in a profiler. The calls of the threads beyond are dropped.
+#define D3D9_PROFILER_MAX_SHARDS       64
+// Calls timed by D3D9Profiler_measure_overhead
+#define D3D9_PROFILER_OVERHEAD_CALLS   1000000
+// D3D9Profiler_start times one call out of this period on average, the other ones are only counted
+#define D3D9_PROFILER_SAMPLE_PERIOD    64
+
+// ------ Structure declaration -------
+
+// Calls of a method recorded by a thread : only this thread writes them
+typedef struct
+{
+	volatile unsigned long long calls;
+	// Calls timed, their total duration and their histogram
+	volatile unsigned long long samples;
+	volatile unsigned long long ticks;
+	volatile unsigned int buckets [D3D9_PROFILER_BUCKETS];
+
+}	D3D9ProfilerCounters;
+
+// Counters of all the methods for a thread
+typedef struct
+{
+	// Identifier of the thread
+	volatile unsigned long owner;
+	// Allocated by the thread once it owns the shard, NULL until then
+	D3D9ProfilerCounters * volatile methods;
+
+}	D3D9ProfilerShard;
+
+// Calls of a method recorded by all the threads, aggregated by D3D9Profiler_aggregate
+typedef struct
+{
+	// Since the profiler started. The duration of the calls not timed is estimated from the calls timed.
+	unsigned long long calls;
+	unsigned long long ticks;
+	// During the last frame
+	unsigned long long frameCalls;
+	unsigned long long frameTicks;
+
+	// Calls timed since the profiler started, and their total duration
+	unsigned long long samples;
+	unsigned long long sampledTicks;
+
+	// Number of calls timed by duration : see D3D9Profiler_get_bucket_ticks
+	unsigned long long buckets [D3D9_PROFILER_BUCKETS];
+
+}	D3D9ProfilerStats;
+
+// Call counters and latency histograms of a set of methods, identified by an index.
+// The calls are counted in a shard per thread, without lock nor atomic operation, and aggregated once per frame.
+// The durations are measured with the time stamp counter on x86, with the monotonic clock otherwise.
+// D3D9Profiler_start and D3D9Profiler_stop count every call but only time a sample of them : reading the clock
+// costs more than the rest of the profiler.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	// Number of methods
+	int count;
+	// Unique among the profilers allocated : the threads cache their shard for this serial
+	long serial;
+
+	// Claimed in order by the threads, at their first call recorded
+	D3D9ProfilerShard shards [D3D9_PROFILER_MAX_SHARDS];
+	volatile int shardsCount;
+	// Calls not recorded because all the shards are owned
+	volatile long long dropped;
+
+	// Aggregated stats of each method and number of frames aggregated
+	D3D9ProfilerStats *stats;
+	long long frames;
+
+	// Clocks read when the profiler started, to convert the ticks to nanoseconds
+	unsigned long long startTicks;
+	long long startTime;
+	double nanosecondsPerTick;
+
+	// Protects the aggregated stats
+	D3D9Lock lock;
+
+}	D3D9Profiler;
+
+// Counters of the last profiler used by the current thread, and its serial : the calls not timed are counted inline
+extern __thread D3D9ProfilerCounters *d3d9ProfilerCounters;
+extern __thread long d3d9ProfilerSerial;
+// Calls of the current thread left before the next one timed
+extern __thread unsigned int d3d9ProfilerCountdown;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9Profiler structure.
+ * int count : Number of methods profiled
+ * Return : A pointer to an allocated D3D9Profiler.
+ */
+D3D9Profiler *
+D3D9Profiler_new (
+	int count
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9Profiler structure.
+ * D3D9Profiler *this : An allocated D3D9Profiler to initialize.
+ * int count : Number of methods profiled
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9Profiler_init (
+	D3D9Profiler *this,
+	int count
+);
+
+/*
+ * Description : Read the clock timing the calls
+ * Return : unsigned long long the current time in ticks
+ */
+unsigned long long
+D3D9Profiler_get_ticks (
+	void
+);
+
+/*
+ * Description : Record a call of a method and its duration in the shard of the current thread
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * unsigned long long ticks : Duration of the call, difference of two D3D9Profiler_get_ticks
+ * Return : void
+ */
+void
+D3D9Profiler_record (
+	D3D9Profiler *this,
+	int index,
+	unsigned long long ticks
+);
+
+/*
+ * Description : Start timing a call, called by D3D9Profiler_start when the countdown of the thread expires
+ *               or when the thread uses another profiler. Use D3D9Profiler_start.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : unsigned long long the start of the call in ticks, 0 if the call isn't timed
+ */
+unsigned long long
+D3D9Profiler_start_sample (
+	D3D9Profiler *this
+);
+
+/*
+ * Description : Count a call of a method before calling it. One call out of D3D9_PROFILER_SAMPLE_PERIOD on average
+ *               is timed : the other ones only increment the counter of the thread, without reading the clock.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * Return : unsigned long long the start of the call in ticks, given to D3D9Profiler_stop. 0 if the call isn't timed.
+ */
+static inline unsigned long long
+D3D9Profiler_start (
+	D3D9Profiler *this,
+	int index
+) {
+	D3D9ProfilerCounters *counters = d3d9ProfilerCounters;
+
+	if (__builtin_expect (d3d9ProfilerSerial == this->serial && counters && --d3d9ProfilerCountdown, 1)) {
+		__atomic_store_n (&counters [index].calls, counters [index].calls + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	return D3D9Profiler_start_sample (this);
+}
+
+/*
+ * Description : Record the duration of a call counted by D3D9Profiler_start, if it is timed
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * unsigned long long start : The value returned by D3D9Profiler_start
+ * Return : void
+ */
+static inline void
+D3D9Profiler_stop (
+	D3D9Profiler *this,
+	int index,
+	unsigned long long start
+) {
+	if (start) {
+		D3D9Profiler_record (this, index, D3D9Profiler_get_ticks () - start);
+	}
+}
+
+/*
+ * Description : Sum the shards of all the threads in the stats, and end the frame. Called once per frame, on Present.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : void
+ */
+void
+D3D9Profiler_aggregate (
+	D3D9Profiler *this
+);
+
+/*
+ * Description : Get the stats of a method aggregated by the last D3D9Profiler_aggregate
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * D3D9ProfilerStats *stats : Output of the stats
+ * Return : bool true on success, false if the index is invalid
+ */
+bool
+D3D9Profiler_get_stats (
+	D3D9Profiler *this,
+	int index,
+	D3D9ProfilerStats *stats
+);
+
+/*
+ * Description : Get the methods which took the most time during the last frame
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int *indices : Output of the indices of the methods, the most expensive first
+ * int capacity : Maximum number of indices
+ * Return : int the number of indices written, only the methods called during the last frame
+ */
+int
+D3D9Profiler_get_costliest (
+	D3D9Profiler *this,
+	int *indices,
+	int capacity
+);
+
+/*
+ * Description : Get a percentile of the duration of the calls timed of a method since the profiler started
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * int index : Index of the method
+ * double percentile : Between 0 and 100
+ * Return : double the duration in nanoseconds, 0 if the method hasn't been called
+ */
+double
+D3D9Profiler_get_percentile (
+	D3D9Profiler *this,
+	int index,
+	double percentile
+);
+
+/*
+ * Description : Get the shortest duration counted in a bucket of the histograms
+ * int bucket : Index of the bucket
+ * Return : unsigned long long the duration in ticks
+ */
+unsigned long long
+D3D9Profiler_get_bucket_ticks (
+	int bucket
+);
+
+/*
+ * Description : Convert a duration in ticks to nanoseconds. The ratio is measured at each D3D9Profiler_aggregate.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * double ticks : A duration in ticks
+ * Return : double the duration in nanoseconds
+ */
+double
+D3D9Profiler_ticks_to_ns (
+	D3D9Profiler *this,
+	double ticks
+);
+
+/*
+ * Description : Measure what the profiler adds to a call : D3D9Profiler_start and D3D9Profiler_stop,
+ *               the samples included. The calls timed aren't counted in the stats.
+ * D3D9Profiler *this : An allocated D3D9Profiler
+ * Return : double the time added to each call, in nanoseconds
+ */
+double
+D3D9Profiler_measure_overhead (
+	D3D9Profiler *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9Profiler structure.
+ *               /!\ No thread must record a call anymore.
+ * D3D9Profiler *this : An allocated D3D9Profiler to free.
+ */
+void
+D3D9Profiler_free (
+	D3D9Profiler *this
+);
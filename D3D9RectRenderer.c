@@ -0,0 +1,293 @@
+#include "D3D9RectRenderer.h"
+
+// ---------- Debugging -------------
+#define __DEBUG_OBJECT__ "D3D9RectRenderer"
+#include "dbg/dbg.h"
+
+// Private headers
+/*
+ * Description : Create the vertex buffer and the state block if they don't exist, or if they belong to another device
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : bool true on success, false otherwise
+ */
+static bool D3D9RectRenderer_create_resources (D3D9RectRenderer *this, IDirect3DDevice9 * pDevice);
+
+/*
+ * Description : Set the render states drawing colored screen space triangles over the scene
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : void
+ */
+static void D3D9RectRenderer_set_states (D3D9RectRenderer *this, IDirect3DDevice9 * pDevice);
+
+
+/*
+ * Description : Allocate a new D3D9RectRenderer structure.
+ * int capacity : Number of rectangles drawn by one DrawPrimitive call
+ * Return : A pointer to an allocated D3D9RectRenderer.
+ */
+D3D9RectRenderer *
+D3D9RectRenderer_new (
+	int capacity
+) {
+	D3D9RectRenderer *this;
+
+	if ((this = calloc (1, sizeof(D3D9RectRenderer))) == NULL)
+		return NULL;
+
+	if (!D3D9RectRenderer_init (this, capacity)) {
+		D3D9RectRenderer_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9RectRenderer structure.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer to initialize.
+ * int capacity : Number of rectangles drawn by one DrawPrimitive call
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9RectRenderer_init (
+	D3D9RectRenderer *this,
+	int capacity
+) {
+	this->vertexBuffer     = NULL;
+	this->stateBlock       = NULL;
+	this->device           = NULL;
+	this->bufferCapacity   = capacity * D3D9_RECT_VERTICES_COUNT;
+	this->bufferOffset     = 0;
+	this->verticesCount    = 0;
+	this->verticesCapacity = this->bufferCapacity;
+
+	if ((this->vertices = malloc (sizeof(D3D9RectVertex) * this->verticesCapacity)) == NULL) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Description : Queue a rectangle until the next flush
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * int x, int y : Position of the rectangle
+ * int w, int h : Size of the rectangle
+ * D3DCOLOR color : ARGB color of the rectangle, the alpha is blended
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9RectRenderer_add (
+	D3D9RectRenderer *this,
+	int x, int y,
+	int w, int h,
+	D3DCOLOR color
+) {
+	if (this->verticesCount + D3D9_RECT_VERTICES_COUNT > this->verticesCapacity) {
+		D3D9RectVertex *vertices;
+		int capacity = this->verticesCapacity * 2;
+
+		if ((vertices = realloc (this->vertices, sizeof(D3D9RectVertex) * capacity)) == NULL) {
+			return false;
+		}
+
+		this->vertices = vertices;
+		this->verticesCapacity = capacity;
+	}
+
+	this->verticesCount += D3D9RectVertex_build (&this->vertices [this->verticesCount], x, y, w, h, color);
+
+	return true;
+}
+
+/*
+ * Description : Draw the queued rectangles, with one DrawPrimitive call per vertex buffer filled.
+ *               The render states of the application are restored after.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : int the number of DrawPrimitive calls
+ */
+int
+D3D9RectRenderer_flush (
+	D3D9RectRenderer *this,
+	IDirect3DDevice9 * pDevice
+) {
+	int drawCalls = 0;
+	int written = 0;
+
+	if (this->verticesCount == 0) {
+		return 0;
+	}
+
+	if (!D3D9RectRenderer_create_resources (this, pDevice)) {
+		this->verticesCount = 0;
+		return 0;
+	}
+
+	this->stateBlock->lpVtbl->Capture (this->stateBlock);
+	D3D9RectRenderer_set_states (this, pDevice);
+
+	while (written < this->verticesCount)
+	{
+		IDirect3DVertexBuffer9 *vertexBuffer = this->vertexBuffer;
+		int count = this->verticesCount - written;
+		DWORD flags = D3DLOCK_NOOVERWRITE;
+		void *data;
+
+		if (count > this->bufferCapacity) {
+			count = this->bufferCapacity;
+		}
+
+		// Append after the vertices the GPU may still read, or start a new buffer when the end is reached
+		if (this->bufferOffset + count > this->bufferCapacity || this->bufferOffset == 0) {
+			this->bufferOffset = 0;
+			flags = D3DLOCK_DISCARD;
+		}
+
+		if (vertexBuffer->lpVtbl->Lock (vertexBuffer, this->bufferOffset * sizeof(D3D9RectVertex),
+			count * sizeof(D3D9RectVertex), &data, flags) != D3D_OK) {
+			warn ("Cannot lock the rectangles vertex buffer.");
+			break;
+		}
+
+		memcpy (data, &this->vertices [written], count * sizeof(D3D9RectVertex));
+		vertexBuffer->lpVtbl->Unlock (vertexBuffer);
+
+		pDevice->lpVtbl->DrawPrimitive (pDevice, D3DPT_TRIANGLELIST, this->bufferOffset, count / 3);
+		drawCalls++;
+
+		this->bufferOffset += count;
+		written += count;
+	}
+
+	this->stateBlock->lpVtbl->Apply (this->stateBlock);
+	this->verticesCount = 0;
+
+	return drawCalls;
+}
+
+/*
+ * Description : Create the vertex buffer and the state block if they don't exist, or if they belong to another device
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : bool true on success, false otherwise
+ */
+static bool
+D3D9RectRenderer_create_resources (
+	D3D9RectRenderer *this,
+	IDirect3DDevice9 * pDevice
+) {
+	// The resources of a device cannot be used with another one
+	if (this->device != pDevice) {
+		D3D9RectRenderer_on_lost_device (this);
+		this->device = pDevice;
+	}
+
+	if (!this->vertexBuffer) {
+		if (pDevice->lpVtbl->CreateVertexBuffer (pDevice, this->bufferCapacity * sizeof(D3D9RectVertex),
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, D3D9_RECT_RENDERER_FVF, D3DPOOL_DEFAULT, &this->vertexBuffer, NULL) != D3D_OK) {
+			warn ("Cannot create the rectangles vertex buffer.");
+			this->vertexBuffer = NULL;
+			return false;
+		}
+
+		this->bufferOffset = 0;
+	}
+
+	if (!this->stateBlock) {
+		if (pDevice->lpVtbl->CreateStateBlock (pDevice, D3DSBT_ALL, &this->stateBlock) != D3D_OK) {
+			warn ("Cannot create the rectangles state block.");
+			this->stateBlock = NULL;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Set the render states drawing colored screen space triangles over the scene
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : void
+ */
+static void
+D3D9RectRenderer_set_states (
+	D3D9RectRenderer *this,
+	IDirect3DDevice9 * pDevice
+) {
+	pDevice->lpVtbl->SetVertexShader (pDevice, NULL);
+	pDevice->lpVtbl->SetPixelShader (pDevice, NULL);
+	pDevice->lpVtbl->SetTexture (pDevice, 0, NULL);
+	pDevice->lpVtbl->SetFVF (pDevice, D3D9_RECT_RENDERER_FVF);
+	pDevice->lpVtbl->SetStreamSource (pDevice, 0, this->vertexBuffer, 0, sizeof(D3D9RectVertex));
+
+	// Drawn over the scene : the depth buffer of the application is neither tested nor written
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_ZENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_ZWRITEENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_STENCILENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_SCISSORTESTENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_LIGHTING, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_FOGENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_CULLMODE, D3DCULL_NONE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_ALPHATESTENABLE, FALSE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_ALPHABLENDENABLE, TRUE);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_BLENDOP, D3DBLENDOP_ADD);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_SEPARATEALPHABLENDENABLE, FALSE);
+
+	// Every channel is written, in the space of the vertex colors
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_COLORWRITEENABLE,
+		D3DCOLORWRITEENABLE_RED | D3DCOLORWRITEENABLE_GREEN | D3DCOLORWRITEENABLE_BLUE | D3DCOLORWRITEENABLE_ALPHA);
+	pDevice->lpVtbl->SetRenderState (pDevice, D3DRS_SRGBWRITEENABLE, FALSE);
+
+	// Untextured : the color and the alpha come from the vertices only, whatever the stages of the application
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 0, D3DTSS_COLORARG1, D3DTA_DIFFUSE);
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 0, D3DTSS_ALPHAARG1, D3DTA_DIFFUSE);
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+	pDevice->lpVtbl->SetTextureStageState (pDevice, 1, D3DTSS_ALPHAOP, D3DTOP_DISABLE);
+}
+
+/*
+ * Description : Release the video memory before the device is reset. It is created again by the next flush.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * Return : void
+ */
+void
+D3D9RectRenderer_on_lost_device (
+	D3D9RectRenderer *this
+) {
+	if (this->vertexBuffer) {
+		this->vertexBuffer->lpVtbl->Release (this->vertexBuffer);
+		this->vertexBuffer = NULL;
+	}
+
+	if (this->stateBlock) {
+		this->stateBlock->lpVtbl->Release (this->stateBlock);
+		this->stateBlock = NULL;
+	}
+
+	this->bufferOffset = 0;
+}
+
+/*
+ * Description : Free an allocated D3D9RectRenderer structure.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer to free.
+ */
+void
+D3D9RectRenderer_free (
+	D3D9RectRenderer *this
+) {
+	if (this != NULL)
+	{
+		D3D9RectRenderer_on_lost_device (this);
+		free (this->vertices);
+		free (this);
+	}
+}
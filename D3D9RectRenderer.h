@@ -0,0 +1,109 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "D3D9RectVertex.h"
+
+// ---------- Defines -------------
+// Default size of the vertex buffer, in rectangles
+#define D3D9_RECT_RENDERER_DEFAULT_CAPACITY 1024
+#define D3D9_RECT_RENDERER_FVF              (D3DFVF_XYZRHW | D3DFVF_DIFFUSE)
+
+// ------ Structure declaration -------
+typedef struct
+{
+	// Dynamic vertex buffer used as a ring : appended without overwrite, discarded when full
+	IDirect3DVertexBuffer9 *vertexBuffer;
+	int bufferCapacity;
+	int bufferOffset;
+
+	// Render states of the application, restored after each flush. Created once per device, captured at each flush.
+	IDirect3DStateBlock9 *stateBlock;
+	// Device owning the vertex buffer and the state block
+	IDirect3DDevice9 *device;
+
+	// Vertices of the rectangles added since the last flush
+	D3D9RectVertex *vertices;
+	int verticesCount;
+	int verticesCapacity;
+
+}	D3D9RectRenderer;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9RectRenderer structure.
+ * int capacity : Number of rectangles drawn by one DrawPrimitive call
+ * Return : A pointer to an allocated D3D9RectRenderer.
+ */
+D3D9RectRenderer *
+D3D9RectRenderer_new (
+	int capacity
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9RectRenderer structure.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer to initialize.
+ * int capacity : Number of rectangles drawn by one DrawPrimitive call
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9RectRenderer_init (
+	D3D9RectRenderer *this,
+	int capacity
+);
+
+/*
+ * Description : Queue a rectangle until the next flush
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * int x, int y : Position of the rectangle
+ * int w, int h : Size of the rectangle
+ * D3DCOLOR color : ARGB color of the rectangle, the alpha is blended
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9RectRenderer_add (
+	D3D9RectRenderer *this,
+	int x, int y,
+	int w, int h,
+	D3DCOLOR color
+);
+
+/*
+ * Description : Draw the queued rectangles, with one DrawPrimitive call per vertex buffer filled.
+ *               The render states of the application are restored after.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * IDirect3DDevice9 * pDevice : An allocated d3d9 device
+ * Return : int the number of DrawPrimitive calls
+ */
+int
+D3D9RectRenderer_flush (
+	D3D9RectRenderer *this,
+	IDirect3DDevice9 * pDevice
+);
+
+/*
+ * Description : Release the video memory before the device is reset. It is created again by the next flush.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer
+ * Return : void
+ */
+void
+D3D9RectRenderer_on_lost_device (
+	D3D9RectRenderer *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9RectRenderer structure.
+ * D3D9RectRenderer *this : An allocated D3D9RectRenderer to free.
+ */
+void
+D3D9RectRenderer_free (
+	D3D9RectRenderer *this
+);
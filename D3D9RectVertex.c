@@ -0,0 +1,44 @@
+#include "D3D9RectVertex.h"
+
+/*
+ * Description : Write the two triangles covering a rectangle on the screen
+ * D3D9RectVertex *vertices : Output of D3D9_RECT_VERTICES_COUNT vertices
+ * int x, int y : Position of the top left corner of the rectangle
+ * int w, int h : Size of the rectangle
+ * unsigned int color : ARGB color of the rectangle
+ * Return : int the number of vertices written, 0 if the rectangle is empty
+ */
+int
+D3D9RectVertex_build (
+	D3D9RectVertex *vertices,
+	int x, int y,
+	int w, int h,
+	unsigned int color
+) {
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+
+	// Direct3D 9 samples the pixels at their top left corner : shift by half a pixel to cover exactly the pixels of the rectangle
+	float left   = (float) x - 0.5f;
+	float top    = (float) y - 0.5f;
+	float right  = (float) (x + w) - 0.5f;
+	float bottom = (float) (y + h) - 0.5f;
+
+	D3D9RectVertex corners [4] = {
+		{left,  top,    0.0f, 1.0f, color},
+		{right, top,    0.0f, 1.0f, color},
+		{right, bottom, 0.0f, 1.0f, color},
+		{left,  bottom, 0.0f, 1.0f, color}
+	};
+
+	// Clockwise triangles : top left, top right, bottom right / top left, bottom right, bottom left
+	vertices [0] = corners [0];
+	vertices [1] = corners [1];
+	vertices [2] = corners [2];
+	vertices [3] = corners [0];
+	vertices [4] = corners [2];
+	vertices [5] = corners [3];
+
+	return D3D9_RECT_VERTICES_COUNT;
+}
@@ -0,0 +1,38 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+// Two triangles per rectangle
+#define D3D9_RECT_VERTICES_COUNT 6
+
+// ------ Structure declaration -------
+
+// Pre-transformed colored vertex, with the layout of D3DFVF_XYZRHW | D3DFVF_DIFFUSE.
+// It doesn't depend on DirectX, so the vertices can be built and tested on their own.
+typedef struct
+{
+	float x, y, z, rhw;
+	unsigned int color;
+
+}	D3D9RectVertex;
+
+// ----------- Functions ------------
+
+/*
+ * Description : Write the two triangles covering a rectangle on the screen
+ * D3D9RectVertex *vertices : Output of D3D9_RECT_VERTICES_COUNT vertices
+ * int x, int y : Position of the top left corner of the rectangle
+ * int w, int h : Size of the rectangle
+ * unsigned int color : ARGB color of the rectangle
+ * Return : int the number of vertices written, 0 if the rectangle is empty
+ */
+int
+D3D9RectVertex_build (
+	D3D9RectVertex *vertices,
+	int x, int y,
+	int w, int h,
+	unsigned int color
+);
@@ -0,0 +1,80 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+// Static initializer of a D3D9SeqLock
+#define D3D9_SEQ_LOCK_INITIALIZER 0
+
+// ------ Structure declaration -------
+
+// Sequence counter of data written in place by writers serialized by another lock, and read by threads that never wait for them.
+// The counter is odd while the data is written : a reader copies the data, and copies it again if the counter changed meanwhile.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef volatile unsigned int D3D9SeqLock;
+
+// ----------- Functions ------------
+
+/*
+ * Description : Start writing the data protected. The writers must be serialized by the caller.
+ * D3D9SeqLock *this : A D3D9SeqLock
+ * Return : void
+ */
+static inline void
+D3D9SeqLock_write_begin (
+	D3D9SeqLock *this
+) {
+	__atomic_store_n (this, __atomic_load_n (this, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	// The data written next is never seen before the odd counter
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+/*
+ * Description : Finish writing the data protected
+ * D3D9SeqLock *this : A D3D9SeqLock being written
+ * Return : void
+ */
+static inline void
+D3D9SeqLock_write_end (
+	D3D9SeqLock *this
+) {
+	__atomic_store_n (this, __atomic_load_n (this, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Description : Start reading the data protected, waiting for a write in progress to finish.
+ *               A write is a few stores, so the reader only spins when the writer is preempted in the middle of one.
+ * D3D9SeqLock *this : A D3D9SeqLock
+ * Return : unsigned int the version of the data, given to D3D9SeqLock_read_retry
+ */
+static inline unsigned int
+D3D9SeqLock_read_begin (
+	D3D9SeqLock *this
+) {
+	unsigned int version;
+
+	while ((version = __atomic_load_n (this, __ATOMIC_ACQUIRE)) & 1) {
+		__builtin_ia32_pause ();
+	}
+
+	return version;
+}
+
+/*
+ * Description : Check whether the data read since D3D9SeqLock_read_begin has been written meanwhile
+ * D3D9SeqLock *this : A D3D9SeqLock
+ * unsigned int version : The version returned by D3D9SeqLock_read_begin
+ * Return : bool true if the data must be read again, false if the copy is consistent
+ */
+static inline bool
+D3D9SeqLock_read_retry (
+	D3D9SeqLock *this,
+	unsigned int version
+) {
+	// The data read before is never read after the counter
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n (this, __ATOMIC_RELAXED) != version;
+}
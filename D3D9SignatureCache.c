@@ -0,0 +1,411 @@
+#include "D3D9SignatureCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Offsets in the PE headers
+#define D3D9_PE_HEADER_OFFSET      0x3C
+#define D3D9_PE_FILE_HEADER_SIZE   20
+#define D3D9_PE_SECTION_SIZE       40
+#define D3D9_PE_CHECKSUM_OFFSET    64
+
+// Width of the names in the format of the lines, from the size of their buffer
+#define D3D9_SIGNATURE_CACHE_STRINGIFY(value)  #value
+#define D3D9_SIGNATURE_CACHE_WIDTH(length)     D3D9_SIGNATURE_CACHE_STRINGIFY (length)
+#define D3D9_SIGNATURE_CACHE_NAME_FORMAT       "%" D3D9_SIGNATURE_CACHE_WIDTH (D3D9_SIGNATURE_CACHE_NAME_LENGTH) "s"
+
+// Private headers
+/*
+ * Description : Hash a buffer with 64 bits FNV-1a, continuing a previous hash
+ * unsigned long long hash : The hash of the previous buffers
+ * const unsigned char *bytes : The buffer to hash
+ * size_t size : Size of the buffer in bytes
+ * Return : unsigned long long the new hash
+ */
+static unsigned long long D3D9SignatureCache_hash (unsigned long long hash, const unsigned char *bytes, size_t size);
+
+/*
+ * Description : Read a 16 or 32 bits little endian value of a module
+ * unsigned char *module : Base of the module
+ * size_t offset : Offset of the value
+ * int bytes : Size of the value
+ * Return : unsigned int the value
+ */
+static unsigned int D3D9SignatureCache_read (unsigned char *module, size_t offset, int bytes);
+
+/*
+ * Description : Find the entry of a signature in a module
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * Return : D3D9SignatureCacheEntry * the entry, or NULL if not cached
+ */
+static D3D9SignatureCacheEntry * D3D9SignatureCache_find (D3D9SignatureCache *this, D3D9ModuleFingerprint *fingerprint, char *name);
+
+
+/*
+ * Description : Allocate a new D3D9SignatureCache structure and load its file.
+ * char *path : Path of the cache file. It is created by D3D9SignatureCache_save if it doesn't exist.
+ * Return : A pointer to an allocated D3D9SignatureCache.
+ */
+D3D9SignatureCache *
+D3D9SignatureCache_new (
+	char *path
+) {
+	D3D9SignatureCache *this;
+
+	if ((this = calloc (1, sizeof(D3D9SignatureCache))) == NULL)
+		return NULL;
+
+	if (!D3D9SignatureCache_init (this, path)) {
+		D3D9SignatureCache_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9SignatureCache structure and load its file.
+ *               Malformed lines are ignored : the signatures concerned are scanned again.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache to initialize.
+ * char *path : Path of the cache file
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SignatureCache_init (
+	D3D9SignatureCache *this,
+	char *path
+) {
+	char line [256];
+	FILE *file;
+
+	this->entries  = NULL;
+	this->count    = 0;
+	this->capacity = 0;
+	this->modified = false;
+
+	if ((this->path = strdup (path)) == NULL) {
+		return false;
+	}
+
+	if ((file = fopen (path, "r")) == NULL) {
+		// No cache yet
+		return true;
+	}
+
+	// One entry per line : size timestamp hash name offset
+	while (fgets (line, sizeof(line), file)) {
+		D3D9ModuleFingerprint fingerprint;
+		char name [D3D9_SIGNATURE_CACHE_NAME_SIZE];
+		unsigned long long offset;
+		int nameEnd = 0;
+
+		if (sscanf (line, "%x %x %llx " D3D9_SIGNATURE_CACHE_NAME_FORMAT "%n %llx", &fingerprint.size, &fingerprint.timestamp,
+			&fingerprint.hash, name, &nameEnd, &offset) != 5) {
+			continue;
+		}
+
+		// A name longer than the buffer is cut by the format : the rest mustn't be read as the offset
+		if (line [nameEnd] != ' ') {
+			continue;
+		}
+
+		D3D9SignatureCache_set (this, &fingerprint, name, offset);
+	}
+
+	fclose (file);
+	this->modified = false;
+
+	return true;
+}
+
+/*
+ * Description : Hash a buffer with 64 bits FNV-1a, continuing a previous hash
+ * unsigned long long hash : The hash of the previous buffers
+ * const unsigned char *bytes : The buffer to hash
+ * size_t size : Size of the buffer in bytes
+ * Return : unsigned long long the new hash
+ */
+static unsigned long long
+D3D9SignatureCache_hash (
+	unsigned long long hash,
+	const unsigned char *bytes,
+	size_t size
+) {
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Description : Read a 16 or 32 bits little endian value of a module
+ * unsigned char *module : Base of the module
+ * size_t offset : Offset of the value
+ * int bytes : Size of the value
+ * Return : unsigned int the value
+ */
+static unsigned int
+D3D9SignatureCache_read (
+	unsigned char *module,
+	size_t offset,
+	int bytes
+) {
+	unsigned int value = 0;
+
+	for (int index = bytes - 1; index >= 0; index--) {
+		value = (value << 8) | module [offset + index];
+	}
+
+	return value;
+}
+
+/*
+ * Description : Compute the fingerprint of a module image in memory
+ * unsigned char *module : Base of the module
+ * size_t size : Size of the module
+ * D3D9ModuleFingerprint *fingerprint : Output of the fingerprint
+ * Return : void
+ */
+void
+D3D9SignatureCache_fingerprint (
+	unsigned char *module,
+	size_t size,
+	D3D9ModuleFingerprint *fingerprint
+) {
+	unsigned long long hash = 14695981039346656037ULL;
+	size_t header;
+
+	fingerprint->size      = size;
+	fingerprint->timestamp = 0;
+
+	if (size >= D3D9_PE_HEADER_OFFSET + 4 && module [0] == 'M' && module [1] == 'Z'
+	&& (header = D3D9SignatureCache_read (module, D3D9_PE_HEADER_OFFSET, 4)) + 4 + D3D9_PE_FILE_HEADER_SIZE <= size
+	&&  memcmp (&module [header], "PE\0\0", 4) == 0)
+	{
+		size_t fileHeader     = header + 4;
+		size_t optionalHeader = fileHeader + D3D9_PE_FILE_HEADER_SIZE;
+		int sectionsCount     = D3D9SignatureCache_read (module, fileHeader + 2, 2);
+		int optionalSize      = D3D9SignatureCache_read (module, fileHeader + 16, 2);
+		size_t sections       = optionalHeader + optionalSize;
+		size_t sectionsSize   = (size_t) sectionsCount * D3D9_PE_SECTION_SIZE;
+
+		// The file header, the checksum and the section table aren't modified by the loader, unlike the image base
+		fingerprint->timestamp = D3D9SignatureCache_read (module, fileHeader + 4, 4);
+		hash = D3D9SignatureCache_hash (hash, &module [fileHeader], D3D9_PE_FILE_HEADER_SIZE);
+
+		if (optionalSize >= D3D9_PE_CHECKSUM_OFFSET + 4 && optionalHeader + D3D9_PE_CHECKSUM_OFFSET + 4 <= size) {
+			hash = D3D9SignatureCache_hash (hash, &module [optionalHeader + D3D9_PE_CHECKSUM_OFFSET], 4);
+		}
+
+		if (sections + sectionsSize <= size) {
+			hash = D3D9SignatureCache_hash (hash, &module [sections], sectionsSize);
+		}
+	}
+	else {
+		// Not a PE image : hash its first page
+		hash = D3D9SignatureCache_hash (hash, module, (size < 4096) ? size : 4096);
+	}
+
+	fingerprint->hash = hash;
+}
+
+/*
+ * Description : Find the entry of a signature in a module
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * Return : D3D9SignatureCacheEntry * the entry, or NULL if not cached
+ */
+static D3D9SignatureCacheEntry *
+D3D9SignatureCache_find (
+	D3D9SignatureCache *this,
+	D3D9ModuleFingerprint *fingerprint,
+	char *name
+) {
+	for (int index = 0; index < this->count; index++) {
+		D3D9SignatureCacheEntry *entry = &this->entries [index];
+
+		if (entry->fingerprint.size      == fingerprint->size
+		&&  entry->fingerprint.timestamp == fingerprint->timestamp
+		&&  entry->fingerprint.hash      == fingerprint->hash
+		&&  strcmp (entry->name, name) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Get the cached offset of a signature in a module
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * size_t *offset : Output of the offset
+ * Return : bool true if the offset is cached, false otherwise
+ */
+bool
+D3D9SignatureCache_get (
+	D3D9SignatureCache *this,
+	D3D9ModuleFingerprint *fingerprint,
+	char *name,
+	size_t *offset
+) {
+	D3D9SignatureCacheEntry *entry;
+
+	if (!(entry = D3D9SignatureCache_find (this, fingerprint, name))) {
+		return false;
+	}
+
+	*offset = entry->offset;
+
+	return true;
+}
+
+/*
+ * Description : Store the offset of a signature in a module. The file is written by D3D9SignatureCache_save.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * size_t offset : Offset of the signature
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SignatureCache_set (
+	D3D9SignatureCache *this,
+	D3D9ModuleFingerprint *fingerprint,
+	char *name,
+	size_t offset
+) {
+	D3D9SignatureCacheEntry *entry;
+
+	// Names are written as a single word in the file
+	if (strlen (name) >= D3D9_SIGNATURE_CACHE_NAME_SIZE || strpbrk (name, " \t\r\n") || !*name) {
+		return false;
+	}
+
+	if (!(entry = D3D9SignatureCache_find (this, fingerprint, name)))
+	{
+		if (this->count == D3D9_SIGNATURE_CACHE_MAX_ENTRIES) {
+			// Drop the oldest entry
+			memmove (&this->entries [0], &this->entries [1], sizeof(D3D9SignatureCacheEntry) * (this->count - 1));
+			this->count--;
+		}
+
+		if (this->count == this->capacity) {
+			int capacity = (this->capacity) ? this->capacity * 2 : 16;
+			D3D9SignatureCacheEntry *entries;
+
+			if ((entries = realloc (this->entries, sizeof(D3D9SignatureCacheEntry) * capacity)) == NULL) {
+				return false;
+			}
+
+			this->entries = entries;
+			this->capacity = capacity;
+		}
+
+		entry = &this->entries [this->count++];
+		entry->fingerprint = *fingerprint;
+		strcpy (entry->name, name);
+	}
+	else if (entry->offset == offset) {
+		return true;
+	}
+
+	entry->offset  = offset;
+	this->modified = true;
+
+	return true;
+}
+
+/*
+ * Description : Write the cache file if it has been modified.
+ *               The entries are written to a temporary file of the process, then renamed over the cache,
+ *               so a crash or another process saving at the same time never leaves a partial file.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SignatureCache_save (
+	D3D9SignatureCache *this
+) {
+	size_t tempPathSize = strlen (this->path) + 32;
+	char *tempPath;
+	FILE *file;
+	bool written = true;
+
+	if (!this->modified) {
+		return true;
+	}
+
+	if ((tempPath = malloc (tempPathSize)) == NULL) {
+		return false;
+	}
+
+	#ifdef _WIN32
+	snprintf (tempPath, tempPathSize, "%s.%lu.tmp", this->path, (unsigned long) GetCurrentProcessId ());
+	#else
+	snprintf (tempPath, tempPathSize, "%s.%lu.tmp", this->path, (unsigned long) getpid ());
+	#endif
+
+	if ((file = fopen (tempPath, "w")) == NULL) {
+		free (tempPath);
+		return false;
+	}
+
+	for (int index = 0; index < this->count; index++) {
+		D3D9SignatureCacheEntry *entry = &this->entries [index];
+
+		if (fprintf (file, "%x %x %llx %s %llx\n", entry->fingerprint.size, entry->fingerprint.timestamp,
+			entry->fingerprint.hash, entry->name, (unsigned long long) entry->offset) < 0) {
+			written = false;
+		}
+	}
+
+	if (fclose (file) != 0) {
+		written = false;
+	}
+
+	#ifdef _WIN32
+	// rename fails on Windows when the cache already exists
+	written = written && MoveFileExA (tempPath, this->path, MOVEFILE_REPLACE_EXISTING);
+	#else
+	written = written && rename (tempPath, this->path) == 0;
+	#endif
+
+	if (!written) {
+		remove (tempPath);
+		free (tempPath);
+		return false;
+	}
+
+	free (tempPath);
+	this->modified = false;
+
+	return true;
+}
+
+/*
+ * Description : Free an allocated D3D9SignatureCache structure. The modifications not saved are lost.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache to free.
+ */
+void
+D3D9SignatureCache_free (
+	D3D9SignatureCache *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	free (this->path);
+	free (this->entries);
+	free (this);
+}
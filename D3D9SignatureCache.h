@@ -0,0 +1,143 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// Longest name of a signature, without the terminating null byte
+#define D3D9_SIGNATURE_CACHE_NAME_LENGTH 63
+#define D3D9_SIGNATURE_CACHE_NAME_SIZE   (D3D9_SIGNATURE_CACHE_NAME_LENGTH + 1)
+// Oldest entries are dropped beyond this count, so the file doesn't grow with each update of the modules
+#define D3D9_SIGNATURE_CACHE_MAX_ENTRIES 256
+
+// ------ Structure declaration -------
+
+// Identity of a module image. Only the bytes the loader doesn't relocate are hashed,
+// so the fingerprint stays the same wherever the module is loaded.
+typedef struct
+{
+	unsigned int size;
+	unsigned int timestamp;
+	unsigned long long hash;
+
+}	D3D9ModuleFingerprint;
+
+// Offset of a signature, relative to the base of the module
+typedef struct
+{
+	D3D9ModuleFingerprint fingerprint;
+	char name [D3D9_SIGNATURE_CACHE_NAME_SIZE];
+	size_t offset;
+
+}	D3D9SignatureCacheEntry;
+
+// Offsets of signatures found in previous runs, stored in a text file
+typedef struct
+{
+	char *path;
+
+	D3D9SignatureCacheEntry *entries;
+	int count;
+	int capacity;
+
+	bool modified;
+
+}	D3D9SignatureCache;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9SignatureCache structure and load its file.
+ * char *path : Path of the cache file. It is created by D3D9SignatureCache_save if it doesn't exist.
+ * Return : A pointer to an allocated D3D9SignatureCache.
+ */
+D3D9SignatureCache *
+D3D9SignatureCache_new (
+	char *path
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9SignatureCache structure and load its file.
+ *               Malformed lines are ignored : the signatures concerned are scanned again.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache to initialize.
+ * char *path : Path of the cache file
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SignatureCache_init (
+	D3D9SignatureCache *this,
+	char *path
+);
+
+/*
+ * Description : Compute the fingerprint of a module image in memory
+ * unsigned char *module : Base of the module
+ * size_t size : Size of the module
+ * D3D9ModuleFingerprint *fingerprint : Output of the fingerprint
+ * Return : void
+ */
+void
+D3D9SignatureCache_fingerprint (
+	unsigned char *module,
+	size_t size,
+	D3D9ModuleFingerprint *fingerprint
+);
+
+/*
+ * Description : Get the cached offset of a signature in a module
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * size_t *offset : Output of the offset
+ * Return : bool true if the offset is cached, false otherwise
+ */
+bool
+D3D9SignatureCache_get (
+	D3D9SignatureCache *this,
+	D3D9ModuleFingerprint *fingerprint,
+	char *name,
+	size_t *offset
+);
+
+/*
+ * Description : Store the offset of a signature in a module. The file is written by D3D9SignatureCache_save.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * D3D9ModuleFingerprint *fingerprint : Fingerprint of the module
+ * char *name : Name of the signature
+ * size_t offset : Offset of the signature
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SignatureCache_set (
+	D3D9SignatureCache *this,
+	D3D9ModuleFingerprint *fingerprint,
+	char *name,
+	size_t offset
+);
+
+/*
+ * Description : Write the cache file if it has been modified.
+ *               The entries are written to a temporary file of the process, then renamed over the cache,
+ *               so a crash or another process saving at the same time never leaves a partial file.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SignatureCache_save (
+	D3D9SignatureCache *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9SignatureCache structure. The modifications not saved are lost.
+ * D3D9SignatureCache *this : An allocated D3D9SignatureCache to free.
+ */
+void
+D3D9SignatureCache_free (
+	D3D9SignatureCache *this
+);
@@ -0,0 +1,1291 @@
+#include "D3D9SignatureScanner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Pass over the buffer selected for the CPU
+typedef int (*D3D9SignatureScannerPass) (D3D9SignatureScanner *this, unsigned char *buffer, size_t size,
+	D3D9SignatureScannerCallback callback, void *userData, bool *stopped);
+
+// State of D3D9SignatureScanner_find_first
+typedef struct {
+	size_t *offsets;
+	int remaining;
+} D3D9SignatureScannerFirst;
+
+// Matches found in a chunk of a parallel scan
+typedef struct {
+	D3D9SignatureMatch *matches;
+	int count;
+	int capacity;
+} D3D9SignatureScannerChunk;
+
+// Chunks left to a thread : [begin, end) packed in one word, so the owner and the thieves take a chunk with a single CAS.
+// The owner takes the chunks from the front, the thieves from the back.
+typedef struct {
+	volatile unsigned long long range;
+	// Keep the queues of the threads on separated cache lines
+	char padding [64 - sizeof(unsigned long long)];
+} D3D9SignatureScannerQueue;
+
+// Parallel scan shared by the threads
+typedef struct {
+	D3D9SignatureScanner *scanner;
+	D3D9SignatureScannerPass pass;
+	unsigned char *buffer;
+	size_t size;
+	size_t chunkSize;
+	int chunksCount;
+	D3D9SignatureScannerChunk *chunks;
+	D3D9SignatureScannerQueue *queues;
+	int threadsCount;
+	volatile bool failed;
+
+	// Only the first match of each signature is needed : first chunk matching each signature,
+	// and last chunk worth scanning once every signature is found
+	bool firstOnly;
+	volatile long *firstChunks;
+	volatile long limit;
+} D3D9SignatureScannerJob;
+
+// Thread of a parallel scan
+typedef struct {
+	D3D9SignatureScannerJob *job;
+	int index;
+	int chunk;
+} D3D9SignatureScannerWorker;
+
+// Private headers
+/*
+ * Description : Estimate how often a byte appears in x86 code, so the rarest bytes of a pattern are used as anchor
+ * unsigned char byte : A byte of a pattern
+ * Return : int a weight, higher for the common bytes
+ */
+static int D3D9SignatureScanner_get_byte_weight (unsigned char byte);
+
+/*
+ * Description : Add a signature to the group of its anchor, creating the group if needed
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * Return : bool true on success, false otherwise
+ */
+static bool D3D9SignatureScanner_link_anchor (D3D9SignatureScanner *this, int signature);
+
+/*
+ * Description : Verify the signatures of an anchor found at a position of the buffer
+ * Return : int the number of matches reported. *stopped is set if the callback stopped the scan.
+ */
+static inline int D3D9SignatureScanner_verify (D3D9SignatureScanner *this, D3D9SignatureAnchor *anchor,
+	unsigned char *buffer, size_t size, size_t position, D3D9SignatureScannerCallback callback, void *userData, bool *stopped);
+
+/*
+ * Description : Search the anchors from a position to the end of the buffer, one byte at a time
+ * Return : int the number of matches reported. *stopped is set if the callback stopped the scan.
+ */
+static int D3D9SignatureScanner_scan_tail (D3D9SignatureScanner *this, unsigned char *buffer, size_t size, size_t first,
+	D3D9SignatureScannerCallback callback, void *userData, bool *stopped);
+
+/*
+ * Description : Search the anchors one byte at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int D3D9SignatureScanner_scan_scalar (D3D9SignatureScanner *this, unsigned char *buffer, size_t size,
+	D3D9SignatureScannerCallback callback, void *userData, bool *stopped);
+
+/*
+ * Description : Search the anchors 16 bytes at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int D3D9SignatureScanner_scan_sse2 (D3D9SignatureScanner *this, unsigned char *buffer, size_t size,
+	D3D9SignatureScannerCallback callback, void *userData, bool *stopped)
+	__attribute__ ((target ("sse2")));
+
+/*
+ * Description : Search the anchors 32 bytes at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int D3D9SignatureScanner_scan_avx2 (D3D9SignatureScanner *this, unsigned char *buffer, size_t size,
+	D3D9SignatureScannerCallback callback, void *userData, bool *stopped)
+	__attribute__ ((target ("avx2")));
+
+/*
+ * Description : Select the pass for the CPU
+ * Return : D3D9SignatureScannerPass the widest pass supported
+ */
+static D3D9SignatureScannerPass D3D9SignatureScanner_select (void);
+
+/*
+ * Description : Record the first match of each signature. Stop when all the signatures are found.
+ * Same parameters and return as D3D9SignatureScannerCallback.
+ */
+static bool D3D9SignatureScanner_on_first (void *userData, int signature, size_t offset);
+
+/*
+ * Description : Get the pass for the CPU, selected at the first call
+ * Return : D3D9SignatureScannerPass the widest pass supported
+ */
+static D3D9SignatureScannerPass D3D9SignatureScanner_get_pass (void);
+
+/*
+ * Description : Split a buffer in chunks, scan them with a pool of threads and keep the matches of each chunk
+ * D3D9SignatureScannerJob *job : The job to run, with its scanner, buffer and mode set
+ * int threads : Number of threads scanning, 0 for one per processor
+ * Return : bool true if all the chunks have been scanned, false if the scan has been cancelled or failed
+ */
+static bool D3D9SignatureScanner_run (D3D9SignatureScannerJob *job, int threads);
+
+/*
+ * Description : Scan chunks until no thread has any left
+ * D3D9SignatureScannerWorker *worker : The thread scanning
+ * Return : void
+ */
+static void D3D9SignatureScanner_work (D3D9SignatureScannerWorker *worker);
+
+/*
+ * Description : Take the next chunk of a thread, or steal the last chunk of another thread
+ * D3D9SignatureScannerJob *job : The job running
+ * int index : Index of the thread
+ * Return : int the index of the chunk, or -1 if no chunk is left
+ */
+static int D3D9SignatureScanner_take_chunk (D3D9SignatureScannerJob *job, int index);
+
+/*
+ * Description : Keep a match found in the chunk scanned by a thread
+ * Same parameters and return as D3D9SignatureScannerCallback. userData is the D3D9SignatureScannerWorker.
+ */
+static bool D3D9SignatureScanner_on_chunk_match (void *userData, int signature, size_t offset);
+
+/*
+ * Description : Order the matches by offset, then by signature
+ * const void *a, const void *b : Two D3D9SignatureMatch
+ * Return : int like strcmp
+ */
+static int D3D9SignatureMatch_compare (const void *a, const void *b);
+
+/*
+ * Description : Free the matches of a job
+ * D3D9SignatureScannerJob *job : A job ran by D3D9SignatureScanner_run
+ * Return : void
+ */
+static void D3D9SignatureScanner_free_job (D3D9SignatureScannerJob *job);
+
+
+/*
+ * Description : Allocate a new D3D9SignatureScanner structure.
+ * Return : A pointer to an allocated D3D9SignatureScanner.
+ */
+D3D9SignatureScanner *
+D3D9SignatureScanner_new (
+	void
+) {
+	D3D9SignatureScanner *this;
+
+	if ((this = calloc (1, sizeof(D3D9SignatureScanner))) == NULL)
+		return NULL;
+
+	if (!D3D9SignatureScanner_init (this)) {
+		D3D9SignatureScanner_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9SignatureScanner structure.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SignatureScanner_init (
+	D3D9SignatureScanner *this
+) {
+	this->signatures         = NULL;
+	this->signaturesCount    = 0;
+	this->signaturesCapacity = 0;
+	this->anchors            = NULL;
+	this->anchorsCount       = 0;
+	this->anchorsCapacity    = 0;
+	this->longest            = 0;
+	this->cancelled          = false;
+
+	return true;
+}
+
+/*
+ * Description : Estimate how often a byte appears in x86 code, so the rarest bytes of a pattern are used as anchor
+ * unsigned char byte : A byte of a pattern
+ * Return : int a weight, higher for the common bytes
+ */
+static int
+D3D9SignatureScanner_get_byte_weight (
+	unsigned char byte
+) {
+	switch (byte)
+	{
+		// Padding, immediates and displacements
+		case 0x00: case 0xFF: case 0xCC: case 0x90:
+			return 4;
+
+		// mov, push, call, jcc, ret and the usual ModRM / SIB bytes
+		case 0x8B: case 0x89: case 0x8D: case 0xE8: case 0x0F: case 0x83: case 0x74: case 0x75:
+		case 0xC3: case 0x50: case 0x55: case 0x56: case 0x57: case 0x24: case 0x44: case 0x45:
+		case 0x01: case 0x04: case 0x08: case 0x10:
+			return 2;
+
+		default :
+			return 1;
+	}
+}
+
+/*
+ * Description : Compile a signature and add it to the scanner. The masks have the format of mem_scanner.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * char *name : Name of the signature
+ * unsigned char *pattern : Bytes of the signature
+ * char *searchMask : 'x' for the bytes to compare, '?' for the wildcards. Its length is the size of the pattern.
+ * char *resultMask : '?' for the bytes returned by D3D9SignatureScanner_get_result, or NULL
+ * Return : int the index of the signature, or -1 on error
+ */
+int
+D3D9SignatureScanner_add (
+	D3D9SignatureScanner *this,
+	char *name,
+	unsigned char *pattern,
+	char *searchMask,
+	char *resultMask
+) {
+	D3D9Signature *signature;
+	int size = strlen (searchMask);
+	int bestWeight = -1;
+
+	// Grow the signatures table
+	if (this->signaturesCount == this->signaturesCapacity) {
+		int capacity = (this->signaturesCapacity) ? this->signaturesCapacity * 2 : 16;
+		D3D9Signature *signatures;
+
+		if ((signatures = realloc (this->signatures, sizeof(D3D9Signature) * capacity)) == NULL) {
+			return -1;
+		}
+
+		this->signatures = signatures;
+		this->signaturesCapacity = capacity;
+	}
+
+	signature = &this->signatures [this->signaturesCount];
+	signature->size         = size;
+	signature->resultOffset = 0;
+	signature->resultSize   = 0;
+	signature->name         = strdup (name);
+	signature->bytes        = malloc (size);
+	signature->mask         = malloc (size);
+
+	if (!signature->name || !signature->bytes || !signature->mask) {
+		goto error;
+	}
+
+	for (int index = 0; index < size; index++) {
+		signature->mask [index]  = (searchMask [index] == 'x') ? 0xFF : 0x00;
+		signature->bytes [index] = pattern [index] & signature->mask [index];
+	}
+
+	// The anchor is the rarest pair of consecutive significant bytes, or the rarest significant byte.
+	// A single byte costs more than any pair.
+	for (int index = 0; index < size; index++) {
+		int weight;
+
+		if (!signature->mask [index]) {
+			continue;
+		}
+
+		if (index + 1 < size && signature->mask [index + 1]) {
+			weight = D3D9SignatureScanner_get_byte_weight (signature->bytes [index])
+			       + D3D9SignatureScanner_get_byte_weight (signature->bytes [index + 1]);
+		} else {
+			weight = D3D9SignatureScanner_get_byte_weight (signature->bytes [index]) + 8;
+		}
+
+		if (bestWeight == -1 || weight < bestWeight) {
+			bestWeight = weight;
+			signature->anchor = index;
+		}
+	}
+
+	if (bestWeight == -1) {
+		// Only wildcards : the signature matches everywhere
+		goto error;
+	}
+
+	// Bytes extracted from a match
+	if (resultMask) {
+		char *wildcard = strchr (resultMask, '?');
+
+		if (wildcard) {
+			signature->resultOffset = wildcard - resultMask;
+			signature->resultSize   = strspn (wildcard, "?");
+
+			if (signature->resultSize > (int) sizeof(unsigned int)) {
+				signature->resultSize = sizeof(unsigned int);
+			}
+		}
+	}
+
+	if (!D3D9SignatureScanner_link_anchor (this, this->signaturesCount)) {
+		goto error;
+	}
+
+	if (size > this->longest) {
+		this->longest = size;
+	}
+
+	return this->signaturesCount++;
+
+error:
+	free (signature->name);
+	free (signature->bytes);
+	free (signature->mask);
+	return -1;
+}
+
+/*
+ * Description : Add a signature to the group of its anchor, creating the group if needed
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * Return : bool true on success, false otherwise
+ */
+static bool
+D3D9SignatureScanner_link_anchor (
+	D3D9SignatureScanner *this,
+	int signature
+) {
+	D3D9Signature *compiled = &this->signatures [signature];
+	unsigned char first = compiled->bytes [compiled->anchor];
+	bool pair = (compiled->anchor + 1 < compiled->size && compiled->mask [compiled->anchor + 1]);
+	unsigned char second = (pair) ? compiled->bytes [compiled->anchor + 1] : 0;
+	D3D9SignatureAnchor *anchor = NULL;
+	int *signatures;
+
+	for (int index = 0; index < this->anchorsCount; index++) {
+		D3D9SignatureAnchor *candidate = &this->anchors [index];
+
+		if (candidate->first == first && candidate->second == second && candidate->pair == pair) {
+			anchor = candidate;
+			break;
+		}
+	}
+
+	if (!anchor) {
+		if (this->anchorsCount == this->anchorsCapacity) {
+			int capacity = (this->anchorsCapacity) ? this->anchorsCapacity * 2 : 16;
+			D3D9SignatureAnchor *anchors;
+
+			if ((anchors = realloc (this->anchors, sizeof(D3D9SignatureAnchor) * capacity)) == NULL) {
+				return false;
+			}
+
+			this->anchors = anchors;
+			this->anchorsCapacity = capacity;
+		}
+
+		anchor = &this->anchors [this->anchorsCount++];
+		anchor->first      = first;
+		anchor->second     = second;
+		anchor->pair       = pair;
+		anchor->signatures = NULL;
+		anchor->count      = 0;
+	}
+
+	if ((signatures = realloc (anchor->signatures, sizeof(int) * (anchor->count + 1))) == NULL) {
+		return false;
+	}
+
+	anchor->signatures = signatures;
+	anchor->signatures [anchor->count++] = signature;
+
+	return true;
+}
+
+/*
+ * Description : Verify the signatures of an anchor found at a position of the buffer
+ * Return : int the number of matches reported. *stopped is set if the callback stopped the scan.
+ */
+static inline int
+D3D9SignatureScanner_verify (
+	D3D9SignatureScanner *this,
+	D3D9SignatureAnchor *anchor,
+	unsigned char *buffer,
+	size_t size,
+	size_t position,
+	D3D9SignatureScannerCallback callback,
+	void *userData,
+	bool *stopped
+) {
+	int found = 0;
+
+	for (int index = 0; index < anchor->count; index++) {
+		D3D9Signature *signature = &this->signatures [anchor->signatures [index]];
+		size_t start = position - signature->anchor;
+		int byte;
+
+		if (position < (size_t) signature->anchor || start + signature->size > size) {
+			continue;
+		}
+
+		for (byte = 0; byte < signature->size; byte++) {
+			if ((buffer [start + byte] & signature->mask [byte]) != signature->bytes [byte]) {
+				break;
+			}
+		}
+
+		if (byte == signature->size) {
+			found++;
+
+			if (!callback (userData, anchor->signatures [index], start)) {
+				*stopped = true;
+				return found;
+			}
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Search the anchors from a position to the end of the buffer, one byte at a time
+ * Return : int the number of matches reported. *stopped is set if the callback stopped the scan.
+ */
+static int
+D3D9SignatureScanner_scan_tail (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	size_t first,
+	D3D9SignatureScannerCallback callback,
+	void *userData,
+	bool *stopped
+) {
+	int found = 0;
+
+	for (size_t position = first; position < size && !*stopped; position++) {
+		for (int index = 0; index < this->anchorsCount && !*stopped; index++) {
+			D3D9SignatureAnchor *anchor = &this->anchors [index];
+
+			if (buffer [position] != anchor->first) {
+				continue;
+			}
+
+			if (anchor->pair && (position + 1 >= size || buffer [position + 1] != anchor->second)) {
+				continue;
+			}
+
+			found += D3D9SignatureScanner_verify (this, anchor, buffer, size, position, callback, userData, stopped);
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Search the anchors one byte at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int
+D3D9SignatureScanner_scan_scalar (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	D3D9SignatureScannerCallback callback,
+	void *userData,
+	bool *stopped
+) {
+	return D3D9SignatureScanner_scan_tail (this, buffer, size, 0, callback, userData, stopped);
+}
+
+/*
+ * Description : Search the anchors 16 bytes at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int
+D3D9SignatureScanner_scan_sse2 (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	D3D9SignatureScannerCallback callback,
+	void *userData,
+	bool *stopped
+) {
+	size_t position = 0;
+	int found = 0;
+
+	int count = this->anchorsCount;
+	__m128i firsts [count];
+	__m128i seconds [count];
+	__m128i wildcards [count];
+
+	// Broadcast the anchors once. The wildcard is set for the single byte anchors, so their second byte matches everything.
+	for (int index = 0; index < count; index++) {
+		firsts [index]    = _mm_set1_epi8 (this->anchors [index].first);
+		seconds [index]   = _mm_set1_epi8 (this->anchors [index].second);
+		wildcards [index] = _mm_set1_epi8 ((this->anchors [index].pair) ? 0x00 : 0xFF);
+	}
+
+	// The second byte of the anchor is loaded from the next position : one more byte must be readable
+	for (; position + 16 < size && !*stopped; position += 16) {
+		__m128i current = _mm_loadu_si128 ((const __m128i *) &buffer [position]);
+		__m128i next    = _mm_loadu_si128 ((const __m128i *) &buffer [position + 1]);
+
+		for (int index = 0; index < count; index++) {
+			// Without branch on the first byte : it matches too often to be predicted
+			unsigned int bits = _mm_movemask_epi8 (_mm_and_si128 (
+				_mm_cmpeq_epi8 (current, firsts [index]),
+				_mm_or_si128 (_mm_cmpeq_epi8 (next, seconds [index]), wildcards [index])
+			));
+
+			while (bits && !*stopped) {
+				found += D3D9SignatureScanner_verify (this, &this->anchors [index], buffer, size,
+					position + __builtin_ctz (bits), callback, userData, stopped);
+				bits &= bits - 1;
+			}
+
+			// The callback stopped the scan
+			if (*stopped) {
+				break;
+			}
+		}
+	}
+
+	if (*stopped) {
+		return found;
+	}
+
+	return found + D3D9SignatureScanner_scan_tail (this, buffer, size, position, callback, userData, stopped);
+}
+
+/*
+ * Description : Search the anchors 32 bytes at a time
+ * Same parameters and return as D3D9SignatureScannerPass.
+ */
+static int
+D3D9SignatureScanner_scan_avx2 (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	D3D9SignatureScannerCallback callback,
+	void *userData,
+	bool *stopped
+) {
+	size_t position = 0;
+	int found = 0;
+
+	int count = this->anchorsCount;
+	__m256i firsts [count];
+	__m256i seconds [count];
+	__m256i wildcards [count];
+
+	// Broadcast the anchors once. The wildcard is set for the single byte anchors, so their second byte matches everything.
+	for (int index = 0; index < count; index++) {
+		firsts [index]    = _mm256_set1_epi8 (this->anchors [index].first);
+		seconds [index]   = _mm256_set1_epi8 (this->anchors [index].second);
+		wildcards [index] = _mm256_set1_epi8 ((this->anchors [index].pair) ? 0x00 : 0xFF);
+	}
+
+	// The second byte of the anchor is loaded from the next position : one more byte must be readable
+	for (; position + 32 < size && !*stopped; position += 32) {
+		__m256i current = _mm256_loadu_si256 ((const __m256i *) &buffer [position]);
+		__m256i next    = _mm256_loadu_si256 ((const __m256i *) &buffer [position + 1]);
+
+		for (int index = 0; index < count; index++) {
+			// Without branch on the first byte : it matches too often to be predicted
+			unsigned int bits = _mm256_movemask_epi8 (_mm256_and_si256 (
+				_mm256_cmpeq_epi8 (current, firsts [index]),
+				_mm256_or_si256 (_mm256_cmpeq_epi8 (next, seconds [index]), wildcards [index])
+			));
+
+			while (bits && !*stopped) {
+				found += D3D9SignatureScanner_verify (this, &this->anchors [index], buffer, size,
+					position + __builtin_ctz (bits), callback, userData, stopped);
+				bits &= bits - 1;
+			}
+
+			// The callback stopped the scan
+			if (*stopped) {
+				break;
+			}
+		}
+	}
+
+	// The AVX registers are left dirty for the SSE code of the caller otherwise
+	_mm256_zeroupper ();
+
+	if (*stopped) {
+		return found;
+	}
+
+	return found + D3D9SignatureScanner_scan_tail (this, buffer, size, position, callback, userData, stopped);
+}
+
+/*
+ * Description : Select the pass for the CPU
+ * Return : D3D9SignatureScannerPass the widest pass supported
+ */
+static D3D9SignatureScannerPass
+D3D9SignatureScanner_select (
+	void
+) {
+	__builtin_cpu_init ();
+
+	if (__builtin_cpu_supports ("avx2")) {
+		return D3D9SignatureScanner_scan_avx2;
+	}
+
+	if (__builtin_cpu_supports ("sse2")) {
+		return D3D9SignatureScanner_scan_sse2;
+	}
+
+	return D3D9SignatureScanner_scan_scalar;
+}
+
+/*
+ * Description : Search all the signatures in a buffer, in a single pass.
+ *               The matches of a signature are reported in increasing order of offset.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * D3D9SignatureScannerCallback callback : Called for each match
+ * void *userData : Passed to the callback
+ * Return : int the number of matches reported
+ */
+int
+D3D9SignatureScanner_scan (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	D3D9SignatureScannerCallback callback,
+	void *userData
+) {
+	bool stopped = false;
+
+	return D3D9SignatureScanner_get_pass () (this, buffer, size, callback, userData, &stopped);
+}
+
+/*
+ * Description : Get the pass for the CPU, selected at the first call
+ * Return : D3D9SignatureScannerPass the widest pass supported
+ */
+static D3D9SignatureScannerPass
+D3D9SignatureScanner_get_pass (
+	void
+) {
+	// Every thread selects the same pass, so the race on the first call is harmless
+	static D3D9SignatureScannerPass pass = NULL;
+
+	if (pass == NULL) {
+		pass = D3D9SignatureScanner_select ();
+	}
+
+	return pass;
+}
+
+/*
+ * Description : Record the first match of each signature. Stop when all the signatures are found.
+ * Same parameters and return as D3D9SignatureScannerCallback.
+ */
+static bool
+D3D9SignatureScanner_on_first (
+	void *userData,
+	int signature,
+	size_t offset
+) {
+	D3D9SignatureScannerFirst *first = userData;
+
+	if (first->offsets [signature] == D3D9_SIGNATURE_NOT_FOUND) {
+		first->offsets [signature] = offset;
+		first->remaining--;
+	}
+
+	return (first->remaining > 0);
+}
+
+/*
+ * Description : Get the offset of the first match of each signature. The scan stops once all of them are found.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : int the number of signatures found
+ */
+int
+D3D9SignatureScanner_find_first (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	size_t *offsets
+) {
+	D3D9SignatureScannerFirst first = {
+		.offsets   = offsets,
+		.remaining = this->signaturesCount
+	};
+
+	for (int index = 0; index < this->signaturesCount; index++) {
+		offsets [index] = D3D9_SIGNATURE_NOT_FOUND;
+	}
+
+	if (this->signaturesCount) {
+		D3D9SignatureScanner_scan (this, buffer, size, D3D9SignatureScanner_on_first, &first);
+	}
+
+	return this->signaturesCount - first.remaining;
+}
+
+/*
+ * Description : Thread entry of a parallel scan
+ * D3D9SignatureScannerWorker *worker : The thread scanning
+ */
+#ifdef _WIN32
+static DWORD WINAPI
+D3D9SignatureScanner_thread (
+	LPVOID worker
+) {
+	D3D9SignatureScanner_work (worker);
+	return 0;
+}
+#else
+static void *
+D3D9SignatureScanner_thread (
+	void *worker
+) {
+	D3D9SignatureScanner_work (worker);
+	return NULL;
+}
+#endif
+
+/*
+ * Description : Split a buffer in chunks, scan them with a pool of threads and keep the matches of each chunk
+ * D3D9SignatureScannerJob *job : The job to run, with its scanner, buffer and mode set
+ * int threads : Number of threads scanning, 0 for one per processor
+ * Return : bool true if all the chunks have been scanned, false if the scan has been cancelled or failed
+ */
+static bool
+D3D9SignatureScanner_run (
+	D3D9SignatureScannerJob *job,
+	int threads
+) {
+	D3D9SignatureScannerWorker workers [D3D9_SIGNATURE_SCANNER_MAX_THREADS];
+	#ifdef _WIN32
+	HANDLE handles [D3D9_SIGNATURE_SCANNER_MAX_THREADS];
+	#else
+	pthread_t handles [D3D9_SIGNATURE_SCANNER_MAX_THREADS];
+	#endif
+	bool started [D3D9_SIGNATURE_SCANNER_MAX_THREADS] = {false};
+
+	if (threads <= 0) {
+		#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo (&info);
+		threads = info.dwNumberOfProcessors;
+		#else
+		threads = sysconf (_SC_NPROCESSORS_ONLN);
+		#endif
+	}
+
+	// The chunks overlap by the longest signature minus one byte, so a match across two chunks is found by the first one
+	job->pass      = D3D9SignatureScanner_get_pass ();
+	job->chunkSize = D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE;
+
+	if (job->chunkSize < (size_t) job->scanner->longest) {
+		job->chunkSize = job->scanner->longest;
+	}
+
+	job->chunksCount  = (job->size + job->chunkSize - 1) / job->chunkSize;
+	job->threadsCount = threads;
+	job->failed       = false;
+	job->limit        = LONG_MAX;
+
+	if (job->threadsCount > job->chunksCount) {
+		job->threadsCount = job->chunksCount;
+	}
+
+	if (job->threadsCount > D3D9_SIGNATURE_SCANNER_MAX_THREADS) {
+		job->threadsCount = D3D9_SIGNATURE_SCANNER_MAX_THREADS;
+	}
+
+	if (job->threadsCount < 1) {
+		job->threadsCount = 1;
+	}
+
+	job->chunks = calloc (job->chunksCount + 1, sizeof(D3D9SignatureScannerChunk));
+	job->queues = calloc (job->threadsCount, sizeof(D3D9SignatureScannerQueue));
+
+	if (!job->chunks || !job->queues) {
+		return false;
+	}
+
+	// Each thread starts with a contiguous range of chunks
+	for (int index = 0; index < job->threadsCount; index++) {
+		unsigned long long begin = (unsigned long long) job->chunksCount * index / job->threadsCount;
+		unsigned long long end   = (unsigned long long) job->chunksCount * (index + 1) / job->threadsCount;
+
+		job->queues [index].range = begin | (end << 32);
+		workers [index].job   = job;
+		workers [index].index = index;
+	}
+
+	// The calling thread scans too. The chunks of a thread that can't be started are stolen by the others.
+	for (int index = 1; index < job->threadsCount; index++) {
+		#ifdef _WIN32
+		started [index] = (handles [index] = CreateThread (NULL, 0, D3D9SignatureScanner_thread, &workers [index], 0, NULL)) != NULL;
+		#else
+		started [index] = (pthread_create (&handles [index], NULL, D3D9SignatureScanner_thread, &workers [index]) == 0);
+		#endif
+	}
+
+	D3D9SignatureScanner_work (&workers [0]);
+
+	for (int index = 1; index < job->threadsCount; index++) {
+		if (!started [index]) {
+			continue;
+		}
+
+		#ifdef _WIN32
+		WaitForSingleObject (handles [index], INFINITE);
+		CloseHandle (handles [index]);
+		#else
+		pthread_join (handles [index], NULL);
+		#endif
+	}
+
+	return !job->failed && !job->scanner->cancelled;
+}
+
+/*
+ * Description : Take the next chunk of a thread, or steal the last chunk of another thread
+ * D3D9SignatureScannerJob *job : The job running
+ * int index : Index of the thread
+ * Return : int the index of the chunk, or -1 if no chunk is left
+ */
+static int
+D3D9SignatureScanner_take_chunk (
+	D3D9SignatureScannerJob *job,
+	int index
+) {
+	for (int victim = 0; victim < job->threadsCount; victim++) {
+		// Start with the own queue of the thread
+		D3D9SignatureScannerQueue *queue = &job->queues [(index + victim) % job->threadsCount];
+		unsigned long long range;
+
+		while (true) {
+			// Read the range atomically : a 64 bits read can be torn on 32 bits CPUs
+			range = __sync_fetch_and_add (&queue->range, 0);
+			unsigned long long begin = range & 0xFFFFFFFF;
+			unsigned long long end   = range >> 32;
+
+			if (begin >= end) {
+				break;
+			}
+
+			if (victim == 0) {
+				if (__sync_bool_compare_and_swap (&queue->range, range, (begin + 1) | (end << 32))) {
+					return begin;
+				}
+			}
+			else {
+				if (__sync_bool_compare_and_swap (&queue->range, range, begin | ((end - 1) << 32))) {
+					return end - 1;
+				}
+			}
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Description : Scan chunks until no thread has any left
+ * D3D9SignatureScannerWorker *worker : The thread scanning
+ * Return : void
+ */
+static void
+D3D9SignatureScanner_work (
+	D3D9SignatureScannerWorker *worker
+) {
+	D3D9SignatureScannerJob *job = worker->job;
+	int chunk;
+
+	while ((chunk = D3D9SignatureScanner_take_chunk (job, worker->index)) != -1) {
+		size_t base = (size_t) chunk * job->chunkSize;
+		size_t length = job->chunkSize + job->scanner->longest - 1;
+		bool stopped = false;
+
+		// The remaining chunks are only emptied once the scan is cancelled or every first match is known
+		if (job->scanner->cancelled || job->failed || chunk > job->limit) {
+			continue;
+		}
+
+		if (length > job->size - base) {
+			length = job->size - base;
+		}
+
+		worker->chunk = chunk;
+		job->pass (job->scanner, job->buffer + base, length, D3D9SignatureScanner_on_chunk_match, worker, &stopped);
+
+		if (job->firstOnly) {
+			long last = 0;
+
+			// Once every signature is found, the chunks after the last first match can't change the result
+			for (int index = 0; index < job->scanner->signaturesCount; index++) {
+				if (job->firstChunks [index] > last) {
+					last = job->firstChunks [index];
+				}
+			}
+
+			while (true) {
+				long limit = job->limit;
+
+				if (last >= limit || __sync_bool_compare_and_swap (&job->limit, limit, last)) {
+					break;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Description : Keep a match found in the chunk scanned by a thread
+ * Same parameters and return as D3D9SignatureScannerCallback. userData is the D3D9SignatureScannerWorker.
+ */
+static bool
+D3D9SignatureScanner_on_chunk_match (
+	void *userData,
+	int signature,
+	size_t offset
+) {
+	D3D9SignatureScannerWorker *worker = userData;
+	D3D9SignatureScannerJob *job = worker->job;
+	D3D9SignatureScannerChunk *chunk = &job->chunks [worker->chunk];
+
+	if (job->scanner->cancelled || job->failed) {
+		return false;
+	}
+
+	// The matches starting in the overlap belong to the next chunk
+	if (offset >= job->chunkSize) {
+		return true;
+	}
+
+	if (job->firstOnly) {
+		long first;
+
+		// The matches of a signature come by increasing offset : only the first one of the chunk is kept
+		for (int index = 0; index < chunk->count; index++) {
+			if (chunk->matches [index].signature == signature) {
+				return true;
+			}
+		}
+
+		while ((first = job->firstChunks [signature]) > worker->chunk) {
+			if (__sync_bool_compare_and_swap (&job->firstChunks [signature], first, worker->chunk)) {
+				break;
+			}
+		}
+	}
+
+	if (chunk->count == chunk->capacity) {
+		int capacity = (chunk->capacity) ? chunk->capacity * 2 : 16;
+		D3D9SignatureMatch *matches;
+
+		if ((matches = realloc (chunk->matches, sizeof(D3D9SignatureMatch) * capacity)) == NULL) {
+			job->failed = true;
+			return false;
+		}
+
+		chunk->matches = matches;
+		chunk->capacity = capacity;
+	}
+
+	chunk->matches [chunk->count].offset    = (size_t) worker->chunk * job->chunkSize + offset;
+	chunk->matches [chunk->count].signature = signature;
+	chunk->count++;
+
+	// Every signature has been found in this chunk
+	return !(job->firstOnly && chunk->count == job->scanner->signaturesCount);
+}
+
+/*
+ * Description : Order the matches by offset, then by signature
+ * const void *a, const void *b : Two D3D9SignatureMatch
+ * Return : int like strcmp
+ */
+static int
+D3D9SignatureMatch_compare (
+	const void *a,
+	const void *b
+) {
+	const D3D9SignatureMatch *matchA = a;
+	const D3D9SignatureMatch *matchB = b;
+
+	if (matchA->offset != matchB->offset) {
+		return (matchA->offset < matchB->offset) ? -1 : 1;
+	}
+
+	return matchA->signature - matchB->signature;
+}
+
+/*
+ * Description : Free the matches of a job
+ * D3D9SignatureScannerJob *job : A job ran by D3D9SignatureScanner_run
+ * Return : void
+ */
+static void
+D3D9SignatureScanner_free_job (
+	D3D9SignatureScannerJob *job
+) {
+	if (job->chunks) {
+		for (int index = 0; index < job->chunksCount; index++) {
+			free (job->chunks [index].matches);
+		}
+	}
+
+	free (job->chunks);
+	free (job->queues);
+}
+
+/*
+ * Description : Search all the signatures in a buffer split in overlapping chunks, scanned by a pool of threads.
+ *               The threads steal the chunks of each other when they run out of work.
+ *               The matches are reported from the calling thread once all the chunks are scanned,
+ *               by increasing offset then signature, so the result doesn't depend on the scheduling.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * int threads : Number of threads scanning, 0 for one per processor
+ * D3D9SignatureScannerCallback callback : Called for each match
+ * void *userData : Passed to the callback
+ * Return : int the number of matches reported, or -1 if the scan has been cancelled or failed
+ */
+int
+D3D9SignatureScanner_scan_parallel (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	int threads,
+	D3D9SignatureScannerCallback callback,
+	void *userData
+) {
+	D3D9SignatureScannerJob job = {
+		.scanner   = this,
+		.buffer    = buffer,
+		.size      = size,
+		.firstOnly = false
+	};
+	int found = 0;
+
+	this->cancelled = false;
+
+	if (!D3D9SignatureScanner_run (&job, threads)) {
+		D3D9SignatureScanner_free_job (&job);
+		return -1;
+	}
+
+	// The chunks are in order of address : sorting each of them sorts all the matches
+	for (int index = 0; index < job.chunksCount; index++) {
+		D3D9SignatureScannerChunk *chunk = &job.chunks [index];
+
+		// qsort mustn't be given the NULL matches of an empty chunk
+		if (chunk->count > 1) {
+			qsort (chunk->matches, chunk->count, sizeof(D3D9SignatureMatch), D3D9SignatureMatch_compare);
+		}
+
+		for (int match = 0; match < chunk->count; match++) {
+			found++;
+
+			if (!callback (userData, chunk->matches [match].signature, chunk->matches [match].offset)) {
+				D3D9SignatureScanner_free_job (&job);
+				return found;
+			}
+		}
+	}
+
+	D3D9SignatureScanner_free_job (&job);
+
+	return found;
+}
+
+/*
+ * Description : Get the offset of the first match of each signature with a pool of threads.
+ *               The chunks following the first match of every signature are skipped.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * int threads : Number of threads scanning, 0 for one per processor
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : int the number of signatures found, or -1 if the scan has been cancelled or failed
+ */
+int
+D3D9SignatureScanner_find_first_parallel (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	int threads,
+	size_t *offsets
+) {
+	D3D9SignatureScannerJob job = {
+		.scanner   = this,
+		.buffer    = buffer,
+		.size      = size,
+		.firstOnly = true
+	};
+	int found = 0;
+
+	for (int index = 0; index < this->signaturesCount; index++) {
+		offsets [index] = D3D9_SIGNATURE_NOT_FOUND;
+	}
+
+	if (this->signaturesCount <= 0) {
+		return 0;
+	}
+
+	if ((job.firstChunks = malloc (sizeof(long) * this->signaturesCount)) == NULL) {
+		return -1;
+	}
+
+	for (int index = 0; index < this->signaturesCount; index++) {
+		job.firstChunks [index] = LONG_MAX;
+	}
+
+	this->cancelled = false;
+
+	if (!D3D9SignatureScanner_run (&job, threads)) {
+		D3D9SignatureScanner_free_job (&job);
+		free ((void *) job.firstChunks);
+		return -1;
+	}
+
+	// The first chunk matching a signature holds its first match
+	for (int index = 0; index < this->signaturesCount; index++) {
+		if (job.firstChunks [index] == LONG_MAX) {
+			continue;
+		}
+
+		D3D9SignatureScannerChunk *chunk = &job.chunks [job.firstChunks [index]];
+
+		for (int match = 0; match < chunk->count; match++) {
+			if (chunk->matches [match].signature == index) {
+				offsets [index] = chunk->matches [match].offset;
+				found++;
+			}
+		}
+	}
+
+	D3D9SignatureScanner_free_job (&job);
+	free ((void *) job.firstChunks);
+
+	return found;
+}
+
+/*
+ * Description : Cancel the parallel scan running. It returns -1 as soon as the threads notice it.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * Return : void
+ */
+void
+D3D9SignatureScanner_cancel (
+	D3D9SignatureScanner *this
+) {
+	this->cancelled = true;
+}
+
+/*
+ * Description : Check if a signature matches at an offset of a buffer, for instance an offset found by a previous scan
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * unsigned char *buffer : The memory to check
+ * size_t size : Size of the buffer
+ * size_t offset : Offset of the signature
+ * Return : bool true if all the significant bytes of the signature match
+ */
+bool
+D3D9SignatureScanner_matches (
+	D3D9SignatureScanner *this,
+	int signature,
+	unsigned char *buffer,
+	size_t size,
+	size_t offset
+) {
+	D3D9Signature *compiled = &this->signatures [signature];
+
+	if (offset > size || size - offset < (size_t) compiled->size) {
+		return false;
+	}
+
+	for (int index = 0; index < compiled->size; index++) {
+		if ((buffer [offset + index] & compiled->mask [index]) != compiled->bytes [index]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Read the bytes marked in the result mask of a signature, in little endian
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * unsigned char *buffer : The memory scanned
+ * size_t offset : Offset of a match of the signature
+ * Return : unsigned int the value read, or the offset if the signature has no result mask
+ */
+unsigned int
+D3D9SignatureScanner_get_result (
+	D3D9SignatureScanner *this,
+	int signature,
+	unsigned char *buffer,
+	size_t offset
+) {
+	D3D9Signature *compiled = &this->signatures [signature];
+	unsigned int result = 0;
+
+	if (compiled->resultSize == 0) {
+		return offset;
+	}
+
+	for (int index = compiled->resultSize - 1; index >= 0; index--) {
+		result = (result << 8) | buffer [offset + compiled->resultOffset + index];
+	}
+
+	return result;
+}
+
+/*
+ * Description : Free an allocated D3D9SignatureScanner structure.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner to free.
+ */
+void
+D3D9SignatureScanner_free (
+	D3D9SignatureScanner *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	for (int index = 0; index < this->signaturesCount; index++) {
+		free (this->signatures [index].name);
+		free (this->signatures [index].bytes);
+		free (this->signatures [index].mask);
+	}
+
+	for (int index = 0; index < this->anchorsCount; index++) {
+		free (this->anchors [index].signatures);
+	}
+
+	free (this->signatures);
+	free (this->anchors);
+	free (this);
+}
@@ -0,0 +1,252 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// Returned by D3D9SignatureScanner_find_first for the signatures not found
+#define D3D9_SIGNATURE_NOT_FOUND ((size_t) -1)
+// Bytes of the buffer scanned by a task of the parallel scan. The chunks overlap by the size of the longest signature.
+#define D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE (1024 * 1024)
+// Maximum number of threads of the parallel scan
+#define D3D9_SIGNATURE_SCANNER_MAX_THREADS        64
+
+// ------ Structure declaration -------
+
+// Masked byte pattern compiled by D3D9SignatureScanner_add
+typedef struct
+{
+	char *name;
+
+	// A byte matches when (byte & mask) == bytes
+	unsigned char *bytes;
+	unsigned char *mask;
+	int size;
+
+	// Offset of the anchor in the pattern
+	int anchor;
+
+	// Bytes extracted by D3D9SignatureScanner_get_result
+	int resultOffset;
+	int resultSize;
+
+}	D3D9Signature;
+
+// Group of signatures filtered by the same anchor : one or two consecutive significant bytes
+typedef struct
+{
+	unsigned char first;
+	unsigned char second;
+	bool pair;
+
+	int *signatures;
+	int count;
+
+}	D3D9SignatureAnchor;
+
+// Match of a signature in a buffer
+typedef struct
+{
+	size_t offset;
+	int signature;
+
+}	D3D9SignatureMatch;
+
+// Called for each match found. Return false to stop the scan.
+typedef bool (*D3D9SignatureScannerCallback) (void *userData, int signature, size_t offset);
+
+// Search many masked signatures in a single pass over a buffer.
+// Candidates are found by comparing the anchors of all the signatures with SIMD instructions,
+// then verified against the complete pattern. It doesn't depend on Windows, so it can be used and tested on its own.
+typedef struct
+{
+	D3D9Signature *signatures;
+	int signaturesCount;
+	int signaturesCapacity;
+
+	D3D9SignatureAnchor *anchors;
+	int anchorsCount;
+	int anchorsCapacity;
+
+	// Size of the longest signature
+	int longest;
+
+	// Set by D3D9SignatureScanner_cancel, checked between the chunks and the matches of a parallel scan
+	volatile bool cancelled;
+
+}	D3D9SignatureScanner;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9SignatureScanner structure.
+ * Return : A pointer to an allocated D3D9SignatureScanner.
+ */
+D3D9SignatureScanner *
+D3D9SignatureScanner_new (
+	void
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9SignatureScanner structure.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SignatureScanner_init (
+	D3D9SignatureScanner *this
+);
+
+/*
+ * Description : Compile a signature and add it to the scanner. The masks have the format of mem_scanner.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * char *name : Name of the signature
+ * unsigned char *pattern : Bytes of the signature
+ * char *searchMask : 'x' for the bytes to compare, '?' for the wildcards. Its length is the size of the pattern.
+ * char *resultMask : '?' for the bytes returned by D3D9SignatureScanner_get_result, or NULL
+ * Return : int the index of the signature, or -1 on error
+ */
+int
+D3D9SignatureScanner_add (
+	D3D9SignatureScanner *this,
+	char *name,
+	unsigned char *pattern,
+	char *searchMask,
+	char *resultMask
+);
+
+/*
+ * Description : Search all the signatures in a buffer, in a single pass.
+ *               The matches of a signature are reported in increasing order of offset.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * D3D9SignatureScannerCallback callback : Called for each match
+ * void *userData : Passed to the callback
+ * Return : int the number of matches reported
+ */
+int
+D3D9SignatureScanner_scan (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	D3D9SignatureScannerCallback callback,
+	void *userData
+);
+
+/*
+ * Description : Get the offset of the first match of each signature. The scan stops once all of them are found.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : int the number of signatures found
+ */
+int
+D3D9SignatureScanner_find_first (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	size_t *offsets
+);
+
+/*
+ * Description : Search all the signatures in a buffer split in overlapping chunks, scanned by a pool of threads.
+ *               The threads steal the chunks of each other when they run out of work.
+ *               The matches are reported from the calling thread once all the chunks are scanned,
+ *               by increasing offset then signature, so the result doesn't depend on the scheduling.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * int threads : Number of threads scanning, 0 for one per processor
+ * D3D9SignatureScannerCallback callback : Called for each match
+ * void *userData : Passed to the callback
+ * Return : int the number of matches reported, or -1 if the scan has been cancelled or failed
+ */
+int
+D3D9SignatureScanner_scan_parallel (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	int threads,
+	D3D9SignatureScannerCallback callback,
+	void *userData
+);
+
+/*
+ * Description : Get the offset of the first match of each signature with a pool of threads.
+ *               The chunks following the first match of every signature are skipped.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * unsigned char *buffer : The memory to scan
+ * size_t size : Size of the buffer
+ * int threads : Number of threads scanning, 0 for one per processor
+ * size_t *offsets : Output of one offset per signature, D3D9_SIGNATURE_NOT_FOUND if it isn't found
+ * Return : int the number of signatures found, or -1 if the scan has been cancelled or failed
+ */
+int
+D3D9SignatureScanner_find_first_parallel (
+	D3D9SignatureScanner *this,
+	unsigned char *buffer,
+	size_t size,
+	int threads,
+	size_t *offsets
+);
+
+/*
+ * Description : Cancel the parallel scan running. It returns -1 as soon as the threads notice it.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * Return : void
+ */
+void
+D3D9SignatureScanner_cancel (
+	D3D9SignatureScanner *this
+);
+
+/*
+ * Description : Check if a signature matches at an offset of a buffer, for instance an offset found by a previous scan
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * unsigned char *buffer : The memory to check
+ * size_t size : Size of the buffer
+ * size_t offset : Offset of the signature
+ * Return : bool true if all the significant bytes of the signature match
+ */
+bool
+D3D9SignatureScanner_matches (
+	D3D9SignatureScanner *this,
+	int signature,
+	unsigned char *buffer,
+	size_t size,
+	size_t offset
+);
+
+/*
+ * Description : Read the bytes marked in the result mask of a signature, in little endian
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner
+ * int signature : Index of the signature
+ * unsigned char *buffer : The memory scanned
+ * size_t offset : Offset of a match of the signature
+ * Return : unsigned int the value read, or the offset if the signature has no result mask
+ */
+unsigned int
+D3D9SignatureScanner_get_result (
+	D3D9SignatureScanner *this,
+	int signature,
+	unsigned char *buffer,
+	size_t offset
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9SignatureScanner structure.
+ * D3D9SignatureScanner *this : An allocated D3D9SignatureScanner to free.
+ */
+void
+D3D9SignatureScanner_free (
+	D3D9SignatureScanner *this
+);
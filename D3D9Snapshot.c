@@ -0,0 +1,302 @@
+#include "D3D9Snapshot.h"
+#include <stdlib.h>
+
+// Pointer linking an object removed to the next one
+#define D3D9SnapshotExchange_link(this, object) \
+	((void **) ((char *) (object) + (this)->linkOffset))
+
+// Private headers
+/*
+ * Description : Reuse the snapshots replaced that the reader doesn't use anymore
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : void
+ */
+static void D3D9SnapshotExchange_reclaim (D3D9SnapshotExchange *this);
+
+
+/*
+ * Description : Allocate a new D3D9SnapshotExchange structure.
+ * size_t linkOffset : Offset of the pointer linking the objects removed, in the objects
+ * Return : A pointer to an allocated D3D9SnapshotExchange.
+ */
+D3D9SnapshotExchange *
+D3D9SnapshotExchange_new (
+	size_t linkOffset
+) {
+	D3D9SnapshotExchange *this;
+
+	if ((this = calloc (1, sizeof(D3D9SnapshotExchange))) == NULL)
+		return NULL;
+
+	D3D9SnapshotExchange_init (this, linkOffset);
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9SnapshotExchange structure.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange to initialize.
+ * size_t linkOffset : Offset of the pointer linking the objects removed, in the objects
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_init (
+	D3D9SnapshotExchange *this,
+	size_t linkOffset
+) {
+	this->published   = NULL;
+	this->reading     = NULL;
+	this->retired     = NULL;
+	this->spares      = NULL;
+	this->sparesCount = 0;
+	this->serial      = 0;
+	this->removed     = NULL;
+	this->reclaimable = NULL;
+	this->linkOffset  = linkOffset;
+	this->stats       = (D3D9SnapshotStats) {0};
+}
+
+/*
+ * Description : Get a block replaced by a previous publication to build the next snapshot.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * int capacity : Number of rows needed
+ * Return : D3D9Snapshot * a block of at least capacity rows, or NULL if the writer must allocate one
+ */
+D3D9Snapshot *
+D3D9SnapshotExchange_get_spare (
+	D3D9SnapshotExchange *this,
+	int capacity
+) {
+	D3D9SnapshotExchange_reclaim (this);
+
+	while (this->spares)
+	{
+		D3D9Snapshot *snapshot = this->spares;
+
+		this->spares = snapshot->next;
+		this->sparesCount--;
+
+		if (snapshot->capacity >= capacity) {
+			snapshot->next = NULL;
+			__sync_fetch_and_add (&this->stats.reuses, 1);
+			return snapshot;
+		}
+
+		// Too small for the draw list that grew : the writer allocates a larger one
+		free (snapshot);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Remove an object from the next snapshots. It is given back to the reader once no snapshot it can read references it.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * void *object : An object that the snapshot published may reference, and the next ones won't
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_remove (
+	D3D9SnapshotExchange *this,
+	void *object
+) {
+	// Linked through the object itself, so removing never fails
+	*D3D9SnapshotExchange_link (this, object) = this->removed;
+	this->removed = object;
+	__sync_fetch_and_add (&this->stats.removed, 1);
+}
+
+/*
+ * Description : Publish a snapshot built by a writer, so the reader reads it from its next acquisition.
+ *               The snapshot replaced is reused by the next publications once the reader doesn't use it.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * D3D9Snapshot *snapshot : A block allocated with malloc or given by D3D9SnapshotExchange_get_spare, filled with the new rows
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_publish (
+	D3D9SnapshotExchange *this,
+	D3D9Snapshot *snapshot
+) {
+	D3D9Snapshot *previous;
+	void *removed = this->removed;
+
+	snapshot->serial = ++this->serial;
+	snapshot->next = NULL;
+
+	// The rows are written before the pointer is visible to the reader
+	previous = __atomic_exchange_n (&this->published, snapshot, __ATOMIC_SEQ_CST);
+	__sync_fetch_and_add (&this->stats.publications, 1);
+
+	if (previous) {
+		previous->next = this->retired;
+		this->retired = previous;
+	}
+
+	// The objects removed aren't in the new snapshot : once the reader releases the one it reads, it can't find them anymore.
+	if (removed) {
+		void *last = removed;
+		void *head;
+
+		while (*D3D9SnapshotExchange_link (this, last)) {
+			last = *D3D9SnapshotExchange_link (this, last);
+		}
+
+		this->removed = NULL;
+
+		// Only the reader takes the list, all at once : the push can't be mistaken by a head popped and pushed again
+		do {
+			head = __atomic_load_n (&this->reclaimable, __ATOMIC_ACQUIRE);
+			*D3D9SnapshotExchange_link (this, last) = head;
+		} while (!__atomic_compare_exchange_n (&this->reclaimable, &head, removed, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	D3D9SnapshotExchange_reclaim (this);
+}
+
+/*
+ * Description : Reuse the snapshots replaced that the reader doesn't use anymore
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : void
+ */
+static void
+D3D9SnapshotExchange_reclaim (
+	D3D9SnapshotExchange *this
+) {
+	// Read after the snapshots have been replaced : if the reader announces one of them later,
+	// it sees that it isn't published anymore and reads the current one instead.
+	D3D9Snapshot *reading = __atomic_load_n (&this->reading, __ATOMIC_SEQ_CST);
+	D3D9Snapshot **link = &this->retired;
+
+	while (*link)
+	{
+		D3D9Snapshot *snapshot = *link;
+
+		if (snapshot == reading) {
+			link = &snapshot->next;
+			continue;
+		}
+
+		*link = snapshot->next;
+
+		if (this->sparesCount < D3D9_SNAPSHOT_MAX_SPARES) {
+			snapshot->next = this->spares;
+			this->spares = snapshot;
+			this->sparesCount++;
+		} else {
+			free (snapshot);
+		}
+	}
+}
+
+/*
+ * Description : Get the last snapshot published, without waiting. It isn't reused before D3D9SnapshotExchange_release.
+ *               /!\ Reader only.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : D3D9Snapshot * the snapshot to read, NULL if nothing has been published yet
+ */
+D3D9Snapshot *
+D3D9SnapshotExchange_acquire (
+	D3D9SnapshotExchange *this
+) {
+	D3D9Snapshot *snapshot;
+
+	// Announce the snapshot, then check it is still published : a writer replacing it meanwhile may have missed the announce.
+	// A retry only happens when a publication falls between the two reads.
+	do {
+		snapshot = __atomic_load_n (&this->published, __ATOMIC_ACQUIRE);
+		__atomic_store_n (&this->reading, snapshot, __ATOMIC_SEQ_CST);
+	} while (snapshot != __atomic_load_n (&this->published, __ATOMIC_SEQ_CST));
+
+	return snapshot;
+}
+
+/*
+ * Description : Stop reading the snapshot acquired, and get the objects that no snapshot references anymore.
+ *               /!\ Reader only.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : void * the objects to free, linked through their link, or NULL
+ */
+void *
+D3D9SnapshotExchange_release (
+	D3D9SnapshotExchange *this
+) {
+	void *objects;
+	long long count = 0;
+
+	__atomic_store_n (&this->reading, NULL, __ATOMIC_RELEASE);
+
+	// Removed before a publication that happened before this exchange : the next snapshots acquired don't reference them
+	if (!(objects = __atomic_exchange_n (&this->reclaimable, NULL, __ATOMIC_ACQUIRE))) {
+		return NULL;
+	}
+
+	for (void *object = objects; object; object = *D3D9SnapshotExchange_link (this, object)) {
+		count++;
+	}
+
+	__sync_fetch_and_add (&this->stats.reclaimed, count);
+
+	return objects;
+}
+
+/*
+ * Description : Get the counters of the exchange
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * D3D9SnapshotStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_get_stats (
+	D3D9SnapshotExchange *this,
+	D3D9SnapshotStats *stats
+) {
+	stats->publications = __sync_fetch_and_add (&this->stats.publications, 0);
+	stats->reuses       = __sync_fetch_and_add (&this->stats.reuses, 0);
+	stats->removed      = __sync_fetch_and_add (&this->stats.removed, 0);
+	stats->reclaimed    = __sync_fetch_and_add (&this->stats.reclaimed, 0);
+}
+
+/*
+ * Description : Free the snapshots of an initialized D3D9SnapshotExchange, without freeing the structure.
+ *               The objects removed aren't freed : the reader must have released them first.
+ * D3D9SnapshotExchange *this : An initialized D3D9SnapshotExchange
+ */
+void
+D3D9SnapshotExchange_destroy (
+	D3D9SnapshotExchange *this
+) {
+	D3D9Snapshot *lists [] = {this->retired, this->spares};
+
+	for (int index = 0; index < (int) (sizeof(lists) / sizeof(*lists)); index++) {
+		D3D9Snapshot *snapshot = lists [index];
+
+		while (snapshot) {
+			D3D9Snapshot *next = snapshot->next;
+			free (snapshot);
+			snapshot = next;
+		}
+	}
+
+	free (this->published);
+	D3D9SnapshotExchange_init (this, this->linkOffset);
+}
+
+/*
+ * Description : Free an allocated D3D9SnapshotExchange structure.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange to free.
+ */
+void
+D3D9SnapshotExchange_free (
+	D3D9SnapshotExchange *this
+) {
+	if (this != NULL) {
+		D3D9SnapshotExchange_destroy (this);
+		free (this);
+	}
+}
@@ -0,0 +1,198 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// Number of snapshots replaced kept by the writers to build the next ones, the others are freed
+#define D3D9_SNAPSHOT_MAX_SPARES 2
+
+// Static initializer of a D3D9SnapshotExchange whose removed objects are linked through their field link
+#define D3D9_SNAPSHOT_EXCHANGE_INITIALIZER(type, link) { \
+	.published   = NULL,                                 \
+	.reading     = NULL,                                 \
+	.retired     = NULL,                                 \
+	.spares      = NULL,                                 \
+	.sparesCount = 0,                                    \
+	.serial      = 0,                                    \
+	.removed     = NULL,                                 \
+	.reclaimable = NULL,                                 \
+	.linkOffset  = offsetof (type, link),                \
+	.stats       = {0}                                   \
+}
+
+// ------ Structure declaration -------
+
+// Header of a snapshot, at the beginning of a block allocated with malloc by the writer that built it
+typedef struct _D3D9Snapshot
+{
+	// Publication order of the snapshot
+	unsigned long long serial;
+	// Number of rows the block holds
+	int capacity;
+	// Next snapshot replaced or spare
+	struct _D3D9Snapshot *next;
+
+}	D3D9Snapshot;
+
+typedef struct
+{
+	// Snapshots published, and published in a block reused instead of allocated
+	volatile long long publications;
+	volatile long long reuses;
+	// Objects removed, and freed by the reader
+	volatile long long removed;
+	volatile long long reclaimed;
+
+}	D3D9SnapshotStats;
+
+// Exchange of the snapshots between the writers, serialized by a lock of the caller, and a single reader that never waits :
+// a writer builds the next snapshot aside and publishes it with one atomic pointer swap.
+// The reader announces the snapshot it reads, so the writers reuse the blocks of the others without allocating.
+// The objects removed are given back to the reader when it releases its snapshot : none of the snapshots
+// it can read from then references them.
+typedef struct
+{
+	// Last snapshot published, and the one the reader is using, NULL between two reads
+	D3D9Snapshot * volatile published;
+	D3D9Snapshot * volatile reading;
+
+	// Writers side : snapshots replaced that the reader may still use, and blocks free to build the next snapshots
+	D3D9Snapshot *retired;
+	D3D9Snapshot *spares;
+	int sparesCount;
+	unsigned long long serial;
+	// Objects removed since the last publication, still referenced by the snapshot published
+	void *removed;
+
+	// Objects removed before a publication, taken by the reader
+	void * volatile reclaimable;
+	// Offset of the pointer linking the objects removed
+	size_t linkOffset;
+
+	D3D9SnapshotStats stats;
+
+}	D3D9SnapshotExchange;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9SnapshotExchange structure.
+ * size_t linkOffset : Offset of the pointer linking the objects removed, in the objects
+ * Return : A pointer to an allocated D3D9SnapshotExchange.
+ */
+D3D9SnapshotExchange *
+D3D9SnapshotExchange_new (
+	size_t linkOffset
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9SnapshotExchange structure.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange to initialize.
+ * size_t linkOffset : Offset of the pointer linking the objects removed, in the objects
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_init (
+	D3D9SnapshotExchange *this,
+	size_t linkOffset
+);
+
+/*
+ * Description : Get a block replaced by a previous publication to build the next snapshot.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * int capacity : Number of rows needed
+ * Return : D3D9Snapshot * a block of at least capacity rows, or NULL if the writer must allocate one
+ */
+D3D9Snapshot *
+D3D9SnapshotExchange_get_spare (
+	D3D9SnapshotExchange *this,
+	int capacity
+);
+
+/*
+ * Description : Remove an object from the next snapshots. It is given back to the reader once no snapshot it can read references it.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * void *object : An object that the snapshot published may reference, and the next ones won't
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_remove (
+	D3D9SnapshotExchange *this,
+	void *object
+);
+
+/*
+ * Description : Publish a snapshot built by a writer, so the reader reads it from its next acquisition.
+ *               The snapshot replaced is reused by the next publications once the reader doesn't use it.
+ *               /!\ Writers only, with the lock of the caller held.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * D3D9Snapshot *snapshot : A block allocated with malloc or given by D3D9SnapshotExchange_get_spare, filled with the new rows
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_publish (
+	D3D9SnapshotExchange *this,
+	D3D9Snapshot *snapshot
+);
+
+/*
+ * Description : Get the last snapshot published, without waiting. It isn't reused before D3D9SnapshotExchange_release.
+ *               /!\ Reader only.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : D3D9Snapshot * the snapshot to read, NULL if nothing has been published yet
+ */
+D3D9Snapshot *
+D3D9SnapshotExchange_acquire (
+	D3D9SnapshotExchange *this
+);
+
+/*
+ * Description : Stop reading the snapshot acquired, and get the objects that no snapshot references anymore.
+ *               /!\ Reader only.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * Return : void * the objects to free, linked through their link, or NULL
+ */
+void *
+D3D9SnapshotExchange_release (
+	D3D9SnapshotExchange *this
+);
+
+/*
+ * Description : Get the counters of the exchange
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange
+ * D3D9SnapshotStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9SnapshotExchange_get_stats (
+	D3D9SnapshotExchange *this,
+	D3D9SnapshotStats *stats
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free the snapshots of an initialized D3D9SnapshotExchange, without freeing the structure.
+ *               The objects removed aren't freed : the reader must have released them first.
+ * D3D9SnapshotExchange *this : An initialized D3D9SnapshotExchange
+ */
+void
+D3D9SnapshotExchange_destroy (
+	D3D9SnapshotExchange *this
+);
+
+/*
+ * Description : Free an allocated D3D9SnapshotExchange structure.
+ * D3D9SnapshotExchange *this : An allocated D3D9SnapshotExchange to free.
+ */
+void
+D3D9SnapshotExchange_free (
+	D3D9SnapshotExchange *this
+);
@@ -0,0 +1,436 @@
+#include "D3D9SpatialGrid.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Private headers
+/*
+ * Description : Get the cell coordinate of a position, clamped to the grid
+ * int position : Position in pixels
+ * int cellSize : Size of a cell in pixels
+ * int cells : Number of cells on this axis
+ * Return : int the index of the cell
+ */
+static int D3D9SpatialGrid_get_cell (int position, int cellSize, int cells);
+
+/*
+ * Description : Add an item to a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * D3D9SpatialGridItem *item : Bounds of the item
+ * Return : bool true on success, false otherwise
+ */
+static bool D3D9SpatialGridCell_add (D3D9SpatialGridCell *cell, int handle, D3D9SpatialGridItem *item);
+
+/*
+ * Description : Find the entry of an item in a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * Return : D3D9SpatialGridEntry * the entry of the item, NULL if it isn't in the cell
+ */
+static D3D9SpatialGridEntry *D3D9SpatialGridCell_find (D3D9SpatialGridCell *cell, int handle);
+
+/*
+ * Description : Copy the bounds of an item in an entry
+ * D3D9SpatialGridEntry *entry : An entry of a cell
+ * int handle : Handle of the item
+ * D3D9SpatialGridItem *item : Bounds of the item
+ * Return : void
+ */
+static void D3D9SpatialGridEntry_set (D3D9SpatialGridEntry *entry, int handle, D3D9SpatialGridItem *item);
+
+/*
+ * Description : Remove a handle from a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * Return : void
+ */
+static void D3D9SpatialGridCell_remove (D3D9SpatialGridCell *cell, int handle);
+
+
+/*
+ * Description : Allocate a new D3D9SpatialGrid structure.
+ * int cellSize : Size of a cell in pixels
+ * int columns, int rows : Number of cells of the grid
+ * Return : A pointer to an allocated D3D9SpatialGrid.
+ */
+D3D9SpatialGrid *
+D3D9SpatialGrid_new (
+	int cellSize,
+	int columns, int rows
+) {
+	D3D9SpatialGrid *this;
+
+	if ((this = calloc (1, sizeof(D3D9SpatialGrid))) == NULL)
+		return NULL;
+
+	if (!D3D9SpatialGrid_init (this, cellSize, columns, rows)) {
+		D3D9SpatialGrid_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9SpatialGrid structure.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid to initialize.
+ * int cellSize : Size of a cell in pixels
+ * int columns, int rows : Number of cells of the grid
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SpatialGrid_init (
+	D3D9SpatialGrid *this,
+	int cellSize,
+	int columns, int rows
+) {
+	this->cellSize      = cellSize;
+	this->columns       = columns;
+	this->rows          = rows;
+	this->items         = NULL;
+	this->itemsCapacity = 0;
+
+	if ((this->cells = calloc (columns * rows, sizeof(D3D9SpatialGridCell))) == NULL) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Description : Get the cell coordinate of a position, clamped to the grid
+ * int position : Position in pixels
+ * int cellSize : Size of a cell in pixels
+ * int cells : Number of cells on this axis
+ * Return : int the index of the cell
+ */
+static int
+D3D9SpatialGrid_get_cell (
+	int position,
+	int cellSize,
+	int cells
+) {
+	if (position < 0) {
+		return 0;
+	}
+
+	position /= cellSize;
+
+	return (position >= cells) ? cells - 1 : position;
+}
+
+/*
+ * Description : Insert an item or update its bounds. Only the cells entered or left by the item are modified.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int handle : Handle of the item
+ * int x, int y, int w, int h : Bounds of the item. Empty bounds remove the item.
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SpatialGrid_update (
+	D3D9SpatialGrid *this,
+	int handle,
+	int x, int y, int w, int h
+) {
+	D3D9SpatialGridItem *item, moved;
+
+	if (w <= 0 || h <= 0) {
+		D3D9SpatialGrid_remove (this, handle);
+		return true;
+	}
+
+	// Grow the items table
+	if (handle >= this->itemsCapacity) {
+		int capacity = (this->itemsCapacity) ? this->itemsCapacity : 64;
+		D3D9SpatialGridItem *items;
+
+		while (capacity <= handle) {
+			capacity *= 2;
+		}
+
+		if ((items = realloc (this->items, sizeof(D3D9SpatialGridItem) * capacity)) == NULL) {
+			return false;
+		}
+
+		memset (&items [this->itemsCapacity], 0, sizeof(D3D9SpatialGridItem) * (capacity - this->itemsCapacity));
+		this->items = items;
+		this->itemsCapacity = capacity;
+	}
+
+	item  = &this->items [handle];
+	moved = (D3D9SpatialGridItem) {
+		.x        = x,
+		.y        = y,
+		.w        = w,
+		.h        = h,
+		.left     = D3D9SpatialGrid_get_cell (x, this->cellSize, this->columns),
+		.top      = D3D9SpatialGrid_get_cell (y, this->cellSize, this->rows),
+		.right    = D3D9SpatialGrid_get_cell (x + w - 1, this->cellSize, this->columns),
+		.bottom   = D3D9SpatialGrid_get_cell (y + h - 1, this->cellSize, this->rows),
+		.inserted = true
+	};
+
+	// Leave the cells not covered anymore
+	if (item->inserted) {
+		for (int row = item->top; row <= item->bottom; row++) {
+			for (int column = item->left; column <= item->right; column++) {
+				if (column < moved.left || column > moved.right || row < moved.top || row > moved.bottom) {
+					D3D9SpatialGridCell_remove (&this->cells [row * this->columns + column], handle);
+				}
+			}
+		}
+	}
+
+	// Enter the new cells, and copy the new bounds in the cells kept
+	for (int row = moved.top; row <= moved.bottom; row++) {
+		for (int column = moved.left; column <= moved.right; column++) {
+			D3D9SpatialGridCell *cell = &this->cells [row * this->columns + column];
+			D3D9SpatialGridEntry *entry;
+
+			if (item->inserted && column >= item->left && column <= item->right && row >= item->top && row <= item->bottom
+			&& (entry = D3D9SpatialGridCell_find (cell, handle))) {
+				D3D9SpatialGridEntry_set (entry, handle, &moved);
+				continue;
+			}
+
+			if (!D3D9SpatialGridCell_add (cell, handle, &moved)) {
+				// Some cells have been entered : take the item out of the new range, it is not indexed anymore
+				*item = moved;
+				D3D9SpatialGrid_remove (this, handle);
+				return false;
+			}
+		}
+	}
+
+	*item = moved;
+
+	return true;
+}
+
+/*
+ * Description : Remove an item from the grid
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int handle : Handle of the item
+ * Return : void
+ */
+void
+D3D9SpatialGrid_remove (
+	D3D9SpatialGrid *this,
+	int handle
+) {
+	D3D9SpatialGridItem *item;
+
+	if (handle >= this->itemsCapacity || !this->items [handle].inserted) {
+		return;
+	}
+
+	item = &this->items [handle];
+
+	for (int row = item->top; row <= item->bottom; row++) {
+		for (int column = item->left; column <= item->right; column++) {
+			D3D9SpatialGridCell_remove (&this->cells [row * this->columns + column], handle);
+		}
+	}
+
+	item->inserted = false;
+}
+
+/*
+ * Description : Get the items containing a point. Only the cell of the point is visited.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int x, int y : The point
+ * int *handles : Output of the handles found, in no particular order
+ * int capacity : Maximum number of handles written
+ * Return : int the number of items found, it can be greater than capacity
+ */
+int
+D3D9SpatialGrid_query_point (
+	D3D9SpatialGrid *this,
+	int x, int y,
+	int *handles,
+	int capacity
+) {
+	int column = D3D9SpatialGrid_get_cell (x, this->cellSize, this->columns);
+	int row = D3D9SpatialGrid_get_cell (y, this->cellSize, this->rows);
+	D3D9SpatialGridCell *cell = &this->cells [row * this->columns + column];
+	int found = 0;
+
+	for (int index = 0; index < cell->count; index++) {
+		D3D9SpatialGridEntry *entry = &cell->entries [index];
+
+		if (x >= entry->x && x < entry->x + entry->w && y >= entry->y && y < entry->y + entry->h) {
+			if (found < capacity) {
+				handles [found] = entry->handle;
+			}
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Get the items intersecting a rectangle. Each item is reported once.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int x, int y, int w, int h : The rectangle
+ * int *handles : Output of the handles found, in no particular order
+ * int capacity : Maximum number of handles written
+ * Return : int the number of items found, it can be greater than capacity
+ */
+int
+D3D9SpatialGrid_query_rect (
+	D3D9SpatialGrid *this,
+	int x, int y, int w, int h,
+	int *handles,
+	int capacity
+) {
+	int left, top, right, bottom;
+	int found = 0;
+
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+
+	left   = D3D9SpatialGrid_get_cell (x, this->cellSize, this->columns);
+	top    = D3D9SpatialGrid_get_cell (y, this->cellSize, this->rows);
+	right  = D3D9SpatialGrid_get_cell (x + w - 1, this->cellSize, this->columns);
+	bottom = D3D9SpatialGrid_get_cell (y + h - 1, this->cellSize, this->rows);
+
+	for (int row = top; row <= bottom; row++) {
+		for (int column = left; column <= right; column++) {
+			D3D9SpatialGridCell *cell = &this->cells [row * this->columns + column];
+
+			for (int index = 0; index < cell->count; index++) {
+				D3D9SpatialGridEntry *entry = &cell->entries [index];
+
+				// An item covering many cells of the query is reported only by the first cell they share.
+				// The tests are computed without branch : the handle is written in any case, and kept only if it is found.
+				bool first = (column == ((entry->left > left) ? entry->left : left))
+				           & (row    == ((entry->top > top) ? entry->top : top));
+				bool intersects = (entry->x < x + w) & (x < entry->x + entry->w) & (entry->y < y + h) & (y < entry->y + entry->h);
+
+				if (found < capacity) {
+					handles [found] = entry->handle;
+				}
+
+				found += first & intersects;
+			}
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Add an item to a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * D3D9SpatialGridItem *item : Bounds of the item
+ * Return : bool true on success, false otherwise
+ */
+static bool
+D3D9SpatialGridCell_add (
+	D3D9SpatialGridCell *cell,
+	int handle,
+	D3D9SpatialGridItem *item
+) {
+	if (cell->count == cell->capacity) {
+		int capacity = (cell->capacity) ? cell->capacity * 2 : 8;
+		D3D9SpatialGridEntry *entries;
+
+		if ((entries = realloc (cell->entries, sizeof(D3D9SpatialGridEntry) * capacity)) == NULL) {
+			return false;
+		}
+
+		cell->entries = entries;
+		cell->capacity = capacity;
+	}
+
+	D3D9SpatialGridEntry_set (&cell->entries [cell->count++], handle, item);
+
+	return true;
+}
+
+/*
+ * Description : Find the entry of an item in a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * Return : D3D9SpatialGridEntry * the entry of the item, NULL if it isn't in the cell
+ */
+static D3D9SpatialGridEntry *
+D3D9SpatialGridCell_find (
+	D3D9SpatialGridCell *cell,
+	int handle
+) {
+	for (int index = 0; index < cell->count; index++) {
+		if (cell->entries [index].handle == handle) {
+			return &cell->entries [index];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Remove a handle from a cell
+ * D3D9SpatialGridCell *cell : A cell of the grid
+ * int handle : Handle of the item
+ * Return : void
+ */
+static void
+D3D9SpatialGridCell_remove (
+	D3D9SpatialGridCell *cell,
+	int handle
+) {
+	D3D9SpatialGridEntry *entry;
+
+	if ((entry = D3D9SpatialGridCell_find (cell, handle))) {
+		// The order of the entries in a cell doesn't matter
+		*entry = cell->entries [--cell->count];
+	}
+}
+
+/*
+ * Description : Copy the bounds of an item in an entry
+ * D3D9SpatialGridEntry *entry : An entry of a cell
+ * int handle : Handle of the item
+ * D3D9SpatialGridItem *item : Bounds of the item
+ * Return : void
+ */
+static void
+D3D9SpatialGridEntry_set (
+	D3D9SpatialGridEntry *entry,
+	int handle,
+	D3D9SpatialGridItem *item
+) {
+	entry->handle = handle;
+	entry->x      = item->x;
+	entry->y      = item->y;
+	entry->w      = item->w;
+	entry->h      = item->h;
+	entry->left   = item->left;
+	entry->top    = item->top;
+}
+
+/*
+ * Description : Free an allocated D3D9SpatialGrid structure.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid to free.
+ */
+void
+D3D9SpatialGrid_free (
+	D3D9SpatialGrid *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	if (this->cells) {
+		for (int index = 0; index < this->columns * this->rows; index++) {
+			free (this->cells [index].entries);
+		}
+	}
+
+	free (this->cells);
+	free (this->items);
+	free (this);
+}
@@ -0,0 +1,152 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+// Size of a cell in pixels, and number of cells covering the screen. Bounds outside the grid are clamped to its edges.
+#define D3D9_SPATIAL_GRID_DEFAULT_CELL_SIZE 64
+#define D3D9_SPATIAL_GRID_DEFAULT_COLUMNS   64
+#define D3D9_SPATIAL_GRID_DEFAULT_ROWS      64
+
+// ------ Structure declaration -------
+// Item in a cell, with a copy of its bounds : a query walks the entries of a cell without reading the items table
+typedef struct
+{
+	int handle;
+	int x, y, w, h;
+	// First cell covered by the item
+	int left, top;
+
+}	D3D9SpatialGridEntry;
+
+typedef struct
+{
+	D3D9SpatialGridEntry *entries;
+	int count;
+	int capacity;
+
+}	D3D9SpatialGridCell;
+
+typedef struct
+{
+	int x, y, w, h;
+	// Range of cells covered by the bounds
+	int left, top, right, bottom;
+	bool inserted;
+
+}	D3D9SpatialGridItem;
+
+// Uniform grid indexing rectangles by the cells they cover. Items are identified by small positive handles.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	int cellSize;
+	int columns, rows;
+	D3D9SpatialGridCell *cells;
+
+	// Bounds of the items, indexed by handle
+	D3D9SpatialGridItem *items;
+	int itemsCapacity;
+
+}	D3D9SpatialGrid;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9SpatialGrid structure.
+ * int cellSize : Size of a cell in pixels
+ * int columns, int rows : Number of cells of the grid
+ * Return : A pointer to an allocated D3D9SpatialGrid.
+ */
+D3D9SpatialGrid *
+D3D9SpatialGrid_new (
+	int cellSize,
+	int columns, int rows
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9SpatialGrid structure.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid to initialize.
+ * int cellSize : Size of a cell in pixels
+ * int columns, int rows : Number of cells of the grid
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SpatialGrid_init (
+	D3D9SpatialGrid *this,
+	int cellSize,
+	int columns, int rows
+);
+
+/*
+ * Description : Insert an item or update its bounds. Only the cells entered or left by the item are modified.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int handle : Handle of the item
+ * int x, int y, int w, int h : Bounds of the item. Empty bounds remove the item.
+ * Return : bool true on success, false otherwise
+ */
+bool
+D3D9SpatialGrid_update (
+	D3D9SpatialGrid *this,
+	int handle,
+	int x, int y, int w, int h
+);
+
+/*
+ * Description : Remove an item from the grid
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int handle : Handle of the item
+ * Return : void
+ */
+void
+D3D9SpatialGrid_remove (
+	D3D9SpatialGrid *this,
+	int handle
+);
+
+/*
+ * Description : Get the items containing a point. Only the cell of the point is visited.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int x, int y : The point
+ * int *handles : Output of the handles found, in no particular order
+ * int capacity : Maximum number of handles written
+ * Return : int the number of items found, it can be greater than capacity
+ */
+int
+D3D9SpatialGrid_query_point (
+	D3D9SpatialGrid *this,
+	int x, int y,
+	int *handles,
+	int capacity
+);
+
+/*
+ * Description : Get the items intersecting a rectangle. Each item is reported once.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid
+ * int x, int y, int w, int h : The rectangle
+ * int *handles : Output of the handles found, in no particular order
+ * int capacity : Maximum number of handles written
+ * Return : int the number of items found, it can be greater than capacity
+ */
+int
+D3D9SpatialGrid_query_rect (
+	D3D9SpatialGrid *this,
+	int x, int y, int w, int h,
+	int *handles,
+	int capacity
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9SpatialGrid structure.
+ * D3D9SpatialGrid *this : An allocated D3D9SpatialGrid to free.
+ */
+void
+D3D9SpatialGrid_free (
+	D3D9SpatialGrid *this
+);
@@ -0,0 +1,216 @@
+#include "D3D9SpriteBatch.h"
+#include <stdint.h>
+
+// Private headers
+/*
+ * Description : Draw a sprite between the Begin and the End of the batch
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * D3D9SpriteBatchItem *item : The sprite to draw
+ * Return : void
+ */
+static void D3D9SpriteBatch_draw (D3D9SpriteBatch *this, D3D9SpriteBatchItem *item);
+
+/*
+ * Description : Compare two sprites of a batch by texture, then by order in the batch
+ * const void *a, *b : Two D3D9SpriteBatchItem
+ * Return : int lower, equal or greater than 0
+ */
+static int D3D9SpriteBatchItem_compare (const void *a, const void *b);
+
+
+/*
+ * Description : Allocate a new D3D9SpriteBatch structure.
+ * Return : A pointer to an allocated D3D9SpriteBatch.
+ */
+D3D9SpriteBatch *
+D3D9SpriteBatch_new (
+	void
+) {
+	D3D9SpriteBatch *this;
+
+	if ((this = calloc (1, sizeof(D3D9SpriteBatch))) == NULL)
+		return NULL;
+
+	if (!D3D9SpriteBatch_init (this)) {
+		D3D9SpriteBatch_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9SpriteBatch structure.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SpriteBatch_init (
+	D3D9SpriteBatch *this
+) {
+	*this = (D3D9SpriteBatch) D3D9_SPRITE_BATCH_INITIALIZER;
+
+	return true;
+}
+
+/*
+ * Description : Begin a batch of the shared sprite, and reset the counters of the batch.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch
+ * ID3DXSprite *sprite : The shared sprite
+ * int count : Number of sprites that will be added, to grow the sort buffer once
+ * Return : void
+ */
+void
+D3D9SpriteBatch_begin (
+	D3D9SpriteBatch *this,
+	ID3DXSprite *sprite,
+	int count
+) {
+	// Grow the sort buffer : on failure, the sprites beyond its capacity are drawn in the order they are added
+	if (count > this->itemsCapacity) {
+		D3D9SpriteBatchItem *items;
+		int capacity = (count > D3D9_SPRITE_BATCH_MIN_CAPACITY) ? count * 2 : D3D9_SPRITE_BATCH_MIN_CAPACITY;
+
+		if ((items = realloc (this->items, sizeof(D3D9SpriteBatchItem) * capacity))) {
+			this->items = items;
+			this->itemsCapacity = capacity;
+		}
+	}
+
+	this->sprite         = sprite;
+	this->itemsCount     = 0;
+	this->lastTexture    = NULL;
+	this->textureChanges = 0;
+	this->draws          = 0;
+
+	sprite->lpVtbl->Begin (sprite, D3DXSPRITE_ALPHABLEND);
+}
+
+/*
+ * Description : Queue a sprite until the end of the batch. If the sort buffer couldn't grow, the sprite is drawn now.
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * IDirect3DTexture9 *texture : Texture of the sprite
+ * RECT *source : Part of the texture drawn, or NULL for the whole texture. It must stay valid until the end of the batch.
+ * int x, int y : Position of the sprite
+ * D3DCOLOR color : Color modulating the sprite, its alpha is the opacity
+ * Return : void
+ */
+void
+D3D9SpriteBatch_add (
+	D3D9SpriteBatch *this,
+	IDirect3DTexture9 *texture,
+	RECT *source,
+	int x, int y,
+	D3DCOLOR color
+) {
+	D3D9SpriteBatchItem item = {
+		.texture = texture,
+		.source  = source,
+		.x       = x,
+		.y       = y,
+		.color   = color,
+		.order   = this->itemsCount
+	};
+
+	if (this->itemsCount < this->itemsCapacity) {
+		this->items [this->itemsCount++] = item;
+	} else {
+		D3D9SpriteBatch_draw (this, &item);
+	}
+}
+
+/*
+ * Description : Draw the sprites queued sorted by texture, in the order they were added for a same texture, then end the batch.
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * Return : void
+ */
+void
+D3D9SpriteBatch_end (
+	D3D9SpriteBatch *this
+) {
+	ID3DXSprite *sprite = this->sprite;
+
+	if (this->itemsCount > 1) {
+		qsort (this->items, this->itemsCount, sizeof(D3D9SpriteBatchItem), D3D9SpriteBatchItem_compare);
+	}
+
+	for (int index = 0; index < this->itemsCount; index++) {
+		D3D9SpriteBatch_draw (this, &this->items [index]);
+	}
+
+	sprite->lpVtbl->End (sprite);
+
+	this->sprite = NULL;
+	this->itemsCount = 0;
+}
+
+/*
+ * Description : Draw a sprite between the Begin and the End of the batch
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * D3D9SpriteBatchItem *item : The sprite to draw
+ * Return : void
+ */
+static void
+D3D9SpriteBatch_draw (
+	D3D9SpriteBatch *this,
+	D3D9SpriteBatchItem *item
+) {
+	D3DXVECTOR3 position3D = {item->x, item->y, 0.0};
+
+	if (item->texture != this->lastTexture) {
+		this->lastTexture = item->texture;
+		this->textureChanges++;
+	}
+
+	this->sprite->lpVtbl->Draw (this->sprite, item->texture, item->source, NULL, &position3D, item->color);
+	this->draws++;
+}
+
+/*
+ * Description : Compare two sprites of a batch by texture, then by order in the batch
+ * const void *a, *b : Two D3D9SpriteBatchItem
+ * Return : int lower, equal or greater than 0
+ */
+static int
+D3D9SpriteBatchItem_compare (
+	const void *a,
+	const void *b
+) {
+	const D3D9SpriteBatchItem *itemA = a;
+	const D3D9SpriteBatchItem *itemB = b;
+	uintptr_t textureA = (uintptr_t) itemA->texture;
+	uintptr_t textureB = (uintptr_t) itemB->texture;
+
+	if (textureA != textureB) {
+		return (textureA < textureB) ? -1 : 1;
+	}
+
+	return itemA->order - itemB->order;
+}
+
+/*
+ * Description : Free the sort buffer of an initialized D3D9SpriteBatch, without freeing the structure.
+ * D3D9SpriteBatch *this : An initialized D3D9SpriteBatch
+ */
+void
+D3D9SpriteBatch_destroy (
+	D3D9SpriteBatch *this
+) {
+	free (this->items);
+	D3D9SpriteBatch_init (this);
+}
+
+/*
+ * Description : Free an allocated D3D9SpriteBatch structure.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch to free.
+ */
+void
+D3D9SpriteBatch_free (
+	D3D9SpriteBatch *this
+) {
+	if (this != NULL) {
+		D3D9SpriteBatch_destroy (this);
+		free (this);
+	}
+}
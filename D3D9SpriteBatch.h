@@ -0,0 +1,139 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "dx/d3dx9.h"
+
+// ---------- Defines -------------
+// Minimum number of sprites of the sort buffer
+#define D3D9_SPRITE_BATCH_MIN_CAPACITY 64
+
+#define D3D9_SPRITE_BATCH_INITIALIZER { \
+	.sprite         = NULL,             \
+	.items          = NULL,             \
+	.itemsCount     = 0,                \
+	.itemsCapacity  = 0,                \
+	.lastTexture    = NULL,             \
+	.textureChanges = 0,                \
+	.draws          = 0                 \
+}
+
+// ------ Structure declaration -------
+
+// Sprite queued in a batch, with its position in the batch so sorting by texture is stable
+typedef struct
+{
+	IDirect3DTexture9 *texture;
+	RECT *source;
+	int x, y;
+	D3DCOLOR color;
+	int order;
+
+}	D3D9SpriteBatchItem;
+
+// Sprites drawn between one Begin and one End of a shared ID3DXSprite, grouped by texture
+// so the ID3DXSprite flushes its vertices once per texture.
+typedef struct
+{
+	// Sprite between D3D9SpriteBatch_begin and D3D9SpriteBatch_end, NULL otherwise
+	ID3DXSprite *sprite;
+
+	// Sort buffer, reused from a frame to another
+	D3D9SpriteBatchItem *items;
+	int itemsCount;
+	int itemsCapacity;
+
+	// Texture of the last sprite drawn, and counters of the current batch
+	IDirect3DTexture9 *lastTexture;
+	int textureChanges;
+	int draws;
+
+}	D3D9SpriteBatch;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9SpriteBatch structure.
+ * Return : A pointer to an allocated D3D9SpriteBatch.
+ */
+D3D9SpriteBatch *
+D3D9SpriteBatch_new (
+	void
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9SpriteBatch structure.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch to initialize.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9SpriteBatch_init (
+	D3D9SpriteBatch *this
+);
+
+/*
+ * Description : Begin a batch of the shared sprite, and reset the counters of the batch.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch
+ * ID3DXSprite *sprite : The shared sprite
+ * int count : Number of sprites that will be added, to grow the sort buffer once
+ * Return : void
+ */
+void
+D3D9SpriteBatch_begin (
+	D3D9SpriteBatch *this,
+	ID3DXSprite *sprite,
+	int count
+);
+
+/*
+ * Description : Queue a sprite until the end of the batch. If the sort buffer couldn't grow, the sprite is drawn now.
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * IDirect3DTexture9 *texture : Texture of the sprite
+ * RECT *source : Part of the texture drawn, or NULL for the whole texture. It must stay valid until the end of the batch.
+ * int x, int y : Position of the sprite
+ * D3DCOLOR color : Color modulating the sprite, its alpha is the opacity
+ * Return : void
+ */
+void
+D3D9SpriteBatch_add (
+	D3D9SpriteBatch *this,
+	IDirect3DTexture9 *texture,
+	RECT *source,
+	int x, int y,
+	D3DCOLOR color
+);
+
+/*
+ * Description : Draw the sprites queued sorted by texture, in the order they were added for a same texture, then end the batch.
+ * D3D9SpriteBatch *this : A D3D9SpriteBatch begun
+ * Return : void
+ */
+void
+D3D9SpriteBatch_end (
+	D3D9SpriteBatch *this
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free the sort buffer of an initialized D3D9SpriteBatch, without freeing the structure.
+ * D3D9SpriteBatch *this : An initialized D3D9SpriteBatch
+ */
+void
+D3D9SpriteBatch_destroy (
+	D3D9SpriteBatch *this
+);
+
+/*
+ * Description : Free an allocated D3D9SpriteBatch structure.
+ * D3D9SpriteBatch *this : An allocated D3D9SpriteBatch to free.
+ */
+void
+D3D9SpriteBatch_free (
+	D3D9SpriteBatch *this
+);
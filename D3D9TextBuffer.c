@@ -0,0 +1,85 @@
+#include "D3D9TextBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Description : Initialize a D3D9TextBuffer with an empty string
+ * D3D9TextBuffer *this : A D3D9TextBuffer to initialize
+ * Return : void
+ */
+void
+D3D9TextBuffer_init (
+	D3D9TextBuffer *this
+) {
+	this->inlineData [0] = '\0';
+	this->heapData       = NULL;
+	this->heapCapacity   = 0;
+	this->data           = this->inlineData;
+	this->length         = 0;
+}
+
+/*
+ * Description : Copy a string into the buffer. No memory is allocated unless the string is longer than all the previous ones.
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * const char *string : The string to copy
+ * Return : bool true on success, false if the memory cannot be allocated
+ */
+bool
+D3D9TextBuffer_set (
+	D3D9TextBuffer *this,
+	const char *string
+) {
+	int length = strlen (string);
+	char *data = this->inlineData;
+
+	if (length >= D3D9_TEXT_BUFFER_INLINE_SIZE)
+	{
+		// Grow the heap block geometrically, so a string growing char by char doesn't reallocate each time
+		if (length >= this->heapCapacity) {
+			int capacity = (this->heapCapacity * 2 > length + 1) ? this->heapCapacity * 2 : length + 1;
+			char *heapData;
+
+			if ((heapData = realloc (this->heapData, capacity)) == NULL) {
+				return false;
+			}
+
+			this->heapData = heapData;
+			this->heapCapacity = capacity;
+		}
+
+		data = this->heapData;
+	}
+
+	memcpy (data, string, length + 1);
+	this->data   = data;
+	this->length = length;
+
+	return true;
+}
+
+/*
+ * Description : Compare the content of the buffer with a string
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * const char *string : The string to compare
+ * Return : bool true if the strings are identical
+ */
+bool
+D3D9TextBuffer_equals (
+	D3D9TextBuffer *this,
+	const char *string
+) {
+	return strcmp (this->data, string) == 0;
+}
+
+/*
+ * Description : Release the heap memory of the buffer and empty it
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * Return : void
+ */
+void
+D3D9TextBuffer_reset (
+	D3D9TextBuffer *this
+) {
+	free (this->heapData);
+	D3D9TextBuffer_init (this);
+}
@@ -0,0 +1,72 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+
+// ---------- Defines -------------
+// Strings shorter than this are stored inside the buffer, without allocation
+#define D3D9_TEXT_BUFFER_INLINE_SIZE 32
+
+// ------ Structure declaration -------
+
+// String storage reused from a change to another : short strings are stored inline,
+// longer ones in a heap block kept as long as it is large enough.
+// It doesn't depend on DirectX, so it can be used and tested on its own.
+typedef struct
+{
+	char inlineData [D3D9_TEXT_BUFFER_INLINE_SIZE];
+	char *heapData;
+	int heapCapacity;
+
+	// Current string, pointing to inlineData or heapData
+	char *data;
+	int length;
+
+}	D3D9TextBuffer;
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize a D3D9TextBuffer with an empty string
+ * D3D9TextBuffer *this : A D3D9TextBuffer to initialize
+ * Return : void
+ */
+void
+D3D9TextBuffer_init (
+	D3D9TextBuffer *this
+);
+
+/*
+ * Description : Copy a string into the buffer. No memory is allocated unless the string is longer than all the previous ones.
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * const char *string : The string to copy
+ * Return : bool true on success, false if the memory cannot be allocated
+ */
+bool
+D3D9TextBuffer_set (
+	D3D9TextBuffer *this,
+	const char *string
+);
+
+/*
+ * Description : Compare the content of the buffer with a string
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * const char *string : The string to compare
+ * Return : bool true if the strings are identical
+ */
+bool
+D3D9TextBuffer_equals (
+	D3D9TextBuffer *this,
+	const char *string
+);
+
+/*
+ * Description : Release the heap memory of the buffer and empty it
+ * D3D9TextBuffer *this : An initialized D3D9TextBuffer
+ * Return : void
+ */
+void
+D3D9TextBuffer_reset (
+	D3D9TextBuffer *this
+);
@@ -0,0 +1,546 @@
+#include "D3D9TextureCache.h"
+#include <ctype.h>
+
+// ---------- Debugging -------------
+#define __DEBUG_OBJECT__ "D3D9TextureCache"
+#include "dbg/dbg.h"
+
+// Private headers
+/*
+ * Description : Get the bucket of a key
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : int the index of the bucket
+ */
+static int D3D9TextureCache_get_bucket (char *path, unsigned long long version);
+
+/*
+ * Description : Evict the least recently used unreferenced textures until the cache fits in its budget.
+ *               Their textures are released by the next D3D9TextureCache_drain.
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * Return : void
+ */
+static void D3D9TextureCache_evict (D3D9TextureCache *this);
+
+/*
+ * Description : Append an entry not referenced anymore to the unused entries, as the most recently used
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry of the cache, not in the unused entries
+ * Return : void
+ */
+static void D3D9TextureCache_lru_push (D3D9TextureCache *this, D3D9TextureCacheEntry *entry);
+
+/*
+ * Description : Remove an entry from the unused entries
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry of the unused entries
+ * Return : void
+ */
+static void D3D9TextureCache_lru_remove (D3D9TextureCache *this, D3D9TextureCacheEntry *entry);
+
+/*
+ * Description : Release the texture and the memory of an entry
+ * D3D9TextureCacheEntry *entry : An entry removed from the cache
+ * Return : void
+ */
+static void D3D9TextureCacheEntry_free (D3D9TextureCacheEntry *entry);
+
+/*
+ * Description : Allocate a new entry
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : D3D9TextureCacheEntry * an entry referenced once, or NULL on error
+ */
+static D3D9TextureCacheEntry * D3D9TextureCacheEntry_new (char *path, unsigned long long version);
+
+/*
+ * Description : Add an allocated entry to the cache
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry not yet in the cache
+ * Return : void
+ */
+static void D3D9TextureCache_link (D3D9TextureCache *this, D3D9TextureCacheEntry *entry);
+
+
+/*
+ * Description : Allocate a new D3D9TextureCache structure.
+ * DWORD budget : Maximum bytes of texture memory kept by the cache. Only unreferenced textures are evicted.
+ * Return : A pointer to an allocated D3D9TextureCache.
+ */
+D3D9TextureCache *
+D3D9TextureCache_new (
+	DWORD budget
+) {
+	D3D9TextureCache *this;
+
+	if ((this = calloc (1, sizeof(D3D9TextureCache))) == NULL)
+		return NULL;
+
+	if (!D3D9TextureCache_init (this, budget)) {
+		D3D9TextureCache_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9TextureCache structure.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache to initialize.
+ * DWORD budget : Maximum bytes of texture memory kept by the cache. Only unreferenced textures are evicted.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9TextureCache_init (
+	D3D9TextureCache *this,
+	DWORD budget
+) {
+	memset (this->buckets, 0, sizeof(this->buckets));
+	memset (&this->stats, 0, sizeof(this->stats));
+	this->lruFirst = NULL;
+	this->lruLast  = NULL;
+	this->evicted  = NULL;
+	this->budget   = budget;
+
+	return D3D9Lock_init (&this->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+}
+
+/*
+ * Description : Normalize a path so different writings of the same file give the same key
+ * char *path : Absolute or relative path
+ * char *normalized : Output buffer of MAX_PATH characters
+ * Return : void
+ */
+void
+D3D9TextureCache_normalize_path (
+	char *path,
+	char *normalized
+) {
+	if (!GetFullPathName (path, MAX_PATH, normalized, NULL)) {
+		strncpy (normalized, path, MAX_PATH - 1);
+		normalized [MAX_PATH - 1] = '\0';
+	}
+
+	// Windows paths are case insensitive
+	for (char *c = normalized; *c; c++) {
+		*c = (*c == '/') ? '\\' : tolower ((unsigned char) *c);
+	}
+}
+
+/*
+ * Description : Get the bucket of a key
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : int the index of the bucket
+ */
+static int
+D3D9TextureCache_get_bucket (
+	char *path,
+	unsigned long long version
+) {
+	// FNV-1a of the path, mixed with the version of the file
+	unsigned long long key = 14695981039346656037ULL;
+
+	for (unsigned char *c = (unsigned char *) path; *c; c++) {
+		key = (key ^ *c) * 1099511628211ULL;
+	}
+
+	key ^= version;
+
+	return (int) ((key ^ (key >> 32)) % D3D9_TEXTURE_CACHE_BUCKETS);
+}
+
+/*
+ * Description : Get a reference on a cached texture
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL if the texture isn't cached
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_acquire (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version
+) {
+	D3D9TextureCacheEntry *entry;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	for (entry = this->buckets [D3D9TextureCache_get_bucket (path, version)]; entry != NULL; entry = entry->next) {
+		if (entry->version == version && strcmp (entry->path, path) == 0) {
+			break;
+		}
+	}
+
+	if (!entry) {
+		this->stats.misses++;
+		D3D9Lock_release_exclusive (&this->lock);
+		return NULL;
+	}
+
+	// The entry isn't a candidate for eviction anymore
+	if (entry->refCount++ == 0) {
+		D3D9TextureCache_lru_remove (this, entry);
+	}
+
+	this->stats.hits++;
+	D3D9Lock_release_exclusive (&this->lock);
+
+	return entry;
+}
+
+/*
+ * Description : Add a texture to the cache and get a reference on it. The cache takes the reference of the texture.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * IDirect3DTexture9 *texture : The texture created from the image
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_insert (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version,
+	IDirect3DTexture9 *texture
+) {
+	D3D9TextureCacheEntry *entry;
+	D3DSURFACE_DESC surfaceDesc;
+
+	if ((entry = D3D9TextureCacheEntry_new (path, version)) == NULL) {
+		return NULL;
+	}
+
+	texture->lpVtbl->GetLevelDesc (texture, 0, &surfaceDesc);
+
+	entry->texture = texture;
+	entry->w       = surfaceDesc.Width;
+	entry->h       = surfaceDesc.Height;
+
+	// Estimate the memory of the texture : 32 bits per pixel for every mip level
+	for (DWORD level = 0; level < texture->lpVtbl->GetLevelCount (texture); level++) {
+		texture->lpVtbl->GetLevelDesc (texture, level, &surfaceDesc);
+		entry->bytes += surfaceDesc.Width * surfaceDesc.Height * 4;
+	}
+
+	D3D9TextureCache_link (this, entry);
+
+	return entry;
+}
+
+/*
+ * Description : Add an image packed in an atlas to the cache and get a reference on it. The cache takes the ownership of the region.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * D3D9Atlas *atlas : The atlas containing the image
+ * D3D9AtlasRegion *region : The region of the image in the atlas
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_insert_region (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version,
+	D3D9Atlas *atlas,
+	D3D9AtlasRegion *region
+) {
+	D3D9TextureCacheEntry *entry;
+
+	if ((entry = D3D9TextureCacheEntry_new (path, version)) == NULL) {
+		return NULL;
+	}
+
+	// The entry keeps the page alive with its own reference
+	entry->texture = region->page->texture;
+	entry->texture->lpVtbl->AddRef (entry->texture);
+	entry->atlas   = atlas;
+	entry->region  = region;
+	entry->w       = region->rect.right - region->rect.left;
+	entry->h       = region->rect.bottom - region->rect.top;
+	entry->bytes   = entry->w * entry->h * 4;
+
+	D3D9TextureCache_link (this, entry);
+
+	return entry;
+}
+
+/*
+ * Description : Allocate a new entry
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : D3D9TextureCacheEntry * an entry referenced once, or NULL on error
+ */
+static D3D9TextureCacheEntry *
+D3D9TextureCacheEntry_new (
+	char *path,
+	unsigned long long version
+) {
+	D3D9TextureCacheEntry *entry;
+
+	if ((entry = calloc (1, sizeof(D3D9TextureCacheEntry))) == NULL) {
+		return NULL;
+	}
+
+	if ((entry->path = strdup (path)) == NULL) {
+		free (entry);
+		return NULL;
+	}
+
+	entry->version  = version;
+	entry->refCount = 1;
+
+	return entry;
+}
+
+/*
+ * Description : Add an allocated entry to the cache
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry not yet in the cache
+ * Return : void
+ */
+static void
+D3D9TextureCache_link (
+	D3D9TextureCache *this,
+	D3D9TextureCacheEntry *entry
+) {
+	int bucket = D3D9TextureCache_get_bucket (entry->path, entry->version);
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	entry->next = this->buckets [bucket];
+	this->buckets [bucket] = entry;
+
+	this->stats.entries++;
+	this->stats.bytes += entry->bytes;
+	D3D9TextureCache_evict (this);
+
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Release a reference on a cached texture. It can be called from any thread.
+ *               Unreferenced textures stay cached until the cache exceeds its budget.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry referenced with acquire or insert
+ * Return : void
+ */
+void
+D3D9TextureCache_release (
+	D3D9TextureCache *this,
+	D3D9TextureCacheEntry *entry
+) {
+	D3D9Lock_acquire_exclusive (&this->lock);
+
+	if (--entry->refCount == 0) {
+		D3D9TextureCache_lru_push (this, entry);
+		D3D9TextureCache_evict (this);
+	}
+
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Append an entry not referenced anymore to the unused entries, as the most recently used
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry of the cache, not in the unused entries
+ * Return : void
+ */
+static void
+D3D9TextureCache_lru_push (
+	D3D9TextureCache *this,
+	D3D9TextureCacheEntry *entry
+) {
+	entry->lruPrev = this->lruLast;
+	entry->lruNext = NULL;
+
+	if (this->lruLast) {
+		this->lruLast->lruNext = entry;
+	} else {
+		this->lruFirst = entry;
+	}
+
+	this->lruLast = entry;
+}
+
+/*
+ * Description : Remove an entry from the unused entries
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry of the unused entries
+ * Return : void
+ */
+static void
+D3D9TextureCache_lru_remove (
+	D3D9TextureCache *this,
+	D3D9TextureCacheEntry *entry
+) {
+	if (entry->lruPrev) {
+		entry->lruPrev->lruNext = entry->lruNext;
+	} else {
+		this->lruFirst = entry->lruNext;
+	}
+
+	if (entry->lruNext) {
+		entry->lruNext->lruPrev = entry->lruPrev;
+	} else {
+		this->lruLast = entry->lruPrev;
+	}
+
+	entry->lruPrev = NULL;
+	entry->lruNext = NULL;
+}
+
+/*
+ * Description : Evict the least recently used unreferenced textures until the cache fits in its budget.
+ *               Their textures are released by the next D3D9TextureCache_drain.
+ *               /!\ The cache MUST BE LOCKED when calling this function.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * Return : void
+ */
+static void
+D3D9TextureCache_evict (
+	D3D9TextureCache *this
+) {
+	while (this->stats.bytes > this->budget && this->lruFirst)
+	{
+		D3D9TextureCacheEntry *entry = this->lruFirst;
+		D3D9TextureCacheEntry **link = &this->buckets [D3D9TextureCache_get_bucket (entry->path, entry->version)];
+
+		D3D9TextureCache_lru_remove (this, entry);
+
+		// Unlink from its bucket
+		while (*link != entry) {
+			link = &(*link)->next;
+		}
+		*link = entry->next;
+
+		this->stats.evictions++;
+		this->stats.entries--;
+		this->stats.bytes -= entry->bytes;
+
+		// The texture and the atlas belong to the DirectX thread
+		entry->next = this->evicted;
+		this->evicted = entry;
+	}
+}
+
+/*
+ * Description : Release the textures and the atlas regions of the entries evicted.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * Return : int the number of entries released
+ */
+int
+D3D9TextureCache_drain (
+	D3D9TextureCache *this
+) {
+	D3D9TextureCacheEntry *entry;
+	int count = 0;
+
+	D3D9Lock_acquire_exclusive (&this->lock);
+	entry = this->evicted;
+	this->evicted = NULL;
+	D3D9Lock_release_exclusive (&this->lock);
+
+	// Released without the lock : the entries aren't reachable anymore
+	while (entry) {
+		D3D9TextureCacheEntry *next = entry->next;
+		D3D9TextureCacheEntry_free (entry);
+		entry = next;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Description : Change the budget of the cache and evict the textures exceeding it. It can be called from any thread :
+ *               the textures evicted are released by the next D3D9TextureCache_drain.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * DWORD budget : Maximum bytes of texture memory kept by the cache
+ * Return : void
+ */
+void
+D3D9TextureCache_set_budget (
+	D3D9TextureCache *this,
+	DWORD budget
+) {
+	D3D9Lock_acquire_exclusive (&this->lock);
+	this->budget = budget;
+	D3D9TextureCache_evict (this);
+	D3D9Lock_release_exclusive (&this->lock);
+}
+
+/*
+ * Description : Get the hit / miss / eviction counters of the cache
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9TextureCache_get_stats (
+	D3D9TextureCache *this,
+	D3D9TextureCacheStats *stats
+) {
+	D3D9Lock_acquire_shared (&this->lock);
+	*stats = this->stats;
+	D3D9Lock_release_shared (&this->lock);
+}
+
+/*
+ * Description : Release the texture and the memory of an entry
+ * D3D9TextureCacheEntry *entry : An entry removed from the cache
+ * Return : void
+ */
+static void
+D3D9TextureCacheEntry_free (
+	D3D9TextureCacheEntry *entry
+) {
+	if (entry->region) {
+		D3D9Atlas_remove (entry->atlas, entry->region);
+	}
+
+	if (entry->texture) {
+		entry->texture->lpVtbl->Release (entry->texture);
+	}
+
+	free (entry->path);
+	free (entry);
+}
+
+/*
+ * Description : Free an allocated D3D9TextureCache structure and release all its textures.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache to free.
+ */
+void
+D3D9TextureCache_free (
+	D3D9TextureCache *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	for (int bucket = 0; bucket < D3D9_TEXTURE_CACHE_BUCKETS; bucket++) {
+		D3D9TextureCacheEntry *entry = this->buckets [bucket];
+
+		while (entry) {
+			D3D9TextureCacheEntry *next = entry->next;
+			if (entry->refCount) {
+				warn ("Texture <%s> is still referenced %d times.", entry->path, entry->refCount);
+			}
+			D3D9TextureCacheEntry_free (entry);
+			entry = next;
+		}
+	}
+
+	D3D9TextureCache_drain (this);
+
+	D3D9Lock_destroy (&this->lock);
+	free (this);
+}
@@ -0,0 +1,209 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include "Utils/Utils.h"
+#include "dx/d3d9.h"
+#include "D3D9Lock.h"
+#include "D3D9Atlas.h"
+
+// ---------- Defines -------------
+#define D3D9_TEXTURE_CACHE_BUCKETS        1024
+// Default size of the cache, in bytes of texture memory
+#define D3D9_TEXTURE_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+// ------ Structure declaration -------
+typedef struct _D3D9TextureCacheEntry
+{
+	// Key : normalized path and version of the file, so a modified file is decoded again
+	char *path;
+	unsigned long long version;
+
+	IDirect3DTexture9 *texture;
+	int w, h;
+	DWORD bytes;
+	int refCount;
+
+	// Place of the image in an atlas page, or NULL if the texture contains only this image
+	D3D9Atlas *atlas;
+	D3D9AtlasRegion *region;
+
+	// Next entry of the bucket, or of the entries evicted
+	struct _D3D9TextureCacheEntry *next;
+	// Neighbours in the list of the entries not referenced anymore
+	struct _D3D9TextureCacheEntry *lruPrev;
+	struct _D3D9TextureCacheEntry *lruNext;
+
+}	D3D9TextureCacheEntry;
+
+typedef struct
+{
+	int hits;
+	int misses;
+	int evictions;
+	int entries;
+	DWORD bytes;
+
+}	D3D9TextureCacheStats;
+
+typedef struct
+{
+	D3D9TextureCacheEntry *buckets [D3D9_TEXTURE_CACHE_BUCKETS];
+
+	// Entries not referenced anymore, the least recently used first
+	D3D9TextureCacheEntry *lruFirst;
+	D3D9TextureCacheEntry *lruLast;
+	// Entries evicted, waiting for the DirectX thread to release their texture
+	D3D9TextureCacheEntry *evicted;
+
+	DWORD budget;
+	D3D9TextureCacheStats stats;
+	D3D9Lock lock;
+
+}	D3D9TextureCache;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9TextureCache structure.
+ * DWORD budget : Maximum bytes of texture memory kept by the cache. Only unreferenced textures are evicted.
+ * Return : A pointer to an allocated D3D9TextureCache.
+ */
+D3D9TextureCache *
+D3D9TextureCache_new (
+	DWORD budget
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9TextureCache structure.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache to initialize.
+ * DWORD budget : Maximum bytes of texture memory kept by the cache. Only unreferenced textures are evicted.
+ * Return : true on success, false on failure.
+ */
+bool
+D3D9TextureCache_init (
+	D3D9TextureCache *this,
+	DWORD budget
+);
+
+/*
+ * Description : Normalize a path so different writings of the same file give the same key
+ * char *path : Absolute or relative path
+ * char *normalized : Output buffer of MAX_PATH characters
+ * Return : void
+ */
+void
+D3D9TextureCache_normalize_path (
+	char *path,
+	char *normalized
+);
+
+/*
+ * Description : Get a reference on a cached texture
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL if the texture isn't cached
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_acquire (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version
+);
+
+/*
+ * Description : Add a texture to the cache and get a reference on it. The cache takes the reference of the texture.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * IDirect3DTexture9 *texture : The texture created from the image
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_insert (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version,
+	IDirect3DTexture9 *texture
+);
+
+/*
+ * Description : Add an image packed in an atlas to the cache and get a reference on it. The cache takes the ownership of the region.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * char *path : Normalized path of the image
+ * unsigned long long version : Version of the image file, from D3D9Image_get_version
+ * D3D9Atlas *atlas : The atlas containing the image
+ * D3D9AtlasRegion *region : The region of the image in the atlas
+ * Return : D3D9TextureCacheEntry * the referenced entry, or NULL on error
+ */
+D3D9TextureCacheEntry *
+D3D9TextureCache_insert_region (
+	D3D9TextureCache *this,
+	char *path,
+	unsigned long long version,
+	D3D9Atlas *atlas,
+	D3D9AtlasRegion *region
+);
+
+/*
+ * Description : Release a reference on a cached texture. It can be called from any thread.
+ *               Unreferenced textures stay cached until the cache exceeds its budget.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheEntry *entry : An entry referenced with acquire or insert
+ * Return : void
+ */
+void
+D3D9TextureCache_release (
+	D3D9TextureCache *this,
+	D3D9TextureCacheEntry *entry
+);
+
+/*
+ * Description : Change the budget of the cache and evict the textures exceeding it. It can be called from any thread :
+ *               the textures evicted are released by the next D3D9TextureCache_drain.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * DWORD budget : Maximum bytes of texture memory kept by the cache
+ * Return : void
+ */
+void
+D3D9TextureCache_set_budget (
+	D3D9TextureCache *this,
+	DWORD budget
+);
+
+/*
+ * Description : Release the textures and the atlas regions of the entries evicted.
+ *               /!\ This function must be called only from the DirectX thread.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * Return : int the number of entries released
+ */
+int
+D3D9TextureCache_drain (
+	D3D9TextureCache *this
+);
+
+/*
+ * Description : Get the hit / miss / eviction counters of the cache
+ * D3D9TextureCache *this : An allocated D3D9TextureCache
+ * D3D9TextureCacheStats *stats : Output of the counters
+ * Return : void
+ */
+void
+D3D9TextureCache_get_stats (
+	D3D9TextureCache *this,
+	D3D9TextureCacheStats *stats
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9TextureCache structure and release all its textures.
+ * D3D9TextureCache *this : An allocated D3D9TextureCache to free.
+ */
+void
+D3D9TextureCache_free (
+	D3D9TextureCache *this
+);
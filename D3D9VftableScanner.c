@@ -0,0 +1,653 @@
+#include "D3D9VftableScanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Offsets in the PE headers
+#define D3D9_PE_HEADER_OFFSET          0x3C
+#define D3D9_PE_FILE_HEADER_SIZE       20
+#define D3D9_PE_SECTION_SIZE           40
+#define D3D9_PE32_MAGIC                0x10B
+#define D3D9_PE32_DIRECTORIES_COUNT    92
+#define D3D9_PE32_DIRECTORIES          96
+#define D3D9_PE_DIRECTORY_BASERELOC    5
+#define D3D9_PE_SECTION_CODE           0x00000020
+#define D3D9_PE_SECTION_EXECUTE        0x20000000
+#define D3D9_PE_RELOCATION_HIGHLOW     3
+
+// Private headers
+/*
+ * Description : Read a 16 or 32 bits little endian value of the image
+ * unsigned char *image : Base of the image
+ * size_t offset : Offset of the value
+ * int bytes : Size of the value
+ * Return : unsigned int the value
+ */
+static unsigned int D3D9VftableScanner_read (unsigned char *image, size_t offset, int bytes);
+
+/*
+ * Description : Get the section containing an offset of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset relative to the base of the image
+ * Return : D3D9VftableSection * the section, or NULL if the offset isn't in a section
+ */
+static D3D9VftableSection * D3D9VftableScanner_get_section (D3D9VftableScanner *this, size_t offset);
+
+/*
+ * Description : Read the base relocations of the image and keep the 32 bits ones, sorted
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t start : Offset of the relocation directory
+ * size_t size : Size of the relocation directory
+ * Return : bool true on success, false if out of memory
+ */
+static bool D3D9VftableScanner_read_relocations (D3D9VftableScanner *this, size_t start, size_t size);
+
+/*
+ * Description : Count the relocated pointers to an offset of the image in its code
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset relative to the base of the image
+ * Return : int the number of references
+ */
+static int D3D9VftableScanner_count_references (D3D9VftableScanner *this, size_t offset);
+
+/*
+ * Description : Add an array to the candidates if it has an accepted number of pointers
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset of the array
+ * int count : Number of pointers of the array
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * int found : Number of arrays found before this one
+ * Return : int the new number of arrays found
+ */
+static int D3D9VftableScanner_add_candidate (D3D9VftableScanner *this, size_t offset, int count, int minCount, int maxCount, D3D9VftableCandidate *candidates, int capacity, int found);
+
+/*
+ * Description : Scan the data or the code sections for arrays of consecutive pointers to code
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * bool executable : true to scan the code sections, false to scan the data sections
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+static int D3D9VftableScanner_scan_sections (D3D9VftableScanner *this, bool executable, int minCount, int maxCount, D3D9VftableCandidate *candidates, int capacity);
+
+/*
+ * Description : Find the arrays of consecutive relocated pointers to code in the data or the code sections
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * bool executable : true to consider the relocations of the code sections, false the ones of the data sections
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+static int D3D9VftableScanner_scan_relocations (D3D9VftableScanner *this, bool executable, int minCount, int maxCount, D3D9VftableCandidate *candidates, int capacity);
+
+/*
+ * Description : Compare two relocations by offset, for qsort
+ * const void *a, const void *b : Pointers to unsigned int offsets
+ * Return : int negative, zero or positive
+ */
+static int D3D9VftableScanner_compare_relocations (const void *a, const void *b);
+
+
+/*
+ * Description : Allocate a new D3D9VftableScanner structure.
+ * unsigned char *image : Base of the PE image, with its sections at their virtual addresses
+ * size_t size : Size of the image
+ * unsigned int base : Address the image is loaded at
+ * Return : A pointer to an allocated D3D9VftableScanner, or NULL if the image isn't a 32 bits PE.
+ */
+D3D9VftableScanner *
+D3D9VftableScanner_new (
+	unsigned char *image,
+	size_t size,
+	unsigned int base
+) {
+	D3D9VftableScanner *this;
+
+	if ((this = calloc (1, sizeof(D3D9VftableScanner))) == NULL)
+		return NULL;
+
+	if (!D3D9VftableScanner_init (this, image, size, base)) {
+		D3D9VftableScanner_free (this);
+		return NULL;
+	}
+
+	return this;
+}
+
+/*
+ * Description : Initialize an allocated D3D9VftableScanner structure : read the sections and the relocations of the image.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner to initialize.
+ * unsigned char *image : Base of the PE image, with its sections at their virtual addresses
+ * size_t size : Size of the image
+ * unsigned int base : Address the image is loaded at
+ * Return : true on success, false if the image isn't a 32 bits PE.
+ */
+bool
+D3D9VftableScanner_init (
+	D3D9VftableScanner *this,
+	unsigned char *image,
+	size_t size,
+	unsigned int base
+) {
+	size_t header, fileHeader, optionalHeader, sections;
+	int sectionsCount, optionalSize;
+
+	this->image            = image;
+	this->size             = size;
+	this->base             = base;
+	this->sectionsCount    = 0;
+	this->relocations      = NULL;
+	this->relocationsCount = 0;
+
+	if (size < D3D9_PE_HEADER_OFFSET + 4 || image [0] != 'M' || image [1] != 'Z') {
+		return false;
+	}
+
+	header = D3D9VftableScanner_read (image, D3D9_PE_HEADER_OFFSET, 4);
+	if (header > size - 4 - D3D9_PE_FILE_HEADER_SIZE || memcmp (&image [header], "PE\0\0", 4) != 0) {
+		return false;
+	}
+
+	fileHeader     = header + 4;
+	optionalHeader = fileHeader + D3D9_PE_FILE_HEADER_SIZE;
+	sectionsCount  = D3D9VftableScanner_read (image, fileHeader + 2, 2);
+	optionalSize   = D3D9VftableScanner_read (image, fileHeader + 16, 2);
+	sections       = optionalHeader + optionalSize;
+
+	// The pointers of a vftable are 32 bits only in a PE32 image
+	if (optionalSize < D3D9_PE32_DIRECTORIES || sections > size
+	||  D3D9VftableScanner_read (image, optionalHeader, 2) != D3D9_PE32_MAGIC) {
+		return false;
+	}
+
+	if (sectionsCount > D3D9_VFTABLE_SCANNER_MAX_SECTIONS) {
+		sectionsCount = D3D9_VFTABLE_SCANNER_MAX_SECTIONS;
+	}
+
+	for (int index = 0; index < sectionsCount; index++) {
+		size_t section = sections + (size_t) index * D3D9_PE_SECTION_SIZE;
+		unsigned int virtualSize, start, characteristics;
+
+		if (section + D3D9_PE_SECTION_SIZE > size) {
+			break;
+		}
+
+		virtualSize     = D3D9VftableScanner_read (image, section + 8, 4);
+		start           = D3D9VftableScanner_read (image, section + 12, 4);
+		characteristics = D3D9VftableScanner_read (image, section + 36, 4);
+
+		if (virtualSize == 0) {
+			virtualSize = D3D9VftableScanner_read (image, section + 16, 4);
+		}
+
+		// Only the part of the section mapped in the image is read
+		if (start >= size) {
+			continue;
+		}
+
+		D3D9VftableSection *target = &this->sections [this->sectionsCount++];
+		target->start      = start;
+		target->end        = (virtualSize > size - start) ? size : start + virtualSize;
+		target->executable = (characteristics & (D3D9_PE_SECTION_CODE | D3D9_PE_SECTION_EXECUTE)) != 0;
+	}
+
+	// An image without relocations can still be scanned for arrays
+	if (D3D9VftableScanner_read (image, optionalHeader + D3D9_PE32_DIRECTORIES_COUNT, 4) > D3D9_PE_DIRECTORY_BASERELOC
+	&&  optionalSize >= D3D9_PE32_DIRECTORIES + (D3D9_PE_DIRECTORY_BASERELOC + 1) * 8)
+	{
+		size_t directory = optionalHeader + D3D9_PE32_DIRECTORIES + D3D9_PE_DIRECTORY_BASERELOC * 8;
+
+		if (!D3D9VftableScanner_read_relocations (this,
+			D3D9VftableScanner_read (image, directory, 4),
+			D3D9VftableScanner_read (image, directory + 4, 4))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Read a 16 or 32 bits little endian value of the image
+ * unsigned char *image : Base of the image
+ * size_t offset : Offset of the value
+ * int bytes : Size of the value
+ * Return : unsigned int the value
+ */
+static unsigned int
+D3D9VftableScanner_read (
+	unsigned char *image,
+	size_t offset,
+	int bytes
+) {
+	unsigned int value = 0;
+
+	for (int index = bytes - 1; index >= 0; index--) {
+		value = (value << 8) | image [offset + index];
+	}
+
+	return value;
+}
+
+/*
+ * Description : Read the base relocations of the image and keep the 32 bits ones, sorted
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t start : Offset of the relocation directory
+ * size_t size : Size of the relocation directory
+ * Return : bool true on success, false if out of memory
+ */
+static bool
+D3D9VftableScanner_read_relocations (
+	D3D9VftableScanner *this,
+	size_t start,
+	size_t size
+) {
+	int capacity = 0;
+	size_t end;
+
+	if (start >= this->size) {
+		return true;
+	}
+
+	end = (size > this->size - start) ? this->size : start + size;
+
+	// The directory is a list of blocks : page offset, block size, then one 16 bits entry per address of the page
+	for (size_t block = start; block + 8 <= end; ) {
+		unsigned int page      = D3D9VftableScanner_read (this->image, block, 4);
+		unsigned int blockSize = D3D9VftableScanner_read (this->image, block + 4, 4);
+
+		if (blockSize < 8 || blockSize > end - block) {
+			break;
+		}
+
+		for (size_t entry = block + 8; entry + 2 <= block + blockSize; entry += 2) {
+			unsigned int value  = D3D9VftableScanner_read (this->image, entry, 2);
+			unsigned int offset = page + (value & 0xFFF);
+
+			if ((value >> 12) != D3D9_PE_RELOCATION_HIGHLOW || offset > this->size - 4) {
+				continue;
+			}
+
+			if (this->relocationsCount == capacity) {
+				int newCapacity = (capacity) ? capacity * 2 : 1024;
+				unsigned int *relocations;
+
+				if ((relocations = realloc (this->relocations, newCapacity * sizeof(unsigned int))) == NULL) {
+					return false;
+				}
+
+				this->relocations = relocations;
+				capacity = newCapacity;
+			}
+
+			this->relocations [this->relocationsCount++] = offset;
+		}
+
+		block += blockSize;
+	}
+
+	// The blocks are usually sorted by page, but nothing requires it
+	if (this->relocationsCount > 1) {
+		qsort (this->relocations, this->relocationsCount, sizeof(unsigned int), D3D9VftableScanner_compare_relocations);
+	}
+
+	return true;
+}
+
+/*
+ * Description : Compare two relocations by offset, for qsort
+ * const void *a, const void *b : Pointers to unsigned int offsets
+ * Return : int negative, zero or positive
+ */
+static int
+D3D9VftableScanner_compare_relocations (
+	const void *a,
+	const void *b
+) {
+	unsigned int first  = *(const unsigned int *) a;
+	unsigned int second = *(const unsigned int *) b;
+
+	return (first > second) - (first < second);
+}
+
+/*
+ * Description : Get the section containing an offset of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset relative to the base of the image
+ * Return : D3D9VftableSection * the section, or NULL if the offset isn't in a section
+ */
+static D3D9VftableSection *
+D3D9VftableScanner_get_section (
+	D3D9VftableScanner *this,
+	size_t offset
+) {
+	for (int index = 0; index < this->sectionsCount; index++) {
+		D3D9VftableSection *section = &this->sections [index];
+
+		if (offset >= section->start && offset < section->end) {
+			return section;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Check if an address points to the code of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * unsigned int address : An address in the process
+ * Return : bool true if the address is in an executable section
+ */
+bool
+D3D9VftableScanner_is_code_pointer (
+	D3D9VftableScanner *this,
+	unsigned int address
+) {
+	// Addresses below the base wrap around to offsets larger than any section
+	D3D9VftableSection *section = D3D9VftableScanner_get_section (this, address - this->base);
+
+	return section && section->executable;
+}
+
+/*
+ * Description : Check if an address points to an array of pointers to the code of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * unsigned int address : An address in the process
+ * int count : Number of pointers of the array
+ * Return : bool true if the array is in the image and all its pointers point to code
+ */
+bool
+D3D9VftableScanner_is_array (
+	D3D9VftableScanner *this,
+	unsigned int address,
+	int count
+) {
+	size_t offset = address - this->base;
+
+	if (count <= 0 || offset > this->size || (size_t) count * 4 > this->size - offset) {
+		return false;
+	}
+
+	for (int index = 0; index < count; index++) {
+		if (!D3D9VftableScanner_is_code_pointer (this, D3D9VftableScanner_read (this->image, offset + index * 4, 4))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Count the relocated pointers to an offset of the image in its code
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset relative to the base of the image
+ * Return : int the number of references
+ */
+static int
+D3D9VftableScanner_count_references (
+	D3D9VftableScanner *this,
+	size_t offset
+) {
+	unsigned int address = this->base + offset;
+	int references = 0;
+
+	for (int index = 0; index < this->relocationsCount; index++) {
+		unsigned int relocation = this->relocations [index];
+		D3D9VftableSection *section = D3D9VftableScanner_get_section (this, relocation);
+
+		if (section && section->executable
+		&&  D3D9VftableScanner_read (this->image, relocation, 4) == address) {
+			references++;
+		}
+	}
+
+	return references;
+}
+
+/*
+ * Description : Add an array to the candidates if it has an accepted number of pointers
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * size_t offset : Offset of the array
+ * int count : Number of pointers of the array
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * int found : Number of arrays found before this one
+ * Return : int the new number of arrays found
+ */
+static int
+D3D9VftableScanner_add_candidate (
+	D3D9VftableScanner *this,
+	size_t offset,
+	int count,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity,
+	int found
+) {
+	D3D9VftableSection *section = D3D9VftableScanner_get_section (this, offset);
+
+	// When .rdata is merged into .text, the RTTI locator is in the code too and the pointer to it starts the array.
+	// The vftable is after it, where the constructors point to.
+	if (section && section->executable && count > 1
+	&&  D3D9VftableScanner_count_references (this, offset) == 0
+	&&  D3D9VftableScanner_count_references (this, offset + 4) > 0) {
+		offset += 4;
+		count--;
+	}
+
+	if (count < minCount || count > maxCount) {
+		return found;
+	}
+
+	if (found < capacity) {
+		D3D9VftableCandidate *candidate = &candidates [found];
+		candidate->offset     = offset;
+		candidate->count      = count;
+		candidate->references = D3D9VftableScanner_count_references (this, offset);
+	}
+
+	return found + 1;
+}
+
+/*
+ * Description : Scan the data sections for arrays of consecutive pointers to code.
+ *               The arrays are bounded by values that aren't pointers to code, like the RTTI locator before a vftable.
+ *               The code sections are scanned only if the data sections have none, as in the images merging .rdata into .text :
+ *               the jump tables of the switches are arrays of pointers to code too.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+int
+D3D9VftableScanner_find_arrays (
+	D3D9VftableScanner *this,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+) {
+	int found = D3D9VftableScanner_scan_sections (this, false, minCount, maxCount, candidates, capacity);
+
+	if (found == 0) {
+		found = D3D9VftableScanner_scan_sections (this, true, minCount, maxCount, candidates, capacity);
+	}
+
+	return found;
+}
+
+/*
+ * Description : Scan the data or the code sections for arrays of consecutive pointers to code
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * bool executable : true to scan the code sections, false to scan the data sections
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+static int
+D3D9VftableScanner_scan_sections (
+	D3D9VftableScanner *this,
+	bool executable,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+) {
+	int found = 0;
+
+	for (int index = 0; index < this->sectionsCount; index++) {
+		D3D9VftableSection *section = &this->sections [index];
+		size_t runStart = 0;
+		int run = 0;
+
+		if (section->executable != executable) {
+			continue;
+		}
+
+		// The compilers align the vftables on their pointers
+		for (size_t offset = (section->start + 3) & ~3; offset + 4 <= section->end; offset += 4) {
+			if (D3D9VftableScanner_is_code_pointer (this, D3D9VftableScanner_read (this->image, offset, 4))) {
+				if (run++ == 0) {
+					runStart = offset;
+				}
+			}
+			else if (run) {
+				found = D3D9VftableScanner_add_candidate (this, runStart, run, minCount, maxCount, candidates, capacity, found);
+				run = 0;
+			}
+		}
+
+		if (run) {
+			found = D3D9VftableScanner_add_candidate (this, runStart, run, minCount, maxCount, candidates, capacity, found);
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : Find the arrays of consecutive pointers to code from the relocation table only.
+ *               Only the pointers fixed by the loader are considered, so data looking like addresses is ignored.
+ *               The relocations of the code sections are considered only if the data sections have no array,
+ *               as in the images merging .rdata into .text.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity, 0 if the image has no relocations
+ */
+int
+D3D9VftableScanner_find_relocated_arrays (
+	D3D9VftableScanner *this,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+) {
+	int found = D3D9VftableScanner_scan_relocations (this, false, minCount, maxCount, candidates, capacity);
+
+	if (found == 0) {
+		found = D3D9VftableScanner_scan_relocations (this, true, minCount, maxCount, candidates, capacity);
+	}
+
+	return found;
+}
+
+/*
+ * Description : Find the arrays of consecutive relocated pointers to code in the data or the code sections
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * bool executable : true to consider the relocations of the code sections, false the ones of the data sections
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+static int
+D3D9VftableScanner_scan_relocations (
+	D3D9VftableScanner *this,
+	bool executable,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+) {
+	size_t runStart = 0;
+	unsigned int previous = 0;
+	int found = 0;
+	int run = 0;
+
+	for (int index = 0; index < this->relocationsCount; index++) {
+		unsigned int relocation = this->relocations [index];
+		D3D9VftableSection *section = D3D9VftableScanner_get_section (this, relocation);
+
+		bool isPointer = section && section->executable == executable
+			&& D3D9VftableScanner_is_code_pointer (this, D3D9VftableScanner_read (this->image, relocation, 4));
+
+		// The array continues only with the relocation right after the previous one
+		if (run && (!isPointer || relocation != previous + 4)) {
+			found = D3D9VftableScanner_add_candidate (this, runStart, run, minCount, maxCount, candidates, capacity, found);
+			run = 0;
+		}
+
+		if (isPointer) {
+			if (run++ == 0) {
+				runStart = relocation;
+			}
+			previous = relocation;
+		}
+	}
+
+	if (run) {
+		found = D3D9VftableScanner_add_candidate (this, runStart, run, minCount, maxCount, candidates, capacity, found);
+	}
+
+	return found;
+}
+
+/*
+ * Description : Choose the vftable among the candidates : the only one found, or else the only one referenced by the code
+ * D3D9VftableCandidate *candidates : Arrays found by a scan
+ * int count : Number of candidates
+ * Return : int the index of the candidate chosen, or -1 if none or ambiguous
+ */
+int
+D3D9VftableScanner_choose (
+	D3D9VftableCandidate *candidates,
+	int count
+) {
+	int chosen = -1;
+
+	if (count == 1) {
+		return 0;
+	}
+
+	for (int index = 0; index < count; index++) {
+		if (candidates [index].references > 0) {
+			if (chosen != -1) {
+				return -1;
+			}
+			chosen = index;
+		}
+	}
+
+	return chosen;
+}
+
+/*
+ * Description : Free an allocated D3D9VftableScanner structure.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner to free.
+ */
+void
+D3D9VftableScanner_free (
+	D3D9VftableScanner *this
+) {
+	if (this == NULL) {
+		return;
+	}
+
+	free (this->relocations);
+	free (this);
+}
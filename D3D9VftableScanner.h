@@ -0,0 +1,173 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// ---------- Includes ------------
+#include <stdbool.h>
+#include <stddef.h>
+
+// ---------- Defines -------------
+// Sections beyond this count are ignored
+#define D3D9_VFTABLE_SCANNER_MAX_SECTIONS 96
+
+// ------ Structure declaration -------
+
+// Section of the image, as loaded in memory
+typedef struct
+{
+	unsigned int start, end;
+	bool executable;
+
+}	D3D9VftableSection;
+
+// Array of pointers to code found in the data of the image
+typedef struct
+{
+	// Offset of the first pointer, relative to the base of the image
+	size_t offset;
+	int count;
+
+	// Number of relocated pointers to the array in the code, usually the constructors storing the vftable
+	int references;
+
+}	D3D9VftableCandidate;
+
+// Finds vftables in a PE image loaded in memory, without exports nor signatures :
+// a vftable is an array of consecutive pointers to the code of the image.
+// It doesn't depend on Windows, so it can be used and tested on its own.
+typedef struct
+{
+	unsigned char *image;
+	size_t size;
+
+	// Address the image is loaded at : the pointers of the image are relocated to it
+	unsigned int base;
+
+	D3D9VftableSection sections [D3D9_VFTABLE_SCANNER_MAX_SECTIONS];
+	int sectionsCount;
+
+	// Offsets of the 32 bits addresses fixed by the loader, sorted
+	unsigned int *relocations;
+	int relocationsCount;
+
+}	D3D9VftableScanner;
+
+// --------- Allocators ---------
+
+/*
+ * Description : Allocate a new D3D9VftableScanner structure.
+ * unsigned char *image : Base of the PE image, with its sections at their virtual addresses
+ * size_t size : Size of the image
+ * unsigned int base : Address the image is loaded at
+ * Return : A pointer to an allocated D3D9VftableScanner, or NULL if the image isn't a 32 bits PE.
+ */
+D3D9VftableScanner *
+D3D9VftableScanner_new (
+	unsigned char *image,
+	size_t size,
+	unsigned int base
+);
+
+// ----------- Functions ------------
+
+/*
+ * Description : Initialize an allocated D3D9VftableScanner structure : read the sections and the relocations of the image.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner to initialize.
+ * unsigned char *image : Base of the PE image, with its sections at their virtual addresses
+ * size_t size : Size of the image
+ * unsigned int base : Address the image is loaded at
+ * Return : true on success, false if the image isn't a 32 bits PE.
+ */
+bool
+D3D9VftableScanner_init (
+	D3D9VftableScanner *this,
+	unsigned char *image,
+	size_t size,
+	unsigned int base
+);
+
+/*
+ * Description : Check if an address points to the code of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * unsigned int address : An address in the process
+ * Return : bool true if the address is in an executable section
+ */
+bool
+D3D9VftableScanner_is_code_pointer (
+	D3D9VftableScanner *this,
+	unsigned int address
+);
+
+/*
+ * Description : Check if an address points to an array of pointers to the code of the image
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * unsigned int address : An address in the process
+ * int count : Number of pointers of the array
+ * Return : bool true if the array is in the image and all its pointers point to code
+ */
+bool
+D3D9VftableScanner_is_array (
+	D3D9VftableScanner *this,
+	unsigned int address,
+	int count
+);
+
+/*
+ * Description : Scan the data sections for arrays of consecutive pointers to code.
+ *               The arrays are bounded by values that aren't pointers to code, like the RTTI locator before a vftable.
+ *               The code sections are scanned only if the data sections have none, as in the images merging .rdata into .text :
+ *               the jump tables of the switches are arrays of pointers to code too.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity
+ */
+int
+D3D9VftableScanner_find_arrays (
+	D3D9VftableScanner *this,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+);
+
+/*
+ * Description : Find the arrays of consecutive pointers to code from the relocation table only.
+ *               Only the pointers fixed by the loader are considered, so data looking like addresses is ignored.
+ *               The relocations of the code sections are considered only if the data sections have no array,
+ *               as in the images merging .rdata into .text.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner
+ * int minCount, int maxCount : Number of pointers accepted for an array
+ * D3D9VftableCandidate *candidates : Output of the arrays found
+ * int capacity : Maximum number of arrays written in candidates
+ * Return : int the number of arrays found, which can exceed capacity, 0 if the image has no relocations
+ */
+int
+D3D9VftableScanner_find_relocated_arrays (
+	D3D9VftableScanner *this,
+	int minCount, int maxCount,
+	D3D9VftableCandidate *candidates,
+	int capacity
+);
+
+/*
+ * Description : Choose the vftable among the candidates : the only one found, or else the only one referenced by the code
+ * D3D9VftableCandidate *candidates : Arrays found by a scan
+ * int count : Number of candidates
+ * Return : int the index of the candidate chosen, or -1 if none or ambiguous
+ */
+int
+D3D9VftableScanner_choose (
+	D3D9VftableCandidate *candidates,
+	int count
+);
+
+// --------- Destructors ----------
+
+/*
+ * Description : Free an allocated D3D9VftableScanner structure.
+ * D3D9VftableScanner *this : An allocated D3D9VftableScanner to free.
+ */
+void
+D3D9VftableScanner_free (
+	D3D9VftableScanner *this
+);
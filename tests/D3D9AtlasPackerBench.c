@@ -0,0 +1,114 @@
+#include "D3D9Test.h"
+#include "D3D9AtlasPacker.h"
+#include <stdlib.h>
+
+// Time to pack from 1k to 50k sprites into atlas pages, and time to repack a whole page like D3D9Atlas_repack.
+
+// Size of the pages, and of the sprites packed with their padding
+#define PAGE_SIZE   1024
+#define SPRITE_MIN  4
+#define SPRITE_MAX  34
+#define MAX_PAGES   256
+
+static int rectsCounts [] = {1000, 5000, 10000, 50000};
+
+// Rectangle packed by the bench
+typedef struct
+{
+	int w, h, page;
+
+}	BenchRect;
+
+/*
+ * Description : Pack some random rectangles, then repack the first page, and print the times
+ * int count : Number of rectangles
+ * Return : void
+ */
+static void
+measure (
+	int count
+) {
+	BenchRect *rects = malloc (sizeof(BenchRect) * count);
+	D3D9AtlasPacker *pages [MAX_PAGES] = {NULL};
+	unsigned int seed = 1;
+	int pagesCount = 0, x, y;
+	long long usedArea = 0;
+	double start, packTime, repackTime;
+	int repacked = 0;
+
+	for (int index = 0; index < count; index++) {
+		rects [index].w = SPRITE_MIN + rand_r (&seed) % (SPRITE_MAX - SPRITE_MIN);
+		rects [index].h = SPRITE_MIN + rand_r (&seed) % (SPRITE_MAX - SPRITE_MIN);
+	}
+
+	// Like D3D9Atlas_add : the first page with enough space, else a new page
+	start = D3D9Test_now ();
+
+	for (int index = 0; index < count; index++)
+	{
+		BenchRect *rect = &rects [index];
+		rect->page = -1;
+
+		for (int page = 0; page < pagesCount && rect->page == -1; page++) {
+			if (D3D9AtlasPacker_insert (pages [page], rect->w, rect->h, &x, &y)) {
+				rect->page = page;
+			}
+		}
+
+		if (rect->page == -1 && pagesCount < MAX_PAGES) {
+			pages [pagesCount] = D3D9AtlasPacker_new (PAGE_SIZE, PAGE_SIZE);
+
+			if (D3D9AtlasPacker_insert (pages [pagesCount], rect->w, rect->h, &x, &y)) {
+				rect->page = pagesCount;
+			}
+
+			pagesCount++;
+		}
+	}
+
+	packTime = D3D9Test_now () - start;
+
+	// Half of the sprites of the first page are removed, then the page is repacked with the others
+	for (int index = 0; index < count; index += 2) {
+		if (rects [index].page == 0) {
+			D3D9AtlasPacker_remove (pages [0], rects [index].w, rects [index].h);
+		}
+	}
+
+	start = D3D9Test_now ();
+
+	D3D9AtlasPacker_reset (pages [0]);
+
+	for (int index = 1; index < count; index += 2) {
+		if (rects [index].page == 0 && D3D9AtlasPacker_insert (pages [0], rects [index].w, rects [index].h, &x, &y)) {
+			repacked++;
+		}
+	}
+
+	repackTime = D3D9Test_now () - start;
+
+	for (int page = 0; page < pagesCount; page++) {
+		usedArea += pages [page]->usedArea;
+		D3D9AtlasPacker_free (pages [page]);
+	}
+
+	printf ("%6d | %5d | %9.1f | %10.1f | %8d | %11.1f | %5.1f%%\n",
+		count, pagesCount, packTime / count, packTime / 1000, repacked, repackTime / 1000,
+		100.0 * usedArea / ((double) pagesCount * PAGE_SIZE * PAGE_SIZE));
+
+	free (rects);
+}
+
+int
+main (
+	void
+) {
+	printf ("Sprites from %dx%d to %dx%d in pages of %dx%d\n", SPRITE_MIN, SPRITE_MIN, SPRITE_MAX - 1, SPRITE_MAX - 1, PAGE_SIZE, PAGE_SIZE);
+	printf ("Rects  | Pages | ns/rect   | Total (us) | Repacked | Repack (us) | Filled\n");
+
+	for (int index = 0; index < (int) (sizeof(rectsCounts) / sizeof(*rectsCounts)); index++) {
+		measure (rectsCounts [index]);
+	}
+
+	return 0;
+}
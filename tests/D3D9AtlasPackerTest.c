@@ -0,0 +1,154 @@
+#include "D3D9Test.h"
+#include "D3D9AtlasPacker.h"
+#include <stdlib.h>
+
+// Rectangles of the random test
+#define RANDOM_RECTS 400
+
+// Rectangle packed by the tests
+typedef struct
+{
+	int x, y, w, h;
+
+}	TestRect;
+
+/*
+ * Description : Check that the rectangles packed are inside the area and never overlap
+ * D3D9AtlasPacker *packer : The packer of the rectangles
+ * TestRect *rects : The rectangles packed
+ * int count : Number of rectangles
+ * Return : bool true if every rectangle has its own place
+ */
+static bool
+test_rects_valid (
+	D3D9AtlasPacker *packer,
+	TestRect *rects,
+	int count
+) {
+	for (int index = 0; index < count; index++)
+	{
+		TestRect *rect = &rects [index];
+
+		if (rect->x < 0 || rect->y < 0 || rect->x + rect->w > packer->w || rect->y + rect->h > packer->h) {
+			return false;
+		}
+
+		for (int other = index + 1; other < count; other++) {
+			TestRect *next = &rects [other];
+
+			if (rect->x < next->x + next->w && next->x < rect->x + rect->w
+			&&  rect->y < next->y + next->h && next->y < rect->y + rect->h) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : The rectangles are packed as low then as left as possible, and refused when they don't fit
+ */
+static void
+test_insert (
+	void
+) {
+	D3D9AtlasPacker *packer = D3D9AtlasPacker_new (64, 64);
+	int x, y;
+
+	check (packer != NULL);
+
+	check (D3D9AtlasPacker_insert (packer, 32, 16, &x, &y) && x == 0 && y == 0);
+	check (D3D9AtlasPacker_insert (packer, 32, 8, &x, &y) && x == 32 && y == 0);
+	// The lowest segment is the one of 8 pixels high
+	check (D3D9AtlasPacker_insert (packer, 16, 16, &x, &y) && x == 32 && y == 8);
+
+	check (!D3D9AtlasPacker_insert (packer, 65, 1, &x, &y));
+	check (!D3D9AtlasPacker_insert (packer, 1, 65, &x, &y));
+	check (!D3D9AtlasPacker_insert (packer, 0, 8, &x, &y));
+	check (!D3D9AtlasPacker_insert (packer, 8, -1, &x, &y));
+
+	// The area is full once a rectangle takes all the height left
+	check (D3D9AtlasPacker_insert (packer, 64, 40, &x, &y) && x == 0 && y == 24);
+	check (!D3D9AtlasPacker_insert (packer, 64, 1, &x, &y));
+	check (packer->usedArea == 32 * 16 + 32 * 8 + 16 * 16 + 64 * 40);
+
+	D3D9AtlasPacker_free (packer);
+}
+
+/*
+ * Description : The removed rectangles lower the efficiency, the reset gives back the whole area
+ */
+static void
+test_remove_reset (
+	void
+) {
+	D3D9AtlasPacker packer;
+	int x, y;
+
+	check (D3D9AtlasPacker_init (&packer, 32, 32));
+	check (D3D9AtlasPacker_get_efficiency (&packer) == 1.0);
+
+	check (D3D9AtlasPacker_insert (&packer, 32, 16, &x, &y));
+	check (D3D9AtlasPacker_insert (&packer, 32, 16, &x, &y));
+	check (!D3D9AtlasPacker_insert (&packer, 32, 16, &x, &y));
+
+	// The space of a removed rectangle isn't reused before the reset
+	D3D9AtlasPacker_remove (&packer, 32, 16);
+	check (D3D9AtlasPacker_get_efficiency (&packer) == 0.5);
+	check (packer.usedArea == 32 * 16 && packer.allocatedArea == 32 * 32);
+	check (!D3D9AtlasPacker_insert (&packer, 32, 16, &x, &y));
+
+	D3D9AtlasPacker_reset (&packer);
+	check (packer.usedArea == 0 && packer.allocatedArea == 0 && packer.nodesCount == 1);
+	check (D3D9AtlasPacker_insert (&packer, 32, 32, &x, &y) && x == 0 && y == 0);
+
+	free (packer.nodes);
+}
+
+/*
+ * Description : Random rectangles never overlap and stay inside the area, until the area is full
+ */
+static void
+test_random (
+	void
+) {
+	D3D9AtlasPacker *packer = D3D9AtlasPacker_new (512, 512);
+	TestRect rects [RANDOM_RECTS];
+	unsigned int seed = 1;
+	long long area = 0;
+	int count = 0, refused = 0;
+
+	for (int index = 0; index < RANDOM_RECTS; index++)
+	{
+		TestRect *rect = &rects [count];
+
+		rect->w = 4 + rand_r (&seed) % 60;
+		rect->h = 4 + rand_r (&seed) % 60;
+
+		if (D3D9AtlasPacker_insert (packer, rect->w, rect->h, &rect->x, &rect->y)) {
+			area += rect->w * rect->h;
+			count++;
+		} else {
+			refused++;
+		}
+	}
+
+	check (count > 0 && refused > 0);
+	check (test_rects_valid (packer, rects, count));
+	check (packer->usedArea == area && packer->allocatedArea == area);
+	check (area <= 512 * 512);
+
+	D3D9AtlasPacker_free (packer);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_insert);
+	run_test (test_remove_reset);
+	run_test (test_random);
+
+	return test_result ();
+}
@@ -0,0 +1,65 @@
+#include "D3D9Test.h"
+// The SIMD kernels are private : they are measured one by one through the source
+#include "../D3D9BoundsKernel.c"
+#include <stdlib.h>
+
+// Objects tested by each query, and queries measured per kernel
+#define OBJECTS_COUNT 10000
+#define QUERIES_COUNT 2000
+
+static int x [OBJECTS_COUNT], y [OBJECTS_COUNT], w [OBJECTS_COUNT], h [OBJECTS_COUNT];
+static unsigned int mask [D3D9_BOUNDS_MASK_WORDS (OBJECTS_COUNT)];
+
+/*
+ * Description : Measure a kernel with point queries over a 1920 x 1080 screen
+ * D3D9BoundsKernelFunction kernel : The kernel measured
+ * char *name : Name of the kernel
+ * Return : void
+ */
+static void
+measure (
+	D3D9BoundsKernelFunction kernel,
+	char *name
+) {
+	D3D9Bounds bounds = {x, y, w, h, OBJECTS_COUNT};
+	unsigned int seed = 1;
+	long long found = 0;
+	double start = D3D9Test_now ();
+
+	for (int query = 0; query < QUERIES_COUNT; query++) {
+		found += kernel (&bounds, rand_r (&seed) % 1920, rand_r (&seed) % 1080, 1, 1, mask);
+	}
+
+	double elapsed = D3D9Test_now () - start;
+
+	printf ("D3D9BoundsKernel %-6s : %.2f us per query of %d objects, %.2f ns per object (%lld hits)\n",
+		name, elapsed / QUERIES_COUNT / 1000.0, OBJECTS_COUNT, elapsed / ((double) QUERIES_COUNT * OBJECTS_COUNT), found);
+}
+
+int
+main (
+	void
+) {
+	unsigned int seed = 2;
+
+	for (int i = 0; i < OBJECTS_COUNT; i++) {
+		x [i] = rand_r (&seed) % 1920;
+		y [i] = rand_r (&seed) % 1080;
+		w [i] = rand_r (&seed) % 200 + 1;
+		h [i] = rand_r (&seed) % 100 + 1;
+	}
+
+	__builtin_cpu_init ();
+
+	measure (D3D9BoundsKernel_intersect_scalar, "scalar");
+
+	if (__builtin_cpu_supports ("sse2")) {
+		measure (D3D9BoundsKernel_intersect_sse2, "sse2");
+	}
+
+	if (__builtin_cpu_supports ("avx2")) {
+		measure (D3D9BoundsKernel_intersect_avx2, "avx2");
+	}
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+#include "D3D9Test.h"
+// The SIMD kernels are private : they are tested one by one through the source
+#include "../D3D9BoundsKernel.c"
+#include <stdlib.h>
+
+// Largest number of objects tested
+#define OBJECTS_MAX 200
+
+/*
+ * Description : Intersection of an object with a rectangle, written independently of the kernels
+ * Return : bool true if the half open rectangles share a pixel
+ */
+static bool
+naive_intersect (
+	int ox, int oy, int ow, int oh,
+	int x, int y, int w, int h
+) {
+	if (ow <= 0 || oh <= 0 || w <= 0 || h <= 0) {
+		return false;
+	}
+
+	int left   = (ox > x) ? ox : x;
+	int top    = (oy > y) ? oy : y;
+	int right  = (ox + ow < x + w) ? ox + ow : x + w;
+	int bottom = (oy + oh < y + h) ? oy + oh : y + h;
+
+	return left < right && top < bottom;
+}
+
+/*
+ * Description : Compare a kernel with the naive intersection on random bounds, for every count up to OBJECTS_MAX
+ * D3D9BoundsKernelFunction kernel : The kernel tested
+ * Return : void
+ */
+static void
+check_kernel (
+	D3D9BoundsKernelFunction kernel
+) {
+	static int x [OBJECTS_MAX], y [OBJECTS_MAX], w [OBJECTS_MAX], h [OBJECTS_MAX];
+	unsigned int mask [D3D9_BOUNDS_MASK_WORDS (OBJECTS_MAX) + 1];
+	unsigned int seed = 1;
+
+	for (int count = 0; count <= OBJECTS_MAX; count++)
+	{
+		D3D9Bounds bounds = {x, y, w, h, count};
+
+		// Small coordinates so the rectangles often touch, and empty or negative sizes
+		for (int i = 0; i < count; i++) {
+			x [i] = rand_r (&seed) % 64 - 16;
+			y [i] = rand_r (&seed) % 64 - 16;
+			w [i] = rand_r (&seed) % 24 - 2;
+			h [i] = rand_r (&seed) % 24 - 2;
+		}
+
+		for (int query = 0; query < 8; query++) {
+			int qx = rand_r (&seed) % 64 - 16;
+			int qy = rand_r (&seed) % 64 - 16;
+			int qw = (query == 0) ? 1 : rand_r (&seed) % 32;
+			int qh = (query == 0) ? 1 : rand_r (&seed) % 32;
+			int expected = 0;
+
+			// The word after the mask must be left untouched
+			memset (mask, 0xFF, sizeof(mask));
+			int found = kernel (&bounds, qx, qy, qw, qh, mask);
+
+			for (int i = 0; i < count; i++) {
+				bool hit = naive_intersect (x [i], y [i], w [i], h [i], qx, qy, qw, qh);
+				check (D3D9_BOUNDS_MASK_TEST (mask, i) == hit);
+				expected += hit;
+			}
+
+			for (int i = count; i < D3D9_BOUNDS_MASK_WORDS (count) * 32; i++) {
+				check (D3D9_BOUNDS_MASK_TEST (mask, i) == 0);
+			}
+
+			check (mask [D3D9_BOUNDS_MASK_WORDS (count)] == 0xFFFFFFFF);
+			check (found == expected);
+		}
+	}
+}
+
+/*
+ * Description : Every kernel supported by the CPU gives the same result as the naive intersection
+ */
+static void
+test_kernels (
+	void
+) {
+	check_kernel (D3D9BoundsKernel_intersect_scalar);
+	check_kernel (D3D9BoundsKernel_intersect);
+
+	__builtin_cpu_init ();
+
+	if (__builtin_cpu_supports ("sse2")) {
+		check_kernel (D3D9BoundsKernel_intersect_sse2);
+	}
+
+	if (__builtin_cpu_supports ("avx2")) {
+		check_kernel (D3D9BoundsKernel_intersect_avx2);
+	} else {
+		printf ("AVX2 isn't supported by the CPU, its kernel isn't tested.\n");
+	}
+}
+
+/*
+ * Description : The last object set is found in any word of the mask
+ */
+static void
+test_get_last (
+	void
+) {
+	unsigned int mask [D3D9_BOUNDS_MASK_WORDS (100)] = {0};
+
+	check (D3D9BoundsKernel_get_last (mask, 100) == -1);
+	check (D3D9BoundsKernel_get_last (mask, 0) == -1);
+
+	mask [0] = 1;
+	check (D3D9BoundsKernel_get_last (mask, 100) == 0);
+
+	mask [1] = 1U << 31;
+	check (D3D9BoundsKernel_get_last (mask, 100) == 63);
+
+	mask [3] = 1U << 3;
+	check (D3D9BoundsKernel_get_last (mask, 100) == 99);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_kernels);
+	run_test (test_get_last);
+
+	return test_result ();
+}
@@ -0,0 +1,257 @@
+#include "D3D9Test.h"
+#include "D3D9Snapshot.h"
+#include "D3D9SeqLock.h"
+#include "D3D9Lock.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Frame walk of a draw list of 100k objects while a writer moves them : the move is written in place in the row
+// of the snapshot published under its version, against a new snapshot of every row built for each move.
+
+#define OBJECTS_COUNT 100000
+#define FRAMES_COUNT  200
+// Time left to the writer between two frames, in microseconds
+#define FRAME_INTERVAL 1000
+
+// Snapshot of the draw list, with the layout of D3D9ObjectDrawList
+typedef struct
+{
+	D3D9Snapshot snapshot;
+	int count;
+	int *x, *y, *w, *h;
+	unsigned int *colors;
+	D3D9SeqLock *versions;
+
+}	BenchDrawList;
+
+// State shared by the writer and the frame loop
+typedef struct
+{
+	D3D9SnapshotExchange exchange;
+	D3D9Lock lock;
+	// Positions of the objects, copied by the rebuilds
+	int x [OBJECTS_COUNT], y [OBJECTS_COUNT];
+	bool inPlace;
+	volatile int stopping;
+	volatile long long moves;
+
+}	BenchState;
+
+// Sum of the rows walked, so the walk isn't optimized out
+static volatile long long walked;
+
+/*
+ * Description : Build a snapshot of every row, in a spare block if possible, and publish it
+ * BenchState *state : The state of the bench, locked exclusively
+ * Return : BenchDrawList * the snapshot published
+ */
+static BenchDrawList *
+bench_publish (
+	BenchState *state
+) {
+	BenchDrawList *drawList;
+
+	if (!(drawList = (BenchDrawList *) D3D9SnapshotExchange_get_spare (&state->exchange, OBJECTS_COUNT))) {
+		drawList = malloc (sizeof(BenchDrawList) + (sizeof(int) * 5 + sizeof(D3D9SeqLock)) * OBJECTS_COUNT);
+		drawList->snapshot.capacity = OBJECTS_COUNT;
+	}
+
+	drawList->x        = (int *) (drawList + 1);
+	drawList->y        = drawList->x + OBJECTS_COUNT;
+	drawList->w        = drawList->y + OBJECTS_COUNT;
+	drawList->h        = drawList->w + OBJECTS_COUNT;
+	drawList->colors   = (unsigned int *) (drawList->h + OBJECTS_COUNT);
+	drawList->versions = (D3D9SeqLock *) (drawList->colors + OBJECTS_COUNT);
+	drawList->count    = OBJECTS_COUNT;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		drawList->x [index]        = state->x [index];
+		drawList->y [index]        = state->y [index];
+		drawList->w [index]        = 32;
+		drawList->h [index]        = 32;
+		drawList->colors [index]   = 0xFFFFFFFF;
+		drawList->versions [index] = D3D9_SEQ_LOCK_INITIALIZER;
+	}
+
+	D3D9SnapshotExchange_publish (&state->exchange, &drawList->snapshot);
+
+	return drawList;
+}
+
+/*
+ * Description : Writer : moves random objects, in place or with a new snapshot each time
+ * void *argument : The BenchState
+ * Return : void * NULL
+ */
+static void *
+bench_writer (
+	void *argument
+) {
+	BenchState *state = argument;
+	unsigned int seed = (unsigned int) (size_t) &seed;
+
+	while (!__atomic_load_n (&state->stopping, __ATOMIC_RELAXED))
+	{
+		int index = rand_r (&seed) % OBJECTS_COUNT;
+
+		D3D9Lock_acquire_exclusive (&state->lock);
+
+		state->x [index] = rand_r (&seed) % 1920;
+		state->y [index] = rand_r (&seed) % 1080;
+
+		if (state->inPlace) {
+			BenchDrawList *drawList = (BenchDrawList *) state->exchange.published;
+
+			D3D9SeqLock_write_begin (&drawList->versions [index]);
+			drawList->x [index] = state->x [index];
+			drawList->y [index] = state->y [index];
+			D3D9SeqLock_write_end (&drawList->versions [index]);
+		} else {
+			bench_publish (state);
+		}
+
+		D3D9Lock_release_exclusive (&state->lock);
+		__sync_fetch_and_add (&state->moves, 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Walk every row of a snapshot like the frame loop
+ * BenchDrawList *drawList : The snapshot acquired
+ * bool versioned : Copy each row under its version, or read the arrays directly
+ * Return : long long the sum of the rows
+ */
+static long long
+bench_walk (
+	BenchDrawList *drawList,
+	bool versioned
+) {
+	long long sum = 0;
+
+	for (int index = 0; index < drawList->count; index++)
+	{
+		int x, y, w, h;
+		unsigned int color, version = 0;
+
+		do {
+			if (versioned) {
+				version = D3D9SeqLock_read_begin (&drawList->versions [index]);
+			}
+
+			x     = drawList->x [index];
+			y     = drawList->y [index];
+			w     = drawList->w [index];
+			h     = drawList->h [index];
+			color = drawList->colors [index];
+		} while (versioned && D3D9SeqLock_read_retry (&drawList->versions [index], version));
+
+		sum += x + y + w + h + (color & 0xFF);
+	}
+
+	return sum;
+}
+
+/*
+ * Description : Compare two times
+ * const void *a, *b : Two doubles
+ * Return : int lower, equal or greater than 0
+ */
+static int
+compare_times (
+	const void *a,
+	const void *b
+) {
+	double timeA = *(const double *) a;
+	double timeB = *(const double *) b;
+
+	return (timeA > timeB) - (timeA < timeB);
+}
+
+/*
+ * Description : Walk the frames, with or without a writer moving the objects, and print the walk times and the moves
+ * const char *name : Name of the configuration
+ * bool writer : Run a writer moving the objects
+ * bool inPlace : The writer writes the rows in place, or publishes a new snapshot per move
+ * bool versioned : The frame copies the rows under their version
+ * Return : void
+ */
+static void
+measure (
+	const char *name,
+	bool writer,
+	bool inPlace,
+	bool versioned
+) {
+	BenchState *state = calloc (1, sizeof(BenchState));
+	double *times = malloc (sizeof(double) * FRAMES_COUNT);
+	double start, elapsed;
+	pthread_t thread;
+	long long sum = 0;
+
+	D3D9SnapshotExchange_init (&state->exchange, 0);
+	D3D9Lock_init (&state->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+	state->inPlace = inPlace;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		state->x [index] = index % 1920;
+		state->y [index] = index % 1080;
+	}
+
+	bench_publish (state);
+
+	if (writer) {
+		pthread_create (&thread, NULL, bench_writer, state);
+	}
+
+	start = D3D9Test_now ();
+
+	for (int frame = 0; frame < FRAMES_COUNT; frame++)
+	{
+		usleep (FRAME_INTERVAL);
+
+		double frameStart = D3D9Test_now ();
+		BenchDrawList *drawList = (BenchDrawList *) D3D9SnapshotExchange_acquire (&state->exchange);
+
+		sum += bench_walk (drawList, versioned);
+		D3D9SnapshotExchange_release (&state->exchange);
+
+		times [frame] = D3D9Test_now () - frameStart;
+	}
+
+	elapsed = D3D9Test_now () - start;
+	state->stopping = 1;
+
+	if (writer) {
+		pthread_join (thread, NULL);
+	}
+
+	qsort (times, FRAMES_COUNT, sizeof(double), compare_times);
+	walked = sum;
+
+	printf ("%-17s | %8.1f | %8.1f | %8.2f | %11.0f\n",
+		name, times [FRAMES_COUNT / 2] / 1000, times [FRAMES_COUNT * 99 / 100] / 1000,
+		times [FRAMES_COUNT / 2] / OBJECTS_COUNT, state->moves / (elapsed / 1e9));
+
+	D3D9SnapshotExchange_destroy (&state->exchange);
+	D3D9Lock_destroy (&state->lock);
+	free (times);
+	free (state);
+}
+
+int
+main (
+	void
+) {
+	printf ("%d objects, %d frames\n", OBJECTS_COUNT, FRAMES_COUNT);
+	printf ("Frame             | p50 (us) | p99 (us) | ns/row   | Moves/s\n");
+
+	measure ("plain, idle",       false, false, false);
+	measure ("versioned, idle",   false, false, true);
+	measure ("rebuild per move",  true,  false, false);
+	measure ("in place",          true,  true,  true);
+
+	return 0;
+}
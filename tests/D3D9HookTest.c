@@ -0,0 +1,405 @@
+#include "D3D9Test.h"
+#include "D3D9Hook.h"
+#include <string.h>
+
+// The hooks are installed on a fake vftable : the methods of the device are replaced by counters.
+// D3D9Hook only builds on Windows : this test is built by "make hook".
+
+// Calls reaching the fake methods and the hooks, by index
+static int originalCalls [D3D9INDEX_VFTABLE_SIZE];
+static int hookCalls [D3D9INDEX_VFTABLE_SIZE];
+static DWORD lastValue;
+
+static void *fakeVftable [D3D9_HOOK_VFTABLE_MIN_COUNT];
+static IDirect3DDevice9 fakeDevice = {.lpVtbl = (IDirect3DDevice9Vtbl *) fakeVftable};
+static D3D9Hook *hook;
+
+/*
+ * Description : Fake methods of the device, counting their calls
+ */
+static HRESULT __stdcall
+fake_BeginScene (
+	IDirect3DDevice9 *device
+) {
+	(void) device;
+	originalCalls [D3D9INDEX_BeginScene]++;
+	return D3D_OK;
+}
+
+static HRESULT __stdcall
+fake_EndScene (
+	IDirect3DDevice9 *device
+) {
+	(void) device;
+	originalCalls [D3D9INDEX_EndScene]++;
+	return D3D_OK;
+}
+
+static HRESULT __stdcall
+fake_SetRenderState (
+	IDirect3DDevice9 *device,
+	D3DRENDERSTATETYPE state,
+	DWORD value
+) {
+	(void) device;
+	(void) state;
+	originalCalls [D3D9INDEX_SetRenderState]++;
+	lastValue = value;
+	return D3D_OK;
+}
+
+static HRESULT __stdcall
+fake_Clear (
+	IDirect3DDevice9 *device,
+	DWORD count,
+	CONST D3DRECT *rects,
+	DWORD flags,
+	D3DCOLOR color,
+	float z,
+	DWORD stencil
+) {
+	(void) device; (void) count; (void) rects; (void) flags; (void) color; (void) z; (void) stencil;
+	originalCalls [D3D9INDEX_Clear]++;
+	return D3D_OK;
+}
+
+/*
+ * Description : Method of the fake vftable that the tests never call
+ */
+static void
+fake_unused (
+	void
+) {
+	check (false);
+}
+
+/*
+ * Description : Hooks of the fake methods, calling the originals
+ */
+static HRESULT __stdcall
+hook_BeginScene (
+	IDirect3DDevice9 *device
+) {
+	hookCalls [D3D9INDEX_BeginScene]++;
+	return D3D9Hook_get_original (hook, BeginScene) (device);
+}
+
+static HRESULT __stdcall
+hook_EndScene (
+	IDirect3DDevice9 *device
+) {
+	hookCalls [D3D9INDEX_EndScene]++;
+	return D3D9Hook_get_original (hook, EndScene) (device);
+}
+
+static HRESULT __stdcall
+hook_SetRenderState (
+	IDirect3DDevice9 *device,
+	D3DRENDERSTATETYPE state,
+	DWORD value
+) {
+	hookCalls [D3D9INDEX_SetRenderState]++;
+	return D3D9Hook_get_original (hook, SetRenderState) (device, state, value + 1);
+}
+
+static HRESULT __stdcall
+hook_Clear (
+	IDirect3DDevice9 *device,
+	DWORD count,
+	CONST D3DRECT *rects,
+	DWORD flags,
+	D3DCOLOR color,
+	float z,
+	DWORD stencil
+) {
+	hookCalls [D3D9INDEX_Clear]++;
+	return D3D9Hook_get_original (hook, Clear) (device, count, rects, flags, color, z, stencil);
+}
+
+/*
+ * Description : Fill the fake vftable with the fake methods, reset the counters and hook it
+ * Return : void
+ */
+static void
+setup (
+	void
+) {
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		fakeVftable [index] = (void *) fake_unused;
+	}
+
+	fakeVftable [D3D9INDEX_BeginScene]     = (void *) fake_BeginScene;
+	fakeVftable [D3D9INDEX_EndScene]       = (void *) fake_EndScene;
+	fakeVftable [D3D9INDEX_SetRenderState] = (void *) fake_SetRenderState;
+	fakeVftable [D3D9INDEX_Clear]          = (void *) fake_Clear;
+
+	memset (originalCalls, 0, sizeof(originalCalls));
+	memset (hookCalls, 0, sizeof(hookCalls));
+
+	check ((hook = D3D9Hook_new_with_vftable ((DWORD *) fakeVftable, D3D9_HOOK_VFTABLE_MIN_COUNT)) != NULL);
+}
+
+/*
+ * Description : Only a vftable of the size of a device is accepted
+ */
+static void
+test_vftable (
+	void
+) {
+	check (D3D9Hook_new_with_vftable (NULL, D3D9_HOOK_VFTABLE_MIN_COUNT) == NULL);
+	check (D3D9Hook_new_with_vftable ((DWORD *) fakeVftable, D3D9_HOOK_VFTABLE_MIN_COUNT - 1) == NULL);
+	check (D3D9Hook_new_with_vftable ((DWORD *) fakeVftable, D3D9_HOOK_VFTABLE_MAX_COUNT + 1) == NULL);
+}
+
+/*
+ * Description : A batch writes the slots of the methods requested only, and the calls through the vftable reach the hooks
+ */
+static void
+test_hook_batch (
+	void
+) {
+	void *before [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookRequest requests [] = {
+		{.index = D3D9INDEX_BeginScene,     .hookFunction = (ULONG_PTR) hook_BeginScene},
+		{.index = D3D9INDEX_EndScene,       .hookFunction = (ULONG_PTR) hook_EndScene},
+		{.index = D3D9INDEX_SetRenderState, .hookFunction = (ULONG_PTR) hook_SetRenderState},
+	};
+	int count = sizeof(requests) / sizeof(*requests);
+
+	setup ();
+	memcpy (before, fakeVftable, sizeof(before));
+
+	check (D3D9Hook_hook_batch (hook, requests, count));
+
+	for (int request = 0; request < count; request++) {
+		D3D9VirtualFunctionTableIndex index = requests [request].index;
+
+		check (requests [request].originalFunction == before [index]);
+		check (hook->original.slots [index] == before [index]);
+		check (fakeVftable [index] != before [index]);
+	}
+
+	for (int index = 0; index < D3D9_HOOK_VFTABLE_MIN_COUNT; index++) {
+		if (index != D3D9INDEX_BeginScene && index != D3D9INDEX_EndScene && index != D3D9INDEX_SetRenderState) {
+			check (fakeVftable [index] == before [index]);
+			check (hook->original.slots [index] == NULL);
+		}
+	}
+
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	fakeDevice.lpVtbl->SetRenderState (&fakeDevice, D3DRS_ZENABLE, 41);
+	fakeDevice.lpVtbl->EndScene (&fakeDevice);
+
+	check (hookCalls [D3D9INDEX_BeginScene] == 1 && originalCalls [D3D9INDEX_BeginScene] == 1);
+	check (hookCalls [D3D9INDEX_EndScene] == 1 && originalCalls [D3D9INDEX_EndScene] == 1);
+	check (hookCalls [D3D9INDEX_SetRenderState] == 1 && originalCalls [D3D9INDEX_SetRenderState] == 1);
+	check (lastValue == 42);
+
+	D3D9Hook_free (hook);
+}
+
+/*
+ * Description : A batch with an invalid request hooks nothing
+ */
+static void
+test_hook_batch_invalid (
+	void
+) {
+	void *before [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookRequest twice [] = {
+		{.index = D3D9INDEX_Clear,      .hookFunction = (ULONG_PTR) hook_Clear},
+		{.index = D3D9INDEX_BeginScene, .hookFunction = (ULONG_PTR) hook_BeginScene},
+		{.index = D3D9INDEX_BeginScene, .hookFunction = (ULONG_PTR) hook_BeginScene},
+	};
+	D3D9HookRequest invalid [] = {
+		{.index = D3D9INDEX_Clear,     .hookFunction = (ULONG_PTR) hook_Clear},
+		{.index = D3D9INDEX_Undefined, .hookFunction = (ULONG_PTR) hook_Clear},
+	};
+	D3D9HookRequest hooked [] = {
+		{.index = D3D9INDEX_Clear,    .hookFunction = (ULONG_PTR) hook_Clear},
+		{.index = D3D9INDEX_EndScene, .hookFunction = (ULONG_PTR) hook_EndScene},
+	};
+
+	setup ();
+	memcpy (before, fakeVftable, sizeof(before));
+
+	check (!D3D9Hook_hook_batch (hook, twice, 3));
+	check (!D3D9Hook_hook_batch (hook, invalid, 2));
+	check (memcmp (before, fakeVftable, sizeof(before)) == 0);
+
+	// A method already hooked can't be hooked again by a batch
+	check (D3D9Hook_hook_method (hook, EndScene, hook_EndScene) == fake_EndScene);
+	check (!D3D9Hook_hook_batch (hook, hooked, 2));
+	check (fakeVftable [D3D9INDEX_Clear] == before [D3D9INDEX_Clear]);
+	check (hook->original.slots [D3D9INDEX_Clear] == NULL);
+
+	D3D9Hook_free (hook);
+}
+
+/*
+ * Description : Hook alternative to hook_BeginScene, for the swaps
+ */
+static HRESULT __stdcall
+hook_BeginScene_swapped (
+	IDirect3DDevice9 *device
+) {
+	hookCalls [D3D9INDEX_BeginScene] += 100;
+	return D3D9Hook_get_original (hook, BeginScene) (device);
+}
+
+/*
+ * Description : The methods hooked by a batch in inline mode are unhooked : the vftable is written back as it was
+ */
+static void
+test_unhook_batch (
+	void
+) {
+	void *before [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookRequest requests [] = {
+		{.index = D3D9INDEX_BeginScene, .hookFunction = (ULONG_PTR) hook_BeginScene},
+		{.index = D3D9INDEX_EndScene,   .hookFunction = (ULONG_PTR) hook_EndScene},
+	};
+
+	setup ();
+	memcpy (before, fakeVftable, sizeof(before));
+
+	check (D3D9Hook_hook_batch (hook, requests, 2));
+	check (hook->installed [D3D9INDEX_BeginScene] == D3D9_HOOK_MODE_SLOT);
+	check (hook->modes [D3D9INDEX_BeginScene] == D3D9_HOOK_MODE_INLINE);
+
+	// Hooked in inline mode : through the thunk, so swappable
+	check (D3D9Hook_swap (hook, D3D9INDEX_BeginScene, (ULONG_PTR) hook_BeginScene_swapped, 1000));
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	check (hookCalls [D3D9INDEX_BeginScene] == 100 && originalCalls [D3D9INDEX_BeginScene] == 1);
+
+	check (D3D9Hook_unhook_all (hook, 1000));
+	check (memcmp (before, fakeVftable, sizeof(before)) == 0);
+	check (!hook->hooked [D3D9INDEX_BeginScene] && !hook->hooked [D3D9INDEX_EndScene]);
+
+	// The calls reach the originals only, and the methods can be hooked again
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	fakeDevice.lpVtbl->EndScene (&fakeDevice);
+	check (hookCalls [D3D9INDEX_BeginScene] == 100 && originalCalls [D3D9INDEX_BeginScene] == 2);
+	check (hookCalls [D3D9INDEX_EndScene] == 0 && originalCalls [D3D9INDEX_EndScene] == 1);
+
+	check (D3D9Hook_hook_batch (hook, requests, 2));
+	D3D9Hook_free (hook);
+	check (memcmp (before, fakeVftable, sizeof(before)) == 0);
+}
+
+/*
+ * Description : A hook in slot mode is called directly unless swappable, and both are unhooked
+ */
+static void
+test_unhook_slot (
+	void
+) {
+	void *before [D3D9_HOOK_VFTABLE_MIN_COUNT];
+
+	setup ();
+	memcpy (before, fakeVftable, sizeof(before));
+
+	check (D3D9Hook_set_mode (hook, D3D9INDEX_BeginScene, D3D9_HOOK_MODE_SLOT));
+	check (D3D9Hook_set_mode (hook, D3D9INDEX_EndScene, D3D9_HOOK_MODE_SLOT));
+	check (D3D9Hook_set_swappable (hook, D3D9INDEX_EndScene, true));
+
+	check (D3D9Hook_hook_method (hook, BeginScene, hook_BeginScene) == fake_BeginScene);
+	check (D3D9Hook_hook_method (hook, EndScene, hook_EndScene) == fake_EndScene);
+	check (fakeVftable [D3D9INDEX_BeginScene] == (void *) hook_BeginScene);
+	check (fakeVftable [D3D9INDEX_EndScene] == D3D9HookThunks_get_entry (hook->thunks, D3D9INDEX_EndScene));
+
+	check (!D3D9Hook_swap (hook, D3D9INDEX_BeginScene, (ULONG_PTR) hook_BeginScene_swapped, 1000));
+	check (!D3D9Hook_set_swappable (hook, D3D9INDEX_BeginScene, true));
+
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	fakeDevice.lpVtbl->EndScene (&fakeDevice);
+	check (hookCalls [D3D9INDEX_BeginScene] == 1 && originalCalls [D3D9INDEX_BeginScene] == 1);
+	check (hookCalls [D3D9INDEX_EndScene] == 1 && originalCalls [D3D9INDEX_EndScene] == 1);
+
+	check (D3D9Hook_unhook (hook, D3D9INDEX_BeginScene, 1000));
+	check (D3D9Hook_unhook (hook, D3D9INDEX_EndScene, 1000));
+	check (!D3D9Hook_unhook (hook, D3D9INDEX_EndScene, 1000));
+	check (memcmp (before, fakeVftable, sizeof(before)) == 0);
+
+	// The originals stay readable by the hooks still running
+	check (D3D9Hook_get_original (hook, BeginScene) == fake_BeginScene);
+
+	D3D9Hook_free (hook);
+}
+
+/*
+ * Description : Profiling times the methods not hooked and the methods hooked through their thunk with their hook,
+ *               and unprofiling writes the vftable back as it was
+ */
+static void
+test_profile (
+	void
+) {
+	void *before [D3D9_HOOK_VFTABLE_MIN_COUNT], *hooked [D3D9_HOOK_VFTABLE_MIN_COUNT];
+	D3D9HookRequest requests [] = {
+		{.index = D3D9INDEX_BeginScene, .hookFunction = (ULONG_PTR) hook_BeginScene},
+	};
+	D3D9Profiler *profiler;
+	D3D9ProfilerStats stats;
+
+	setup ();
+	memcpy (before, fakeVftable, sizeof(before));
+	check ((profiler = D3D9Profiler_new (D3D9_HOOK_VFTABLE_MIN_COUNT)) != NULL);
+
+	// BeginScene through its thunk, EndScene directly : the profiler can't time it
+	check (D3D9Hook_hook_batch (hook, requests, 1));
+	check (D3D9Hook_set_mode (hook, D3D9INDEX_EndScene, D3D9_HOOK_MODE_SLOT));
+	check (D3D9Hook_hook_method (hook, EndScene, hook_EndScene) == fake_EndScene);
+	memcpy (hooked, fakeVftable, sizeof(hooked));
+
+	check (D3D9Hook_profile (hook, profiler));
+	check (!D3D9Hook_profile (hook, profiler));
+
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	fakeDevice.lpVtbl->EndScene (&fakeDevice);
+	fakeDevice.lpVtbl->SetRenderState (&fakeDevice, D3DRS_ZENABLE, 1);
+	fakeDevice.lpVtbl->SetRenderState (&fakeDevice, D3DRS_ZENABLE, 2);
+	D3D9Profiler_aggregate (profiler);
+
+	check (hookCalls [D3D9INDEX_BeginScene] == 1 && originalCalls [D3D9INDEX_BeginScene] == 1);
+	check (hookCalls [D3D9INDEX_EndScene] == 1 && originalCalls [D3D9INDEX_EndScene] == 1);
+	check (originalCalls [D3D9INDEX_SetRenderState] == 2 && lastValue == 2);
+	check (D3D9Profiler_get_stats (profiler, D3D9INDEX_BeginScene, &stats) && stats.calls == 1);
+	check (D3D9Profiler_get_stats (profiler, D3D9INDEX_EndScene, &stats) && stats.calls == 0);
+	check (D3D9Profiler_get_stats (profiler, D3D9INDEX_SetRenderState, &stats) && stats.calls == 2);
+
+	// Round trip : the hooks of before are installed again, the others are unhooked
+	check (D3D9Hook_unprofile (hook, 1000));
+	check (memcmp (hooked, fakeVftable, sizeof(hooked)) == 0);
+	check (hook->thunks->thunks [D3D9INDEX_BeginScene].implementation == (void *) hook_BeginScene);
+	check (!hook->hooked [D3D9INDEX_SetRenderState] && hook->hooked [D3D9INDEX_BeginScene]);
+
+	fakeDevice.lpVtbl->BeginScene (&fakeDevice);
+	check (hookCalls [D3D9INDEX_BeginScene] == 2);
+
+	D3D9Profiler_free (profiler);
+
+	// The profiler can be used again
+	check ((profiler = D3D9Profiler_new (D3D9_HOOK_VFTABLE_MIN_COUNT)) != NULL);
+	check (D3D9Hook_profile (hook, profiler));
+	check (D3D9Hook_unprofile (hook, 1000));
+	check (memcmp (hooked, fakeVftable, sizeof(hooked)) == 0);
+	D3D9Profiler_free (profiler);
+
+	D3D9Hook_free (hook);
+	check (memcmp (before, fakeVftable, sizeof(before)) == 0);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_vftable);
+	run_test (test_hook_batch);
+	run_test (test_hook_batch_invalid);
+	run_test (test_unhook_batch);
+	run_test (test_unhook_slot);
+	run_test (test_profile);
+
+	return test_result ();
+}
@@ -0,0 +1,152 @@
+#include "D3D9Test.h"
+#include "D3D9HookThunks.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Cost of a call through each kind of hook, on a synthetic vftable called like the game calls SetRenderState.
+// The inline mode adds the jump of the HookEngine detour in front of the thunk : it only exists on Windows.
+
+// Calls measured per configuration
+#define CALLS_COUNT    20000000
+// Threads calling the hooked methods at the same time
+#define THREADS_COUNT  4
+// Methods of the synthetic vftable : one per thread
+#define METHODS_COUNT  THREADS_COUNT
+
+typedef struct
+{
+	void * volatile *lpVtbl;
+
+}	FakeDevice;
+
+typedef int (*FakeMethod) (FakeDevice *device, int state, int value);
+
+// The vftable is read at each call, as the game does
+static void * volatile vftable [METHODS_COUNT];
+static FakeMethod originals [METHODS_COUNT];
+static D3D9HookThunks *thunks;
+
+/*
+ * Description : Method of the device, doing as little as possible
+ */
+static __attribute__((noinline)) int
+fake_method (
+	FakeDevice *device,
+	int state,
+	int value
+) {
+	(void) device;
+	return state + value;
+}
+
+/*
+ * Description : Hook of the methods, calling the original of the first one
+ */
+static __attribute__((noinline)) int
+hook_method_0 (
+	FakeDevice *device,
+	int state,
+	int value
+) {
+	return originals [0] (device, state, value);
+}
+
+/*
+ * Description : Call a method of the device as the game does, through its vftable
+ * int index : Index of the method
+ * Return : double the nanoseconds per call
+ */
+static double
+measure_calls (
+	int index
+) {
+	FakeDevice device = {.lpVtbl = vftable};
+	volatile int sink = 0;
+	double start = D3D9Test_now ();
+
+	for (int i = 0; i < CALLS_COUNT; i++) {
+		sink += ((FakeMethod) device.lpVtbl [index]) (&device, i, 1);
+	}
+
+	return (D3D9Test_now () - start) / CALLS_COUNT;
+}
+
+/*
+ * Description : Thread calling a method through the vftable
+ * void *argument : Index of the method
+ * Return : void * NULL
+ */
+static void *
+caller_thread (
+	void *argument
+) {
+	measure_calls ((int) (intptr_t) argument);
+
+	return NULL;
+}
+
+/*
+ * Description : Call methods from several threads at once
+ * bool sameMethod : true if all the threads call the method 0, false if each calls its own
+ * Return : double the nanoseconds per call, all the threads together
+ */
+static double
+measure_threads (
+	bool sameMethod
+) {
+	pthread_t threads [THREADS_COUNT];
+	double start = D3D9Test_now ();
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_create (&threads [index], NULL, caller_thread, (void *) (intptr_t) (sameMethod ? 0 : index));
+	}
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_join (threads [index], NULL);
+	}
+
+	return (D3D9Test_now () - start) / ((double) CALLS_COUNT * THREADS_COUNT);
+}
+
+int
+main (
+	void
+) {
+	int argumentsCounts [METHODS_COUNT];
+	double original, direct, thunk;
+
+	for (int index = 0; index < METHODS_COUNT; index++) {
+		argumentsCounts [index] = 3;
+		originals [index] = fake_method;
+		vftable [index] = (void *) fake_method;
+	}
+
+	if (!(thunks = D3D9HookThunks_new (argumentsCounts, METHODS_COUNT))) {
+		fprintf (stderr, "Cannot allocate the thunks.\n");
+		return 1;
+	}
+
+	original = measure_calls (0);
+
+	// Slot or shadow mode : the vftable points to the hook
+	vftable [0] = (void *) hook_method_0;
+	direct = measure_calls (0);
+
+	// Slot or shadow mode made swappable : the vftable points to the thunk, which calls the hook
+	for (int index = 0; index < METHODS_COUNT; index++) {
+		D3D9HookThunks_swap (thunks, index, (void *) hook_method_0);
+		vftable [index] = D3D9HookThunks_get_entry (thunks, index);
+	}
+	thunk = measure_calls (0);
+
+	printf ("Not hooked                        : %.2f ns per call\n", original);
+	printf ("Hook called directly              : %.2f ns per call (+%.2f ns)\n", direct, direct - original);
+	printf ("Hook called through its thunk     : %.2f ns per call (+%.2f ns)\n", thunk, thunk - original);
+	printf ("Thunk, %d threads, same method     : %.2f ns per call\n", THREADS_COUNT, measure_threads (true));
+	printf ("Thunk, %d threads, one method each : %.2f ns per call (%ld processors)\n",
+		THREADS_COUNT, measure_threads (false), sysconf (_SC_NPROCESSORS_ONLN));
+
+	D3D9HookThunks_free (thunks);
+
+	return 0;
+}
@@ -0,0 +1,250 @@
+#include "D3D9Test.h"
+#include "D3D9HookThunks.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+// Threads calling a synthetic vftable while the main thread swaps the hooks of a method and unhooks it.
+// A hook is retired once D3D9HookThunks_wait returns after it has been swapped out : it must never run again.
+
+// Threads calling the method without pause
+#define THREADS_COUNT  4
+// Hooks swapped in turn
+#define HOOKS_COUNT    4
+// Swaps done while the threads call the method
+#define SWAPS_COUNT    200
+// Maximum time waited for the calls of a hook, in milliseconds
+#define WAIT_TIMEOUT   5000
+
+typedef struct
+{
+	void * volatile *lpVtbl;
+
+}	FakeDevice;
+
+typedef long (*FakeMethod) (FakeDevice *device, long first, long second);
+
+static void * volatile vftable [1];
+static D3D9HookThunks *thunks;
+
+// Calls running each hook, and the hooks which mustn't run anymore
+static volatile int running [HOOKS_COUNT + 1];
+static volatile bool retired [HOOKS_COUNT + 1];
+// Calls which entered a retired hook, and calls done by the threads
+static volatile int violations;
+static volatile long calls;
+static volatile bool stopping;
+
+/*
+ * Description : Body of the hooks and of the original : checks it isn't retired, and stays in the call a while
+ * int hook : Index of the hook, HOOKS_COUNT for the original
+ * long first, long second : Arguments of the method
+ * Return : long the value returned by the method
+ */
+static long
+run_hook (
+	int hook,
+	long first,
+	long second
+) {
+	__sync_fetch_and_add (&running [hook], 1);
+
+	if (retired [hook]) {
+		__sync_fetch_and_add (&violations, 1);
+	}
+
+	// A window in which the hook can be swapped and waited for
+	for (volatile int spin = 0; spin < 200; spin++);
+
+	if (retired [hook]) {
+		__sync_fetch_and_add (&violations, 1);
+	}
+
+	__sync_fetch_and_sub (&running [hook], 1);
+
+	return first * 10 + second + hook;
+}
+
+/*
+ * Description : Hooks of the method, and its original
+ */
+static long hook_0 (FakeDevice *device, long first, long second) { (void) device; return run_hook (0, first, second); }
+static long hook_1 (FakeDevice *device, long first, long second) { (void) device; return run_hook (1, first, second); }
+static long hook_2 (FakeDevice *device, long first, long second) { (void) device; return run_hook (2, first, second); }
+static long hook_3 (FakeDevice *device, long first, long second) { (void) device; return run_hook (3, first, second); }
+static long original (FakeDevice *device, long first, long second) { (void) device; return run_hook (HOOKS_COUNT, first, second); }
+
+static FakeMethod hooks [HOOKS_COUNT] = {hook_0, hook_1, hook_2, hook_3};
+
+/*
+ * Description : Thread calling the method through the vftable until stopped, and checking its result
+ * void *argument : Unused
+ * Return : void * NULL
+ */
+static void *
+caller_thread (
+	void *argument
+) {
+	FakeDevice device = {.lpVtbl = vftable};
+	(void) argument;
+
+	for (long i = 0; !stopping; i++) {
+		long result = ((FakeMethod) device.lpVtbl [0]) (&device, i, 7) - (i * 10 + 7);
+
+		if (result < 0 || result > HOOKS_COUNT) {
+			__sync_fetch_and_add (&violations, 1);
+		}
+
+		__sync_fetch_and_add (&calls, 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Allocate the thunk of the method and install it in the vftable, calling the original
+ * Return : void
+ */
+static void
+setup (
+	void
+) {
+	int argumentsCounts [1] = {3};
+
+	memset ((void *) running, 0, sizeof(running));
+	memset ((void *) retired, 0, sizeof(retired));
+	violations = 0;
+	calls = 0;
+	stopping = false;
+
+	check ((thunks = D3D9HookThunks_new (argumentsCounts, 1)) != NULL);
+	D3D9HookThunks_swap (thunks, 0, (void *) original);
+	vftable [0] = D3D9HookThunks_get_entry (thunks, 0);
+}
+
+/*
+ * Description : A thunk passes the arguments and the return value, and counts nothing once the call is over
+ */
+static void
+test_call (
+	void
+) {
+	FakeDevice device = {.lpVtbl = vftable};
+
+	setup ();
+
+	check (((FakeMethod) device.lpVtbl [0]) (&device, 4, 2) == 42 + HOOKS_COUNT);
+	check (D3D9HookThunks_swap (thunks, 0, (void *) hook_1) == (void *) original);
+	check (((FakeMethod) device.lpVtbl [0]) (&device, 4, 2) == 43);
+	check (thunks->thunks [0].inFlight [0] == 0 && thunks->thunks [0].inFlight [1] == 0);
+	check (D3D9HookThunks_wait (thunks, 0, 0));
+
+	D3D9HookThunks_free (thunks);
+}
+
+/*
+ * Description : Too many arguments for the thunk are refused
+ */
+static void
+test_arguments (
+	void
+) {
+	int argumentsCounts [2] = {1, D3D9_HOOK_THUNKS_MAX_ARGUMENTS + 1};
+
+	check (D3D9HookThunks_new (argumentsCounts, 2) == NULL);
+}
+
+/*
+ * Description : The hooks swapped while the threads call the method never run once waited for,
+ *               the calls never miss the method, and the hook unhooked never runs again
+ */
+static void
+test_swap_while_calling (
+	void
+) {
+	pthread_t threads [THREADS_COUNT];
+	void *previous;
+	long before;
+
+	setup ();
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_create (&threads [index], NULL, caller_thread, NULL);
+	}
+
+	for (int swap = 0; swap < SWAPS_COUNT; swap++) {
+		int hook = swap % HOOKS_COUNT;
+
+		// A hook retired before can be installed again : it only mustn't run while retired
+		retired [hook] = false;
+		previous = D3D9HookThunks_swap (thunks, 0, (void *) hooks [hook]);
+		check (D3D9HookThunks_wait (thunks, 0, WAIT_TIMEOUT));
+
+		for (int other = 0; other < HOOKS_COUNT; other++) {
+			if ((void *) hooks [other] == previous) {
+				retired [other] = true;
+				check (running [other] == 0);
+			}
+		}
+
+		// The threads make progress between two swaps
+		for (before = calls; calls == before;) {
+			sched_yield ();
+		}
+	}
+
+	// Unhook : the original is called from now on, no hook runs once waited for
+	D3D9HookThunks_swap (thunks, 0, (void *) original);
+	check (D3D9HookThunks_wait (thunks, 0, WAIT_TIMEOUT));
+
+	for (int hook = 0; hook < HOOKS_COUNT; hook++) {
+		retired [hook] = true;
+		check (running [hook] == 0);
+	}
+
+	for (before = calls; calls < before + 1000;) {
+		sched_yield ();
+	}
+
+	stopping = true;
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_join (threads [index], NULL);
+	}
+
+	check (violations == 0);
+	check (running [HOOKS_COUNT] == 0);
+	check (thunks->thunks [0].inFlight [0] == 0 && thunks->thunks [0].inFlight [1] == 0);
+
+	D3D9HookThunks_free (thunks);
+}
+
+/*
+ * Description : A wait times out while a call is running the hook, and succeeds once it returns
+ */
+static void
+test_wait_timeout (
+	void
+) {
+	setup ();
+
+	// A call entered the thunk and is still running its hook
+	__sync_fetch_and_add (thunks->thunks [0].active, 1);
+	check (!D3D9HookThunks_wait (thunks, 0, 10));
+	__sync_fetch_and_sub (&thunks->thunks [0].inFlight [0], 1);
+	check (D3D9HookThunks_wait (thunks, 0, 10));
+
+	D3D9HookThunks_free (thunks);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_call);
+	run_test (test_arguments);
+	run_test (test_swap_while_calling);
+	run_test (test_wait_timeout);
+
+	return test_result ();
+}
@@ -0,0 +1,225 @@
+#include "D3D9Test.h"
+#include "D3D9ImageLoader.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Frame times while 200 sprites load : a writer submits them like D3D9ObjectSprite_init_async, the workers read them,
+// and the frame loop uploads them within its budget then tries to give them to the factory without waiting.
+
+// Sprites loaded, and size of their files
+#define SPRITES_COUNT 200
+#define FILE_SIZE     (256 * 1024)
+// Time between two frames, and time the device takes to create a texture, in microseconds
+#define FRAME_INTERVAL 1000
+#define UPLOAD_COST    100
+
+typedef struct
+{
+	const char *name;
+	// Whether the writer queries the file system with the factory lock held
+	bool statLocked;
+	// Upload budget of a frame in microseconds, -1 for no budget
+	int uploadBudget;
+
+}	BenchConfig;
+
+static BenchConfig configs [] = {
+	{"stat locked", true,  1000},
+	{"stat first",  false, 1000},
+	{"stat first",  false, -1},
+};
+
+// Sum of the bytes uploaded, so the copies aren't optimized out
+static volatile long long uploaded;
+
+// State shared by the writer and the frame loop
+typedef struct
+{
+	D3D9ImageLoader *loader;
+	// The factory lock
+	D3D9Lock lock;
+	char paths [SPRITES_COUNT][PATH_MAX];
+	bool statLocked;
+
+}	BenchState;
+
+/*
+ * Description : Writer : submits the sprites, querying the file system inside or outside the factory lock
+ * void *argument : The BenchState
+ * Return : void * NULL
+ */
+static void *
+bench_writer (
+	void *argument
+) {
+	BenchState *state = argument;
+
+	for (int index = 0; index < SPRITES_COUNT; index++)
+	{
+		char normalized [PATH_MAX];
+		unsigned long long version = 0;
+
+		if (!state->statLocked) {
+			realpath (state->paths [index], normalized);
+			D3D9Image_get_version (state->paths [index], &version);
+		}
+
+		D3D9Lock_acquire_exclusive (&state->lock);
+
+		if (state->statLocked) {
+			realpath (state->paths [index], normalized);
+			D3D9Image_get_version (state->paths [index], &version);
+		}
+
+		D3D9ImageLoader_submit (state->loader, state->paths [index], NULL);
+
+		D3D9Lock_release_exclusive (&state->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Compare two frame times
+ * const void *a, *b : Two doubles
+ * Return : int lower, equal or greater than 0
+ */
+static int
+compare_times (
+	const void *a,
+	const void *b
+) {
+	double timeA = *(const double *) a;
+	double timeB = *(const double *) b;
+
+	return (timeA > timeB) - (timeA < timeB);
+}
+
+/*
+ * Description : Load the sprites once and print the frame times
+ * BenchState *state : The state of the bench, with the files created
+ * BenchConfig *config : The configuration measured
+ * Return : void
+ */
+static void
+measure (
+	BenchState *state,
+	BenchConfig *config
+) {
+	double *times = malloc (sizeof(double) * SPRITES_COUNT * 4);
+	unsigned char *texture = malloc (FILE_SIZE);
+	int framesCount = 0, loaded = 0, deferred = 0;
+	D3D9LockStats stats;
+	pthread_t writer;
+
+	state->loader = D3D9ImageLoader_new (D3D9_IMAGE_LOADER_DEFAULT_THREADS, NULL);
+	state->statLocked = config->statLocked;
+	D3D9Lock_init (&state->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+	D3D9Lock_set_hold_timing (&state->lock, true);
+
+	pthread_create (&writer, NULL, bench_writer, state);
+
+	while (loaded < SPRITES_COUNT && framesCount < SPRITES_COUNT * 4)
+	{
+		usleep (FRAME_INTERVAL);
+
+		double start = D3D9Test_now ();
+		D3D9ImageRequest *request;
+
+		// Upload until the budget is spent, one image at least
+		while ((request = D3D9ImageLoader_pop_decoded (state->loader)))
+		{
+			double uploadStart = D3D9Test_now ();
+
+			if (request->success) {
+				memcpy (texture, request->image.fileData, request->image.fileSize);
+				uploaded += texture [request->image.fileSize - 1];
+			}
+
+			while (D3D9Test_now () - uploadStart < UPLOAD_COST * 1000.0);
+
+			D3D9ImageRequest_free (request);
+			loaded++;
+
+			if (config->uploadBudget >= 0 && D3D9Test_now () - start >= config->uploadBudget * 1000.0) {
+				break;
+			}
+		}
+
+		// The sprites uploaded wait for the next frame if a writer holds the factory
+		if (D3D9Lock_try_acquire_exclusive (&state->lock)) {
+			D3D9Lock_release_exclusive (&state->lock);
+		} else {
+			deferred++;
+		}
+
+		times [framesCount++] = D3D9Test_now () - start;
+	}
+
+	pthread_join (writer, NULL);
+	D3D9Lock_get_stats (&state->lock, &stats);
+
+	qsort (times, framesCount, sizeof(double), compare_times);
+
+	printf ("%-11s | %6d | %8.1f | %8.1f | %8.1f | %6d | %8d | %13.1f\n",
+		config->name, config->uploadBudget,
+		times [framesCount / 2] / 1000, times [framesCount * 99 / 100] / 1000, times [framesCount - 1] / 1000,
+		framesCount, deferred, (double) stats.maxHoldTime);
+
+	D3D9ImageLoader_free (state->loader);
+	D3D9Lock_destroy (&state->lock);
+	free (texture);
+	free (times);
+}
+
+int
+main (
+	void
+) {
+	BenchState *state = calloc (1, sizeof(BenchState));
+	char directory [] = "/tmp/D3D9ImageLoaderBench.XXXXXX";
+	unsigned char *content = malloc (FILE_SIZE);
+
+	if (!mkdtemp (directory)) {
+		perror ("mkdtemp");
+		return 1;
+	}
+
+	for (int index = 0; index < FILE_SIZE; index++) {
+		content [index] = (unsigned char) index;
+	}
+
+	for (int index = 0; index < SPRITES_COUNT; index++) {
+		FILE *file;
+
+		snprintf (state->paths [index], PATH_MAX, "%s/sprite%03d.png", directory, index);
+
+		if (!(file = fopen (state->paths [index], "wb"))) {
+			perror ("fopen");
+			return 1;
+		}
+
+		fwrite (content, 1, FILE_SIZE, file);
+		fclose (file);
+	}
+
+	printf ("%d sprites of %d KB uploaded in %d us, a frame every %d us\n", SPRITES_COUNT, FILE_SIZE / 1024, UPLOAD_COST, FRAME_INTERVAL);
+	printf ("Writer      | Budget | p50 (us) | p99 (us) | max (us) | Frames | Deferred | Max hold (us)\n");
+
+	for (int index = 0; index < (int) (sizeof(configs) / sizeof(*configs)); index++) {
+		measure (state, &configs [index]);
+	}
+
+	for (int index = 0; index < SPRITES_COUNT; index++) {
+		unlink (state->paths [index]);
+	}
+
+	rmdir (directory);
+	free (content);
+	free (state);
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+#include "D3D9Test.h"
+#include "D3D9ImageLoader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Number of requests submitted by the queue tests
+#define REQUESTS_COUNT 500
+
+/*
+ * Description : Decoder giving each file a size derived from its name, without any I/O
+ * char *filePath : A decimal number
+ * D3D9Image *image : Output image
+ * Return : bool false for the odd numbers, to check the failures are delivered too
+ */
+static bool
+fake_decoder (
+	char *filePath,
+	D3D9Image *image
+) {
+	int number = atoi (filePath);
+
+	memset (image, 0, sizeof(D3D9Image));
+	image->w = number;
+	image->h = number * 2;
+	image->version = number;
+
+	return (number % 2) == 0;
+}
+
+/*
+ * Description : Pop the decoded requests until a count is reached or a second has elapsed
+ * D3D9ImageLoader *loader : An allocated D3D9ImageLoader
+ * bool *seen : Output, indexed by the number of the requests
+ * int count : Number of requests expected
+ * Return : int the number of requests popped
+ */
+static int
+pop_all (
+	D3D9ImageLoader *loader,
+	bool *seen,
+	int count
+) {
+	int popped = 0;
+
+	for (int tries = 0; popped < count && tries < 1000;) {
+		D3D9ImageRequest *request;
+
+		if (!(request = D3D9ImageLoader_pop_decoded (loader))) {
+			usleep (1000);
+			tries++;
+			continue;
+		}
+
+		int number = (int) (intptr_t) request->userData;
+
+		check (number >= 0 && number < count);
+		check (!seen [number]);
+		check (atoi (request->filePath) == number);
+		check (request->success == ((number % 2) == 0));
+		check (request->image.w == number && request->image.h == number * 2);
+		check (request->image.version == (unsigned long long) number);
+
+		seen [number] = true;
+		popped++;
+		D3D9ImageRequest_free (request);
+	}
+
+	return popped;
+}
+
+/*
+ * Description : Every request submitted is decoded once by the workers and given back with its data
+ */
+static void
+test_decode_queue (
+	void
+) {
+	D3D9ImageLoader *loader;
+	bool seen [REQUESTS_COUNT] = {false};
+	char path [16];
+
+	check ((loader = D3D9ImageLoader_new (4, fake_decoder)) != NULL);
+	check (D3D9ImageLoader_pop_decoded (loader) == NULL);
+
+	for (int i = 0; i < REQUESTS_COUNT; i++) {
+		sprintf (path, "%d", i);
+		check (D3D9ImageLoader_submit (loader, path, (void *) (intptr_t) i));
+	}
+
+	check (pop_all (loader, seen, REQUESTS_COUNT) == REQUESTS_COUNT);
+	check (D3D9ImageLoader_pop_decoded (loader) == NULL);
+
+	D3D9ImageLoader_free (loader);
+}
+
+/*
+ * Description : The loader can be freed with requests pending or decoded
+ */
+static void
+test_free_with_requests (
+	void
+) {
+	D3D9ImageLoader *loader;
+	char path [16];
+
+	check ((loader = D3D9ImageLoader_new (2, fake_decoder)) != NULL);
+
+	for (int i = 0; i < REQUESTS_COUNT; i++) {
+		sprintf (path, "%d", i);
+		D3D9ImageLoader_submit (loader, path, NULL);
+	}
+
+	D3D9ImageLoader_free (loader);
+}
+
+/*
+ * Description : The default decoder reads the files, and fails on missing ones
+ */
+static void
+test_decode_file (
+	void
+) {
+	char path [] = "/tmp/D3D9ImageLoaderTestXXXXXX";
+	unsigned char content [1000];
+	D3D9ImageLoader *loader;
+	D3D9ImageRequest *request = NULL;
+	D3D9Image image;
+	unsigned long long version;
+	int fd;
+
+	for (int i = 0; i < (int) sizeof(content); i++) {
+		content [i] = i * 7;
+	}
+
+	check ((fd = mkstemp (path)) != -1);
+	check (write (fd, content, sizeof(content)) == sizeof(content));
+	close (fd);
+
+	check (D3D9Image_decode_file (path, &image));
+	check (image.pixels == NULL);
+	check (image.fileSize == sizeof(content));
+	check (image.fileData && memcmp (image.fileData, content, sizeof(content)) == 0);
+	check (D3D9Image_get_version (path, &version) && image.version == version);
+	D3D9Image_release (&image);
+
+	// Through the worker threads with the default decoder
+	check ((loader = D3D9ImageLoader_new (1, NULL)) != NULL);
+	check (D3D9ImageLoader_submit (loader, path, NULL));
+	check (D3D9ImageLoader_submit (loader, "/nonexistent/image.png", NULL));
+
+	for (int popped = 0, tries = 0; popped < 2 && tries < 1000;) {
+		if (!(request = D3D9ImageLoader_pop_decoded (loader))) {
+			usleep (1000);
+			tries++;
+			continue;
+		}
+
+		if (popped++ == 0) {
+			check (request->success);
+			check (request->image.fileSize == sizeof(content));
+		} else {
+			check (!request->success);
+		}
+
+		D3D9ImageRequest_free (request);
+	}
+
+	D3D9ImageLoader_free (loader);
+	unlink (path);
+}
+
+/*
+ * Description : The version of a file changes with its size and its modification time, not with its path
+ */
+static void
+test_version (
+	void
+) {
+	char path [] = "/tmp/D3D9ImageLoaderTestXXXXXX";
+	unsigned long long version, same, changed;
+	struct timespec times [2];
+	int fd;
+
+	check ((fd = mkstemp (path)) != -1);
+	check (write (fd, "image", 5) == 5);
+	close (fd);
+
+	check (D3D9Image_get_version (path, &version));
+	check (D3D9Image_get_version (path, &same) && same == version);
+
+	// Same size, another modification time
+	times [0] = times [1] = (struct timespec) {.tv_sec = 1000000000, .tv_nsec = 0};
+	check (utimensat (AT_FDCWD, path, times, 0) == 0);
+	check (D3D9Image_get_version (path, &changed) && changed != version);
+
+	// Same modification time, another size
+	check (truncate (path, 6) == 0);
+	check (utimensat (AT_FDCWD, path, times, 0) == 0);
+	check (D3D9Image_get_version (path, &version) && version != changed);
+
+	check (!D3D9Image_get_version ("/nonexistent/image.png", &version));
+
+	unlink (path);
+}
+
+/*
+ * Description : Decoder that must never be called
+ */
+static bool
+unexpected_decoder (
+	char *filePath,
+	D3D9Image *image
+) {
+	(void) filePath;
+	(void) image;
+	check (false);
+	return false;
+}
+
+/*
+ * Description : The requests ready to be uploaded are given back without being decoded
+ */
+static void
+test_submit_ready (
+	void
+) {
+	D3D9ImageLoader *loader;
+	D3D9ImageRequest *request;
+
+	check ((loader = D3D9ImageLoader_new (1, unexpected_decoder)) != NULL);
+
+	check (D3D9ImageLoader_submit_ready (loader, "cached.png", 42, (void *) 1));
+	check (D3D9ImageLoader_submit_ready (loader, "other.png", 43, (void *) 2));
+
+	// Given back at once and in order, without waiting for a worker
+	check ((request = D3D9ImageLoader_pop_decoded (loader)) != NULL);
+	check (request->success && request->userData == (void *) 1 && request->image.version == 42);
+	check (strcmp (request->filePath, "cached.png") == 0);
+	check (request->image.pixels == NULL && request->image.fileData == NULL);
+	D3D9ImageRequest_free (request);
+
+	check ((request = D3D9ImageLoader_pop_decoded (loader)) != NULL);
+	check (request->success && request->userData == (void *) 2 && request->image.version == 43);
+	D3D9ImageRequest_free (request);
+
+	check (D3D9ImageLoader_pop_decoded (loader) == NULL);
+
+	D3D9ImageLoader_free (loader);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_decode_queue);
+	run_test (test_free_with_requests);
+	run_test (test_decode_file);
+	run_test (test_version);
+	run_test (test_submit_ready);
+
+	return test_result ();
+}
@@ -0,0 +1,52 @@
+#include "D3D9Test.h"
+#include "D3D9Lock.h"
+
+// Acquisitions measured per configuration
+#define ITERATIONS_COUNT 10000000
+
+/*
+ * Description : Measure an uncontended exclusive acquisition and release
+ * D3D9Lock *lock : An initialized D3D9Lock
+ * Return : double the nanoseconds per acquisition
+ */
+static double
+measure_exclusive (
+	D3D9Lock *lock
+) {
+	double start = D3D9Test_now ();
+
+	for (int i = 0; i < ITERATIONS_COUNT; i++) {
+		D3D9Lock_acquire_exclusive (lock);
+		D3D9Lock_release_exclusive (lock);
+	}
+
+	return (D3D9Test_now () - start) / ITERATIONS_COUNT;
+}
+
+int
+main (
+	void
+) {
+	D3D9Lock lock;
+	double start, shared;
+
+	if (!D3D9Lock_init (&lock, D3D9_LOCK_DEFAULT_SPIN_COUNT)) {
+		return 1;
+	}
+
+	start = D3D9Test_now ();
+	for (int i = 0; i < ITERATIONS_COUNT; i++) {
+		D3D9Lock_acquire_shared (&lock);
+		D3D9Lock_release_shared (&lock);
+	}
+	shared = (D3D9Test_now () - start) / ITERATIONS_COUNT;
+
+	printf ("D3D9Lock shared                       : %.1f ns per acquisition\n", shared);
+	printf ("D3D9Lock exclusive, hold timing off   : %.1f ns per acquisition\n", measure_exclusive (&lock));
+	D3D9Lock_set_hold_timing (&lock, true);
+	printf ("D3D9Lock exclusive, hold timing on    : %.1f ns per acquisition\n", measure_exclusive (&lock));
+
+	D3D9Lock_destroy (&lock);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+#include "D3D9Test.h"
+#include "D3D9Lock.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Threads and iterations of the exclusion test
+#define THREADS_COUNT    4
+#define ITERATIONS_COUNT 100000
+
+static D3D9Lock sharedLock = D3D9_LOCK_INITIALIZER;
+static long long counter = 0;
+
+/*
+ * Description : Increment the counter under the exclusive side, and read it under the shared side
+ * void *param : Unused
+ * Return : NULL
+ */
+static void *
+increment_thread (
+	void *param
+) {
+	(void) param;
+
+	for (int i = 0; i < ITERATIONS_COUNT; i++) {
+		D3D9Lock_acquire_exclusive (&sharedLock);
+		counter++;
+		D3D9Lock_release_exclusive (&sharedLock);
+
+		D3D9Lock_acquire_shared (&sharedLock);
+		check (counter > 0);
+		D3D9Lock_release_shared (&sharedLock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : The exclusive side excludes the other threads, and every acquisition is counted
+ */
+static void
+test_exclusion (
+	void
+) {
+	pthread_t threads [THREADS_COUNT];
+	D3D9LockStats stats;
+
+	for (int i = 0; i < THREADS_COUNT; i++) {
+		check (pthread_create (&threads [i], NULL, increment_thread, NULL) == 0);
+	}
+
+	for (int i = 0; i < THREADS_COUNT; i++) {
+		pthread_join (threads [i], NULL);
+	}
+
+	D3D9Lock_get_stats (&sharedLock, &stats);
+	check (counter == (long long) THREADS_COUNT * ITERATIONS_COUNT);
+	check (stats.exclusiveAcquisitions == (long long) THREADS_COUNT * ITERATIONS_COUNT);
+	check (stats.sharedAcquisitions == (long long) THREADS_COUNT * ITERATIONS_COUNT);
+}
+
+/*
+ * Description : The try acquisition fails while any side is held, without blocking
+ */
+static void
+test_try_acquire (
+	void
+) {
+	D3D9Lock lock;
+
+	check (D3D9Lock_init (&lock, D3D9_LOCK_DEFAULT_SPIN_COUNT));
+
+	D3D9Lock_acquire_shared (&lock);
+	check (!D3D9Lock_try_acquire_exclusive (&lock));
+	D3D9Lock_release_shared (&lock);
+
+	check (D3D9Lock_try_acquire_exclusive (&lock));
+	check (!D3D9Lock_try_acquire_exclusive (&lock));
+	D3D9Lock_release_exclusive (&lock);
+
+	D3D9Lock_destroy (&lock);
+}
+
+/*
+ * Description : The hold time is measured only while the hold timing is enabled
+ */
+static void
+test_hold_timing (
+	void
+) {
+	D3D9Lock lock;
+	D3D9LockStats stats;
+
+	check (D3D9Lock_init (&lock, D3D9_LOCK_DEFAULT_SPIN_COUNT));
+
+	D3D9Lock_acquire_exclusive (&lock);
+	check (lock.exclusiveSince == 0);
+	usleep (2000);
+	D3D9Lock_release_exclusive (&lock);
+
+	D3D9Lock_get_stats (&lock, &stats);
+	check (stats.holdTime == 0 && stats.maxHoldTime == 0);
+
+	D3D9Lock_set_hold_timing (&lock, true);
+	D3D9Lock_acquire_exclusive (&lock);
+	check (lock.exclusiveSince != 0);
+	usleep (2000);
+	D3D9Lock_release_exclusive (&lock);
+
+	D3D9Lock_get_stats (&lock, &stats);
+	check (stats.holdTime >= 2000 && stats.maxHoldTime == stats.holdTime);
+
+	D3D9Lock_destroy (&lock);
+}
+
+/*
+ * Description : A lock can be initialized again after being destroyed
+ */
+static void
+test_destroy (
+	void
+) {
+	D3D9Lock lock;
+
+	for (int i = 0; i < 1000; i++) {
+		check (D3D9Lock_init (&lock, D3D9_LOCK_DEFAULT_SPIN_COUNT));
+		D3D9Lock_acquire_exclusive (&lock);
+		D3D9Lock_release_exclusive (&lock);
+		D3D9Lock_destroy (&lock);
+	}
+}
+
+int
+main (
+	void
+) {
+	run_test (test_exclusion);
+	run_test (test_try_acquire);
+	run_test (test_hold_timing);
+	run_test (test_destroy);
+
+	return test_result ();
+}
@@ -0,0 +1,95 @@
+#include "D3D9Test.h"
+#include "D3D9ObjectPool.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Size of the blocks, close to a D3D9Object
+#define BLOCK_SIZE       256
+// Blocks alive per thread, and allocations measured per thread
+#define LIVE_COUNT       16
+#define ITERATIONS_COUNT 2000000
+#define THREADS_MAX      4
+
+static D3D9ObjectPool *pool;
+static bool usePool;
+
+/*
+ * Description : Allocate and release blocks in a ring, with the pool or with malloc
+ * void *param : Unused
+ * Return : NULL
+ */
+static void *
+bench_thread (
+	void *param
+) {
+	void *live [LIVE_COUNT] = {NULL};
+
+	(void) param;
+
+	for (int i = 0; i < ITERATIONS_COUNT; i++) {
+		int slot = i % LIVE_COUNT;
+
+		if (usePool) {
+			D3D9ObjectPool_release (pool, live [slot]);
+			live [slot] = D3D9ObjectPool_alloc (pool);
+		} else {
+			free (live [slot]);
+			live [slot] = calloc (1, BLOCK_SIZE);
+		}
+	}
+
+	for (int slot = 0; slot < LIVE_COUNT; slot++) {
+		if (usePool) {
+			D3D9ObjectPool_release (pool, live [slot]);
+		} else {
+			free (live [slot]);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Run the benchmark on several threads
+ * int threadsCount : Number of threads
+ * Return : double the nanoseconds per allocation and release
+ */
+static double
+measure (
+	int threadsCount
+) {
+	pthread_t threads [THREADS_MAX];
+	double start = D3D9Test_now ();
+
+	for (int i = 0; i < threadsCount; i++) {
+		pthread_create (&threads [i], NULL, bench_thread, NULL);
+	}
+	for (int i = 0; i < threadsCount; i++) {
+		pthread_join (threads [i], NULL);
+	}
+
+	return (D3D9Test_now () - start) / ((double) ITERATIONS_COUNT * threadsCount);
+}
+
+int
+main (
+	void
+) {
+	if ((pool = D3D9ObjectPool_new (BLOCK_SIZE, D3D9_OBJECT_POOL_DEFAULT_SLAB_COUNT)) == NULL) {
+		return 1;
+	}
+
+	for (int threadsCount = 1; threadsCount <= THREADS_MAX; threadsCount *= 2) {
+		usePool = true;
+		double pooled = measure (threadsCount);
+		usePool = false;
+		double heap = measure (threadsCount);
+
+		printf ("D3D9ObjectPool, %d threads : %.1f ns per alloc + release (calloc + free : %.1f ns)\n",
+			threadsCount, pooled, heap);
+	}
+
+	D3D9ObjectPool_free (pool);
+
+	return 0;
+}
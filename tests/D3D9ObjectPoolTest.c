@@ -0,0 +1,216 @@
+#include "D3D9Test.h"
+#include "D3D9ObjectPool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Blocks of a slab in the tests
+#define SLAB_COUNT 8
+
+// Threads and iterations of the stress test
+#define THREADS_COUNT    4
+#define ITERATIONS_COUNT 20000
+#define LIVE_COUNT       64
+
+/*
+ * Description : The blocks are zeroed, aligned on a cache line, distinct, and reused once released
+ */
+static void
+test_alloc (
+	void
+) {
+	D3D9ObjectPool *pool;
+	unsigned char *blocks [SLAB_COUNT * 2];
+	D3D9ObjectPoolStats stats;
+
+	check ((pool = D3D9ObjectPool_new (100, SLAB_COUNT)) != NULL);
+	check (pool->blockSize == 128);
+
+	for (int i = 0; i < SLAB_COUNT * 2; i++) {
+		check ((blocks [i] = D3D9ObjectPool_alloc (pool)) != NULL);
+		check (((uintptr_t) blocks [i] % D3D9_OBJECT_POOL_CACHE_LINE) == 0);
+		for (int byte = 0; byte < pool->blockSize; byte++) {
+			check (blocks [i][byte] == 0);
+		}
+		for (int j = 0; j < i; j++) {
+			check (blocks [i] != blocks [j]);
+		}
+		memset (blocks [i], 0xFF, pool->blockSize);
+	}
+
+	// Consecutive allocations of a slab are contiguous
+	check (blocks [1] == blocks [0] + pool->blockSize);
+
+	D3D9ObjectPool_release (pool, blocks [3]);
+	check (D3D9ObjectPool_alloc (pool) == blocks [3]);
+	check (blocks [3][0] == 0);
+
+	D3D9ObjectPool_get_stats (pool, &stats);
+	check (stats.slabs == 2);
+	check (stats.allocations == SLAB_COUNT * 2 + 1);
+	check (stats.frees == 1);
+	check (stats.threadCacheHits == 1);
+
+	D3D9ObjectPool_free (pool);
+}
+
+/*
+ * Description : The blocks cached by a thread for a pool go back to it when the thread uses another pool
+ */
+static void *
+drain_thread (
+	void *param
+) {
+	D3D9ObjectPool **pools = param;
+	void *blocks [SLAB_COUNT];
+
+	for (int i = 0; i < SLAB_COUNT; i++) {
+		blocks [i] = D3D9ObjectPool_alloc (pools [0]);
+	}
+	for (int i = 0; i < SLAB_COUNT; i++) {
+		D3D9ObjectPool_release (pools [0], blocks [i]);
+	}
+
+	// The cache of the thread now belongs to the second pool
+	D3D9ObjectPool_release (pools [1], D3D9ObjectPool_alloc (pools [1]));
+
+	return NULL;
+}
+
+static void
+test_drain_on_switch (
+	void
+) {
+	D3D9ObjectPool *pools [2];
+	D3D9ObjectPoolStats stats;
+	pthread_t thread;
+
+	check ((pools [0] = D3D9ObjectPool_new (64, SLAB_COUNT)) != NULL);
+	check ((pools [1] = D3D9ObjectPool_new (64, SLAB_COUNT)) != NULL);
+
+	check (pthread_create (&thread, NULL, drain_thread, pools) == 0);
+	pthread_join (thread, NULL);
+
+	// The blocks released by the thread are found without growing the pool
+	for (int i = 0; i < SLAB_COUNT; i++) {
+		check (D3D9ObjectPool_alloc (pools [0]) != NULL);
+	}
+
+	D3D9ObjectPool_get_stats (pools [0], &stats);
+	check (stats.slabs == 1);
+
+	D3D9ObjectPool_free (pools [0]);
+	D3D9ObjectPool_free (pools [1]);
+}
+
+/*
+ * Description : Free a pool from another thread than the ones using it
+ * void *param : The pool
+ * Return : NULL
+ */
+static void *
+free_thread (
+	void *param
+) {
+	D3D9ObjectPool_free (param);
+
+	return NULL;
+}
+
+/*
+ * Description : The cache of a thread still holding blocks of a freed pool is given to the next pool used
+ */
+static void
+test_freed_pool (
+	void
+) {
+	D3D9ObjectPool *pool;
+	D3D9ObjectPoolStats stats;
+	pthread_t thread;
+
+	// The main thread caches a block of a pool, then another thread frees it
+	check ((pool = D3D9ObjectPool_new (64, SLAB_COUNT)) != NULL);
+	D3D9ObjectPool_release (pool, D3D9ObjectPool_alloc (pool));
+
+	check (pthread_create (&thread, NULL, free_thread, pool) == 0);
+	pthread_join (thread, NULL);
+
+	// The cache of the main thread works with the next pool
+	check ((pool = D3D9ObjectPool_new (64, SLAB_COUNT)) != NULL);
+	D3D9ObjectPool_release (pool, D3D9ObjectPool_alloc (pool));
+	check (D3D9ObjectPool_alloc (pool) != NULL);
+
+	D3D9ObjectPool_get_stats (pool, &stats);
+	check (stats.threadCacheHits == 1);
+
+	D3D9ObjectPool_free (pool);
+}
+
+/*
+ * Description : Allocate and release blocks in random order, checking nobody else owns them
+ * void *param : The pool
+ * Return : NULL
+ */
+static void *
+stress_thread (
+	void *param
+) {
+	D3D9ObjectPool *pool = param;
+	uintptr_t *live [LIVE_COUNT] = {NULL};
+	unsigned int seed = (unsigned int) (uintptr_t) &live;
+
+	for (int i = 0; i < ITERATIONS_COUNT; i++) {
+		int slot = rand_r (&seed) % LIVE_COUNT;
+
+		if (live [slot]) {
+			check (*live [slot] == (uintptr_t) live [slot]);
+			D3D9ObjectPool_release (pool, live [slot]);
+			live [slot] = NULL;
+		} else if ((live [slot] = D3D9ObjectPool_alloc (pool))) {
+			check (*live [slot] == 0);
+			*live [slot] = (uintptr_t) live [slot];
+		}
+	}
+
+	for (int slot = 0; slot < LIVE_COUNT; slot++) {
+		D3D9ObjectPool_release (pool, live [slot]);
+	}
+
+	return NULL;
+}
+
+static void
+test_threads (
+	void
+) {
+	D3D9ObjectPool *pool;
+	pthread_t threads [THREADS_COUNT];
+	D3D9ObjectPoolStats stats;
+
+	check ((pool = D3D9ObjectPool_new (64, SLAB_COUNT)) != NULL);
+
+	for (int i = 0; i < THREADS_COUNT; i++) {
+		check (pthread_create (&threads [i], NULL, stress_thread, pool) == 0);
+	}
+	for (int i = 0; i < THREADS_COUNT; i++) {
+		pthread_join (threads [i], NULL);
+	}
+
+	D3D9ObjectPool_get_stats (pool, &stats);
+	check (stats.allocations == stats.frees);
+
+	D3D9ObjectPool_free (pool);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_alloc);
+	run_test (test_drain_on_switch);
+	run_test (test_freed_pool);
+	run_test (test_threads);
+
+	return test_result ();
+}
@@ -0,0 +1,162 @@
+#include "D3D9Test.h"
+#include "D3D9ObjectTable.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Show, hide and delete of random objects among 10k to 100k, with the table and with the list it replaced :
+// an array searched linearly, the removal shifting the objects drawn above.
+
+// Operations measured per size
+#define OPERATIONS_COUNT 20000
+
+static int sizes [] = {10000, 25000, 50000, 100000};
+
+/*
+ * Description : Remove an object from a linear list, keeping the order
+ * void **list : The list
+ * int *count : Number of objects of the list
+ * void *object : The object to remove
+ * Return : bool true if the object was in the list
+ */
+static bool
+linear_remove (
+	void **list,
+	int *count,
+	void *object
+) {
+	for (int index = 0; index < *count; index++) {
+		if (list [index] == object) {
+			memmove (&list [index], &list [index + 1], sizeof(void *) * (*count - index - 1));
+			(*count)--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Description : Measure the operations on the table
+ * int size : Number of objects
+ * double *show, double *hide, double *delete : Output of the nanoseconds per operation
+ * Return : void
+ */
+static void
+measure_table (
+	int size,
+	double *show,
+	double *hide,
+	double *delete
+) {
+	D3D9ObjectTable table = D3D9_OBJECT_TABLE_INITIALIZER;
+	int *ids = malloc (sizeof(int) * size);
+	unsigned int seed = 42;
+	double start;
+
+	for (int index = 0; index < size; index++) {
+		ids [index] = D3D9ObjectTable_register (&table, &ids [index]);
+		D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index]));
+	}
+
+	// Show an object again : on top of the others
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		D3D9ObjectTable_show (&table, D3D9_OBJECT_TABLE_INDEX (ids [rand_r (&seed) % size]));
+	}
+	*show = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	// Hide an object then show it back, so the draw list keeps its size
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		int index = D3D9_OBJECT_TABLE_INDEX (ids [rand_r (&seed) % size]);
+		D3D9ObjectTable_hide (&table, index);
+		D3D9ObjectTable_show (&table, index);
+	}
+	*hide = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	// Delete an object and create another one in its place
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		int index = rand_r (&seed) % size;
+		D3D9ObjectTable_unregister (&table, ids [index]);
+		ids [index] = D3D9ObjectTable_register (&table, &ids [index]);
+		D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index]));
+	}
+	*delete = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	D3D9ObjectTable_destroy (&table);
+	free (ids);
+}
+
+/*
+ * Description : Measure the same operations on a linear list
+ * int size : Number of objects
+ * double *show, double *hide, double *delete : Output of the nanoseconds per operation
+ * Return : void
+ */
+static void
+measure_linear (
+	int size,
+	double *show,
+	double *hide,
+	double *delete
+) {
+	void **list = malloc (sizeof(void *) * size);
+	int *objects = malloc (sizeof(int) * size);
+	unsigned int seed = 42;
+	int count = size;
+	double start;
+
+	for (int index = 0; index < size; index++) {
+		list [index] = &objects [index];
+	}
+
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		void *object = &objects [rand_r (&seed) % size];
+		linear_remove (list, &count, object);
+		list [count++] = object;
+	}
+	*show = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	// Hiding and showing back is the same removal and append
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		void *object = &objects [rand_r (&seed) % size];
+		linear_remove (list, &count, object);
+		list [count++] = object;
+	}
+	*hide = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	// The deleted object is also removed from the list of all the objects
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		void *object = &objects [rand_r (&seed) % size];
+		linear_remove (list, &count, object);
+		linear_remove (list, &count, NULL);
+		list [count++] = object;
+	}
+	*delete = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	free (objects);
+	free (list);
+}
+
+int
+main (
+	void
+) {
+	double show, hide, delete;
+
+	printf ("Objects | Table show | Table hide | Table delete | Linear show | Linear hide | Linear delete (ns per operation)\n");
+
+	for (int index = 0; index < (int) (sizeof(sizes) / sizeof(*sizes)); index++) {
+		printf ("%7d |", sizes [index]);
+		measure_table (sizes [index], &show, &hide, &delete);
+		printf (" %10.1f | %10.1f | %12.1f |", show, hide, delete);
+		measure_linear (sizes [index], &show, &hide, &delete);
+		printf (" %11.1f | %11.1f | %13.1f\n", show, hide, delete);
+	}
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+#include "D3D9Test.h"
+#include "D3D9ObjectTable.h"
+#include <stdlib.h>
+
+// Objects registered by the tests
+#define OBJECTS_COUNT 1000
+
+static int objects [OBJECTS_COUNT];
+
+/*
+ * Description : Check that the draw list holds exactly some objects in a given order, and that its orders grow
+ * D3D9ObjectTable *table : An allocated D3D9ObjectTable
+ * int *ids : Expected IDs, the object drawn first first
+ * int count : Number of IDs
+ * Return : bool true if the draw list matches
+ */
+static bool
+draw_list_equals (
+	D3D9ObjectTable *table,
+	int *ids,
+	int count
+) {
+	int position = 0;
+	unsigned long long order = 0;
+
+	foreach_d3d9object_table_slot (table, &table->drawObjects, index) {
+		if (position >= count || index != D3D9_OBJECT_TABLE_INDEX (ids [position])) {
+			return false;
+		}
+
+		if (position > 0 && table->slots [index].drawLink.order <= order) {
+			return false;
+		}
+
+		order = table->slots [index].drawLink.order;
+		position++;
+	}
+
+	return position == count && table->drawObjects.count == count;
+}
+
+/*
+ * Description : An ID resolves to its object until it is unregistered, and never again once its slot is reused
+ */
+static void
+test_register (
+	void
+) {
+	D3D9ObjectTable *table;
+	int id, reused;
+
+	check ((table = D3D9ObjectTable_new ()) != NULL);
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		check ((id = D3D9ObjectTable_register (table, &objects [index])) == index);
+		check (D3D9ObjectTable_get_slot (table, id)->object == &objects [index]);
+	}
+
+	check (table->slotsCount == OBJECTS_COUNT);
+	check (D3D9ObjectTable_get_slot (table, OBJECTS_COUNT) == NULL);
+
+	id = 10;
+	check (D3D9ObjectTable_unregister (table, id));
+	check (!D3D9ObjectTable_unregister (table, id));
+	check (D3D9ObjectTable_get_slot (table, id) == NULL);
+
+	// The slot is reused with another generation : the old ID stays invalid
+	reused = D3D9ObjectTable_register (table, &objects [0]);
+	check (D3D9_OBJECT_TABLE_INDEX (reused) == D3D9_OBJECT_TABLE_INDEX (id) && reused != id);
+	check (D3D9ObjectTable_get_slot (table, id) == NULL);
+	check (D3D9ObjectTable_get_slot (table, reused)->object == &objects [0]);
+	check (table->slotsCount == OBJECTS_COUNT);
+
+	D3D9ObjectTable_free (table);
+}
+
+/*
+ * Description : The draw list keeps its order through add, show, hide and unregister
+ */
+static void
+test_draw_order (
+	void
+) {
+	D3D9ObjectTable table = D3D9_OBJECT_TABLE_INITIALIZER;
+	int ids [5];
+
+	for (int index = 0; index < 5; index++) {
+		ids [index] = D3D9ObjectTable_register (&table, &objects [index]);
+		check (D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index])));
+	}
+
+	check (draw_list_equals (&table, (int []) {ids [0], ids [1], ids [2], ids [3], ids [4]}, 5));
+	check (!D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [2])));
+	check (draw_list_equals (&table, (int []) {ids [0], ids [1], ids [2], ids [3], ids [4]}, 5));
+
+	// Shown again : on top
+	check (!D3D9ObjectTable_show (&table, D3D9_OBJECT_TABLE_INDEX (ids [1])));
+	check (draw_list_equals (&table, (int []) {ids [0], ids [2], ids [3], ids [4], ids [1]}, 5));
+
+	check (D3D9ObjectTable_hide (&table, D3D9_OBJECT_TABLE_INDEX (ids [0])));
+	check (!D3D9ObjectTable_hide (&table, D3D9_OBJECT_TABLE_INDEX (ids [0])));
+	check (D3D9ObjectTable_hide (&table, D3D9_OBJECT_TABLE_INDEX (ids [4])));
+	check (draw_list_equals (&table, (int []) {ids [2], ids [3], ids [1]}, 3));
+	check (table.allObjects.count == 5);
+
+	// A hidden object shown again is drawn on top, and is last of all the objects
+	check (D3D9ObjectTable_show (&table, D3D9_OBJECT_TABLE_INDEX (ids [0])));
+	check (draw_list_equals (&table, (int []) {ids [2], ids [3], ids [1], ids [0]}, 4));
+	check (table.allObjects.tail == D3D9_OBJECT_TABLE_INDEX (ids [0]));
+
+	check (D3D9ObjectTable_unregister (&table, ids [3]));
+	check (draw_list_equals (&table, (int []) {ids [2], ids [1], ids [0]}, 3));
+	check (table.allObjects.count == 4);
+
+	D3D9ObjectTable_destroy (&table);
+}
+
+/*
+ * Description : The iteration over the draw list follows the draw order and stops on a hidden object
+ */
+static void
+test_next_drawn (
+	void
+) {
+	D3D9ObjectTable table = D3D9_OBJECT_TABLE_INITIALIZER;
+	int ids [3];
+
+	check (D3D9ObjectTable_get_next_drawn (&table, -1) == -1);
+
+	for (int index = 0; index < 3; index++) {
+		ids [index] = D3D9ObjectTable_register (&table, &objects [index]);
+		D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index]));
+	}
+
+	D3D9ObjectTable_show (&table, D3D9_OBJECT_TABLE_INDEX (ids [0]));
+
+	int index = D3D9ObjectTable_get_next_drawn (&table, -1);
+	check (index == D3D9_OBJECT_TABLE_INDEX (ids [1]));
+	check ((index = D3D9ObjectTable_get_next_drawn (&table, index)) == D3D9_OBJECT_TABLE_INDEX (ids [2]));
+	check ((index = D3D9ObjectTable_get_next_drawn (&table, index)) == D3D9_OBJECT_TABLE_INDEX (ids [0]));
+	check (D3D9ObjectTable_get_next_drawn (&table, index) == -1);
+
+	D3D9ObjectTable_hide (&table, D3D9_OBJECT_TABLE_INDEX (ids [1]));
+	check (D3D9ObjectTable_get_next_drawn (&table, D3D9_OBJECT_TABLE_INDEX (ids [1])) == -1);
+
+	D3D9ObjectTable_destroy (&table);
+}
+
+/*
+ * Description : Random show, hide and unregister keep the lists consistent with the slots
+ */
+static void
+test_random (
+	void
+) {
+	D3D9ObjectTable table = D3D9_OBJECT_TABLE_INITIALIZER;
+	int ids [OBJECTS_COUNT];
+	unsigned int seed = 1234;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		ids [index] = D3D9ObjectTable_register (&table, &objects [index]);
+		D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index]));
+	}
+
+	for (int step = 0; step < 100000; step++) {
+		int index = rand_r (&seed) % OBJECTS_COUNT;
+
+		switch (rand_r (&seed) % 3) {
+			case 0: D3D9ObjectTable_show (&table, D3D9_OBJECT_TABLE_INDEX (ids [index])); break;
+			case 1: D3D9ObjectTable_hide (&table, D3D9_OBJECT_TABLE_INDEX (ids [index])); break;
+			case 2:
+				D3D9ObjectTable_unregister (&table, ids [index]);
+				ids [index] = D3D9ObjectTable_register (&table, &objects [index]);
+				D3D9ObjectTable_add (&table, D3D9_OBJECT_TABLE_INDEX (ids [index]));
+			break;
+		}
+	}
+
+	int drawn = 0, walked = 0, previous = -1;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		drawn += table.slots [D3D9_OBJECT_TABLE_INDEX (ids [index])].drawn;
+	}
+
+	foreach_d3d9object_table_slot (&table, &table.drawObjects, index) {
+		check (table.slots [index].drawn);
+		check (table.slots [index].drawLink.prev == previous);
+		previous = index;
+		walked++;
+	}
+
+	check (walked == drawn && table.drawObjects.count == drawn);
+	check (table.drawObjects.tail == previous);
+	check (table.allObjects.count == OBJECTS_COUNT);
+	check (table.slotsCount == OBJECTS_COUNT);
+
+	D3D9ObjectTable_destroy (&table);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_register);
+	run_test (test_draw_order);
+	run_test (test_next_drawn);
+	run_test (test_random);
+
+	return test_result ();
+}
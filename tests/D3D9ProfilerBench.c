@@ -0,0 +1,160 @@
+#include "D3D9Test.h"
+#include "D3D9Profiler.h"
+#include "D3D9HookThunks.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Cost of profiling a call, alone and as D3D9Hook_profile does : a thunk calling a wrapper which counts the call
+// and times a sample of them, against a wrapper timing every call.
+
+// Calls measured per configuration
+#define CALLS_COUNT    10000000
+// Threads recording at the same time
+#define THREADS_COUNT  4
+// Methods of the profiler, as many as IDirect3DDevice9
+#define METHODS_COUNT  119
+
+typedef int (*FakeMethod) (void *device, int state, int value);
+
+static D3D9Profiler *profiler;
+static void * volatile vftable [1];
+
+/*
+ * Description : Method of the device, doing as little as possible
+ */
+static __attribute__((noinline)) int
+fake_method (
+	void *device,
+	int state,
+	int value
+) {
+	(void) device;
+	return state + value;
+}
+
+/*
+ * Description : Wrapper timing every call of the method
+ */
+static __attribute__((noinline)) int
+timed_method (
+	void *device,
+	int state,
+	int value
+) {
+	unsigned long long start = D3D9Profiler_get_ticks ();
+	int result = fake_method (device, state, value);
+	D3D9Profiler_record (profiler, 42, D3D9Profiler_get_ticks () - start);
+
+	return result;
+}
+
+/*
+ * Description : Wrapper counting the calls and timing a sample of them, as the wrappers of D3D9Hook_profile
+ */
+static __attribute__((noinline)) int
+profiled_method (
+	void *device,
+	int state,
+	int value
+) {
+	unsigned long long start = D3D9Profiler_start (profiler, 42);
+	int result = fake_method (device, state, value);
+	D3D9Profiler_stop (profiler, 42, start);
+
+	return result;
+}
+
+/*
+ * Description : Call the method through the vftable
+ * Return : double the nanoseconds per call
+ */
+static double
+measure_calls (
+	void
+) {
+	volatile int sink = 0;
+	double start = D3D9Test_now ();
+
+	for (int i = 0; i < CALLS_COUNT; i++) {
+		sink += ((FakeMethod) vftable [0]) (NULL, i, 1);
+	}
+
+	return (D3D9Test_now () - start) / CALLS_COUNT;
+}
+
+/*
+ * Description : Thread recording calls
+ * void *argument : Unused
+ * Return : void * NULL
+ */
+static void *
+recorder_thread (
+	void *argument
+) {
+	(void) argument;
+	D3D9Profiler_measure_overhead (profiler);
+
+	return NULL;
+}
+
+int
+main (
+	void
+) {
+	pthread_t threads [THREADS_COUNT];
+	int argumentsCounts [1] = {3};
+	D3D9HookThunks *thunks;
+	double start, ticks, original, timed, wrapped, hooked, thunked, threaded;
+
+	if (!(profiler = D3D9Profiler_new (METHODS_COUNT)) || !(thunks = D3D9HookThunks_new (argumentsCounts, 1))) {
+		fprintf (stderr, "Cannot allocate the profiler.\n");
+		return 1;
+	}
+
+	start = D3D9Test_now ();
+	for (int i = 0; i < CALLS_COUNT; i++) {
+		(void) D3D9Profiler_get_ticks ();
+	}
+	ticks = (D3D9Test_now () - start) / CALLS_COUNT;
+
+	vftable [0] = (void *) fake_method;
+	original = measure_calls ();
+
+	vftable [0] = (void *) timed_method;
+	timed = measure_calls ();
+
+	vftable [0] = (void *) profiled_method;
+	wrapped = measure_calls ();
+
+	// The thunk counts the calls running for the unhook, profiled or not
+	D3D9HookThunks_swap (thunks, 0, (void *) fake_method);
+	vftable [0] = D3D9HookThunks_get_entry (thunks, 0);
+	hooked = measure_calls ();
+
+	D3D9HookThunks_swap (thunks, 0, (void *) profiled_method);
+	thunked = measure_calls ();
+
+	start = D3D9Test_now ();
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_create (&threads [index], NULL, recorder_thread, NULL);
+	}
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_join (threads [index], NULL);
+	}
+	threaded = (D3D9Test_now () - start) / ((double) D3D9_PROFILER_OVERHEAD_CALLS * THREADS_COUNT);
+
+	printf ("D3D9Profiler_get_ticks                      : %.2f ns\n", ticks);
+	printf ("Start and stop, 1 call out of %d timed      : %.2f ns per call\n", D3D9_PROFILER_SAMPLE_PERIOD, D3D9Profiler_measure_overhead (profiler));
+	printf ("Same, %d threads at once, all together       : %.2f ns per call (%ld processors)\n",
+		THREADS_COUNT, threaded, sysconf (_SC_NPROCESSORS_ONLN));
+	printf ("Method not profiled                         : %.2f ns per call\n", original);
+	printf ("Method timed at every call by a wrapper     : %.2f ns per call (+%.2f ns)\n", timed, timed - original);
+	printf ("Method profiled by a wrapper                : %.2f ns per call (+%.2f ns)\n", wrapped, wrapped - original);
+	printf ("Method hooked through thunk, not profiled   : %.2f ns per call (+%.2f ns)\n", hooked, hooked - original);
+	printf ("Method profiled by a wrapper, through thunk : %.2f ns per call (+%.2f ns over the thunk)\n", thunked, thunked - hooked);
+
+	D3D9HookThunks_free (thunks);
+	D3D9Profiler_free (profiler);
+
+	return 0;
+}
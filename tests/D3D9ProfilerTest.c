@@ -0,0 +1,316 @@
+#include "D3D9Test.h"
+#include "D3D9Profiler.h"
+#include <pthread.h>
+
+// Methods of the profilers tested
+#define METHODS_COUNT  8
+// Calls recorded by each thread
+#define CALLS_COUNT    10000
+// Threads recording in the same profiler
+#define THREADS_COUNT  8
+
+static D3D9Profiler *profiler;
+// Keeps the threads alive together : a thread ending can give its identifier to the next one
+static pthread_barrier_t barrier;
+
+/*
+ * Description : Find the only bucket counting a call in the stats of a method
+ * D3D9ProfilerStats *stats : Stats of a method called once
+ * Return : int the index of the bucket, -1 if none or several count a call
+ */
+static int
+find_bucket (
+	D3D9ProfilerStats *stats
+) {
+	int found = -1;
+
+	for (int bucket = 0; bucket < D3D9_PROFILER_BUCKETS; bucket++) {
+		if (stats->buckets [bucket]) {
+			if (found != -1 || stats->buckets [bucket] != 1) {
+				return -1;
+			}
+			found = bucket;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : A duration is counted in the bucket whose range contains it
+ */
+static void
+test_buckets (
+	void
+) {
+	unsigned long long durations [] = {0, 1, 3, 4, 5, 7, 100, 1000, 123456, 1ULL << 40};
+	D3D9ProfilerStats stats;
+
+	// The durations of 64 bits reach the bucket of their highest bit, D3D9_PROFILER_SUB_BUCKETS_BITS below the last ones
+	for (int bucket = 1; bucket < (64 - D3D9_PROFILER_SUB_BUCKETS_BITS) * D3D9_PROFILER_SUB_BUCKETS; bucket++) {
+		check (D3D9Profiler_get_bucket_ticks (bucket) > D3D9Profiler_get_bucket_ticks (bucket - 1));
+	}
+
+	for (int index = 0; index < (int) (sizeof(durations) / sizeof(*durations)); index++) {
+		check ((profiler = D3D9Profiler_new (1)) != NULL);
+
+		D3D9Profiler_record (profiler, 0, durations [index]);
+		D3D9Profiler_aggregate (profiler);
+		check (D3D9Profiler_get_stats (profiler, 0, &stats));
+
+		int bucket = find_bucket (&stats);
+		check (bucket != -1);
+		check (D3D9Profiler_get_bucket_ticks (bucket) <= durations [index]);
+		check (D3D9Profiler_get_bucket_ticks (bucket + 1) > durations [index]);
+
+		D3D9Profiler_free (profiler);
+	}
+}
+
+/*
+ * Description : The stats of a frame and since the start, the costliest methods and the percentiles
+ */
+static void
+test_aggregate (
+	void
+) {
+	D3D9ProfilerStats stats;
+	int indices [3];
+
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+
+	for (int call = 0; call < 100; call++) {
+		D3D9Profiler_record (profiler, 1, 10);
+		D3D9Profiler_record (profiler, 2, call < 99 ? 1000 : 100000);
+	}
+	D3D9Profiler_record (profiler, 3, 5);
+
+	// Nothing is visible before the frame is aggregated
+	check (D3D9Profiler_get_stats (profiler, 1, &stats) && stats.calls == 0);
+	D3D9Profiler_aggregate (profiler);
+
+	check (D3D9Profiler_get_stats (profiler, 1, &stats));
+	check (stats.calls == 100 && stats.frameCalls == 100 && stats.ticks == 1000 && stats.frameTicks == 1000);
+	check (D3D9Profiler_get_stats (profiler, 2, &stats));
+	check (stats.calls == 100 && stats.ticks == 99 * 1000 + 100000);
+	check (!D3D9Profiler_get_stats (profiler, METHODS_COUNT, &stats));
+
+	check (D3D9Profiler_get_costliest (profiler, indices, 3) == 3);
+	check (indices [0] == 2 && indices [1] == 1 && indices [2] == 3);
+	check (D3D9Profiler_get_costliest (profiler, indices, 1) == 1 && indices [0] == 2);
+
+	// The median of the method 2 is within its bucket of 1000 ticks, the slowest call is within 25%
+	double median = D3D9Profiler_get_percentile (profiler, 2, 50.0) / D3D9Profiler_ticks_to_ns (profiler, 1.0);
+	double slowest = D3D9Profiler_get_percentile (profiler, 2, 100.0) / D3D9Profiler_ticks_to_ns (profiler, 1.0);
+	check (median >= 1000 * 0.75 && median <= 1000 * 1.25);
+	check (slowest >= 100000 * 0.75 && slowest <= 100000 * 1.25);
+	check (D3D9Profiler_get_percentile (profiler, 4, 50.0) == 0.0);
+
+	// A frame without calls : the totals stay, the frame is empty
+	D3D9Profiler_record (profiler, 1, 10);
+	D3D9Profiler_aggregate (profiler);
+	check (D3D9Profiler_get_stats (profiler, 1, &stats) && stats.calls == 101 && stats.frameCalls == 1);
+	check (D3D9Profiler_get_stats (profiler, 2, &stats) && stats.calls == 100 && stats.frameCalls == 0);
+	check (D3D9Profiler_get_costliest (profiler, indices, 3) == 1 && indices [0] == 1);
+	check (profiler->frames == 2);
+
+	D3D9Profiler_free (profiler);
+}
+
+/*
+ * Description : Thread recording calls of the method 1
+ * void *argument : Unused
+ * Return : void * NULL
+ */
+static void *
+recorder_thread (
+	void *argument
+) {
+	(void) argument;
+
+	for (int call = 0; call < CALLS_COUNT; call++) {
+		D3D9Profiler_record (profiler, 1, call);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : The calls recorded by several threads at once are all counted, each in its own shard
+ */
+static void
+test_threads (
+	void
+) {
+	pthread_t threads [THREADS_COUNT];
+	D3D9ProfilerStats stats;
+	unsigned long long inBuckets = 0;
+
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_create (&threads [index], NULL, recorder_thread, NULL);
+	}
+
+	for (int index = 0; index < THREADS_COUNT; index++) {
+		pthread_join (threads [index], NULL);
+	}
+
+	D3D9Profiler_aggregate (profiler);
+	check (D3D9Profiler_get_stats (profiler, 1, &stats));
+	check (stats.calls == (unsigned long long) THREADS_COUNT * CALLS_COUNT);
+	check (stats.ticks == (unsigned long long) THREADS_COUNT * CALLS_COUNT * (CALLS_COUNT - 1) / 2);
+
+	for (int bucket = 0; bucket < D3D9_PROFILER_BUCKETS; bucket++) {
+		inBuckets += stats.buckets [bucket];
+	}
+	check (inBuckets == stats.calls);
+	check (profiler->shardsCount == THREADS_COUNT && profiler->dropped == 0);
+
+	D3D9Profiler_free (profiler);
+}
+
+/*
+ * Description : Thread recording a few calls of the method 0
+ * void *argument : Unused
+ * Return : void * NULL
+ */
+static void *
+short_thread (
+	void *argument
+) {
+	(void) argument;
+
+	for (int call = 0; call < 10; call++) {
+		D3D9Profiler_record (profiler, 0, 1);
+	}
+
+	pthread_barrier_wait (&barrier);
+
+	return NULL;
+}
+
+/*
+ * Description : The threads beyond D3D9_PROFILER_MAX_SHARDS drop their calls, and look for a shard only once
+ */
+static void
+test_shards_exhausted (
+	void
+) {
+	pthread_t threads [D3D9_PROFILER_MAX_SHARDS + 6];
+	int count = sizeof(threads) / sizeof(*threads), extra = count - D3D9_PROFILER_MAX_SHARDS;
+	D3D9ProfilerStats stats;
+
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+	pthread_barrier_init (&barrier, NULL, count + 1);
+
+	for (int index = 0; index < count; index++) {
+		pthread_create (&threads [index], NULL, short_thread, NULL);
+	}
+
+	pthread_barrier_wait (&barrier);
+
+	for (int index = 0; index < count; index++) {
+		pthread_join (threads [index], NULL);
+	}
+
+	pthread_barrier_destroy (&barrier);
+
+	D3D9Profiler_aggregate (profiler);
+	check (D3D9Profiler_get_stats (profiler, 0, &stats) && stats.calls == D3D9_PROFILER_MAX_SHARDS * 10ULL);
+	check (profiler->dropped == extra * 10);
+	check (profiler->shardsCount == count);
+
+	D3D9Profiler_free (profiler);
+}
+
+/*
+ * Description : D3D9Profiler_start counts every call and times one out of D3D9_PROFILER_SAMPLE_PERIOD on average,
+ *               the duration of the calls not timed is estimated from the calls timed
+ */
+static void
+test_sampling (
+	void
+) {
+	int calls = D3D9_PROFILER_SAMPLE_PERIOD * 1000;
+	unsigned long long inBuckets = 0, start;
+	D3D9ProfilerStats stats;
+
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+
+	// The first call in a profiler is timed
+	check ((start = D3D9Profiler_start (profiler, 1)) != 0);
+	D3D9Profiler_stop (profiler, 1, start);
+
+	for (int call = 1; call < calls; call++) {
+		start = D3D9Profiler_start (profiler, 1);
+		D3D9Profiler_stop (profiler, 1, start);
+	}
+
+	D3D9Profiler_aggregate (profiler);
+	check (D3D9Profiler_get_stats (profiler, 1, &stats));
+	check (stats.calls == (unsigned long long) calls && stats.frameCalls == stats.calls);
+	check (stats.samples >= 500 && stats.samples <= 2000);
+	check (stats.ticks >= stats.sampledTicks);
+
+	for (int bucket = 0; bucket < D3D9_PROFILER_BUCKETS; bucket++) {
+		inBuckets += stats.buckets [bucket];
+	}
+	check (inBuckets == stats.samples);
+	D3D9Profiler_free (profiler);
+
+	// 10 calls of 100 ticks timed, then 10 calls not timed : they last as long on average
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+
+	for (int call = 0; call < 10; call++) {
+		D3D9Profiler_record (profiler, 2, 100);
+	}
+	D3D9Profiler_aggregate (profiler);
+
+	d3d9ProfilerCountdown = 100;
+	for (int call = 0; call < 10; call++) {
+		check (D3D9Profiler_start (profiler, 2) == 0);
+	}
+	D3D9Profiler_aggregate (profiler);
+
+	check (D3D9Profiler_get_stats (profiler, 2, &stats));
+	check (stats.calls == 20 && stats.samples == 10 && stats.sampledTicks == 1000);
+	check (stats.frameCalls == 10 && stats.frameTicks == 1000 && stats.ticks == 2000);
+
+	D3D9Profiler_free (profiler);
+}
+
+/*
+ * Description : The calls timed by D3D9Profiler_measure_overhead aren't part of the stats
+ */
+static void
+test_overhead (
+	void
+) {
+	D3D9ProfilerStats stats;
+
+	check ((profiler = D3D9Profiler_new (METHODS_COUNT)) != NULL);
+
+	check (D3D9Profiler_measure_overhead (profiler) > 0.0);
+	D3D9Profiler_aggregate (profiler);
+
+	for (int index = 0; index < METHODS_COUNT; index++) {
+		check (D3D9Profiler_get_stats (profiler, index, &stats) && stats.calls == 0);
+	}
+
+	D3D9Profiler_free (profiler);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_buckets);
+	run_test (test_aggregate);
+	run_test (test_threads);
+	run_test (test_shards_exhausted);
+	run_test (test_sampling);
+	run_test (test_overhead);
+
+	return test_result ();
+}
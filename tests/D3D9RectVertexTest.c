@@ -0,0 +1,79 @@
+#include "D3D9Test.h"
+#include "D3D9RectVertex.h"
+#include <string.h>
+
+/*
+ * Description : The two triangles cover exactly the pixels of the rectangle, with the color of the rectangle
+ */
+static void
+test_build (
+	void
+) {
+	D3D9RectVertex vertices [D3D9_RECT_VERTICES_COUNT];
+	float minX = 1e9, minY = 1e9, maxX = -1e9, maxY = -1e9;
+
+	check (D3D9RectVertex_build (vertices, 10, 20, 30, 40, 0x80FF0000) == D3D9_RECT_VERTICES_COUNT);
+
+	for (int i = 0; i < D3D9_RECT_VERTICES_COUNT; i++) {
+		check (vertices [i].color == 0x80FF0000);
+		check (vertices [i].z == 0.0f && vertices [i].rhw == 1.0f);
+		minX = (vertices [i].x < minX) ? vertices [i].x : minX;
+		minY = (vertices [i].y < minY) ? vertices [i].y : minY;
+		maxX = (vertices [i].x > maxX) ? vertices [i].x : maxX;
+		maxY = (vertices [i].y > maxY) ? vertices [i].y : maxY;
+	}
+
+	// Shifted by half a pixel
+	check (minX == 9.5f && minY == 19.5f);
+	check (maxX == 39.5f && maxY == 59.5f);
+}
+
+/*
+ * Description : Both triangles are clockwise, so they are drawn whatever the cull mode of the application
+ */
+static void
+test_winding (
+	void
+) {
+	D3D9RectVertex vertices [D3D9_RECT_VERTICES_COUNT];
+
+	check (D3D9RectVertex_build (vertices, 0, 0, 8, 4, 0xFFFFFFFF) == D3D9_RECT_VERTICES_COUNT);
+
+	for (int triangle = 0; triangle < 2; triangle++) {
+		D3D9RectVertex *a = &vertices [triangle * 3];
+		D3D9RectVertex *b = &vertices [triangle * 3 + 1];
+		D3D9RectVertex *c = &vertices [triangle * 3 + 2];
+
+		// Y goes down on the screen : a positive cross product is clockwise
+		float cross = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+		check (cross > 0.0f);
+	}
+}
+
+/*
+ * Description : Empty rectangles don't write any vertex
+ */
+static void
+test_empty (
+	void
+) {
+	D3D9RectVertex vertices [D3D9_RECT_VERTICES_COUNT];
+
+	memset (vertices, 0xAB, sizeof(vertices));
+
+	check (D3D9RectVertex_build (vertices, 0, 0, 0, 10, 0) == 0);
+	check (D3D9RectVertex_build (vertices, 0, 0, 10, 0, 0) == 0);
+	check (D3D9RectVertex_build (vertices, 0, 0, -5, 10, 0) == 0);
+	check (vertices [0].color == 0xABABABAB);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_build);
+	run_test (test_winding);
+	run_test (test_empty);
+
+	return test_result ();
+}
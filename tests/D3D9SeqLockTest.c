@@ -0,0 +1,123 @@
+#include "D3D9Test.h"
+#include "D3D9SeqLock.h"
+#include <pthread.h>
+
+// Rows written by the stress test, and copies of all the rows made by its reader
+#define STRESS_ROWS    64
+#define STRESS_PASSES  50000
+
+// Row of the stress test : its fields are always written together, so a consistent copy has y == -x and w == x * 3
+typedef struct
+{
+	int x, y, w;
+
+}	TestRow;
+
+// State shared by the writer and the reader of the stress test
+typedef struct
+{
+	TestRow rows [STRESS_ROWS];
+	D3D9SeqLock versions [STRESS_ROWS];
+	volatile int reading;
+
+}	StressState;
+
+/*
+ * Description : The version is even at rest, odd while written, and a read retries only if a write happened meanwhile
+ */
+static void
+test_versions (
+	void
+) {
+	D3D9SeqLock lock = D3D9_SEQ_LOCK_INITIALIZER;
+	unsigned int version;
+
+	version = D3D9SeqLock_read_begin (&lock);
+	check (version == 0);
+	check (!D3D9SeqLock_read_retry (&lock, version));
+
+	D3D9SeqLock_write_begin (&lock);
+	check (lock == 1);
+	check (D3D9SeqLock_read_retry (&lock, version));
+	D3D9SeqLock_write_end (&lock);
+	check (lock == 2);
+
+	check (D3D9SeqLock_read_retry (&lock, version));
+	version = D3D9SeqLock_read_begin (&lock);
+	check (version == 2 && !D3D9SeqLock_read_retry (&lock, version));
+}
+
+/*
+ * Description : Writer of the stress test : changes the rows in place until the reader is done
+ * void *argument : The StressState
+ * Return : void * NULL
+ */
+static void *
+stress_writer (
+	void *argument
+) {
+	StressState *state = argument;
+	int change = 0;
+
+	while (__atomic_load_n (&state->reading, __ATOMIC_ACQUIRE)) {
+		int index = ++change % STRESS_ROWS;
+
+		D3D9SeqLock_write_begin (&state->versions [index]);
+		state->rows [index].x = change;
+		state->rows [index].y = -change;
+		state->rows [index].w = change * 3;
+		D3D9SeqLock_write_end (&state->versions [index]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : A reader copying the rows while they are written in place never gets a torn row
+ */
+static void
+test_stress (
+	void
+) {
+	StressState state = {.reading = 1};
+	long long torn = 0;
+	pthread_t writer;
+
+	pthread_create (&writer, NULL, stress_writer, &state);
+
+	for (int pass = 0; pass < STRESS_PASSES; pass++) {
+		for (int index = 0; index < STRESS_ROWS; index++) {
+			unsigned int version;
+			TestRow row;
+
+			do {
+				version = D3D9SeqLock_read_begin (&state.versions [index]);
+				row = state.rows [index];
+			} while (D3D9SeqLock_read_retry (&state.versions [index], version));
+
+			if (row.y != -row.x || row.w != row.x * 3) {
+				torn++;
+			}
+		}
+	}
+
+	__atomic_store_n (&state.reading, 0, __ATOMIC_RELEASE);
+	pthread_join (writer, NULL);
+
+	check (torn == 0);
+
+	// The writer is done : every version is even again
+	for (int index = 0; index < STRESS_ROWS; index++) {
+		check ((state.versions [index] & 1) == 0);
+	}
+}
+
+int
+main (
+	void
+) {
+	run_test (test_versions);
+	run_test (test_stress);
+
+	return test_result ();
+}
@@ -0,0 +1,203 @@
+#include "D3D9Test.h"
+#include "D3D9SignatureCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// Size of the synthetic module fingerprinted
+#define MODULE_SIZE 0x2000
+
+static char directory [] = "/tmp/D3D9SignatureCacheTestXXXXXX";
+static char path [64];
+
+/*
+ * Description : Count the files of the test directory, to find the temporary files left
+ * Return : int the number of files
+ */
+static int
+count_files (
+	void
+) {
+	DIR *dir = opendir (directory);
+	struct dirent *entry;
+	int count = 0;
+
+	while ((entry = readdir (dir))) {
+		count += (entry->d_name [0] != '.');
+	}
+
+	closedir (dir);
+
+	return count;
+}
+
+/*
+ * Description : Build a minimal PE image : headers, a section table, and an image base the loader would relocate
+ * unsigned char *module : Output, MODULE_SIZE bytes
+ * unsigned int timestamp : Timestamp of the file header
+ * unsigned int imageBase : Image base of the optional header
+ */
+static void
+make_module (
+	unsigned char *module,
+	unsigned int timestamp,
+	unsigned int imageBase
+) {
+	memset (module, 0, MODULE_SIZE);
+	module [0] = 'M';
+	module [1] = 'Z';
+	*(unsigned int *) &module [0x3C] = 0x80;
+	memcpy (&module [0x80], "PE\0\0", 4);
+	*(unsigned short *) &module [0x84 + 2]  = 1;
+	*(unsigned int *)   &module [0x84 + 4]  = timestamp;
+	*(unsigned short *) &module [0x84 + 16] = 0xE0;
+	*(unsigned int *)   &module [0x98 + 28] = imageBase;
+	memcpy (&module [0x98 + 0xE0], ".text\0\0\0", 8);
+}
+
+/*
+ * Description : The entries saved are loaded back, and the save leaves no temporary file
+ */
+static void
+test_round_trip (
+	void
+) {
+	D3D9ModuleFingerprint fingerprint = {0x1000, 0x12345678, 0xDEADBEEFCAFEULL};
+	D3D9ModuleFingerprint other = {0x1000, 0x12345678, 0xDEADBEEFCAFFULL};
+	D3D9SignatureCache *cache;
+	size_t offset;
+
+	check ((cache = D3D9SignatureCache_new (path)) != NULL);
+	check (!D3D9SignatureCache_get (cache, &fingerprint, "present", &offset));
+	check (D3D9SignatureCache_set (cache, &fingerprint, "present", 0x1234));
+	check (D3D9SignatureCache_set (cache, &other, "present", 0x5678));
+	check (D3D9SignatureCache_save (cache));
+	D3D9SignatureCache_free (cache);
+
+	check (count_files () == 1);
+
+	check ((cache = D3D9SignatureCache_new (path)) != NULL);
+	check (D3D9SignatureCache_get (cache, &fingerprint, "present", &offset) && offset == 0x1234);
+	check (D3D9SignatureCache_get (cache, &other, "present", &offset) && offset == 0x5678);
+	check (!D3D9SignatureCache_get (cache, &fingerprint, "absent", &offset));
+	D3D9SignatureCache_free (cache);
+}
+
+/*
+ * Description : The longest name fits the format of the file, longer names are refused and never read truncated
+ */
+static void
+test_name_width (
+	void
+) {
+	D3D9ModuleFingerprint fingerprint = {0x1000, 1, 2};
+	char longest [D3D9_SIGNATURE_CACHE_NAME_SIZE];
+	char tooLong [D3D9_SIGNATURE_CACHE_NAME_SIZE + 1];
+	D3D9SignatureCache *cache;
+	size_t offset;
+	FILE *file;
+
+	memset (longest, 'n', D3D9_SIGNATURE_CACHE_NAME_LENGTH);
+	longest [D3D9_SIGNATURE_CACHE_NAME_LENGTH] = '\0';
+	memset (tooLong, 'a', D3D9_SIGNATURE_CACHE_NAME_SIZE);
+	tooLong [D3D9_SIGNATURE_CACHE_NAME_SIZE] = '\0';
+
+	check ((cache = D3D9SignatureCache_new (path)) != NULL);
+	check (D3D9SignatureCache_set (cache, &fingerprint, longest, 0x42));
+	check (!D3D9SignatureCache_set (cache, &fingerprint, tooLong, 0x43));
+	check (D3D9SignatureCache_save (cache));
+	D3D9SignatureCache_free (cache);
+
+	// A hand written line with a name too long : the hexadecimal end of the name isn't an offset
+	check ((file = fopen (path, "a")) != NULL);
+	fprintf (file, "1000 1 2 %s 44\n", tooLong);
+	fclose (file);
+
+	check ((cache = D3D9SignatureCache_new (path)) != NULL);
+	check (D3D9SignatureCache_get (cache, &fingerprint, longest, &offset) && offset == 0x42);
+	tooLong [D3D9_SIGNATURE_CACHE_NAME_LENGTH] = '\0';
+	check (!D3D9SignatureCache_get (cache, &fingerprint, tooLong, &offset));
+	D3D9SignatureCache_free (cache);
+}
+
+/*
+ * Description : The save replaces the file at once : a reader of the previous file still reads it completely
+ */
+static void
+test_replace (
+	void
+) {
+	D3D9ModuleFingerprint fingerprint = {0x1000, 3, 4};
+	D3D9SignatureCache *cache;
+	char line [256];
+	FILE *reader;
+	int lines = 0;
+
+	check ((cache = D3D9SignatureCache_new (path)) != NULL);
+	for (int index = 0; index < 100; index++) {
+		char name [16];
+		sprintf (name, "first%d", index);
+		check (D3D9SignatureCache_set (cache, &fingerprint, name, index));
+	}
+	check (D3D9SignatureCache_save (cache));
+
+	check ((reader = fopen (path, "r")) != NULL);
+
+	// Rewritten while the reader has the previous file open
+	check (D3D9SignatureCache_set (cache, &fingerprint, "second", 1));
+	check (D3D9SignatureCache_save (cache));
+	check (count_files () == 1);
+
+	while (fgets (line, sizeof(line), reader)) {
+		check (strstr (line, "second") == NULL);
+		lines++;
+	}
+	fclose (reader);
+	check (lines >= 100);
+
+	// Nothing is written if nothing changed
+	check (D3D9SignatureCache_save (cache));
+	D3D9SignatureCache_free (cache);
+}
+
+/*
+ * Description : The fingerprint ignores the relocated image base, but not the timestamp
+ */
+static void
+test_fingerprint (
+	void
+) {
+	static unsigned char module [MODULE_SIZE], relocated [MODULE_SIZE], rebuilt [MODULE_SIZE];
+	D3D9ModuleFingerprint a, b, c;
+
+	make_module (module, 0x5000, 0x10000000);
+	make_module (relocated, 0x5000, 0x20000000);
+	make_module (rebuilt, 0x5001, 0x10000000);
+
+	D3D9SignatureCache_fingerprint (module, MODULE_SIZE, &a);
+	D3D9SignatureCache_fingerprint (relocated, MODULE_SIZE, &b);
+	D3D9SignatureCache_fingerprint (rebuilt, MODULE_SIZE, &c);
+
+	check (a.size == MODULE_SIZE && a.timestamp == 0x5000);
+	check (a.hash == b.hash && a.timestamp == b.timestamp);
+	check (a.hash != c.hash && c.timestamp == 0x5001);
+}
+
+int
+main (
+	void
+) {
+	check (mkdtemp (directory) != NULL);
+	snprintf (path, sizeof(path), "%s/signatures.txt", directory);
+
+	run_test (test_round_trip);
+	run_test (test_name_width);
+	run_test (test_replace);
+	run_test (test_fingerprint);
+
+	unlink (path);
+	rmdir (directory);
+
+	return test_result ();
+}
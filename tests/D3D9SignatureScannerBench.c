@@ -0,0 +1,123 @@
+#include "D3D9Test.h"
+#include "D3D9SignatureScanner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Synthetic module scanned, and signatures searched in it
+#define BUFFER_SIZE      (64 * 1024 * 1024)
+#define SIGNATURES_COUNT 32
+#define SIGNATURE_SIZE   16
+
+static unsigned char *buffer;
+static unsigned char patterns [SIGNATURES_COUNT][SIGNATURE_SIZE];
+static char masks [SIGNATURES_COUNT][SIGNATURE_SIZE + 1];
+
+/*
+ * Description : Count the matches reported
+ * Same parameters and return as D3D9SignatureScannerCallback. userData is a counter.
+ */
+static bool
+count_match (
+	void *userData,
+	int signature,
+	size_t offset
+) {
+	(void) signature;
+	(void) offset;
+	(*(long long *) userData)++;
+
+	return true;
+}
+
+/*
+ * Description : Search the signatures one after the other, a pass over the buffer for each, as mem_scanner does
+ * Return : long long the number of matches
+ */
+static long long
+naive_scan (
+	void
+) {
+	long long found = 0;
+
+	for (int index = 0; index < SIGNATURES_COUNT; index++) {
+		for (size_t offset = 0; offset + SIGNATURE_SIZE <= BUFFER_SIZE; offset++) {
+			int i;
+
+			for (i = 0; i < SIGNATURE_SIZE; i++) {
+				if (masks [index][i] == 'x' && buffer [offset + i] != patterns [index][i]) {
+					break;
+				}
+			}
+
+			found += (i == SIGNATURE_SIZE);
+		}
+	}
+
+	return found;
+}
+
+int
+main (
+	void
+) {
+	D3D9SignatureScanner *scanner = D3D9SignatureScanner_new ();
+	unsigned int seed = 3;
+	long long found;
+	double start, elapsed;
+
+	// Code like bytes : mostly the frequent opcodes, so the anchors are really filtered
+	buffer = malloc (BUFFER_SIZE);
+	for (size_t i = 0; i < BUFFER_SIZE; i++) {
+		unsigned char frequent [] = {0x00, 0x8B, 0xFF, 0xCC, 0x89, 0xE8, 0x0F, 0x85};
+		buffer [i] = (rand_r (&seed) % 2) ? frequent [rand_r (&seed) % sizeof(frequent)] : rand_r (&seed);
+	}
+
+	for (int index = 0; index < SIGNATURES_COUNT; index++) {
+		char name [32];
+
+		for (int i = 0; i < SIGNATURE_SIZE; i++) {
+			patterns [index][i] = rand_r (&seed);
+			masks [index][i] = (i > 0 && rand_r (&seed) % 4 == 0) ? '?' : 'x';
+		}
+		masks [index][SIGNATURE_SIZE] = '\0';
+
+		// A few matches of each signature
+		for (int copy = 0; copy < 4; copy++) {
+			memcpy (&buffer [rand_r (&seed) % (BUFFER_SIZE - SIGNATURE_SIZE)], patterns [index], SIGNATURE_SIZE);
+		}
+
+		sprintf (name, "signature%d", index);
+		D3D9SignatureScanner_add (scanner, name, patterns [index], masks [index], NULL);
+	}
+
+	start = D3D9Test_now ();
+	found = naive_scan ();
+	elapsed = D3D9Test_now () - start;
+	printf ("D3D9SignatureScanner naive  : %7.1f ms for %d signatures in %d MB, %6.1f MB/s (%lld matches)\n",
+		elapsed / 1e6, SIGNATURES_COUNT, BUFFER_SIZE >> 20, (BUFFER_SIZE >> 20) / (elapsed / 1e9), found);
+
+	found = 0;
+	start = D3D9Test_now ();
+	D3D9SignatureScanner_scan (scanner, buffer, BUFFER_SIZE, count_match, &found);
+	elapsed = D3D9Test_now () - start;
+	printf ("D3D9SignatureScanner scan   : %7.1f ms for %d signatures in %d MB, %6.1f MB/s (%lld matches)\n",
+		elapsed / 1e6, SIGNATURES_COUNT, BUFFER_SIZE >> 20, (BUFFER_SIZE >> 20) / (elapsed / 1e9), found);
+
+	// Scaling of the parallel scan with the threads
+	double single = 0.0;
+	for (int threads = 1; threads <= 16; threads *= 2) {
+		found = 0;
+		start = D3D9Test_now ();
+		D3D9SignatureScanner_scan_parallel (scanner, buffer, BUFFER_SIZE, threads, count_match, &found);
+		elapsed = D3D9Test_now () - start;
+		single = (threads == 1) ? elapsed : single;
+		printf ("D3D9SignatureScanner %2d threads : %7.1f ms, %6.1f MB/s, x%.2f (%lld matches, %ld processors)\n",
+			threads, elapsed / 1e6, (BUFFER_SIZE >> 20) / (elapsed / 1e9), single / elapsed, found, sysconf (_SC_NPROCESSORS_ONLN));
+	}
+
+	D3D9SignatureScanner_free (scanner);
+	free (buffer);
+
+	return 0;
+}
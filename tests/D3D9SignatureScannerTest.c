@@ -0,0 +1,396 @@
+#include "D3D9Test.h"
+#include "D3D9SignatureScanner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Size of the scanned buffer : several chunks of the parallel scan, and a partial one
+#define BUFFER_SIZE       (D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE * 2 + 123457)
+#define SIGNATURES_COUNT  12
+#define SIGNATURE_MAX     24
+// Size of the buffer scanned by the cancellation test, slow to scan so it can be cancelled in the middle
+#define CANCELLED_SIZE    (D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE * 16)
+// Copies of each signature planted in the buffer, besides the ones crossing the chunk boundaries
+#define PLANTED_COUNT     40
+
+// Signature in the source format, as given to D3D9SignatureScanner_add
+typedef struct
+{
+	unsigned char pattern [SIGNATURE_MAX];
+	char mask [SIGNATURE_MAX + 1];
+	int size;
+
+}	TestSignature;
+
+// Matches collected from a callback, or computed by the naive matcher
+typedef struct
+{
+	D3D9SignatureMatch *matches;
+	int count;
+	int capacity;
+
+}	TestMatches;
+
+static unsigned char *buffer;
+static TestSignature signatures [SIGNATURES_COUNT];
+static D3D9SignatureScanner *scanner;
+static TestMatches expected;
+
+/*
+ * Description : Add a match to a list
+ * Same parameters and return as D3D9SignatureScannerCallback. userData is the TestMatches.
+ */
+static bool
+collect (
+	void *userData,
+	int signature,
+	size_t offset
+) {
+	TestMatches *matches = userData;
+
+	if (matches->count == matches->capacity) {
+		matches->capacity = (matches->capacity) ? matches->capacity * 2 : 1024;
+		matches->matches = realloc (matches->matches, sizeof(D3D9SignatureMatch) * matches->capacity);
+	}
+
+	matches->matches [matches->count++] = (D3D9SignatureMatch) {.offset = offset, .signature = signature};
+
+	return true;
+}
+
+/*
+ * Description : Order the matches by offset then signature, the order of the parallel scan
+ */
+static int
+compare_matches (
+	const void *a,
+	const void *b
+) {
+	const D3D9SignatureMatch *matchA = a;
+	const D3D9SignatureMatch *matchB = b;
+
+	if (matchA->offset != matchB->offset) {
+		return (matchA->offset < matchB->offset) ? -1 : 1;
+	}
+
+	return matchA->signature - matchB->signature;
+}
+
+/*
+ * Description : Compare two lists of matches, field by field since the structure is padded
+ * Return : bool true if they contain the same matches in the same order
+ */
+static bool
+same_matches (
+	TestMatches *a,
+	TestMatches *b
+) {
+	if (a->count != b->count) {
+		return false;
+	}
+
+	for (int i = 0; i < a->count; i++) {
+		if (compare_matches (&a->matches [i], &b->matches [i]) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Check a signature at an offset byte by byte, from its source format
+ * Return : bool true if every 'x' byte of the mask is equal
+ */
+static bool
+naive_matches (
+	TestSignature *signature,
+	size_t offset,
+	size_t size
+) {
+	if (offset + signature->size > size) {
+		return false;
+	}
+
+	for (int i = 0; i < signature->size; i++) {
+		if (signature->mask [i] == 'x' && buffer [offset + i] != signature->pattern [i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Description : Fill the buffer with random bytes, generate the signatures and plant them, some across the chunk boundaries
+ */
+static void
+setup (
+	void
+) {
+	unsigned int seed = 42;
+
+	buffer = malloc (BUFFER_SIZE);
+	for (size_t i = 0; i < BUFFER_SIZE; i++) {
+		buffer [i] = rand_r (&seed);
+	}
+
+	check ((scanner = D3D9SignatureScanner_new ()) != NULL);
+
+	for (int index = 0; index < SIGNATURES_COUNT; index++)
+	{
+		TestSignature *signature = &signatures [index];
+		char name [32];
+
+		// From a single byte up to SIGNATURE_MAX, with leading wildcards for some of them
+		signature->size = (index == 0) ? 1 : 2 + rand_r (&seed) % (SIGNATURE_MAX - 1);
+		for (int i = 0; i < signature->size; i++) {
+			signature->pattern [i] = rand_r (&seed);
+			signature->mask [i] = (rand_r (&seed) % 4 == 0) ? '?' : 'x';
+		}
+		if (index % 3 == 1 && signature->size > 2) {
+			signature->mask [0] = '?';
+		}
+		signature->mask [signature->size - 1] = 'x';
+		signature->mask [signature->size] = '\0';
+
+		sprintf (name, "signature%d", index);
+		check (D3D9SignatureScanner_add (scanner, name, signature->pattern, signature->mask, NULL) == index);
+
+		// Planted at random offsets, and across each chunk boundary
+		for (int copy = 0; copy < PLANTED_COUNT + 2; copy++) {
+			size_t offset = (copy < PLANTED_COUNT) ?
+				(size_t) rand_r (&seed) % (BUFFER_SIZE - signature->size) :
+				(size_t) D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE * (copy - PLANTED_COUNT + 1) - signature->size / 2 - index;
+
+			for (int i = 0; i < signature->size; i++) {
+				if (signature->mask [i] == 'x') {
+					buffer [offset + i] = signature->pattern [i];
+				}
+			}
+		}
+	}
+
+	// The naive matches, computed once the buffer is final
+	for (size_t offset = 0; offset < BUFFER_SIZE; offset++) {
+		for (int index = 0; index < SIGNATURES_COUNT; index++) {
+			if (naive_matches (&signatures [index], offset, BUFFER_SIZE)) {
+				collect (&expected, index, offset);
+			}
+		}
+	}
+}
+
+/*
+ * Description : The single pass scan reports the matches of the naive matcher
+ */
+static void
+test_scan (
+	void
+) {
+	TestMatches found = {NULL, 0, 0};
+
+	check (D3D9SignatureScanner_scan (scanner, buffer, BUFFER_SIZE, collect, &found) == expected.count);
+	check (found.count == expected.count);
+
+	// The matches of a signature come by increasing offset
+	for (int i = 1; i < found.count; i++) {
+		for (int j = i - 1; j >= 0; j--) {
+			if (found.matches [j].signature == found.matches [i].signature) {
+				check (found.matches [j].offset < found.matches [i].offset);
+				break;
+			}
+		}
+	}
+
+	qsort (found.matches, found.count, sizeof(D3D9SignatureMatch), compare_matches);
+	check (same_matches (&found, &expected));
+
+	free (found.matches);
+}
+
+/*
+ * Description : The parallel scan reports the matches of the naive matcher in the same order, whatever the threads
+ */
+static void
+test_scan_parallel (
+	void
+) {
+	int threadsCounts [] = {1, 2, 3, 8};
+
+	for (int i = 0; i < (int) (sizeof(threadsCounts) / sizeof(*threadsCounts)); i++) {
+		TestMatches found = {NULL, 0, 0};
+
+		check (D3D9SignatureScanner_scan_parallel (scanner, buffer, BUFFER_SIZE, threadsCounts [i], collect, &found) == expected.count);
+		check (same_matches (&found, &expected));
+
+		free (found.matches);
+	}
+}
+
+/*
+ * Description : The first offsets are the ones of the naive matcher, sequential and parallel
+ */
+static void
+test_find_first (
+	void
+) {
+	size_t first [SIGNATURES_COUNT];
+	size_t offsets [SIGNATURES_COUNT];
+	int expectedFound = 0;
+
+	for (int index = 0; index < SIGNATURES_COUNT; index++) {
+		first [index] = D3D9_SIGNATURE_NOT_FOUND;
+	}
+	for (int i = expected.count - 1; i >= 0; i--) {
+		first [expected.matches [i].signature] = expected.matches [i].offset;
+	}
+	for (int index = 0; index < SIGNATURES_COUNT; index++) {
+		expectedFound += (first [index] != D3D9_SIGNATURE_NOT_FOUND);
+	}
+
+	check (D3D9SignatureScanner_find_first (scanner, buffer, BUFFER_SIZE, offsets) == expectedFound);
+	check (memcmp (offsets, first, sizeof(first)) == 0);
+
+	check (D3D9SignatureScanner_find_first_parallel (scanner, buffer, BUFFER_SIZE, 4, offsets) == expectedFound);
+	check (memcmp (offsets, first, sizeof(first)) == 0);
+}
+
+/*
+ * Description : A match is confirmed at every offset of the naive matcher, and only there
+ */
+static void
+test_matches (
+	void
+) {
+	unsigned int seed = 7;
+
+	for (int i = 0; i < expected.count; i++) {
+		check (D3D9SignatureScanner_matches (scanner, expected.matches [i].signature, buffer, BUFFER_SIZE, expected.matches [i].offset));
+	}
+
+	for (int i = 0; i < 10000; i++) {
+		size_t offset = rand_r (&seed) % BUFFER_SIZE;
+		int index = rand_r (&seed) % SIGNATURES_COUNT;
+
+		check (D3D9SignatureScanner_matches (scanner, index, buffer, BUFFER_SIZE, offset) == naive_matches (&signatures [index], offset, BUFFER_SIZE));
+	}
+}
+
+/*
+ * Description : Empty buffers and buffers without any match are scanned without error
+ */
+static void
+test_empty (
+	void
+) {
+	unsigned char zeros [4096] = {0};
+	TestMatches found = {NULL, 0, 0};
+	D3D9SignatureScanner *empty;
+	unsigned char pattern [] = {0xAA, 0xBB};
+
+	check ((empty = D3D9SignatureScanner_new ()) != NULL);
+	check (D3D9SignatureScanner_add (empty, "none", pattern, "xx", NULL) == 0);
+
+	check (D3D9SignatureScanner_scan (empty, zeros, 0, collect, &found) == 0);
+	check (D3D9SignatureScanner_scan (empty, zeros, sizeof(zeros), collect, &found) == 0);
+	check (D3D9SignatureScanner_scan_parallel (empty, zeros, 0, 4, collect, &found) == 0);
+	check (D3D9SignatureScanner_scan_parallel (empty, zeros, sizeof(zeros), 4, collect, &found) == 0);
+	check (found.count == 0);
+
+	D3D9SignatureScanner_free (empty);
+}
+
+/*
+ * Description : Cancel the scan of a scanner until the scan is over
+ * void *arg : The D3D9SignatureScanner scanning, followed by the flag telling the scan is over
+ */
+static void *
+cancel_scan (
+	void *arg
+) {
+	void **args = arg;
+
+	while (!__atomic_load_n ((bool *) args [1], __ATOMIC_ACQUIRE)) {
+		D3D9SignatureScanner_cancel (args [0]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : A parallel scan cancelled from another thread stops early, and the next scan runs normally
+ */
+static void
+test_cancel (
+	void
+) {
+	// A pair of zeros is the anchor : every offset of a zeroed buffer is a candidate
+	unsigned char pattern [] = {0x00, 0x00, 0x01};
+	unsigned char *zeros = calloc (1, CANCELLED_SIZE);
+	TestMatches found = {NULL, 0, 0};
+	D3D9SignatureScanner *slow;
+	bool done = false;
+	void *args [] = {NULL, &done};
+	pthread_t canceller;
+
+	check ((slow = D3D9SignatureScanner_new ()) != NULL);
+	check (D3D9SignatureScanner_add (slow, "slow", pattern, "xxx", NULL) == 0);
+	args [0] = slow;
+
+	check (pthread_create (&canceller, NULL, cancel_scan, args) == 0);
+	check (D3D9SignatureScanner_scan_parallel (slow, zeros, CANCELLED_SIZE, 2, collect, &found) == -1);
+	check (found.count == 0);
+	__atomic_store_n (&done, true, __ATOMIC_RELEASE);
+	pthread_join (canceller, NULL);
+
+	// The cancellation doesn't outlive the scan it stopped
+	check (D3D9SignatureScanner_scan_parallel (slow, zeros, D3D9_SIGNATURE_SCANNER_DEFAULT_CHUNK_SIZE, 2, collect, &found) == 0);
+	check (D3D9SignatureScanner_scan_parallel (scanner, buffer, BUFFER_SIZE, 2, collect, &found) == expected.count);
+
+	D3D9SignatureScanner_free (slow);
+	free (found.matches);
+	free (zeros);
+}
+
+/*
+ * Description : The result mask reads the marked bytes in little endian
+ */
+static void
+test_get_result (
+	void
+) {
+	unsigned char code [] = {0x90, 0xC7, 0x06, 0x78, 0x56, 0x34, 0x12, 0x90};
+	unsigned char pattern [] = {0xC7, 0x06, 0x00, 0x00, 0x00, 0x00};
+	D3D9SignatureScanner *results;
+	size_t offset;
+
+	check ((results = D3D9SignatureScanner_new ()) != NULL);
+	check (D3D9SignatureScanner_add (results, "mov [esi], imm32", pattern, "xx????", "xx????") == 0);
+	check (D3D9SignatureScanner_find_first (results, code, sizeof(code), &offset) == 1);
+	check (offset == 1);
+	check (D3D9SignatureScanner_get_result (results, 0, code, offset) == 0x12345678);
+
+	D3D9SignatureScanner_free (results);
+}
+
+int
+main (
+	void
+) {
+	setup ();
+
+	run_test (test_scan);
+	run_test (test_scan_parallel);
+	run_test (test_find_first);
+	run_test (test_matches);
+	run_test (test_empty);
+	run_test (test_cancel);
+	run_test (test_get_result);
+
+	D3D9SignatureScanner_free (scanner);
+	free (expected.matches);
+	free (buffer);
+
+	return test_result ();
+}
@@ -0,0 +1,192 @@
+#include "D3D9Test.h"
+#include "D3D9Snapshot.h"
+#include "D3D9Lock.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Frame latency while writers change the draw list : the frame reads the snapshot published without lock,
+// against the frame walking the list under the shared lock that the writers hold exclusively.
+
+// Objects drawn, and frames measured per configuration
+#define OBJECTS_COUNT 10000
+#define FRAMES_COUNT  2000
+// Time left to the writers between two frames, in microseconds
+#define FRAME_INTERVAL 200
+
+static int writersCounts [] = {1, 2, 4, 8};
+
+// Sum of the values walked, so the walk isn't optimized out
+static volatile long long walked;
+
+typedef struct
+{
+	D3D9Snapshot snapshot;
+	int count;
+	int *values;
+
+}	BenchSnapshot;
+
+// State shared by the writers and the frame loop
+typedef struct
+{
+	D3D9SnapshotExchange exchange;
+	D3D9Lock lock;
+	int values [OBJECTS_COUNT];
+	bool snapshots;
+	volatile int stopping;
+	volatile long long changes;
+
+}	BenchState;
+
+/*
+ * Description : Writer : changes an object then publishes a snapshot, or only changes it under the lock
+ * void *argument : The BenchState
+ * Return : void * NULL
+ */
+static void *
+bench_writer (
+	void *argument
+) {
+	BenchState *state = argument;
+	unsigned int seed = (unsigned int) (size_t) &seed;
+
+	while (!__atomic_load_n (&state->stopping, __ATOMIC_RELAXED))
+	{
+		D3D9Lock_acquire_exclusive (&state->lock);
+
+		state->values [rand_r (&seed) % OBJECTS_COUNT] = rand_r (&seed);
+
+		if (state->snapshots) {
+			BenchSnapshot *snapshot;
+
+			if (!(snapshot = (BenchSnapshot *) D3D9SnapshotExchange_get_spare (&state->exchange, OBJECTS_COUNT))) {
+				snapshot = malloc (sizeof(BenchSnapshot) + sizeof(int) * OBJECTS_COUNT);
+				snapshot->snapshot.capacity = OBJECTS_COUNT;
+			}
+
+			snapshot->values = (int *) (snapshot + 1);
+			snapshot->count  = OBJECTS_COUNT;
+
+			for (int index = 0; index < OBJECTS_COUNT; index++) {
+				snapshot->values [index] = state->values [index];
+			}
+
+			D3D9SnapshotExchange_publish (&state->exchange, &snapshot->snapshot);
+		}
+
+		D3D9Lock_release_exclusive (&state->lock);
+		__sync_fetch_and_add (&state->changes, 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * Description : Compare two latencies
+ * const void *a, *b : Two doubles
+ * Return : int lower, equal or greater than 0
+ */
+static int
+compare_latencies (
+	const void *a,
+	const void *b
+) {
+	double latencyA = *(const double *) a;
+	double latencyB = *(const double *) b;
+
+	return (latencyA > latencyB) - (latencyA < latencyB);
+}
+
+/*
+ * Description : Run the frame loop against some writers and print its latency percentiles
+ * int writersCount : Number of writer threads
+ * bool snapshots : true to read the snapshots published, false to walk the list under the shared lock
+ * Return : void
+ */
+static void
+measure (
+	int writersCount,
+	bool snapshots
+) {
+	BenchState *state = calloc (1, sizeof(BenchState));
+	double *latencies = malloc (sizeof(double) * FRAMES_COUNT);
+	pthread_t writers [8];
+	long long sum = 0;
+
+	D3D9SnapshotExchange_init (&state->exchange, 0);
+	D3D9Lock_init (&state->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+	state->snapshots = snapshots;
+
+	for (int index = 0; index < writersCount; index++) {
+		pthread_create (&writers [index], NULL, bench_writer, state);
+	}
+
+	// The frames start once every writer is changing the objects
+	while (__sync_fetch_and_add (&state->changes, 0) < writersCount) {
+		usleep (FRAME_INTERVAL);
+	}
+
+	for (int frame = 0; frame < FRAMES_COUNT; frame++)
+	{
+		usleep (FRAME_INTERVAL);
+
+		double start = D3D9Test_now ();
+
+		if (snapshots) {
+			BenchSnapshot *snapshot = (BenchSnapshot *) D3D9SnapshotExchange_acquire (&state->exchange);
+
+			for (int index = 0; snapshot && index < snapshot->count; index++) {
+				sum += snapshot->values [index];
+			}
+
+			D3D9SnapshotExchange_release (&state->exchange);
+		}
+		else {
+			D3D9Lock_acquire_shared (&state->lock);
+
+			for (int index = 0; index < OBJECTS_COUNT; index++) {
+				sum += state->values [index];
+			}
+
+			D3D9Lock_release_shared (&state->lock);
+		}
+
+		latencies [frame] = D3D9Test_now () - start;
+	}
+
+	state->stopping = 1;
+
+	for (int index = 0; index < writersCount; index++) {
+		pthread_join (writers [index], NULL);
+	}
+
+	qsort (latencies, FRAMES_COUNT, sizeof(double), compare_latencies);
+
+	walked = sum;
+
+	printf ("%-9s | %7d | %8.1f | %8.1f | %8.1f | %10lld\n",
+		snapshots ? "snapshot" : "lock", writersCount,
+		latencies [FRAMES_COUNT / 2] / 1000, latencies [FRAMES_COUNT * 99 / 100] / 1000, latencies [FRAMES_COUNT - 1] / 1000,
+		state->changes);
+
+	D3D9SnapshotExchange_destroy (&state->exchange);
+	D3D9Lock_destroy (&state->lock);
+	free (latencies);
+	free (state);
+}
+
+int
+main (
+	void
+) {
+	printf ("%d objects, %d frames\n", OBJECTS_COUNT, FRAMES_COUNT);
+	printf ("Frame     | Writers | p50 (us) | p99 (us) | max (us) | Changes\n");
+
+	for (int index = 0; index < (int) (sizeof(writersCounts) / sizeof(*writersCounts)); index++) {
+		measure (writersCounts [index], false);
+		measure (writersCounts [index], true);
+	}
+
+	return 0;
+}
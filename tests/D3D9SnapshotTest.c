@@ -0,0 +1,351 @@
+#include "D3D9Test.h"
+#include "D3D9Snapshot.h"
+#include "D3D9Lock.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// Objects of the stress test
+#define STRESS_WRITERS  4
+#define STRESS_OBJECTS  256
+#define STRESS_CHANGES  20000
+
+#define OBJECT_ALIVE 0xA11FEu
+#define OBJECT_DEAD  0xDEADu
+
+// Object referenced by the snapshots, never freed before the end of a test so a use after reclaim is seen
+typedef struct _TestObject
+{
+	unsigned int magic;
+	int value;
+	struct _TestObject *nextRemoved;
+	struct _TestObject *nextAllocated;
+
+}	TestObject;
+
+// Snapshot of the tests : the objects and a copy of their value, with a checksum of the rows
+typedef struct
+{
+	D3D9Snapshot snapshot;
+	int count;
+	long long checksum;
+	TestObject **objects;
+	int *values;
+
+}	TestSnapshot;
+
+// Blocks allocated by the writers, instead of reused
+static int snapshotsAllocated = 0;
+
+/*
+ * Description : Get a block for a snapshot of some rows, reused if possible
+ * D3D9SnapshotExchange *exchange : The exchange of the test
+ * int count : Number of rows
+ * Return : TestSnapshot * an empty snapshot
+ */
+static TestSnapshot *
+test_snapshot_get (
+	D3D9SnapshotExchange *exchange,
+	int count
+) {
+	TestSnapshot *snapshot;
+	int capacity = (count > 16) ? count * 2 : 16;
+
+	if (!(snapshot = (TestSnapshot *) D3D9SnapshotExchange_get_spare (exchange, count))) {
+		snapshotsAllocated++;
+		snapshot = malloc (sizeof(TestSnapshot) + (sizeof(TestObject *) + sizeof(int)) * capacity);
+		snapshot->snapshot.capacity = capacity;
+	}
+
+	capacity = snapshot->snapshot.capacity;
+	snapshot->objects  = (TestObject **) (snapshot + 1);
+	snapshot->values   = (int *) (snapshot->objects + capacity);
+	snapshot->count    = 0;
+	snapshot->checksum = 0;
+
+	return snapshot;
+}
+
+/*
+ * Description : Publish the objects alive as a new snapshot
+ * D3D9SnapshotExchange *exchange : The exchange of the test
+ * TestObject **objects : The objects alive
+ * int count : Number of objects
+ * Return : TestSnapshot * the snapshot published
+ */
+static TestSnapshot *
+test_snapshot_publish (
+	D3D9SnapshotExchange *exchange,
+	TestObject **objects,
+	int count
+) {
+	TestSnapshot *snapshot = test_snapshot_get (exchange, count);
+
+	for (int index = 0; index < count; index++) {
+		snapshot->objects [index] = objects [index];
+		snapshot->values [index]  = objects [index]->value;
+		snapshot->checksum       += objects [index]->value;
+	}
+
+	snapshot->count = count;
+	D3D9SnapshotExchange_publish (exchange, &snapshot->snapshot);
+
+	return snapshot;
+}
+
+/*
+ * Description : The reader gets the last snapshot published, and the objects removed once it released the snapshots referencing them
+ */
+static void
+test_publish (
+	void
+) {
+	D3D9SnapshotExchange *exchange = D3D9SnapshotExchange_new (offsetof (TestObject, nextRemoved));
+	TestObject objects [3] = {{OBJECT_ALIVE, 1, NULL, NULL}, {OBJECT_ALIVE, 2, NULL, NULL}, {OBJECT_ALIVE, 3, NULL, NULL}};
+	TestObject *alive [3] = {&objects [0], &objects [1], &objects [2]};
+	TestSnapshot *first, *second;
+	D3D9SnapshotStats stats;
+
+	check (exchange != NULL);
+	check (D3D9SnapshotExchange_acquire (exchange) == NULL);
+	check (D3D9SnapshotExchange_release (exchange) == NULL);
+
+	first = test_snapshot_publish (exchange, alive, 3);
+	check (D3D9SnapshotExchange_acquire (exchange) == &first->snapshot);
+
+	// Removed while the reader reads a snapshot referencing it : not given back before the reader releases it
+	D3D9SnapshotExchange_remove (exchange, &objects [1]);
+	alive [1] = &objects [2];
+	second = test_snapshot_publish (exchange, alive, 2);
+	check (second != first);
+	check (second->snapshot.serial > first->snapshot.serial);
+	check (first->count == 3 && first->objects [1] == &objects [1]);
+
+	check (D3D9SnapshotExchange_release (exchange) == &objects [1]);
+	check (objects [1].nextRemoved == NULL);
+	check (D3D9SnapshotExchange_release (exchange) == NULL);
+
+	// Removed but not published yet : the snapshot published still references it
+	D3D9SnapshotExchange_remove (exchange, &objects [0]);
+	check (D3D9SnapshotExchange_acquire (exchange) == &second->snapshot);
+	check (D3D9SnapshotExchange_release (exchange) == NULL);
+
+	D3D9SnapshotExchange_get_stats (exchange, &stats);
+	check (stats.publications == 2);
+	check (stats.removed == 2 && stats.reclaimed == 1);
+
+	D3D9SnapshotExchange_free (exchange);
+}
+
+/*
+ * Description : The writers reuse the blocks replaced, except the one the reader reads
+ */
+static void
+test_reuse (
+	void
+) {
+	D3D9SnapshotExchange exchange = D3D9_SNAPSHOT_EXCHANGE_INITIALIZER (TestObject, nextRemoved);
+	TestObject object = {OBJECT_ALIVE, 1, NULL, NULL};
+	TestObject *alive [1] = {&object};
+	TestSnapshot *read, *snapshots [8];
+	D3D9SnapshotStats stats;
+
+	read = test_snapshot_publish (&exchange, alive, 1);
+	check (D3D9SnapshotExchange_acquire (&exchange) == &read->snapshot);
+
+	// While the first one is read, the writers build the next ones in the same two other blocks
+	for (int index = 0; index < 8; index++) {
+		snapshots [index] = test_snapshot_publish (&exchange, alive, 1);
+		check (snapshots [index] != read);
+		check (read->count == 1 && read->objects [0] == &object);
+
+		if (index >= 2) {
+			check (snapshots [index] == snapshots [index - 2]);
+		}
+	}
+
+	D3D9SnapshotExchange_release (&exchange);
+
+	// Once released, the block read is reused too
+	check (test_snapshot_publish (&exchange, alive, 1) == read);
+
+	// A block too small for the new rows is freed and replaced
+	check (D3D9SnapshotExchange_get_spare (&exchange, 1000) == NULL);
+	check (exchange.sparesCount == 0);
+
+	D3D9SnapshotExchange_get_stats (&exchange, &stats);
+	check (stats.publications == 10);
+	check (stats.reuses == 7);
+
+	D3D9SnapshotExchange_destroy (&exchange);
+}
+
+// State shared by the writers and the reader of the stress test
+typedef struct
+{
+	D3D9SnapshotExchange exchange;
+	D3D9Lock lock;
+	TestObject *alive [STRESS_OBJECTS];
+	int aliveCount;
+	// Every object allocated, freed at the end
+	TestObject *allocated;
+	volatile int writersRunning;
+	// Checks failed by the reader
+	volatile int errors;
+	long long frames;
+	long long reclaimed;
+
+}	StressState;
+
+/*
+ * Description : Writer of the stress test : creates, removes and changes objects, and publishes each change
+ * void *argument : The StressState
+ * Return : void * NULL
+ */
+static void *
+stress_writer (
+	void *argument
+) {
+	StressState *state = argument;
+	unsigned int seed = (unsigned int) (size_t) &seed;
+
+	for (int change = 0; change < STRESS_CHANGES; change++)
+	{
+		D3D9Lock_acquire_exclusive (&state->lock);
+
+		int index = rand_r (&seed) % STRESS_OBJECTS;
+
+		if (index < state->aliveCount && rand_r (&seed) % 2) {
+			// Remove an object : the last one takes its place
+			D3D9SnapshotExchange_remove (&state->exchange, state->alive [index]);
+			state->alive [index] = state->alive [--state->aliveCount];
+		}
+		else if (state->aliveCount < STRESS_OBJECTS) {
+			TestObject *object = malloc (sizeof(TestObject));
+
+			object->magic = OBJECT_ALIVE;
+			object->value = rand_r (&seed);
+			object->nextRemoved = NULL;
+			object->nextAllocated = state->allocated;
+			state->allocated = object;
+			state->alive [state->aliveCount++] = object;
+		}
+
+		test_snapshot_publish (&state->exchange, state->alive, state->aliveCount);
+
+		D3D9Lock_release_exclusive (&state->lock);
+	}
+
+	__sync_fetch_and_sub (&state->writersRunning, 1);
+
+	return NULL;
+}
+
+/*
+ * Description : Frame of the stress test : checks every row of the snapshot, then kills the objects reclaimed
+ * StressState *state : The state of the test
+ * Return : void
+ */
+static void
+stress_frame (
+	StressState *state
+) {
+	TestSnapshot *snapshot = (TestSnapshot *) D3D9SnapshotExchange_acquire (&state->exchange);
+	TestObject *object;
+
+	if (snapshot) {
+		long long checksum = 0;
+
+		for (int index = 0; index < snapshot->count; index++) {
+			// An object referenced by the snapshot read is never reclaimed, and the rows never change while read
+			if (snapshot->objects [index]->magic != OBJECT_ALIVE
+			||  snapshot->objects [index]->value != snapshot->values [index]) {
+				state->errors++;
+			}
+
+			checksum += snapshot->values [index];
+		}
+
+		if (checksum != snapshot->checksum) {
+			state->errors++;
+		}
+	}
+
+	object = D3D9SnapshotExchange_release (&state->exchange);
+
+	while (object) {
+		if (object->magic != OBJECT_ALIVE) {
+			state->errors++;
+		}
+
+		object->magic = OBJECT_DEAD;
+		state->reclaimed++;
+		object = object->nextRemoved;
+	}
+
+	state->frames++;
+}
+
+/*
+ * Description : Many writers publish while a frame loop reads the snapshots without lock
+ */
+static void
+test_stress (
+	void
+) {
+	StressState *state = calloc (1, sizeof(StressState));
+	pthread_t writers [STRESS_WRITERS];
+	D3D9SnapshotStats stats;
+
+	snapshotsAllocated = 0;
+
+	D3D9SnapshotExchange_init (&state->exchange, offsetof (TestObject, nextRemoved));
+	D3D9Lock_init (&state->lock, D3D9_LOCK_DEFAULT_SPIN_COUNT);
+	state->writersRunning = STRESS_WRITERS;
+
+	for (int index = 0; index < STRESS_WRITERS; index++) {
+		pthread_create (&writers [index], NULL, stress_writer, state);
+	}
+
+	while (__sync_fetch_and_add (&state->writersRunning, 0)) {
+		stress_frame (state);
+	}
+
+	for (int index = 0; index < STRESS_WRITERS; index++) {
+		pthread_join (writers [index], NULL);
+	}
+
+	// Every object removed comes back once published and released
+	test_snapshot_publish (&state->exchange, state->alive, state->aliveCount);
+	stress_frame (state);
+
+	D3D9SnapshotExchange_get_stats (&state->exchange, &stats);
+	check (state->errors == 0);
+	check (state->frames > 1);
+	check (stats.publications == STRESS_WRITERS * STRESS_CHANGES + 1);
+	check (stats.removed == state->reclaimed && stats.reclaimed == state->reclaimed);
+
+	// The blocks are reused : one is allocated when the draw list grows, or when the reader kept the spare one
+	check (stats.reuses + snapshotsAllocated == stats.publications);
+	check (snapshotsAllocated <= state->frames + 32);
+
+	while (state->allocated) {
+		TestObject *next = state->allocated->nextAllocated;
+		free (state->allocated);
+		state->allocated = next;
+	}
+
+	D3D9SnapshotExchange_destroy (&state->exchange);
+	D3D9Lock_destroy (&state->lock);
+	free (state);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_publish);
+	run_test (test_reuse);
+	run_test (test_stress);
+
+	return test_result ();
+}
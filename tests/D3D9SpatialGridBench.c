@@ -0,0 +1,152 @@
+#include "D3D9Test.h"
+#include "D3D9SpatialGrid.h"
+#include <stdlib.h>
+
+// Hit tests and visible rectangles among 50k objects of 8 to 72 pixels spread over the grid, and moves of the objects,
+// with the grid and with the linear scan of every object it replaced.
+
+#define OBJECTS_COUNT    50000
+#define OPERATIONS_COUNT 20000
+// Side of the area covered by the objects, in pixels
+#define AREA_SIZE (D3D9_SPATIAL_GRID_DEFAULT_CELL_SIZE * D3D9_SPATIAL_GRID_DEFAULT_COLUMNS)
+// Size of the rectangles queried, a screen
+#define QUERY_W 800
+#define QUERY_H 600
+
+typedef struct
+{
+	int x, y, w, h;
+
+}	BenchRect;
+
+// Sum of the objects found, so the queries aren't optimized out
+static volatile long long found;
+
+/*
+ * Description : Count the objects containing a point with a linear scan
+ * BenchRect *objects : The objects
+ * int x, int y : The point
+ * Return : int the number of objects found
+ */
+static int
+linear_query_point (
+	BenchRect *objects,
+	int x, int y
+) {
+	int count = 0;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		BenchRect *object = &objects [index];
+		count += (x >= object->x && x < object->x + object->w && y >= object->y && y < object->y + object->h);
+	}
+
+	return count;
+}
+
+/*
+ * Description : Count the objects intersecting a rectangle with a linear scan
+ * BenchRect *objects : The objects
+ * int x, int y, int w, int h : The rectangle
+ * Return : int the number of objects found
+ */
+static int
+linear_query_rect (
+	BenchRect *objects,
+	int x, int y, int w, int h
+) {
+	int count = 0;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		BenchRect *object = &objects [index];
+		count += (object->x < x + w && x < object->x + object->w && object->y < y + h && y < object->y + object->h);
+	}
+
+	return count;
+}
+
+/*
+ * Description : Place an object at random
+ * BenchRect *object : The object
+ * unsigned int *seed : Seed of rand_r
+ * Return : void
+ */
+static void
+random_rect (
+	BenchRect *object,
+	unsigned int *seed
+) {
+	object->x = rand_r (seed) % AREA_SIZE;
+	object->y = rand_r (seed) % AREA_SIZE;
+	object->w = rand_r (seed) % 64 + 8;
+	object->h = rand_r (seed) % 64 + 8;
+}
+
+int
+main (
+	void
+) {
+	BenchRect *objects = malloc (sizeof(BenchRect) * OBJECTS_COUNT);
+	D3D9SpatialGrid *grid = D3D9SpatialGrid_new (D3D9_SPATIAL_GRID_DEFAULT_CELL_SIZE, D3D9_SPATIAL_GRID_DEFAULT_COLUMNS, D3D9_SPATIAL_GRID_DEFAULT_ROWS);
+	int *handles = malloc (sizeof(int) * OBJECTS_COUNT);
+	double gridPoint, gridRect, gridMove, linearPoint, linearRect, start;
+	unsigned int seed = 42;
+	long long sum = 0;
+
+	for (int index = 0; index < OBJECTS_COUNT; index++) {
+		random_rect (&objects [index], &seed);
+		D3D9SpatialGrid_update (grid, index, objects [index].x, objects [index].y, objects [index].w, objects [index].h);
+	}
+
+	// Hit test of the mouse
+	seed = 1;
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		sum += D3D9SpatialGrid_query_point (grid, rand_r (&seed) % AREA_SIZE, rand_r (&seed) % AREA_SIZE, handles, OBJECTS_COUNT);
+	}
+	gridPoint = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	seed = 1;
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT / 100; i++) {
+		sum -= linear_query_point (objects, rand_r (&seed) % AREA_SIZE, rand_r (&seed) % AREA_SIZE);
+	}
+	linearPoint = (D3D9Test_now () - start) / (OPERATIONS_COUNT / 100);
+
+	// Objects visible on a screen
+	seed = 2;
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT / 100; i++) {
+		sum += D3D9SpatialGrid_query_rect (grid, rand_r (&seed) % AREA_SIZE, rand_r (&seed) % AREA_SIZE, QUERY_W, QUERY_H, handles, OBJECTS_COUNT);
+	}
+	gridRect = (D3D9Test_now () - start) / (OPERATIONS_COUNT / 100);
+
+	seed = 2;
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT / 100; i++) {
+		sum -= linear_query_rect (objects, rand_r (&seed) % AREA_SIZE, rand_r (&seed) % AREA_SIZE, QUERY_W, QUERY_H);
+	}
+	linearRect = (D3D9Test_now () - start) / (OPERATIONS_COUNT / 100);
+
+	// Move of an object : the linear list has nothing to update
+	start = D3D9Test_now ();
+	for (int i = 0; i < OPERATIONS_COUNT; i++) {
+		int index = rand_r (&seed) % OBJECTS_COUNT;
+		random_rect (&objects [index], &seed);
+		D3D9SpatialGrid_update (grid, index, objects [index].x, objects [index].y, objects [index].w, objects [index].h);
+	}
+	gridMove = (D3D9Test_now () - start) / OPERATIONS_COUNT;
+
+	found = sum;
+
+	printf ("%d objects over %dx%d pixels, %dx%d queried (ns per operation)\n", OBJECTS_COUNT, AREA_SIZE, AREA_SIZE, QUERY_W, QUERY_H);
+	printf ("Query | Grid       | Linear     | Speedup\n");
+	printf ("point | %10.1f | %10.1f | %6.1fx\n", gridPoint, linearPoint, linearPoint / gridPoint);
+	printf ("rect  | %10.1f | %10.1f | %6.1fx\n", gridRect, linearRect, linearRect / gridRect);
+	printf ("move  | %10.1f |          - |       -\n", gridMove);
+
+	D3D9SpatialGrid_free (grid);
+	free (handles);
+	free (objects);
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+#include "D3D9Test.h"
+#include "D3D9SpatialGrid.h"
+#include <stdlib.h>
+
+// Grid of the tests : 16 cells of 64 pixels in each direction
+#define GRID_CELL_SIZE 64
+#define GRID_CELLS     16
+
+// Items of the random test
+#define ITEMS_COUNT 500
+
+/*
+ * Description : Count a handle in a list of handles
+ * int *handles : The handles found by a query
+ * int count : Number of handles
+ * int handle : The handle looked for
+ * Return : int the number of times the handle is in the list
+ */
+static int
+count_handle (
+	int *handles,
+	int count,
+	int handle
+) {
+	int found = 0;
+
+	for (int index = 0; index < count; index++) {
+		if (handles [index] == handle) {
+			found++;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * Description : A point finds the items containing it, a rectangle the items intersecting it, each once
+ */
+static void
+test_query (
+	void
+) {
+	D3D9SpatialGrid *grid = D3D9SpatialGrid_new (GRID_CELL_SIZE, GRID_CELLS, GRID_CELLS);
+	int handles [8];
+
+	check (grid != NULL);
+
+	// 1 inside one cell, 2 over 3x3 cells, 3 on the edge of 1
+	check (D3D9SpatialGrid_update (grid, 1, 10, 10, 20, 20));
+	check (D3D9SpatialGrid_update (grid, 2, 32, 32, 150, 150));
+	check (D3D9SpatialGrid_update (grid, 3, 30, 10, 10, 10));
+
+	check (D3D9SpatialGrid_query_point (grid, 15, 15, handles, 8) == 1 && handles [0] == 1);
+	check (D3D9SpatialGrid_query_point (grid, 30, 15, handles, 8) == 1 && handles [0] == 3);
+	check (D3D9SpatialGrid_query_point (grid, 100, 100, handles, 8) == 1 && handles [0] == 2);
+	check (D3D9SpatialGrid_query_point (grid, 500, 500, handles, 8) == 0);
+
+	// The item 2 covers every cell of the query, it is reported once
+	int found = D3D9SpatialGrid_query_rect (grid, 0, 0, 200, 200, handles, 8);
+	check (found == 3);
+	check (count_handle (handles, found, 1) == 1 && count_handle (handles, found, 2) == 1 && count_handle (handles, found, 3) == 1);
+
+	// The handles beyond the capacity are counted but not written
+	check (D3D9SpatialGrid_query_rect (grid, 0, 0, 200, 200, handles, 1) == 3);
+
+	// Sharing a cell isn't intersecting
+	check (D3D9SpatialGrid_query_rect (grid, 40, 0, 10, 10, handles, 8) == 0);
+	check (D3D9SpatialGrid_query_rect (grid, 0, 0, 0, 10, handles, 8) == 0);
+
+	D3D9SpatialGrid_free (grid);
+}
+
+/*
+ * Description : Moving an item leaves the cells it doesn't cover anymore, empty bounds and remove take it out
+ */
+static void
+test_update_remove (
+	void
+) {
+	D3D9SpatialGrid *grid = D3D9SpatialGrid_new (GRID_CELL_SIZE, GRID_CELLS, GRID_CELLS);
+	int handles [8];
+
+	check (D3D9SpatialGrid_update (grid, 5, 0, 0, 100, 100));
+	check (D3D9SpatialGrid_update (grid, 5, 300, 300, 10, 10));
+
+	check (D3D9SpatialGrid_query_point (grid, 50, 50, handles, 8) == 0);
+	check (D3D9SpatialGrid_query_rect (grid, 0, 0, 128, 128, handles, 8) == 0);
+	check (D3D9SpatialGrid_query_point (grid, 305, 305, handles, 8) == 1 && handles [0] == 5);
+
+	for (int index = 0; index < GRID_CELLS * GRID_CELLS; index++) {
+		check (grid->cells [index].count == ((index == (300 / GRID_CELL_SIZE) * GRID_CELLS + 300 / GRID_CELL_SIZE) ? 1 : 0));
+	}
+
+	// Empty bounds remove the item, removing it twice or an unknown handle does nothing
+	check (D3D9SpatialGrid_update (grid, 5, 300, 300, 0, 10));
+	check (D3D9SpatialGrid_query_point (grid, 305, 305, handles, 8) == 0);
+	check (!grid->items [5].inserted);
+
+	check (D3D9SpatialGrid_update (grid, 5, 300, 300, 10, 10));
+	D3D9SpatialGrid_remove (grid, 5);
+	D3D9SpatialGrid_remove (grid, 5);
+	D3D9SpatialGrid_remove (grid, 1000);
+	check (D3D9SpatialGrid_query_point (grid, 305, 305, handles, 8) == 0);
+
+	D3D9SpatialGrid_free (grid);
+}
+
+/*
+ * Description : Bounds outside of the grid are clamped to its edge cells, and still found
+ */
+static void
+test_clamp (
+	void
+) {
+	D3D9SpatialGrid *grid = D3D9SpatialGrid_new (GRID_CELL_SIZE, GRID_CELLS, GRID_CELLS);
+	int limit = GRID_CELL_SIZE * GRID_CELLS;
+	int handles [8];
+
+	check (D3D9SpatialGrid_update (grid, 1, -50, -50, 20, 20));
+	check (D3D9SpatialGrid_update (grid, 2, limit + 100, limit + 100, 20, 20));
+
+	check (D3D9SpatialGrid_query_point (grid, -40, -40, handles, 8) == 1 && handles [0] == 1);
+	check (D3D9SpatialGrid_query_point (grid, 0, 0, handles, 8) == 0);
+	check (D3D9SpatialGrid_query_rect (grid, limit + 90, limit + 90, 20, 20, handles, 8) == 1 && handles [0] == 2);
+	check (grid->cells [0].count == 1 && grid->cells [GRID_CELLS * GRID_CELLS - 1].count == 1);
+
+	D3D9SpatialGrid_free (grid);
+}
+
+/*
+ * Description : Random items moved and queried give the same results as a linear scan of their bounds
+ */
+static void
+test_random (
+	void
+) {
+	D3D9SpatialGrid *grid = D3D9SpatialGrid_new (GRID_CELL_SIZE, GRID_CELLS, GRID_CELLS);
+	int bounds [ITEMS_COUNT][4] = {{0}};
+	int handles [ITEMS_COUNT];
+	unsigned int seed = 42;
+	int limit = GRID_CELL_SIZE * GRID_CELLS;
+
+	for (int round = 0; round < 2000; round++)
+	{
+		int handle = rand_r (&seed) % ITEMS_COUNT;
+		int *item = bounds [handle];
+
+		// A tenth of the updates remove the item
+		item [0] = rand_r (&seed) % (limit + 200) - 100;
+		item [1] = rand_r (&seed) % (limit + 200) - 100;
+		item [2] = (rand_r (&seed) % 10) ? rand_r (&seed) % 200 + 1 : 0;
+		item [3] = rand_r (&seed) % 200 + 1;
+		check (D3D9SpatialGrid_update (grid, handle, item [0], item [1], item [2], item [3]));
+
+		int x = rand_r (&seed) % limit, y = rand_r (&seed) % limit;
+		int w = rand_r (&seed) % 300 + 1, h = rand_r (&seed) % 300 + 1;
+		int found = D3D9SpatialGrid_query_rect (grid, x, y, w, h, handles, ITEMS_COUNT);
+		int expected = 0;
+
+		for (int index = 0; index < ITEMS_COUNT; index++)
+		{
+			int *other = bounds [index];
+			bool intersects = other [2] > 0 && other [0] < x + w && x < other [0] + other [2] && other [1] < y + h && y < other [1] + other [3];
+
+			if (count_handle (handles, found, index) != (intersects ? 1 : 0)) {
+				check (false);
+				break;
+			}
+
+			expected += intersects;
+		}
+
+		check (found == expected);
+	}
+
+	D3D9SpatialGrid_free (grid);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_query);
+	run_test (test_update_remove);
+	run_test (test_clamp);
+	run_test (test_random);
+
+	return test_result ();
+}
@@ -0,0 +1,231 @@
+#include "D3D9Test.h"
+#include "D3D9SpriteBatch.h"
+
+// The batch is tested against a mock ID3DXSprite : its vftable counts the Begin, Draw and End calls,
+// and records the textures drawn. D3D9SpriteBatch only builds on Windows : this test is built by "make d3d".
+
+// Methods of ID3DXSprite used by the batch, by index in its vftable
+#define MOCK_SPRITE_Begin         8
+#define MOCK_SPRITE_Draw          9
+#define MOCK_SPRITE_End           11
+#define MOCK_SPRITE_VFTABLE_SIZE  14
+
+// Sprites drawn by the tests
+#define MOCK_DRAWS_MAX 64
+
+// Sprite of the tests, the ID3DXSprite first so the methods find it back
+typedef struct
+{
+	ID3DXSprite sprite;
+	int begins, ends, draws;
+	bool begun;
+	// Calls made outside of a Begin and an End
+	int misplaced;
+	// Textures and positions of the sprites drawn, in the order of the Draw calls
+	IDirect3DTexture9 *textures [MOCK_DRAWS_MAX];
+	int x [MOCK_DRAWS_MAX];
+
+}	MockSprite;
+
+static void *mockVftable [MOCK_SPRITE_VFTABLE_SIZE];
+
+/*
+ * Description : Methods of the mock sprite
+ */
+static HRESULT __stdcall
+mock_Begin (
+	ID3DXSprite *sprite,
+	DWORD flags
+) {
+	MockSprite *mock = (MockSprite *) sprite;
+
+	(void) flags;
+	mock->misplaced += mock->begun;
+	mock->begun = true;
+	mock->begins++;
+	return D3D_OK;
+}
+
+static HRESULT __stdcall
+mock_Draw (
+	ID3DXSprite *sprite,
+	IDirect3DTexture9 *texture,
+	const RECT *source,
+	const D3DXVECTOR3 *center,
+	const D3DXVECTOR3 *position,
+	D3DCOLOR color
+) {
+	MockSprite *mock = (MockSprite *) sprite;
+
+	(void) source;
+	(void) center;
+	(void) color;
+	mock->misplaced += !mock->begun;
+
+	if (mock->draws < MOCK_DRAWS_MAX) {
+		mock->textures [mock->draws] = texture;
+		mock->x [mock->draws] = (int) position->x;
+	}
+
+	mock->draws++;
+	return D3D_OK;
+}
+
+static HRESULT __stdcall
+mock_End (
+	ID3DXSprite *sprite
+) {
+	MockSprite *mock = (MockSprite *) sprite;
+
+	mock->misplaced += !mock->begun;
+	mock->begun = false;
+	mock->ends++;
+	return D3D_OK;
+}
+
+/*
+ * Description : Method of the vftable that the batch never calls
+ */
+static void
+mock_unused (
+	void
+) {
+	check (false);
+}
+
+/*
+ * Description : Initialize a mock sprite
+ * MockSprite *this : The sprite to initialize
+ * Return : ID3DXSprite * the sprite
+ */
+static ID3DXSprite *
+mock_sprite_init (
+	MockSprite *this
+) {
+	for (int index = 0; index < MOCK_SPRITE_VFTABLE_SIZE; index++) {
+		mockVftable [index] = (void *) mock_unused;
+	}
+
+	mockVftable [MOCK_SPRITE_Begin] = (void *) mock_Begin;
+	mockVftable [MOCK_SPRITE_Draw]  = (void *) mock_Draw;
+	mockVftable [MOCK_SPRITE_End]   = (void *) mock_End;
+
+	memset (this, 0, sizeof(MockSprite));
+	this->sprite.lpVtbl = (ID3DXSpriteVtbl *) mockVftable;
+
+	return &this->sprite;
+}
+
+/*
+ * Description : Count the runs of consecutive Draw calls sharing a texture
+ * MockSprite *mock : The mock sprite drawn
+ * Return : int the number of runs
+ */
+static int
+mock_texture_runs (
+	MockSprite *mock
+) {
+	int runs = 0;
+
+	for (int index = 0; index < mock->draws && index < MOCK_DRAWS_MAX; index++) {
+		if (index == 0 || mock->textures [index] != mock->textures [index - 1]) {
+			runs++;
+		}
+	}
+
+	return runs;
+}
+
+/*
+ * Description : Sprites with interleaved textures are drawn in one Begin / End, one run of Draw calls per texture,
+ *               each run in the order the sprites were added
+ */
+static void
+test_one_batch_per_texture (
+	void
+) {
+	D3D9SpriteBatch batch = D3D9_SPRITE_BATCH_INITIALIZER;
+	IDirect3DTexture9 textures [3];
+	MockSprite mock;
+	ID3DXSprite *sprite = mock_sprite_init (&mock);
+
+	D3D9SpriteBatch_begin (&batch, sprite, 12);
+	check (mock.begins == 1 && mock.draws == 0);
+
+	for (int index = 0; index < 12; index++) {
+		D3D9SpriteBatch_add (&batch, &textures [index % 3], NULL, index, 0, D3DCOLOR_ARGB (255, 255, 255, 255));
+	}
+
+	// Nothing is drawn before the end of the batch
+	check (mock.draws == 0);
+
+	D3D9SpriteBatch_end (&batch);
+
+	check (mock.begins == 1 && mock.ends == 1 && mock.draws == 12);
+	check (mock.misplaced == 0);
+	check (mock_texture_runs (&mock) == 3);
+	check (batch.textureChanges == 3 && batch.draws == 12);
+
+	for (int index = 1; index < 12; index++) {
+		if (mock.textures [index] == mock.textures [index - 1]) {
+			check (mock.x [index] > mock.x [index - 1]);
+		}
+	}
+
+	D3D9SpriteBatch_destroy (&batch);
+}
+
+/*
+ * Description : Each batch begins and ends the sprite once, resets its counters and reuses its sort buffer
+ */
+static void
+test_batches (
+	void
+) {
+	D3D9SpriteBatch *batch = D3D9SpriteBatch_new ();
+	IDirect3DTexture9 texture;
+	D3D9SpriteBatchItem *items = NULL;
+	MockSprite mock;
+	ID3DXSprite *sprite = mock_sprite_init (&mock);
+
+	check (batch != NULL);
+
+	// An empty batch still begins and ends
+	D3D9SpriteBatch_begin (batch, sprite, 0);
+	D3D9SpriteBatch_end (batch);
+	check (mock.begins == 1 && mock.ends == 1 && mock.draws == 0);
+	check (batch->textureChanges == 0 && batch->draws == 0);
+
+	for (int frame = 0; frame < 3; frame++) {
+		D3D9SpriteBatch_begin (batch, sprite, 4);
+
+		for (int index = 0; index < 4; index++) {
+			D3D9SpriteBatch_add (batch, &texture, NULL, index, 0, 0);
+		}
+
+		D3D9SpriteBatch_end (batch);
+
+		check (batch->textureChanges == 1 && batch->draws == 4);
+		check (batch->sprite == NULL && batch->itemsCount == 0);
+
+		if (frame == 0) {
+			items = batch->items;
+		}
+		check (batch->items == items && batch->itemsCapacity == D3D9_SPRITE_BATCH_MIN_CAPACITY);
+	}
+
+	check (mock.begins == 4 && mock.ends == 4 && mock.draws == 12);
+	check (mock.misplaced == 0);
+
+	D3D9SpriteBatch_free (batch);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_one_batch_per_texture);
+	run_test (test_batches);
+
+	return test_result ();
+}
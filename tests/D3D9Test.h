@@ -0,0 +1,44 @@
+// --- Author : Moreau Cyril - Spl3en
+#pragma once
+
+// Minimal harness of the unit tests : each test file is a program returning the number of failed checks.
+
+// ---------- Includes ------------
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+// ---------- Defines -------------
+// Number of checks failed by the current program
+static int d3d9TestFailures __attribute__((unused)) = 0;
+
+// Report a failed check without stopping the test
+#define check(condition) do {                                                    \
+	if (!(condition)) {                                                          \
+		fprintf (stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #condition); \
+		d3d9TestFailures++;                                                      \
+	}                                                                            \
+} while (0)
+
+// Run a test function and report its name
+#define run_test(test) do {                          \
+	int failuresBefore = d3d9TestFailures;           \
+	test ();                                         \
+	printf ("%s %s\n", (d3d9TestFailures == failuresBefore) ? "[ OK ]" : "[FAIL]", #test); \
+} while (0)
+
+// Exit status of a test program
+#define test_result() ((d3d9TestFailures == 0) ? 0 : 1)
+
+/*
+ * Description : Read the monotonic clock, for the benchmarks
+ * Return : double the current time in nanoseconds
+ */
+static inline double
+D3D9Test_now (
+	void
+) {
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
@@ -0,0 +1,86 @@
+#include "D3D9Test.h"
+#include "D3D9TextBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Throughput of the text changes : D3D9TextBuffer_set against the strdup / free of each change it replaced,
+// and D3D9ObjectText_set giving the same string again, skipped by D3D9TextBuffer_equals.
+
+#define SETS_COUNT 2000000
+
+static int lengths [] = {8, 31, 64, 256};
+
+// Sum of the first characters, so the copies aren't optimized out
+static volatile long long copied;
+
+/*
+ * Description : Measure the changes of a string between two strings of the same length
+ * int length : Length of the strings
+ * Return : void
+ */
+static void
+measure (
+	int length
+) {
+	char *strings [2] = {malloc (length + 1), malloc (length + 1)};
+	D3D9TextBuffer buffer;
+	char *duplicate = NULL;
+	double start, setTime, strdupTime, sameTime;
+	long long sum = 0;
+
+	for (int index = 0; index < 2; index++) {
+		memset (strings [index], 'a' + index, length);
+		strings [index][length] = '\0';
+	}
+
+	D3D9TextBuffer_init (&buffer);
+
+	start = D3D9Test_now ();
+	for (int set = 0; set < SETS_COUNT; set++) {
+		D3D9TextBuffer_set (&buffer, strings [set & 1]);
+		sum += buffer.data [0];
+	}
+	setTime = D3D9Test_now () - start;
+
+	start = D3D9Test_now ();
+	for (int set = 0; set < SETS_COUNT; set++) {
+		free (duplicate);
+		duplicate = strdup (strings [set & 1]);
+		sum += duplicate [0];
+	}
+	strdupTime = D3D9Test_now () - start;
+
+	start = D3D9Test_now ();
+	for (int set = 0; set < SETS_COUNT; set++) {
+		if (!D3D9TextBuffer_equals (&buffer, strings [1])) {
+			D3D9TextBuffer_set (&buffer, strings [1]);
+		}
+		sum += buffer.data [0];
+	}
+	sameTime = D3D9Test_now () - start;
+
+	copied = sum;
+
+	printf ("%6d | %8.1f | %11.1f | %9.1f | %9.1f\n",
+		length, setTime / SETS_COUNT, strdupTime / SETS_COUNT, sameTime / SETS_COUNT,
+		SETS_COUNT / (setTime / 1e9) / 1e6);
+
+	D3D9TextBuffer_reset (&buffer);
+	free (duplicate);
+	free (strings [0]);
+	free (strings [1]);
+}
+
+int
+main (
+	void
+) {
+	printf ("%d changes per length\n", SETS_COUNT);
+	printf ("Length | set (ns) | strdup (ns) | same (ns) | set (M/s)\n");
+
+	for (int index = 0; index < (int) (sizeof(lengths) / sizeof(*lengths)); index++) {
+		measure (lengths [index]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include "D3D9Test.h"
+#include "D3D9TextBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The heap blocks of the buffers are counted by wrapping realloc and free at link time (-Wl,--wrap),
+// so a block allocated and never released is seen by the tests.
+
+// Blocks allocated and not freed yet, and calls to realloc
+static int blocksAlive = 0;
+static int reallocs = 0;
+
+void *__real_realloc (void *data, size_t size);
+void __real_free (void *data);
+
+/*
+ * Description : Count the blocks allocated by D3D9TextBuffer
+ */
+void *
+__wrap_realloc (
+	void *data,
+	size_t size
+) {
+	void *block = __real_realloc (data, size);
+
+	if (block && !data) {
+		blocksAlive++;
+	}
+
+	reallocs++;
+	return block;
+}
+
+void
+__wrap_free (
+	void *data
+) {
+	if (data) {
+		blocksAlive--;
+	}
+
+	__real_free (data);
+}
+
+/*
+ * Description : Fill a string with a character
+ * char *string : The string to fill, of length + 1 bytes at least
+ * int length : Length of the string
+ * Return : char * the string
+ */
+static char *
+test_string (
+	char *string,
+	int length
+) {
+	memset (string, 'a' + length % 26, length);
+	string [length] = '\0';
+
+	return string;
+}
+
+/*
+ * Description : The short strings are stored inline, without allocation
+ */
+static void
+test_inline (
+	void
+) {
+	D3D9TextBuffer buffer;
+	char string [D3D9_TEXT_BUFFER_INLINE_SIZE];
+
+	reallocs = 0;
+
+	D3D9TextBuffer_init (&buffer);
+	check (buffer.length == 0 && buffer.data [0] == '\0');
+
+	check (D3D9TextBuffer_set (&buffer, "Hello"));
+	check (buffer.data == buffer.inlineData && buffer.length == 5);
+	check (D3D9TextBuffer_equals (&buffer, "Hello"));
+	check (!D3D9TextBuffer_equals (&buffer, "Hello world"));
+
+	check (D3D9TextBuffer_set (&buffer, test_string (string, D3D9_TEXT_BUFFER_INLINE_SIZE - 1)));
+	check (buffer.data == buffer.inlineData && buffer.length == D3D9_TEXT_BUFFER_INLINE_SIZE - 1);
+	check (reallocs == 0);
+
+	D3D9TextBuffer_reset (&buffer);
+	check (blocksAlive == 0);
+}
+
+/*
+ * Description : The heap block grows geometrically and is kept for the shorter strings
+ */
+static void
+test_heap (
+	void
+) {
+	D3D9TextBuffer buffer;
+	char string [1024];
+
+	reallocs = 0;
+	D3D9TextBuffer_init (&buffer);
+
+	// A string growing char by char reallocates a logarithmic number of times
+	for (int length = 0; length < (int) sizeof(string); length++) {
+		check (D3D9TextBuffer_set (&buffer, test_string (string, length)));
+		check (buffer.length == length && strcmp (buffer.data, string) == 0);
+	}
+
+	check (reallocs <= 8);
+	check (blocksAlive == 1);
+
+	// Shorter strings reuse the block, or the inline storage
+	reallocs = 0;
+	check (D3D9TextBuffer_set (&buffer, test_string (string, 100)));
+	check (buffer.data == buffer.heapData);
+	check (D3D9TextBuffer_set (&buffer, "short"));
+	check (buffer.data == buffer.inlineData && buffer.heapData != NULL);
+	check (reallocs == 0);
+
+	D3D9TextBuffer_reset (&buffer);
+	check (blocksAlive == 0 && buffer.heapData == NULL && buffer.length == 0);
+}
+
+/*
+ * Description : Many buffers changed many times release all their blocks when reset
+ */
+static void
+test_leaks (
+	void
+) {
+	D3D9TextBuffer buffers [64];
+	char string [512];
+	unsigned int seed = 1;
+
+	for (int index = 0; index < 64; index++) {
+		D3D9TextBuffer_init (&buffers [index]);
+	}
+
+	for (int change = 0; change < 100000; change++) {
+		D3D9TextBuffer *buffer = &buffers [rand_r (&seed) % 64];
+
+		check (D3D9TextBuffer_set (buffer, test_string (string, rand_r (&seed) % (int) sizeof(string))));
+	}
+
+	// One block per buffer at most, whatever the number of changes
+	check (blocksAlive <= 64);
+
+	for (int index = 0; index < 64; index++) {
+		D3D9TextBuffer_reset (&buffers [index]);
+		// A buffer reset can be used and reset again
+		check (D3D9TextBuffer_set (&buffers [index], test_string (string, 100)));
+		D3D9TextBuffer_reset (&buffers [index]);
+	}
+
+	check (blocksAlive == 0);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_inline);
+	run_test (test_heap);
+	run_test (test_leaks);
+
+	return test_result ();
+}
@@ -0,0 +1,254 @@
+#include "D3D9Test.h"
+#include "D3D9TextureCache.h"
+
+// The cache is tested against mock textures : their vftable counts the references, and the atlas
+// counts the regions removed. D3D9TextureCache only builds on Windows : this test is built by "make d3d".
+
+// Methods of IDirect3DTexture9 used by the cache, by index in its vftable
+#define MOCK_TEXTURE_AddRef        1
+#define MOCK_TEXTURE_Release       2
+#define MOCK_TEXTURE_GetLevelCount 13
+#define MOCK_TEXTURE_GetLevelDesc  17
+#define MOCK_TEXTURE_VFTABLE_SIZE  22
+
+// Bytes of a mock texture of 64x64 pixels
+#define MOCK_TEXTURE_BYTES (64 * 64 * 4)
+
+// Texture of the tests, the IDirect3DTexture9 first so the methods find it back
+typedef struct
+{
+	IDirect3DTexture9 texture;
+	int references;
+	UINT w, h;
+
+}	MockTexture;
+
+static void *mockVftable [MOCK_TEXTURE_VFTABLE_SIZE];
+
+// Regions removed from the atlas by the cache
+static int regionsRemoved = 0;
+
+/*
+ * Description : Methods of the mock textures
+ */
+static ULONG __stdcall
+mock_AddRef (
+	IDirect3DTexture9 *texture
+) {
+	return ++((MockTexture *) texture)->references;
+}
+
+static ULONG __stdcall
+mock_Release (
+	IDirect3DTexture9 *texture
+) {
+	return --((MockTexture *) texture)->references;
+}
+
+static DWORD __stdcall
+mock_GetLevelCount (
+	IDirect3DTexture9 *texture
+) {
+	(void) texture;
+	return 1;
+}
+
+static HRESULT __stdcall
+mock_GetLevelDesc (
+	IDirect3DTexture9 *texture,
+	UINT level,
+	D3DSURFACE_DESC *desc
+) {
+	(void) level;
+	memset (desc, 0, sizeof(D3DSURFACE_DESC));
+	desc->Width  = ((MockTexture *) texture)->w;
+	desc->Height = ((MockTexture *) texture)->h;
+	return D3D_OK;
+}
+
+/*
+ * Description : Method of the vftable that the cache never calls
+ */
+static void
+mock_unused (
+	void
+) {
+	check (false);
+}
+
+/*
+ * Description : Replace D3D9Atlas_remove, so the atlas doesn't need a device
+ * D3D9Atlas *this : The atlas of the region
+ * D3D9AtlasRegion *region : The region removed
+ * Return : void
+ */
+void
+D3D9Atlas_remove (
+	D3D9Atlas *this,
+	D3D9AtlasRegion *region
+) {
+	(void) this;
+	(void) region;
+	regionsRemoved++;
+}
+
+/*
+ * Description : Initialize a mock texture of 64x64 pixels, referenced once
+ * MockTexture *this : The texture to initialize
+ * Return : IDirect3DTexture9 * the texture
+ */
+static IDirect3DTexture9 *
+mock_texture_init (
+	MockTexture *this
+) {
+	for (int index = 0; index < MOCK_TEXTURE_VFTABLE_SIZE; index++) {
+		mockVftable [index] = (void *) mock_unused;
+	}
+
+	mockVftable [MOCK_TEXTURE_AddRef]        = (void *) mock_AddRef;
+	mockVftable [MOCK_TEXTURE_Release]       = (void *) mock_Release;
+	mockVftable [MOCK_TEXTURE_GetLevelCount] = (void *) mock_GetLevelCount;
+	mockVftable [MOCK_TEXTURE_GetLevelDesc]  = (void *) mock_GetLevelDesc;
+
+	this->texture.lpVtbl = (IDirect3DTexture9Vtbl *) mockVftable;
+	this->references = 1;
+	this->w = 64;
+	this->h = 64;
+
+	return &this->texture;
+}
+
+/*
+ * Description : The hits, misses, entries and bytes count the lookups and the textures cached
+ */
+static void
+test_stats (
+	void
+) {
+	D3D9TextureCache *cache = D3D9TextureCache_new (MOCK_TEXTURE_BYTES * 4);
+	D3D9TextureCacheEntry *entry, *shared;
+	D3D9TextureCacheStats stats;
+	MockTexture texture;
+
+	check (D3D9TextureCache_acquire (cache, "a.png", 1) == NULL);
+
+	entry = D3D9TextureCache_insert (cache, "a.png", 1, mock_texture_init (&texture));
+	check (entry != NULL && entry->w == 64 && entry->h == 64 && entry->bytes == MOCK_TEXTURE_BYTES);
+
+	// Another version of the same file is another texture
+	shared = D3D9TextureCache_acquire (cache, "a.png", 1);
+	check (shared == entry);
+	check (D3D9TextureCache_acquire (cache, "a.png", 2) == NULL);
+
+	D3D9TextureCache_get_stats (cache, &stats);
+	check (stats.hits == 1 && stats.misses == 2);
+	check (stats.entries == 1 && stats.bytes == MOCK_TEXTURE_BYTES);
+	check (stats.evictions == 0);
+
+	// Unreferenced within the budget : kept
+	D3D9TextureCache_release (cache, entry);
+	D3D9TextureCache_release (cache, shared);
+	check (D3D9TextureCache_drain (cache) == 0);
+	check (texture.references == 1);
+
+	D3D9TextureCache_free (cache);
+	check (texture.references == 0);
+}
+
+/*
+ * Description : The least recently released texture is evicted first, an entry acquired again leaves the unused entries
+ */
+static void
+test_lru (
+	void
+) {
+	D3D9TextureCache *cache = D3D9TextureCache_new (MOCK_TEXTURE_BYTES * 3);
+	char *paths [4] = {"a.png", "b.png", "c.png", "d.png"};
+	D3D9TextureCacheEntry *entries [4];
+	MockTexture textures [4];
+	D3D9TextureCacheStats stats;
+
+	for (int index = 0; index < 3; index++) {
+		entries [index] = D3D9TextureCache_insert (cache, paths [index], 1, mock_texture_init (&textures [index]));
+	}
+
+	// Released in the order b, a, c, then a is used again : b then c are the oldest ones
+	D3D9TextureCache_release (cache, entries [1]);
+	D3D9TextureCache_release (cache, entries [0]);
+	D3D9TextureCache_release (cache, entries [2]);
+	check (D3D9TextureCache_acquire (cache, "a.png", 1) == entries [0]);
+	check (cache->lruFirst == entries [1] && cache->lruLast == entries [2]);
+	D3D9TextureCache_release (cache, entries [0]);
+	check (cache->lruLast == entries [0]);
+
+	entries [3] = D3D9TextureCache_insert (cache, paths [3], 1, mock_texture_init (&textures [3]));
+
+	D3D9TextureCache_get_stats (cache, &stats);
+	check (stats.evictions == 1 && stats.entries == 3);
+	check (D3D9TextureCache_acquire (cache, "b.png", 1) == NULL);
+	check (cache->lruFirst == entries [2]);
+
+	// The texture evicted is released only by the drain
+	check (textures [1].references == 1);
+	check (D3D9TextureCache_drain (cache) == 1);
+	check (textures [1].references == 0);
+	check (textures [0].references == 1 && textures [2].references == 1 && textures [3].references == 1);
+
+	D3D9TextureCache_release (cache, entries [3]);
+	D3D9TextureCache_free (cache);
+}
+
+/*
+ * Description : A smaller budget and the last release of an entry only queue the evictions, released by the drain
+ */
+static void
+test_deferred_release (
+	void
+) {
+	D3D9TextureCache *cache = D3D9TextureCache_new (MOCK_TEXTURE_BYTES * 8);
+	D3D9AtlasPage page = {.texture = NULL};
+	D3D9AtlasRegion region = {.page = &page, .rect = {0, 0, 16, 16}};
+	D3D9TextureCacheEntry *entries [4];
+	MockTexture textures [4], pageTexture;
+	D3D9TextureCacheStats stats;
+
+	page.texture = mock_texture_init (&pageTexture);
+	regionsRemoved = 0;
+
+	for (int index = 0; index < 3; index++) {
+		char path [16];
+		snprintf (path, sizeof(path), "%d.png", index);
+		entries [index] = D3D9TextureCache_insert (cache, path, 1, mock_texture_init (&textures [index]));
+		D3D9TextureCache_release (cache, entries [index]);
+	}
+
+	// The region keeps its own reference on the page
+	entries [3] = D3D9TextureCache_insert_region (cache, "region.png", 1, NULL, &region);
+	check (entries [3] != NULL && entries [3]->w == 16 && entries [3]->h == 16);
+	check (pageTexture.references == 2);
+
+	D3D9TextureCache_set_budget (cache, 0);
+	D3D9TextureCache_release (cache, entries [3]);
+
+	D3D9TextureCache_get_stats (cache, &stats);
+	check (stats.evictions == 4 && stats.entries == 0 && stats.bytes == 0);
+	check (textures [0].references == 1 && pageTexture.references == 2 && regionsRemoved == 0);
+
+	check (D3D9TextureCache_drain (cache) == 4);
+	check (textures [0].references == 0 && textures [1].references == 0 && textures [2].references == 0);
+	check (pageTexture.references == 1 && regionsRemoved == 1);
+	check (D3D9TextureCache_drain (cache) == 0);
+
+	D3D9TextureCache_free (cache);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_stats);
+	run_test (test_lru);
+	run_test (test_deferred_release);
+
+	return test_result ();
+}
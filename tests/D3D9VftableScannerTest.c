@@ -0,0 +1,326 @@
+#include "D3D9Test.h"
+#include "D3D9VftableScanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Synthetic PE32 image : .text, .rdata and .reloc, or .rdata merged into .text
+#define IMAGE_SIZE        0x6000
+#define IMAGE_BASE        0x10000000
+#define TEXT_START        0x1000
+#define RDATA_START       0x3000
+#define RELOC_START       0x5000
+#define SECTION_TABLE     0x178
+
+// Layout of the code
+#define CONSTRUCTOR       0x2800
+#define JUMP_TABLE        0x2900
+#define JUMP_TABLE_COUNT  6
+
+// Layout of the data
+#define LOCATOR           0x3000
+#define VFTABLE           0x3104
+#define VFTABLE_COUNT     16
+#define UNRELOCATED       0x3400
+#define UNRELOCATED_COUNT 12
+#define SHORT_ARRAY       0x3600
+#define SHORT_ARRAY_COUNT 3
+
+#define MIN_COUNT         10
+#define MAX_COUNT         20
+
+static unsigned char image [IMAGE_SIZE];
+static unsigned int relocations [256];
+static int relocationsCount;
+
+/*
+ * Description : Write a 16 or 32 bits little endian value in the image
+ */
+static void
+write_value (
+	size_t offset,
+	unsigned int value,
+	int bytes
+) {
+	for (int index = 0; index < bytes; index++) {
+		image [offset + index] = value >> (index * 8);
+	}
+}
+
+/*
+ * Description : Write an address of the image, fixed by the loader
+ * size_t offset : Where the address is written
+ * size_t target : Offset of the address, relative to the base
+ */
+static void
+write_pointer (
+	size_t offset,
+	size_t target
+) {
+	write_value (offset, IMAGE_BASE + target, 4);
+	relocations [relocationsCount++] = offset;
+}
+
+/*
+ * Description : Write a section header
+ */
+static void
+write_section (
+	int index,
+	char *name,
+	unsigned int start,
+	unsigned int size,
+	unsigned int characteristics
+) {
+	size_t section = SECTION_TABLE + index * 40;
+
+	memcpy (&image [section], name, strlen (name));
+	write_value (section + 8, size, 4);
+	write_value (section + 12, start, 4);
+	write_value (section + 16, size, 4);
+	write_value (section + 20, start, 4);
+	write_value (section + 36, characteristics, 4);
+}
+
+/*
+ * Description : Build the image : a class with a vftable stored by its constructor, a switch jump table,
+ *               an array of code addresses without relocations, and a vftable too short to be accepted
+ * bool merged : true to merge .rdata into .text, as linked with /MERGE:.rdata=.text
+ */
+static void
+build_image (
+	bool merged
+) {
+	memset (image, 0, sizeof(image));
+	relocationsCount = 0;
+
+	// Headers
+	image [0] = 'M';
+	image [1] = 'Z';
+	write_value (0x3C, 0x80, 4);
+	memcpy (&image [0x80], "PE\0\0", 4);
+	write_value (0x84, 0x14C, 2);
+	write_value (0x84 + 2, merged ? 2 : 3, 2);
+	write_value (0x84 + 16, 0xE0, 2);
+	write_value (0x98, 0x10B, 2);
+	write_value (0x98 + 92, 16, 4);
+	write_value (0x98 + 96 + 5 * 8, RELOC_START, 4);
+
+	if (merged) {
+		write_section (0, ".text", TEXT_START, RELOC_START - TEXT_START, 0x60000020);
+		write_section (1, ".reloc", RELOC_START, IMAGE_SIZE - RELOC_START, 0x42000040);
+	} else {
+		write_section (0, ".text", TEXT_START, RDATA_START - TEXT_START, 0x60000020);
+		write_section (1, ".rdata", RDATA_START, RELOC_START - RDATA_START, 0x40000040);
+		write_section (2, ".reloc", RELOC_START, IMAGE_SIZE - RELOC_START, 0x42000040);
+	}
+
+	// Code : int3 padding between the methods
+	memset (&image [TEXT_START], 0xCC, RDATA_START - TEXT_START);
+	for (int index = 0; index < 64; index++) {
+		image [TEXT_START + index * 0x10] = 0x55;
+		image [TEXT_START + index * 0x10 + 1] = 0xC3;
+	}
+
+	// mov dword ptr [esi], offset vftable
+	image [CONSTRUCTOR] = 0xC7;
+	image [CONSTRUCTOR + 1] = 0x06;
+	write_pointer (CONSTRUCTOR + 2, VFTABLE);
+
+	// jmp dword ptr [eax * 4 + jumpTable], then the table
+	image [CONSTRUCTOR + 0x10] = 0xFF;
+	image [CONSTRUCTOR + 0x11] = 0x24;
+	image [CONSTRUCTOR + 0x12] = 0x85;
+	write_pointer (CONSTRUCTOR + 0x13, JUMP_TABLE);
+	for (int index = 0; index < JUMP_TABLE_COUNT; index++) {
+		write_pointer (JUMP_TABLE + index * 4, CONSTRUCTOR + 0x20 + index * 2);
+	}
+
+	// The RTTI locator, pointed to right before the vftable
+	write_pointer (VFTABLE - 4, LOCATOR);
+	for (int index = 0; index < VFTABLE_COUNT; index++) {
+		write_pointer (VFTABLE + index * 4, TEXT_START + index * 0x10);
+	}
+
+	// Addresses of code that aren't relocated : constants looking like a vftable
+	for (int index = 0; index < UNRELOCATED_COUNT; index++) {
+		write_value (UNRELOCATED + index * 4, IMAGE_BASE + TEXT_START + 0x200 + index * 0x10, 4);
+	}
+
+	for (int index = 0; index < SHORT_ARRAY_COUNT; index++) {
+		write_pointer (SHORT_ARRAY + index * 4, TEXT_START + 0x300 + index * 0x10);
+	}
+
+	// Relocations : a block per page, entries of type HIGHLOW, in the order written
+	size_t block = RELOC_START;
+	for (int first = 0; first < relocationsCount;) {
+		unsigned int page = relocations [first] & ~0xFFF;
+		size_t entry = block + 8;
+		int last;
+
+		for (last = first; last < relocationsCount && (relocations [last] & ~0xFFF) == page; last++) {
+			write_value (entry, (3 << 12) | (relocations [last] & 0xFFF), 2);
+			entry += 2;
+		}
+
+		write_value (block, page, 4);
+		write_value (block + 4, entry - block, 4);
+		block = entry;
+		first = last;
+	}
+
+	write_value (0x98 + 96 + 5 * 8 + 4, block - RELOC_START, 4);
+}
+
+/*
+ * Description : Only the 32 bits PE images are accepted
+ */
+static void
+test_headers (
+	void
+) {
+	D3D9VftableScanner *scanner;
+
+	build_image (false);
+	check ((scanner = D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE)) != NULL);
+	check (scanner->sectionsCount == 3);
+	check (scanner->relocationsCount == relocationsCount);
+	D3D9VftableScanner_free (scanner);
+
+	// PE32+
+	write_value (0x98, 0x20B, 2);
+	check (D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE) == NULL);
+
+	image [0] = 'X';
+	check (D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE) == NULL);
+	check (D3D9VftableScanner_new (image, 16, IMAGE_BASE) == NULL);
+}
+
+/*
+ * Description : The code pointers and the arrays of them are recognized
+ */
+static void
+test_pointers (
+	void
+) {
+	D3D9VftableScanner *scanner;
+
+	build_image (false);
+	check ((scanner = D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE)) != NULL);
+
+	check (D3D9VftableScanner_is_code_pointer (scanner, IMAGE_BASE + TEXT_START));
+	check (!D3D9VftableScanner_is_code_pointer (scanner, IMAGE_BASE + LOCATOR));
+	check (!D3D9VftableScanner_is_code_pointer (scanner, IMAGE_BASE - 4));
+	check (!D3D9VftableScanner_is_code_pointer (scanner, IMAGE_BASE + IMAGE_SIZE));
+
+	check (D3D9VftableScanner_is_array (scanner, IMAGE_BASE + VFTABLE, VFTABLE_COUNT));
+	check (!D3D9VftableScanner_is_array (scanner, IMAGE_BASE + VFTABLE, VFTABLE_COUNT + 1));
+	check (!D3D9VftableScanner_is_array (scanner, IMAGE_BASE + VFTABLE - 4, VFTABLE_COUNT));
+	check (!D3D9VftableScanner_is_array (scanner, IMAGE_BASE + IMAGE_SIZE - 4, 2));
+
+	D3D9VftableScanner_free (scanner);
+}
+
+/*
+ * Description : Check the candidates of a heuristic contain the vftable, chosen at its exact offset and size
+ * D3D9VftableCandidate *candidates : Arrays found
+ * int count : Number of arrays found
+ * int expected : Number of arrays expected
+ */
+static void
+check_vftable (
+	D3D9VftableCandidate *candidates,
+	int count,
+	int expected
+) {
+	int chosen;
+
+	check (count == expected);
+	check ((chosen = D3D9VftableScanner_choose (candidates, count)) != -1);
+
+	if (chosen != -1) {
+		check (candidates [chosen].offset == VFTABLE);
+		check (candidates [chosen].count == VFTABLE_COUNT);
+		check (candidates [chosen].references == 1);
+	}
+}
+
+/*
+ * Description : Both heuristics find the vftable in .rdata, and not the jump table of the code
+ */
+static void
+test_data_sections (
+	void
+) {
+	D3D9VftableCandidate candidates [8];
+	D3D9VftableScanner *scanner;
+
+	build_image (false);
+	check ((scanner = D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE)) != NULL);
+
+	// The constants aren't relocated : only the heuristic reading the data finds them
+	check_vftable (candidates, D3D9VftableScanner_find_arrays (scanner, MIN_COUNT, MAX_COUNT, candidates, 8), 2);
+	check_vftable (candidates, D3D9VftableScanner_find_relocated_arrays (scanner, MIN_COUNT, MAX_COUNT, candidates, 8), 1);
+
+	// Shorter arrays, but never the jump table when the data sections have arrays
+	check (D3D9VftableScanner_find_relocated_arrays (scanner, 1, MAX_COUNT, candidates, 8) == 2);
+	check (candidates [1].offset == SHORT_ARRAY && candidates [1].count == SHORT_ARRAY_COUNT);
+
+	// More arrays than the capacity are counted
+	check (D3D9VftableScanner_find_arrays (scanner, 1, MAX_COUNT, candidates, 1) == 3);
+
+	D3D9VftableScanner_free (scanner);
+}
+
+/*
+ * Description : With .rdata merged into .text, both heuristics still find the vftable, without the RTTI locator before it
+ */
+static void
+test_merged_sections (
+	void
+) {
+	D3D9VftableCandidate candidates [8];
+	D3D9VftableScanner *scanner;
+
+	build_image (true);
+	check ((scanner = D3D9VftableScanner_new (image, IMAGE_SIZE, IMAGE_BASE)) != NULL);
+	check (scanner->sectionsCount == 2);
+
+	check_vftable (candidates, D3D9VftableScanner_find_arrays (scanner, MIN_COUNT, MAX_COUNT, candidates, 8), 2);
+	check_vftable (candidates, D3D9VftableScanner_find_relocated_arrays (scanner, MIN_COUNT, MAX_COUNT, candidates, 8), 1);
+
+	D3D9VftableScanner_free (scanner);
+}
+
+/*
+ * Description : The chosen candidate is the only one, or the only one referenced
+ */
+static void
+test_choose (
+	void
+) {
+	D3D9VftableCandidate candidates [3] = {
+		{.offset = 0x10, .count = 10, .references = 0},
+		{.offset = 0x20, .count = 10, .references = 2},
+		{.offset = 0x30, .count = 10, .references = 0},
+	};
+
+	check (D3D9VftableScanner_choose (candidates, 0) == -1);
+	check (D3D9VftableScanner_choose (&candidates [2], 1) == 0);
+	check (D3D9VftableScanner_choose (candidates, 3) == 1);
+
+	candidates [2].references = 1;
+	check (D3D9VftableScanner_choose (candidates, 3) == -1);
+}
+
+int
+main (
+	void
+) {
+	run_test (test_headers);
+	run_test (test_pointers);
+	run_test (test_data_sections);
+	run_test (test_merged_sections);
+	run_test (test_choose);
+
+	return test_result ();
+}